@@ -1,5 +1,6 @@
 #include "perfmon/pfmlib.h"
 #include "perfmon/perf_event.h"
+#include "perfmon/pfmlib_perf_event.h"
 #include "mock_pfm.h"
 
 #include <stdarg.h>
@@ -7,6 +8,7 @@
 #include <errno.h>
 
 #define BASE_FAKE_FD 65000
+#define MAX_FAKE_FDS 8192
 
 int pfm_initialise_retval = 0;
 int pfm_get_os_event_encoding_retvals[RETURN_VALUES_COUNT];
@@ -17,6 +19,9 @@ int wrap_ioctl_retval = 0;
 int wrap_malloc_fail = 0;
 int wrap_sysconf_override = 0;
 int wrap_sysconf_retcode = -1;
+int pfm_get_os_event_encoding_type = PERF_TYPE_HARDWARE;
+int n_fake_fd_reads = 0;
+static int group_members[MAX_FAKE_FDS];
 
 void init_mock()
 {
@@ -29,6 +34,9 @@ void init_mock()
     wrap_malloc_fail = 0;
     wrap_sysconf_override = 0;
     wrap_sysconf_retcode = -1;
+    pfm_get_os_event_encoding_type = PERF_TYPE_HARDWARE;
+    n_fake_fd_reads = 0;
+    memset(group_members, 0, sizeof group_members);
 }
 
 /* Mock implementations of pfm library functions to allow unit testing */
@@ -41,6 +49,11 @@ pfm_err_t pfm_get_os_event_encoding(const char *str, int dfl_plm, pfm_os_t os, v
 {
     pfm_err_t ret = pfm_get_os_event_encoding_retvals[n_get_os_event_encoding_calls];
     n_get_os_event_encoding_calls = (n_get_os_event_encoding_calls + 1) % RETURN_VALUES_COUNT;
+    if(ret == PFM_SUCCESS && os == PFM_OS_PERF_EVENT_EXT)
+    {
+        pfm_perf_encode_arg_t *arg = args;
+        arg->attr->type = pfm_get_os_event_encoding_type;
+    }
     return ret;
 }
 
@@ -57,7 +70,21 @@ long int __wrap_syscall(long int sysno, ...)
             return -1;
         }
         else
+        {
+            va_list ap;
+            int group_fd;
+
+            /* perf_event_open(attr, pid, cpu, group_fd, flags) */
+            va_start(ap, sysno);
+            (void)va_arg(ap, struct perf_event_attr *);
+            (void)va_arg(ap, int);
+            (void)va_arg(ap, int);
+            group_fd = va_arg(ap, int);
+            va_end(ap);
+            if(group_fd >= BASE_FAKE_FD && group_fd < BASE_FAKE_FD + MAX_FAKE_FDS)
+                group_members[group_fd - BASE_FAKE_FD]++;
             return fake_fd++;
+        }
     }
     else
     {
@@ -111,6 +138,10 @@ ssize_t __wrap_read(int fd, void *buf, size_t count)
     if(fd >= BASE_FAKE_FD)
     {
         memset(buf, 0, count);
+        /* PERF_FORMAT_GROUP read of a leader: the number of counters first */
+        if(fd < BASE_FAKE_FD + MAX_FAKE_FDS && group_members[fd - BASE_FAKE_FD])
+            *(uint64_t *)buf = group_members[fd - BASE_FAKE_FD] + 1;
+        ++n_fake_fd_reads;
         return count;
     }
 
@@ -12,5 +12,7 @@ extern int wrap_ioctl_retval;
 extern int wrap_malloc_fail;
 extern int wrap_sysconf_override;
 extern int wrap_sysconf_retcode;
+extern int pfm_get_os_event_encoding_type;
+extern int n_fake_fd_reads;
 
 #endif /* MOCK_PFM_H_ */
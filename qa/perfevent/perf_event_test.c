@@ -223,6 +223,68 @@ void test_node_rr()
     perf_counter_destroy(data, size, pdata, derivedsize);
 }
 
+void test_grouped_reads()
+{
+    printf( " ===== %s ==== \n", __FUNCTION__) ;
+
+    setenv("SYSFS_MOUNT_POINT", "./fakefs/sysrr", 1);
+    wrap_sysconf_override = 1;
+    wrap_sysconf_retcode = 32;
+
+    const char *configfile = "config/test_node_rr.txt";
+
+    /* Software counters are grouped per cpu, each group read at once */
+    pfm_get_os_event_encoding_type = PERF_TYPE_SOFTWARE;
+    perfhandle_t *h = perf_event_create(configfile);
+    assert( h != NULL );
+
+    perf_counter *data = NULL;
+    int size = 0;
+    perf_derived_counter *pdata = NULL;
+    int derivedsize = 0;
+
+    n_fake_fd_reads = 0;
+    int count = perf_get(h, &data, &size, &pdata, &derivedsize);
+
+    assert(count == (3 * 32 + 4 * 4) );
+    assert(size == (3 + 4) );
+    printf("%d software counters, %d reads\n", count, n_fake_fd_reads);
+    assert(n_fake_fd_reads == 32);
+
+    int i;
+    for(i = 0; i < 4; ++i)
+    {
+        assert( data[i].ninstances == 4 );
+        assert( data[i].data[0].id == (0 + i) );
+        assert( data[i].data[3].id == (24+ i) );
+    }
+
+    perf_event_destroy(h);
+    perf_counter_destroy(data, size, pdata, derivedsize);
+
+    /* Hardware counters are not grouped beyond the pmu counter limit,
+     * which for this pmu (two generic counters) means not at all */
+    pfm_get_os_event_encoding_type = PERF_TYPE_HARDWARE;
+    h = perf_event_create(configfile);
+    assert( h != NULL );
+
+    data = NULL;
+    size = 0;
+    pdata = NULL;
+    derivedsize = 0;
+
+    n_fake_fd_reads = 0;
+    count = perf_get(h, &data, &size, &pdata, &derivedsize);
+
+    assert(count == (3 * 32 + 4 * 4) );
+    printf("%d hardware counters, %d reads\n", count, n_fake_fd_reads);
+    assert(n_fake_fd_reads == count);
+
+    perf_event_destroy(h);
+    perf_counter_destroy(data, size, pdata, derivedsize);
+    wrap_sysconf_override = 0;
+}
+
 void test_missing_pmu_config()
 {
     printf( " ===== %s ==== \n", __FUNCTION__) ;
@@ -1200,6 +1262,9 @@ int runtest(int n)
         case 33:
             test_parse_raw_events();
             break;
+        case 34:
+            test_grouped_reads();
+            break;
         default:
             ret = -1;
     }
@@ -0,0 +1,201 @@
+//
+// Test archive window prefetching in QmcGroup
+// Values fetched through the background window cache are compared with
+// those from direct interpolated fetches, repositioning for every sample
+// as pmchart does, stepping forwards past the window, and backwards.
+//
+
+#include <math.h>
+#include <QTextStream>
+#include <QStringList>
+#include <qmc_context.h>
+#include <qmc_group.h>
+#include <qmc_metric.h>
+
+QTextStream cerr(stderr);
+QTextStream cout(stdout);
+
+static QList<QmcMetric *> metrics[2];	// [0] direct, [1] prefetched
+static int verbose;
+
+static int
+setup(QmcGroup &group, int which, QStringList &archives, char **names, int count)
+{
+    int sts;
+
+    for (int a = 0; a < archives.size(); a++) {
+	if ((sts = group.use(PM_CONTEXT_ARCHIVE, archives[a])) < 0) {
+	    pmflush();
+	    cerr << "use(" << archives[a] << "): " << pmErrStr(sts) << endl;
+	    return sts;
+	}
+	for (int i = 0; i < count; i++) {
+	    QmcMetric *metric = group.addMetric(names[i], 0.0);
+	    if (metric->status() < 0) {
+		pmflush();
+		cerr << "addMetric(" << names[i] << "): "
+		     << pmErrStr(metric->status()) << endl;
+		return metric->status();
+	    }
+	    metrics[which].append(metric);
+	}
+    }
+    pmflush();
+    return 0;
+}
+
+// Compare the values from the most recent fetch, returning mismatches
+static int
+compare(int sample)
+{
+    int mismatches = 0;
+
+    for (int i = 0; i < metrics[0].size(); i++) {
+	QmcMetric *m0 = metrics[0][i];
+	QmcMetric *m1 = metrics[1][i];
+
+	if (m0->numValues() != m1->numValues()) {
+	    cout << "sample " << sample << ": " << m0->name() << ": "
+		 << m0->numValues() << " != " << m1->numValues()
+		 << " values" << endl;
+	    mismatches++;
+	    continue;
+	}
+	for (int j = 0; j < m0->numValues(); j++) {
+	    int e0 = m0->error(j), e1 = m1->error(j);
+	    double v0 = m0->value(j), v1 = m1->value(j);
+
+	    if (verbose)
+		cerr << "sample " << sample << ": " << m0->name() << "[" << j
+		     << "] " << v0 << " (" << e0 << ") " << v1 << " ("
+		     << e1 << ")" << endl;
+	    if (e0 != e1 ||
+		(e0 >= 0 && fabs(v0 - v1) > 1e-9 * (fabs(v0) + 1.0))) {
+		cout << "sample " << sample << ": " << m0->name() << "[" << j
+		     << "]: " << v0 << " (" << pmErrStr(e0) << ") != " << v1
+		     << " (" << pmErrStr(e1) << ")" << endl;
+		mismatches++;
+	    }
+	}
+    }
+    return mismatches;
+}
+
+static void
+position(QmcGroup &group, double when, int delta)
+{
+    struct timeval tv;
+
+    pmtimevalFromReal(when, &tv);
+    group.setArchiveMode(PM_MODE_INTERP | PM_XTB_SET(PM_TIME_SEC), &tv, delta);
+}
+
+int
+main(int argc, char* argv[])
+{
+    int		sts = 0;
+    int		c, i, n;
+    int		samples = 20;
+    int		delta = 10;
+    int		mismatches;
+    QStringList	archives;
+    double	start, when;
+
+    pmSetProgname(argv[0]);
+
+    while ((c = getopt(argc, argv, "a:D:s:t:v?")) != EOF) {
+	switch (c) {
+	case 'a':
+	    archives.append(optarg);
+	    break;
+	case 'D':
+	    sts = pmSetDebug(optarg);
+            if (sts < 0) {
+		pmprintf("%s: unrecognized debug options specification (%s)\n",
+			 pmGetProgname(), optarg);
+                sts = 1;
+            }
+            break;
+	case 's':
+	    samples = atoi(optarg);
+	    break;
+	case 't':
+	    delta = atoi(optarg);
+	    break;
+	case 'v':
+	    verbose++;
+	    break;
+	case '?':
+	default:
+	    sts = 1;
+	    break;
+	}
+    }
+
+    if (sts || archives.size() == 0 || optind == argc ||
+	samples < 1 || delta < 1) {
+	pmprintf("Usage: %s [-D debug] [-s samples] [-t delta] -a archive "
+		 "[-a archive ...] metric ...\n", pmGetProgname());
+	pmflush();
+	exit(1);
+        /*NOTREACHED*/
+    }
+
+    QmcGroup direct;
+    QmcGroup cached;
+
+    if (setup(direct, 0, archives, &argv[optind], argc - optind) < 0 ||
+	setup(cached, 1, archives, &argv[optind], argc - optind) < 0)
+	exit(1);
+    cached.setPrefetch(samples);
+    cached.updateBounds();
+    start = pmtimevalToReal(&cached.logStart());
+
+    // pmchart-style: reposition before every sample, left to right
+    for (i = mismatches = 0; i < samples; i++) {
+	when = start + i * delta;
+	position(direct, when, delta);
+	position(cached, when, delta);
+	direct.fetch();
+	cached.fetch();
+	mismatches += compare(i);
+    }
+    cout << "positioned forward: " << samples << " samples, "
+	 << mismatches << " mismatches" << endl;
+
+    // keep stepping, beyond the initial window
+    for (n = 0, mismatches = 0; n < 3 * samples; n++, i++) {
+	direct.fetch();
+	cached.fetch();
+	mismatches += compare(i);
+    }
+    cout << "stepped forward: " << n << " samples, "
+	 << mismatches << " mismatches" << endl;
+
+    // then backwards from where we are, right to left
+    when = start + (i - 1) * delta;
+    position(direct, when, -delta);
+    position(cached, when, -delta);
+    for (n = 0, mismatches = 0; n < 2 * samples; n++, i--) {
+	direct.fetch();
+	cached.fetch();
+	mismatches += compare(i);
+    }
+    cout << "stepped backward: " << n << " samples, "
+	 << mismatches << " mismatches" << endl;
+
+    // and a jump, as for a scroll, back to the start
+    for (n = 0, mismatches = 0; n < samples; n++) {
+	when = start + (samples - n - 1) * delta;
+	position(direct, when, -delta);
+	position(cached, when, -delta);
+	direct.fetch();
+	cached.fetch();
+	mismatches += compare(n);
+    }
+    cout << "positioned backward: " << n << " samples, "
+	 << mismatches << " mismatches" << endl;
+
+    pmflush();
+    return 0;
+}
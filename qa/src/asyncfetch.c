@@ -0,0 +1,264 @@
+/*
+ * Exercise pmFetchAsync and pmGetInDomAsync - many requests pipelined
+ * on several host contexts at once, with replies delivered in order
+ * from pmAsyncPoll, watch callbacks, synchronous requests refused and
+ * destroying a context while requests are still outstanding.
+ *
+ * Copyright (c) 2019 Red Hat.
+ */
+
+#include <pcp/pmapi.h>
+#include "libpcp.h"
+
+#define MAXCTX		16
+
+typedef struct {
+    int		ctx;
+    int		nfetch;		/* fetch replies so far */
+    int		nindom;		/* indom replies so far */
+    int		ninst;		/* instances in indom reply */
+    int		starts;		/* PM_ASYNC_START watch callbacks */
+    int		stops;		/* PM_ASYNC_STOP watch callbacks */
+    int		closes;		/* PM_ASYNC_CLOSE watch callbacks */
+    int		errors;
+} client_t;
+
+static client_t	clients[MAXCTX+1];
+static int	numpmid;
+static pmID	*pmidlist;
+static pmInDom	indom = PM_INDOM_NULL;
+
+static void
+fetch_done(int ctx, int sts, pmResult *rp, void *arg)
+{
+    client_t	*cp = &clients[(int)(__psint_t)arg >> 16];
+    int		seq = (int)(__psint_t)arg & 0xffff;
+
+    if (ctx != cp->ctx) {
+	printf("fetch reply for context %d delivered to context %d\n", cp->ctx, ctx);
+	cp->errors++;
+    }
+    if (sts < 0) {
+	printf("context %d fetch %d: %s\n", (int)(cp - clients), seq, pmErrStr(sts));
+	cp->errors++;
+	return;
+    }
+    if (seq != cp->nfetch + cp->nindom) {
+	printf("context %d: reply for request %d, expected %d\n", (int)(cp - clients),
+		seq, cp->nfetch + cp->nindom);
+	cp->errors++;
+    }
+    if (rp->numpmid != numpmid) {
+	printf("context %d: %d metrics in result, expected %d\n", (int)(cp - clients),
+		rp->numpmid, numpmid);
+	cp->errors++;
+    }
+    if (pmDebugOptions.appl0)
+	__pmDumpResult(stderr, rp);
+    cp->nfetch++;
+    pmFreeResult(rp);
+}
+
+static void
+indom_done(int ctx, int sts, int *instlist, char **namelist, void *arg)
+{
+    client_t	*cp = &clients[(int)(__psint_t)arg >> 16];
+    int		seq = (int)(__psint_t)arg & 0xffff;
+
+    if (sts < 0) {
+	printf("context %d indom: %s\n", (int)(cp - clients), pmErrStr(sts));
+	cp->errors++;
+	return;
+    }
+    if (seq != cp->nfetch + cp->nindom) {
+	printf("context %d: indom reply for request %d, expected %d\n",
+		(int)(cp - clients), seq, cp->nfetch + cp->nindom);
+	cp->errors++;
+    }
+    cp->nindom++;
+    cp->ninst = sts;
+    if (sts > 0) {
+	free(instlist);
+	free(namelist);
+    }
+}
+
+static void
+watch(int ctx, int fd, int action, void *data)
+{
+    client_t	*cp = (client_t *)data;
+
+    if (pmDebugOptions.appl1)
+	fprintf(stderr, "watch: context %d fd %d action %d\n", ctx, fd, action);
+    if (action == PM_ASYNC_START)
+	cp->starts++;
+    else if (action == PM_ASYNC_STOP)
+	cp->stops++;
+    else if (action == PM_ASYNC_CLOSE)
+	cp->closes++;
+}
+
+static void *
+request(int c, int seq)
+{
+    return (void *)(__psint_t)((c << 16) | seq);
+}
+
+int
+main(int argc, char **argv)
+{
+    client_t	*cp;
+    pmDesc	desc;
+    pmResult	*rp;
+    pmID	pmid;
+    int		*instlist;
+    char	**namelist;
+    char	*host = "local:";
+    int		ctxlist[MAXCTX];
+    int		c, f, i, sts, pending;
+    int		errflag = 0, ncontexts = 4, nfetches = 10;
+
+    pmSetProgname(argv[0]);
+
+    while ((c = getopt(argc, argv, "c:D:f:h:")) != EOF) {
+	switch (c) {
+
+	case 'c':
+	    ncontexts = atoi(optarg);
+	    break;
+
+	case 'D':	/* debug options */
+	    if (pmSetDebug(optarg) < 0) {
+		fprintf(stderr, "%s: unrecognized debug options specification (%s)\n",
+		    pmGetProgname(), optarg);
+		errflag++;
+	    }
+	    break;
+
+	case 'f':
+	    nfetches = atoi(optarg);
+	    break;
+
+	case 'h':
+	    host = optarg;
+	    break;
+
+	case '?':
+	default:
+	    errflag++;
+	    break;
+	}
+    }
+
+    if (errflag || optind == argc || ncontexts < 1 || ncontexts > MAXCTX ||
+	nfetches < 1 || nfetches > 0xfff0) {
+	fprintf(stderr, "Usage: %s [-D debug] [-c contexts] [-f fetches] [-h host] metric ...\n",
+		pmGetProgname());
+	exit(1);
+    }
+
+    numpmid = argc - optind;
+    if ((pmidlist = (pmID *)malloc(numpmid * sizeof(pmID))) == NULL) {
+	perror("malloc");
+	exit(1);
+    }
+
+    for (c = 0; c <= ncontexts; c++) {
+	cp = &clients[c];
+	if ((cp->ctx = pmNewContext(PM_CONTEXT_HOST, host)) < 0) {
+	    fprintf(stderr, "pmNewContext(%s): %s\n", host, pmErrStr(cp->ctx));
+	    exit(1);
+	}
+	if (c == 0) {
+	    if ((sts = pmLookupName(numpmid, &argv[optind], pmidlist)) < 0) {
+		fprintf(stderr, "pmLookupName: %s\n", pmErrStr(sts));
+		exit(1);
+	    }
+	    if ((sts = pmLookupDesc(pmidlist[0], &desc)) < 0) {
+		fprintf(stderr, "pmLookupDesc: %s\n", pmErrStr(sts));
+		exit(1);
+	    }
+	    indom = desc.indom;
+	}
+	if ((sts = pmAsyncSetWatch(cp->ctx, watch, cp)) < 0) {
+	    fprintf(stderr, "pmAsyncSetWatch: %s\n", pmErrStr(sts));
+	    exit(1);
+	}
+	if (c < ncontexts)
+	    ctxlist[c] = cp->ctx;
+    }
+
+    /* every request is sent before any reply is read */
+    for (c = 0; c < ncontexts; c++) {
+	for (f = i = 0; f < nfetches; f++) {
+	    if ((sts = pmFetchAsync(clients[c].ctx, numpmid, pmidlist,
+				fetch_done, request(c, i++))) < 0) {
+		printf("pmFetchAsync: %s\n", pmErrStr(sts));
+		clients[c].errors++;
+	    }
+	    if (f == nfetches / 2 && indom != PM_INDOM_NULL &&
+		(sts = pmGetInDomAsync(clients[c].ctx, indom,
+				indom_done, request(c, i++))) < 0) {
+		printf("pmGetInDomAsync: %s\n", pmErrStr(sts));
+		clients[c].errors++;
+	    }
+	}
+    }
+    for (c = 0, pending = 0; c < ncontexts; c++)
+	pending += pmAsyncPending(clients[c].ctx);
+    printf("%d requests pending\n", pending);
+
+    while (pending > 0) {
+	if ((sts = pmAsyncPoll(ctxlist, ncontexts, NULL)) < 0) {
+	    printf("pmAsyncPoll: %s\n", pmErrStr(sts));
+	    break;
+	}
+	pending -= sts;
+    }
+
+    for (c = 0; c < ncontexts; c++) {
+	cp = &clients[c];
+	printf("context %d: %d fetches, %d indoms", c, cp->nfetch, cp->nindom);
+	if (cp->nindom)
+	    printf(" (%d instances)", cp->ninst);
+	printf(", watch start %d stop %d, %s\n", cp->starts, cp->stops,
+		cp->errors ? "FAILED" : "in order");
+	if ((sts = pmAsyncPending(cp->ctx)) != 0)
+	    printf("context %d: %d still pending\n", c, sts);
+    }
+
+    /* synchronous requests are fine once all replies have arrived */
+    pmUseContext(clients[0].ctx);
+    if ((sts = pmFetch(numpmid, pmidlist, &rp)) < 0)
+	printf("pmFetch after replies: %s\n", pmErrStr(sts));
+    else {
+	printf("pmFetch after replies: %d metrics\n", rp->numpmid);
+	pmFreeResult(rp);
+    }
+
+    /* destroy a context with replies outstanding - no callbacks */
+    cp = &clients[ncontexts];
+    for (f = 0; f < 3; f++)
+	pmFetchAsync(cp->ctx, numpmid, pmidlist, fetch_done, request(ncontexts, f));
+
+    /* ... but first, synchronous requests are refused while pending */
+    pmUseContext(cp->ctx);
+    sts = pmFetch(numpmid, pmidlist, &rp);
+    printf("pmFetch while pending: %s\n", pmErrStr(sts));
+    if (indom != PM_INDOM_NULL) {
+	sts = pmGetInDom(indom, &instlist, &namelist);
+	printf("pmGetInDom while pending: %s\n", pmErrStr(sts));
+    }
+    sts = pmLookupName(1, &argv[optind], &pmid);
+    printf("pmLookupName while pending: %s\n", pmErrStr(sts));
+    printf("destroy with %d pending\n", pmAsyncPending(cp->ctx));
+    pmDestroyContext(cp->ctx);
+    printf("destroyed: %d fetch callbacks, watch start %d close %d\n",
+	    cp->nfetch, cp->starts, cp->closes);
+
+    /* requests on a context that no longer exists */
+    sts = pmFetchAsync(cp->ctx, numpmid, pmidlist, fetch_done, request(0, 0));
+    printf("destroyed context: %s\n", pmErrStr(sts));
+
+    return 0;
+}
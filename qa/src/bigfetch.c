@@ -0,0 +1,189 @@
+/*
+ * Fetch all of the metrics below some PMNS nodes in one pmResult, over
+ * a plain connection to pmcd and over one where large PDUs are sent
+ * compressed, checking that the results match and reporting fetch rates.
+ *
+ * Copyright (c) 2019 Red Hat.
+ */
+
+#include <pcp/pmapi.h>
+#include "libpcp.h"
+
+static pmID	*pmidlist;
+static int	numpmid;
+static int	maxpmid;
+
+static void
+dometric(const char *name)
+{
+    pmID	pmid;
+    int		sts;
+
+    if ((sts = pmLookupName(1, (char **)&name, &pmid)) < 0) {
+	fprintf(stderr, "%s: pmLookupName(%s): %s\n",
+		pmGetProgname(), name, pmErrStr(sts));
+	return;
+    }
+    if (numpmid == maxpmid) {
+	maxpmid = maxpmid ? maxpmid * 2 : 64;
+	if ((pmidlist = realloc(pmidlist, maxpmid * sizeof(pmID))) == NULL) {
+	    fprintf(stderr, "%s: out of memory\n", pmGetProgname());
+	    exit(1);
+	}
+    }
+    pmidlist[numpmid++] = pmid;
+}
+
+static int
+compressed(int ctx)
+{
+    __pmContext	*ctxp;
+    int		sts;
+
+    if ((ctxp = __pmHandleToPtr(ctx)) == NULL)
+	return 0;
+    sts = __pmCompressIPC(ctxp->c_pmcd->pc_fd);
+    PM_UNLOCK(ctxp->c_lock);
+    return sts;
+}
+
+/* the values must match, those that change between fetches aside */
+static int
+compare(pmResult *a, pmResult *b)
+{
+    pmValueSet	*avsp, *bvsp;
+    int		i, j, bad = 0;
+
+    if (a->numpmid != b->numpmid) {
+	printf("numpmid %d != %d\n", a->numpmid, b->numpmid);
+	return 1;
+    }
+    for (i = 0; i < a->numpmid; i++) {
+	avsp = a->vset[i];
+	bvsp = b->vset[i];
+	if (avsp->pmid != bvsp->pmid || avsp->numval != bvsp->numval ||
+	    (avsp->numval > 0 && avsp->valfmt != bvsp->valfmt)) {
+	    printf("%s: numval %d != %d\n", pmIDStr(avsp->pmid),
+		    avsp->numval, bvsp->numval);
+	    bad++;
+	    continue;
+	}
+	for (j = 0; j < avsp->numval; j++) {
+	    if (avsp->vlist[j].inst != bvsp->vlist[j].inst) {
+		printf("%s: inst[%d] %d != %d\n", pmIDStr(avsp->pmid), j,
+			avsp->vlist[j].inst, bvsp->vlist[j].inst);
+		bad++;
+	    }
+	}
+    }
+    return bad;
+}
+
+static double
+fetchrate(int ctx, int iterations, pmResult **rp)
+{
+    struct timeval	before, after;
+    pmResult		*result;
+    int			i, sts;
+
+    pmUseContext(ctx);
+    pmtimevalNow(&before);
+    for (i = 0; i < iterations; i++) {
+	if ((sts = pmFetch(numpmid, pmidlist, &result)) < 0) {
+	    fprintf(stderr, "%s: pmFetch: %s\n", pmGetProgname(), pmErrStr(sts));
+	    exit(1);
+	}
+	if (i == iterations - 1)
+	    *rp = result;
+	else
+	    pmFreeResult(result);
+    }
+    pmtimevalNow(&after);
+    return iterations / pmtimevalSub(&after, &before);
+}
+
+int
+main(int argc, char **argv)
+{
+    int		c, sts, values, i;
+    int		errflag = 0;
+    int		iterations = 100;
+    int		ctx[2];
+    double	rate[2];
+    char	*host = "localhost";
+    char	spec[MAXHOSTNAMELEN + 16];
+    pmResult	*result[2];
+
+    pmSetProgname(argv[0]);
+
+    while ((c = getopt(argc, argv, "D:h:i:?")) != EOF) {
+	switch (c) {
+	case 'D':
+	    if ((sts = pmSetDebug(optarg)) < 0) {
+		fprintf(stderr, "%s: unrecognized debug options specification (%s)\n",
+			pmGetProgname(), optarg);
+		errflag++;
+	    }
+	    break;
+	case 'h':
+	    host = optarg;
+	    break;
+	case 'i':
+	    iterations = atoi(optarg);
+	    if (iterations < 1)
+		errflag++;
+	    break;
+	case '?':
+	default:
+	    errflag++;
+	    break;
+	}
+    }
+
+    if (errflag || optind == argc) {
+	fprintf(stderr, "Usage: %s [-D debug] [-h host] [-i iterations] metric ...\n",
+		pmGetProgname());
+	exit(1);
+    }
+
+    /* exclusive, so that the two contexts do not share one connection */
+    pmsprintf(spec, sizeof(spec), "%s?exclusive", host);
+    if ((ctx[0] = pmNewContext(PM_CONTEXT_HOST, spec)) < 0) {
+	fprintf(stderr, "%s: pmNewContext(%s): %s\n",
+		pmGetProgname(), spec, pmErrStr(ctx[0]));
+	exit(1);
+    }
+    for (; optind < argc; optind++) {
+	if ((sts = pmTraversePMNS(argv[optind], dometric)) < 0) {
+	    fprintf(stderr, "%s: pmTraversePMNS(%s): %s\n",
+		    pmGetProgname(), argv[optind], pmErrStr(sts));
+	    exit(1);
+	}
+    }
+    if (numpmid == 0) {
+	fprintf(stderr, "%s: no metrics\n", pmGetProgname());
+	exit(1);
+    }
+    pmsprintf(spec, sizeof(spec), "%s?exclusive&compress", host);
+    if ((ctx[1] = pmNewContext(PM_CONTEXT_HOST, spec)) < 0) {
+	fprintf(stderr, "%s: pmNewContext(%s): %s\n",
+		pmGetProgname(), spec, pmErrStr(ctx[1]));
+	exit(1);
+    }
+    printf("compression: %s\n", compressed(ctx[1]) ? "on" : "off");
+
+    for (i = 0; i < 2; i++)
+	rate[i] = fetchrate(ctx[i], iterations, &result[i]);
+
+    for (i = values = 0; i < result[0]->numpmid; i++)
+	if (result[0]->vset[i]->numval > 0)
+	    values += result[0]->vset[i]->numval;
+    printf("%d metrics, %d values\n", numpmid, values);
+    printf("results %s\n", compare(result[0], result[1]) ? "differ" : "match");
+    printf("plain: %.1f fetches/second\n", rate[0]);
+    printf("compressed: %.1f fetches/second\n", rate[1]);
+
+    pmFreeResult(result[0]);
+    pmFreeResult(result[1]);
+    exit(0);
+}
@@ -0,0 +1,110 @@
+/*
+ * Copyright (c) 2019 Red Hat.
+ *
+ * Repeatedly fetch metrics from each of the proc PMDA cgroup clusters,
+ * to measure the cost of walking the cgroup hierarchies and parsing
+ * the control files of every cgroup found.
+ */
+#include <pcp/pmapi.h>
+#include <sys/time.h>
+
+static struct {
+    const char	*file;
+    const char	*metric;
+} groups[] = {
+    { "cpuset",		"cgroup.cpuset.cpus" },
+    { "cpuacct",	"cgroup.cpuacct.usage" },
+    { "cpusched",	"cgroup.cpusched.shares" },
+    { "memory",		"cgroup.memory.usage" },
+    { "blkio",		"cgroup.blkio.all.sectors" },
+};
+static int ngroups = sizeof(groups) / sizeof(groups[0]);
+
+static int
+overrides(int opt, pmOptions *opts)
+{
+    return (opt == 't');	/* timing, not the sample interval */
+}
+
+static pmLongOptions longopts[] = {
+    PMAPI_OPTIONS_HEADER("Options"),
+    PMOPT_DEBUG,
+    PMOPT_SPECLOCAL,
+    PMOPT_LOCALPMDA,
+    PMOPT_NAMESPACE,
+    PMOPT_SAMPLES,
+    { "timing", 0, 't', 0, "report fetch times" },
+    PMOPT_HELP,
+    PMAPI_OPTIONS_END
+};
+
+static pmOptions opts = {
+    .short_options = "D:K:Ln:s:t?",
+    .long_options = longopts,
+    .short_usage = "[options]",
+    .override = overrides,
+};
+
+int
+main(int argc, char **argv)
+{
+    struct timeval	start, now;
+    pmResult		*result;
+    pmID		pmid;
+    double		elapsed;
+    char		*name;
+    int			i, n, c, sts, ctx, samples, timing = 0;
+
+    pmSetProgname(argv[0]);
+    while ((c = pmGetOptions(argc, argv, &opts)) != EOF) {
+	switch (c) {
+	case 't':
+	    timing = 1;
+	    break;
+	default:
+	    opts.errors++;
+	    break;
+	}
+    }
+    if (opts.errors || opts.flags & PM_OPTFLAG_EXIT || opts.optind != argc) {
+	sts = !(opts.flags & PM_OPTFLAG_EXIT);
+	pmUsageMessage(&opts);
+	exit(sts);
+    }
+    samples = opts.samples > 0 ? opts.samples : 1000;
+
+    if ((ctx = pmNewContext(opts.Lflag ? PM_CONTEXT_LOCAL : PM_CONTEXT_HOST,
+			    opts.Lflag ? NULL : "local:")) < 0) {
+	fprintf(stderr, "%s: pmNewContext: %s\n", pmGetProgname(), pmErrStr(ctx));
+	exit(1);
+    }
+
+    for (i = 0; i < ngroups; i++) {
+	name = (char *)groups[i].metric;
+	if ((sts = pmLookupName(1, &name, &pmid)) < 0) {
+	    printf("%s: %s: %s\n", groups[i].file, name, pmErrStr(sts));
+	    continue;
+	}
+	gettimeofday(&start, NULL);
+	for (n = 0; n < samples; n++) {
+	    if ((sts = pmFetch(1, &pmid, &result)) < 0)
+		break;
+	    if (n < samples - 1)
+		pmFreeResult(result);
+	}
+	gettimeofday(&now, NULL);
+	if (sts < 0) {
+	    printf("%s: %s: pmFetch: %s\n", groups[i].file, name, pmErrStr(sts));
+	    continue;
+	}
+	elapsed = pmtimevalSub(&now, &start);
+	printf("%s: %s %d values", groups[i].file, name, result->vset[0]->numval);
+	if (timing)
+	    printf(", %.1f usec per fetch", elapsed * 1000000.0 / samples);
+	putchar('\n');
+	pmFreeResult(result);
+    }
+
+    pmDestroyContext(ctx);
+    return 0;
+}
@@ -0,0 +1,275 @@
+/*
+ * Decode pmResult PDUs of typical shapes with __pmDecodeResult and
+ * __pmDecodeResultArena, checking that the results are the same and
+ * counting the allocations made to decode and free each one.
+ *
+ * Copyright (c) 2019 Red Hat.
+ */
+
+#include <pcp/pmapi.h>
+#include "libpcp.h"
+
+#ifdef __GLIBC__
+/*
+ * Count heap allocations, libpcp included, by interposing on the
+ * glibc allocator.
+ */
+extern void *__libc_malloc(size_t);
+extern void *__libc_calloc(size_t, size_t);
+extern void *__libc_realloc(void *, size_t);
+extern void __libc_free(void *);
+
+static int	counting;
+static long	nalloc;
+static long	nfree;
+
+void *
+malloc(size_t size)
+{
+    if (counting)
+	nalloc++;
+    return __libc_malloc(size);
+}
+
+void *
+calloc(size_t nmemb, size_t size)
+{
+    if (counting)
+	nalloc++;
+    return __libc_calloc(nmemb, size);
+}
+
+void *
+realloc(void *ptr, size_t size)
+{
+    if (counting && ptr == NULL)
+	nalloc++;
+    return __libc_realloc(ptr, size);
+}
+
+void
+free(void *ptr)
+{
+    if (counting && ptr != NULL)
+	nfree++;
+    __libc_free(ptr);
+}
+#define ALLOC_COUNTS	1
+#else
+static int	counting;
+static long	nalloc = -1;
+static long	nfree = -1;
+#define ALLOC_COUNTS	0
+#endif
+
+typedef struct {
+    const char	*name;
+    int		numpmid;
+    int		numinst;
+    int		type;		/* PM_TYPE_* of the values */
+    int		errors;		/* every n-th metric has no values */
+} shape_t;
+
+static shape_t shapes[] = {
+    { "empty",		0,	0,	PM_TYPE_32,	0 },
+    { "one value",	1,	1,	PM_TYPE_32,	0 },
+    { "100 metrics",	100,	1,	PM_TYPE_U32,	0 },
+    { "100 metrics, errors", 100, 1,	PM_TYPE_U32,	4 },
+    { "10 x 1000 instances", 10, 1000,	PM_TYPE_32,	0 },
+    { "20 x 50 counters", 20,	50,	PM_TYPE_U64,	0 },
+    { "20 x 50 doubles", 20,	50,	PM_TYPE_DOUBLE,	3 },
+    { "50 x 20 strings", 50,	20,	PM_TYPE_STRING,	0 },
+};
+
+static pmResult *
+build(shape_t *sp)
+{
+    pmResult	*rp;
+    pmValueSet	*vsp;
+    pmAtomValue	atom;
+    char	buf[32];
+    int		i, j, sts;
+
+    rp = (pmResult *)calloc(1, sizeof(pmResult) + sp->numpmid * sizeof(pmValueSet *));
+    rp->timestamp.tv_sec = 1000000000;
+    rp->timestamp.tv_usec = 123456;
+    rp->numpmid = sp->numpmid;
+    for (i = 0; i < sp->numpmid; i++) {
+	vsp = rp->vset[i] = (pmValueSet *)calloc(1, sizeof(pmValueSet) +
+				sp->numinst * sizeof(pmValue));
+	vsp->pmid = pmID_build(29, i / 64, i % 64);
+	if (sp->errors && (i % sp->errors) == 1) {
+	    vsp->numval = PM_ERR_AGAIN;
+	    continue;
+	}
+	vsp->numval = sp->numinst;
+	for (j = 0; j < sp->numinst; j++) {
+	    vsp->vlist[j].inst = j * 7;
+	    switch (sp->type) {
+	    case PM_TYPE_32:
+		atom.l = i * j - 1000;
+		break;
+	    case PM_TYPE_U32:
+		atom.ul = i * 1000 + j;
+		break;
+	    case PM_TYPE_U64:
+		atom.ull = (__uint64_t)i << 40 | j;
+		break;
+	    case PM_TYPE_DOUBLE:
+		atom.d = i + j / 3.0;
+		break;
+	    case PM_TYPE_STRING:
+		pmsprintf(buf, sizeof(buf), "metric %d instance %d", i, j);
+		atom.cp = buf;
+		break;
+	    }
+	    if ((sts = __pmStuffValue(&atom, &vsp->vlist[j], sp->type)) < 0) {
+		fprintf(stderr, "__pmStuffValue: %s\n", pmErrStr(sts));
+		exit(1);
+	    }
+	    vsp->valfmt = sts;
+	}
+    }
+    return rp;
+}
+
+static int
+compare(pmResult *a, pmResult *b)
+{
+    pmValueSet	*avsp, *bvsp;
+    int		i, j;
+
+    if (a->numpmid != b->numpmid ||
+	a->timestamp.tv_sec != b->timestamp.tv_sec ||
+	a->timestamp.tv_usec != b->timestamp.tv_usec)
+	return 1;
+    for (i = 0; i < a->numpmid; i++) {
+	avsp = a->vset[i];
+	bvsp = b->vset[i];
+	if (avsp->pmid != bvsp->pmid || avsp->numval != bvsp->numval)
+	    return 1;
+	if (avsp->numval <= 0)
+	    continue;
+	if (avsp->valfmt != bvsp->valfmt)
+	    return 1;
+	for (j = 0; j < avsp->numval; j++) {
+	    if (avsp->vlist[j].inst != bvsp->vlist[j].inst)
+		return 1;
+	    if (avsp->valfmt == PM_VAL_INSITU) {
+		if (avsp->vlist[j].value.lval != bvsp->vlist[j].value.lval)
+		    return 1;
+	    }
+	    else if (avsp->vlist[j].value.pval->vlen != bvsp->vlist[j].value.pval->vlen ||
+		     memcmp(avsp->vlist[j].value.pval, bvsp->vlist[j].value.pval,
+			    avsp->vlist[j].value.pval->vlen) != 0)
+		return 1;
+	}
+    }
+    return 0;
+}
+
+/* decode and free a fresh copy of the PDU, returning the elapsed time */
+static double
+decode(__pmPDU *pdu, int arena, pmResult *expect, int *bad)
+{
+    struct timeval	before, after;
+    __pmPDU		*pb;
+    pmResult		*rp;
+    int			len = ((__pmPDUHdr *)pdu)->len;
+    int			sts;
+
+    /* decoding converts the PDU in place, so decode a copy */
+    pb = __pmFindPDUBuf(len);
+    memcpy(pb, pdu, len);
+
+    pmtimevalNow(&before);
+    counting = 1;
+    sts = arena ? __pmDecodeResultArena(pb, &rp) : __pmDecodeResult(pb, &rp);
+    if (sts >= 0) {
+	counting = 0;
+	if (expect != NULL && compare(expect, rp) != 0)
+	    (*bad)++;
+	counting = 1;
+	pmFreeResult(rp);
+    }
+    counting = 0;
+    pmtimevalNow(&after);
+
+    __pmUnpinPDUBuf(pb);
+    if (sts < 0) {
+	fprintf(stderr, "decode: %s\n", pmErrStr(sts));
+	exit(1);
+    }
+    return pmtimevalSub(&after, &before);
+}
+
+int
+main(int argc, char **argv)
+{
+    int		c, i, k, arena, sts;
+    int		errflag = 0;
+    int		iterations = 1000;
+    int		bad;
+    long	allocs, frees;
+    double	elapsed;
+    pmResult	*rp;
+    __pmPDU	*pdu;
+    shape_t	*sp;
+
+    pmSetProgname(argv[0]);
+
+    while ((c = getopt(argc, argv, "D:i:?")) != EOF) {
+	switch (c) {
+	case 'D':
+	    if ((sts = pmSetDebug(optarg)) < 0) {
+		fprintf(stderr, "%s: unrecognized debug options specification (%s)\n",
+			pmGetProgname(), optarg);
+		errflag++;
+	    }
+	    break;
+	case 'i':
+	    iterations = atoi(optarg);
+	    if (iterations < 1)
+		errflag++;
+	    break;
+	case '?':
+	default:
+	    errflag++;
+	    break;
+	}
+    }
+
+    if (errflag || optind != argc) {
+	fprintf(stderr, "Usage: %s [-D debug] [-i iterations]\n", pmGetProgname());
+	exit(1);
+    }
+    if (!ALLOC_COUNTS)
+	printf("Note: no allocation counts on this platform\n");
+
+    for (k = 0; k < sizeof(shapes) / sizeof(shapes[0]); k++) {
+	sp = &shapes[k];
+	rp = build(sp);
+	if ((sts = __pmEncodeResult(-1, rp, &pdu)) < 0) {
+	    fprintf(stderr, "__pmEncodeResult: %s\n", pmErrStr(sts));
+	    exit(1);
+	}
+	printf("%s: %d bytes\n", sp->name, ((__pmPDUHdr *)pdu)->len);
+	for (arena = 0; arena < 2; arena++) {
+	    bad = 0;
+	    decode(pdu, arena, rp, &bad);
+	    nalloc = nfree = 0;
+	    elapsed = 0;
+	    for (i = 0; i < iterations; i++)
+		elapsed += decode(pdu, arena, NULL, &bad);
+	    allocs = ALLOC_COUNTS ? nalloc / iterations : -1;
+	    frees = ALLOC_COUNTS ? nfree / iterations : -1;
+	    printf("    %s: %ld allocs, %ld frees, %s, %.3f usec\n",
+		    arena ? "arena" : "plain", allocs, frees,
+		    bad ? "values differ" : "values match",
+		    elapsed * 1000000 / iterations);
+	}
+	__pmUnpinPDUBuf(pdu);
+	pmFreeResult(rp);
+    }
+    exit(0);
+}
@@ -0,0 +1,253 @@
+/*
+ * Exercise instance domain changes from pmcd - pmGetInDom results,
+ * built from changes since the instances last sent, must match the
+ * whole instance domain as sent by pmcd, as a metric controlling the
+ * size of the instance domain is changed between requests.  Reports
+ * the size of the replies for the whole and the unchanged instance
+ * domain.
+ *
+ * Copyright (c) 2019 Red Hat.
+ */
+
+#include <pcp/pmapi.h>
+#include "libpcp.h"
+
+/* values stored into the -s metric, one per iteration */
+static int	counts[] = { 8, 8, 3, 10, 10, 0, 4, 1000, 999, 1001 };
+
+static int
+newcontext(const char *host, int flags)
+{
+    int		ctx;
+
+    if ((ctx = pmNewContext(PM_CONTEXT_HOST | flags, host)) < 0) {
+	fprintf(stderr, "%s: pmNewContext(%s): %s\n",
+		pmGetProgname(), host, pmErrStr(ctx));
+	exit(1);
+    }
+    return ctx;
+}
+
+static int
+connection(int ctx)
+{
+    __pmContext	*ctxp;
+    int		fd;
+
+    if ((ctxp = __pmHandleToPtr(ctx)) == NULL)
+	return -1;
+    fd = ctxp->c_pmcd->pc_fd;
+    PM_UNLOCK(ctxp->c_lock);
+    return fd;
+}
+
+/* the whole instance domain, as pmcd sends it without changes */
+static int
+wholeindom(int ctx, pmInDom indom, pmInResult **result)
+{
+    pmTimeval	when = { 0, 0 };
+    __pmPDU	*pb;
+    int		fd = connection(ctx);
+    int		pinpdu, sts;
+
+    if ((sts = __pmSendInstanceReq(fd, ctx, &when, indom, PM_IN_NULL, NULL)) < 0)
+	return sts;
+    pinpdu = sts = __pmGetPDU(fd, ANY_SIZE, TIMEOUT_DEFAULT, &pb);
+    if (sts == PDU_INSTANCE) {
+	sts = __pmDecodeInstance(pb, result);
+    }
+    else if (sts == PDU_ERROR)
+	__pmDecodeError(pb, &sts);
+    else if (sts >= 0)
+	sts = PM_ERR_IPC;
+    if (pinpdu > 0)
+	__pmUnpinPDUBuf(pb);
+    return sts;
+}
+
+/* size of the reply to a request for changes since a generation */
+static int
+deltasize(int ctx, pmInDom indom, int *generation)
+{
+    __pmInDomDelta	delta;
+    __pmPDU		*pb;
+    int			fd = connection(ctx);
+    int			pinpdu, len, sts;
+
+    if ((sts = __pmSendInstanceDeltaReq(fd, ctx, indom, *generation)) < 0)
+	return sts;
+    pinpdu = sts = __pmGetPDU(fd, ANY_SIZE, TIMEOUT_DEFAULT, &pb);
+    if (sts == PDU_INSTANCE) {
+	len = ((__pmPDUHdr *)pb)->len;
+	if ((sts = __pmDecodeInstanceDelta(pb, &delta)) >= 0) {
+	    *generation = delta.generation;
+	    __pmFreeInDomDelta(&delta);
+	    sts = len;
+	}
+    }
+    else if (sts == PDU_ERROR)
+	__pmDecodeError(pb, &sts);
+    else if (sts >= 0)
+	sts = PM_ERR_IPC;
+    if (pinpdu > 0)
+	__pmUnpinPDUBuf(pb);
+    return sts;
+}
+
+static void
+store(int ctx, pmID pmid, int value)
+{
+    pmResult	*rp;
+    pmAtomValue	atom;
+    int		sts;
+
+    pmUseContext(ctx);
+    if ((sts = pmFetch(1, &pmid, &rp)) < 0) {
+	fprintf(stderr, "%s: pmFetch: %s\n", pmGetProgname(), pmErrStr(sts));
+	exit(1);
+    }
+    atom.l = value;
+    if ((sts = __pmStuffValue(&atom, &rp->vset[0]->vlist[0], PM_TYPE_32)) >= 0) {
+	rp->vset[0]->valfmt = sts;
+	sts = pmStore(rp);
+    }
+    if (sts < 0) {
+	fprintf(stderr, "%s: pmStore: %s\n", pmGetProgname(), pmErrStr(sts));
+	exit(1);
+    }
+    pmFreeResult(rp);
+}
+
+int
+main(int argc, char **argv)
+{
+    int		c, i, j, sts;
+    int		errflag = 0;
+    int		errors = 0;
+    int		iterations = 10;
+    int		ctx, fullctx, sizectx;
+    int		generation;
+    int		n;
+    int		*ilist;
+    char	**nlist;
+    pmInResult	*full;
+    char	*host = "localhost";
+    char	*control = NULL;
+    char	*name;
+    pmID	pmid, ctlpmid = PM_ID_NULL;
+    pmDesc	desc;
+
+    pmSetProgname(argv[0]);
+
+    while ((c = getopt(argc, argv, "D:h:i:s:?")) != EOF) {
+	switch (c) {
+	case 'D':
+	    if ((sts = pmSetDebug(optarg)) < 0) {
+		fprintf(stderr, "%s: unrecognized debug options specification (%s)\n",
+			pmGetProgname(), optarg);
+		errflag++;
+	    }
+	    break;
+	case 'h':
+	    host = optarg;
+	    break;
+	case 'i':
+	    iterations = atoi(optarg);
+	    if (iterations < 1)
+		errflag++;
+	    break;
+	case 's':
+	    control = optarg;
+	    break;
+	case '?':
+	default:
+	    errflag++;
+	    break;
+	}
+    }
+
+    if (errflag || optind != argc - 1) {
+	fprintf(stderr, "Usage: %s [-D debug] [-h host] [-i iterations] [-s metric] metric\n",
+		pmGetProgname());
+	exit(1);
+    }
+    name = argv[optind];
+
+    /* exclusive, so that each context has a pmcd client of its own */
+    ctx = newcontext(host, PM_CTXFLAG_EXCLUSIVE);
+    fullctx = newcontext(host, PM_CTXFLAG_EXCLUSIVE);
+    sizectx = newcontext(host, PM_CTXFLAG_EXCLUSIVE);
+    if ((sts = pmLookupName(1, &name, &pmid)) < 0) {
+	fprintf(stderr, "%s: pmLookupName(%s): %s\n",
+		pmGetProgname(), name, pmErrStr(sts));
+	exit(1);
+    }
+    if ((sts = pmLookupDesc(pmid, &desc)) < 0 || desc.indom == PM_INDOM_NULL) {
+	fprintf(stderr, "%s: %s has no instance domain\n", pmGetProgname(), name);
+	exit(1);
+    }
+    generation = 0;
+    if ((sts = deltasize(sizectx, desc.indom, &generation)) == PM_ERR_IPC) {
+	printf("pmcd does not send instance domain changes\n");
+	exit(0);
+    }
+    if (control != NULL &&
+	(sts = pmLookupName(1, &control, &ctlpmid)) < 0) {
+	fprintf(stderr, "%s: pmLookupName(%s): %s\n",
+		pmGetProgname(), control, pmErrStr(sts));
+	exit(1);
+    }
+
+    for (i = 0; i < iterations; i++) {
+	if (control != NULL)
+	    store(fullctx, ctlpmid, counts[i % (sizeof(counts) / sizeof(counts[0]))]);
+
+	pmUseContext(ctx);
+	ilist = NULL;
+	nlist = NULL;
+	if ((n = pmGetInDom(desc.indom, &ilist, &nlist)) < 0) {
+	    printf("iteration %d: pmGetInDom: %s\n", i, pmErrStr(n));
+	    errors++;
+	    continue;
+	}
+	pmUseContext(fullctx);
+	if ((sts = wholeindom(fullctx, desc.indom, &full)) < 0) {
+	    printf("iteration %d: whole indom: %s\n", i, pmErrStr(sts));
+	    errors++;
+	    continue;
+	}
+	for (j = 0; j < n && j < full->numinst; j++) {
+	    if (ilist[j] != full->instlist[j] ||
+		strcmp(nlist[j], full->namelist[j]) != 0)
+		break;
+	}
+	if (j != n || n != full->numinst) {
+	    printf("iteration %d: %d instances, %d in whole indom, differ at [%d]\n",
+		    i, n, full->numinst, j);
+	    errors++;
+	}
+	else if (control != NULL)
+	    printf("iteration %d: %d instances, match\n", i, n);
+	if (n > 0) {
+	    free(ilist);
+	    free(nlist);
+	}
+	__pmFreeInResult(full);
+    }
+
+    pmUseContext(sizectx);
+    generation = 0;
+    if ((sts = deltasize(sizectx, desc.indom, &generation)) < 0) {
+	fprintf(stderr, "%s: whole indom: %s\n", pmGetProgname(), pmErrStr(sts));
+	exit(1);
+    }
+    printf("whole indom: %d bytes\n", sts);
+    if ((sts = deltasize(sizectx, desc.indom, &generation)) < 0) {
+	fprintf(stderr, "%s: no changes: %s\n", pmGetProgname(), pmErrStr(sts));
+	exit(1);
+    }
+    printf("no changes: %d bytes\n", sts);
+
+    printf("%d errors\n", errors);
+    exit(errors != 0);
+}
@@ -0,0 +1,179 @@
+/*
+ * Look up the labels of all of the metrics below some PMNS nodes
+ * repeatedly, checking that the label sets do not change and counting
+ * the label requests sent to pmcd, before and after a reconnect.
+ *
+ * Copyright (c) 2019 Red Hat.
+ */
+
+#include <pcp/pmapi.h>
+#include "libpcp.h"
+
+static pmID	*pmidlist;
+static int	numpmid;
+static int	maxpmid;
+static char	**jsonlist;
+static unsigned	pdu_in[PDU_MAX+1];
+static unsigned	pdu_out[PDU_MAX+1];
+
+static void
+dometric(const char *name)
+{
+    pmID	pmid;
+    pmDesc	desc;
+    int		sts;
+
+    if ((sts = pmLookupName(1, (char **)&name, &pmid)) < 0) {
+	fprintf(stderr, "%s: pmLookupName(%s): %s\n",
+		pmGetProgname(), name, pmErrStr(sts));
+	return;
+    }
+    /* skip metrics with no descriptor, like sample.bad.unknown */
+    if (pmLookupDesc(pmid, &desc) < 0)
+	return;
+    if (numpmid == maxpmid) {
+	maxpmid = maxpmid ? maxpmid * 2 : 64;
+	if ((pmidlist = realloc(pmidlist, maxpmid * sizeof(pmID))) == NULL) {
+	    fprintf(stderr, "%s: out of memory\n", pmGetProgname());
+	    exit(1);
+	}
+    }
+    pmidlist[numpmid++] = pmid;
+}
+
+/* merge all of the labels of a metric into one JSONB string */
+static char *
+labels(pmID pmid)
+{
+    pmLabelSet	*sets = NULL, *setp[6];
+    char	buf[PM_MAXLABELJSONLEN];
+    int		i, sts, nsets;
+
+    if ((nsets = pmLookupLabels(pmid, &sets)) < 0) {
+	fprintf(stderr, "%s: pmLookupLabels(%s): %s\n",
+		pmGetProgname(), pmIDStr(pmid), pmErrStr(nsets));
+	exit(1);
+    }
+    for (i = 0; i < nsets; i++)
+	setp[i] = &sets[i];
+    if ((sts = pmMergeLabelSets(setp, nsets, buf, sizeof(buf), NULL, NULL)) < 0) {
+	fprintf(stderr, "%s: pmMergeLabelSets(%s): %s\n",
+		pmGetProgname(), pmIDStr(pmid), pmErrStr(sts));
+	exit(1);
+    }
+    if (nsets > 0)
+	pmFreeLabelSets(sets, nsets);
+    return strdup(buf);
+}
+
+static void
+lookup(const char *when, int iterations)
+{
+    struct timeval	before, after;
+    unsigned		sent;
+    char		*json;
+    int			i, j, bad = 0;
+
+    sent = pdu_out[PDU_LABEL_REQ - PDU_START];
+    pmtimevalNow(&before);
+    for (i = 0; i < iterations; i++) {
+	for (j = 0; j < numpmid; j++) {
+	    json = labels(pmidlist[j]);
+	    if (jsonlist[j] == NULL)
+		jsonlist[j] = json;
+	    else {
+		if (strcmp(json, jsonlist[j]) != 0) {
+		    printf("%s: %s labels %s != %s\n", when,
+			    pmIDStr(pmidlist[j]), json, jsonlist[j]);
+		    bad++;
+		}
+		free(json);
+	    }
+	}
+    }
+    pmtimevalNow(&after);
+    sent = pdu_out[PDU_LABEL_REQ - PDU_START] - sent;
+    printf("%s: %s, %s\n", when, bad ? "labels differ" : "labels match",
+	    sent ? "label requests sent" : "no label requests");
+    if (pmDebugOptions.appl0)
+	fprintf(stderr, "%s: %.1f label requests, %.1f usec per lookup\n", when,
+		(double)sent / (iterations * numpmid),
+		pmtimevalSub(&after, &before) * 1000000 / (iterations * numpmid));
+}
+
+int
+main(int argc, char **argv)
+{
+    int		c, sts, ctx;
+    int		errflag = 0;
+    int		iterations = 10;
+    char	*host = "localhost";
+
+    pmSetProgname(argv[0]);
+
+    while ((c = getopt(argc, argv, "D:h:i:?")) != EOF) {
+	switch (c) {
+	case 'D':
+	    if ((sts = pmSetDebug(optarg)) < 0) {
+		fprintf(stderr, "%s: unrecognized debug options specification (%s)\n",
+			pmGetProgname(), optarg);
+		errflag++;
+	    }
+	    break;
+	case 'h':
+	    host = optarg;
+	    break;
+	case 'i':
+	    iterations = atoi(optarg);
+	    if (iterations < 1)
+		errflag++;
+	    break;
+	case '?':
+	default:
+	    errflag++;
+	    break;
+	}
+    }
+
+    if (errflag || optind == argc) {
+	fprintf(stderr, "Usage: %s [-D debug] [-h host] [-i iterations] metric ...\n",
+		pmGetProgname());
+	exit(1);
+    }
+
+    if ((ctx = pmNewContext(PM_CONTEXT_HOST, host)) < 0) {
+	fprintf(stderr, "%s: pmNewContext(%s): %s\n",
+		pmGetProgname(), host, pmErrStr(ctx));
+	exit(1);
+    }
+    for (; optind < argc; optind++) {
+	if ((sts = pmTraversePMNS(argv[optind], dometric)) < 0) {
+	    fprintf(stderr, "%s: pmTraversePMNS(%s): %s\n",
+		    pmGetProgname(), argv[optind], pmErrStr(sts));
+	    exit(1);
+	}
+    }
+    if (numpmid == 0) {
+	fprintf(stderr, "%s: no metrics\n", pmGetProgname());
+	exit(1);
+    }
+    if ((jsonlist = calloc(numpmid, sizeof(char *))) == NULL) {
+	fprintf(stderr, "%s: out of memory\n", pmGetProgname());
+	exit(1);
+    }
+    __pmSetPDUCntBuf(pdu_in, pdu_out);
+
+    lookup("first lookup", 1);
+    lookup("repeated lookups", iterations);
+
+    /* cached label sets must not outlive the connection they came from */
+    if ((sts = pmReconnectContext(ctx)) < 0) {
+	fprintf(stderr, "%s: pmReconnectContext: %s\n",
+		pmGetProgname(), pmErrStr(sts));
+	exit(1);
+    }
+    lookup("after reconnect", 1);
+    lookup("repeated lookups", iterations);
+
+    exit(0);
+}
@@ -0,0 +1,222 @@
+/*
+ * Drive pmcd with requests from several clients at once, for a daemon
+ * PMDA that pipelines them (pmdathreads -P, in domain 251).  Each
+ * client thread has its own context and connection, and alternates
+ * fetches with instance domain and help text requests, checking that
+ * every reply is for its own context.
+ *
+ * With -l the PMDA is expected to be lost part way through (pmdathreads
+ * -x or -s), and from then on requests may fail with the errors pmcd
+ * reports for an agent that has gone - but every one must still be
+ * answered, and never with another context's values.
+ *
+ * Copyright (c) 2019 Red Hat.
+ */
+
+#include <pcp/pmapi.h>
+#include "libpcp.h"
+#include <pthread.h>
+
+#define FORQA		251
+#define NINST		50
+#define MAXCLIENTS	32
+
+static char	*host = "local:";
+static int	nfetches = 10;
+static pmID	pmids[5];
+static int	lossok;		/* agent may be lost part way (-l) */
+static int	nlost;		/* requests failed as the agent was lost */
+static pthread_mutex_t	lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* is this an error from pmcd for an agent that has failed, if allowed? */
+static int
+agent_lost(int sts)
+{
+    if (!lossok)
+	return 0;
+    if (sts != PM_ERR_NOAGENT && sts != PM_ERR_IPC && sts != PM_ERR_TIMEOUT)
+	return 0;
+    pthread_mutex_lock(&lock);
+    nlost++;
+    pthread_mutex_unlock(&lock);
+    return 1;
+}
+
+/* check one fetch reply - its first three metrics, for this context */
+static int
+check_fetch(pmResult *rp, int f, int *context)
+{
+    pmValueSet	*vsp;
+    pmAtomValue	atom;
+    int		i, errors = 0;
+
+    /* pmcd's client slot, as seen by the PMDA, is fixed per context */
+    vsp = rp->vset[0];
+    if (vsp->numval < 0 && agent_lost(vsp->numval))
+	return 0;
+    if (vsp->numval != 1) {
+	printf("fetch %d: context numval %d\n", f, vsp->numval);
+	errors++;
+    } else if (*context == -1) {
+	*context = vsp->vlist[0].value.lval;
+    } else if (vsp->vlist[0].value.lval != *context) {
+	printf("fetch %d: reply for context %d, not %d\n", f,
+		vsp->vlist[0].value.lval, *context);
+	errors++;
+    }
+    vsp = rp->vset[2];
+    if (vsp->numval != NINST) {
+	printf("fetch %d: expected %d values, got %d\n", f, NINST, vsp->numval);
+	errors++;
+    }
+    for (i = 0; i < vsp->numval; i++) {
+	pmExtractValue(vsp->valfmt, &vsp->vlist[i], PM_TYPE_U64, &atom, PM_TYPE_U64);
+	if (atom.ull != (__uint64_t)*context * 1000 + vsp->vlist[i].inst) {
+	    printf("fetch %d: inst %d value %llu\n", f,
+		    vsp->vlist[i].inst, (unsigned long long)atom.ull);
+	    errors++;
+	}
+    }
+    return errors;
+}
+
+static void *
+client(void *arg)
+{
+    intptr_t	errors = 0;
+    pmResult	*rp;
+    pmInDom	indom = pmInDom_build(FORQA, 0);
+    char	*buffer;
+    char	**names;
+    int		*insts;
+    int		c, f, sts, context = -1;
+
+    (void)arg;
+    if ((c = pmNewContext(PM_CONTEXT_HOST, host)) < 0) {
+	printf("pmNewContext: %s\n", pmErrStr(c));
+	return (void *)1;
+    }
+    for (f = 0; f < nfetches; f++) {
+	if ((sts = pmFetch(3, pmids, &rp)) < 0) {
+	    printf("pmFetch: %s\n", pmErrStr(sts));
+	    errors++;
+	    break;
+	}
+	errors += check_fetch(rp, f, &context);
+	pmFreeResult(rp);
+
+	if ((sts = pmGetInDom(indom, &insts, &names)) < 0 && agent_lost(sts))
+	    ;
+	else if (sts != NINST) {
+	    printf("pmGetInDom: %s\n", sts < 0 ? pmErrStr(sts) : "wrong count");
+	    errors++;
+	}
+	if (sts > 0) {
+	    free(insts);
+	    free(names);
+	}
+	/* no help text, but the request goes all the way to the PMDA */
+	if ((sts = pmLookupText(pmids[f % 3], PM_TEXT_ONELINE, &buffer)) == 0)
+	    free(buffer);
+	else if (sts != PM_ERR_TEXT && !agent_lost(sts)) {
+	    printf("pmLookupText: %s\n", pmErrStr(sts));
+	    errors++;
+	}
+    }
+    pmDestroyContext(c);
+    return (void *)errors;
+}
+
+int
+main(int argc, char **argv)
+{
+    pthread_t	threads[MAXCLIENTS];
+    pmResult	*rp;
+    void	*status;
+    int		c, i, sts, errflag = 0, errors = 0;
+    int		nclients = 8;
+
+    pmSetProgname(argv[0]);
+
+    while ((c = getopt(argc, argv, "c:D:f:h:l")) != EOF) {
+	switch (c) {
+
+	case 'c':
+	    nclients = atoi(optarg);
+	    break;
+
+	case 'D':	/* debug options */
+	    if (pmSetDebug(optarg) < 0) {
+		fprintf(stderr, "%s: unrecognized debug options specification (%s)\n",
+		    pmGetProgname(), optarg);
+		errflag++;
+	    }
+	    break;
+
+	case 'f':
+	    nfetches = atoi(optarg);
+	    break;
+
+	case 'h':
+	    host = optarg;
+	    break;
+
+	case 'l':
+	    lossok = 1;
+	    break;
+
+	case '?':
+	default:
+	    errflag++;
+	    break;
+	}
+    }
+
+    if (errflag || optind != argc || nclients < 1 || nclients > MAXCLIENTS ||
+	nfetches < 1) {
+	fprintf(stderr, "Usage: %s [-D debug] [-c clients] [-f fetches] [-h host] [-l]\n",
+		pmGetProgname());
+	exit(1);
+    }
+
+    for (i = 0; i < 5; i++)
+	pmids[i] = pmID_build(FORQA, 0, i);
+
+    for (i = 0; i < nclients; i++) {
+	if ((sts = pthread_create(&threads[i], NULL, client, NULL)) != 0) {
+	    printf("pthread_create: %s\n", pmErrStr(-sts));
+	    exit(1);
+	}
+    }
+    for (i = 0; i < nclients; i++) {
+	pthread_join(threads[i], &status);
+	errors += (int)(intptr_t)status;
+    }
+    printf("%d clients, %d fetches each: %s\n", nclients, nfetches,
+	    errors ? "FAILED" : "replies ok");
+    if (lossok) {
+	/* no agent left to report its concurrency */
+	printf("requests failed once agent lost: %s\n", nlost > 0 ? "yes" : "no");
+	if (pmDebugOptions.appl0)
+	    fprintf(stderr, "requests failed: %d\n", nlost);
+	exit(errors != 0);
+    }
+
+    if ((c = pmNewContext(PM_CONTEXT_HOST, host)) < 0) {
+	printf("pmNewContext: %s\n", pmErrStr(c));
+	exit(1);
+    }
+    if ((sts = pmFetch(2, &pmids[3], &rp)) < 0) {
+	printf("pmFetch: %s\n", pmErrStr(sts));
+	exit(1);
+    }
+    sts = rp->vset[0]->numval == 1 ? rp->vset[0]->vlist[0].value.lval : 0;
+    printf("concurrent fetches: %s\n", sts > 1 ? "yes" : "no");
+    if (pmDebugOptions.appl0)
+	fprintf(stderr, "maximum concurrent fetches: %d\n", sts);
+    sts = rp->vset[1]->numval == 1 ? rp->vset[1]->vlist[0].value.lval : 0;
+    printf("concurrent requests: %s\n", sts > 0 ? "yes" : "no");
+    pmFreeResult(rp);
+    pmDestroyContext(c);
+    exit(errors != 0);
+}
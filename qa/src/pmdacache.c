@@ -8,12 +8,34 @@ main(int argc, char **argv)
     int	indom = 123;
     int	sts;
     int c;
+    int	lo, hi;
+    int	inst;
+    char	*p;
+    char	name[32];
 
     pmSetProgname(argv[0]);
 
-    while ((c = getopt(argc, argv, "Cc:D:dh:LSs:")) != EOF) {
+    while ((c = getopt(argc, argv, "a:Cc:D:dh:Ll:nSs:")) != EOF) {
 	switch (c) {
 
+	case 'a':	/* add a range of instances, inst-<lo> ... inst-<hi> */
+	    lo = hi = (int)strtol(optarg, &p, 10);
+	    if (*p == '-')
+		hi = (int)strtol(p+1, &p, 10);
+	    if (*p != '\0' || lo < 0 || hi < lo) {
+		fprintf(stderr, "%s: bad range (%s)\n", pmGetProgname(), optarg);
+		errflag++;
+		break;
+	    }
+	    for (sts = 0; lo <= hi && sts >= 0; lo++) {
+		pmsprintf(name, sizeof(name), "inst-%d", lo);
+		sts = pmdaCacheStore(indom, PMDA_CACHE_ADD, name, NULL);
+	    }
+	    fprintf(stderr, "add(%s) -> %d", optarg, sts);
+	    if (sts < 0) fprintf(stderr, " %s", pmErrStr(sts));
+	    fputc('\n', stderr);
+	    break;
+
 	case 'C':
 	    sts = pmdaCacheOp(indom, PMDA_CACHE_CULL);
 	    fprintf(stderr, "cull() -> %d", sts);
@@ -59,6 +81,20 @@ main(int argc, char **argv)
 	    fputc('\n', stderr);
 	    break;
 
+	case 'l':
+	    sts = pmdaCacheLookupName(indom, optarg, &inst, NULL);
+	    fprintf(stderr, "lookup(%s) -> %d", optarg, sts);
+	    if (sts < 0) fprintf(stderr, " %s", pmErrStr(sts));
+	    else fprintf(stderr, " inst=%d", inst);
+	    fputc('\n', stderr);
+	    break;
+
+	case 'n':
+	    fprintf(stderr, "size: active=%d inactive=%d\n",
+		pmdaCacheOp(indom, PMDA_CACHE_SIZE_ACTIVE),
+		pmdaCacheOp(indom, PMDA_CACHE_SIZE_INACTIVE));
+	    break;
+
 	case 'S':
 	    sts = pmdaCacheOp(indom, PMDA_CACHE_SAVE);
 	    fprintf(stderr, "save() -> %d", sts);
@@ -83,12 +119,15 @@ main(int argc, char **argv)
     if (errflag) {
 	fprintf(stderr, "Usage: %s ...\n", pmGetProgname());
 	fprintf(stderr, "options:\n");
+	fprintf(stderr, "-a lo-hi       store inst-lo ... inst-hi\n");
 	fprintf(stderr, "-C             cull all\n");
 	fprintf(stderr, "-c inst        cull one\n");
 	fprintf(stderr, "-D debug\n");
 	fprintf(stderr, "-d             dump\n");
 	fprintf(stderr, "-h inst        hide\n");
 	fprintf(stderr, "-L             load\n");
+	fprintf(stderr, "-l inst        lookup\n");
+	fprintf(stderr, "-n             report number of entries\n");
 	fprintf(stderr, "-S             store\n");
 	fprintf(stderr, "-s inst        save\n");
 	exit(1);
@@ -1,5 +1,6 @@
 #include <pcp/pmapi.h>
 #include <pcp/pmda.h>
+#include <pthread.h>
 
 /*
  * Make a dummy event, timestamped now
@@ -83,11 +84,115 @@ void queue_events(int q, int context)
     fprintf(stderr, "end walk queue#%d\n", q);
 }
 
+/*
+ * Concurrent producer threads appending events to one queue, with
+ * each event identifying its producer and position in that stream,
+ * while the main thread fetches on behalf of a single client.
+ */
+typedef struct {
+    pthread_t	tid;
+    int		queueid;
+    int		thread;
+    int		count;
+} producer_t;
+
+typedef struct {
+    int		nthreads;
+    int		*next;		/* next expected event, per thread */
+    int		received;
+    int		bad;
+} consumer_t;
+
+static void
+fill_event(char *buffer, size_t size, int thread, int n)
+{
+    int i;
+
+    memcpy(buffer, &thread, sizeof(int));
+    memcpy(buffer + sizeof(int), &n, sizeof(int));
+    for (i = 2 * sizeof(int); i < size; i++)
+	buffer[i] = (char)(thread + n + i);
+}
+
+static void *
+producer(void *arg)
+{
+    producer_t *p = (producer_t *)arg;
+    struct timeval tv;
+    char buffer[256];
+    size_t size;
+    int n;
+
+    for (n = 0; n < p->count; n++) {
+	size = 2 * sizeof(int) + (n % 200);
+	fill_event(buffer, size, p->thread, n);
+	gettimeofday(&tv, NULL);
+	pmdaEventQueueAppend(p->queueid, buffer, size, &tv);
+    }
+    return NULL;
+}
+
+int stress_event(int key, void *event, size_t size,
+		 struct timeval *timestamp, void *data)
+{
+    consumer_t *c = (consumer_t *)data;
+    char expect[256];
+    int thread, n;
+
+    memcpy(&thread, event, sizeof(int));
+    memcpy(&n, (char *)event + sizeof(int), sizeof(int));
+    if (thread < 0 || thread >= c->nthreads || n < c->next[thread] ||
+	size != 2 * sizeof(int) + (n % 200)) {
+	c->bad++;
+	return 0;
+    }
+    fill_event(expect, size, thread, n);
+    if (memcmp(expect, event, size) != 0)
+	c->bad++;
+    c->next[thread] = n + 1;
+    c->received++;
+    return 0;
+}
+
+void queue_stress(int q, int context, int nthreads, int count)
+{
+    producer_t *producers = calloc(nthreads, sizeof(producer_t));
+    consumer_t consumer = { nthreads, calloc(nthreads, sizeof(int)) };
+    pmAtomValue records, dropped;
+    int i;
+
+    /* ensure this client is known to the queue before events arrive */
+    pmdaEventQueueRecords(q, &records, context, stress_event, &consumer);
+    for (i = 0; i < nthreads; i++) {
+	producers[i].queueid = q;
+	producers[i].thread = i;
+	producers[i].count = count;
+	pthread_create(&producers[i].tid, NULL, producer, &producers[i]);
+    }
+    for (i = 0; i < 1000; i++)
+	pmdaEventQueueRecords(q, &records, context, stress_event, &consumer);
+    for (i = 0; i < nthreads; i++)
+	pthread_join(producers[i].tid, NULL);
+    pmdaEventQueueRecords(q, &records, context, stress_event, &consumer);
+    pmdaEventQueueDropped(q, &dropped, context);
+
+    fprintf(stderr, "queue#%d client#%d stress: %d threads, %d events each: %s\n",
+	    q, context, nthreads, count,
+	    (consumer.bad == 0 &&
+	     consumer.received + (int)dropped.ull == nthreads * count) ?
+		"ok" : "FAILED");
+    fprintf(stderr, "received=%d dropped=%d bad=%d\n",
+	    consumer.received, (int)dropped.ull, consumer.bad);
+    free(consumer.next);
+    free(producers);
+}
+
 int
 main(int argc, char **argv)
 {
     int	c, sts;
     int errflag = 0;
+    int threads;
     int context, queueid;
     size_t size;
     size_t filter_size;
@@ -97,7 +202,7 @@ main(int argc, char **argv)
 
     pmSetProgname(argv[0]);
 
-    while ((c = getopt(argc, argv, "A:a:C:c:D:E:e:F:f:q:s:S:")) != EOF) {
+    while ((c = getopt(argc, argv, "A:a:C:c:D:E:e:F:f:q:s:S:t:")) != EOF) {
 	switch (c) {
 
 	case 'a':	/* disallow a clients queue access */
@@ -277,6 +382,26 @@ main(int argc, char **argv)
 	    queue_events(queueid, context);
 	    break;
 
+	case 't':	/* concurrent producers: ID,name,threads,events */
+	    s = optarg;
+	    context = atoi(strsep(&s, ","));
+	    name = strsep(&s, ",");
+	    if (!s || (queueid = pmdaEventQueueHandle(name)) < 0) {
+		fprintf(stderr, "%s: invalid stress test specification (%s)\n",
+			pmGetProgname(), optarg);
+		errflag++;
+		break;
+	    }
+	    threads = atoi(strsep(&s, ","));
+	    if (!s || threads <= 0) {
+		fprintf(stderr, "%s: invalid stress test events (%s)\n",
+			pmGetProgname(), optarg);
+		errflag++;
+		break;
+	    }
+	    queue_stress(queueid, context, threads, atoi(s));
+	    break;
+
 	case '?':
 	default:
 	    errflag++;
@@ -299,6 +424,7 @@ main(int argc, char **argv)
 	fprintf(stderr, "  -D debug\n");
 	fprintf(stderr, "  -s name        report statistics for a queue\n");
 	fprintf(stderr, "  -S id,name     report clients events in a queue\n");
+	fprintf(stderr, "  -t id,name,threads,events  concurrent appends\n");
 	exit(1);
     }
 
@@ -0,0 +1,546 @@
+/*
+ * Exercise pmdaSetThreads - concurrent fetches for different contexts,
+ * with replies sequenced back to the caller in request order.
+ *
+ * With -P this is a daemon PMDA on stdin/stdout, otherwise it is the
+ * driver, standing in for pmcd, that runs itself as the PMDA and sends
+ * it pipelined requests from several client contexts at once, along
+ * with instance, text and label requests to be answered meanwhile.
+ *
+ * The PMDA can also fail part way through, to check that pmcd answers
+ * every request pipelined to it - exiting (-x N) or hanging (-s N) in
+ * the Nth fetch, with others in progress and queued behind it.
+ *
+ * With -b the PMDA also registers a bulk fetch callback, producing
+ * all the values of the metric with an instance domain at once, and
+ * the same values must be returned as from the per-instance callback
+ * (-v reports every value fetched, for comparison).
+ *
+ * Copyright (c) 2019 Red Hat.
+ */
+
+#include <pcp/pmapi.h>
+#include <pcp/pmda.h>
+#include "libpcp.h"
+#include <pthread.h>
+#include <sys/wait.h>
+
+#define FORQA		251
+#define MAXCTX		64
+#define NINST		50
+#define NSUBSET		10	/* even instances, for even contexts */
+
+static pmdaIndom indomtab[] = {
+    { 0, 0, NULL },
+};
+
+static pmdaMetric metrictab[] = {
+    /* context */
+    { NULL, { PMDA_PMID(0,0), PM_TYPE_32, PM_INDOM_NULL, PM_SEM_DISCRETE,
+	PMDA_PMUNITS(0,0,0,0,0,0) } },
+    /* fetches */
+    { NULL, { PMDA_PMID(0,1), PM_TYPE_U32, PM_INDOM_NULL, PM_SEM_COUNTER,
+	PMDA_PMUNITS(0,0,1,0,0,PM_COUNT_ONE) } },
+    /* values */
+    { NULL, { PMDA_PMID(0,2), PM_TYPE_U64, 0, PM_SEM_INSTANT,
+	PMDA_PMUNITS(0,0,0,0,0,0) } },
+    /* concurrency */
+    { NULL, { PMDA_PMID(0,3), PM_TYPE_U32, PM_INDOM_NULL, PM_SEM_INSTANT,
+	PMDA_PMUNITS(0,0,0,0,0,0) } },
+    /* overlapped */
+    { NULL, { PMDA_PMID(0,4), PM_TYPE_U32, PM_INDOM_NULL, PM_SEM_COUNTER,
+	PMDA_PMUNITS(0,0,1,0,0,PM_COUNT_ONE) } },
+    /* bulk */
+    { NULL, { PMDA_PMID(0,5), PM_TYPE_U32, PM_INDOM_NULL, PM_SEM_COUNTER,
+	PMDA_PMUNITS(0,0,1,0,0,PM_COUNT_ONE) } },
+};
+
+static pthread_mutex_t	lock = PTHREAD_MUTEX_INITIALIZER;
+static unsigned int	fetches[MAXCTX];
+static unsigned int	active;
+static unsigned int	maxactive;
+static unsigned int	overlapped;	/* requests answered during fetches */
+static unsigned int	bulkcalls;	/* metrics fetched by bulk callback */
+static int		delay = 20;	/* msec per fetch */
+static unsigned int	nfetched;	/* fetches started, all contexts */
+static unsigned int	exitfetch;	/* exit in this fetch, if set */
+static unsigned int	stallfetch;	/* hang in this fetch, if set */
+static int		verbose;	/* report values fetched (driver) */
+
+static int
+threads_fetchCallBack(pmdaMetric *mdesc, unsigned int inst, pmAtomValue *atom)
+{
+    int		context = pmdaGetContext();
+
+    if (context < 0 || context >= MAXCTX)
+	return PM_ERR_NOCONTEXT;
+    pthread_mutex_lock(&lock);
+    switch (pmID_item(mdesc->m_desc.pmid)) {
+    case 0:
+	atom->l = context;
+	break;
+    case 1:
+	atom->ul = fetches[context];
+	break;
+    case 2:
+	atom->ull = (__uint64_t)context * 1000 + inst;
+	break;
+    case 3:
+	atom->ul = maxactive;
+	break;
+    case 4:
+	atom->ul = overlapped;
+	break;
+    case 5:
+	atom->ul = bulkcalls;
+	break;
+    default:
+	pthread_mutex_unlock(&lock);
+	return PM_ERR_PMID;
+    }
+    pthread_mutex_unlock(&lock);
+    return PMDA_FETCH_STATIC;
+}
+
+/* all instances of the values metric at once, the rest one at a time */
+static int
+threads_fetchBulkCallBack(pmdaMetric *mdesc, int numinst, const int *instlist,
+		pmAtomValue *avlist, int *stslist)
+{
+    int		context = pmdaGetContext();
+    int		i;
+
+    if (pmID_item(mdesc->m_desc.pmid) != 2)
+	return PM_ERR_NYI;
+    if (context < 0 || context >= MAXCTX)
+	return PM_ERR_NOCONTEXT;
+    for (i = 0; i < numinst; i++) {
+	avlist[i].ull = (__uint64_t)context * 1000 + instlist[i];
+	stslist[i] = PMDA_FETCH_STATIC;
+    }
+    pthread_mutex_lock(&lock);
+    bulkcalls++;
+    pthread_mutex_unlock(&lock);
+    return 0;
+}
+
+static int
+threads_fetch(int numpmid, pmID pmidlist[], pmResult **resp, pmdaExt *pmda)
+{
+    unsigned int	n;
+    int			sts;
+
+    if (pmda->e_context < 0 || pmda->e_context >= MAXCTX)
+	return PM_ERR_NOCONTEXT;
+    pthread_mutex_lock(&lock);
+    fetches[pmda->e_context]++;
+    if (++active > maxactive)
+	maxactive = active;
+    n = ++nfetched;
+    pthread_mutex_unlock(&lock);
+
+    /* long enough for other contexts to be fetched meanwhile */
+    usleep(delay * 1000);
+    if (n == exitfetch)
+	_exit(1);
+    if (n == stallfetch)
+	sleep(60);	/* well beyond the pmcd timeout */
+    sts = pmdaFetch(numpmid, pmidlist, resp, pmda);
+
+    pthread_mutex_lock(&lock);
+    active--;
+    pthread_mutex_unlock(&lock);
+    return sts;
+}
+
+/* note instance, text and label requests answered during fetches */
+static void
+threads_overlap(void)
+{
+    /* midway through a fetch that may have started alongside */
+    usleep(delay * 500);
+    pthread_mutex_lock(&lock);
+    if (active > 0)
+	overlapped++;
+    pthread_mutex_unlock(&lock);
+}
+
+static int
+threads_instance(pmInDom indom, int inst, char *name, pmInResult **result, pmdaExt *pmda)
+{
+    threads_overlap();
+    return pmdaInstance(indom, inst, name, result, pmda);
+}
+
+static int
+threads_text(int ident, int type, char **buffer, pmdaExt *pmda)
+{
+    threads_overlap();
+    return pmdaText(ident, type, buffer, pmda);
+}
+
+static int
+threads_label(int ident, int type, pmLabelSet **lp, pmdaExt *pmda)
+{
+    threads_overlap();
+    return pmdaLabel(ident, type, lp, pmda);
+}
+
+static int
+pmda(int nthreads, int bulk)
+{
+    pmdaInterface	dispatch;
+    char		name[16];
+    int			i;
+
+    pmdaDaemon(&dispatch, PMDA_INTERFACE_7, pmGetProgname(), FORQA, NULL, NULL);
+    dispatch.version.any.fetch = threads_fetch;
+    dispatch.version.any.instance = threads_instance;
+    dispatch.version.any.text = threads_text;
+    dispatch.version.seven.label = threads_label;
+    pmdaSetFetchCallBack(&dispatch, threads_fetchCallBack);
+    if (bulk)
+	pmdaSetFetchBulkCallBack(&dispatch, threads_fetchBulkCallBack);
+    pmdaSetThreads(&dispatch, nthreads);
+
+    pmdaInit(&dispatch, indomtab, 1, metrictab, sizeof(metrictab)/sizeof(metrictab[0]));
+    if (dispatch.status != 0) {
+	fprintf(stderr, "pmdaInit: %s\n", pmErrStr(dispatch.status));
+	return 1;
+    }
+    for (i = 0; i < NINST; i++) {
+	pmsprintf(name, sizeof(name), "inst-%02d", i);
+	pmdaCacheStore(indomtab[0].it_indom, PMDA_CACHE_ADD, name, NULL);
+    }
+    pmdaConnect(&dispatch);
+    pmdaMain(&dispatch);
+    return 0;
+}
+
+/*
+ * check one reply - first three metrics, for the given context, with
+ * all instances or (even contexts) those in the partial profile
+ */
+static int
+check_result(__pmPDU *pb, int context, unsigned int count)
+{
+    pmResult	*rp;
+    pmValueSet	*vsp;
+    pmAtomValue	atom;
+    int		i, sts, errors = 0;
+    int		ninst = (context % 2) ? NINST : NSUBSET;
+
+    if ((sts = __pmDecodeResult(pb, &rp)) < 0) {
+	printf("__pmDecodeResult: %s\n", pmErrStr(sts));
+	return 1;
+    }
+    vsp = rp->vset[0];
+    if (vsp->numval != 1 || vsp->vlist[0].value.lval != context) {
+	printf("context %d: got reply for context %d\n", context,
+		vsp->numval == 1 ? vsp->vlist[0].value.lval : vsp->numval);
+	errors++;
+    }
+    vsp = rp->vset[1];
+    if (vsp->numval != 1 || (unsigned int)vsp->vlist[0].value.lval != count) {
+	printf("context %d: expected fetch %u, got %d\n", context, count,
+		vsp->numval == 1 ? vsp->vlist[0].value.lval : vsp->numval);
+	errors++;
+    }
+    vsp = rp->vset[2];
+    if (vsp->numval != ninst) {
+	printf("context %d: expected %d values, got %d\n", context, ninst, vsp->numval);
+	errors++;
+    }
+    if (verbose)
+	printf("context %d fetch %u:", context, count);
+    for (i = 0; i < vsp->numval; i++) {
+	pmExtractValue(vsp->valfmt, &vsp->vlist[i], PM_TYPE_U64, &atom, PM_TYPE_U64);
+	if (ninst == NSUBSET &&
+	    (vsp->vlist[i].inst % 2 || vsp->vlist[i].inst >= NSUBSET * 2)) {
+	    printf("context %d: inst %d not in profile\n", context,
+		    vsp->vlist[i].inst);
+	    errors++;
+	}
+	if (verbose)
+	    printf(" %d=%llu", vsp->vlist[i].inst, (unsigned long long)atom.ull);
+	else if (atom.ull != (__uint64_t)context * 1000 + vsp->vlist[i].inst) {
+	    printf("context %d: inst %d value %llu\n", context,
+		    vsp->vlist[i].inst, (unsigned long long)atom.ull);
+	    errors++;
+	}
+    }
+    if (verbose)
+	putchar('\n');
+    pmFreeResult(rp);
+    return errors;
+}
+
+/* the pipelined requests from the driver */
+typedef struct {
+    int		fd;
+    int		ncontexts;
+    int		nfetches;
+    pmID	*pmids;
+} sendctl_t;
+
+/*
+ * Send every request without waiting for any reply, one round of fetches
+ * for all contexts at a time, each preceded by the context profile as
+ * pmcd would (some instances only, for even contexts).  Midway, instance,
+ * text and label requests for the first context precede the round - to
+ * be answered while the other contexts are fetched - and a descriptor
+ * request follows it.
+ */
+static void *
+send_requests(void *arg)
+{
+    sendctl_t		*ctl = (sendctl_t *)arg;
+    pmProfile		profile = { PM_PROFILE_INCLUDE, 0, NULL };
+    pmInDomProfile	subset;
+    pmProfile		partial = { PM_PROFILE_INCLUDE, 1, &subset };
+    int			subsetinst[NSUBSET];
+    pmTimeval		when = { 0, 0 };
+    pmInDom		indom = pmInDom_build(FORQA, 0);
+    pmID		*pmids = ctl->pmids;
+    int			c, f, i;
+
+    for (i = 0; i < NSUBSET; i++)
+	subsetinst[i] = i * 2;
+    subset.indom = indom;
+    subset.state = PM_PROFILE_EXCLUDE;	/* all but those listed */
+    subset.instances_len = NSUBSET;
+    subset.instances = subsetinst;
+
+    for (f = 0; f < ctl->nfetches; f++) {
+	if (f == ctl->nfetches / 2) {
+	    __pmSendInstanceReq(ctl->fd, 1, &when, indom, PM_IN_NULL, NULL);
+	    __pmSendTextReq(ctl->fd, 1, pmids[0], PM_TEXT_PMID|PM_TEXT_ONELINE);
+	    __pmSendLabelReq(ctl->fd, 1, FORQA, PM_LABEL_DOMAIN);
+	}
+	for (c = 1; c <= ctl->ncontexts; c++) {
+	    __pmSendProfile(ctl->fd, c, c, (c % 2) ? &profile : &partial);
+	    __pmSendFetch(ctl->fd, c, 0, NULL, 3, pmids);
+	}
+	if (f == ctl->nfetches / 2)
+	    __pmSendDescReq(ctl->fd, FROM_ANON, pmids[2]);
+    }
+    return NULL;
+}
+
+static int
+driver(char *self, int nthreads, int bulk, int ncontexts, int nfetches)
+{
+    __pmVersionCred	handshake;
+    __pmVersionCred	*vcp;
+    __pmCred		*credlist;
+    __pmPDU		*pb;
+    pmResult		*rp;
+    pmInResult		*inresult;
+    pmDesc		desc;
+    pmID		pmids[6];
+    pthread_t		sendthread;
+    sendctl_t		ctl;
+    pid_t		pid;
+    char		threads[16];
+    int			in[2], out[2];
+    int			c, f, i, sts, sender, count, errors = 0;
+
+    for (i = 0; i < 6; i++)
+	pmids[i] = pmID_build(FORQA, 0, i);
+    if (pipe(in) < 0 || pipe(out) < 0) {
+	perror("pipe");
+	return 1;
+    }
+    if ((pid = fork()) == 0) {
+	dup2(out[0], 0);
+	dup2(in[1], 1);
+	close(in[0]); close(in[1]); close(out[0]); close(out[1]);
+	pmsprintf(threads, sizeof(threads), "%d", nthreads);
+	execl(self, self, "-P", "-t", threads, bulk ? "-b" : NULL, NULL);
+	_exit(1);
+    }
+    close(in[1]);
+    close(out[0]);
+
+    /* credentials exchange, as pmcd does */
+    if ((sts = __pmGetPDU(in[0], ANY_SIZE, TIMEOUT_NEVER, &pb)) != PDU_CREDS ||
+	(sts = __pmDecodeCreds(pb, &sender, &count, &credlist)) < 0) {
+	printf("expected PDU_CREDS, got %d: %s\n", sts, pmErrStr(sts));
+	return 1;
+    }
+    vcp = (__pmVersionCred *)credlist;
+    printf("pipelining: %s\n", (vcp->c_flags & PDU_FLAG_PIPELINE) ? "yes" : "no");
+    free(credlist);
+    __pmUnpinPDUBuf(pb);
+    memset(&handshake, 0, sizeof(handshake));
+    handshake.c_type = CVERSION;
+    handshake.c_version = PDU_VERSION;
+    __pmSendCreds(out[1], getpid(), 1, (__pmCred *)&handshake);
+    __pmSetVersionIPC(in[0], PDU_VERSION);
+    __pmSetVersionIPC(out[1], PDU_VERSION);
+
+    /* replies are read meanwhile, so neither pipe can fill up for good */
+    ctl.fd = out[1];
+    ctl.ncontexts = ncontexts;
+    ctl.nfetches = nfetches;
+    ctl.pmids = pmids;
+    if ((sts = pthread_create(&sendthread, NULL, send_requests, &ctl)) != 0) {
+	printf("pthread_create: %s\n", pmErrStr(-sts));
+	return 1;
+    }
+
+    for (f = 0; f < nfetches; f++) {
+	if (f == nfetches / 2) {
+	    sts = __pmGetPDU(in[0], ANY_SIZE, TIMEOUT_NEVER, &pb);
+	    if (sts != PDU_INSTANCE) {
+		printf("expected PDU_INSTANCE, got %d\n", sts);
+		return 1;
+	    }
+	    if ((sts = __pmDecodeInstance(pb, &inresult)) < 0 ||
+		inresult->numinst != NINST) {
+		printf("bad instance reply: %s\n", pmErrStr(sts));
+		errors++;
+	    }
+	    if (sts >= 0)
+		__pmFreeInResult(inresult);
+	    __pmUnpinPDUBuf(pb);
+	    /* no help text, so an error reply */
+	    sts = __pmGetPDU(in[0], ANY_SIZE, TIMEOUT_NEVER, &pb);
+	    if (sts != PDU_TEXT && sts != PDU_ERROR) {
+		printf("expected PDU_TEXT, got %d\n", sts);
+		return 1;
+	    }
+	    __pmUnpinPDUBuf(pb);
+	    sts = __pmGetPDU(in[0], ANY_SIZE, TIMEOUT_NEVER, &pb);
+	    if (sts != PDU_LABEL) {
+		printf("expected PDU_LABEL, got %d\n", sts);
+		return 1;
+	    }
+	    __pmUnpinPDUBuf(pb);
+	}
+	for (c = 1; c <= ncontexts; c++) {
+	    sts = __pmGetPDU(in[0], ANY_SIZE, TIMEOUT_NEVER, &pb);
+	    if (sts != PDU_RESULT) {
+		printf("fetch %d context %d: expected PDU_RESULT, got %d\n", f, c, sts);
+		return 1;
+	    }
+	    errors += check_result(pb, c, f + 1);
+	    __pmUnpinPDUBuf(pb);
+	}
+	if (f == nfetches / 2) {
+	    sts = __pmGetPDU(in[0], ANY_SIZE, TIMEOUT_NEVER, &pb);
+	    if (sts != PDU_DESC) {
+		printf("expected PDU_DESC, got %d\n", sts);
+		return 1;
+	    }
+	    if ((sts = __pmDecodeDesc(pb, &desc)) < 0 || desc.pmid != pmids[2]) {
+		printf("bad descriptor reply: %s\n", pmErrStr(sts));
+		errors++;
+	    }
+	    __pmUnpinPDUBuf(pb);
+	}
+    }
+    printf("%d fetch replies for %d contexts: %s\n", nfetches * ncontexts,
+	    ncontexts, errors ? "FAILED" : "in order");
+    pthread_join(sendthread, NULL);
+
+    __pmSendFetch(out[1], 1, 0, NULL, 3, &pmids[3]);
+    if ((sts = __pmGetPDU(in[0], ANY_SIZE, TIMEOUT_NEVER, &pb)) != PDU_RESULT ||
+	__pmDecodeResult(pb, &rp) < 0) {
+	printf("concurrency fetch failed: %d\n", sts);
+	return 1;
+    }
+    sts = rp->vset[0]->numval == 1 ? rp->vset[0]->vlist[0].value.lval : 0;
+    printf("concurrent fetches: %s\n", sts > 1 ? "yes" : "no");
+    if (pmDebugOptions.appl0)
+	fprintf(stderr, "maximum concurrent fetches: %d\n", sts);
+    sts = rp->vset[1]->numval == 1 ? rp->vset[1]->vlist[0].value.lval : 0;
+    printf("concurrent requests: %s\n", sts > 0 ? "yes" : "no");
+    sts = rp->vset[2]->numval == 1 ? rp->vset[2]->vlist[0].value.lval : 0;
+    printf("bulk fetch callback: %s\n", sts > 0 ? "used" : "not used");
+    pmFreeResult(rp);
+    __pmUnpinPDUBuf(pb);
+
+    close(out[1]);
+    waitpid(pid, &sts, 0);
+    close(in[0]);
+    if (WIFEXITED(sts) && WEXITSTATUS(sts) != 0) {
+	printf("PMDA exit status %d\n", WEXITSTATUS(sts));
+	errors++;
+    }
+    return errors != 0;
+}
+
+int
+main(int argc, char **argv)
+{
+    int		c, errflag = 0, pmdamode = 0, bulk = 0;
+    int		nthreads = 4, ncontexts = 4, nfetches = 5;
+
+    pmSetProgname(argv[0]);
+
+    while ((c = getopt(argc, argv, "bc:D:d:f:Ps:t:vx:")) != EOF) {
+	switch (c) {
+
+	case 'b':
+	    bulk = 1;
+	    break;
+
+	case 'c':
+	    ncontexts = atoi(optarg);
+	    break;
+
+	case 'D':	/* debug options */
+	    if (pmSetDebug(optarg) < 0) {
+		fprintf(stderr, "%s: unrecognized debug options specification (%s)\n",
+		    pmGetProgname(), optarg);
+		errflag++;
+	    }
+	    break;
+
+	case 'd':
+	    delay = atoi(optarg);
+	    break;
+
+	case 'f':
+	    nfetches = atoi(optarg);
+	    break;
+
+	case 'P':
+	    pmdamode = 1;
+	    break;
+
+	case 's':
+	    stallfetch = atoi(optarg);
+	    break;
+
+	case 't':
+	    nthreads = atoi(optarg);
+	    break;
+
+	case 'v':
+	    verbose = 1;
+	    break;
+
+	case 'x':
+	    exitfetch = atoi(optarg);
+	    break;
+
+	case '?':
+	default:
+	    errflag++;
+	    break;
+	}
+    }
+
+    if (errflag || optind != argc || ncontexts < 1 || ncontexts >= MAXCTX ||
+	nfetches < 1) {
+	fprintf(stderr, "Usage: %s [-b] [-D debug] [-c contexts] [-d msec] [-f fetches] [-s fetch] [-t threads] [-v] [-x fetch]\n",
+		pmGetProgname());
+	exit(1);
+    }
+
+    if (pmdamode)
+	exit(pmda(nthreads, bulk));
+    exit(driver(argv[0], nthreads, bulk, ncontexts, nfetches));
+}
@@ -0,0 +1,132 @@
+/*
+ * Load the default PMNS, from a compiled image if pmnscomp has made
+ * a current one, and report every name with its PMID and all of the
+ * names for that PMID.  Then unload and load it again.
+ *
+ * Copyright (c) 2019 Red Hat.
+ */
+
+#include <pcp/pmapi.h>
+
+static int	numnames;
+static int	maxnames;
+static char	**names;
+
+static void
+dometric(const char *name)
+{
+    if (numnames == maxnames) {
+	maxnames = maxnames ? maxnames * 2 : 256;
+	if ((names = (char **)realloc(names, maxnames * sizeof(char *))) == NULL) {
+	    perror("realloc");
+	    exit(1);
+	}
+    }
+    if ((names[numnames++] = strdup(name)) == NULL) {
+	perror("strdup");
+	exit(1);
+    }
+}
+
+static int
+compar(const void *a, const void *b)
+{
+    return strcmp(*(char **)a, *(char **)b);
+}
+
+static int
+report(int verbose)
+{
+    pmID	pmid;
+    char	**allnames;
+    int		i, j, n, sts;
+
+    numnames = 0;
+    if ((sts = pmTraversePMNS("", dometric)) < 0) {
+	printf("pmTraversePMNS: %s\n", pmErrStr(sts));
+	return sts;
+    }
+    qsort(names, numnames, sizeof(char *), compar);
+    for (i = 0; i < numnames; i++) {
+	if ((sts = pmLookupName(1, &names[i], &pmid)) < 0) {
+	    printf("pmLookupName(%s): %s\n", names[i], pmErrStr(sts));
+	    continue;
+	}
+	if ((n = pmNameAll(pmid, &allnames)) < 0) {
+	    printf("pmNameAll(%s): %s\n", pmIDStr(pmid), pmErrStr(n));
+	    continue;
+	}
+	qsort(allnames, n, sizeof(char *), compar);
+	if (verbose) {
+	    printf("%s %s", names[i], pmIDStr(pmid));
+	    for (j = 0; j < n; j++)
+		printf(" %s", allnames[j]);
+	    putchar('\n');
+	}
+	free(allnames);
+    }
+    for (i = 0; i < numnames; i++)
+	free(names[i]);
+    return numnames;
+}
+
+int
+main(int argc, char **argv)
+{
+    int		c, n, sts;
+    int		dupok = 1;
+    int		errflag = 0;
+    int		verbose = 0;
+
+    pmSetProgname(argv[0]);
+
+    while ((c = getopt(argc, argv, "D:vx")) != EOF) {
+	switch (c) {
+
+	case 'D':	/* debug options */
+	    if ((sts = pmSetDebug(optarg)) < 0) {
+		fprintf(stderr, "%s: unrecognized debug options specification (%s)\n",
+		    pmGetProgname(), optarg);
+		errflag++;
+	    }
+	    break;
+
+	case 'v':	/* report every name */
+	    verbose++;
+	    break;
+
+	case 'x':	/* duplicate PMIDs are not allowed */
+	    dupok = 0;
+	    break;
+
+	case '?':
+	default:
+	    errflag++;
+	    break;
+	}
+    }
+
+    if (errflag || optind != argc) {
+	fprintf(stderr, "Usage: %s [-D debug] [-vx]\n", pmGetProgname());
+	exit(1);
+    }
+
+    if ((sts = pmLoadASCIINameSpace(PM_NS_DEFAULT, dupok)) < 0) {
+	printf("pmLoadASCIINameSpace: %s\n", pmErrStr(sts));
+	exit(1);
+    }
+    if ((n = report(verbose)) < 0)
+	exit(1);
+    printf("%d names\n", n);
+
+    pmUnloadNameSpace();
+    if ((sts = pmLoadASCIINameSpace(PM_NS_DEFAULT, dupok)) < 0) {
+	printf("reload: pmLoadASCIINameSpace: %s\n", pmErrStr(sts));
+	exit(1);
+    }
+    if ((sts = report(0)) != n)
+	printf("reload: %d names, expected %d\n", sts, n);
+    pmUnloadNameSpace();
+
+    return 0;
+}
@@ -0,0 +1,273 @@
+/*
+ * Copyright (c) 2019 Red Hat.
+ *
+ * Compare JSON and columnar binary encoding of /series/query values
+ * as produced by pmproxy - wire size, encode time and round-trip.
+ */
+#include <pcp/pmapi.h>
+#include <pcp/sds.h>
+#include <sys/time.h>
+#include "columns.h"
+
+static int	nseries = 8;
+static int	ninsts = 16;
+static int	npoints = 720;
+static int	timing;
+static int	strings;
+
+static const char *
+sid(int s, char *buffer)
+{
+    pmsprintf(buffer, 41, "%040x", 0x1000 + s);
+    return buffer;
+}
+
+static const char *
+iid(int s, int i, char *buffer)
+{
+    pmsprintf(buffer, 41, "%040x", 0x100000 + s * 0x1000 + i);
+    return buffer;
+}
+
+static sds
+value(sds data, int s, int i, int p)
+{
+    sdsclear(data);
+    if (strings)
+	return sdscatfmt(data, "string-%i", (s + i + p / 16) % 7);
+    if (s % 2)	/* counter-like */
+	return sdscatfmt(data, "%U",
+		(unsigned long long)(s * 1000000 + i * 1000 + p * (i + 1) * 3));
+    /* instantaneous, rate-converted */
+    return sdscatprintf(data, "%.6f",
+		(double)((s + 1) * (i + 1) * ((p * 7919) % 101)) / 100.0);
+}
+
+/* same layout as on_pmseries_value() in pmproxy series.c */
+static sds
+encode_json(sds result)
+{
+    char	sbuf[48], ibuf[48];
+    sds		timestamp = sdsempty(), data = sdsempty();
+    int		s, i, p, count = 0;
+
+    for (s = 0; s < nseries; s++) {
+	for (p = 0; p < npoints; p++) {
+	    sdsclear(timestamp);
+	    timestamp = sdscatfmt(timestamp, "%U.%u",
+			1547483646000ULL + p * 10000ULL, 0);
+	    for (i = 0; i < ninsts; i++) {
+		data = value(data, s, i, p);
+		result = sdscatfmt(result, "%s{\"series\":\"%s\",",
+				count++ ? "," : "[", sid(s, sbuf));
+		result = sdscatfmt(result, "\"instance\":\"%s\",",
+				iid(s, i, ibuf));
+		result = sdscatfmt(result, "\"timestamp\":%S,", timestamp);
+		result = sdscatfmt(result, "\"value\":\"%S\"}", data);
+	    }
+	}
+    }
+    sdsfree(timestamp);
+    sdsfree(data);
+    return sdscatlen(result, "]\r\n", 3);
+}
+
+static sds
+encode_columns(sds result)
+{
+    seriesColumns	*columns = seriesColumnsCreate();
+    char		sbuf[48], ibuf[48];
+    sds			timestamp = sdsempty(), data = sdsempty();
+    sds			series = sdsempty(), instance = sdsempty();
+    int			s, i, p;
+
+    for (s = 0; s < nseries; s++) {
+	series = sdscpy(series, sid(s, sbuf));
+	for (p = 0; p < npoints; p++) {
+	    sdsclear(timestamp);
+	    timestamp = sdscatfmt(timestamp, "%U.%u",
+			1547483646000ULL + p * 10000ULL, 0);
+	    for (i = 0; i < ninsts; i++) {
+		data = value(data, s, i, p);
+		instance = sdscpy(instance, iid(s, i, ibuf));
+		if (seriesColumnsAppend(columns, series, instance,
+					timestamp, data) < 0) {
+		    fprintf(stderr, "seriesColumnsAppend failed\n");
+		    exit(1);
+		}
+	    }
+	}
+    }
+    result = seriesColumnsEncode(columns, result);
+    seriesColumnsFree(columns);
+    sdsfree(timestamp);
+    sdsfree(data);
+    sdsfree(series);
+    sdsfree(instance);
+    return result;
+}
+
+static __uint64_t
+varint(const unsigned char **pp)
+{
+    const unsigned char	*p = *pp;
+    __uint64_t		value = 0;
+    int			shift = 0;
+
+    do {
+	value |= (__uint64_t)(*p & 0x7f) << shift;
+	shift += 7;
+    } while (*p++ & 0x80);
+    *pp = p;
+    return value;
+}
+
+static __int64_t
+zigzag(__uint64_t value)
+{
+    return (__int64_t)(value >> 1) ^ -(__int64_t)(value & 1);
+}
+
+/* decode the binary response, checking it against the generated input */
+static int
+verify_columns(sds buffer)
+{
+    const unsigned char	*p = (const unsigned char *)buffer;
+    __uint64_t		stamp, bits, xor;
+    __int64_t		delta;
+    double		d;
+    char		sbuf[48], ibuf[48];
+    sds			data = sdsempty(), text = sdsempty();
+    int			c, n, count, type, seq, lz, nbytes, b, s, i;
+
+    if (memcmp(p, "PCPS", 4) != 0 || p[4] != 1)
+	return -1;
+    p += 5;
+    if ((n = varint(&p)) != nseries * ninsts)
+	return -2;
+    for (c = 0; c < n; c++) {
+	s = c / ninsts;
+	i = c % ninsts;
+	if ((b = varint(&p)) != 40 || memcmp(p, sid(s, sbuf), 40) != 0)
+	    return -3;
+	p += b;
+	if ((b = varint(&p)) != 40 || memcmp(p, iid(s, i, ibuf), 40) != 0)
+	    return -4;
+	p += b;
+	if ((count = varint(&p)) != npoints)
+	    return -5;
+	type = *p++;
+	seq = *p++;
+	stamp = 0;
+	delta = 0;
+	for (b = 0; b < count; b++) {
+	    if (b == 0)
+		stamp = varint(&p);
+	    else {
+		delta += zigzag(varint(&p));
+		stamp += delta;
+	    }
+	    if (stamp != 1547483646000ULL + b * 10000ULL)
+		return -6;
+	}
+	if (seq)
+	    return -7;
+	bits = 0;
+	for (b = 0; b < count; b++) {
+	    data = value(data, s, i, b);
+	    if (type == SERIES_COLUMN_DOUBLE) {
+		if ((xor = *p++) != 0) {
+		    lz = (xor >> 4) & 0x7;
+		    nbytes = xor & 0xf;
+		    for (xor = 0; nbytes > 0; nbytes--, lz++)
+			xor |= (__uint64_t)*p++ << (56 - lz * 8);
+		    bits ^= xor;
+		}
+		memcpy(&d, &bits, sizeof(d));
+		if (d != strtod(data, NULL))
+		    return -8;
+	    } else {
+		nbytes = varint(&p);
+		text = sdscpylen(text, (const char *)p, nbytes);
+		p += nbytes;
+		if (sdscmp(text, data) != 0)
+		    return -9;
+	    }
+	}
+    }
+    sdsfree(data);
+    sdsfree(text);
+    return (p == (const unsigned char *)buffer + sdslen(buffer)) ? 0 : -10;
+}
+
+static double
+elapsed(struct timeval *start)
+{
+    struct timeval	now;
+
+    gettimeofday(&now, NULL);
+    return pmtimevalSub(&now, start);
+}
+
+int
+main(int argc, char **argv)
+{
+    struct timeval	start;
+    double		jtime, ctime;
+    sds			json, columns;
+    int			c, sts, errflag = 0;
+
+    pmSetProgname(argv[0]);
+    while ((c = getopt(argc, argv, "i:n:p:st?")) != EOF) {
+	switch (c) {
+	case 'i':
+	    ninsts = atoi(optarg);
+	    break;
+	case 'n':
+	    nseries = atoi(optarg);
+	    break;
+	case 'p':
+	    npoints = atoi(optarg);
+	    break;
+	case 's':
+	    strings = 1;
+	    break;
+	case 't':
+	    timing = 1;
+	    break;
+	case '?':
+	default:
+	    errflag++;
+	    break;
+	}
+    }
+    if (errflag || optind != argc || nseries < 1 || ninsts < 1 || npoints < 1) {
+	fprintf(stderr, "Usage: %s [-st] [-i insts] [-n series] [-p points]\n",
+		pmGetProgname());
+	exit(1);
+    }
+
+    gettimeofday(&start, NULL);
+    json = encode_json(sdsempty());
+    jtime = elapsed(&start);
+
+    gettimeofday(&start, NULL);
+    columns = encode_columns(sdsempty());
+    ctime = elapsed(&start);
+
+    printf("values: %d series x %d instances x %d points (%s)\n",
+		nseries, ninsts, npoints, strings ? "strings" : "numbers");
+    printf("json: %zu bytes\n", sdslen(json));
+    printf("columns: %zu bytes (%.1f%%)\n", sdslen(columns),
+		100.0 * sdslen(columns) / sdslen(json));
+    if (timing)
+	printf("encode time: json %.6f sec, columns %.6f sec\n", jtime, ctime);
+    if ((sts = verify_columns(columns)) < 0)
+	printf("round-trip: FAILED (%d)\n", sts);
+    else
+	printf("round-trip: ok\n");
+
+    sdsfree(json);
+    sdsfree(columns);
+    return sts < 0;
+}
@@ -0,0 +1,211 @@
+/*
+ * Exercise pmcd connection sharing between host contexts - several
+ * contexts to the one pmcd, each with a different instance profile,
+ * fetching in turn, across a reconnect, with exclusive contexts, without
+ * sharing requested and as contexts sharing a connection are destroyed.
+ *
+ * Copyright (c) 2019 Red Hat.
+ */
+
+#include <pcp/pmapi.h>
+#include "libpcp.h"
+
+#define MAXCTX		16
+
+static int	ctxlist[MAXCTX];
+static int	instlist[MAXCTX];
+static int	nctx = 4;
+static pmID	pmid;
+static int	errors;
+
+static int
+connection(int ctx)
+{
+    __pmContext	*ctxp;
+    int		fd;
+
+    if ((ctxp = __pmHandleToPtr(ctx)) == NULL)
+	return -1;
+    fd = ctxp->c_pmcd->pc_fd;
+    PM_UNLOCK(ctxp->c_lock);
+    return fd;
+}
+
+static void
+connections(const char *when)
+{
+    int		fds[MAXCTX];
+    int		i, j, n, nfd = 0;
+
+    for (i = n = 0; i < nctx; i++) {
+	if (ctxlist[i] < 0)
+	    continue;
+	n++;
+	fds[i] = connection(ctxlist[i]);
+	for (j = 0; j < i; j++) {
+	    if (ctxlist[j] >= 0 && fds[j] == fds[i])
+		break;
+	}
+	if (j == i)
+	    nfd++;
+    }
+    printf("%s: %d contexts, %d connections\n", when, n, nfd);
+    if (pmDebugOptions.appl0)
+	__pmDumpContext(stderr, -1, PM_INDOM_NULL);
+}
+
+static void
+fetchall(const char *when)
+{
+    pmResult	*rp;
+    int		i, sts, bad = 0;
+
+    for (i = 0; i < nctx; i++) {
+	if (ctxlist[i] < 0)
+	    continue;
+	pmUseContext(ctxlist[i]);
+	if ((sts = pmFetch(1, &pmid, &rp)) < 0) {
+	    printf("%s: context %d: pmFetch: %s\n", when, i, pmErrStr(sts));
+	    bad++;
+	    continue;
+	}
+	if (rp->vset[0]->numval != 1 ||
+	    rp->vset[0]->vlist[0].inst != instlist[i]) {
+	    printf("%s: context %d: %d values, first inst %d, expected inst %d\n",
+		    when, i, rp->vset[0]->numval,
+		    rp->vset[0]->numval > 0 ? rp->vset[0]->vlist[0].inst : -1,
+		    instlist[i]);
+	    bad++;
+	}
+	pmFreeResult(rp);
+    }
+    printf("%s: %s\n", when, bad ? "FAILED" : "ok");
+    errors += bad;
+}
+
+int
+main(int argc, char **argv)
+{
+    int		c, i, sts;
+    int		exclusive = 0;
+    int		shared = PM_CTXFLAG_SHARED;
+    int		errflag = 0;
+    int		ninst;
+    int		*insts;
+    char	**names;
+    char	*host = "local:";
+    char	*name;
+    pmDesc	desc;
+
+    pmSetProgname(argv[0]);
+
+    while ((c = getopt(argc, argv, "c:D:h:ux?")) != EOF) {
+	switch (c) {
+	case 'c':
+	    nctx = atoi(optarg);
+	    if (nctx < 2 || nctx > MAXCTX) {
+		fprintf(stderr, "%s: -c must be between 2 and %d\n",
+			pmGetProgname(), MAXCTX);
+		errflag++;
+	    }
+	    break;
+	case 'D':
+	    if ((sts = pmSetDebug(optarg)) < 0) {
+		fprintf(stderr, "%s: unrecognized debug options specification (%s)\n",
+			pmGetProgname(), optarg);
+		errflag++;
+	    }
+	    break;
+	case 'h':
+	    host = optarg;
+	    break;
+	case 'u':
+	    shared = 0;
+	    break;
+	case 'x':
+	    exclusive = 1;
+	    break;
+	case '?':
+	default:
+	    errflag++;
+	    break;
+	}
+    }
+
+    if (errflag || optind != argc - 1) {
+	fprintf(stderr, "Usage: %s [-c count] [-D debug] [-h host] [-ux] metric\n",
+		pmGetProgname());
+	exit(1);
+    }
+    name = argv[optind];
+
+    /*
+     * sharing is requested unless -u is given, and with -x every second
+     * context will not share its connection
+     */
+    for (i = 0; i < nctx; i++) {
+	int	type = PM_CONTEXT_HOST | shared;
+
+	if (exclusive && (i % 2) == 1)
+	    type |= PM_CTXFLAG_EXCLUSIVE;
+	if ((ctxlist[i] = pmNewContext(type, host)) < 0) {
+	    fprintf(stderr, "%s: pmNewContext(%s): %s\n",
+		    pmGetProgname(), host, pmErrStr(ctxlist[i]));
+	    exit(1);
+	}
+    }
+
+    if ((sts = pmLookupName(1, &name, &pmid)) < 0) {
+	fprintf(stderr, "%s: pmLookupName(%s): %s\n",
+		pmGetProgname(), name, pmErrStr(sts));
+	exit(1);
+    }
+    if ((sts = pmLookupDesc(pmid, &desc)) < 0) {
+	fprintf(stderr, "%s: pmLookupDesc(%s): %s\n",
+		pmGetProgname(), name, pmErrStr(sts));
+	exit(1);
+    }
+    if (desc.indom == PM_INDOM_NULL) {
+	fprintf(stderr, "%s: %s has no instance domain\n", pmGetProgname(), name);
+	exit(1);
+    }
+    if ((ninst = pmGetInDom(desc.indom, &insts, &names)) < 2) {
+	fprintf(stderr, "%s: pmGetInDom(%s): %s\n", pmGetProgname(),
+		pmInDomStr(desc.indom), ninst < 0 ? pmErrStr(ninst) : "too few instances");
+	exit(1);
+    }
+
+    /* a different instance in the profile of each context */
+    for (i = 0; i < nctx; i++) {
+	instlist[i] = insts[i % ninst];
+	pmUseContext(ctxlist[i]);
+	pmDelProfile(desc.indom, 0, NULL);
+	pmAddProfile(desc.indom, 1, &instlist[i]);
+    }
+    free(insts);
+    free(names);
+
+    connections("created");
+    fetchall("first fetch");
+    fetchall("second fetch");
+
+    /* all contexts sharing the connection must send their profile again */
+    pmUseContext(ctxlist[0]);
+    if ((sts = pmReconnectContext(ctxlist[0])) < 0) {
+	printf("pmReconnectContext: %s\n", pmErrStr(sts));
+	errors++;
+    }
+    connections("reconnected");
+    fetchall("after reconnect");
+
+    /* the connection stays open until the last context using it goes */
+    for (i = 0; i < nctx - 1; i++) {
+	pmDestroyContext(ctxlist[i]);
+	ctxlist[i] = -1;
+    }
+    connections("destroyed");
+    fetchall("last context");
+
+    printf("%d errors\n", errors);
+    exit(errors != 0);
+}
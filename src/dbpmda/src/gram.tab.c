@@ -0,0 +1,2659 @@
+/* A Bison parser, made by GNU Bison 3.8.2.  */
+
+/* Bison implementation for Yacc-like parsers in C
+
+   Copyright (C) 1984, 1989-1990, 2000-2015, 2018-2021 Free Software Foundation,
+   Inc.
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <https://www.gnu.org/licenses/>.  */
+
+/* As a special exception, you may create a larger work that contains
+   part or all of the Bison parser skeleton and distribute that work
+   under terms of your choice, so long as that work isn't itself a
+   parser generator using the skeleton or a modified version thereof
+   as a parser skeleton.  Alternatively, if you modify or redistribute
+   the parser skeleton itself, you may (at your option) remove this
+   special exception, which will cause the skeleton and the resulting
+   Bison output files to be licensed under the GNU General Public
+   License without this special exception.
+
+   This special exception was added by the Free Software Foundation in
+   version 2.2 of Bison.  */
+
+/* C LALR(1) parser skeleton written by Richard Stallman, by
+   simplifying the original so-called "semantic" parser.  */
+
+/* DO NOT RELY ON FEATURES THAT ARE NOT DOCUMENTED in the manual,
+   especially those whose name start with YY_ or yy_.  They are
+   private implementation details that can be changed or removed.  */
+
+/* All symbols defined below should begin with yy or YY, to avoid
+   infringing on user name space.  This should be done even for local
+   variables, as they might otherwise be expanded by user macros.
+   There are some unavoidable exceptions within include files to
+   define necessary library symbols; they are noted "INFRINGES ON
+   USER NAME SPACE" below.  */
+
+/* Identify Bison output, and Bison version.  */
+#define YYBISON 30802
+
+/* Bison version string.  */
+#define YYBISON_VERSION "3.8.2"
+
+/* Skeleton name.  */
+#define YYSKELETON_NAME "yacc.c"
+
+/* Pure parsers.  */
+#define YYPURE 0
+
+/* Push parsers.  */
+#define YYPUSH 0
+
+/* Pull parsers.  */
+#define YYPULL 1
+
+
+
+
+/* First part of user prologue.  */
+#line 16 "gram.y"
+
+#include "./dbpmda.h"
+#include "./lex.h"
+
+extern int stmt_type;
+
+static union {
+    pmID	whole;
+    __pmID_int	part;
+} pmid;
+
+static union {
+    pmInDom		whole;
+    __pmInDom_int	part;
+} indom;
+
+
+static int	sts;
+static int	inst;
+static char	*str;
+#define MYWARNSTRSZ 80
+static char	warnStr[MYWARNSTRSZ];
+
+param_t	param;
+
+/*
+ * pmidp may contain a dynamic PMID ... if so, ask the PMDA to
+ * translate name if possible
+ */
+static int
+fix_dynamic_pmid(char *name, pmID *pmidp)
+{
+    int		sts;
+    __pmPDU	*pb;
+    extern int	toPMDA;
+    extern int	fromPMDA;
+    extern pmdaInterface	dispatch;
+
+    if (IS_DYNAMIC_ROOT(*pmidp)) {
+	if (connmode == CONN_DSO) {
+	    if (dispatch.comm.pmda_interface >= PMDA_INTERFACE_4) {
+		sts = dispatch.version.four.pmid(name, pmidp, dispatch.version.four.ext);
+		if (sts < 0) return sts;
+	    }
+	}
+	else if (connmode == CONN_DAEMON) {
+	    sts = __pmSendNameList(toPMDA, FROM_ANON, 1, &name, NULL);
+	    if (sts < 0) return sts;
+	    sts = __pmGetPDU(fromPMDA, ANY_SIZE, TIMEOUT_NEVER, &pb);
+	    if (sts < 0) return sts;
+	    if (sts == PDU_PMNS_IDS) {
+		int	xsts;
+		sts = __pmDecodeIDList(pb, 1, pmidp, &xsts);
+		__pmUnpinPDUBuf(pb);
+		if (sts < 0) return sts;
+		return xsts;
+	    }
+	    else if (sts == PDU_ERROR) {
+		__pmDecodeError(pb, &sts);
+		__pmUnpinPDUBuf(pb);
+		return sts;
+	    }
+	}
+    }
+    return 0;
+}
+
+
+
+#line 141 "gram.tab.c"
+
+# ifndef YY_CAST
+#  ifdef __cplusplus
+#   define YY_CAST(Type, Val) static_cast<Type> (Val)
+#   define YY_REINTERPRET_CAST(Type, Val) reinterpret_cast<Type> (Val)
+#  else
+#   define YY_CAST(Type, Val) ((Type) (Val))
+#   define YY_REINTERPRET_CAST(Type, Val) ((Type) (Val))
+#  endif
+# endif
+# ifndef YY_NULLPTR
+#  if defined __cplusplus
+#   if 201103L <= __cplusplus
+#    define YY_NULLPTR nullptr
+#   else
+#    define YY_NULLPTR 0
+#   endif
+#  else
+#   define YY_NULLPTR ((void*)0)
+#  endif
+# endif
+
+#include "gram.tab.h"
+/* Symbol kind.  */
+enum yysymbol_kind_t
+{
+  YYSYMBOL_YYEMPTY = -2,
+  YYSYMBOL_YYEOF = 0,                      /* "end of file"  */
+  YYSYMBOL_YYerror = 1,                    /* error  */
+  YYSYMBOL_YYUNDEF = 2,                    /* "invalid token"  */
+  YYSYMBOL_NUMBER2D = 3,                   /* NUMBER2D  */
+  YYSYMBOL_NUMBER3D = 4,                   /* NUMBER3D  */
+  YYSYMBOL_NUMBER = 5,                     /* NUMBER  */
+  YYSYMBOL_NEGNUMBER = 6,                  /* NEGNUMBER  */
+  YYSYMBOL_FLAG = 7,                       /* FLAG  */
+  YYSYMBOL_NAME = 8,                       /* NAME  */
+  YYSYMBOL_PATHNAME = 9,                   /* PATHNAME  */
+  YYSYMBOL_MACRO = 10,                     /* MACRO  */
+  YYSYMBOL_STRING = 11,                    /* STRING  */
+  YYSYMBOL_COMMA = 12,                     /* COMMA  */
+  YYSYMBOL_EQUAL = 13,                     /* EQUAL  */
+  YYSYMBOL_OPEN = 14,                      /* OPEN  */
+  YYSYMBOL_CLOSE = 15,                     /* CLOSE  */
+  YYSYMBOL_DESC = 16,                      /* DESC  */
+  YYSYMBOL_GETDESC = 17,                   /* GETDESC  */
+  YYSYMBOL_FETCH = 18,                     /* FETCH  */
+  YYSYMBOL_INSTANCE = 19,                  /* INSTANCE  */
+  YYSYMBOL_PROFILE = 20,                   /* PROFILE  */
+  YYSYMBOL_HELP = 21,                      /* HELP  */
+  YYSYMBOL_WATCH = 22,                     /* WATCH  */
+  YYSYMBOL_DBG = 23,                       /* DBG  */
+  YYSYMBOL_QUIT = 24,                      /* QUIT  */
+  YYSYMBOL_STATUS = 25,                    /* STATUS  */
+  YYSYMBOL_STORE = 26,                     /* STORE  */
+  YYSYMBOL_INFO = 27,                      /* INFO  */
+  YYSYMBOL_TIMER = 28,                     /* TIMER  */
+  YYSYMBOL_NAMESPACE = 29,                 /* NAMESPACE  */
+  YYSYMBOL_WAIT = 30,                      /* WAIT  */
+  YYSYMBOL_PMNS_NAME = 31,                 /* PMNS_NAME  */
+  YYSYMBOL_PMNS_PMID = 32,                 /* PMNS_PMID  */
+  YYSYMBOL_PMNS_CHILDREN = 33,             /* PMNS_CHILDREN  */
+  YYSYMBOL_PMNS_TRAVERSE = 34,             /* PMNS_TRAVERSE  */
+  YYSYMBOL_ATTR = 35,                      /* ATTR  */
+  YYSYMBOL_LABEL = 36,                     /* LABEL  */
+  YYSYMBOL_CTXT = 37,                      /* CTXT  */
+  YYSYMBOL_DOMAIN = 38,                    /* DOMAIN  */
+  YYSYMBOL_INDOM = 39,                     /* INDOM  */
+  YYSYMBOL_CLUSTER = 40,                   /* CLUSTER  */
+  YYSYMBOL_ITEM = 41,                      /* ITEM  */
+  YYSYMBOL_INSTANCES = 42,                 /* INSTANCES  */
+  YYSYMBOL_DSO = 43,                       /* DSO  */
+  YYSYMBOL_PIPE = 44,                      /* PIPE  */
+  YYSYMBOL_SOCK = 45,                      /* SOCK  */
+  YYSYMBOL_UNIX = 46,                      /* UNIX  */
+  YYSYMBOL_INET = 47,                      /* INET  */
+  YYSYMBOL_IPV6 = 48,                      /* IPV6  */
+  YYSYMBOL_ADD = 49,                       /* ADD  */
+  YYSYMBOL_DEL = 50,                       /* DEL  */
+  YYSYMBOL_ALL = 51,                       /* ALL  */
+  YYSYMBOL_NONE = 52,                      /* NONE  */
+  YYSYMBOL_ON = 53,                        /* ON  */
+  YYSYMBOL_OFF = 54,                       /* OFF  */
+  YYSYMBOL_PLUS = 55,                      /* PLUS  */
+  YYSYMBOL_EOL = 56,                       /* EOL  */
+  YYSYMBOL_YYACCEPT = 57,                  /* $accept  */
+  YYSYMBOL_stmt = 58,                      /* stmt  */
+  YYSYMBOL_fname = 59,                     /* fname  */
+  YYSYMBOL_optdomain = 60,                 /* optdomain  */
+  YYSYMBOL_attribute = 61,                 /* attribute  */
+  YYSYMBOL_servport = 62,                  /* servport  */
+  YYSYMBOL_metric = 63,                    /* metric  */
+  YYSYMBOL_cluster = 64,                   /* cluster  */
+  YYSYMBOL_indom = 65,                     /* indom  */
+  YYSYMBOL_raw_pmid = 66,                  /* raw_pmid  */
+  YYSYMBOL_metriclist = 67,                /* metriclist  */
+  YYSYMBOL_arglist = 68,                   /* arglist  */
+  YYSYMBOL_inst = 69,                      /* inst  */
+  YYSYMBOL_debug = 70                      /* debug  */
+};
+typedef enum yysymbol_kind_t yysymbol_kind_t;
+
+
+
+
+#ifdef short
+# undef short
+#endif
+
+/* On compilers that do not define __PTRDIFF_MAX__ etc., make sure
+   <limits.h> and (if available) <stdint.h> are included
+   so that the code can choose integer types of a good width.  */
+
+#ifndef __PTRDIFF_MAX__
+# include <limits.h> /* INFRINGES ON USER NAME SPACE */
+# if defined __STDC_VERSION__ && 199901 <= __STDC_VERSION__
+#  include <stdint.h> /* INFRINGES ON USER NAME SPACE */
+#  define YY_STDINT_H
+# endif
+#endif
+
+/* Narrow types that promote to a signed type and that can represent a
+   signed or unsigned integer of at least N bits.  In tables they can
+   save space and decrease cache pressure.  Promoting to a signed type
+   helps avoid bugs in integer arithmetic.  */
+
+#ifdef __INT_LEAST8_MAX__
+typedef __INT_LEAST8_TYPE__ yytype_int8;
+#elif defined YY_STDINT_H
+typedef int_least8_t yytype_int8;
+#else
+typedef signed char yytype_int8;
+#endif
+
+#ifdef __INT_LEAST16_MAX__
+typedef __INT_LEAST16_TYPE__ yytype_int16;
+#elif defined YY_STDINT_H
+typedef int_least16_t yytype_int16;
+#else
+typedef short yytype_int16;
+#endif
+
+/* Work around bug in HP-UX 11.23, which defines these macros
+   incorrectly for preprocessor constants.  This workaround can likely
+   be removed in 2023, as HPE has promised support for HP-UX 11.23
+   (aka HP-UX 11i v2) only through the end of 2022; see Table 2 of
+   <https://h20195.www2.hpe.com/V2/getpdf.aspx/4AA4-7673ENW.pdf>.  */
+#ifdef __hpux
+# undef UINT_LEAST8_MAX
+# undef UINT_LEAST16_MAX
+# define UINT_LEAST8_MAX 255
+# define UINT_LEAST16_MAX 65535
+#endif
+
+#if defined __UINT_LEAST8_MAX__ && __UINT_LEAST8_MAX__ <= __INT_MAX__
+typedef __UINT_LEAST8_TYPE__ yytype_uint8;
+#elif (!defined __UINT_LEAST8_MAX__ && defined YY_STDINT_H \
+       && UINT_LEAST8_MAX <= INT_MAX)
+typedef uint_least8_t yytype_uint8;
+#elif !defined __UINT_LEAST8_MAX__ && UCHAR_MAX <= INT_MAX
+typedef unsigned char yytype_uint8;
+#else
+typedef short yytype_uint8;
+#endif
+
+#if defined __UINT_LEAST16_MAX__ && __UINT_LEAST16_MAX__ <= __INT_MAX__
+typedef __UINT_LEAST16_TYPE__ yytype_uint16;
+#elif (!defined __UINT_LEAST16_MAX__ && defined YY_STDINT_H \
+       && UINT_LEAST16_MAX <= INT_MAX)
+typedef uint_least16_t yytype_uint16;
+#elif !defined __UINT_LEAST16_MAX__ && USHRT_MAX <= INT_MAX
+typedef unsigned short yytype_uint16;
+#else
+typedef int yytype_uint16;
+#endif
+
+#ifndef YYPTRDIFF_T
+# if defined __PTRDIFF_TYPE__ && defined __PTRDIFF_MAX__
+#  define YYPTRDIFF_T __PTRDIFF_TYPE__
+#  define YYPTRDIFF_MAXIMUM __PTRDIFF_MAX__
+# elif defined PTRDIFF_MAX
+#  ifndef ptrdiff_t
+#   include <stddef.h> /* INFRINGES ON USER NAME SPACE */
+#  endif
+#  define YYPTRDIFF_T ptrdiff_t
+#  define YYPTRDIFF_MAXIMUM PTRDIFF_MAX
+# else
+#  define YYPTRDIFF_T long
+#  define YYPTRDIFF_MAXIMUM LONG_MAX
+# endif
+#endif
+
+#ifndef YYSIZE_T
+# ifdef __SIZE_TYPE__
+#  define YYSIZE_T __SIZE_TYPE__
+# elif defined size_t
+#  define YYSIZE_T size_t
+# elif defined __STDC_VERSION__ && 199901 <= __STDC_VERSION__
+#  include <stddef.h> /* INFRINGES ON USER NAME SPACE */
+#  define YYSIZE_T size_t
+# else
+#  define YYSIZE_T unsigned
+# endif
+#endif
+
+#define YYSIZE_MAXIMUM                                  \
+  YY_CAST (YYPTRDIFF_T,                                 \
+           (YYPTRDIFF_MAXIMUM < YY_CAST (YYSIZE_T, -1)  \
+            ? YYPTRDIFF_MAXIMUM                         \
+            : YY_CAST (YYSIZE_T, -1)))
+
+#define YYSIZEOF(X) YY_CAST (YYPTRDIFF_T, sizeof (X))
+
+
+/* Stored state numbers (used for stacks). */
+typedef yytype_uint8 yy_state_t;
+
+/* State numbers in computations.  */
+typedef int yy_state_fast_t;
+
+#ifndef YY_
+# if defined YYENABLE_NLS && YYENABLE_NLS
+#  if ENABLE_NLS
+#   include <libintl.h> /* INFRINGES ON USER NAME SPACE */
+#   define YY_(Msgid) dgettext ("bison-runtime", Msgid)
+#  endif
+# endif
+# ifndef YY_
+#  define YY_(Msgid) Msgid
+# endif
+#endif
+
+
+#ifndef YY_ATTRIBUTE_PURE
+# if defined __GNUC__ && 2 < __GNUC__ + (96 <= __GNUC_MINOR__)
+#  define YY_ATTRIBUTE_PURE __attribute__ ((__pure__))
+# else
+#  define YY_ATTRIBUTE_PURE
+# endif
+#endif
+
+#ifndef YY_ATTRIBUTE_UNUSED
+# if defined __GNUC__ && 2 < __GNUC__ + (7 <= __GNUC_MINOR__)
+#  define YY_ATTRIBUTE_UNUSED __attribute__ ((__unused__))
+# else
+#  define YY_ATTRIBUTE_UNUSED
+# endif
+#endif
+
+/* Suppress unused-variable warnings by "using" E.  */
+#if ! defined lint || defined __GNUC__
+# define YY_USE(E) ((void) (E))
+#else
+# define YY_USE(E) /* empty */
+#endif
+
+/* Suppress an incorrect diagnostic about yylval being uninitialized.  */
+#if defined __GNUC__ && ! defined __ICC && 406 <= __GNUC__ * 100 + __GNUC_MINOR__
+# if __GNUC__ * 100 + __GNUC_MINOR__ < 407
+#  define YY_IGNORE_MAYBE_UNINITIALIZED_BEGIN                           \
+    _Pragma ("GCC diagnostic push")                                     \
+    _Pragma ("GCC diagnostic ignored \"-Wuninitialized\"")
+# else
+#  define YY_IGNORE_MAYBE_UNINITIALIZED_BEGIN                           \
+    _Pragma ("GCC diagnostic push")                                     \
+    _Pragma ("GCC diagnostic ignored \"-Wuninitialized\"")              \
+    _Pragma ("GCC diagnostic ignored \"-Wmaybe-uninitialized\"")
+# endif
+# define YY_IGNORE_MAYBE_UNINITIALIZED_END      \
+    _Pragma ("GCC diagnostic pop")
+#else
+# define YY_INITIAL_VALUE(Value) Value
+#endif
+#ifndef YY_IGNORE_MAYBE_UNINITIALIZED_BEGIN
+# define YY_IGNORE_MAYBE_UNINITIALIZED_BEGIN
+# define YY_IGNORE_MAYBE_UNINITIALIZED_END
+#endif
+#ifndef YY_INITIAL_VALUE
+# define YY_INITIAL_VALUE(Value) /* Nothing. */
+#endif
+
+#if defined __cplusplus && defined __GNUC__ && ! defined __ICC && 6 <= __GNUC__
+# define YY_IGNORE_USELESS_CAST_BEGIN                          \
+    _Pragma ("GCC diagnostic push")                            \
+    _Pragma ("GCC diagnostic ignored \"-Wuseless-cast\"")
+# define YY_IGNORE_USELESS_CAST_END            \
+    _Pragma ("GCC diagnostic pop")
+#endif
+#ifndef YY_IGNORE_USELESS_CAST_BEGIN
+# define YY_IGNORE_USELESS_CAST_BEGIN
+# define YY_IGNORE_USELESS_CAST_END
+#endif
+
+
+#define YY_ASSERT(E) ((void) (0 && (E)))
+
+#if !defined yyoverflow
+
+/* The parser invokes alloca or malloc; define the necessary symbols.  */
+
+# ifdef YYSTACK_USE_ALLOCA
+#  if YYSTACK_USE_ALLOCA
+#   ifdef __GNUC__
+#    define YYSTACK_ALLOC __builtin_alloca
+#   elif defined __BUILTIN_VA_ARG_INCR
+#    include <alloca.h> /* INFRINGES ON USER NAME SPACE */
+#   elif defined _AIX
+#    define YYSTACK_ALLOC __alloca
+#   elif defined _MSC_VER
+#    include <malloc.h> /* INFRINGES ON USER NAME SPACE */
+#    define alloca _alloca
+#   else
+#    define YYSTACK_ALLOC alloca
+#    if ! defined _ALLOCA_H && ! defined EXIT_SUCCESS
+#     include <stdlib.h> /* INFRINGES ON USER NAME SPACE */
+      /* Use EXIT_SUCCESS as a witness for stdlib.h.  */
+#     ifndef EXIT_SUCCESS
+#      define EXIT_SUCCESS 0
+#     endif
+#    endif
+#   endif
+#  endif
+# endif
+
+# ifdef YYSTACK_ALLOC
+   /* Pacify GCC's 'empty if-body' warning.  */
+#  define YYSTACK_FREE(Ptr) do { /* empty */; } while (0)
+#  ifndef YYSTACK_ALLOC_MAXIMUM
+    /* The OS might guarantee only one guard page at the bottom of the stack,
+       and a page size can be as small as 4096 bytes.  So we cannot safely
+       invoke alloca (N) if N exceeds 4096.  Use a slightly smaller number
+       to allow for a few compiler-allocated temporary stack slots.  */
+#   define YYSTACK_ALLOC_MAXIMUM 4032 /* reasonable circa 2006 */
+#  endif
+# else
+#  define YYSTACK_ALLOC YYMALLOC
+#  define YYSTACK_FREE YYFREE
+#  ifndef YYSTACK_ALLOC_MAXIMUM
+#   define YYSTACK_ALLOC_MAXIMUM YYSIZE_MAXIMUM
+#  endif
+#  if (defined __cplusplus && ! defined EXIT_SUCCESS \
+       && ! ((defined YYMALLOC || defined malloc) \
+             && (defined YYFREE || defined free)))
+#   include <stdlib.h> /* INFRINGES ON USER NAME SPACE */
+#   ifndef EXIT_SUCCESS
+#    define EXIT_SUCCESS 0
+#   endif
+#  endif
+#  ifndef YYMALLOC
+#   define YYMALLOC malloc
+#   if ! defined malloc && ! defined EXIT_SUCCESS
+void *malloc (YYSIZE_T); /* INFRINGES ON USER NAME SPACE */
+#   endif
+#  endif
+#  ifndef YYFREE
+#   define YYFREE free
+#   if ! defined free && ! defined EXIT_SUCCESS
+void free (void *); /* INFRINGES ON USER NAME SPACE */
+#   endif
+#  endif
+# endif
+#endif /* !defined yyoverflow */
+
+#if (! defined yyoverflow \
+     && (! defined __cplusplus \
+         || (defined YYSTYPE_IS_TRIVIAL && YYSTYPE_IS_TRIVIAL)))
+
+/* A type that is properly aligned for any stack member.  */
+union yyalloc
+{
+  yy_state_t yyss_alloc;
+  YYSTYPE yyvs_alloc;
+};
+
+/* The size of the maximum gap between one aligned stack and the next.  */
+# define YYSTACK_GAP_MAXIMUM (YYSIZEOF (union yyalloc) - 1)
+
+/* The size of an array large to enough to hold all stacks, each with
+   N elements.  */
+# define YYSTACK_BYTES(N) \
+     ((N) * (YYSIZEOF (yy_state_t) + YYSIZEOF (YYSTYPE)) \
+      + YYSTACK_GAP_MAXIMUM)
+
+# define YYCOPY_NEEDED 1
+
+/* Relocate STACK from its old location to the new one.  The
+   local variables YYSIZE and YYSTACKSIZE give the old and new number of
+   elements in the stack, and YYPTR gives the new location of the
+   stack.  Advance YYPTR to a properly aligned location for the next
+   stack.  */
+# define YYSTACK_RELOCATE(Stack_alloc, Stack)                           \
+    do                                                                  \
+      {                                                                 \
+        YYPTRDIFF_T yynewbytes;                                         \
+        YYCOPY (&yyptr->Stack_alloc, Stack, yysize);                    \
+        Stack = &yyptr->Stack_alloc;                                    \
+        yynewbytes = yystacksize * YYSIZEOF (*Stack) + YYSTACK_GAP_MAXIMUM; \
+        yyptr += yynewbytes / YYSIZEOF (*yyptr);                        \
+      }                                                                 \
+    while (0)
+
+#endif
+
+#if defined YYCOPY_NEEDED && YYCOPY_NEEDED
+/* Copy COUNT objects from SRC to DST.  The source and destination do
+   not overlap.  */
+# ifndef YYCOPY
+#  if defined __GNUC__ && 1 < __GNUC__
+#   define YYCOPY(Dst, Src, Count) \
+      __builtin_memcpy (Dst, Src, YY_CAST (YYSIZE_T, (Count)) * sizeof (*(Src)))
+#  else
+#   define YYCOPY(Dst, Src, Count)              \
+      do                                        \
+        {                                       \
+          YYPTRDIFF_T yyi;                      \
+          for (yyi = 0; yyi < (Count); yyi++)   \
+            (Dst)[yyi] = (Src)[yyi];            \
+        }                                       \
+      while (0)
+#  endif
+# endif
+#endif /* !YYCOPY_NEEDED */
+
+/* YYFINAL -- State number of the termination state.  */
+#define YYFINAL  116
+/* YYLAST -- Last index in YYTABLE.  */
+#define YYLAST   228
+
+/* YYNTOKENS -- Number of terminals.  */
+#define YYNTOKENS  57
+/* YYNNTS -- Number of nonterminals.  */
+#define YYNNTS  14
+/* YYNRULES -- Number of rules.  */
+#define YYNRULES  115
+/* YYNSTATES -- Number of states.  */
+#define YYNSTATES  213
+
+/* YYMAXUTOK -- Last valid token kind.  */
+#define YYMAXUTOK   311
+
+
+/* YYTRANSLATE(TOKEN-NUM) -- Symbol number corresponding to TOKEN-NUM
+   as returned by yylex, with out-of-bounds checking.  */
+#define YYTRANSLATE(YYX)                                \
+  (0 <= (YYX) && (YYX) <= YYMAXUTOK                     \
+   ? YY_CAST (yysymbol_kind_t, yytranslate[YYX])        \
+   : YYSYMBOL_YYUNDEF)
+
+/* YYTRANSLATE[TOKEN-NUM] -- Symbol number corresponding to TOKEN-NUM
+   as returned by yylex.  */
+static const yytype_int8 yytranslate[] =
+{
+       0,     2,     2,     2,     2,     2,     2,     2,     2,     2,
+       2,     2,     2,     2,     2,     2,     2,     2,     2,     2,
+       2,     2,     2,     2,     2,     2,     2,     2,     2,     2,
+       2,     2,     2,     2,     2,     2,     2,     2,     2,     2,
+       2,     2,     2,     2,     2,     2,     2,     2,     2,     2,
+       2,     2,     2,     2,     2,     2,     2,     2,     2,     2,
+       2,     2,     2,     2,     2,     2,     2,     2,     2,     2,
+       2,     2,     2,     2,     2,     2,     2,     2,     2,     2,
+       2,     2,     2,     2,     2,     2,     2,     2,     2,     2,
+       2,     2,     2,     2,     2,     2,     2,     2,     2,     2,
+       2,     2,     2,     2,     2,     2,     2,     2,     2,     2,
+       2,     2,     2,     2,     2,     2,     2,     2,     2,     2,
+       2,     2,     2,     2,     2,     2,     2,     2,     2,     2,
+       2,     2,     2,     2,     2,     2,     2,     2,     2,     2,
+       2,     2,     2,     2,     2,     2,     2,     2,     2,     2,
+       2,     2,     2,     2,     2,     2,     2,     2,     2,     2,
+       2,     2,     2,     2,     2,     2,     2,     2,     2,     2,
+       2,     2,     2,     2,     2,     2,     2,     2,     2,     2,
+       2,     2,     2,     2,     2,     2,     2,     2,     2,     2,
+       2,     2,     2,     2,     2,     2,     2,     2,     2,     2,
+       2,     2,     2,     2,     2,     2,     2,     2,     2,     2,
+       2,     2,     2,     2,     2,     2,     2,     2,     2,     2,
+       2,     2,     2,     2,     2,     2,     2,     2,     2,     2,
+       2,     2,     2,     2,     2,     2,     2,     2,     2,     2,
+       2,     2,     2,     2,     2,     2,     2,     2,     2,     2,
+       2,     2,     2,     2,     2,     2,     1,     2,     3,     4,
+       5,     6,     7,     8,     9,    10,    11,    12,    13,    14,
+      15,    16,    17,    18,    19,    20,    21,    22,    23,    24,
+      25,    26,    27,    28,    29,    30,    31,    32,    33,    34,
+      35,    36,    37,    38,    39,    40,    41,    42,    43,    44,
+      45,    46,    47,    48,    49,    50,    51,    52,    53,    54,
+      55,    56
+};
+
+#if YYDEBUG
+/* YYRLINE[YYN] -- Source line where rule number YYN was defined.  */
+static const yytype_int16 yyrline[] =
+{
+       0,   136,   136,   140,   144,   148,   152,   156,   160,   164,
+     167,   171,   175,   179,   182,   186,   191,   195,   200,   205,
+     209,   215,   221,   227,   231,   241,   251,   262,   273,   277,
+     281,   285,   289,   293,   297,   301,   305,   309,   313,   317,
+     321,   326,   331,   335,   339,   343,   348,   353,   358,   364,
+     368,   372,   376,   380,   384,   388,   392,   396,   400,   404,
+     408,   412,   416,   420,   424,   428,   432,   436,   440,   444,
+     448,   452,   457,   458,   462,   471,   480,   483,   486,   490,
+     493,   496,   500,   503,   506,   510,   513,   514,   524,   533,
+     536,   537,   540,   549,   560,   561,   574,   586,   600,   615,
+     630,   634,   642,   646,   650,   658,   667,   668,   669,   673,
+     676,   677,   680,   691,   700,   711
+};
+#endif
+
+/** Accessing symbol of state STATE.  */
+#define YY_ACCESSING_SYMBOL(State) YY_CAST (yysymbol_kind_t, yystos[State])
+
+#if YYDEBUG || 0
+/* The user-facing name of the symbol whose (internal) number is
+   YYSYMBOL.  No bounds checking.  */
+static const char *yysymbol_name (yysymbol_kind_t yysymbol) YY_ATTRIBUTE_UNUSED;
+
+/* YYTNAME[SYMBOL-NUM] -- String name of the symbol SYMBOL-NUM.
+   First, the terminals, then, starting at YYNTOKENS, nonterminals.  */
+static const char *const yytname[] =
+{
+  "\"end of file\"", "error", "\"invalid token\"", "NUMBER2D", "NUMBER3D",
+  "NUMBER", "NEGNUMBER", "FLAG", "NAME", "PATHNAME", "MACRO", "STRING",
+  "COMMA", "EQUAL", "OPEN", "CLOSE", "DESC", "GETDESC", "FETCH",
+  "INSTANCE", "PROFILE", "HELP", "WATCH", "DBG", "QUIT", "STATUS", "STORE",
+  "INFO", "TIMER", "NAMESPACE", "WAIT", "PMNS_NAME", "PMNS_PMID",
+  "PMNS_CHILDREN", "PMNS_TRAVERSE", "ATTR", "LABEL", "CTXT", "DOMAIN",
+  "INDOM", "CLUSTER", "ITEM", "INSTANCES", "DSO", "PIPE", "SOCK", "UNIX",
+  "INET", "IPV6", "ADD", "DEL", "ALL", "NONE", "ON", "OFF", "PLUS", "EOL",
+  "$accept", "stmt", "fname", "optdomain", "attribute", "servport",
+  "metric", "cluster", "indom", "raw_pmid", "metriclist", "arglist",
+  "inst", "debug", YY_NULLPTR
+};
+
+static const char *
+yysymbol_name (yysymbol_kind_t yysymbol)
+{
+  return yytname[yysymbol];
+}
+#endif
+
+#define YYPACT_NINF (-16)
+
+#define yypact_value_is_default(Yyn) \
+  ((Yyn) == YYPACT_NINF)
+
+#define YYTABLE_NINF (-1)
+
+#define yytable_value_is_error(Yyn) \
+  0
+
+/* YYPACT[STATE-NUM] -- Index in YYTABLE of the portion describing
+   STATE-NUM.  */
+static const yytype_int16 yypact[] =
+{
+     108,    16,     1,    17,    28,    23,    37,    41,   143,    44,
+      24,    10,    18,    30,     2,    63,    80,    -1,    -2,     9,
+      22,    42,    13,   144,   -16,    77,    80,    80,    55,   -16,
+     -16,   -16,   -16,   -16,   -16,   -16,    29,    43,    49,   -16,
+     -16,   -16,    11,   -16,   -16,   -16,   -16,    40,   -16,    62,
+      50,    53,    59,    89,    90,    91,    92,    93,    94,    95,
+      96,    97,    98,    99,   100,   124,   131,   132,   133,   134,
+     135,   136,   -16,   -16,   -16,   -16,   137,   -16,   -16,   138,
+     139,   -16,    31,   -16,   -16,   -16,   185,    65,   -16,   141,
+     142,   145,   -16,   146,   147,   -16,   -16,   -16,   148,   149,
+     -16,   150,   -16,   151,   -16,   -16,   -16,   -16,    38,   152,
+     153,    65,   115,    87,    65,   -16,   -16,   202,   -16,    80,
+      51,    51,   -16,   -16,   -16,   -16,    87,   -16,   -16,   155,
+     -16,   -16,   -16,   156,   208,   209,   159,   160,   -16,   -16,
+     -16,   -16,   -16,   -16,   -16,   -16,   -16,   -16,   -16,   -16,
+     -16,   -16,   -16,   -16,   -16,   -16,   -16,   -16,   -16,   -16,
+     -16,   -16,   -16,   -16,   -16,   -16,   161,   162,   -16,   -16,
+     -16,   -16,   -16,   -16,   -16,   -16,   -16,   163,   -16,   -16,
+     -16,   164,   -16,   -16,   165,   166,   167,   219,   -16,   -16,
+     -16,   -16,   -16,   -16,   -16,   -16,   -16,   169,   170,   -16,
+     -16,   -16,   -16,   -16,   -16,   -16,   -16,   -16,   -16,   171,
+     -16,   -16,   -16
+};
+
+/* YYDEFACT[STATE-NUM] -- Default reduction number in state STATE-NUM.
+   Performed when YYTABLE does not specify something else to do.  Zero
+   means the default is an error.  */
+static const yytype_int8 yydefact[] =
+{
+      87,     0,     0,     0,     0,     0,     0,     0,     0,     0,
+       0,     0,     0,     0,     0,     0,     0,     0,     0,     0,
+       0,     0,     0,     0,    86,     0,     0,     0,     0,     2,
+       9,    97,    98,    96,    99,    10,     0,     0,     0,    81,
+      12,   106,     0,   104,   102,   103,    19,     0,    23,     0,
+       0,     0,     0,     0,     0,     0,     0,     0,     0,     0,
+       0,     0,     0,     0,     0,     0,     0,     0,     0,     0,
+       0,     0,    49,    88,    89,    28,     0,   112,   113,     0,
+       0,    73,     0,    72,    77,    14,     0,     0,    16,     0,
+       0,     0,    78,     0,     0,    84,   105,    30,     0,     0,
+      32,     0,    34,     0,    36,    92,    93,    39,     0,     0,
+       0,     0,     0,     0,     0,    42,     1,     0,   109,     0,
+       0,     0,     5,    11,    82,    83,     0,    13,   107,     0,
+     111,   110,    20,     0,     0,     0,     0,     0,    60,    51,
+      53,    55,    54,    57,    65,    71,    52,    66,    67,    68,
+      56,    69,    59,    70,    62,    63,    61,    64,    50,    58,
+      29,    74,    75,   114,   115,    76,     0,     0,    17,    79,
+      80,    38,    85,    31,    33,    35,    37,     0,    40,    43,
+      44,     0,   101,   100,     0,     0,     0,    91,     4,     6,
+      94,    95,     7,     8,   108,    21,    22,     0,     0,    24,
+      25,    15,    18,    41,    45,    46,    47,    48,    90,     0,
+      26,    27,     3
+};
+
+/* YYPGOTO[NTERM-NUM].  */
+static const yytype_int8 yypgoto[] =
+{
+     -16,   -16,   -15,   -16,   -16,   107,    -5,   -16,    -4,   -16,
+     -16,   -16,   -16,   -16
+};
+
+/* YYDEFGOTO[NTERM-NUM].  */
+static const yytype_uint8 yydefgoto[] =
+{
+       0,    25,    76,   209,   108,   192,    36,   184,    47,    98,
+      42,   188,   133,    82
+};
+
+/* YYTABLE[YYPACT[STATE-NUM]] -- What to do in state STATE-NUM.  If
+   positive, shift that token.  If negative, reduce the rule whose
+   number is the opposite.  If YYTABLE_NINF, syntax error.  */
+static const yytype_uint8 yytable[] =
+{
+      41,    93,    96,    49,    94,    31,    32,    33,    86,    89,
+      34,   117,   118,   122,    31,    32,    33,    99,   105,    34,
+      31,    32,    33,   126,   106,    34,    31,    32,    33,    77,
+     101,    34,    78,    31,    32,    33,   163,   128,    34,   164,
+      43,    87,    44,    45,    43,   129,    44,    45,   130,   177,
+     103,   131,    73,    74,    97,    95,   190,    30,    88,    26,
+      27,    28,   191,    73,    74,   100,    83,   127,    43,   107,
+      44,    45,    29,    35,    84,    79,    80,   116,   102,    40,
+      81,    37,    38,   167,    39,   123,    85,   165,    73,    74,
+      31,    32,    33,    46,   178,    34,   132,    48,   104,   124,
+      75,   119,   120,   121,   189,   125,   138,   181,   185,   139,
+     186,   134,   135,   136,   137,   140,    90,    91,   182,    92,
+     183,   194,     1,     2,     3,     4,     5,     6,     7,     8,
+       9,    10,    11,    12,    13,    14,    15,    16,    17,    18,
+      19,    20,    21,    22,    23,   141,   142,   143,   144,   145,
+     146,   147,   148,   149,   150,   151,   152,    50,    51,    52,
+      53,    54,    55,    56,    24,    57,    58,    59,    60,    61,
+      62,    63,    64,    65,    66,    67,    68,    69,    70,    71,
+     153,   109,   110,   111,   112,   113,   114,   154,   155,   156,
+     157,   158,   159,   160,   161,   162,   166,   168,   169,    72,
+     115,   170,   171,   172,   173,   174,   175,   176,   179,   180,
+     187,   195,   196,   197,   198,   199,   200,   201,   202,   203,
+     204,   205,   206,   207,   208,   210,   211,   212,   193
+};
+
+static const yytype_int8 yycheck[] =
+{
+       5,    16,     4,     7,     5,     3,     4,     5,    13,    14,
+       8,    26,    27,    28,     3,     4,     5,     8,     5,     8,
+       3,     4,     5,    12,    11,     8,     3,     4,     5,     5,
+       8,     8,     8,     3,     4,     5,     5,    42,     8,     8,
+       3,    39,     5,     6,     3,     5,     5,     6,     8,    11,
+       8,    11,     8,     9,    56,    56,     5,    56,    56,    43,
+      44,    45,    11,     8,     9,    56,    56,    56,     3,    56,
+       5,     6,    56,    56,    56,    51,    52,     0,    56,    56,
+      56,    53,    54,    87,    56,    56,    56,    56,     8,     9,
+       3,     4,     5,    56,    56,     8,    56,    56,    56,    56,
+      56,    46,    47,    48,   119,    56,    56,   111,   113,    56,
+     114,    49,    50,    51,    52,    56,    53,    54,     3,    56,
+       5,   126,    14,    15,    16,    17,    18,    19,    20,    21,
+      22,    23,    24,    25,    26,    27,    28,    29,    30,    31,
+      32,    33,    34,    35,    36,    56,    56,    56,    56,    56,
+      56,    56,    56,    56,    56,    56,    56,    14,    15,    16,
+      17,    18,    19,    20,    56,    22,    23,    24,    25,    26,
+      27,    28,    29,    30,    31,    32,    33,    34,    35,    36,
+      56,    37,    38,    39,    40,    41,    42,    56,    56,    56,
+      56,    56,    56,    56,    56,    56,    11,    56,    56,    56,
+      56,    56,    56,    56,    56,    56,    56,    56,    56,    56,
+       8,    56,    56,     5,     5,    56,    56,    56,    56,    56,
+      56,    56,    56,    56,     5,    56,    56,    56,   121
+};
+
+/* YYSTOS[STATE-NUM] -- The symbol kind of the accessing symbol of
+   state STATE-NUM.  */
+static const yytype_int8 yystos[] =
+{
+       0,    14,    15,    16,    17,    18,    19,    20,    21,    22,
+      23,    24,    25,    26,    27,    28,    29,    30,    31,    32,
+      33,    34,    35,    36,    56,    58,    43,    44,    45,    56,
+      56,     3,     4,     5,     8,    56,    63,    53,    54,    56,
+      56,    63,    67,     3,     5,     6,    56,    65,    56,    65,
+      14,    15,    16,    17,    18,    19,    20,    22,    23,    24,
+      25,    26,    27,    28,    29,    30,    31,    32,    33,    34,
+      35,    36,    56,     8,     9,    56,    59,     5,     8,    51,
+      52,    56,    70,    56,    56,    56,    63,    39,    56,    63,
+      53,    54,    56,    59,     5,    56,     4,    56,    66,     8,
+      56,     8,    56,     8,    56,     5,    11,    56,    61,    37,
+      38,    39,    40,    41,    42,    56,     0,    59,    59,    46,
+      47,    48,    59,    56,    56,    56,    12,    56,    63,     5,
+       8,    11,    56,    69,    49,    50,    51,    52,    56,    56,
+      56,    56,    56,    56,    56,    56,    56,    56,    56,    56,
+      56,    56,    56,    56,    56,    56,    56,    56,    56,    56,
+      56,    56,    56,     5,     8,    56,    11,    65,    56,    56,
+      56,    56,    56,    56,    56,    56,    56,    11,    56,    56,
+      56,    65,     3,     5,    64,    63,    65,     8,    68,    59,
+       5,    11,    62,    62,    63,    56,    56,     5,     5,    56,
+      56,    56,    56,    56,    56,    56,    56,    56,     5,    60,
+      56,    56,    56
+};
+
+/* YYR1[RULE-NUM] -- Symbol kind of the left-hand side of rule RULE-NUM.  */
+static const yytype_int8 yyr1[] =
+{
+       0,    57,    58,    58,    58,    58,    58,    58,    58,    58,
+      58,    58,    58,    58,    58,    58,    58,    58,    58,    58,
+      58,    58,    58,    58,    58,    58,    58,    58,    58,    58,
+      58,    58,    58,    58,    58,    58,    58,    58,    58,    58,
+      58,    58,    58,    58,    58,    58,    58,    58,    58,    58,
+      58,    58,    58,    58,    58,    58,    58,    58,    58,    58,
+      58,    58,    58,    58,    58,    58,    58,    58,    58,    58,
+      58,    58,    58,    58,    58,    58,    58,    58,    58,    58,
+      58,    58,    58,    58,    58,    58,    58,    58,    59,    59,
+      60,    60,    61,    61,    62,    62,    63,    63,    63,    63,
+      64,    64,    65,    65,    65,    66,    67,    67,    67,    68,
+      69,    69,    70,    70,    70,    70
+};
+
+/* YYR2[RULE-NUM] -- Number of symbols on the right-hand side of rule RULE-NUM.  */
+static const yytype_int8 yyr2[] =
+{
+       0,     2,     2,     6,     4,     3,     4,     4,     4,     2,
+       2,     3,     2,     3,     2,     4,     2,     3,     4,     2,
+       3,     4,     4,     2,     4,     4,     5,     5,     2,     3,
+       2,     3,     2,     3,     2,     3,     2,     3,     3,     2,
+       3,     4,     2,     3,     3,     4,     4,     4,     4,     2,
+       3,     3,     3,     3,     3,     3,     3,     3,     3,     3,
+       3,     3,     3,     3,     3,     3,     3,     3,     3,     3,
+       3,     3,     2,     2,     3,     3,     3,     2,     2,     3,
+       3,     2,     3,     3,     2,     3,     1,     0,     1,     1,
+       1,     0,     1,     1,     1,     1,     1,     1,     1,     1,
+       1,     1,     1,     1,     1,     1,     1,     2,     3,     0,
+       1,     1,     1,     1,     2,     2
+};
+
+
+enum { YYENOMEM = -2 };
+
+#define yyerrok         (yyerrstatus = 0)
+#define yyclearin       (yychar = YYEMPTY)
+
+#define YYACCEPT        goto yyacceptlab
+#define YYABORT         goto yyabortlab
+#define YYERROR         goto yyerrorlab
+#define YYNOMEM         goto yyexhaustedlab
+
+
+#define YYRECOVERING()  (!!yyerrstatus)
+
+#define YYBACKUP(Token, Value)                                    \
+  do                                                              \
+    if (yychar == YYEMPTY)                                        \
+      {                                                           \
+        yychar = (Token);                                         \
+        yylval = (Value);                                         \
+        YYPOPSTACK (yylen);                                       \
+        yystate = *yyssp;                                         \
+        goto yybackup;                                            \
+      }                                                           \
+    else                                                          \
+      {                                                           \
+        yyerror (YY_("syntax error: cannot back up")); \
+        YYERROR;                                                  \
+      }                                                           \
+  while (0)
+
+/* Backward compatibility with an undocumented macro.
+   Use YYerror or YYUNDEF. */
+#define YYERRCODE YYUNDEF
+
+
+/* Enable debugging if requested.  */
+#if YYDEBUG
+
+# ifndef YYFPRINTF
+#  include <stdio.h> /* INFRINGES ON USER NAME SPACE */
+#  define YYFPRINTF fprintf
+# endif
+
+# define YYDPRINTF(Args)                        \
+do {                                            \
+  if (yydebug)                                  \
+    YYFPRINTF Args;                             \
+} while (0)
+
+
+
+
+# define YY_SYMBOL_PRINT(Title, Kind, Value, Location)                    \
+do {                                                                      \
+  if (yydebug)                                                            \
+    {                                                                     \
+      YYFPRINTF (stderr, "%s ", Title);                                   \
+      yy_symbol_print (stderr,                                            \
+                  Kind, Value); \
+      YYFPRINTF (stderr, "\n");                                           \
+    }                                                                     \
+} while (0)
+
+
+/*-----------------------------------.
+| Print this symbol's value on YYO.  |
+`-----------------------------------*/
+
+static void
+yy_symbol_value_print (FILE *yyo,
+                       yysymbol_kind_t yykind, YYSTYPE const * const yyvaluep)
+{
+  FILE *yyoutput = yyo;
+  YY_USE (yyoutput);
+  if (!yyvaluep)
+    return;
+  YY_IGNORE_MAYBE_UNINITIALIZED_BEGIN
+  YY_USE (yykind);
+  YY_IGNORE_MAYBE_UNINITIALIZED_END
+}
+
+
+/*---------------------------.
+| Print this symbol on YYO.  |
+`---------------------------*/
+
+static void
+yy_symbol_print (FILE *yyo,
+                 yysymbol_kind_t yykind, YYSTYPE const * const yyvaluep)
+{
+  YYFPRINTF (yyo, "%s %s (",
+             yykind < YYNTOKENS ? "token" : "nterm", yysymbol_name (yykind));
+
+  yy_symbol_value_print (yyo, yykind, yyvaluep);
+  YYFPRINTF (yyo, ")");
+}
+
+/*------------------------------------------------------------------.
+| yy_stack_print -- Print the state stack from its BOTTOM up to its |
+| TOP (included).                                                   |
+`------------------------------------------------------------------*/
+
+static void
+yy_stack_print (yy_state_t *yybottom, yy_state_t *yytop)
+{
+  YYFPRINTF (stderr, "Stack now");
+  for (; yybottom <= yytop; yybottom++)
+    {
+      int yybot = *yybottom;
+      YYFPRINTF (stderr, " %d", yybot);
+    }
+  YYFPRINTF (stderr, "\n");
+}
+
+# define YY_STACK_PRINT(Bottom, Top)                            \
+do {                                                            \
+  if (yydebug)                                                  \
+    yy_stack_print ((Bottom), (Top));                           \
+} while (0)
+
+
+/*------------------------------------------------.
+| Report that the YYRULE is going to be reduced.  |
+`------------------------------------------------*/
+
+static void
+yy_reduce_print (yy_state_t *yyssp, YYSTYPE *yyvsp,
+                 int yyrule)
+{
+  int yylno = yyrline[yyrule];
+  int yynrhs = yyr2[yyrule];
+  int yyi;
+  YYFPRINTF (stderr, "Reducing stack by rule %d (line %d):\n",
+             yyrule - 1, yylno);
+  /* The symbols being reduced.  */
+  for (yyi = 0; yyi < yynrhs; yyi++)
+    {
+      YYFPRINTF (stderr, "   $%d = ", yyi + 1);
+      yy_symbol_print (stderr,
+                       YY_ACCESSING_SYMBOL (+yyssp[yyi + 1 - yynrhs]),
+                       &yyvsp[(yyi + 1) - (yynrhs)]);
+      YYFPRINTF (stderr, "\n");
+    }
+}
+
+# define YY_REDUCE_PRINT(Rule)          \
+do {                                    \
+  if (yydebug)                          \
+    yy_reduce_print (yyssp, yyvsp, Rule); \
+} while (0)
+
+/* Nonzero means print parse trace.  It is left uninitialized so that
+   multiple parsers can coexist.  */
+int yydebug;
+#else /* !YYDEBUG */
+# define YYDPRINTF(Args) ((void) 0)
+# define YY_SYMBOL_PRINT(Title, Kind, Value, Location)
+# define YY_STACK_PRINT(Bottom, Top)
+# define YY_REDUCE_PRINT(Rule)
+#endif /* !YYDEBUG */
+
+
+/* YYINITDEPTH -- initial size of the parser's stacks.  */
+#ifndef YYINITDEPTH
+# define YYINITDEPTH 200
+#endif
+
+/* YYMAXDEPTH -- maximum size the stacks can grow to (effective only
+   if the built-in stack extension method is used).
+
+   Do not make this value too large; the results are undefined if
+   YYSTACK_ALLOC_MAXIMUM < YYSTACK_BYTES (YYMAXDEPTH)
+   evaluated with infinite-precision integer arithmetic.  */
+
+#ifndef YYMAXDEPTH
+# define YYMAXDEPTH 10000
+#endif
+
+
+
+
+
+
+/*-----------------------------------------------.
+| Release the memory associated to this symbol.  |
+`-----------------------------------------------*/
+
+static void
+yydestruct (const char *yymsg,
+            yysymbol_kind_t yykind, YYSTYPE *yyvaluep)
+{
+  YY_USE (yyvaluep);
+  if (!yymsg)
+    yymsg = "Deleting";
+  YY_SYMBOL_PRINT (yymsg, yykind, yyvaluep, yylocationp);
+
+  YY_IGNORE_MAYBE_UNINITIALIZED_BEGIN
+  YY_USE (yykind);
+  YY_IGNORE_MAYBE_UNINITIALIZED_END
+}
+
+
+/* Lookahead token kind.  */
+int yychar;
+
+/* The semantic value of the lookahead symbol.  */
+YYSTYPE yylval;
+/* Number of syntax errors so far.  */
+int yynerrs;
+
+
+
+
+/*----------.
+| yyparse.  |
+`----------*/
+
+int
+yyparse (void)
+{
+    yy_state_fast_t yystate = 0;
+    /* Number of tokens to shift before error messages enabled.  */
+    int yyerrstatus = 0;
+
+    /* Refer to the stacks through separate pointers, to allow yyoverflow
+       to reallocate them elsewhere.  */
+
+    /* Their size.  */
+    YYPTRDIFF_T yystacksize = YYINITDEPTH;
+
+    /* The state stack: array, bottom, top.  */
+    yy_state_t yyssa[YYINITDEPTH];
+    yy_state_t *yyss = yyssa;
+    yy_state_t *yyssp = yyss;
+
+    /* The semantic value stack: array, bottom, top.  */
+    YYSTYPE yyvsa[YYINITDEPTH];
+    YYSTYPE *yyvs = yyvsa;
+    YYSTYPE *yyvsp = yyvs;
+
+  int yyn;
+  /* The return value of yyparse.  */
+  int yyresult;
+  /* Lookahead symbol kind.  */
+  yysymbol_kind_t yytoken = YYSYMBOL_YYEMPTY;
+  /* The variables used to return semantic value and location from the
+     action routines.  */
+  YYSTYPE yyval;
+
+
+
+#define YYPOPSTACK(N)   (yyvsp -= (N), yyssp -= (N))
+
+  /* The number of symbols on the RHS of the reduced rule.
+     Keep to zero when no symbol should be popped.  */
+  int yylen = 0;
+
+  YYDPRINTF ((stderr, "Starting parse\n"));
+
+  yychar = YYEMPTY; /* Cause a token to be read.  */
+
+  goto yysetstate;
+
+
+/*------------------------------------------------------------.
+| yynewstate -- push a new state, which is found in yystate.  |
+`------------------------------------------------------------*/
+yynewstate:
+  /* In all cases, when you get here, the value and location stacks
+     have just been pushed.  So pushing a state here evens the stacks.  */
+  yyssp++;
+
+
+/*--------------------------------------------------------------------.
+| yysetstate -- set current state (the top of the stack) to yystate.  |
+`--------------------------------------------------------------------*/
+yysetstate:
+  YYDPRINTF ((stderr, "Entering state %d\n", yystate));
+  YY_ASSERT (0 <= yystate && yystate < YYNSTATES);
+  YY_IGNORE_USELESS_CAST_BEGIN
+  *yyssp = YY_CAST (yy_state_t, yystate);
+  YY_IGNORE_USELESS_CAST_END
+  YY_STACK_PRINT (yyss, yyssp);
+
+  if (yyss + yystacksize - 1 <= yyssp)
+#if !defined yyoverflow && !defined YYSTACK_RELOCATE
+    YYNOMEM;
+#else
+    {
+      /* Get the current used size of the three stacks, in elements.  */
+      YYPTRDIFF_T yysize = yyssp - yyss + 1;
+
+# if defined yyoverflow
+      {
+        /* Give user a chance to reallocate the stack.  Use copies of
+           these so that the &'s don't force the real ones into
+           memory.  */
+        yy_state_t *yyss1 = yyss;
+        YYSTYPE *yyvs1 = yyvs;
+
+        /* Each stack pointer address is followed by the size of the
+           data in use in that stack, in bytes.  This used to be a
+           conditional around just the two extra args, but that might
+           be undefined if yyoverflow is a macro.  */
+        yyoverflow (YY_("memory exhausted"),
+                    &yyss1, yysize * YYSIZEOF (*yyssp),
+                    &yyvs1, yysize * YYSIZEOF (*yyvsp),
+                    &yystacksize);
+        yyss = yyss1;
+        yyvs = yyvs1;
+      }
+# else /* defined YYSTACK_RELOCATE */
+      /* Extend the stack our own way.  */
+      if (YYMAXDEPTH <= yystacksize)
+        YYNOMEM;
+      yystacksize *= 2;
+      if (YYMAXDEPTH < yystacksize)
+        yystacksize = YYMAXDEPTH;
+
+      {
+        yy_state_t *yyss1 = yyss;
+        union yyalloc *yyptr =
+          YY_CAST (union yyalloc *,
+                   YYSTACK_ALLOC (YY_CAST (YYSIZE_T, YYSTACK_BYTES (yystacksize))));
+        if (! yyptr)
+          YYNOMEM;
+        YYSTACK_RELOCATE (yyss_alloc, yyss);
+        YYSTACK_RELOCATE (yyvs_alloc, yyvs);
+#  undef YYSTACK_RELOCATE
+        if (yyss1 != yyssa)
+          YYSTACK_FREE (yyss1);
+      }
+# endif
+
+      yyssp = yyss + yysize - 1;
+      yyvsp = yyvs + yysize - 1;
+
+      YY_IGNORE_USELESS_CAST_BEGIN
+      YYDPRINTF ((stderr, "Stack size increased to %ld\n",
+                  YY_CAST (long, yystacksize)));
+      YY_IGNORE_USELESS_CAST_END
+
+      if (yyss + yystacksize - 1 <= yyssp)
+        YYABORT;
+    }
+#endif /* !defined yyoverflow && !defined YYSTACK_RELOCATE */
+
+
+  if (yystate == YYFINAL)
+    YYACCEPT;
+
+  goto yybackup;
+
+
+/*-----------.
+| yybackup.  |
+`-----------*/
+yybackup:
+  /* Do appropriate processing given the current state.  Read a
+     lookahead token if we need one and don't already have one.  */
+
+  /* First try to decide what to do without reference to lookahead token.  */
+  yyn = yypact[yystate];
+  if (yypact_value_is_default (yyn))
+    goto yydefault;
+
+  /* Not known => get a lookahead token if don't already have one.  */
+
+  /* YYCHAR is either empty, or end-of-input, or a valid lookahead.  */
+  if (yychar == YYEMPTY)
+    {
+      YYDPRINTF ((stderr, "Reading a token\n"));
+      yychar = yylex ();
+    }
+
+  if (yychar <= YYEOF)
+    {
+      yychar = YYEOF;
+      yytoken = YYSYMBOL_YYEOF;
+      YYDPRINTF ((stderr, "Now at end of input.\n"));
+    }
+  else if (yychar == YYerror)
+    {
+      /* The scanner already issued an error message, process directly
+         to error recovery.  But do not keep the error token as
+         lookahead, it is too special and may lead us to an endless
+         loop in error recovery. */
+      yychar = YYUNDEF;
+      yytoken = YYSYMBOL_YYerror;
+      goto yyerrlab1;
+    }
+  else
+    {
+      yytoken = YYTRANSLATE (yychar);
+      YY_SYMBOL_PRINT ("Next token is", yytoken, &yylval, &yylloc);
+    }
+
+  /* If the proper action on seeing token YYTOKEN is to reduce or to
+     detect an error, take that action.  */
+  yyn += yytoken;
+  if (yyn < 0 || YYLAST < yyn || yycheck[yyn] != yytoken)
+    goto yydefault;
+  yyn = yytable[yyn];
+  if (yyn <= 0)
+    {
+      if (yytable_value_is_error (yyn))
+        goto yyerrlab;
+      yyn = -yyn;
+      goto yyreduce;
+    }
+
+  /* Count tokens shifted since error; after three, turn off error
+     status.  */
+  if (yyerrstatus)
+    yyerrstatus--;
+
+  /* Shift the lookahead token.  */
+  YY_SYMBOL_PRINT ("Shifting", yytoken, &yylval, &yylloc);
+  yystate = yyn;
+  YY_IGNORE_MAYBE_UNINITIALIZED_BEGIN
+  *++yyvsp = yylval;
+  YY_IGNORE_MAYBE_UNINITIALIZED_END
+
+  /* Discard the shifted token.  */
+  yychar = YYEMPTY;
+  goto yynewstate;
+
+
+/*-----------------------------------------------------------.
+| yydefault -- do the default action for the current state.  |
+`-----------------------------------------------------------*/
+yydefault:
+  yyn = yydefact[yystate];
+  if (yyn == 0)
+    goto yyerrlab;
+  goto yyreduce;
+
+
+/*-----------------------------.
+| yyreduce -- do a reduction.  |
+`-----------------------------*/
+yyreduce:
+  /* yyn is the number of a rule to reduce with.  */
+  yylen = yyr2[yyn];
+
+  /* If YYLEN is nonzero, implement the default value of the action:
+     '$$ = $1'.
+
+     Otherwise, the following line sets YYVAL to garbage.
+     This behavior is undocumented and Bison
+     users should not rely upon it.  Assigning to YYVAL
+     unconditionally makes the parser a bit smaller, and it avoids a
+     GCC warning that YYVAL may be used uninitialized.  */
+  yyval = yyvsp[1-yylen];
+
+
+  YY_REDUCE_PRINT (yyn);
+  switch (yyn)
+    {
+  case 2: /* stmt: OPEN EOL  */
+#line 136 "gram.y"
+                                                {
+		param.number = OPEN; param.pmid = HELP_USAGE;
+		stmt_type = HELP; YYACCEPT;
+	    }
+#line 1344 "gram.tab.c"
+    break;
+
+  case 3: /* stmt: OPEN DSO fname NAME optdomain EOL  */
+#line 140 "gram.y"
+                                                {
+		opendso((yyvsp[-3].y_str), (yyvsp[-2].y_str), (yyvsp[-1].y_num));
+		stmt_type = OPEN; YYACCEPT;
+	    }
+#line 1353 "gram.tab.c"
+    break;
+
+  case 4: /* stmt: OPEN PIPE fname arglist  */
+#line 144 "gram.y"
+                                                {
+		openpmda((yyvsp[-1].y_str));
+		stmt_type = OPEN; YYACCEPT;
+	    }
+#line 1362 "gram.tab.c"
+    break;
+
+  case 5: /* stmt: OPEN SOCK fname  */
+#line 148 "gram.y"
+                                                {
+		open_unix_socket((yyvsp[0].y_str));
+		stmt_type = OPEN; YYACCEPT;
+	    }
+#line 1371 "gram.tab.c"
+    break;
+
+  case 6: /* stmt: OPEN SOCK UNIX fname  */
+#line 152 "gram.y"
+                                                {
+		open_unix_socket((yyvsp[0].y_str));
+		stmt_type = OPEN; YYACCEPT;
+	    }
+#line 1380 "gram.tab.c"
+    break;
+
+  case 7: /* stmt: OPEN SOCK INET servport  */
+#line 156 "gram.y"
+                                                {
+		open_inet_socket((yyvsp[0].y_num));
+		stmt_type = OPEN; YYACCEPT;
+	    }
+#line 1389 "gram.tab.c"
+    break;
+
+  case 8: /* stmt: OPEN SOCK IPV6 servport  */
+#line 160 "gram.y"
+                                                {
+		open_ipv6_socket((yyvsp[0].y_num));
+		stmt_type = OPEN; YYACCEPT;
+	    }
+#line 1398 "gram.tab.c"
+    break;
+
+  case 9: /* stmt: CLOSE EOL  */
+#line 164 "gram.y"
+                                                { 
+		stmt_type = CLOSE; YYACCEPT; 
+	    }
+#line 1406 "gram.tab.c"
+    break;
+
+  case 10: /* stmt: DESC EOL  */
+#line 167 "gram.y"
+                                                {
+		param.number = DESC; param.pmid = HELP_USAGE;
+		stmt_type = HELP; YYACCEPT;
+	    }
+#line 1415 "gram.tab.c"
+    break;
+
+  case 11: /* stmt: DESC metric EOL  */
+#line 171 "gram.y"
+                                                {
+		param.pmid = (yyvsp[-1].y_num);
+		stmt_type = DESC; YYACCEPT;
+	    }
+#line 1424 "gram.tab.c"
+    break;
+
+  case 12: /* stmt: FETCH EOL  */
+#line 175 "gram.y"
+                                                {
+		param.number = FETCH; param.pmid = HELP_USAGE;
+		stmt_type = HELP; YYACCEPT;
+	    }
+#line 1433 "gram.tab.c"
+    break;
+
+  case 13: /* stmt: FETCH metriclist EOL  */
+#line 179 "gram.y"
+                                                { 
+		stmt_type = FETCH; YYACCEPT; 
+	    }
+#line 1441 "gram.tab.c"
+    break;
+
+  case 14: /* stmt: STORE EOL  */
+#line 182 "gram.y"
+                                                {
+		param.number = STORE; param.pmid = HELP_USAGE;
+		stmt_type = HELP; YYACCEPT;
+	    }
+#line 1450 "gram.tab.c"
+    break;
+
+  case 15: /* stmt: STORE metric STRING EOL  */
+#line 186 "gram.y"
+                                                {
+		param.name = (yyvsp[-1].y_str);
+		param.pmid = (pmID)(yyvsp[-2].y_num);
+		stmt_type = STORE; YYACCEPT;
+	    }
+#line 1460 "gram.tab.c"
+    break;
+
+  case 16: /* stmt: INFO EOL  */
+#line 191 "gram.y"
+                                                {
+		param.number = INFO; param.pmid = HELP_USAGE;
+		stmt_type = HELP; YYACCEPT;
+	    }
+#line 1469 "gram.tab.c"
+    break;
+
+  case 17: /* stmt: INFO metric EOL  */
+#line 195 "gram.y"
+                                                {
+		param.number = PM_TEXT_PMID;
+		param.pmid = (pmID)(yyvsp[-1].y_num);
+		stmt_type = INFO; YYACCEPT;
+	    }
+#line 1479 "gram.tab.c"
+    break;
+
+  case 18: /* stmt: INFO INDOM indom EOL  */
+#line 200 "gram.y"
+                                                {
+		param.number = PM_TEXT_INDOM;
+		param.indom = indom.whole;
+		stmt_type = INFO; YYACCEPT;
+	    }
+#line 1489 "gram.tab.c"
+    break;
+
+  case 19: /* stmt: INSTANCE EOL  */
+#line 205 "gram.y"
+                                                {
+		param.number = INSTANCE; param.pmid = HELP_USAGE;
+		stmt_type = HELP; YYACCEPT;
+	    }
+#line 1498 "gram.tab.c"
+    break;
+
+  case 20: /* stmt: INSTANCE indom EOL  */
+#line 209 "gram.y"
+                                                {
+		param.indom = indom.whole;
+		param.number = PM_IN_NULL;
+		param.name = NULL;
+		stmt_type = INSTANCE; YYACCEPT;
+	    }
+#line 1509 "gram.tab.c"
+    break;
+
+  case 21: /* stmt: INSTANCE indom NUMBER EOL  */
+#line 215 "gram.y"
+                                                {
+		param.indom = indom.whole;
+		param.number = (yyvsp[-1].y_num);
+		param.name = NULL;
+		stmt_type = INSTANCE; YYACCEPT;
+	    }
+#line 1520 "gram.tab.c"
+    break;
+
+  case 22: /* stmt: INSTANCE indom inst EOL  */
+#line 221 "gram.y"
+                                                {
+		param.indom = indom.whole;
+		param.number = PM_IN_NULL;
+		param.name = (yyvsp[-1].y_str);
+		stmt_type = INSTANCE; YYACCEPT;
+	    }
+#line 1531 "gram.tab.c"
+    break;
+
+  case 23: /* stmt: PROFILE EOL  */
+#line 227 "gram.y"
+                                                {
+		param.number = PROFILE; param.pmid = HELP_USAGE;
+		stmt_type = HELP; YYACCEPT;
+	    }
+#line 1540 "gram.tab.c"
+    break;
+
+  case 24: /* stmt: PROFILE indom ALL EOL  */
+#line 231 "gram.y"
+                                                {
+		sts = pmAddProfile((yyvsp[-2].y_num), 0, NULL);
+		if (sts < 0) {
+		    yyerror(pmErrStr(sts));
+		    YYERROR;
+		}
+		profile_changed = 1;
+		stmt_type = EOL;
+		YYACCEPT;
+	    }
+#line 1555 "gram.tab.c"
+    break;
+
+  case 25: /* stmt: PROFILE indom NONE EOL  */
+#line 241 "gram.y"
+                                                {
+		sts = pmDelProfile((yyvsp[-2].y_num), 0, NULL);
+		if (sts < 0) {
+		    yyerror(pmErrStr(sts));
+		    YYERROR;
+		}
+		profile_changed = 1;
+		stmt_type = EOL;
+		YYACCEPT;
+	    }
+#line 1570 "gram.tab.c"
+    break;
+
+  case 26: /* stmt: PROFILE indom ADD NUMBER EOL  */
+#line 251 "gram.y"
+                                                {
+		inst = (yyvsp[-1].y_num);
+		sts = pmAddProfile((yyvsp[-3].y_num), 1, &inst);
+		if (sts < 0) {
+		    yyerror(pmErrStr(sts));
+		    YYERROR;
+		}
+		profile_changed = 1;
+		stmt_type = EOL;
+		YYACCEPT;
+	    }
+#line 1586 "gram.tab.c"
+    break;
+
+  case 27: /* stmt: PROFILE indom DEL NUMBER EOL  */
+#line 262 "gram.y"
+                                                {
+		inst = (yyvsp[-1].y_num);
+		sts = pmDelProfile((yyvsp[-3].y_num), 1, &inst);
+		if (sts < 0) {
+		    yyerror(pmErrStr(sts));
+		    YYERROR;
+		}
+		profile_changed = 1;
+		stmt_type = EOL;
+		YYACCEPT;
+	    }
+#line 1602 "gram.tab.c"
+    break;
+
+  case 28: /* stmt: WATCH EOL  */
+#line 273 "gram.y"
+                                                {
+		param.number = WATCH; param.pmid = HELP_USAGE;
+		stmt_type = HELP; YYACCEPT;
+	    }
+#line 1611 "gram.tab.c"
+    break;
+
+  case 29: /* stmt: WATCH fname EOL  */
+#line 277 "gram.y"
+                                                {
+		watch((yyvsp[-1].y_str));
+		stmt_type = WATCH; YYACCEPT;
+	    }
+#line 1620 "gram.tab.c"
+    break;
+
+  case 30: /* stmt: PMNS_NAME EOL  */
+#line 281 "gram.y"
+                                                {
+		param.number = PMNS_NAME; param.pmid = HELP_USAGE;
+		stmt_type = HELP; YYACCEPT;
+	    }
+#line 1629 "gram.tab.c"
+    break;
+
+  case 31: /* stmt: PMNS_NAME raw_pmid EOL  */
+#line 285 "gram.y"
+                                                {
+		param.pmid = (yyvsp[-1].y_num);
+		stmt_type = PMNS_NAME; YYACCEPT;
+	    }
+#line 1638 "gram.tab.c"
+    break;
+
+  case 32: /* stmt: PMNS_PMID EOL  */
+#line 289 "gram.y"
+                                                {
+		param.number = PMNS_PMID; param.pmid = HELP_USAGE;
+		stmt_type = HELP; YYACCEPT;
+	    }
+#line 1647 "gram.tab.c"
+    break;
+
+  case 33: /* stmt: PMNS_PMID NAME EOL  */
+#line 293 "gram.y"
+                                                {
+		param.name = (yyvsp[-1].y_str);
+		stmt_type = PMNS_PMID; YYACCEPT;
+	    }
+#line 1656 "gram.tab.c"
+    break;
+
+  case 34: /* stmt: PMNS_CHILDREN EOL  */
+#line 297 "gram.y"
+                                                {
+		param.number = PMNS_CHILDREN; param.pmid = HELP_USAGE;
+		stmt_type = HELP; YYACCEPT;
+	    }
+#line 1665 "gram.tab.c"
+    break;
+
+  case 35: /* stmt: PMNS_CHILDREN NAME EOL  */
+#line 301 "gram.y"
+                                                {
+		param.name = (yyvsp[-1].y_str);
+		stmt_type = PMNS_CHILDREN; YYACCEPT;
+	    }
+#line 1674 "gram.tab.c"
+    break;
+
+  case 36: /* stmt: PMNS_TRAVERSE EOL  */
+#line 305 "gram.y"
+                                                {
+		param.number = PMNS_TRAVERSE; param.pmid = HELP_USAGE;
+		stmt_type = HELP; YYACCEPT;
+	    }
+#line 1683 "gram.tab.c"
+    break;
+
+  case 37: /* stmt: PMNS_TRAVERSE NAME EOL  */
+#line 309 "gram.y"
+                                                {
+		param.name = (yyvsp[-1].y_str);
+		stmt_type = PMNS_TRAVERSE; YYACCEPT;
+	    }
+#line 1692 "gram.tab.c"
+    break;
+
+  case 38: /* stmt: NAMESPACE fname EOL  */
+#line 313 "gram.y"
+                                                {
+		param.name = (yyvsp[-1].y_str);
+		stmt_type = NAMESPACE; YYACCEPT;
+	    }
+#line 1701 "gram.tab.c"
+    break;
+
+  case 39: /* stmt: ATTR EOL  */
+#line 317 "gram.y"
+                                                {
+		param.number = ATTR; param.pmid = HELP_USAGE;
+		stmt_type = HELP; YYACCEPT;
+	    }
+#line 1710 "gram.tab.c"
+    break;
+
+  case 40: /* stmt: ATTR attribute EOL  */
+#line 321 "gram.y"
+                                                {
+		param.number = (yyvsp[-1].y_num);
+		param.name = NULL;
+		stmt_type = ATTR; YYACCEPT;
+	    }
+#line 1720 "gram.tab.c"
+    break;
+
+  case 41: /* stmt: ATTR attribute STRING EOL  */
+#line 326 "gram.y"
+                                                {
+		param.number = (yyvsp[-2].y_num);
+		param.name = (yyvsp[-1].y_str);
+		stmt_type = ATTR; YYACCEPT;
+	    }
+#line 1730 "gram.tab.c"
+    break;
+
+  case 42: /* stmt: LABEL EOL  */
+#line 331 "gram.y"
+                                                {
+		param.number = LABEL; param.pmid = HELP_USAGE;
+		stmt_type = HELP; YYACCEPT;
+	    }
+#line 1739 "gram.tab.c"
+    break;
+
+  case 43: /* stmt: LABEL CTXT EOL  */
+#line 335 "gram.y"
+                                                {
+		param.number = PM_LABEL_CONTEXT;
+		stmt_type = LABEL; YYACCEPT;
+	    }
+#line 1748 "gram.tab.c"
+    break;
+
+  case 44: /* stmt: LABEL DOMAIN EOL  */
+#line 339 "gram.y"
+                                                {
+		param.number = PM_LABEL_DOMAIN;
+		stmt_type = LABEL; YYACCEPT;
+	    }
+#line 1757 "gram.tab.c"
+    break;
+
+  case 45: /* stmt: LABEL INDOM indom EOL  */
+#line 343 "gram.y"
+                                                {
+		param.number = PM_LABEL_INDOM;
+		param.indom = indom.whole;
+		stmt_type = LABEL; YYACCEPT;
+	    }
+#line 1767 "gram.tab.c"
+    break;
+
+  case 46: /* stmt: LABEL CLUSTER cluster EOL  */
+#line 348 "gram.y"
+                                                {
+		param.number = PM_LABEL_CLUSTER;
+		param.pmid = (pmID)(yyvsp[-1].y_num);
+		stmt_type = LABEL; YYACCEPT;
+	    }
+#line 1777 "gram.tab.c"
+    break;
+
+  case 47: /* stmt: LABEL ITEM metric EOL  */
+#line 353 "gram.y"
+                                                {
+		param.number = PM_LABEL_ITEM;
+		param.pmid = (pmID)(yyvsp[-1].y_num);
+		stmt_type = LABEL; YYACCEPT;
+	    }
+#line 1787 "gram.tab.c"
+    break;
+
+  case 48: /* stmt: LABEL INSTANCES indom EOL  */
+#line 358 "gram.y"
+                                                {
+		param.number = PM_LABEL_INSTANCES;
+		param.indom = indom.whole;
+		stmt_type = LABEL; YYACCEPT;
+	    }
+#line 1797 "gram.tab.c"
+    break;
+
+  case 49: /* stmt: HELP EOL  */
+#line 364 "gram.y"
+                                                { 
+		param.number = -1; param.pmid = HELP_FULL; 
+		stmt_type = HELP; YYACCEPT; 
+	    }
+#line 1806 "gram.tab.c"
+    break;
+
+  case 50: /* stmt: HELP ATTR EOL  */
+#line 368 "gram.y"
+                                                {
+		param.number = ATTR; param.pmid = HELP_FULL; 
+		stmt_type = HELP; YYACCEPT;
+	    }
+#line 1815 "gram.tab.c"
+    break;
+
+  case 51: /* stmt: HELP CLOSE EOL  */
+#line 372 "gram.y"
+                                                {
+		param.number = CLOSE; param.pmid = HELP_FULL; 
+		stmt_type = HELP; YYACCEPT;
+	    }
+#line 1824 "gram.tab.c"
+    break;
+
+  case 52: /* stmt: HELP DBG EOL  */
+#line 376 "gram.y"
+                                                {
+		param.number = DBG; param.pmid = HELP_FULL; 
+		stmt_type = HELP; YYACCEPT;
+	    }
+#line 1833 "gram.tab.c"
+    break;
+
+  case 53: /* stmt: HELP DESC EOL  */
+#line 380 "gram.y"
+                                                {
+		param.number = DESC; param.pmid = HELP_FULL; 
+		stmt_type = HELP; YYACCEPT;
+	    }
+#line 1842 "gram.tab.c"
+    break;
+
+  case 54: /* stmt: HELP FETCH EOL  */
+#line 384 "gram.y"
+                                                {
+		param.number = FETCH; param.pmid = HELP_FULL; 
+		stmt_type = HELP; YYACCEPT;
+	    }
+#line 1851 "gram.tab.c"
+    break;
+
+  case 55: /* stmt: HELP GETDESC EOL  */
+#line 388 "gram.y"
+                                                {
+		param.number = GETDESC; param.pmid = HELP_FULL; 
+		stmt_type = HELP; YYACCEPT;
+	    }
+#line 1860 "gram.tab.c"
+    break;
+
+  case 56: /* stmt: HELP INFO EOL  */
+#line 392 "gram.y"
+                                                {
+		param.number = INFO; param.pmid = HELP_FULL;
+		stmt_type = HELP; YYACCEPT;
+	    }
+#line 1869 "gram.tab.c"
+    break;
+
+  case 57: /* stmt: HELP INSTANCE EOL  */
+#line 396 "gram.y"
+                                                {
+		param.number = INSTANCE; param.pmid = HELP_FULL; 
+		stmt_type = HELP; YYACCEPT;
+	    }
+#line 1878 "gram.tab.c"
+    break;
+
+  case 58: /* stmt: HELP LABEL EOL  */
+#line 400 "gram.y"
+                                                {
+		param.number = LABEL; param.pmid = HELP_FULL; 
+		stmt_type = HELP; YYACCEPT;
+	    }
+#line 1887 "gram.tab.c"
+    break;
+
+  case 59: /* stmt: HELP NAMESPACE EOL  */
+#line 404 "gram.y"
+                                                {
+		param.number = NAMESPACE; param.pmid = HELP_FULL; 
+		stmt_type = HELP; YYACCEPT;
+	    }
+#line 1896 "gram.tab.c"
+    break;
+
+  case 60: /* stmt: HELP OPEN EOL  */
+#line 408 "gram.y"
+                                                {
+		param.number = OPEN; param.pmid = HELP_FULL; 
+		stmt_type = HELP; YYACCEPT;
+	    }
+#line 1905 "gram.tab.c"
+    break;
+
+  case 61: /* stmt: HELP PMNS_CHILDREN EOL  */
+#line 412 "gram.y"
+                                                {
+		param.number = PMNS_CHILDREN; param.pmid = HELP_FULL; 
+		stmt_type = HELP; YYACCEPT;
+	    }
+#line 1914 "gram.tab.c"
+    break;
+
+  case 62: /* stmt: HELP PMNS_NAME EOL  */
+#line 416 "gram.y"
+                                                {
+		param.number = PMNS_NAME; param.pmid = HELP_FULL; 
+		stmt_type = HELP; YYACCEPT;
+	    }
+#line 1923 "gram.tab.c"
+    break;
+
+  case 63: /* stmt: HELP PMNS_PMID EOL  */
+#line 420 "gram.y"
+                                                {
+		param.number = PMNS_PMID; param.pmid = HELP_FULL; 
+		stmt_type = HELP; YYACCEPT;
+	    }
+#line 1932 "gram.tab.c"
+    break;
+
+  case 64: /* stmt: HELP PMNS_TRAVERSE EOL  */
+#line 424 "gram.y"
+                                                {
+		param.number = PMNS_TRAVERSE; param.pmid = HELP_FULL; 
+		stmt_type = HELP; YYACCEPT;
+	    }
+#line 1941 "gram.tab.c"
+    break;
+
+  case 65: /* stmt: HELP PROFILE EOL  */
+#line 428 "gram.y"
+                                                {
+		param.number = PROFILE; param.pmid = HELP_FULL; 
+		stmt_type = HELP; YYACCEPT;
+	    }
+#line 1950 "gram.tab.c"
+    break;
+
+  case 66: /* stmt: HELP QUIT EOL  */
+#line 432 "gram.y"
+                                                {
+		param.number = QUIT; param.pmid = HELP_FULL; 
+		stmt_type = HELP; YYACCEPT;
+	    }
+#line 1959 "gram.tab.c"
+    break;
+
+  case 67: /* stmt: HELP STATUS EOL  */
+#line 436 "gram.y"
+                                                {
+		param.number = STATUS; param.pmid = HELP_FULL; 
+		stmt_type = HELP; YYACCEPT;
+	    }
+#line 1968 "gram.tab.c"
+    break;
+
+  case 68: /* stmt: HELP STORE EOL  */
+#line 440 "gram.y"
+                                                {
+		param.number = STORE; param.pmid = HELP_FULL; 
+		stmt_type = HELP; YYACCEPT;
+	    }
+#line 1977 "gram.tab.c"
+    break;
+
+  case 69: /* stmt: HELP TIMER EOL  */
+#line 444 "gram.y"
+                                                        {
+		param.number = TIMER; param.pmid = HELP_FULL;
+		stmt_type = HELP; YYACCEPT;
+	    }
+#line 1986 "gram.tab.c"
+    break;
+
+  case 70: /* stmt: HELP WAIT EOL  */
+#line 448 "gram.y"
+                                                {
+		param.number = WAIT; param.pmid = HELP_FULL;
+		stmt_type = HELP; YYACCEPT;
+	    }
+#line 1995 "gram.tab.c"
+    break;
+
+  case 71: /* stmt: HELP WATCH EOL  */
+#line 452 "gram.y"
+                                                {
+		param.number = WATCH; param.pmid = HELP_FULL; 
+		stmt_type = HELP; YYACCEPT;
+	    }
+#line 2004 "gram.tab.c"
+    break;
+
+  case 72: /* stmt: QUIT EOL  */
+#line 457 "gram.y"
+                                                { stmt_type = QUIT; YYACCEPT; }
+#line 2010 "gram.tab.c"
+    break;
+
+  case 73: /* stmt: DBG EOL  */
+#line 458 "gram.y"
+                                                {
+		param.number = DBG; param.pmid = HELP_USAGE; 
+		stmt_type = HELP; YYACCEPT;
+	    }
+#line 2019 "gram.tab.c"
+    break;
+
+  case 74: /* stmt: DBG ALL EOL  */
+#line 462 "gram.y"
+                                                {
+		sts = pmSetDebug("all");
+		if (sts < 0) {
+		    pmsprintf(warnStr, MYWARNSTRSZ, "pmSetDebug(\"all\") failed\n");
+		    yywarn(warnStr);
+		    YYERROR;
+		}
+		stmt_type = DBG; YYACCEPT;
+	    }
+#line 2033 "gram.tab.c"
+    break;
+
+  case 75: /* stmt: DBG NONE EOL  */
+#line 471 "gram.y"
+                                                {
+		sts = pmClearDebug("all");
+		if (sts < 0) {
+		    pmsprintf(warnStr, MYWARNSTRSZ, "pmClearDebug(\"all\") failed\n");
+		    yywarn(warnStr);
+		    YYERROR;
+		}
+		stmt_type = DBG; YYACCEPT;
+	    }
+#line 2047 "gram.tab.c"
+    break;
+
+  case 76: /* stmt: DBG debug EOL  */
+#line 480 "gram.y"
+                                                {
+	        stmt_type = DBG; YYACCEPT;
+	    }
+#line 2055 "gram.tab.c"
+    break;
+
+  case 77: /* stmt: STATUS EOL  */
+#line 483 "gram.y"
+                                                { 
+		stmt_type = STATUS; YYACCEPT; 
+	    }
+#line 2063 "gram.tab.c"
+    break;
+
+  case 78: /* stmt: TIMER EOL  */
+#line 486 "gram.y"
+                                                {
+		param.number = TIMER; param.pmid = HELP_USAGE;
+		stmt_type = HELP; YYACCEPT;
+	    }
+#line 2072 "gram.tab.c"
+    break;
+
+  case 79: /* stmt: TIMER ON EOL  */
+#line 490 "gram.y"
+                                                { 
+		timer = 1; stmt_type = EOL; YYACCEPT; 
+	    }
+#line 2080 "gram.tab.c"
+    break;
+
+  case 80: /* stmt: TIMER OFF EOL  */
+#line 493 "gram.y"
+                                                { 
+		timer = 0; stmt_type = EOL; YYACCEPT; 
+	    }
+#line 2088 "gram.tab.c"
+    break;
+
+  case 81: /* stmt: GETDESC EOL  */
+#line 496 "gram.y"
+                                                {
+		param.number = GETDESC; param.pmid = HELP_USAGE;
+		stmt_type = HELP; YYACCEPT;
+	    }
+#line 2097 "gram.tab.c"
+    break;
+
+  case 82: /* stmt: GETDESC ON EOL  */
+#line 500 "gram.y"
+                                                        { 
+		get_desc = 1; stmt_type = EOL; YYACCEPT; 
+	    }
+#line 2105 "gram.tab.c"
+    break;
+
+  case 83: /* stmt: GETDESC OFF EOL  */
+#line 503 "gram.y"
+                                                        { 
+		get_desc = 0; stmt_type = EOL; YYACCEPT; 
+	    }
+#line 2113 "gram.tab.c"
+    break;
+
+  case 84: /* stmt: WAIT EOL  */
+#line 506 "gram.y"
+                                                {
+		param.number = WAIT; param.pmid = HELP_USAGE;
+		stmt_type = HELP; YYACCEPT;
+	    }
+#line 2122 "gram.tab.c"
+    break;
+
+  case 85: /* stmt: WAIT NUMBER EOL  */
+#line 510 "gram.y"
+                                                { 
+		stmt_type = EOL; sleep((yyvsp[-1].y_num)); YYACCEPT;
+	    }
+#line 2130 "gram.tab.c"
+    break;
+
+  case 86: /* stmt: EOL  */
+#line 513 "gram.y"
+                                                { stmt_type = EOL; YYACCEPT; }
+#line 2136 "gram.tab.c"
+    break;
+
+  case 87: /* stmt: %empty  */
+#line 514 "gram.y"
+                                                {
+		if (yywrap())
+		    YYACCEPT;
+		else {
+		    yyerror("Unrecognized command");
+		    YYERROR;
+		}
+	    }
+#line 2149 "gram.tab.c"
+    break;
+
+  case 88: /* fname: NAME  */
+#line 524 "gram.y"
+                                                {
+		    /* check for absolute path - *nix and Windows style */
+		    if ((yyvsp[0].y_str)[0] == '/' ||
+		        (strlen((yyvsp[0].y_str)) > 4 && (yyvsp[0].y_str)[1] == ':' && (yyvsp[0].y_str)[2] == '/'))
+			(yyval.y_str) = (yyvsp[0].y_str);
+		    else
+			/* relative path */
+			(yyval.y_str) = strcons("./", (yyvsp[0].y_str));
+	    }
+#line 2163 "gram.tab.c"
+    break;
+
+  case 89: /* fname: PATHNAME  */
+#line 533 "gram.y"
+                                                { (yyval.y_str) = (yyvsp[0].y_str); }
+#line 2169 "gram.tab.c"
+    break;
+
+  case 90: /* optdomain: NUMBER  */
+#line 536 "gram.y"
+                                                { (yyval.y_num) = (yyvsp[0].y_num); }
+#line 2175 "gram.tab.c"
+    break;
+
+  case 91: /* optdomain: %empty  */
+#line 537 "gram.y"
+                                                { (yyval.y_num) = 0; }
+#line 2181 "gram.tab.c"
+    break;
+
+  case 92: /* attribute: NUMBER  */
+#line 540 "gram.y"
+                                                {
+		sts = __pmAttrKeyStr_r((yyvsp[0].y_num), warnStr, sizeof(warnStr));
+		if (sts <= 0) {
+		    pmsprintf(warnStr, MYWARNSTRSZ, "Attribute (%d) is not recognised", (yyvsp[0].y_num));
+		    yyerror(warnStr);
+		    YYERROR;
+		}
+		(yyval.y_num) = (yyvsp[0].y_num);
+	    }
+#line 2195 "gram.tab.c"
+    break;
+
+  case 93: /* attribute: STRING  */
+#line 549 "gram.y"
+                                                { 
+		sts = __pmLookupAttrKey((yyvsp[0].y_str), strlen((yyvsp[0].y_str))+1);
+		if (sts <= 0) {
+		    pmsprintf(warnStr, MYWARNSTRSZ, "Attribute (%s) is not recognised", (yyvsp[0].y_str));
+		    yyerror(warnStr);
+		    YYERROR;
+		}
+		(yyval.y_num) = sts;
+	    }
+#line 2209 "gram.tab.c"
+    break;
+
+  case 94: /* servport: NUMBER  */
+#line 560 "gram.y"
+                                                { (yyval.y_num) = (yyvsp[0].y_num); }
+#line 2215 "gram.tab.c"
+    break;
+
+  case 95: /* servport: STRING  */
+#line 561 "gram.y"
+                                                {
+		struct servent *srv = getservbyname((yyvsp[0].y_str), NULL);
+		if (srv == NULL) {
+		    pmsprintf(warnStr, MYWARNSTRSZ, "Failed to map (%s) to a port number", (yyvsp[0].y_str));
+		    yyerror(warnStr);
+		    YYERROR;
+		}
+		pmsprintf(warnStr, MYWARNSTRSZ, "Mapped %s to port number %d", (yyvsp[0].y_str), srv->s_port);
+		yywarn(warnStr);
+		(yyval.y_num) = srv->s_port;
+	    }
+#line 2231 "gram.tab.c"
+    break;
+
+  case 96: /* metric: NUMBER  */
+#line 574 "gram.y"
+                                                { 
+		pmid.whole = (yyvsp[0].y_num);
+		sts = pmNameID(pmid.whole, &str);
+		if (sts < 0) {
+		    pmsprintf(warnStr, MYWARNSTRSZ, "PMID (%s) is not defined in the PMNS",
+			    pmIDStr(pmid.whole));
+		    yywarn(warnStr);
+		}
+		else
+		    free(str);
+		(yyval.y_num) = (int)pmid.whole; 
+	    }
+#line 2248 "gram.tab.c"
+    break;
+
+  case 97: /* metric: NUMBER2D  */
+#line 586 "gram.y"
+                                                {
+		pmid.whole = 0;
+		pmid.part.cluster = (yyvsp[0].y_2num).num1;
+		pmid.part.item = (yyvsp[0].y_2num).num2;
+		sts = pmNameID(pmid.whole, &str);
+		if (sts < 0) {
+		    pmsprintf(warnStr, MYWARNSTRSZ, "PMID (%s) is not defined in the PMNS",
+			    pmIDStr(pmid.whole));
+		    yywarn(warnStr);
+		}
+		else
+		    free(str);
+		(yyval.y_num) = (int)pmid.whole;
+	    }
+#line 2267 "gram.tab.c"
+    break;
+
+  case 98: /* metric: NUMBER3D  */
+#line 600 "gram.y"
+                                                {
+		pmid.whole = 0;
+		pmid.part.domain = (yyvsp[0].y_3num).num1;
+		pmid.part.cluster = (yyvsp[0].y_3num).num2;
+		pmid.part.item = (yyvsp[0].y_3num).num3;
+		sts = pmNameID(pmid.whole, &str);
+		if (sts < 0) {
+		    pmsprintf(warnStr, MYWARNSTRSZ, "PMID (%s) is not defined in the PMNS",
+			    pmIDStr(pmid.whole));
+		    yywarn(warnStr);
+		}
+		else
+		    free(str);
+		(yyval.y_num) = (int)pmid.whole;
+	    }
+#line 2287 "gram.tab.c"
+    break;
+
+  case 99: /* metric: NAME  */
+#line 615 "gram.y"
+                                                {
+		sts = pmLookupName(1, &(yyvsp[0].y_str), &pmid.whole);
+		if (sts < 0) {
+		    yyerror(pmErrStr(sts));
+		    YYERROR;
+		}
+		sts = fix_dynamic_pmid((yyvsp[0].y_str), &pmid.whole);
+		if (sts < 0) {
+		    yyerror(pmErrStr(sts));
+		    YYERROR;
+		}
+		(yyval.y_num) = (int)pmid.whole;
+	    }
+#line 2305 "gram.tab.c"
+    break;
+
+  case 100: /* cluster: NUMBER  */
+#line 630 "gram.y"
+                                                { 
+		pmid.whole = (yyvsp[0].y_num);
+	        (yyval.y_num) = (int)pmid.whole;
+	    }
+#line 2314 "gram.tab.c"
+    break;
+
+  case 101: /* cluster: NUMBER2D  */
+#line 634 "gram.y"
+                                                {
+		pmid.whole = 0;
+		pmid.part.domain = (yyvsp[0].y_2num).num1;
+		pmid.part.cluster = (yyvsp[0].y_2num).num2;
+		(yyval.y_num) = (int)pmid.whole;
+	    }
+#line 2325 "gram.tab.c"
+    break;
+
+  case 102: /* indom: NUMBER  */
+#line 642 "gram.y"
+                                                { 
+		indom.whole = (yyvsp[0].y_num);
+	        (yyval.y_num) = (int)indom.whole;
+	    }
+#line 2334 "gram.tab.c"
+    break;
+
+  case 103: /* indom: NEGNUMBER  */
+#line 646 "gram.y"
+                                                { 
+		indom.whole = (yyvsp[0].y_num);
+		(yyval.y_num) = (int)indom.whole;
+	    }
+#line 2343 "gram.tab.c"
+    break;
+
+  case 104: /* indom: NUMBER2D  */
+#line 650 "gram.y"
+                                                {
+		indom.whole = 0;
+		indom.part.domain = (yyvsp[0].y_2num).num1;
+		indom.part.serial = (yyvsp[0].y_2num).num2;
+		(yyval.y_num) = (int)indom.whole;
+	    }
+#line 2354 "gram.tab.c"
+    break;
+
+  case 105: /* raw_pmid: NUMBER3D  */
+#line 658 "gram.y"
+                                                {
+		pmid.whole = 0;
+		pmid.part.domain = (yyvsp[0].y_3num).num1;
+		pmid.part.cluster = (yyvsp[0].y_3num).num2;
+		pmid.part.item = (yyvsp[0].y_3num).num3;
+		(yyval.y_num) = (int)pmid.whole;
+	    }
+#line 2366 "gram.tab.c"
+    break;
+
+  case 106: /* metriclist: metric  */
+#line 667 "gram.y"
+                                                { addmetriclist((pmID)(yyvsp[0].y_num)); }
+#line 2372 "gram.tab.c"
+    break;
+
+  case 107: /* metriclist: metriclist metric  */
+#line 668 "gram.y"
+                                                { addmetriclist((pmID)(yyvsp[0].y_num)); }
+#line 2378 "gram.tab.c"
+    break;
+
+  case 108: /* metriclist: metriclist COMMA metric  */
+#line 669 "gram.y"
+                                                { addmetriclist((pmID)(yyvsp[0].y_num)); }
+#line 2384 "gram.tab.c"
+    break;
+
+  case 109: /* arglist: %empty  */
+#line 673 "gram.y"
+                                                { doargs(); }
+#line 2390 "gram.tab.c"
+    break;
+
+  case 110: /* inst: STRING  */
+#line 676 "gram.y"
+                                                { (yyval.y_str) = (yyvsp[0].y_str); }
+#line 2396 "gram.tab.c"
+    break;
+
+  case 111: /* inst: NAME  */
+#line 677 "gram.y"
+                                                { (yyval.y_str) = (yyvsp[0].y_str); }
+#line 2402 "gram.tab.c"
+    break;
+
+  case 112: /* debug: NUMBER  */
+#line 680 "gram.y"
+                                        {
+			char	nbuf[12];
+			pmsprintf(nbuf, sizeof(nbuf), "%d", (yyvsp[0].y_num));
+			sts = pmSetDebug(nbuf);
+			if (sts < 0) {
+			    pmsprintf(warnStr, MYWARNSTRSZ, "Bad debug flag (%s)", nbuf);
+			    yyerror(warnStr);
+			    YYERROR;
+			}
+			(yyval.y_num) = 0;
+		    }
+#line 2418 "gram.tab.c"
+    break;
+
+  case 113: /* debug: NAME  */
+#line 691 "gram.y"
+                                                {
+			sts = pmSetDebug((yyvsp[0].y_str));
+			if (sts < 0) {
+			    pmsprintf(warnStr, MYWARNSTRSZ, "Bad debug flag (%s)", (yyvsp[0].y_str));
+			    yyerror(warnStr);
+			    YYERROR;
+			}
+			(yyval.y_num) = 0;
+		    }
+#line 2432 "gram.tab.c"
+    break;
+
+  case 114: /* debug: debug NUMBER  */
+#line 700 "gram.y"
+                                                {
+			char	nbuf[12];
+			pmsprintf(nbuf, sizeof(nbuf), "%d", (yyvsp[0].y_num));
+			sts = pmSetDebug(nbuf);
+			if (sts < 0) {
+			    pmsprintf(warnStr, MYWARNSTRSZ, "Bad debug flag (%s)", nbuf);
+			    yyerror(warnStr);
+			    YYERROR;
+			}
+			(yyval.y_num) = 0;
+		    }
+#line 2448 "gram.tab.c"
+    break;
+
+  case 115: /* debug: debug NAME  */
+#line 711 "gram.y"
+                                                        {
+			sts = pmSetDebug((yyvsp[0].y_str));
+			if (sts < 0) {
+			    pmsprintf(warnStr, MYWARNSTRSZ, "Bad debug flag (%s)", (yyvsp[0].y_str));
+			    yyerror(warnStr);
+			    YYERROR;
+			}
+			(yyval.y_num) = 0;
+		    }
+#line 2462 "gram.tab.c"
+    break;
+
+
+#line 2466 "gram.tab.c"
+
+      default: break;
+    }
+  /* User semantic actions sometimes alter yychar, and that requires
+     that yytoken be updated with the new translation.  We take the
+     approach of translating immediately before every use of yytoken.
+     One alternative is translating here after every semantic action,
+     but that translation would be missed if the semantic action invokes
+     YYABORT, YYACCEPT, or YYERROR immediately after altering yychar or
+     if it invokes YYBACKUP.  In the case of YYABORT or YYACCEPT, an
+     incorrect destructor might then be invoked immediately.  In the
+     case of YYERROR or YYBACKUP, subsequent parser actions might lead
+     to an incorrect destructor call or verbose syntax error message
+     before the lookahead is translated.  */
+  YY_SYMBOL_PRINT ("-> $$ =", YY_CAST (yysymbol_kind_t, yyr1[yyn]), &yyval, &yyloc);
+
+  YYPOPSTACK (yylen);
+  yylen = 0;
+
+  *++yyvsp = yyval;
+
+  /* Now 'shift' the result of the reduction.  Determine what state
+     that goes to, based on the state we popped back to and the rule
+     number reduced by.  */
+  {
+    const int yylhs = yyr1[yyn] - YYNTOKENS;
+    const int yyi = yypgoto[yylhs] + *yyssp;
+    yystate = (0 <= yyi && yyi <= YYLAST && yycheck[yyi] == *yyssp
+               ? yytable[yyi]
+               : yydefgoto[yylhs]);
+  }
+
+  goto yynewstate;
+
+
+/*--------------------------------------.
+| yyerrlab -- here on detecting error.  |
+`--------------------------------------*/
+yyerrlab:
+  /* Make sure we have latest lookahead translation.  See comments at
+     user semantic actions for why this is necessary.  */
+  yytoken = yychar == YYEMPTY ? YYSYMBOL_YYEMPTY : YYTRANSLATE (yychar);
+  /* If not already recovering from an error, report this error.  */
+  if (!yyerrstatus)
+    {
+      ++yynerrs;
+      yyerror (YY_("syntax error"));
+    }
+
+  if (yyerrstatus == 3)
+    {
+      /* If just tried and failed to reuse lookahead token after an
+         error, discard it.  */
+
+      if (yychar <= YYEOF)
+        {
+          /* Return failure if at end of input.  */
+          if (yychar == YYEOF)
+            YYABORT;
+        }
+      else
+        {
+          yydestruct ("Error: discarding",
+                      yytoken, &yylval);
+          yychar = YYEMPTY;
+        }
+    }
+
+  /* Else will try to reuse lookahead token after shifting the error
+     token.  */
+  goto yyerrlab1;
+
+
+/*---------------------------------------------------.
+| yyerrorlab -- error raised explicitly by YYERROR.  |
+`---------------------------------------------------*/
+yyerrorlab:
+  /* Pacify compilers when the user code never invokes YYERROR and the
+     label yyerrorlab therefore never appears in user code.  */
+  if (0)
+    YYERROR;
+  ++yynerrs;
+
+  /* Do not reclaim the symbols of the rule whose action triggered
+     this YYERROR.  */
+  YYPOPSTACK (yylen);
+  yylen = 0;
+  YY_STACK_PRINT (yyss, yyssp);
+  yystate = *yyssp;
+  goto yyerrlab1;
+
+
+/*-------------------------------------------------------------.
+| yyerrlab1 -- common code for both syntax error and YYERROR.  |
+`-------------------------------------------------------------*/
+yyerrlab1:
+  yyerrstatus = 3;      /* Each real token shifted decrements this.  */
+
+  /* Pop stack until we find a state that shifts the error token.  */
+  for (;;)
+    {
+      yyn = yypact[yystate];
+      if (!yypact_value_is_default (yyn))
+        {
+          yyn += YYSYMBOL_YYerror;
+          if (0 <= yyn && yyn <= YYLAST && yycheck[yyn] == YYSYMBOL_YYerror)
+            {
+              yyn = yytable[yyn];
+              if (0 < yyn)
+                break;
+            }
+        }
+
+      /* Pop the current state because it cannot handle the error token.  */
+      if (yyssp == yyss)
+        YYABORT;
+
+
+      yydestruct ("Error: popping",
+                  YY_ACCESSING_SYMBOL (yystate), yyvsp);
+      YYPOPSTACK (1);
+      yystate = *yyssp;
+      YY_STACK_PRINT (yyss, yyssp);
+    }
+
+  YY_IGNORE_MAYBE_UNINITIALIZED_BEGIN
+  *++yyvsp = yylval;
+  YY_IGNORE_MAYBE_UNINITIALIZED_END
+
+
+  /* Shift the error token.  */
+  YY_SYMBOL_PRINT ("Shifting", YY_ACCESSING_SYMBOL (yyn), yyvsp, yylsp);
+
+  yystate = yyn;
+  goto yynewstate;
+
+
+/*-------------------------------------.
+| yyacceptlab -- YYACCEPT comes here.  |
+`-------------------------------------*/
+yyacceptlab:
+  yyresult = 0;
+  goto yyreturnlab;
+
+
+/*-----------------------------------.
+| yyabortlab -- YYABORT comes here.  |
+`-----------------------------------*/
+yyabortlab:
+  yyresult = 1;
+  goto yyreturnlab;
+
+
+/*-----------------------------------------------------------.
+| yyexhaustedlab -- YYNOMEM (memory exhaustion) comes here.  |
+`-----------------------------------------------------------*/
+yyexhaustedlab:
+  yyerror (YY_("memory exhausted"));
+  yyresult = 2;
+  goto yyreturnlab;
+
+
+/*----------------------------------------------------------.
+| yyreturnlab -- parsing is finished, clean up and return.  |
+`----------------------------------------------------------*/
+yyreturnlab:
+  if (yychar != YYEMPTY)
+    {
+      /* Make sure we have latest lookahead translation.  See comments at
+         user semantic actions for why this is necessary.  */
+      yytoken = YYTRANSLATE (yychar);
+      yydestruct ("Cleanup: discarding lookahead",
+                  yytoken, &yylval);
+    }
+  /* Do not reclaim the symbols of the rule whose action triggered
+     this YYABORT or YYACCEPT.  */
+  YYPOPSTACK (yylen);
+  YY_STACK_PRINT (yyss, yyssp);
+  while (yyssp != yyss)
+    {
+      yydestruct ("Cleanup: popping",
+                  YY_ACCESSING_SYMBOL (+*yyssp), yyvsp);
+      YYPOPSTACK (1);
+    }
+#ifndef yyoverflow
+  if (yyss != yyssa)
+    YYSTACK_FREE (yyss);
+#endif
+
+  return yyresult;
+}
+
+#line 722 "gram.y"
+
@@ -7,7 +7,7 @@
  *	remain fixed across releases, and they may not work, or may
  *	provide different semantics at some point in the future.
  *
- * Copyright (c) 2012-2018 Red Hat.
+ * Copyright (c) 2012-2019 Red Hat.
  * Copyright (c) 2008-2009 Aconex.  All Rights Reserved.
  * Copyright (c) 1995-2002 Silicon Graphics, Inc.  All Rights Reserved.
  *
@@ -172,6 +172,9 @@ typedef struct __pmnsTree {
     __pmnsNode		**htab; /* hash table of nodes keyed on pmid */
     int			htabsize;     /* number of nodes in the table */
     int			mark_state;   /* the total mark value for trimming */
+    void		*image;	/* mapped compiled PMNS, else NULL */
+    size_t		imagelen;     /* length of mapped image */
+    __pmnsNode		*nodes; /* all nodes of a tree from image */
 } __pmnsTree;
 
 /* used by pmnsmerge/pmnsdel */
@@ -183,6 +186,9 @@ PCP_CALL extern void __pmUsePMNS(__pmnsTree *); /* for debugging */
 PCP_CALL extern int __pmFixPMNSHashTab(__pmnsTree *, int, int);
 PCP_CALL extern int __pmAddPMNSNode(__pmnsTree *, int, const char *);
 
+/* compile a loaded PMNS tree into an image file, for pmnscomp */
+PCP_CALL extern int __pmWritePMNSImage(__pmnsTree *, const char *, const char *);
+
 /* return true if the named pmns file has changed */
 PCP_CALL extern int __pmHasPMNSFileChanged(const char *);
 
@@ -210,6 +216,8 @@ PCP_CALL extern int __pmHasPMNSFileChanged(const char *);
 #define PDU_LABEL		0x7013
 #define PDU_FINISH		0x7013
 #define PDU_MAX		 	(PDU_FINISH - PDU_START)
+/* type flag for a PDU sent with a compressed body, see PDU_FLAG_LZMA */
+#define PDU_COMPRESSED		0x40000000
 
 typedef __uint32_t	__pmPDU;
 /*
@@ -283,6 +291,9 @@ typedef struct {
 #define PDU_FLAG_CERT_REQD	(1U<<7)
 #define PDU_FLAG_BAD_LABEL	(1U<<8)	/* bad, encoding issues */
 #define PDU_FLAG_LABELS		(1U<<9)
+#define PDU_FLAG_LZMA		(1U<<10)	/* compress large PDU bodies */
+#define PDU_FLAG_INDOM_DELTA	(1U<<11)	/* instance domain changes */
+#define PDU_FLAG_PIPELINE	(1U<<12)	/* agent replies to requests in order */
 /* Credential CVERSION PDU elements look like this */
 typedef struct {
 #ifdef HAVE_BITFIELDS_LTOR
@@ -361,6 +372,7 @@ PCP_CALL extern int __pmDecodeXtendError(__pmPDU *, int *, int *);
 PCP_CALL extern int __pmSendResult(int, int, const pmResult *);
 PCP_CALL extern int __pmEncodeResult(int, const pmResult *, __pmPDU **);
 PCP_CALL extern int __pmDecodeResult(__pmPDU *, pmResult **);
+PCP_CALL extern int __pmDecodeResultArena(__pmPDU *, pmResult **);
 PCP_CALL extern int __pmSendProfile(int, int, int, pmProfile *);
 PCP_CALL extern int __pmDecodeProfile(__pmPDU *, int *, pmProfile **);
 PCP_CALL extern int __pmSendFetch(int, int, int, pmTimeval *, int, pmID *);
@@ -373,6 +385,28 @@ PCP_CALL extern int __pmSendInstanceReq(int, int, const pmTimeval *, pmInDom, in
 PCP_CALL extern int __pmDecodeInstanceReq(__pmPDU *, pmTimeval *, pmInDom *, int *, char **);
 PCP_CALL extern int __pmSendInstance(int, int, pmInResult *);
 PCP_CALL extern int __pmDecodeInstance(__pmPDU *, pmInResult **);
+
+/*
+ * Changes to an instance domain since the generation of it last sent
+ * to a client, see PDU_FLAG_INDOM_DELTA.  The client asks for these by
+ * sending its generation in the "when" field of a PDU_INSTANCE_REQ for
+ * all instances, with a tv_usec of PDU_INDOM_DELTA.
+ */
+#define PDU_INDOM_DELTA		-1
+typedef struct {
+    pmInDom	indom;
+    int		generation;	/* generation at pmcd, after the changes */
+    int		full;		/* instlist is the whole instance domain */
+    int		numdrop;	/* no. of instances removed */
+    int		*droplist;	/* internal ids of instances removed */
+    int		numinst;	/* no. of instances added or renamed */
+    int		*instlist;	/* internal ids of instances added or renamed */
+    char	**namelist;	/* names of instances added or renamed */
+} __pmInDomDelta;
+PCP_CALL extern int __pmSendInstanceDeltaReq(int, int, pmInDom, int);
+PCP_CALL extern int __pmSendInstanceDelta(int, int, const __pmInDomDelta *);
+PCP_CALL extern int __pmDecodeInstanceDelta(__pmPDU *, __pmInDomDelta *);
+PCP_CALL extern void __pmFreeInDomDelta(__pmInDomDelta *);
 PCP_CALL extern int __pmSendTextReq(int, int, int, int);
 PCP_CALL extern int __pmDecodeTextReq(__pmPDU *, int *, int *);
 PCP_CALL extern int __pmSendText(int, int, int, const char *);
@@ -414,6 +448,12 @@ PCP_CALL extern int __pmVersionIPC(int);
 PCP_CALL extern int __pmSocketIPC(int);
 PCP_CALL extern void __pmOverrideLastFd(int);
 PCP_CALL extern void __pmResetIPC(int);
+PCP_CALL extern int __pmSetCompressIPC(int, int);
+PCP_CALL extern int __pmCompressIPC(int);
+
+/* queue PDUs sent on a connection, and send them together */
+PCP_CALL extern void __pmXmitBatch(int);
+PCP_CALL extern int __pmXmitFlush(int);
 
 /* platform independent socket services */
 typedef fd_set __pmFdSet;
@@ -593,6 +633,22 @@ typedef struct {
     int			pc_timeout;	/* set if connect times out */
     int			pc_tout_sec;	/* timeout for __pmGetPDU */
     time_t		pc_again;	/* time to try again */
+    /*
+     * Contexts to the same pmcd with the same attributes and flags may
+     * share the one connection, each with its own profile at the pmcd
+     * end.  pmcd reports state changes once per connection, so these
+     * are counted here and passed on to each context (c_changes).
+     */
+    int			pc_refcnt;	/* number of contexts using this */
+    int			pc_exclusive;	/* set if not to be shared further */
+    int			pc_epoch;	/* incremented on each (re)connect */
+    int			pc_labels;	/* incremented on pmcd label changes */
+    int			pc_changes;	/* count of pmcd state changes */
+    int			pc_changed[8];	/* pc_changes as each PMCD_* bit was seen */
+    int			pc_flags;	/* context flags for the connection */
+    char		*pc_spec;	/* host and attributes specification */
+    void		*pc_indoms;	/* cached instance domains, if any */
+    __pmMutex		pc_lock;	/* for each request/reply exchange */
 } __pmPMCDCtl;
 PCP_CALL extern int __pmAuxConnectPMCDPort(const char *, int);
 
@@ -822,6 +878,10 @@ typedef struct {
     __pmHashCtl		c_attrs;	/* various optional context attributes */
     int			c_handle;	/* context number above PMAPI */
     int			c_slot;		/* index to contexts[] below PMAPI */
+    void		*c_async;	/* asynchronous requests, if any */
+    int			c_epoch;	/* pc_epoch when profile was sent */
+    int			c_changes;	/* pc_changes when last reported */
+    void		*c_labels;	/* cached label sets, if any */
 } __pmContext;
 
 #define PM_CONTEXT_INIT	-2		/* special type: being initialized, do not use */
@@ -1206,6 +1266,7 @@ typedef enum {
     PM_SERVER_FEATURE_CONTAINERS,
     PM_SERVER_FEATURE_LOCAL,
     PM_SERVER_FEATURE_CERT_REQD,
+    PM_SERVER_FEATURE_LZMA,
     PM_SERVER_FEATURES
 } __pmServerFeature;
 PCP_CALL extern int __pmServerHasFeature(__pmServerFeature);
@@ -1250,7 +1311,8 @@ typedef enum {
     PCP_ATTR_LOCAL	= 13,	/* AF_UNIX socket with localhost fallback */
     PCP_ATTR_PROCESSID	= 14,	/* pid - process identifier (posix) */
     PCP_ATTR_CONTAINER	= 15,	/* container name (linux) */
-    PCP_ATTR_EXCLUSIVE	= 16,	/* DEPRECATED exclusive socket tied to this context */
+    PCP_ATTR_EXCLUSIVE	= 16,	/* exclusive socket tied to this context */
+    PCP_ATTR_SHARED	= 17,	/* socket shared with like contexts */
 } __pmAttrKey;
 PCP_CALL extern __pmAttrKey __pmLookupAttrKey(const char *, size_t);
 PCP_CALL extern int __pmParseHostAttrsSpec(
@@ -348,12 +348,13 @@ PCP_CALL extern int pmNewContext(int, const char *);
 #define PM_CONTEXT_LOCAL	3	/* local host, no pmcd connection */
 #define PM_CONTEXT_TYPEMASK	0xff	/* mask to separate types / flags */
 #define PM_CTXFLAG_SHALLOW	(1U<<8)	/* DEPRECATED (don't actually connect to host) */
-#define PM_CTXFLAG_EXCLUSIVE	(1U<<9)	/* DEPRECATED (don't share socket among ctxts) */
+#define PM_CTXFLAG_EXCLUSIVE	(1U<<9)	/* don't share socket among ctxts */
 #define PM_CTXFLAG_SECURE	(1U<<10)/* encrypted socket comms channel */
 #define PM_CTXFLAG_COMPRESS	(1U<<11)/* compressed socket host channel */
 #define PM_CTXFLAG_RELAXED	(1U<<12)/* encrypted if possible else not */
 #define PM_CTXFLAG_AUTH		(1U<<13)/* make authenticated connection */
 #define PM_CTXFLAG_CONTAINER	(1U<<14)/* container connection attribute */
+#define PM_CTXFLAG_SHARED	(1U<<15)/* share socket with like contexts */
 
 /*
  * Duplicate current context -- returns handle to new one for pmUseContext()
@@ -1080,6 +1081,9 @@ PCP_CALL extern int pmExtendFetchGroup_item(pmFG, const char *, const char *,
 PCP_CALL extern int pmExtendFetchGroup_indom(pmFG, const char *, const char *,
 			int[], char *[], pmAtomValue[], int, int[],
 			unsigned int, unsigned int *, int *);
+PCP_CALL extern int pmExtendFetchGroup_column(pmFG, const char *, const char *,
+			int[], char *[], void *, int, int[],
+			unsigned int, unsigned int *, int *);
 PCP_CALL extern int pmExtendFetchGroup_event(pmFG, const char *, const char *,
 			const char *, const char *,
 			struct timespec[], pmAtomValue[], int, int[],
@@ -1088,6 +1092,25 @@ PCP_CALL extern int pmExtendFetchGroup_timestamp(pmFG, struct timeval *);
 PCP_CALL extern int pmFetchGroup(pmFG);
 PCP_CALL extern int pmDestroyFetchGroup(pmFG);
 
+/*
+ * Asynchronous requests for PM_CONTEXT_HOST contexts - replies are
+ * delivered to the callbacks from pmAsyncEvents or pmAsyncPoll, in
+ * the order requests were made, once the pmcd socket is readable.
+ */
+typedef void (*pmAsyncFetchCallBack)(int, int, pmResult *, void *);
+typedef void (*pmAsyncInDomCallBack)(int, int, int *, char **, void *);
+typedef void (*pmAsyncWatchCallBack)(int, int, int, void *);
+#define PM_ASYNC_STOP	0	/* no requests pending, stop watching fd */
+#define PM_ASYNC_START	1	/* requests pending, watch fd for input */
+#define PM_ASYNC_CLOSE	2	/* context destroyed, release any watch */
+PCP_CALL extern int pmFetchAsync(int, int, pmID *, pmAsyncFetchCallBack, void *);
+PCP_CALL extern int pmGetInDomAsync(int, pmInDom, pmAsyncInDomCallBack, void *);
+PCP_CALL extern int pmAsyncSetWatch(int, pmAsyncWatchCallBack, void *);
+PCP_CALL extern int pmAsyncFd(int);
+PCP_CALL extern int pmAsyncPending(int);
+PCP_CALL extern int pmAsyncEvents(int);
+PCP_CALL extern int pmAsyncPoll(const int *, int, struct timeval *);
+
 /* libpcp debug/tracing */
 PCP_CALL extern int pmSetDebug(const char *);
 PCP_CALL extern int pmClearDebug(const char *);
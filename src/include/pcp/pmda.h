@@ -83,6 +83,14 @@ typedef int (*pmdaFetchCallBack)(pmdaMetric *, unsigned int, pmAtomValue *);
 #define PMDA_FETCH_STATIC	1
 #define PMDA_FETCH_DYNAMIC	2	/* free avp->vp after __pmStuffValue */
 
+/*
+ * Type of function call back used by pmdaFetch to fetch all instances
+ * of one metric at once (instance list, values and per-instance return
+ * values as for pmdaFetchCallBack), returning PM_ERR_NYI to fall back
+ * to per-instance pmdaFetchCallBack calls for that metric.
+ */
+typedef int (*pmdaFetchBulkCallBack)(pmdaMetric *, int, const int *, pmAtomValue *, int *);
+
 /*
  * Type of function call back used by pmdaMain to clean up a pmResult structure
  * after a fetch.
@@ -438,6 +446,11 @@ typedef struct pmdaOptions {
  *	Loop which receives PDUs and dispatches the callbacks. Must be called
  *	by a daemon PMDA.
  *
+ * pmdaSetThreads
+ *	Request that pmdaMain runs fetches for different client contexts
+ *	concurrently, in the given number of threads (see pmdaMain(3) for
+ *	the thread-safety requirements on the PMDA fetch methods).
+ *
  * pmdaSendError
  *	Used to inform PMCD the PMDA is ready/notready to process requests.
  *	See pmcd(1) for details, in particular the protocol entry for the
@@ -454,6 +467,11 @@ typedef struct pmdaOptions {
  *      pmAtom structure with a metrics value. This must be set if pmdaFetch is
  *      used as the fetch callback.
  *
+ * pmdaSetFetchBulkCallBack
+ *      Allows an application specific routine to be specified for completing
+ *      the pmAtom structures of all requested instances of a metric in one
+ *      call, before (optionally) falling back to the fetch callback.
+ *
  * pmdaSetCheckCallBack
  *      Allows an application specific routine to be called upon receipt of any
  *      PDU. For all PDUs except PDU_PROFILE, a result less than zero
@@ -493,10 +511,12 @@ PMDA_CALL extern void pmdaInit(pmdaInterface *, pmdaIndom *, int, pmdaMetric *,
 PMDA_CALL extern void pmdaConnect(pmdaInterface *);
 
 PMDA_CALL extern void pmdaMain(pmdaInterface *);
+PMDA_CALL extern void pmdaSetThreads(pmdaInterface *, int);
 PMDA_CALL extern void pmdaSendError(pmdaInterface *, int);
 
 PMDA_CALL extern void pmdaSetResultCallBack(pmdaInterface *, pmdaResultCallBack);
 PMDA_CALL extern void pmdaSetFetchCallBack(pmdaInterface *, pmdaFetchCallBack);
+PMDA_CALL extern void pmdaSetFetchBulkCallBack(pmdaInterface *, pmdaFetchBulkCallBack);
 PMDA_CALL extern void pmdaSetCheckCallBack(pmdaInterface *, pmdaCheckCallBack);
 PMDA_CALL extern void pmdaSetDoneCallBack(pmdaInterface *, pmdaDoneCallBack);
 PMDA_CALL extern void pmdaSetEndContextCallBack(pmdaInterface *, pmdaEndContextCallBack);
@@ -724,6 +744,62 @@ PMDA_CALL extern int pmdaCacheResize(pmInDom, int);
 #define PMDA_CACHE_DUMP			19
 #define PMDA_CACHE_DUMP_ALL		20
 
+/*
+ * PMDA per-cluster refresh cache support
+ *
+ * pmdaRefreshCreate
+ *	allocate refresh state for a number of clusters, with a default
+ *	freshness window in milliseconds (zero disables sharing)
+ *
+ * pmdaRefreshSetWindow, pmdaRefreshGetWindow
+ *	adjust or report the window of one cluster, or the default if
+ *	the cluster is negative
+ *
+ * pmdaRefreshCheck
+ *	returns non-zero if a cluster must be refreshed for a request,
+ *	else the values from a recent refresh can be shared; the last
+ *	argument is a per-request window override (negative for none,
+ *	zero forces an unshared refresh)
+ *
+ * pmdaRefreshCheckGroup
+ *	as for pmdaRefreshCheck, for a group of clusters (terminated by
+ *	a negative value) refreshed together - clears the need[] array
+ *	entries of any shared clusters, returns non-zero if the group
+ *	must be refreshed
+ *
+ * pmdaRefreshDone
+ *	mark a cluster refreshed, accumulating refresh time
+ *
+ * pmdaRefreshDoneTime
+ *	as for pmdaRefreshDone, for a cluster refreshed concurrently (e.g.
+ *	by a worker thread) - the given refresh time (microseconds) is used
+ *
+ * pmdaRefreshInvalidate
+ *	discard shared state for one cluster, or all if negative
+ *
+ * pmdaRefreshGetStats
+ *	report hits, misses and cumulative refresh time (microseconds)
+ *	for a cluster - returns zero if it has never been checked
+ */
+typedef struct pmdaRefresh pmdaRefresh;
+
+typedef struct pmdaRefreshStats {
+    __uint64_t	hits;
+    __uint64_t	misses;
+    __uint64_t	time;
+} pmdaRefreshStats;
+
+PMDA_CALL extern pmdaRefresh *pmdaRefreshCreate(int, int);
+PMDA_CALL extern int pmdaRefreshSetWindow(pmdaRefresh *, int, int);
+PMDA_CALL extern int pmdaRefreshGetWindow(pmdaRefresh *, int);
+PMDA_CALL extern int pmdaRefreshCheck(pmdaRefresh *, int, int);
+PMDA_CALL extern int pmdaRefreshCheckGroup(pmdaRefresh *, int *, const int *, int);
+PMDA_CALL extern void pmdaRefreshDone(pmdaRefresh *, int);
+PMDA_CALL extern void pmdaRefreshDoneTime(pmdaRefresh *, int, __uint64_t);
+PMDA_CALL extern void pmdaRefreshInvalidate(pmdaRefresh *, int);
+PMDA_CALL extern int pmdaRefreshGetStats(pmdaRefresh *, int, pmdaRefreshStats *);
+PMDA_CALL extern void pmdaRefreshFree(pmdaRefresh *);
+
 /*
  * Internal libpcp_pmda routines.
  *
@@ -805,6 +881,7 @@ PMDA_CALL extern int pmdaEventQueueClients(int, pmAtomValue *);
 PMDA_CALL extern int pmdaEventQueueCounter(int, pmAtomValue *);
 PMDA_CALL extern int pmdaEventQueueBytes(int, pmAtomValue *);
 PMDA_CALL extern int pmdaEventQueueMemory(int, pmAtomValue *);
+PMDA_CALL extern int pmdaEventQueueDropped(int, pmAtomValue *, int);
 
 typedef int (*pmdaEventDecodeCallBack)(int,
 		void *, size_t, struct timeval *, void *);
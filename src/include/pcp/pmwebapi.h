@@ -137,6 +137,14 @@ extern int pmSeriesSources(pmSeriesSettings *, int, sds *, void *);
 extern int pmSeriesQuery(pmSeriesSettings *, sds, pmSeriesFlags, void *);
 extern int pmSeriesLoad(pmSeriesSettings *, sds, pmSeriesFlags, void *);
 
+typedef struct pmSeriesPlanStats {
+    unsigned long long	hits;		/* queries using a cached plan */
+    unsigned long long	misses;		/* queries needing a full parse */
+    unsigned int	plans;		/* number of cached query plans */
+} pmSeriesPlanStats;
+
+extern void pmSeriesGetPlanStats(pmSeriesPlanStats *);
+
 /*
  * Asynchronous archive location and contents discovery services
  */
@@ -197,6 +205,12 @@ extern int pmDiscoverSetEventLoop(pmDiscoverModule *, void *);
 extern int pmDiscoverSetMetricRegistry(pmDiscoverModule *, void *);
 extern void pmDiscoverClose(pmDiscoverModule *);
 
+/*
+ * Asynchronous PMAPI request processing driven by a libuv event loop,
+ * see pmFetchAsync(3) - detach with pmAsyncSetWatch(context, NULL, NULL)
+ */
+extern int pmAsyncEventAttach(int, void *);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,525 @@
+/*
+ * Asynchronous PMAPI requests for PM_CONTEXT_HOST contexts
+ *
+ * Copyright (c) 2019 Red Hat.
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ * License for more details.
+ */
+
+/*
+ * Requests are sent to pmcd immediately and queued on the context, in
+ * order.  pmcd answers the requests for one client connection in the
+ * order they were sent, so each reply PDU completes the oldest queued
+ * request.  Replies are read without blocking, with partially received
+ * PDUs kept on the context until the rest arrives, so the caller's own
+ * event loop decides when to wait for input on the pmcd socket (see
+ * pmAsyncSetWatch) and when to process it (pmAsyncEvents).
+ *
+ * Completion callbacks are made with no libpcp locks held, so they can
+ * make further PMAPI calls, including new asynchronous requests.  The
+ * watch callback is made with the context locked and must not.
+ */
+
+#include "pmapi.h"
+#include "libpcp.h"
+#include "internal.h"
+
+typedef struct async_req {
+    struct async_req	*next;
+    int			type;		/* PDU_FETCH or PDU_INSTANCE_REQ */
+    int			sts;		/* completion status */
+    int			changed;	/* PMCD state changes seen so far */
+    int			numpmid;	/* request, for derived metrics */
+    pmID		*pmidlist;	/* request, for derived metrics */
+    pmResult		*result;	/* fetch reply */
+    int			*instlist;	/* instance domain reply */
+    char		**namelist;	/* instance domain reply */
+    pmAsyncFetchCallBack fetch;
+    pmAsyncInDomCallBack indom;
+    void		*arg;
+} async_req_t;
+
+typedef struct {
+    int			fd;		/* pmcd socket requests were sent on */
+    int			pending;	/* count of requests awaiting reply */
+    async_req_t		*head;		/* oldest request awaiting reply */
+    async_req_t		*tail;		/* newest request awaiting reply */
+    __pmPDUPartial	partial;	/* partially received reply PDU */
+    pmAsyncWatchCallBack watch;
+    void		*data;
+} async_ctl_t;
+
+static void
+async_watch(__pmContext *ctxp, async_ctl_t *ap, int action)
+{
+    if (ap->watch && (ap->fd >= 0 || action == PM_ASYNC_CLOSE))
+	ap->watch(ctxp->c_handle, ap->fd, action, ap->data);
+}
+
+static async_ctl_t *
+async_ctl(__pmContext *ctxp)
+{
+    async_ctl_t		*ap = (async_ctl_t *)ctxp->c_async;
+
+    if (ap == NULL) {
+	if ((ap = (async_ctl_t *)calloc(1, sizeof(async_ctl_t))) == NULL)
+	    return NULL;
+	ap->fd = -1;
+	ctxp->c_async = (void *)ap;
+    }
+    return ap;
+}
+
+static void
+async_req_free(async_req_t *rp)
+{
+    free(rp->pmidlist);
+    free(rp);
+}
+
+/*
+ * Move every pending request onto the done list with the given error,
+ * after a failure that leaves replies for them unreadable.
+ */
+static void
+async_fail(__pmContext *ctxp, async_ctl_t *ap, int sts, async_req_t **done)
+{
+    async_req_t		*rp;
+
+    if (ap->pending == 0)
+	return;
+    if (pmDebugOptions.context) {
+	char	errmsg[PM_MAXERRMSGLEN];
+	fprintf(stderr, "async_fail: context %d, %d requests: %s\n",
+		ctxp->c_handle, ap->pending, pmErrStr_r(sts, errmsg, sizeof(errmsg)));
+    }
+    for (rp = ap->head; rp != NULL; rp = rp->next)
+	rp->sts = sts;
+    while (*done != NULL)
+	done = &(*done)->next;
+    *done = ap->head;
+    ap->head = ap->tail = NULL;
+    ap->pending = 0;
+    __pmFreePDUPartial(&ap->partial);
+    async_watch(ctxp, ap, PM_ASYNC_STOP);
+}
+
+/*
+ * Queue a request that has been sent on the current pmcd socket, first
+ * failing any requests outstanding from before a reconnect.
+ */
+static void
+async_queue(__pmContext *ctxp, async_ctl_t *ap, async_req_t *rp, async_req_t **done)
+{
+    int			fd = ctxp->c_pmcd->pc_fd;
+
+    if (ap->fd != fd) {
+	async_fail(ctxp, ap, PM_ERR_IPC, done);
+	ap->fd = fd;
+    }
+    if (ap->tail == NULL)
+	ap->head = rp;
+    else
+	ap->tail->next = rp;
+    ap->tail = rp;
+    if (ap->pending++ == 0)
+	async_watch(ctxp, ap, PM_ASYNC_START);
+}
+
+/* make completion callbacks, with no locks held */
+static int
+async_done(int ctx, async_req_t *rp)
+{
+    async_req_t		*next;
+    int			count = 0;
+
+    for ( ; rp != NULL; rp = next, count++) {
+	next = rp->next;
+	if (rp->type == PDU_FETCH)
+	    rp->fetch(ctx, rp->sts, rp->result, rp->arg);
+	else
+	    rp->indom(ctx, rp->sts, rp->instlist, rp->namelist, rp->arg);
+	async_req_free(rp);
+    }
+    return count;
+}
+
+/*
+ * Locate a host context ready for another request, returned locked
+ */
+static int
+async_context(int ctx, __pmContext **ctxpp)
+{
+    __pmContext		*ctxp;
+    int			sts;
+
+    if ((ctxp = __pmHandleToPtr(ctx)) == NULL)
+	return PM_ERR_NOCONTEXT;
+    if (ctxp->c_type != PM_CONTEXT_HOST) {
+	PM_UNLOCK(ctxp->c_lock);
+	return PM_ERR_NOTHOST;
+    }
+    if (async_ctl(ctxp) == NULL) {
+	PM_UNLOCK(ctxp->c_lock);
+	return -ENOMEM;
+    }
+    /* replies are read independently, so pmcd cannot be shared */
+    if ((sts = __pmPMCDExclusive(ctxp)) < 0) {
+	PM_UNLOCK(ctxp->c_lock);
+	return sts;
+    }
+    *ctxpp = ctxp;
+    return 0;
+}
+
+int
+pmFetchAsync(int ctx, int numpmid, pmID *pmidlist, pmAsyncFetchCallBack callback, void *arg)
+{
+    __pmContext		*ctxp;
+    async_req_t		*rp, *done = NULL;
+    pmID		*newlist = NULL;
+    int			newcnt, have_dm, fd, sts, xsts;
+
+    if (pmDebugOptions.pmapi) {
+	char    dbgbuf[20];
+	fprintf(stderr, "pmFetchAsync(%d, %d, pmid[0] %s, ...)\n", ctx, numpmid,
+		numpmid > 0 ? pmIDStr_r(pmidlist[0], dbgbuf, sizeof(dbgbuf)) : "none");
+    }
+
+    if (numpmid < 1)
+	return PM_ERR_TOOSMALL;
+    if (callback == NULL)
+	return -EINVAL;
+    if ((sts = async_context(ctx, &ctxp)) < 0)
+	return sts;
+    if ((rp = (async_req_t *)calloc(1, sizeof(async_req_t))) == NULL) {
+	PM_UNLOCK(ctxp->c_lock);
+	return -ENOMEM;
+    }
+    rp->type = PDU_FETCH;
+    rp->fetch = callback;
+    rp->arg = arg;
+
+    /* for derived metrics, may need to rewrite the pmidlist */
+    have_dm = newcnt = __pmPrepareFetch(ctxp, numpmid, pmidlist, &newlist);
+    if (have_dm) {
+	/* kept to repeat the preparation when the reply arrives */
+	if ((rp->pmidlist = (pmID *)malloc(numpmid * sizeof(pmID))) == NULL) {
+	    PM_UNLOCK(ctxp->c_lock);
+	    free(newlist);
+	    free(rp);
+	    return -ENOMEM;
+	}
+	memcpy(rp->pmidlist, pmidlist, numpmid * sizeof(pmID));
+	rp->numpmid = numpmid;
+    }
+    if (newcnt > numpmid) {
+	numpmid = newcnt;
+	pmidlist = newlist;
+    }
+
+    fd = ctxp->c_pmcd->pc_fd;
+    __pmXmitBatch(fd);
+    if ((sts = __pmUpdateProfile(fd, ctxp, ctxp->c_pmcd->pc_tout_sec)) >= 0)
+	sts = __pmSendFetch(fd, __pmPtrToHandle(ctxp), ctxp->c_slot,
+			&ctxp->c_origin, numpmid, pmidlist);
+    if ((xsts = __pmXmitFlush(fd)) < 0 && sts >= 0)
+	sts = xsts;
+    if (sts < 0) {
+	sts = __pmMapErrno(sts);
+	async_req_free(rp);
+    }
+    else
+	async_queue(ctxp, (async_ctl_t *)ctxp->c_async, rp, &done);
+    PM_UNLOCK(ctxp->c_lock);
+    free(newlist);
+
+    async_done(ctx, done);
+    return sts < 0 ? sts : 0;
+}
+
+int
+pmGetInDomAsync(int ctx, pmInDom indom, pmAsyncInDomCallBack callback, void *arg)
+{
+    __pmContext		*ctxp;
+    async_req_t		*rp, *done = NULL;
+    int			sts;
+
+    if (pmDebugOptions.pmapi) {
+	char    dbgbuf[20];
+	fprintf(stderr, "pmGetInDomAsync(%d, %s, ...)\n", ctx,
+		pmInDomStr_r(indom, dbgbuf, sizeof(dbgbuf)));
+    }
+
+    if (indom == PM_INDOM_NULL)
+	return PM_ERR_INDOM;
+    if (callback == NULL)
+	return -EINVAL;
+    if ((sts = async_context(ctx, &ctxp)) < 0)
+	return sts;
+    if ((rp = (async_req_t *)calloc(1, sizeof(async_req_t))) == NULL) {
+	PM_UNLOCK(ctxp->c_lock);
+	return -ENOMEM;
+    }
+    rp->type = PDU_INSTANCE_REQ;
+    rp->indom = callback;
+    rp->arg = arg;
+
+    if ((sts = __pmSendInstanceReq(ctxp->c_pmcd->pc_fd, __pmPtrToHandle(ctxp),
+			&ctxp->c_origin, indom, PM_IN_NULL, NULL)) < 0) {
+	sts = __pmMapErrno(sts);
+	async_req_free(rp);
+    }
+    else
+	async_queue(ctxp, (async_ctl_t *)ctxp->c_async, rp, &done);
+    PM_UNLOCK(ctxp->c_lock);
+
+    async_done(ctx, done);
+    return sts < 0 ? sts : 0;
+}
+
+/*
+ * Complete the oldest pending request from its reply PDU, returning
+ * zero if more PDUs are expected for it, one when it is complete, or
+ * an error if the reply does not match the request.
+ */
+static int
+async_reply(__pmContext *ctxp, async_req_t *rp, int type, __pmPDU *pb)
+{
+    pmInResult		*inresult;
+    pmID		*newlist = NULL;
+    int			sts;
+
+    if (type == PDU_ERROR) {
+	__pmDecodeError(pb, &sts);
+	if (sts > 0) {
+	    /* PMCD state change protocol, reply follows */
+	    rp->changed |= sts;
+	    if (sts & (PMCD_LABEL_CHANGE | PMCD_AGENT_CHANGE))
+		ctxp->c_pmcd->pc_labels++;	/* discard cached label sets */
+	    return 0;
+	}
+	rp->sts = sts;
+    }
+    else if (type == PDU_RESULT && rp->type == PDU_FETCH) {
+	if ((sts = __pmDecodeResultArena_ctx(ctxp, pb, &rp->result)) < 0)
+	    rp->sts = sts;
+	else {
+	    rp->sts = rp->changed;
+	    if (rp->pmidlist != NULL) {
+		/* restore derived metric state from this request */
+		__pmPrepareFetch(ctxp, rp->numpmid, rp->pmidlist, &newlist);
+		free(newlist);
+		__pmFinishResult(ctxp, rp->sts, &rp->result);
+	    }
+	}
+    }
+    else if (type == PDU_INSTANCE && rp->type == PDU_INSTANCE_REQ) {
+	if ((sts = __pmDecodeInstance(pb, &inresult)) < 0)
+	    rp->sts = sts;
+	else
+	    rp->sts = __pmInResultToLists(inresult, &rp->instlist, &rp->namelist);
+    }
+    else
+	return PM_ERR_IPC;
+    return 1;
+}
+
+int
+pmAsyncEvents(int ctx)
+{
+    __pmContext		*ctxp;
+    async_ctl_t		*ap;
+    async_req_t		*rp, *done = NULL, **donetail = &done;
+    __pmPDU		*pb;
+    int			sts;
+
+    if ((ctxp = __pmHandleToPtr(ctx)) == NULL)
+	return PM_ERR_NOCONTEXT;
+    if ((ap = (async_ctl_t *)ctxp->c_async) == NULL || ap->pending == 0) {
+	PM_UNLOCK(ctxp->c_lock);
+	return 0;
+    }
+    if (ctxp->c_pmcd->pc_fd != ap->fd) {
+	/* reconnected since the requests were sent */
+	async_fail(ctxp, ap, PM_ERR_IPC, &done);
+    }
+
+    while (ap->pending > 0) {
+	sts = __pmGetPDUPartial(ap->fd, ANY_SIZE, &ap->partial, &pb);
+	if (sts == -EAGAIN)
+	    break;
+	if (sts <= 0) {
+	    async_fail(ctxp, ap, sts == 0 ? PM_ERR_IPC : __pmMapErrno(sts), donetail);
+	    break;
+	}
+	rp = ap->head;
+	sts = async_reply(ctxp, rp, sts, pb);
+	__pmUnpinPDUBuf(pb);
+	if (sts < 0) {
+	    /* replies out of step with requests, cannot continue */
+	    async_fail(ctxp, ap, sts, donetail);
+	    break;
+	}
+	if (sts == 0)
+	    continue;
+	if ((ap->head = rp->next) == NULL)
+	    ap->tail = NULL;
+	rp->next = NULL;
+	*donetail = rp;
+	donetail = &rp->next;
+	if (--ap->pending == 0)
+	    async_watch(ctxp, ap, PM_ASYNC_STOP);
+    }
+    PM_UNLOCK(ctxp->c_lock);
+
+    return async_done(ctx, done);
+}
+
+int
+pmAsyncSetWatch(int ctx, pmAsyncWatchCallBack watch, void *data)
+{
+    __pmContext		*ctxp;
+    async_ctl_t		*ap;
+    int			sts;
+
+    if ((sts = async_context(ctx, &ctxp)) < 0)
+	return sts;
+    ap = (async_ctl_t *)ctxp->c_async;
+    /* any previous watch is released, this one starts if needed */
+    async_watch(ctxp, ap, PM_ASYNC_CLOSE);
+    ap->watch = watch;
+    ap->data = data;
+    if (ap->pending > 0)
+	async_watch(ctxp, ap, PM_ASYNC_START);
+    PM_UNLOCK(ctxp->c_lock);
+    return 0;
+}
+
+int
+pmAsyncFd(int ctx)
+{
+    __pmContext		*ctxp;
+    int			sts;
+
+    if ((ctxp = __pmHandleToPtr(ctx)) == NULL)
+	return PM_ERR_NOCONTEXT;
+    if (ctxp->c_type != PM_CONTEXT_HOST)
+	sts = PM_ERR_NOTHOST;
+    else if ((sts = ctxp->c_pmcd->pc_fd) < 0)
+	sts = PM_ERR_IPC;
+    PM_UNLOCK(ctxp->c_lock);
+    return sts;
+}
+
+int
+pmAsyncPending(int ctx)
+{
+    __pmContext		*ctxp;
+    async_ctl_t		*ap;
+    int			sts = 0;
+
+    if ((ctxp = __pmHandleToPtr(ctx)) == NULL)
+	return PM_ERR_NOCONTEXT;
+    if ((ap = (async_ctl_t *)ctxp->c_async) != NULL)
+	sts = ap->pending;
+    PM_UNLOCK(ctxp->c_lock);
+    return sts;
+}
+
+/*
+ * Wait up to timeout (forever if NULL) for replies on any of the given
+ * contexts with requests pending, and process those that arrive.
+ */
+int
+pmAsyncPoll(const int *ctxlist, int nctx, struct timeval *timeout)
+{
+    __pmFdSet		readfds;
+    int			*fds;
+    int			i, sts, maxfd = -1, count = 0;
+
+    if (nctx < 1)
+	return 0;
+    if ((fds = (int *)malloc(nctx * sizeof(int))) == NULL)
+	return -ENOMEM;
+    __pmFD_ZERO(&readfds);
+    for (i = 0; i < nctx; i++) {
+	fds[i] = -1;
+	if (pmAsyncPending(ctxlist[i]) <= 0)
+	    continue;
+	if ((fds[i] = pmAsyncFd(ctxlist[i])) < 0) {
+	    /* connection gone, fail pending requests */
+	    if ((sts = pmAsyncEvents(ctxlist[i])) > 0)
+		count += sts;
+	    fds[i] = -1;
+	    continue;
+	}
+	__pmFD_SET(fds[i], &readfds);
+	if (fds[i] > maxfd)
+	    maxfd = fds[i];
+    }
+    if (maxfd < 0) {
+	free(fds);
+	return count;
+    }
+
+    sts = __pmSelectRead(maxfd+1, &readfds, timeout);
+    if (sts < 0) {
+	sts = neterror();
+	free(fds);
+	return (sts == EINTR || count > 0) ? count : -sts;
+    }
+    for (i = 0; sts > 0 && i < nctx; i++) {
+	if (fds[i] < 0 || !__pmFD_ISSET(fds[i], &readfds))
+	    continue;
+	if ((sts = pmAsyncEvents(ctxlist[i])) > 0)
+	    count += sts;
+	sts = 1;
+    }
+    free(fds);
+    return count;
+}
+
+/*
+ * Synchronous requests read the next reply PDU from pmcd, which belongs
+ * to the oldest asynchronous request while any are pending - so these
+ * fail with -EBUSY on the context until all replies have arrived.
+ * Called with the context locked.
+ */
+int
+__pmAsyncBusy(__pmContext *ctxp)
+{
+    async_ctl_t		*ap = (async_ctl_t *)ctxp->c_async;
+
+    if (ap != NULL && ap->pending > 0)
+	return -EBUSY;
+    return 0;
+}
+
+/*
+ * Context is being destroyed - release the watch and discard requests,
+ * without any completion callbacks.  Called with the context locked.
+ */
+void
+__pmAsyncFree(__pmContext *ctxp)
+{
+    async_ctl_t		*ap = (async_ctl_t *)ctxp->c_async;
+    async_req_t		*rp, *next;
+
+    async_watch(ctxp, ap, PM_ASYNC_CLOSE);
+    for (rp = ap->head; rp != NULL; rp = next) {
+	next = rp->next;
+	async_req_free(rp);
+    }
+    __pmFreePDUPartial(&ap->partial);
+    free(ap);
+    ctxp->c_async = NULL;
+}
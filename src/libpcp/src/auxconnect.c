@@ -1,5 +1,5 @@
 /*
- * Copyright (c) 2012-2015,2017-2018 Red Hat.
+ * Copyright (c) 2012-2015,2017-2019 Red Hat.
  * Copyright (c) 2000,2004,2005 Silicon Graphics, Inc.  All Rights Reserved.
  * 
  * This library is free software; you can redistribute it and/or modify it
@@ -24,6 +24,9 @@
 #ifdef HAVE_NETIOAPI_H
 #include <netioapi.h>
 #endif
+#ifndef IS_MINGW
+#include <sys/uio.h>
+#endif
 #define SOCKET_INTERNAL
 #include "internal.h"
 
@@ -1575,6 +1578,26 @@ __pmSend(int socket, const void *buffer, size_t length, int flags)
     return send(socket, buffer, length, flags);
 }
 
+ssize_t
+__pmSendv(int socket, const struct iovec *iov, int count)
+{
+#if defined(IS_MINGW)
+    ssize_t	size, total = 0;
+    int		i;
+
+    for (i = 0; i < count; i++) {
+	if ((size = send(socket, iov[i].iov_base, iov[i].iov_len, 0)) < 0)
+	    return total ? total : size;
+	total += size;
+	if (size < iov[i].iov_len)
+	    break;
+    }
+    return total;
+#else
+    return writev(socket, iov, count);
+#endif
+}
+
 ssize_t
 __pmRecv(int socket, void *buffer, size_t length, int flags)
 {
@@ -1,5 +1,5 @@
 /*
- * Copyright (c) 2013-2018 Red Hat.
+ * Copyright (c) 2013-2019 Red Hat.
  * 
  * This library is free software; you can redistribute it and/or modify it
  * under the terms of the GNU Lesser General Public License as published
@@ -1008,7 +1008,8 @@ __pmSecureServerHandshake(int fd, int flags, __pmHashCtl *attrs)
     }
     /* remove all of the known good flags */
     flags &= ~(PDU_FLAG_SECURE | PDU_FLAG_SECURE_ACK | PDU_FLAG_COMPRESS |
-	       PDU_FLAG_AUTH | PDU_FLAG_CREDS_REQD | PDU_FLAG_CONTAINER);
+	       PDU_FLAG_AUTH | PDU_FLAG_CREDS_REQD | PDU_FLAG_CONTAINER |
+	       PDU_FLAG_LZMA);
     if (!flags)
 	return 0;
 
@@ -1080,6 +1081,14 @@ __pmServerSetFeature(__pmServerFeature wanted)
 	return 1;
 #else
 	return 0;
+#endif
+    }
+    if (wanted == PM_SERVER_FEATURE_LZMA) {
+#if defined(HAVE_LZMA_DECOMPRESSION)
+	server_features |= (1 << wanted);
+	return 1;
+#else
+	return 0;
 #endif
     }
     return __pmSecureServerSetFeature(wanted);
@@ -1099,6 +1108,7 @@ __pmServerHasFeature(__pmServerFeature query)
     case PM_SERVER_FEATURE_CONTAINERS:
     case PM_SERVER_FEATURE_CREDS_REQD:
     case PM_SERVER_FEATURE_UNIX_DOMAIN:
+    case PM_SERVER_FEATURE_LZMA:
 	if (server_features & (1 << query))
 	    sts = 1;
 	break;
@@ -1,5 +1,5 @@
 /*
- * Copyright (c) 2012-2014,2017 Red Hat.
+ * Copyright (c) 2012-2014,2017,2019 Red Hat.
  * Copyright (c) 1995-2002,2004 Silicon Graphics, Inc.  All Rights Reserved.
  * 
  * This library is free software; you can redistribute it and/or modify it
@@ -158,6 +158,15 @@ check_feature_flags(int ctxflags, int features, int local_conn)
 	    }
 	}
 	if (ctxflags & PM_CTXFLAG_COMPRESS) {
+	    /*
+	     * Prefer compressing large PDUs, which needs no secure
+	     * connection, to compression within the SSL/TLS layer.
+	     */
+#if defined(HAVE_LZMA_DECOMPRESSION)
+	    if (features & PDU_FLAG_LZMA)
+		pduflags |= PDU_FLAG_LZMA;
+	    else
+#endif
 	    if (features & PDU_FLAG_COMPRESS)
 		pduflags |= PDU_FLAG_COMPRESS;
 	    else
@@ -306,6 +315,10 @@ __pmConnectHandshake(int fd, const char *hostname, int ctxflags, __pmHashCtl *at
 	     */
 	    if (sts >= 0 && pduflags)
 		sts = attributes_handshake(fd, pduflags, hostname, attrs);
+
+	    /* all later PDUs may be compressed, in either direction */
+	    if (sts >= 0 && (pduflags & PDU_FLAG_LZMA))
+		sts = __pmSetCompressIPC(fd, 1);
 	}
 	else
 	    sts = PM_ERR_IPC;
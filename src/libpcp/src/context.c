@@ -1,5 +1,5 @@
 /*
- * Copyright (c) 2012-2018 Red Hat.
+ * Copyright (c) 2012-2019 Red Hat.
  * Copyright (c) 2007-2008 Aconex.  All Rights Reserved.
  * Copyright (c) 1995-2002,2004,2006,2008 Silicon Graphics, Inc.  All Rights Reserved.
  * 
@@ -28,6 +28,12 @@
  * and pmDupContext(), then locked in __pmHandleToPtr() ... it is
  * the responsibility of all __pmHandleToPtr() callers to call
  * PM_UNLOCK(ctxp->c_lock) when they are finished with the context.
+ *
+ * A pmcd connection (__pmPMCDCtl) may be shared by several host contexts.
+ * The pc_lock mutex is held (after c_lock) for each request/reply exchange
+ * and while reconnecting.  The pmcd_lock mutex protects c_pmcd for host
+ * contexts, pc_refcnt and pc_exclusive; it is acquired after contexts_lock
+ * or c_lock, and never while pc_lock is held.
  */
 
 #include "pmapi.h"
@@ -69,8 +75,10 @@ static int		*backoff;
 
 #ifdef PM_MULTI_THREAD
 static pthread_mutex_t	contexts_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_mutex_t	pmcd_lock = PTHREAD_MUTEX_INITIALIZER;
 #else
 void			*contexts_lock;
+void			*pmcd_lock;
 #endif
 
 #if defined(PM_MULTI_THREAD) && defined(PM_MULTI_THREAD_DEBUG)
@@ -383,8 +391,21 @@ initcontextlock(pthread_mutex_t *lock)
     __pmInitMutex(lock);
 }
 
+static void
+initpmcdlock(pthread_mutex_t *lock)
+{
+    __pmInitMutex(lock);
+}
+
+static void
+freepmcdlock(pthread_mutex_t *lock)
+{
+    __pmDestroyMutex(lock);
+}
 #else
 #define initcontextlock(x)	do { } while (0)
+#define initpmcdlock(x)		do { } while (0)
+#define freepmcdlock(x)		do { } while (0)
 #endif
 
 static int
@@ -475,11 +496,11 @@ ctxflags(__pmHashCtl *attrs, int *flags)
 	    PM_UNLOCK(__pmLock_extcall);
     }
 
-    /*
-     * PCP_ATTR_EXCLUSIVE attr -> PM_CTXFLAG_EXCLUSIVE mapping used to
-     * happen here, but has been deprecated when mulitplexing of the
-     * client-pmcd socket was abandonded.
-     */
+    /* share the client-pmcd socket with other like contexts, or never */
+    if (__pmHashSearch(PCP_ATTR_SHARED, attrs) != NULL)
+	*flags |= PM_CTXFLAG_SHARED;
+    if (__pmHashSearch(PCP_ATTR_EXCLUSIVE, attrs) != NULL)
+	*flags |= PM_CTXFLAG_EXCLUSIVE;
 
     return 0;
 }
@@ -985,6 +1006,62 @@ initarchive(__pmContext	*ctxp, const char *name)
     return sts;
 }
 
+/*
+ * Set up the control structure for a new pmcd connection - takes
+ * ownership of the host specification and spec string, if any.
+ */
+static __pmPMCDCtl *
+pmcd_create(int fd, pmHostSpec *hosts, int nhosts, int flags, char *spec)
+{
+    __pmPMCDCtl	*ctl;
+
+    if ((ctl = (__pmPMCDCtl *)calloc(1, sizeof(__pmPMCDCtl))) == NULL)
+	return NULL;
+    ctl->pc_fd = fd;
+    ctl->pc_hosts = hosts;
+    ctl->pc_nhosts = nhosts;
+    ctl->pc_tout_sec = __pmConvertTimeout(TIMEOUT_DEFAULT) / 1000;
+    ctl->pc_refcnt = 1;
+    ctl->pc_epoch = 1;
+    ctl->pc_flags = flags;
+    ctl->pc_spec = spec;
+    ctl->pc_exclusive = (spec == NULL || (flags & PM_CTXFLAG_SHARED) == 0 ||
+			 (flags & PM_CTXFLAG_EXCLUSIVE));
+    initpmcdlock(&ctl->pc_lock);
+    return ctl;
+}
+
+/*
+ * Find an existing connection that a new host context can share, one
+ * made for the same host specification, attributes and context flags,
+ * where sharing was requested (PM_CTXFLAG_SHARED) by both contexts.
+ * pmcd keeps an instance profile for each context on the connection,
+ * but PMDAs see just the one client (for pmStore controls, event
+ * queues and so on), which is why sharing is not the default.
+ */
+static __pmPMCDCtl *
+pmcd_share(const char *spec, int flags)
+{
+    __pmPMCDCtl	*ctl, *found = NULL;
+    int		i;
+
+    PM_LOCK(contexts_lock);
+    PM_LOCK(pmcd_lock);
+    for (i = 0; i < contexts_len && found == NULL; i++) {
+	if (contexts_map[i] < 0 || contexts[i]->c_type != PM_CONTEXT_HOST)
+	    continue;
+	ctl = contexts[i]->c_pmcd;
+	if (ctl == NULL || ctl->pc_exclusive || ctl->pc_fd < 0 ||
+	    ctl->pc_flags != flags || strcmp(ctl->pc_spec, spec) != 0)
+	    continue;
+	ctl->pc_refcnt++;
+	found = ctl;
+    }
+    PM_UNLOCK(pmcd_lock);
+    PM_UNLOCK(contexts_lock);
+    return found;
+}
+
 int
 pmNewContext(int type, const char *name)
 {
@@ -1093,6 +1170,9 @@ INIT_CONTEXT:
     new->c_origin.tv_sec = new->c_origin.tv_usec = 0;
     new->c_delta = 0;
     new->c_sent = 0;
+    new->c_epoch = 0;
+    new->c_changes = 0;
+    new->c_labels = NULL;
     new->c_flags = (type & ~PM_CONTEXT_TYPEMASK);
     if ((new->c_instprof = (pmProfile *)calloc(1, sizeof(pmProfile))) == NULL) {
 	/*
@@ -1109,6 +1189,8 @@ INIT_CONTEXT:
 	pmHostSpec	*hosts = NULL;
 	int		nhosts;
 	char		*errmsg;
+	char		*spec = NULL;
+	char		buf[4096];
 
 	/* break down a host[:port@proxy:port][?attributes] specification */
 	__pmHashInit(attrs);
@@ -1135,29 +1217,47 @@ INIT_CONTEXT:
 	}
 
 	/*
-	 * Try to establish the connection.
+	 * Share an existing connection to the same pmcd if requested and
+	 * possible, otherwise try to establish the connection.
 	 * If this fails, restore the original current context
 	 * and return an error.
 	 */
-	sts = __pmConnectPMCD(hosts, nhosts, new->c_flags, &new->c_attrs);
-	if (sts < 0) {
-	    __pmFreeHostAttrsSpec(hosts, nhosts, attrs);
-	    __pmHashClear(attrs);
-	    goto FAILED;
+	if ((new->c_flags & PM_CTXFLAG_SHARED) &&
+	    (new->c_flags & PM_CTXFLAG_EXCLUSIVE) == 0) {
+	    sts = __pmUnparseHostAttrsSpec(hosts, nhosts, attrs,
+					   buf, sizeof(buf));
+	    if (sts >= 0 && sts < sizeof(buf) && (spec = strdup(buf)) != NULL)
+		new->c_pmcd = pmcd_share(spec, new->c_flags);
 	}
-
-	new->c_pmcd = (__pmPMCDCtl *)calloc(1,sizeof(__pmPMCDCtl));
-	if (new->c_pmcd == NULL) {
-	    sts = -oserror();
-	    __pmCloseSocket(sts);
-	    __pmFreeHostAttrsSpec(hosts, nhosts, attrs);
-	    __pmHashClear(attrs);
-	    goto FAILED;
+	if (new->c_pmcd != NULL) {
+	    if (pmDebugOptions.context)
+		fprintf(stderr, "pmNewContext(%d, %s): sharing pmcd fd=%d\n",
+			type, name, new->c_pmcd->pc_fd);
+	    /* only state changes from here on are reported to this context */
+	    PM_LOCK(new->c_pmcd->pc_lock);
+	    new->c_changes = new->c_pmcd->pc_changes;
+	    PM_UNLOCK(new->c_pmcd->pc_lock);
+	    __pmFreeHostSpec(hosts, nhosts);
+	    free(spec);
+	}
+	else {
+	    sts = __pmConnectPMCD(hosts, nhosts, new->c_flags, &new->c_attrs);
+	    if (sts < 0) {
+		__pmFreeHostAttrsSpec(hosts, nhosts, attrs);
+		__pmHashClear(attrs);
+		free(spec);
+		goto FAILED;
+	    }
+	    new->c_pmcd = pmcd_create(sts, hosts, nhosts, new->c_flags, spec);
+	    if (new->c_pmcd == NULL) {
+		__pmCloseSocket(sts);
+		sts = -ENOMEM;
+		__pmFreeHostAttrsSpec(hosts, nhosts, attrs);
+		__pmHashClear(attrs);
+		free(spec);
+		goto FAILED;
+	    }
 	}
-	new->c_pmcd->pc_fd = sts;
-	new->c_pmcd->pc_hosts = hosts;
-	new->c_pmcd->pc_nhosts = nhosts;
-	new->c_pmcd->pc_tout_sec = __pmConvertTimeout(TIMEOUT_DEFAULT) / 1000;
     }
     else if (new->c_type == PM_CONTEXT_LOCAL) {
 	if ((sts = ctxlocal(&new->c_attrs)) != 0)
@@ -1279,11 +1379,14 @@ pmReconnectContext(int handle)
     PM_UNLOCK(contexts_lock);
     ctl = ctxp->c_pmcd;
     if (ctxp->c_type == PM_CONTEXT_HOST) {
+	/* the connection may be shared, so wait for any exchange to finish */
+	PM_LOCK(ctl->pc_lock);
 	if (ctl->pc_timeout && time(NULL) < ctl->pc_again) {
 	    /* too soon to try again */
 	    if (pmDebugOptions.context)
 		fprintf(stderr, "pmReconnectContext(%d) -> %d, too soon (need wait another %d secs)\n",
 			handle, (int)-ETIMEDOUT, (int)(ctl->pc_again - time(NULL)));
+	    PM_UNLOCK(ctl->pc_lock);
 	    PM_UNLOCK(ctxp->c_lock);
 	    sts = -ETIMEDOUT;
 	    goto pmapi_return;
@@ -1301,6 +1404,7 @@ pmReconnectContext(int handle)
 	    if (pmDebugOptions.context)
 		fprintf(stderr, "pmReconnectContext(%d), failed (wait %d secs before next attempt)\n",
 		    handle, (int)(ctl->pc_again - time(NULL)));
+	    PM_UNLOCK(ctl->pc_lock);
 	    PM_UNLOCK(ctxp->c_lock);
 	    sts = -ETIMEDOUT;
 	    goto pmapi_return;
@@ -1308,6 +1412,9 @@ pmReconnectContext(int handle)
 	else {
 	    ctl->pc_fd = sts;
 	    ctl->pc_timeout = 0;
+	    /* profiles for all contexts sharing it must be sent again */
+	    ctl->pc_epoch++;
+	    PM_UNLOCK(ctl->pc_lock);
 	    ctxp->c_sent = 0;
 
 	    if (pmDebugOptions.context)
@@ -1602,10 +1709,21 @@ pmapi_return:
     return sts;
 }
 
+/*
+ * Drop a context's reference to a pmcd connection, closing it when
+ * no other context is sharing it.
+ */
 static void
 __pmPMCDCtlFree(__pmPMCDCtl *cp)
 {
     struct linger	dolinger = {0, 1};
+    int			refcnt;
+
+    PM_LOCK(pmcd_lock);
+    refcnt = --cp->pc_refcnt;
+    PM_UNLOCK(pmcd_lock);
+    if (refcnt > 0)
+	return;
 
     if (cp->pc_fd >= 0) {
 	/* before close, unsent data should be flushed */
@@ -1613,10 +1731,70 @@ __pmPMCDCtlFree(__pmPMCDCtl *cp)
 			(char *)&dolinger, (__pmSockLen)sizeof(dolinger));
 	__pmCloseSocket(cp->pc_fd);
     }
+    __pmInDomCacheFree(cp);
     __pmFreeHostSpec(cp->pc_hosts, cp->pc_nhosts);
+    freepmcdlock(&cp->pc_lock);
+    free(cp->pc_spec);
     free(cp);
 }
 
+/*
+ * Give a host context a pmcd connection of its own, for requests that
+ * are not one request/reply exchange at a time (asynchronous requests),
+ * and prevent any other context sharing it from then on.
+ * Called with ctxp->c_lock held.
+ */
+int
+__pmPMCDExclusive(__pmContext *ctxp)
+{
+    __pmPMCDCtl	*ctl = ctxp->c_pmcd;
+    __pmPMCDCtl	*new;
+    pmHostSpec	*hosts;
+    char	buf[4096];
+    char	*errmsg;
+    int		nhosts;
+    int		sts;
+
+    if (ctl->pc_exclusive)
+	return 0;
+
+    PM_LOCK(pmcd_lock);
+    if (ctl->pc_refcnt == 1) {
+	ctl->pc_exclusive = 1;
+	PM_UNLOCK(pmcd_lock);
+	return 0;
+    }
+    PM_UNLOCK(pmcd_lock);
+
+    /* shared, so make a new connection with the same specification */
+    __pmUnparseHostSpec(ctl->pc_hosts, ctl->pc_nhosts, buf, sizeof(buf));
+    if ((sts = __pmParseHostSpec(buf, &hosts, &nhosts, &errmsg)) < 0) {
+	free(errmsg);
+	return sts;
+    }
+    if ((sts = __pmConnectPMCD(hosts, nhosts, ctxp->c_flags, &ctxp->c_attrs)) < 0) {
+	__pmFreeHostSpec(hosts, nhosts);
+	return sts;
+    }
+    if ((new = pmcd_create(sts, hosts, nhosts, ctxp->c_flags, NULL)) == NULL) {
+	__pmCloseSocket(sts);
+	__pmFreeHostSpec(hosts, nhosts);
+	return -ENOMEM;
+    }
+    new->pc_tout_sec = ctl->pc_tout_sec;
+    if (pmDebugOptions.context)
+	fprintf(stderr, "__pmPMCDExclusive: context %d: pmcd fd=%d, was shared fd=%d\n",
+		ctxp->c_handle, new->pc_fd, ctl->pc_fd);
+
+    PM_LOCK(pmcd_lock);
+    ctxp->c_pmcd = new;
+    PM_UNLOCK(pmcd_lock);
+    __pmPMCDCtlFree(ctl);
+    ctxp->c_sent = 0;
+    ctxp->c_changes = 0;
+    return 0;
+}
+
 int
 pmDestroyContext(int handle)
 {
@@ -1643,6 +1821,10 @@ pmDestroyContext(int handle)
     PM_LOCK(ctxp->c_lock);
     contexts_map[ctxnum] = MAP_TEARDOWN;
     PM_UNLOCK(contexts_lock);
+    if (ctxp->c_async != NULL)
+	__pmAsyncFree(ctxp);
+    if (ctxp->c_labels != NULL)
+	__pmLabelCacheFree(ctxp);
     if (ctxp->c_pmcd != NULL) {
 	__pmPMCDCtlFree(ctxp->c_pmcd);
 	ctxp->c_pmcd = NULL;
@@ -1745,8 +1927,13 @@ __pmDumpContext(FILE *f, int context, pmInDom indom)
 		fprintf(f, " host %s:", con->c_pmcd->pc_hosts[0].name);
 		fprintf(f, " pmcd=%s profile=%s fd=%d",
 		    (con->c_pmcd->pc_fd < 0) ? "NOT CONNECTED" : "CONNECTED",
-		    con->c_sent ? "SENT" : "NOT_SENT",
+		    (con->c_sent && con->c_epoch == con->c_pmcd->pc_epoch) ?
+			"SENT" : "NOT_SENT",
 		    con->c_pmcd->pc_fd);
+		if (con->c_pmcd->pc_refcnt > 1)
+		    fprintf(f, " shared=%d", con->c_pmcd->pc_refcnt);
+		else if (con->c_pmcd->pc_exclusive)
+		    fprintf(f, " exclusive");
 		if (con->c_flags)
 		    fprintf(f, " flags=%x", con->c_flags);
 	    }
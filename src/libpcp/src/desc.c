@@ -1,4 +1,5 @@
 /*
+ * Copyright (c) 2019 Red Hat.
  * Copyright (c) 1995 Silicon Graphics, Inc.  All Rights Reserved.
  * 
  * This library is free software; you can redistribute it and/or modify it
@@ -71,14 +72,17 @@ pmLookupDesc_ctx(__pmContext *ctxp, int derive_locked, pmID pmid, pmDesc *desc)
 	PM_ASSERT_IS_LOCKED(ctxp->c_lock);
 
     if (ctxp->c_type == PM_CONTEXT_HOST) {
+	PM_LOCK(ctxp->c_pmcd->pc_lock);
 	tout = ctxp->c_pmcd->pc_tout_sec;
 	fd = ctxp->c_pmcd->pc_fd;
-	if ((sts = __pmSendDescReq(fd, __pmPtrToHandle(ctxp), pmid)) < 0) {
+	if ((sts = __pmAsyncBusy(ctxp)) < 0 ||
+	    (sts = __pmSendDescReq(fd, __pmPtrToHandle(ctxp), pmid)) < 0) {
 	    sts = __pmMapErrno(sts);
 	} else {
 	    PM_FAULT_POINT("libpcp/" __FILE__ ":1", PM_FAULT_TIMEOUT);
 	    sts = __pmRecvDesc(fd, ctxp, tout, desc);
 	}
+	PM_UNLOCK(ctxp->c_pmcd->pc_lock);
     }
     else if (ctxp->c_type == PM_CONTEXT_LOCAL) {
 	if (PM_MULTIPLE_THREADS(PM_SCOPE_DSO_PMDA))
@@ -1,4 +1,5 @@
 /*
+ * Copyright (c) 2019 Red Hat.
  * Copyright (c) 1995-2006,2008 Silicon Graphics, Inc.  All Rights Reserved.
  * 
  * This library is free software; you can redistribute it and/or modify it
@@ -17,16 +18,21 @@
 #include "internal.h"
 #include "fault.h"
 
-static int
+/*
+ * also used for asynchronous fetches, see pmFetchAsync
+ * called with ctxp->c_pmcd->pc_lock held, unless the connection is exclusive
+ */
+int
 __pmUpdateProfile(int fd, __pmContext *ctxp, int timeout)
 {
     int		sts;
 
-    if (ctxp->c_sent == 0) {
+    if (ctxp->c_sent == 0 || ctxp->c_epoch != ctxp->c_pmcd->pc_epoch) {
 
 	/*
 	 * current profile is _not_ already cached at other end of
-	 * IPC, so send the current profile
+	 * IPC (or the connection has since been re-established, possibly
+	 * by another context sharing it), so send the current profile
 	 */
 	if (pmDebugOptions.profile) {
 	    fprintf(stderr, "pmFetch: calling __pmSendProfile, context: %d slot: %d\n",
@@ -36,12 +42,42 @@ __pmUpdateProfile(int fd, __pmContext *ctxp, int timeout)
 	if ((sts = __pmSendProfile(fd, __pmPtrToHandle(ctxp),
 				   ctxp->c_slot, ctxp->c_instprof)) < 0)
 	    return sts;
-	else
-	    ctxp->c_sent = 1;
+	ctxp->c_sent = 1;
+	ctxp->c_epoch = ctxp->c_pmcd->pc_epoch;
     }
     return 0;
 }
 
+/*
+ * pmcd sends state changes with the next fetch reply on a connection,
+ * which may be for any of the contexts sharing it, so remember when each
+ * change was seen and report those a context has not yet been told of
+ * (when there is a result to report them with).
+ * Called with ctxp->c_pmcd->pc_lock held.
+ */
+static int
+__pmPMCDChanges(__pmContext *ctxp, int changed, int report)
+{
+    __pmPMCDCtl	*ctl = ctxp->c_pmcd;
+    int		i, nbits = sizeof(ctl->pc_changed) / sizeof(ctl->pc_changed[0]);
+
+    if (changed) {
+	ctl->pc_changes++;
+	for (i = 0; i < nbits; i++)
+	    if (changed & (1 << i))
+		ctl->pc_changed[i] = ctl->pc_changes;
+	if (changed & (PMCD_LABEL_CHANGE | PMCD_AGENT_CHANGE))
+	    ctl->pc_labels++;	/* discard any cached label sets */
+    }
+    if (!report)
+	return 0;
+    for (i = 0; i < nbits; i++)
+	if (ctl->pc_changed[i] > ctxp->c_changes)
+	    changed |= (1 << i);
+    ctxp->c_changes = ctl->pc_changes;
+    return changed;
+}
+
 static int
 __pmRecvFetch(int fd, __pmContext *ctxp, int timeout, pmResult **result)
 {
@@ -51,7 +87,7 @@ __pmRecvFetch(int fd, __pmContext *ctxp, int timeout, pmResult **result)
     do {
 	sts = pinpdu = __pmGetPDU(fd, ANY_SIZE, timeout, &pb);
 	if (sts == PDU_RESULT) {
-	    sts = __pmDecodeResult_ctx(ctxp, pb, result);
+	    sts = __pmDecodeResultArena_ctx(ctxp, pb, result);
 	}
 	else if (sts == PDU_ERROR) {
 	    __pmDecodeError(pb, &sts);
@@ -66,6 +102,7 @@ __pmRecvFetch(int fd, __pmContext *ctxp, int timeout, pmResult **result)
 	    __pmUnpinPDUBuf(pb);
     } while (sts > 0);
 
+    changed = __pmPMCDChanges(ctxp, changed, sts == 0);
     if (sts == 0)
 	return changed;
     return sts;
@@ -95,7 +132,7 @@ int
 pmFetch_ctx(__pmContext *ctxp, int numpmid, pmID *pmidlist, pmResult **result)
 {
     int		need_unlock = 0;
-    int		fd, ctx, sts, tout;
+    int		fd, ctx, sts, xsts, tout;
 
     if (pmDebugOptions.pmapi) {
 	char    dbgbuf[20];
@@ -142,19 +179,25 @@ pmFetch_ctx(__pmContext *ctxp, int numpmid, pmID *pmidlist, pmResult **result)
 	}
 
 	if (ctxp->c_type == PM_CONTEXT_HOST) {
+	    PM_LOCK(ctxp->c_pmcd->pc_lock);
 	    tout = ctxp->c_pmcd->pc_tout_sec;
 	    fd = ctxp->c_pmcd->pc_fd;
-	    if ((sts = __pmUpdateProfile(fd, ctxp, tout)) < 0) {
-		sts = __pmMapErrno(sts);
-	    }
-	    else if ((sts = __pmSendFetch(fd, __pmPtrToHandle(ctxp), ctxp->c_slot,
-				&ctxp->c_origin, numpmid, pmidlist)) < 0) {
+	    /* send any profile and the fetch together */
+	    __pmXmitBatch(fd);
+	    if ((sts = __pmAsyncBusy(ctxp)) >= 0 &&
+		(sts = __pmUpdateProfile(fd, ctxp, tout)) >= 0)
+		sts = __pmSendFetch(fd, __pmPtrToHandle(ctxp), ctxp->c_slot,
+				&ctxp->c_origin, numpmid, pmidlist);
+	    if ((xsts = __pmXmitFlush(fd)) < 0 && sts >= 0)
+		sts = xsts;
+	    if (sts < 0) {
 		sts = __pmMapErrno(sts);
 	    }
 	    else {
 		PM_FAULT_POINT("libpcp/" __FILE__ ":1", PM_FAULT_TIMEOUT);
 		sts = __pmRecvFetch(fd, ctxp, tout, result);
 	    }
+	    PM_UNLOCK(ctxp->c_pmcd->pc_lock);
 	}
 	else if (ctxp->c_type == PM_CONTEXT_LOCAL) {
 	    sts = __pmFetchLocal(ctxp, numpmid, pmidlist, result);
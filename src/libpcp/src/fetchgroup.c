@@ -88,6 +88,7 @@ struct __pmFetchGroupItem {
 	    int *output_inst_codes;	/* NB: may be NULL */
 	    char **output_inst_names;	/* NB: may be NULL */
 	    pmAtomValue *output_values;	/* NB: may be NULL */
+	    void *output_column;	/* NB: may be NULL; packed output_type */
 	    int output_type;
 	    int *output_stss;	/* NB: may be NULL */
 	    int *output_sts;	/* NB: may be NULL */
@@ -553,6 +554,122 @@ __pmStuffDoubleValue(double val, pmAtomValue *oval, int otype)
     return sts;
 }
 
+/*
+ * Size of each element of a packed column of values of the given type,
+ * or zero if the type cannot be stored in a column.
+ */
+static size_t
+pmfg_column_size(int type)
+{
+    switch (type) {
+	case PM_TYPE_32:
+	case PM_TYPE_U32:
+	case PM_TYPE_FLOAT:
+	    return 4;
+	case PM_TYPE_64:
+	case PM_TYPE_U64:
+	case PM_TYPE_DOUBLE:
+	    return 8;
+    }
+    return 0;
+}
+
+static void
+pmfg_store_column(void *column, unsigned i, const pmAtomValue *v, int type)
+{
+    switch (type) {
+	case PM_TYPE_32:
+	    ((__int32_t *)column)[i] = v->l;
+	    break;
+	case PM_TYPE_U32:
+	    ((__uint32_t *)column)[i] = v->ul;
+	    break;
+	case PM_TYPE_64:
+	    ((__int64_t *)column)[i] = v->ll;
+	    break;
+	case PM_TYPE_U64:
+	    ((__uint64_t *)column)[i] = v->ull;
+	    break;
+	case PM_TYPE_FLOAT:
+	    ((float *)column)[i] = v->f;
+	    break;
+	case PM_TYPE_DOUBLE:
+	    ((double *)column)[i] = v->d;
+	    break;
+	default:
+	    assert(0);		/* prevented at pmExtendFetchGroup_column */
+    }
+}
+
+typedef struct {
+    int code;
+    char *name;
+} pmfg_inst_t;
+
+static int
+pmfg_inst_compare(const void *a, const void *b)
+{
+    int ca = ((const pmfg_inst_t *)a)->code;
+    int cb = ((const pmfg_inst_t *)b)->code;
+
+    return (ca > cb) - (ca < cb);
+}
+
+/*
+ * Sort the instances saved from pmGetInDom by identifier, so that
+ * instances in each new pmResult can be found by binary search.  The
+ * name pointers are permuted in place - they all point into the one
+ * allocation, which is still released with a single free.
+ */
+static void
+pmfg_sort_indom(pmFGI item)
+{
+    pmfg_inst_t *insts;
+    unsigned k, size = item->u.indom.indom_size;
+
+    if (size < 2)
+	return;
+    if ((insts = malloc(size * sizeof(*insts))) == NULL) {
+	/* cannot search unsorted codes - proceed without names instead */
+	free(item->u.indom.indom_codes);
+	free(item->u.indom.indom_names);
+	item->u.indom.indom_codes = NULL;
+	item->u.indom.indom_names = NULL;
+	item->u.indom.indom_size = 0;
+	return;
+    }
+    for (k = 0; k < size; k++) {
+	insts[k].code = item->u.indom.indom_codes[k];
+	insts[k].name = item->u.indom.indom_names[k];
+    }
+    qsort(insts, size, sizeof(*insts), pmfg_inst_compare);
+    for (k = 0; k < size; k++) {
+	item->u.indom.indom_codes[k] = insts[k].code;
+	item->u.indom.indom_names[k] = insts[k].name;
+    }
+    free(insts);
+}
+
+/* Find an instance in the sorted pmGetInDom results, else -1. */
+static int
+pmfg_lookup_inst(pmFGI item, int inst)
+{
+    const int *codes = item->u.indom.indom_codes;
+    unsigned lo = 0, hi = item->u.indom.indom_size;
+
+    while (lo < hi) {
+	unsigned mid = lo + (hi - lo) / 2;
+
+	if (codes[mid] == inst)
+	    return mid;
+	if (codes[mid] < inst)
+	    lo = mid + 1;
+	else
+	    hi = mid;
+    }
+    return -1;
+}
+
 static void
 pmfg_reinit_timestamp(pmFGI item)
 {
@@ -591,6 +708,10 @@ pmfg_reinit_indom(pmFGI item)
 	for (i = 0; i < item->u.indom.output_maxnum; i++)
 	    __pmReinitValue(&item->u.indom.output_values[i], item->u.indom.output_type);
 
+    if (item->u.indom.output_column)
+	memset(item->u.indom.output_column, 0,
+		pmfg_column_size(item->u.indom.output_type) * item->u.indom.output_maxnum);
+
     if (item->u.indom.output_inst_names)
 	for (i = 0; i < item->u.indom.output_maxnum; i++)
 	    item->u.indom.output_inst_names[i] = NULL;	/* break ref into indom_names[] */
@@ -640,12 +761,15 @@ pmfg_reinit_event(pmFGI item)
 /*
  * Find the pmValue corresponding to the item within the given
  * pmResult.  Convert it to given output type, including possible
- * string<->number conversions.
+ * string<->number conversions.  The instance is looked for first
+ * at position inst_hint in the value list, where it is usually found
+ * when walking an entire indom, before falling back to a scan.
  */
 static int
-pmfg_extract_item(pmID metric_pmid, int metric_inst, int first_vset,
-		  const pmDesc *metric_desc, pmValueSet **vsets,
-		  int numpmid, pmAtomValue *value, int otype)
+pmfg_extract_item(pmID metric_pmid, int metric_inst, int inst_hint,
+		  int first_vset, const pmDesc *metric_desc,
+		  pmValueSet **vsets, int numpmid,
+		  pmAtomValue *value, int otype)
 {
     int i;
 
@@ -660,6 +784,11 @@ pmfg_extract_item(pmID metric_pmid, int metric_inst, int first_vset,
 
 	    if (iv->numval < 0)	/* Pass error code, if any. */
 		return iv->numval;
+	    if (inst_hint >= 0 && inst_hint < iv->numval &&
+		(metric_desc->indom == PM_INDOM_NULL ||
+		 iv->vlist[inst_hint].inst == metric_inst))
+		return __pmExtractValue2(iv->valfmt, &iv->vlist[inst_hint],
+					metric_desc->type, value, otype);
 	    for (j = 0; j < iv->numval; j++) {
 		if (metric_desc->indom == PM_INDOM_NULL ||
 		    iv->vlist[j].inst == metric_inst)
@@ -720,7 +849,7 @@ pmfg_unwrap_counter(pmFG pmfg, int type, double *value)
 
 static int
 pmfg_extract_convert_item(pmFG pmfg, pmID metric_pmid, int metric_inst,
-			  int first_vset, const pmDesc *desc, const pmFGC conv,
+			  int inst_hint, int first_vset, const pmDesc *desc, const pmFGC conv,
 			  pmValueSet **vsets, int numpmid,
 			  const struct timespec *timestamp,
 			  pmAtomValue *oval, int otype)
@@ -731,8 +860,8 @@ pmfg_extract_convert_item(pmFG pmfg, pmID metric_pmid, int metric_inst,
 
     assert(oval != NULL);
 
-    sts = pmfg_extract_item(metric_pmid, metric_inst, first_vset, desc,
-			    vsets, numpmid, &v, PM_TYPE_DOUBLE);
+    sts = pmfg_extract_item(metric_pmid, metric_inst, inst_hint, first_vset,
+			    desc, vsets, numpmid, &v, PM_TYPE_DOUBLE);
     if (sts)
 	return sts;
 
@@ -751,8 +880,8 @@ pmfg_extract_convert_item(pmFG pmfg, pmID metric_pmid, int metric_inst,
 	    if (deltaT < epsilon)	/* avoid division by zero */
 		deltaT = epsilon;	/* (chose not to PM_ERR_CONV here) */
 
-	    sts = pmfg_extract_item(metric_pmid, metric_inst, first_vset,
-				    desc, prev_r->vset, prev_r->numpmid,
+	    sts = pmfg_extract_item(metric_pmid, metric_inst, inst_hint,
+				    first_vset, desc, prev_r->vset, prev_r->numpmid,
 				    &prev_v, PM_TYPE_DOUBLE);
 	    if (sts)
 		return sts;
@@ -829,7 +958,7 @@ pmfg_fetch_item(pmFG pmfg, pmFGI item, pmResult *newResult)
 
 	pmfg_timespec_from_timeval(&newResult->timestamp, &timestamp),
 	sts = pmfg_extract_convert_item(pmfg,
-			item->u.item.metric_pmid, item->u.item.metric_inst, 0,
+			item->u.item.metric_pmid, item->u.item.metric_inst, -1, 0,
 		 	&item->u.item.metric_desc, &item->u.item.conv,
 			newResult->vset, newResult->numpmid, &timestamp,
 			&v, item->u.item.output_type);
@@ -838,7 +967,7 @@ pmfg_fetch_item(pmFG pmfg, pmFGI item, pmResult *newResult)
     }
     else {
 	sts = pmfg_extract_item(item->u.item.metric_pmid,
-			item->u.item.metric_inst, 0,
+			item->u.item.metric_inst, -1, 0,
 			&item->u.item.metric_desc,
 			newResult->vset, newResult->numpmid,
 			&v, item->u.item.output_type);
@@ -913,18 +1042,13 @@ pmfg_fetch_indom(pmFG pmfg, pmFGI item, pmResult *newResult)
 
     /*
      * Analyze newResult to see whether it only contains instances we
-     * already know.  This is unfortunately an O(N**2) operation.  It
-     * could be made a bit faster if we build a pmGetInDom()- variant
-     * that provides instances in sorted order.
+     * already know.  The saved instances are kept sorted (see
+     * pmfg_sort_indom), making this an O(N log N) operation.
      */
     need_indom_refresh = 0;
     if (item->u.indom.output_inst_names) {	/* Caller interested at all? */
 	for (j = 0; j < (unsigned)iv->numval; j++) {
-	    unsigned k;
-	    for (k = 0; k < item->u.indom.indom_size; k++)
-		if (item->u.indom.indom_codes[k] == iv->vlist[j].inst)
-		    break;
-	    if (k >= item->u.indom.indom_size) {
+	    if (pmfg_lookup_inst(item, iv->vlist[j].inst) < 0) {
 		need_indom_refresh = 1;
 		break;
 	    }
@@ -943,6 +1067,7 @@ pmfg_fetch_indom(pmFG pmfg, pmFGI item, pmResult *newResult)
 	}
 	else {
 	    item->u.indom.indom_size = sts;
+	    pmfg_sort_indom(item);
 	}
 	/*
 	 * NB: Even if the pmGetInDom failed, we can proceed with
@@ -977,20 +1102,16 @@ pmfg_fetch_indom(pmFG pmfg, pmFGI item, pmResult *newResult)
 	 * results from pmGetIndom.
 	 */
 	if (item->u.indom.output_inst_names) {
-	    unsigned k;
-
-	    for (k = 0; k < item->u.indom.indom_size; k++) {
-		if (item->u.indom.indom_codes[k] == jv->inst) {
-		    /*
-		     * NB: copy the indom name char* by value.
-		     * The user is not supposed to modify / free this pointer,
-		     * or use it after a subsequent fetch or delete operation.
-		     */
-		    item->u.indom.output_inst_names[j] =
+	    int k = pmfg_lookup_inst(item, jv->inst);
+
+	    /*
+	     * NB: copy the indom name char* by value.
+	     * The user is not supposed to modify / free this pointer,
+	     * or use it after a subsequent fetch or delete operation.
+	     */
+	    if (k >= 0)
+		item->u.indom.output_inst_names[j] =
 				item->u.indom.indom_names[k];
-		    break;
-		}
-	    }
 	}
 
 	/* Fetch & convert the actual value. */
@@ -1000,7 +1121,7 @@ pmfg_fetch_indom(pmFG pmfg, pmFGI item, pmResult *newResult)
 
 	    pmfg_timespec_from_timeval(&newResult->timestamp, &timestamp);
 	    stss = pmfg_extract_convert_item(pmfg, item->u.indom.metric_pmid,
-				jv->inst, 0, &item->u.indom.metric_desc,
+				jv->inst, j, 0, &item->u.indom.metric_desc,
 				&item->u.indom.conv,
 				newResult->vset, newResult->numpmid, &timestamp,
 				&v, item->u.indom.output_type);
@@ -1009,7 +1130,7 @@ pmfg_fetch_indom(pmFG pmfg, pmFGI item, pmResult *newResult)
 	}
 	else {
 	    stss = pmfg_extract_item(item->u.indom.metric_pmid, jv->inst,
-				0, &item->u.indom.metric_desc,
+				j, 0, &item->u.indom.metric_desc,
 				newResult->vset, newResult->numpmid, &v,
 				item->u.indom.output_type);
 	    if (stss < 0)
@@ -1019,6 +1140,9 @@ pmfg_fetch_indom(pmFG pmfg, pmFGI item, pmResult *newResult)
 	/* Pass the output value. */
 	if (item->u.indom.output_values)
 	    item->u.indom.output_values[j] = v;
+	else if (item->u.indom.output_column)
+	    pmfg_store_column(item->u.indom.output_column, j, &v,
+				item->u.indom.output_type);
 
 out1:
 	if (item->u.indom.output_stss)
@@ -1076,7 +1200,7 @@ pmfg_fetch_event_field(pmFG pmfg, pmFGI item, unsigned int *output_num,
 	if (item->u.event.conv.rate_convert ||
 	    item->u.event.conv.unit_convert) {
 	    stss = pmfg_extract_convert_item(pmfg,
-				item->u.event.field_pmid, -1, i,
+				item->u.event.field_pmid, -1, -1, i,
 				&item->u.event.field_desc, &item->u.event.conv,
 				vsets, numpmid, timestamp,
 				&v, item->u.event.output_type);
@@ -1084,7 +1208,7 @@ pmfg_fetch_event_field(pmFG pmfg, pmFGI item, unsigned int *output_num,
 		goto out;
 	}
 	else {
-	    stss = pmfg_extract_item(item->u.event.field_pmid, -1,
+	    stss = pmfg_extract_item(item->u.event.field_pmid, -1, -1,
 				i, &item->u.event.field_desc, vsets, numpmid,
 				&v, item->u.event.output_type);
 	    if (stss < 0)
@@ -1465,6 +1589,36 @@ out:
     return sts;
 }
 
+/*
+ * As for pmExtendFetchGroup_indom, but the values are stored packed
+ * into a caller-provided column of out_type elements (no pmAtomValue
+ * union), so that they can be used as a contiguous numeric array.
+ */
+int
+pmExtendFetchGroup_column(pmFG pmfg,
+		const char *metric, const char *scale,
+		int out_inst_codes[], char *out_inst_names[],
+		void *out_values, int out_type,
+		int out_stss[], unsigned int out_maxnum,
+		unsigned int *out_num, int *out_sts)
+{
+    int sts;
+
+    if (pmfg_column_size(out_type) == 0)
+	return PM_ERR_TYPE;
+
+    sts = pmExtendFetchGroup_indom(pmfg, metric, scale,
+		out_inst_codes, out_inst_names, NULL, out_type,
+		out_stss, out_maxnum, out_num, out_sts);
+    if (sts < 0)
+	return sts;
+
+    /* the new item is at the head of the list */
+    pmfg->items->u.indom.output_column = out_values;
+    pmfg_reinit_indom(pmfg->items);
+    return 0;
+}
+
 int
 pmExtendFetchGroup_event(pmFG pmfg,
 		const char *metric, const char *instance,
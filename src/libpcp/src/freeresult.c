@@ -1,5 +1,5 @@
 /*
- * Copyright (c) 2014 Red Hat.
+ * Copyright (c) 2014,2019 Red Hat.
  * Copyright (c) 1995 Silicon Graphics, Inc.  All Rights Reserved.
  * 
  * This library is free software; you can redistribute it and/or modify it
@@ -69,6 +69,9 @@ pmFreeResult(pmResult *result)
 {
     if (pmDebugOptions.pdubuf)
 	fprintf(stderr, "pmFreeResult(" PRINTF_P_PFX "%p)\n", result);
+    /* all in one pdubuf, from __pmDecodeResultArena */
+    if (__pmUnpinPDUBuf((void *)result))
+	return;
     __pmFreeResultValues(result);
     free(result);
 }
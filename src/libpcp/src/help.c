@@ -1,5 +1,5 @@
 /*
- * Copyright (c) 2013,2016-2018 Red Hat.
+ * Copyright (c) 2013,2016-2019 Red Hat.
  * Copyright (c) 1995 Silicon Graphics, Inc.  All Rights Reserved.
  * 
  * This library is free software; you can redistribute it and/or modify it
@@ -71,10 +71,12 @@ lookuptext(int ident, int type, char **buffer)
 	return PM_ERR_NOCONTEXT;
 
     if (ctxp->c_type == PM_CONTEXT_HOST) {
+	PM_LOCK(ctxp->c_pmcd->pc_lock);
 	tout = ctxp->c_pmcd->pc_tout_sec;
 	fd = ctxp->c_pmcd->pc_fd;
 again_host:
-	sts = __pmSendTextReq(fd, __pmPtrToHandle(ctxp), ident, type);
+	if ((sts = __pmAsyncBusy(ctxp)) >= 0)
+	    sts = __pmSendTextReq(fd, __pmPtrToHandle(ctxp), ident, type);
 	if (sts < 0)
 	    sts = __pmMapErrno(sts);
 	else {
@@ -85,6 +87,7 @@ again_host:
 		goto again_host;
 	    }
 	}
+	PM_UNLOCK(ctxp->c_pmcd->pc_lock);
     }
     else if (ctxp->c_type == PM_CONTEXT_LOCAL) {
 	if (PM_MULTIPLE_THREADS(PM_SCOPE_DSO_PMDA))
@@ -1,5 +1,5 @@
 /*
- * Copyright (c) 2013 Red Hat.
+ * Copyright (c) 2013,2019 Red Hat.
  * Copyright (c) 1995-2006 Silicon Graphics, Inc.  All Rights Reserved.
  * 
  * This library is free software; you can redistribute it and/or modify it
@@ -49,7 +49,9 @@ pmLookupInDom_ctx(__pmContext *ctxp, pmInDom indom, const char *name)
 	else
 	    PM_ASSERT_IS_LOCKED(ctxp->c_lock);
 	if (ctxp->c_type == PM_CONTEXT_HOST) {
-	    sts = __pmSendInstanceReq(ctxp->c_pmcd->pc_fd, __pmPtrToHandle(ctxp),
+	    PM_LOCK(ctxp->c_pmcd->pc_lock);
+	    if ((sts = __pmAsyncBusy(ctxp)) >= 0)
+		sts = __pmSendInstanceReq(ctxp->c_pmcd->pc_fd, __pmPtrToHandle(ctxp),
 				    &ctxp->c_origin, indom, PM_IN_NULL, name);
 	    if (sts < 0)
 		sts = __pmMapErrno(sts);
@@ -75,6 +77,7 @@ PM_FAULT_POINT("libpcp/" __FILE__ ":3", PM_FAULT_TIMEOUT);
 		if (pinpdu > 0)
 		    __pmUnpinPDUBuf(pb);
 	    }
+	    PM_UNLOCK(ctxp->c_pmcd->pc_lock);
 	}
 	else if (ctxp->c_type == PM_CONTEXT_LOCAL) {
 	    __pmDSO		*dp;
@@ -163,7 +166,9 @@ pmNameInDom_ctx(__pmContext *ctxp, pmInDom indom, int inst, char **name)
 	else
 	    PM_ASSERT_IS_LOCKED(ctxp->c_lock);
 	if (ctxp->c_type == PM_CONTEXT_HOST) {
-	    sts = __pmSendInstanceReq(ctxp->c_pmcd->pc_fd, __pmPtrToHandle(ctxp),
+	    PM_LOCK(ctxp->c_pmcd->pc_lock);
+	    if ((sts = __pmAsyncBusy(ctxp)) >= 0)
+		sts = __pmSendInstanceReq(ctxp->c_pmcd->pc_fd, __pmPtrToHandle(ctxp),
 				    &ctxp->c_origin, indom, inst, NULL);
 	    if (sts < 0)
 		sts = __pmMapErrno(sts);
@@ -190,6 +195,7 @@ PM_FAULT_POINT("libpcp/" __FILE__ ":2", PM_FAULT_TIMEOUT);
 		if (pinpdu > 0)
 		    __pmUnpinPDUBuf(pb);
 	    }
+	    PM_UNLOCK(ctxp->c_pmcd->pc_lock);
 	}
 	else if (ctxp->c_type == PM_CONTEXT_LOCAL) {
 	    __pmDSO	*dp;
@@ -244,8 +250,9 @@ pmNameInDom(pmInDom indom, int inst, char **name)
     return sts;
 }
 
-static int
-inresult_to_lists(pmInResult *result, int **instlist, char ***namelist)
+/* also used for asynchronous replies, see pmGetInDomAsync */
+int
+__pmInResultToLists(pmInResult *result, int **instlist, char ***namelist)
 {
     int n, i, sts, need;
     char *p;
@@ -287,6 +294,288 @@ inresult_to_lists(pmInResult *result, int **instlist, char ***namelist)
     return n;
 }
 
+/*
+ * Instance domains from pmcd are cached per pmcd connection, so that
+ * pmGetInDom need only ask pmcd for the changes since the generation
+ * of each that is held (PDU_FLAG_INDOM_DELTA) - for large and mostly
+ * unchanging instance domains, like processes or cgroups, these are far
+ * smaller than the whole instance domain.  Names are packed after the
+ * pointers in namelist[], as returned by pmGetInDom.  The cache is
+ * emptied when the connection is re-established.
+ */
+typedef struct {
+    int		generation;	/* pmcd generation, zero if none */
+    int		numinst;
+    int		*instlist;
+    char	**namelist;
+    size_t	size;		/* bytes allocated for namelist */
+} indom_entry_t;
+
+typedef struct {
+    int		epoch;		/* pc_epoch when last filled */
+    __pmHashCtl	hash;		/* indom_entry_t by indom */
+} indom_cache_t;
+
+static __pmHashWalkState
+indom_free_entry(const __pmHashNode *tp, void *cdata)
+{
+    indom_entry_t	*ep = (indom_entry_t *)tp->data;
+
+    (void)cdata;
+    if (ep->instlist)
+	free(ep->instlist);
+    if (ep->namelist)
+	free(ep->namelist);
+    free(ep);
+    return PM_HASH_WALK_DELETE_NEXT;
+}
+
+static __pmHashWalkState
+indom_free_node(const __pmHashNode *tp, void *cdata)
+{
+    (void)tp;
+    (void)cdata;
+    return PM_HASH_WALK_DELETE_NEXT;
+}
+
+void
+__pmInDomCacheFree(__pmPMCDCtl *pc)
+{
+    indom_cache_t	*cp = (indom_cache_t *)pc->pc_indoms;
+
+    if (cp != NULL) {
+	__pmHashWalkCB(indom_free_entry, NULL, &cp->hash);
+	__pmHashClear(&cp->hash);
+	free(cp);
+	pc->pc_indoms = NULL;
+    }
+}
+
+/* cache entry for an instance domain, called with pc_lock held */
+static indom_entry_t *
+indom_lookup(__pmPMCDCtl *pc, pmInDom indom)
+{
+    indom_cache_t	*cp = (indom_cache_t *)pc->pc_indoms;
+    indom_entry_t	*ep;
+    __pmHashNode	*hp;
+
+    if (cp == NULL) {
+	if ((cp = (indom_cache_t *)calloc(1, sizeof(indom_cache_t))) == NULL)
+	    return NULL;
+	__pmHashInit(&cp->hash);
+	cp->epoch = pc->pc_epoch;
+	pc->pc_indoms = (void *)cp;
+    }
+    else if (cp->epoch != pc->pc_epoch) {
+	__pmHashWalkCB(indom_free_entry, NULL, &cp->hash);
+	__pmHashClear(&cp->hash);
+	cp->epoch = pc->pc_epoch;
+    }
+    if ((hp = __pmHashSearch((unsigned int)indom, &cp->hash)) != NULL)
+	return (indom_entry_t *)hp->data;
+    if ((ep = (indom_entry_t *)calloc(1, sizeof(indom_entry_t))) == NULL)
+	return NULL;
+    if (__pmHashAdd((unsigned int)indom, (void *)ep, &cp->hash) < 0) {
+	free(ep);
+	return NULL;
+    }
+    return ep;
+}
+
+/* bytes used by namelist[] and the names packed after it */
+static size_t
+indom_size(int numinst, char **namelist)
+{
+    char	*last;
+
+    if (numinst == 0)
+	return 0;
+    last = namelist[numinst - 1];
+    return last + strlen(last) + 1 - (char *)namelist;
+}
+
+/*
+ * Bring a cached instance domain up to date - instances are dropped
+ * in place, renamed in place, and added at the end, which pmcd only
+ * sends when that results in the order of the whole instance domain.
+ */
+static int
+indom_apply(indom_entry_t *ep, __pmInDomDelta *dp)
+{
+    __pmHashCtl		drops, adds;
+    __pmHashNode	*hp;
+    size_t		need;
+    char		**names = NULL;
+    char		**nlist = NULL;
+    char		*used = NULL;
+    char		*p;
+    int			*ilist = NULL;
+    int			i, j, n, sts;
+
+    if (dp->full) {
+	if (ep->instlist)
+	    free(ep->instlist);
+	if (ep->namelist)
+	    free(ep->namelist);
+	ep->numinst = dp->numinst;
+	ep->instlist = dp->instlist;
+	ep->namelist = dp->namelist;
+	ep->size = indom_size(dp->numinst, dp->namelist);
+	ep->generation = dp->generation;
+	dp->instlist = NULL;
+	dp->namelist = NULL;
+	return 0;
+    }
+    if (dp->numdrop == 0 && dp->numinst == 0) {
+	ep->generation = dp->generation;
+	return 0;
+    }
+
+    __pmHashInit(&drops);
+    __pmHashInit(&adds);
+    n = ep->numinst + dp->numinst + 1;
+    if ((ilist = (int *)malloc(n * sizeof(int))) == NULL ||
+	(names = (char **)malloc(n * sizeof(char *))) == NULL ||
+	(used = (char *)calloc(dp->numinst + 1, sizeof(char))) == NULL)
+	goto nomem;
+    for (i = 0; i < dp->numdrop; i++) {
+	if (__pmHashAdd((unsigned int)dp->droplist[i], NULL, &drops) < 0)
+	    goto nomem;
+    }
+    for (i = 0; i < dp->numinst; i++) {
+	if (__pmHashAdd((unsigned int)dp->instlist[i],
+			(void *)(__psint_t)i, &adds) < 0)
+	    goto nomem;
+    }
+
+    need = 0;
+    for (j = n = 0; j < ep->numinst; j++) {
+	if (__pmHashSearch((unsigned int)ep->instlist[j], &drops) != NULL)
+	    continue;
+	if ((hp = __pmHashSearch((unsigned int)ep->instlist[j], &adds)) != NULL) {
+	    i = (int)(__psint_t)hp->data;
+	    used[i] = 1;
+	    names[n] = dp->namelist[i];
+	}
+	else
+	    names[n] = ep->namelist[j];
+	ilist[n] = ep->instlist[j];
+	need += strlen(names[n++]) + 1;
+    }
+    for (i = 0; i < dp->numinst; i++) {
+	if (used[i])
+	    continue;
+	ilist[n] = dp->instlist[i];
+	names[n] = dp->namelist[i];
+	need += strlen(names[n++]) + 1;
+    }
+
+    need += n * sizeof(char *);
+    if (n > 0 && (nlist = (char **)malloc(need)) == NULL)
+	goto nomem;
+    p = (char *)&nlist[n];
+    for (i = 0; i < n; i++) {
+	strcpy(p, names[i]);
+	nlist[i] = p;
+	p += strlen(p) + 1;
+    }
+    free(ep->instlist);
+    free(ep->namelist);
+    ep->numinst = n;
+    ep->instlist = ilist;
+    ep->namelist = nlist;
+    ep->size = n > 0 ? need : 0;
+    ep->generation = dp->generation;
+    sts = 0;
+    goto done;
+
+nomem:
+    sts = -oserror();
+    if (ilist)
+	free(ilist);
+    /* start afresh from the whole instance domain next time */
+    ep->generation = 0;
+done:
+    if (names)
+	free(names);
+    if (used)
+	free(used);
+    __pmHashWalkCB(indom_free_node, NULL, &drops);
+    __pmHashClear(&drops);
+    __pmHashWalkCB(indom_free_node, NULL, &adds);
+    __pmHashClear(&adds);
+    return sts;
+}
+
+/* copy a cached instance domain, as for pmGetInDom */
+static int
+indom_copy(indom_entry_t *ep, int **instlist, char ***namelist)
+{
+    char	**nlist;
+    int		*ilist;
+    int		i;
+
+    if (ep->numinst == 0)
+	return 0;
+    if ((ilist = (int *)malloc(ep->numinst * sizeof(int))) == NULL)
+	return -oserror();
+    if ((nlist = (char **)malloc(ep->size)) == NULL) {
+	free(ilist);
+	return -oserror();
+    }
+    memcpy(ilist, ep->instlist, ep->numinst * sizeof(int));
+    memcpy(nlist, ep->namelist, ep->size);
+    for (i = 0; i < ep->numinst; i++)
+	nlist[i] = (char *)nlist + (ep->namelist[i] - (char *)ep->namelist);
+    *instlist = ilist;
+    *namelist = nlist;
+    return ep->numinst;
+}
+
+/*
+ * pmGetInDom for a host context, where pmcd sends instance domain
+ * changes - called with ctxp->c_pmcd->pc_lock held
+ */
+static int
+getindom_delta(__pmContext *ctxp, pmInDom indom, int **instlist, char ***namelist)
+{
+    __pmPMCDCtl		*pc = ctxp->c_pmcd;
+    __pmInDomDelta	delta;
+    indom_entry_t	*ep;
+    __pmPDU		*pb;
+    int			pinpdu;
+    int			sts;
+
+    if ((ep = indom_lookup(pc, indom)) == NULL)
+	return -ENOMEM;
+    sts = __pmSendInstanceDeltaReq(pc->pc_fd, __pmPtrToHandle(ctxp),
+				indom, ep->generation);
+    if (sts < 0)
+	return __pmMapErrno(sts);
+
+PM_FAULT_POINT("libpcp/" __FILE__ ":4", PM_FAULT_TIMEOUT);
+    pinpdu = sts = __pmGetPDU(pc->pc_fd, ANY_SIZE, pc->pc_tout_sec, &pb);
+    if (sts == PDU_INSTANCE) {
+	if ((sts = __pmDecodeInstanceDelta(pb, &delta)) >= 0) {
+	    if (delta.indom != indom)
+		sts = PM_ERR_IPC;
+	    else
+		sts = indom_apply(ep, &delta);
+	    __pmFreeInDomDelta(&delta);
+	}
+    }
+    else if (sts == PDU_ERROR)
+	__pmDecodeError(pb, &sts);
+    else if (sts != PM_ERR_TIMEOUT)
+	sts = PM_ERR_IPC;
+
+    if (pinpdu > 0)
+	__pmUnpinPDUBuf(pb);
+    if (sts < 0)
+	return sts;
+    return indom_copy(ep, instlist, namelist);
+}
+
 int
 pmGetInDom(pmInDom indom, int **instlist, char ***namelist)
 {
@@ -316,7 +605,18 @@ pmGetInDom(pmInDom indom, int **instlist, char ***namelist)
 	    sts = PM_ERR_NOCONTEXT;
 	    goto pmapi_return;
 	}
-	if (ctxp->c_type == PM_CONTEXT_HOST) {
+	if (ctxp->c_type == PM_CONTEXT_HOST && (sts = __pmAsyncBusy(ctxp)) < 0) {
+	    PM_UNLOCK(ctxp->c_lock);
+	    goto pmapi_return;
+	}
+	if (ctxp->c_type == PM_CONTEXT_HOST &&
+	    (__pmFeaturesIPC(ctxp->c_pmcd->pc_fd) & PDU_FLAG_INDOM_DELTA)) {
+	    PM_LOCK(ctxp->c_pmcd->pc_lock);
+	    sts = getindom_delta(ctxp, indom, instlist, namelist);
+	    PM_UNLOCK(ctxp->c_pmcd->pc_lock);
+	}
+	else if (ctxp->c_type == PM_CONTEXT_HOST) {
+	    PM_LOCK(ctxp->c_pmcd->pc_lock);
 	    sts = __pmSendInstanceReq(ctxp->c_pmcd->pc_fd, __pmPtrToHandle(ctxp),
 				    &ctxp->c_origin, indom, PM_IN_NULL, NULL);
 	    if (sts < 0)
@@ -333,10 +633,11 @@ PM_FAULT_POINT("libpcp/" __FILE__ ":1", PM_FAULT_TIMEOUT);
 		    if ((sts = __pmDecodeInstance(pb, &result)) < 0) {
 			if (pinpdu > 0)
 			    __pmUnpinPDUBuf(pb);
+			PM_UNLOCK(ctxp->c_pmcd->pc_lock);
 			PM_UNLOCK(ctxp->c_lock);
 			goto pmapi_return;
 		    }
-		    sts = inresult_to_lists(result, instlist, namelist);
+		    sts = __pmInResultToLists(result, instlist, namelist);
 		}
 		else if (sts == PDU_ERROR)
 		    __pmDecodeError(pb, &sts);
@@ -346,6 +647,7 @@ PM_FAULT_POINT("libpcp/" __FILE__ ":1", PM_FAULT_TIMEOUT);
 		if (pinpdu > 0)
 		    __pmUnpinPDUBuf(pb);
 	    }
+	    PM_UNLOCK(ctxp->c_pmcd->pc_lock);
 	}
 	else if (ctxp->c_type == PM_CONTEXT_LOCAL) {
 	    __pmDSO	*dp;
@@ -362,7 +664,7 @@ PM_FAULT_POINT("libpcp/" __FILE__ ":1", PM_FAULT_TIMEOUT);
 					       dp->dispatch.version.any.ext);
 	    }
 	    if (sts >= 0)
-		sts = inresult_to_lists(result, instlist, namelist);
+		sts = __pmInResultToLists(result, instlist, namelist);
 	}
 	else {
 	    /* assume PM_CONTEXT_ARCHIVE */
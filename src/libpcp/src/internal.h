@@ -1,5 +1,5 @@
 /*
- * Copyright (c) 2012-2018 Red Hat.
+ * Copyright (c) 2012-2019 Red Hat.
  * Copyright (c) 1995-2001 Silicon Graphics, Inc.  All Rights Reserved.
  * 
  * This library is free software; you can redistribute it and/or modify it
@@ -96,6 +96,16 @@ extern void __htonll(char *) _PCP_HIDDEN;	/* 64bit int */
 
 #endif /* HAVE_NETWORK_BYTEORDER */
 
+/* PDUs queued by one thread for one connection, see __pmXmitBatch */
+#define PDU_BATCH_MAX	8
+typedef struct {
+    int		active;		/* PDUs for fd are being queued */
+    int		fd;
+    int		count;		/* number of PDUs queued */
+    int		types[PDU_BATCH_MAX];	/* PDU types, for the counters */
+    __pmPDU	*pdulist[PDU_BATCH_MAX];	/* pinned, in network byte order */
+} __pmPDUBatch;
+
 #ifdef PM_MULTI_THREAD
 extern void __pmInitMutex(pthread_mutex_t *) _PCP_HIDDEN;	/* mutex initializer */
 extern void __pmDestroyMutex(pthread_mutex_t *) _PCP_HIDDEN;	/* mutex destroyer */
@@ -124,6 +134,7 @@ typedef struct {
     __pmnsTree  *curr_pmns;     /* current pmns */
     int         useExtPMNS;     /* ... was the result of a __pmUsePMNS */
     __pmContext	*curr_ctxp;	/* -> current __pmContext */
+    __pmPDUBatch xmit_batch;	/* PDUs queued for transmission */
 } __pmTPD;
 
 static inline __pmTPD *
@@ -331,8 +342,16 @@ extern int pmNameInDom_ctx(__pmContext *, pmInDom, int, char **) _PCP_HIDDEN;
 extern int pmLookupInDom_ctx(__pmContext *, pmInDom, const char *) _PCP_HIDDEN;
 extern int pmGetInDomArchive_ctx(__pmContext *, pmInDom, int **, char ***) _PCP_HIDDEN;
 extern int pmFetch_ctx(__pmContext *, int, pmID *, pmResult **) _PCP_HIDDEN;
+extern int __pmUpdateProfile(int, __pmContext *, int) _PCP_HIDDEN;
+extern int __pmInResultToLists(pmInResult *, int **, char ***) _PCP_HIDDEN;
+extern int __pmAsyncBusy(__pmContext *) _PCP_HIDDEN;
+extern void __pmAsyncFree(__pmContext *) _PCP_HIDDEN;
+extern void __pmLabelCacheFree(__pmContext *) _PCP_HIDDEN;
+extern void __pmInDomCacheFree(__pmPMCDCtl *) _PCP_HIDDEN;
+extern int __pmPMCDExclusive(__pmContext *) _PCP_HIDDEN;
 extern int pmStore_ctx(__pmContext *, const pmResult *) _PCP_HIDDEN;
 extern int __pmDecodeResult_ctx(__pmContext *, __pmPDU *, pmResult **) _PCP_HIDDEN;
+extern int __pmDecodeResultArena_ctx(__pmContext *, __pmPDU *, pmResult **) _PCP_HIDDEN;
 extern int __pmSendResult_ctx(__pmContext *, int, int, const pmResult *) _PCP_HIDDEN;
 extern void __pmDumpResult_ctx(__pmContext *, FILE *, const pmResult *) _PCP_HIDDEN;
 extern int pmGetArchiveEnd_ctx(__pmContext *, struct timeval *) _PCP_HIDDEN;
@@ -374,6 +393,25 @@ extern void __pmCheckIsUnlocked(void *, char *, int) _PCP_HIDDEN;
 
 extern int __pmGetPDUCeiling(void) _PCP_HIDDEN;
 
+/* state for a PDU received piecewise, see __pmGetPDUPartial */
+typedef struct {
+    __pmPDU	*pdubuf;	/* pinned buffer, or NULL before any data */
+    int		size;		/* allocated size of pdubuf in bytes */
+    int		have;		/* bytes received into pdubuf so far */
+} __pmPDUPartial;
+extern int __pmGetPDUPartial(int, int, __pmPDUPartial *, __pmPDU **) _PCP_HIDDEN;
+extern void __pmFreePDUPartial(__pmPDUPartial *) _PCP_HIDDEN;
+
+#ifdef IS_MINGW
+struct iovec {
+    void	*iov_base;
+    size_t	iov_len;
+};
+#else
+struct iovec;
+#endif
+extern ssize_t __pmSendv(int, const struct iovec *, int) _PCP_HIDDEN;
+
 extern int __pmSetFeaturesIPC(int, int, int) _PCP_HIDDEN;
 extern int __pmSetDataIPC(int, void *) _PCP_HIDDEN;
 extern int __pmDataIPCSize(void) _PCP_HIDDEN;
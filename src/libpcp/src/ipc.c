@@ -1,5 +1,5 @@
 /*
- * Copyright (c) 2012-2013 Red Hat.
+ * Copyright (c) 2012-2013,2019 Red Hat.
  * Copyright (c) 1995,2004 Silicon Graphics, Inc.  All Rights Reserved.
  * 
  * This library is free software; you can redistribute it and/or modify it
@@ -36,6 +36,8 @@
  * The features field holds any feature bits received from the other
  * end of the connection, so we can test for the presense/absence of
  * (remote) features.
+ * The compress field is set once both ends have agreed to compress
+ * large PDUs (PDU_FLAG_LZMA) sent on the connection.
  *
  * The table entries are of fixed length, but the actual size depends
  * on compile time options used (in particular, the secure sockets
@@ -45,7 +47,8 @@
 typedef struct {
     int		version : 8;	/* remote version (v1 or v2, so far) */
     unsigned	socket : 1;	/* true or false */
-    int		padding : 7;	/* unused zeroes */
+    unsigned	compress : 1;	/* true or false */
+    int		padding : 6;	/* unused zeroes */
     int		features : 16;	/* remote features (i.e. PDU_FLAG_s) */
     char	data[0];	/* opaque data (optional) */
 } __pmIPC;
@@ -292,6 +295,38 @@ __pmFeaturesIPC(int fd)
     return sts;
 }
 
+int
+__pmSetCompressIPC(int fd, int compress)
+{
+    int sts;
+
+    if (pmDebugOptions.context)
+	fprintf(stderr, "__pmSetCompressIPC: fd=%d compress=%d\n", fd, compress);
+
+    PM_LOCK(ipc_lock);
+    if ((sts = resize(fd)) < 0) {
+	PM_UNLOCK(ipc_lock);
+	return sts;
+    }
+
+    __pmIPCTablePtr(fd)->compress = (compress != 0);
+
+    PM_UNLOCK(ipc_lock);
+    return sts;
+}
+
+int
+__pmCompressIPC(int fd)
+{
+    int		sts = 0;
+
+    PM_LOCK(ipc_lock);
+    if (__pmIPCTable != NULL && fd >= 0 && fd < ipctablecount)
+	sts = __pmIPCTablePtr(fd)->compress;
+    PM_UNLOCK(ipc_lock);
+    return sts;
+}
+
 int
 __pmSetDataIPC(int fd, void *data)
 {
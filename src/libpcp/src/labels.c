@@ -1,5 +1,5 @@
 /*
- * Copyright (c) 2016-2018 Red Hat.
+ * Copyright (c) 2016-2019 Red Hat.
  * 
  * This library is free software; you can redistribute it and/or modify it
  * under the terms of the GNU Lesser General Public License as published
@@ -890,6 +890,149 @@ lookup_domain(int ident, int type)
     return -EINVAL;
 }
 
+/*
+ * Label sets from pmcd are cached per host context, keyed by label
+ * type and identifier, so that repeated requests for labels that have
+ * not changed (pmlogger, pmproxy series loading) need neither a round
+ * trip to pmcd nor parsing of the JSONB strings.  The cache is emptied
+ * when pmcd reports a label or agent change (pc_labels) or the pmcd
+ * connection is re-established (pc_epoch).  Instance labels are not
+ * cached, as pmcd reports no change when instances come and go.
+ */
+#define NLABELTYPES	5	/* context, domain, indom, cluster, item */
+
+typedef struct {
+    pmLabelSet		*sets;
+    int			nsets;
+} label_entry_t;
+
+typedef struct {
+    int			epoch;		/* pc_epoch when last filled */
+    int			changes;	/* pc_labels when last filled */
+    __pmHashCtl		hash[NLABELTYPES];	/* entries by ident */
+} label_cache_t;
+
+static int
+cache_index(int type)
+{
+    switch (type) {
+    case PM_LABEL_CONTEXT:	return 0;
+    case PM_LABEL_DOMAIN:	return 1;
+    case PM_LABEL_INDOM:	return 2;
+    case PM_LABEL_CLUSTER:	return 3;
+    case PM_LABEL_ITEM:		return 4;
+    }
+    return -1;	/* instances, compound or unknown type, not cached */
+}
+
+static __pmHashWalkState
+cache_free_entry(const __pmHashNode *tp, void *cdata)
+{
+    label_entry_t	*ep = (label_entry_t *)tp->data;
+
+    (void)cdata;
+    if (ep->sets)
+	pmFreeLabelSets(ep->sets, ep->nsets);
+    free(ep);
+    return PM_HASH_WALK_DELETE_NEXT;
+}
+
+static void
+cache_empty(label_cache_t *cp)
+{
+    int		i;
+
+    for (i = 0; i < NLABELTYPES; i++) {
+	__pmHashWalkCB(cache_free_entry, NULL, &cp->hash[i]);
+	__pmHashClear(&cp->hash[i]);
+    }
+}
+
+void
+__pmLabelCacheFree(__pmContext *ctxp)
+{
+    label_cache_t	*cp = (label_cache_t *)ctxp->c_labels;
+
+    if (cp != NULL) {
+	cache_empty(cp);
+	free(cp);
+	ctxp->c_labels = NULL;
+    }
+}
+
+/*
+ * Return a copy of cached label sets, one if they were found or zero if
+ * not (or no longer) cached.  Called with the pmcd connection locked.
+ */
+static int
+cache_lookup(__pmContext *ctxp, int ident, int type,
+		pmLabelSet **sets, int *nsets)
+{
+    label_cache_t	*cp = (label_cache_t *)ctxp->c_labels;
+    label_entry_t	*ep;
+    __pmHashNode	*hp;
+    int			i;
+
+    if (cp == NULL || (i = cache_index(type)) < 0)
+	return 0;
+    if (cp->epoch != ctxp->c_pmcd->pc_epoch ||
+	cp->changes != ctxp->c_pmcd->pc_labels) {
+	if (pmDebugOptions.labels)
+	    fprintf(stderr, "cache_lookup: context %d labels changed\n",
+			ctxp->c_handle);
+	cache_empty(cp);
+	cp->epoch = ctxp->c_pmcd->pc_epoch;
+	cp->changes = ctxp->c_pmcd->pc_labels;
+	return 0;
+    }
+    if ((hp = __pmHashSearch((unsigned int)ident, &cp->hash[i])) == NULL)
+	return 0;
+    ep = (label_entry_t *)hp->data;
+    if (ep->nsets > 0 && (*sets = __pmDupLabelSets(ep->sets, ep->nsets)) == NULL)
+	return 0;
+    *nsets = ep->nsets;
+    return 1;
+}
+
+/*
+ * Remember label sets from pmcd, including the absence of any labels.
+ * Failure here is not an error, the labels are simply not cached.
+ */
+static void
+cache_store(__pmContext *ctxp, int ident, int type,
+		pmLabelSet *sets, int nsets)
+{
+    label_cache_t	*cp = (label_cache_t *)ctxp->c_labels;
+    label_entry_t	*ep;
+    int			i;
+
+    if ((i = cache_index(type)) < 0)
+	return;
+    if (cp == NULL) {
+	if ((cp = (label_cache_t *)calloc(1, sizeof(label_cache_t))) == NULL)
+	    return;
+	for (i = 0; i < NLABELTYPES; i++)
+	    __pmHashInit(&cp->hash[i]);
+	cp->epoch = ctxp->c_pmcd->pc_epoch;
+	cp->changes = ctxp->c_pmcd->pc_labels;
+	ctxp->c_labels = (void *)cp;
+	i = cache_index(type);
+    }
+    if ((ep = (label_entry_t *)malloc(sizeof(label_entry_t))) == NULL)
+	return;
+    ep->nsets = nsets;
+    ep->sets = NULL;
+    if (nsets > 0 && (ep->sets = __pmDupLabelSets(sets, nsets)) == NULL) {
+	free(ep);
+	return;
+    }
+    if (__pmHashAdd((unsigned int)ident, (void *)ep, &cp->hash[i]) < 0) {
+	if (ep->sets)
+	    pmFreeLabelSets(ep->sets, ep->nsets);
+	free(ep);
+    }
+}
+
 static int
 getlabels(int ident, int type, pmLabelSet **sets, int *nsets)
 {
@@ -906,15 +1049,22 @@ getlabels(int ident, int type, pmLabelSet **sets, int *nsets)
 	int	tout = ctxp->c_pmcd->pc_tout_sec;
 	int	fd = ctxp->c_pmcd->pc_fd;
 
-	if (!(__pmFeaturesIPC(fd) & PDU_FLAG_LABELS))
+	PM_LOCK(ctxp->c_pmcd->pc_lock);
+	if (cache_lookup(ctxp, ident, type, sets, nsets))
+	    sts = *nsets;
+	else if (!(__pmFeaturesIPC(fd) & PDU_FLAG_LABELS))
 	    sts = PM_ERR_NOLABELS;	/* lack pmcd support */
-	else if ((sts = __pmSendLabelReq(fd, handle, ident, type)) < 0)
+	else if ((sts = __pmAsyncBusy(ctxp)) < 0 ||
+		 (sts = __pmSendLabelReq(fd, handle, ident, type)) < 0)
 	    sts = __pmMapErrno(sts);
 	else {
 	    int x_ident = ident, x_type = type;
 	    PM_FAULT_POINT("libpcp/" __FILE__ ":1", PM_FAULT_TIMEOUT);
 	    sts = __pmRecvLabel(fd, ctxp, tout, &x_ident, &x_type, sets, nsets);
+	    if (sts >= 0)
+		cache_store(ctxp, ident, type, *sets, *nsets);
 	}
+	PM_UNLOCK(ctxp->c_pmcd->pc_lock);
     }
     else if (ctxp->c_type == PM_CONTEXT_LOCAL) {
 	__pmDSO	*dp;
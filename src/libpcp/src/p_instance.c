@@ -1,5 +1,5 @@
 /*
- * Copyright (c) 2012-2013 Red Hat.
+ * Copyright (c) 2012-2013,2019 Red Hat.
  * Copyright (c) 1995-2002 Silicon Graphics, Inc.  All Rights Reserved.
  * 
  * This library is free software; you can redistribute it and/or modify it
@@ -282,3 +282,196 @@ badsts:
     __pmFreeInResult(res);
     return sts;
 }
+
+/*
+ * Request the changes to all instances of an instance domain since
+ * the given generation (zero for none), see PDU_FLAG_INDOM_DELTA
+ */
+int
+__pmSendInstanceDeltaReq(int fd, int from, pmInDom indom, int generation)
+{
+    pmTimeval	when;
+
+    when.tv_sec = generation;
+    when.tv_usec = PDU_INDOM_DELTA;
+    return __pmSendInstanceReq(fd, from, &when, indom, PM_IN_NULL, NULL);
+}
+
+/*
+ * PDU for pm*InDom changes (PDU_INSTANCE, in reply to a delta request)
+ */
+typedef struct {
+    __pmPDUHdr	hdr;
+    pmInDom	indom;
+    int		generation;	/* generation after these changes */
+    int		full;		/* instances are the whole indom */
+    int		numdrop;	/* no. of instance ids removed */
+    int		numinst;	/* no. of instlist_t added or renamed */
+    __pmPDU	rest[1];	/* drop ids, then array of instlist_t */
+} instance_delta_t;
+
+int
+__pmSendInstanceDelta(int fd, int from, const __pmInDomDelta *dp)
+{
+    instance_delta_t	*rp;
+    instlist_t		*ip;
+    int			need;
+    int			i;
+    int			j;
+    int			sts;
+
+    need = sizeof(*rp) - sizeof(rp->rest) + dp->numdrop * sizeof(int);
+    /* instlist_t + name rounded up to a __pmPDU boundary */
+    for (i = 0; i < dp->numinst; i++) {
+	need += sizeof(*ip) - sizeof(ip->name);
+	if (dp->namelist != NULL)
+	    need += PM_PDU_SIZE_BYTES(strlen(dp->namelist[i]));
+    }
+
+    if ((rp = (instance_delta_t *)__pmFindPDUBuf(need)) == NULL)
+	return -oserror();
+    rp->hdr.len = need;
+    rp->hdr.type = PDU_INSTANCE;
+    rp->hdr.from = from;
+    rp->indom = __htonpmInDom(dp->indom);
+    rp->generation = htonl(dp->generation);
+    rp->full = htonl(dp->full);
+    rp->numdrop = htonl(dp->numdrop);
+    rp->numinst = htonl(dp->numinst);
+
+    for (i = 0; i < dp->numdrop; i++)
+	rp->rest[i] = htonl(dp->droplist[i]);
+
+    for (i = 0, j = dp->numdrop * sizeof(int); i < dp->numinst; i++) {
+	ip = (instlist_t *)&rp->rest[j/sizeof(__pmPDU)];
+	if (dp->instlist != NULL)
+	    ip->inst = htonl(dp->instlist[i]);
+	else
+	    ip->inst = htonl(PM_IN_NULL);
+	if (dp->namelist != NULL) {
+	    ip->namelen = (int)strlen(dp->namelist[i]);
+	    memcpy((void *)ip->name, (void *)dp->namelist[i], ip->namelen);
+	    if ((ip->namelen % sizeof(__pmPDU)) != 0) {
+                /* clear the padding bytes, lest they contain garbage */
+		int	pad;
+		char	*padp = ip->name + ip->namelen;
+		for (pad = sizeof(__pmPDU) - 1; pad >= (ip->namelen % sizeof(__pmPDU)); pad--)
+		    *padp++ = '~';	/* buffer end */
+	    }
+	    j += sizeof(*ip) - sizeof(ip->name) + PM_PDU_SIZE_BYTES(ip->namelen);
+	    ip->namelen = htonl(ip->namelen);
+	}
+	else {
+	    ip->namelen = 0;
+	    j += sizeof(*ip) - sizeof(ip->name);
+	}
+    }
+
+    sts = __pmXmitPDU(fd, (__pmPDU *)rp);
+    __pmUnpinPDUBuf(rp);
+    return sts;
+}
+
+/*
+ * Decode instance domain changes - the names are packed into the one
+ * allocation with namelist[], as for pmGetInDom
+ */
+int
+__pmDecodeInstanceDelta(__pmPDU *pdubuf, __pmInDomDelta *dp)
+{
+    instance_delta_t	*rp;
+    instlist_t		*ip;
+    char		*pdu_end;
+    char		*p;
+    size_t		need;
+    int			i;
+    int			j;
+    int			namelen;
+    int			sts;
+
+    rp = (instance_delta_t *)pdubuf;
+    pdu_end = (char *)pdubuf + rp->hdr.len;
+    memset(dp, 0, sizeof(*dp));
+
+    if (pdu_end - (char *)pdubuf < sizeof(instance_delta_t) - sizeof(__pmPDU))
+	return PM_ERR_IPC;
+
+    dp->indom = __ntohpmInDom(rp->indom);
+    dp->generation = ntohl(rp->generation);
+    dp->full = ntohl(rp->full);
+    dp->numdrop = ntohl(rp->numdrop);
+    dp->numinst = ntohl(rp->numinst);
+
+    if (dp->numdrop < 0 || dp->numinst < 0 ||
+	dp->numdrop >= rp->hdr.len / sizeof(int) ||
+	dp->numinst >= rp->hdr.len / sizeof(int) ||
+	(size_t)(pdu_end - (char *)rp->rest) < dp->numdrop * sizeof(int))
+	goto corrupt;
+
+    /* first pass checks the instlist_t bounds and sizes the names */
+    need = 0;
+    for (i = 0, j = dp->numdrop * sizeof(int); i < dp->numinst; i++) {
+	ip = (instlist_t *)&rp->rest[j/sizeof(__pmPDU)];
+	if (sizeof(instlist_t) - sizeof(ip->name) > (size_t)(pdu_end - (char *)ip))
+	    goto corrupt;
+	namelen = ntohl(ip->namelen);
+	if (namelen < 0 ||
+	    sizeof(instlist_t) - sizeof(int) + namelen > (size_t)(pdu_end - (char *)ip))
+	    goto corrupt;
+	need += namelen + 1;
+	j += sizeof(*ip) - sizeof(ip->name) + PM_PDU_SIZE_BYTES(namelen);
+    }
+
+    if (dp->numdrop > 0) {
+	if ((dp->droplist = (int *)malloc(dp->numdrop * sizeof(int))) == NULL)
+	    goto nomem;
+	for (i = 0; i < dp->numdrop; i++)
+	    dp->droplist[i] = ntohl(rp->rest[i]);
+    }
+    if (dp->numinst > 0) {
+	if ((dp->instlist = (int *)malloc(dp->numinst * sizeof(int))) == NULL)
+	    goto nomem;
+	need += dp->numinst * sizeof(char *);
+	if ((dp->namelist = (char **)malloc(need)) == NULL)
+	    goto nomem;
+	p = (char *)&dp->namelist[dp->numinst];
+	for (i = 0, j = dp->numdrop * sizeof(int); i < dp->numinst; i++) {
+	    ip = (instlist_t *)&rp->rest[j/sizeof(__pmPDU)];
+	    dp->instlist[i] = ntohl(ip->inst);
+	    namelen = ntohl(ip->namelen);
+	    memcpy(p, ip->name, namelen);
+	    p[namelen] = '\0';
+	    dp->namelist[i] = p;
+	    p += namelen + 1;
+	    j += sizeof(*ip) - sizeof(ip->name) + PM_PDU_SIZE_BYTES(namelen);
+	}
+    }
+
+    if (pmDebugOptions.indom)
+	fprintf(stderr, "__pmDecodeInstanceDelta: indom %s generation %d%s: "
+		"%d dropped, %d added or renamed\n", pmInDomStr(dp->indom),
+		dp->generation, dp->full ? " (full)" : "",
+		dp->numdrop, dp->numinst);
+    return 0;
+
+corrupt:
+    memset(dp, 0, sizeof(*dp));
+    return PM_ERR_IPC;
+
+nomem:
+    sts = -oserror();
+    __pmFreeInDomDelta(dp);
+    return sts;
+}
+
+void
+__pmFreeInDomDelta(__pmInDomDelta *dp)
+{
+    if (dp->droplist != NULL)
+	free(dp->droplist);
+    if (dp->instlist != NULL)
+	free(dp->instlist);
+    if (dp->namelist != NULL)
+	free(dp->namelist);
+    memset(dp, 0, sizeof(*dp));
+}
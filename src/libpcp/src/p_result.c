@@ -1,5 +1,5 @@
 /*
- * Copyright (c) 2012-2014 Red Hat.
+ * Copyright (c) 2012-2014,2019 Red Hat.
  * Copyright (c) 1995-2000 Silicon Graphics, Inc.  All Rights Reserved.
  * 
  * This library is free software; you can redistribute it and/or modify it
@@ -30,6 +30,13 @@
  * pointers back into the input PDU buffer, this will be pinned _twice_
  * so the pmFreeResult() and __pmUnpinPDUBuf() calls will still be
  * required.
+ *
+ * __pmDecodeResultArena() is the same, except that on 64-bit pointer
+ * platforms the pmResult itself is also built in the second buffer,
+ * along with all of its pmValueSets and pmValueBlocks, so decoding
+ * costs one allocation and pmFreeResult() one unpin, whatever the
+ * shape of the result.  Such a pmResult must only be freed with
+ * pmFreeResult() - it cannot be taken apart, nor passed to free().
  */
 
 #include <ctype.h>
@@ -181,14 +188,18 @@ __pmSendResult(int fd, int from, const pmResult *result)
     return sts;
 }
 
+/* bytes for a pmResult header, aligned for the pmValueSets that follow */
+#define RESULT_SIZE(n) \
+    ((sizeof(pmResult) + ((n) - 1) * sizeof(pmValueSet *) + \
+      sizeof(__int64_t) - 1) & ~(sizeof(__int64_t) - 1))
+
 /*
- * Internal variant of __pmDecodeResult() with current context.
- *
  * Enter here with pdubuf already pinned ... result may point into
- * _another_ pdu buffer that is pinned on exit
+ * _another_ pdu buffer that is pinned on exit, and with arena set
+ * the pmResult is allocated there too
  */
-int
-__pmDecodeResult_ctx(__pmContext *ctxp, __pmPDU *pdubuf, pmResult **result)
+static int
+decode_result(__pmContext *ctxp, __pmPDU *pdubuf, int arena, pmResult **result)
 {
     int		numpmid;	/* number of metrics */
     int		i;		/* range of metrics */
@@ -199,9 +210,10 @@ __pmDecodeResult_ctx(__pmContext *ctxp, __pmPDU *pdubuf, pmResult **result)
     char	*vsplit;	/* vlist/valueblock division point */
     result_t	*pp;
     vlist_t	*vlp;
-    pmResult	*pr;
+    pmResult	*pr = NULL;
 #if defined(HAVE_64BIT_PTR)
-    char	*newbuf;
+    char	*newbuf = NULL;
+    char	*vbase;		/* start of pmValueSets in newbuf */
     int		valfmt;
     int		numval;
     int		need;
@@ -244,13 +256,6 @@ __pmDecodeResult_ctx(__pmContext *ctxp, __pmPDU *pdubuf, pmResult **result)
 	}
 	return PM_ERR_IPC;
     }
-    if ((pr = (pmResult *)malloc(sizeof(pmResult) +
-			     (numpmid - 1) * sizeof(pmValueSet *))) == NULL) {
-	return -oserror();
-    }
-    pr->numpmid = numpmid;
-    pr->timestamp.tv_sec = ntohl(pp->timestamp.tv_sec);
-    pr->timestamp.tv_usec = ntohl(pp->timestamp.tv_usec);
 
 #if defined(HAVE_64BIT_PTR)
     vsplit = pduend;	/* smallest observed value block pointer */
@@ -383,10 +388,26 @@ __pmDecodeResult_ctx(__pmContext *ctxp, __pmPDU *pdubuf, pmResult **result)
     }
 
     /* the original pdubuf is already pinned so we won't allocate that again */
-    if ((newbuf = (char *)__pmFindPDUBuf(need)) == NULL) {
-	free(pr);
-	return -oserror();
+    if (arena) {
+	if ((newbuf = (char *)__pmFindPDUBuf(RESULT_SIZE(numpmid) + need)) == NULL)
+	    return -oserror();
+	pr = (pmResult *)newbuf;
+	vbase = &newbuf[RESULT_SIZE(numpmid)];
     }
+    else {
+	if ((pr = (pmResult *)malloc(sizeof(pmResult) +
+			     (numpmid - 1) * sizeof(pmValueSet *))) == NULL)
+	    return -oserror();
+	/* no pmValueSets (need == 0) means no second buffer */
+	if (numpmid > 0 && (newbuf = (char *)__pmFindPDUBuf(need)) == NULL) {
+	    free(pr);
+	    return -oserror();
+	}
+	vbase = newbuf;
+    }
+    pr->numpmid = numpmid;
+    pr->timestamp.tv_sec = ntohl(pp->timestamp.tv_sec);
+    pr->timestamp.tv_usec = ntohl(pp->timestamp.tv_usec);
 
     /*
      * At this point, we have verified the contents of the incoming PDU and
@@ -400,17 +421,18 @@ __pmDecodeResult_ctx(__pmContext *ctxp, __pmPDU *pdubuf, pmResult **result)
      *                                    bytes              bytes
      *
      * and in the new PDU buffer we are going to build ...
-     * :---------------------:---------------------:
-     * : ... pmValueSets ... : .. pmValueBlocks .. :
-     * :---------------------:---------------------:
-     *  <---   nvsize    ---> <----   vbsize  ---->
-     *         bytes                  bytes
+     * :------------:---------------------:---------------------:
+     * : [pmResult] : ... pmValueSets ... : .. pmValueBlocks .. :
+     * :------------:---------------------:---------------------:
+     *  ^ arena only ^ vbase
+     *               <---   nvsize    ---> <----   vbsize  ---->
+     *                      bytes                  bytes
      */
 
     if (vbsize) {
 	/* pmValueBlocks (if any) are copied across "as is" */
 	index = vsize / sizeof(__pmPDU);
-	memcpy((void *)&newbuf[nvsize], (void *)&pp->data[index], vbsize);
+	memcpy((void *)&vbase[nvsize], (void *)&pp->data[index], vbsize);
     }
 
     /*
@@ -424,7 +446,7 @@ __pmDecodeResult_ctx(__pmContext *ctxp, __pmPDU *pdubuf, pmResult **result)
     nvsize = vsize = 0;
     for (i = 0; i < numpmid; i++) {
 	vlp = (vlist_t *)&pp->data[vsize/sizeof(__pmPDU)];
-	nvsp = (pmValueSet *)&newbuf[nvsize];
+	nvsp = (pmValueSet *)&vbase[nvsize];
 	pr->vset[i] = nvsp;
 	nvsp->pmid = __ntohpmID(vlp->pmid);
 	nvsp->numval = ntohl(vlp->numval);
@@ -461,7 +483,7 @@ __pmDecodeResult_ctx(__pmContext *ctxp, __pmPDU *pdubuf, pmResult **result)
 		     * start of the pmValueBlock, in units of __pmPDU
 		     */
 		    index = sizeof(__pmPDU) * ntohl(vp->value.lval) + offset;
-		    nvp->value.pval = (pmValueBlock *)&newbuf[index];
+		    nvp->value.pval = (pmValueBlock *)&vbase[index];
 		    if (pmDebugOptions.pdu && pmDebugOptions.desperate) {
 			int		k, len;
 			len = nvp->value.pval->vlen - PM_VAL_HDR_SIZE;
@@ -483,11 +505,16 @@ __pmDecodeResult_ctx(__pmContext *ctxp, __pmPDU *pdubuf, pmResult **result)
 	    fputc('\n', stderr);
 	}
     }
-    if (numpmid == 0)
-	__pmUnpinPDUBuf(newbuf);
 
 #elif defined(HAVE_32BIT_PTR)
 
+    /* pmValueSets are already within the PDU buffer, arena or not */
+    (void)arena;
+    if ((pr = (pmResult *)malloc(sizeof(pmResult) +
+			     (numpmid - 1) * sizeof(pmValueSet *))) == NULL) {
+	return -oserror();
+    }
+    pr->numpmid = numpmid;
     pr->timestamp.tv_sec = ntohl(pp->timestamp.tv_sec);
     pr->timestamp.tv_usec = ntohl(pp->timestamp.tv_usec);
     vlp = (vlist_t *)pp->data;
@@ -616,10 +643,30 @@ __pmDecodeResult_ctx(__pmContext *ctxp, __pmPDU *pdubuf, pmResult **result)
     return 0;
 
 corrupt:
-    free(pr);
+#if defined(HAVE_64BIT_PTR)
+    if (newbuf != NULL)
+	__pmUnpinPDUBuf(newbuf);
+    if (!arena)
+#endif
+	free(pr);
     return PM_ERR_IPC;
 }
 
+/*
+ * Internal variants of __pmDecodeResult() with current context.
+ */
+int
+__pmDecodeResult_ctx(__pmContext *ctxp, __pmPDU *pdubuf, pmResult **result)
+{
+    return decode_result(ctxp, pdubuf, 0, result);
+}
+
+int
+__pmDecodeResultArena_ctx(__pmContext *ctxp, __pmPDU *pdubuf, pmResult **result)
+{
+    return decode_result(ctxp, pdubuf, 1, result);
+}
+
 int
 __pmDecodeResult(__pmPDU *pdubuf, pmResult **result)
 {
@@ -627,3 +674,9 @@ __pmDecodeResult(__pmPDU *pdubuf, pmResult **result)
     sts = __pmDecodeResult_ctx(NULL, pdubuf, result);
     return sts;
 }
+
+int
+__pmDecodeResultArena(__pmPDU *pdubuf, pmResult **result)
+{
+    return decode_result(NULL, pdubuf, 1, result);
+}
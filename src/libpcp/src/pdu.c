@@ -1,5 +1,5 @@
 /*
- * Copyright (c) 2012-2015 Red Hat.
+ * Copyright (c) 2012-2015,2019 Red Hat.
  * Copyright (c) 1995-2005 Silicon Graphics, Inc.  All Rights Reserved.
  * 
  * This library is free software; you can redistribute it and/or modify it
@@ -27,6 +27,9 @@
  * maintained with non-atomic updates ... we've decided that it is
  * acceptable for their values to be subject to possible (but unlikely)
  * missed updates
+ *
+ * xmit_batch is thread-private, each thread queueing the PDUs it sends
+ * on one connection between __pmXmitBatch() and __pmXmitFlush().
  */
 
 #include "pmapi.h"
@@ -35,6 +38,13 @@
 #include "fault.h"
 #include <assert.h>
 #include <errno.h>
+#include <stddef.h>
+#ifndef IS_MINGW
+#include <sys/uio.h>
+#endif
+#if defined(HAVE_LZMA_DECOMPRESSION)
+#include <lzma.h>	/* liblzma provides the encoder as well */
+#endif
 
 #ifdef PM_MULTI_THREAD
 static pthread_mutex_t	pdu_lock = PTHREAD_MUTEX_INITIALIZER;
@@ -72,6 +82,39 @@ static int		req_wait_done;
 #define HEADER	-1
 #define BODY	0
 
+#ifdef PM_MULTI_THREAD
+#ifdef HAVE___THREAD
+/* using a gcc construct here to make xmit_batch thread-private */
+static __thread __pmPDUBatch	xmit_batch;
+#endif
+#else
+static __pmPDUBatch		xmit_batch;
+#endif
+
+/*
+ * A PDU sent with the PDU_COMPRESSED type flag, once both ends of the
+ * connection have agreed to PDU_FLAG_LZMA - the header is followed by
+ * the length of the original PDU, then its body as a raw LZMA2 stream.
+ */
+typedef struct {
+    __pmPDUHdr	hdr;
+    int		rawlen;		/* original PDU length, including header */
+    char	data[sizeof(int)];	/* compressed PDU body */
+} compressed_t;
+
+#define COMPRESSED_HDR	((int)offsetof(compressed_t, data))
+
+/* only PDUs at least this large are worth compressing */
+#define COMPRESS_MIN	(4 * PDU_CHUNK)
+
+/*
+ * Largest original to compressed PDU length ratio - a receiver sizes
+ * its buffer from the claimed original length before decompressing,
+ * so this bounds the memory a peer can demand relative to what it has
+ * actually sent.  More compressible PDUs are sent as they are.
+ */
+#define COMPRESS_RATIO	64
+
 int
 __pmSetRequestTimeout(double timeout)
 {
@@ -186,10 +229,9 @@ pduread(int fd, char *buf, int len, int part, int timeout)
 		 * Need all parts of the PDU to be received by dead_hand
 		 * This enforces a low overall timeout for the whole PDU
 		 * (as opposed to just a timeout for individual calls to
-		 * recv).  A more invasive alternative (better) approach
-		 * would see all I/O performed in the main event loop,
-		 * and I/O routines transformed to continuation-passing
-		 * style.
+		 * recv).  Callers wanting all I/O performed in their
+		 * main event loop should use __pmGetPDUPartial instead,
+		 * via the asynchronous PMAPI (see async.c).
 		 */
 		gettimeofday(&dead_hand, NULL);
 		dead_hand.tv_sec += wait.tv_sec;
@@ -357,13 +399,283 @@ __pmIgnoreSignalPIPE(void)
 void __pmIgnoreSignalPIPE(void) {}
 #endif
 
+#if defined(HAVE_LZMA_DECOMPRESSION)
+/*
+ * LZMA2 with the fastest preset, and a dictionary no larger than the
+ * PDU body (the same at both ends, as the body length is sent too).
+ */
+static int
+lzma_filters(size_t length, lzma_options_lzma *options, lzma_filter *filters)
+{
+    if (lzma_lzma_preset(options, 0))
+	return -EINVAL;
+    while (options->dict_size / 2 >= length &&
+	   options->dict_size / 2 >= LZMA_DICT_SIZE_MIN)
+	options->dict_size /= 2;
+    filters[0].id = LZMA_FILTER_LZMA2;
+    filters[0].options = options;
+    filters[1].id = LZMA_VLI_UNKNOWN;
+    filters[1].options = NULL;
+    return 0;
+}
+#endif
+
+/*
+ * Compress a large PDU for a connection where this has been agreed -
+ * returns a new pinned PDU buffer with its header in network byte
+ * order, else NULL if the PDU is to be sent as it is.
+ */
+static __pmPDU *
+pdu_compress(int fd, __pmPDUHdr *php)
+{
+#if defined(HAVE_LZMA_DECOMPRESSION)
+    lzma_options_lzma	options;
+    lzma_filter		filters[2];
+    compressed_t	*cp;
+    size_t		inlen, outlen, outpos = 0;
+
+    if (php->len < COMPRESS_MIN || php->type == PDU_CREDS ||
+	!__pmCompressIPC(fd))
+	return NULL;
+
+    /* not worthwhile unless the body shrinks by at least an eighth */
+    inlen = php->len - sizeof(__pmPDUHdr);
+    outlen = inlen - inlen / 8;
+    if (lzma_filters(inlen, &options, filters) < 0)
+	return NULL;
+    if ((cp = (compressed_t *)__pmFindPDUBuf(COMPRESSED_HDR + outlen)) == NULL)
+	return NULL;
+    if (lzma_raw_buffer_encode(filters, NULL, (const uint8_t *)&php[1], inlen,
+			(uint8_t *)cp->data, &outpos, outlen) != LZMA_OK) {
+	__pmUnpinPDUBuf(cp);
+	return NULL;
+    }
+    if (php->len / COMPRESS_RATIO > COMPRESSED_HDR + (int)outpos) {
+	__pmUnpinPDUBuf(cp);
+	return NULL;
+    }
+    if (pmDebugOptions.pdu)
+	fprintf(stderr, "pdu_compress: fd=%d len=%d -> %d\n",
+		fd, php->len, COMPRESSED_HDR + (int)outpos);
+    cp->hdr.len = htonl(COMPRESSED_HDR + (int)outpos);
+    cp->hdr.type = htonl(php->type | PDU_COMPRESSED);
+    cp->hdr.from = htonl(php->from);
+    cp->rawlen = htonl(php->len);
+    return (__pmPDU *)cp;
+#else
+    (void)fd;
+    (void)php;
+    return NULL;
+#endif
+}
+
+/*
+ * Replace a received compressed PDU, with its length already in host
+ * byte order, by the original - returns zero with *phpp updated if
+ * it was compressed (or not), else an error after unpinning the PDU.
+ */
+static int
+pdu_expand(int fd, int mode, __pmPDUHdr **phpp)
+{
+    __pmPDUHdr		*php = *phpp;
+    int			type = ntohl((unsigned int)php->type);
+#if defined(HAVE_LZMA_DECOMPRESSION)
+    lzma_options_lzma	options;
+    lzma_filter		filters[2];
+    compressed_t	*cp = (compressed_t *)php;
+    __pmPDUHdr		*new;
+    size_t		inpos = 0, outpos = 0, outlen;
+    int			rawlen;
+#endif
+
+    if (type < 0 || (type & PDU_COMPRESSED) == 0)
+	return 0;
+
+    /* only accepted once compression has been negotiated on this socket */
+    if (!__pmCompressIPC(fd)) {
+	pmNotifyErr(LOG_ERR, "__pmGetPDU: fd=%d compressed PDU not negotiated", fd);
+	__pmUnpinPDUBuf(php);
+	return PM_ERR_IPC;
+    }
+
+#if defined(HAVE_LZMA_DECOMPRESSION)
+    if (php->len < COMPRESSED_HDR ||
+	(rawlen = ntohl(cp->rawlen)) < (int)sizeof(__pmPDUHdr)) {
+	pmNotifyErr(LOG_ERR, "__pmGetPDU: fd=%d bad compressed PDU len=%d", fd, php->len);
+	__pmUnpinPDUBuf(php);
+	return PM_ERR_IPC;
+    }
+    if (rawlen / COMPRESS_RATIO > php->len) {
+	pmNotifyErr(LOG_ERR, "__pmGetPDU: fd=%d bad compressed PDU len=%d expands to len=%d",
+		      fd, php->len, rawlen);
+	__pmUnpinPDUBuf(php);
+	return PM_ERR_IPC;
+    }
+    if (mode == LIMIT_SIZE && rawlen > ceiling) {
+	pmNotifyErr(LOG_ERR, "__pmGetPDU: fd=%d bad compressed PDU len=%d exceeds maximum client PDU size (%d)",
+		      fd, rawlen, ceiling);
+	__pmUnpinPDUBuf(php);
+	return PM_ERR_TOOBIG;
+    }
+    if ((new = (__pmPDUHdr *)__pmFindPDUBuf(rawlen)) == NULL) {
+	__pmUnpinPDUBuf(php);
+	return -oserror();
+    }
+    outlen = rawlen - sizeof(__pmPDUHdr);
+    if (lzma_filters(outlen, &options, filters) < 0 ||
+	lzma_raw_buffer_decode(filters, NULL, (const uint8_t *)cp->data,
+			&inpos, php->len - COMPRESSED_HDR,
+			(uint8_t *)&new[1], &outpos, outlen) != LZMA_OK ||
+	outpos != outlen) {
+	pmNotifyErr(LOG_ERR, "__pmGetPDU: fd=%d corrupt compressed PDU len=%d", fd, php->len);
+	__pmUnpinPDUBuf(new);
+	__pmUnpinPDUBuf(php);
+	return PM_ERR_IPC;
+    }
+    if (pmDebugOptions.pdu)
+	fprintf(stderr, "pdu_expand: fd=%d len=%d -> %d\n", fd, php->len, rawlen);
+    new->len = rawlen;
+    new->type = htonl(type & ~PDU_COMPRESSED);
+    new->from = php->from;
+    __pmUnpinPDUBuf(php);
+    *phpp = new;
+    return 0;
+#else
+    pmNotifyErr(LOG_ERR, "__pmGetPDU: fd=%d compressed PDU not supported", fd);
+    __pmUnpinPDUBuf(php);
+    return PM_ERR_IPC;
+#endif
+}
+
+/*
+ * Send PDUs, with headers already in network byte order, in as few
+ * system calls as possible.
+ */
+static int
+pdu_send(int fd, __pmPDU **pdulist, int count)
+{
+    int			socketipc = __pmSocketIPC(fd);
+    struct iovec	iov[PDU_BATCH_MAX];
+    ssize_t		n;
+    int			i;
+
+    for (i = 0; i < count; i++) {
+	iov[i].iov_base = (void *)pdulist[i];
+	iov[i].iov_len = ntohl(((__pmPDUHdr *)pdulist[i])->len);
+    }
+    for (i = 0; i < count; ) {
+	if (socketipc)
+	    n = __pmSendv(fd, &iov[i], count - i);
+#ifdef IS_MINGW
+	else
+	    n = write(fd, iov[i].iov_base, iov[i].iov_len);
+#else
+	else
+	    n = writev(fd, &iov[i], count - i);
+#endif
+	if (n < 0)
+	    break;
+	/* skip whatever has been sent, resuming part way through a PDU */
+	while (i < count && n >= (ssize_t)iov[i].iov_len)
+	    n -= iov[i++].iov_len;
+	if (i < count) {
+	    iov[i].iov_base = (char *)iov[i].iov_base + n;
+	    iov[i].iov_len -= n;
+	}
+    }
+
+    if (i != count) {
+	if (socketipc) {
+	    if (__pmSocketClosed())
+		return PM_ERR_IPC;
+	    return neterror() ? -neterror() : PM_ERR_IPC;
+	}
+	return oserror() ? -oserror() : PM_ERR_IPC;
+    }
+    return 0;
+}
+
+static void
+pdu_sent(int fd, int type)
+{
+    __pmOverrideLastFd(fd);
+    if (type >= PDU_START && type <= PDU_FINISH)
+	__pmPDUCntOut[type-PDU_START]++;
+}
+
+/*
+ * Send any PDUs queued by this thread, whether or not the batch is
+ * finished.
+ */
+static int
+batch_send(__pmPDUBatch *bp)
+{
+    int		i, sts = 0;
+
+    if (bp->count > 0) {
+	if (pmDebugOptions.pdu)
+	    fprintf(stderr, "__pmXmitFlush: fd=%d %d PDUs\n", bp->fd, bp->count);
+	sts = pdu_send(bp->fd, bp->pdulist, bp->count);
+	for (i = 0; i < bp->count; i++) {
+	    if (sts == 0)
+		pdu_sent(bp->fd, bp->types[i]);
+	    __pmUnpinPDUBuf(bp->pdulist[i]);
+	}
+	bp->count = 0;
+    }
+    return sts;
+}
+
+/*
+ * Start queueing the PDUs that this thread sends on fd, rather than
+ * sending each one immediately, until __pmXmitFlush() is called, e.g.
+ * for a profile and the fetch that follows it.  Sending them together
+ * saves system calls and network round trips.  Errors are reported
+ * by __pmXmitFlush(), which must be called before waiting for a reply.
+ * PDU buffers must not be modified once sent, until then.
+ */
+void
+__pmXmitBatch(int fd)
+{
+    __pmPDUBatch	*bp = &PM_TPD(xmit_batch);
+
+#ifdef IS_MINGW
+    if (!__pmSocketIPC(fd))
+	return;
+#endif
+    if (bp->active && bp->fd != fd)
+	__pmXmitFlush(bp->fd);
+    bp->active = 1;
+    bp->fd = fd;
+}
+
+int
+__pmXmitFlush(int fd)
+{
+    __pmPDUBatch	*bp = &PM_TPD(xmit_batch);
+
+    if (!bp->active || bp->fd != fd)
+	return 0;
+    bp->active = 0;
+    return batch_send(bp);
+}
+
+static void
+pdu_htonhdr(__pmPDUHdr *php)
+{
+    php->len = htonl(php->len);
+    php->from = htonl(php->from);
+    php->type = htonl(php->type);
+}
+
 int
 __pmXmitPDU(int fd, __pmPDU *pdubuf)
 {
-    int		socketipc = __pmSocketIPC(fd);
-    int		off = 0;
-    int		len;
-    __pmPDUHdr	*php = (__pmPDUHdr *)pdubuf;
+    __pmPDUBatch	*bp = &PM_TPD(xmit_batch);
+    __pmPDUHdr		*php = (__pmPDUHdr *)pdubuf;
+    __pmPDU		*wire;
+    int			len, type;
+    int			sts;
 
     __pmIgnoreSignalPIPE();
 
@@ -390,39 +702,91 @@ __pmXmitPDU(int fd, __pmPDU *pdubuf)
 	putc('\n', stderr);
     }
     len = php->len;
+    type = php->type;
 
-    php->len = htonl(php->len);
-    php->from = htonl(php->from);
-    php->type = htonl(php->type);
-    while (off < len) {
-	char *p = (char *)pdubuf;
-	int n;
+    if (bp->active && bp->fd == fd) {
+	/* queue it, making room by sending the batch so far if need be */
+	if (bp->count == PDU_BATCH_MAX && (sts = batch_send(bp)) < 0)
+	    return sts;
+	if ((wire = pdu_compress(fd, php)) == NULL) {
+	    __pmPinPDUBuf(pdubuf);
+	    pdu_htonhdr(php);
+	    wire = pdubuf;
+	}
+	bp->types[bp->count] = type;
+	bp->pdulist[bp->count++] = wire;
+	return len;
+    }
 
-	p += off;
+    if ((wire = pdu_compress(fd, php)) != NULL) {
+	sts = pdu_send(fd, &wire, 1);
+	__pmUnpinPDUBuf(wire);
+    }
+    else {
+	pdu_htonhdr(php);
+	sts = pdu_send(fd, &pdubuf, 1);
+	php->len = ntohl(php->len);
+	php->from = ntohl(php->from);
+	php->type = ntohl(php->type);
+    }
+    if (sts < 0)
+	return sts;
 
-	n = socketipc ? __pmSend(fd, p, len-off, 0) : write(fd, p, len-off);
-	if (n < 0)
-	    break;
-	off += n;
+    pdu_sent(fd, type);
+    return len;
+}
+
+/*
+ * Final checks and conversion of a completely received PDU header, with
+ * the length already in host byte order - returns the PDU type, else an
+ * error after unpinning the PDU buffer.
+ */
+static int
+pdu_received(int fd, __pmPDUHdr *php)
+{
+    php->type = ntohl((unsigned int)php->type);
+    if (php->type < 0) {
+	/*
+	 * PDU type is bad ... could be a possible mem leak attack like
+	 * https://bugzilla.redhat.com/show_bug.cgi?id=841319
+	 */
+	pmNotifyErr(LOG_ERR, "__pmGetPDU: fd=%d illegal PDU type=%d in hdr", fd, php->type);
+	__pmUnpinPDUBuf(php);
+	return PM_ERR_IPC;
     }
-    php->len = ntohl(php->len);
-    php->from = ntohl(php->from);
-    php->type = ntohl(php->type);
+    php->from = ntohl((unsigned int)php->from);
+    if (pmDebugOptions.pdu) {
+	int	j;
+	char	*p;
+	int	jend = PM_PDU_SIZE(php->len);
+	char	strbuf[20];
+	__pmPDU	*pdubuf = (__pmPDU *)php;
 
-    if (off != len) {
-	if (socketipc) {
-	    if (__pmSocketClosed())
-		return PM_ERR_IPC;
-	    return neterror() ? -neterror() : PM_ERR_IPC;
+        /* clear the padding bytes, lest they contain garbage */
+	p = (char *)php + php->len;
+	while (p < (char *)php + jend*sizeof(__pmPDU))
+	    *p++ = '~';	/* buffer end */
+
+	if (mypid == -1)
+	    mypid = (int)getpid();
+	fprintf(stderr, "[%d]pmGetPDU: %s fd=%d len=%d from=%d",
+		mypid, __pmPDUTypeStr_r(php->type, strbuf, sizeof(strbuf)), fd, php->len, php->from);
+	for (j = 0; j < jend; j++) {
+	    if ((j % 8) == 0)
+		fprintf(stderr, "\n%03d: ", j);
+	    fprintf(stderr, "%8x ", pdubuf[j]);
 	}
-	return oserror() ? -oserror() : PM_ERR_IPC;
+	putc('\n', stderr);
     }
-
-    __pmOverrideLastFd(fd);
     if (php->type >= PDU_START && php->type <= PDU_FINISH)
-	__pmPDUCntOut[php->type-PDU_START]++;
+	__pmPDUCntIn[php->type-PDU_START]++;
 
-    return off;
+    /*
+     * Note php points into the PDU buffer pdubuf that remains pinned
+     * and php is returned via the result parameter ... see the
+     * thread-safe comments above
+     */
+    return php->type;
 }
 
 /* result is pinned on successful return */
@@ -566,49 +930,128 @@ check_read_len:
 	}
     }
 
+    if ((len = pdu_expand(fd, mode, &php)) < 0)
+	return len;
     *result = (__pmPDU *)php;
-    php->type = ntohl((unsigned int)php->type);
-    if (php->type < 0) {
-	/*
-	 * PDU type is bad ... could be a possible mem leak attack like
-	 * https://bugzilla.redhat.com/show_bug.cgi?id=841319
-	 */
-	pmNotifyErr(LOG_ERR, "__pmGetPDU: fd=%d illegal PDU type=%d in hdr", fd, php->type);
-	__pmUnpinPDUBuf(pdubuf);
-	return PM_ERR_IPC;
-    }
-    php->from = ntohl((unsigned int)php->from);
-    if (pmDebugOptions.pdu) {
-	int	j;
-	char	*p;
-	int	jend = PM_PDU_SIZE(php->len);
-	char	strbuf[20];
+    return pdu_received(fd, php);
+}
 
-        /* clear the padding bytes, lest they contain garbage */
-	p = (char *)*result + php->len;
-	while (p < (char *)*result + jend*sizeof(__pmPDU))
-	    *p++ = '~';	/* buffer end */
+/*
+ * Resumable variant of __pmGetPDU() for event-driven callers, reading
+ * only the data available now and saving any partial PDU in the given
+ * state for the next call, rather than waiting for the rest of it.
+ * Returns the PDU type (result pinned) once a whole PDU has arrived,
+ * -EAGAIN if it has not (yet), zero at end-of-file before any of the
+ * next PDU, else an error.  In all but the -EAGAIN case the partial
+ * state is reset, ready for the next PDU.
+ */
+int
+__pmGetPDUPartial(int fd, int mode, __pmPDUPartial *pp, __pmPDU **result)
+{
+    struct timeval	nowait = { 0, 0 };
+    __pmPDUHdr		*php;
+    __pmPDU		*pdubuf;
+    int			socketipc = __pmSocketIPC(fd);
+    int			need, sts;
 
-	if (mypid == -1)
-	    mypid = (int)getpid();
-	fprintf(stderr, "[%d]pmGetPDU: %s fd=%d len=%d from=%d",
-		mypid, __pmPDUTypeStr_r(php->type, strbuf, sizeof(strbuf)), fd, php->len, php->from);
-	for (j = 0; j < jend; j++) {
-	    if ((j % 8) == 0)
-		fprintf(stderr, "\n%03d: ", j);
-	    fprintf(stderr, "%8x ", (*result)[j]);
+    for ( ; ; ) {
+	if (pp->pdubuf == NULL) {
+	    if ((pp->pdubuf = __pmFindPDUBuf(PDU_CHUNK)) == NULL)
+		return -oserror();
+	    pp->size = PDU_CHUNK;
+	    pp->have = 0;
 	}
-	putc('\n', stderr);
+	php = (__pmPDUHdr *)pp->pdubuf;
+
+	/* length is in network byte order until the whole PDU is here */
+	if (pp->have < (int)sizeof(__pmPDUHdr))
+	    need = sizeof(__pmPDUHdr);
+	else if ((need = ntohl(php->len)) < (int)sizeof(__pmPDUHdr)) {
+	    pmNotifyErr(LOG_ERR, "__pmGetPDU: fd=%d illegal PDU len=%d in hdr", fd, need);
+	    sts = PM_ERR_IPC;
+	    goto fail;
+	}
+	else if (mode == LIMIT_SIZE && need > ceiling) {
+	    pmNotifyErr(LOG_ERR, "__pmGetPDU: fd=%d bad PDU len=%d in hdr exceeds maximum client PDU size (%d)",
+			fd, need, ceiling);
+	    sts = PM_ERR_TOOBIG;
+	    goto fail;
+	}
+	if (pp->have == need)
+	    break;
+	if (need > pp->size) {
+	    int		size = PDU_CHUNK * (1 + need / PDU_CHUNK);
+
+	    if ((pdubuf = __pmFindPDUBuf(size)) == NULL) {
+		sts = -oserror();
+		goto fail;
+	    }
+	    memcpy((void *)pdubuf, (void *)pp->pdubuf, pp->have);
+	    __pmUnpinPDUBuf(pp->pdubuf);
+	    pp->pdubuf = pdubuf;
+	    pp->size = size;
+	    continue;
+	}
+
+	if ((sts = __pmSocketReady(fd, &nowait)) == 0)
+	    return -EAGAIN;
+	if (sts > 0) {
+	    if (socketipc) {
+		sts = __pmRecv(fd, (char *)pp->pdubuf + pp->have, need - pp->have, 0);
+		setoserror(neterror());
+	    } else {
+		sts = read(fd, (char *)pp->pdubuf + pp->have, need - pp->have);
+	    }
+	    __pmOverrideLastFd(fd);
+	}
+	if (sts < 0) {
+	    if (oserror() == EINTR)
+		continue;
+	    if (oserror() == EAGAIN || oserror() == EWOULDBLOCK)
+		return -EAGAIN;
+	    sts = -oserror();
+	    if (!__pmSocketClosed()) {
+		char	errmsg[PM_MAXERRMSGLEN];
+		pmNotifyErr(LOG_ERR, "__pmGetPDU: fd=%d read: %s", fd,
+			pmErrStr_r(sts, errmsg, sizeof(errmsg)));
+	    }
+	    sts = PM_ERR_IPC;
+	    goto fail;
+	}
+	if (sts == 0) {
+	    /* end of file, with or without a partial PDU */
+	    if (pp->have > 0)
+		pmNotifyErr(LOG_ERR, "__pmGetPDU: fd=%d data read: have %d, want %d, got EOF",
+			fd, pp->have, need);
+	    sts = pp->have > 0 ? PM_ERR_IPC : 0;
+	    goto fail;
+	}
+	pp->have += sts;
+	if (pmDebugOptions.pdu && pmDebugOptions.desperate)
+	    fprintf(stderr, "__pmGetPDUPartial(%d, ...): have %d, last read %d, still need %d\n",
+		fd, pp->have, sts, need - pp->have);
     }
-    if (php->type >= PDU_START && php->type <= PDU_FINISH)
-	__pmPDUCntIn[php->type-PDU_START]++;
 
-    /*
-     * Note php points into the PDU buffer pdubuf that remains pinned
-     * and php is returned via the result parameter ... see the
-     * thread-safe comments above
-     */
-    return php->type;
+    pp->pdubuf = NULL;
+    pp->have = 0;
+    php->len = ntohl(php->len);
+    if ((sts = pdu_expand(fd, mode, &php)) < 0)
+	return sts;
+    *result = (__pmPDU *)php;
+    return pdu_received(fd, php);
+
+fail:
+    __pmFreePDUPartial(pp);
+    return sts;
+}
+
+void
+__pmFreePDUPartial(__pmPDUPartial *pp)
+{
+    if (pp->pdubuf != NULL)
+	__pmUnpinPDUBuf(pp->pdubuf);
+    pp->pdubuf = NULL;
+    pp->size = pp->have = 0;
 }
 
 int
@@ -1,5 +1,5 @@
 /*
- * Copyright (c) 2012-2015 Red Hat.
+ * Copyright (c) 2012-2015,2019 Red Hat.
  * Copyright (c) 1995-2001 Silicon Graphics, Inc.  All Rights Reserved.
  * 
  * This library is free software; you can redistribute it and/or modify it
@@ -923,6 +923,9 @@ pass2(int dupok)
     main_pmns->htab = NULL;
     main_pmns->htabsize = 0;
     main_pmns->mark_state = UNKNOWN_MARK_STATE;
+    main_pmns->image = NULL;
+    main_pmns->imagelen = 0;
+    main_pmns->nodes = NULL;
 
     /* Get the root subtree out of the seen list */
     if ((main_pmns->root = findseen("root")) == NULL) {
@@ -1039,6 +1042,9 @@ __pmNewPMNS(__pmnsTree **pmns)
     t->htab = NULL;
     t->htabsize = 0;
     t->mark_state = UNKNOWN_MARK_STATE;
+    t->image = NULL;
+    t->imagelen = 0;
+    t->nodes = NULL;
 
     *pmns = t;
     return 0;
@@ -1460,6 +1466,375 @@ pmapi_return:
     return sts;
 }
 
+/*
+ * Compiled PMNS image support.
+ *
+ * pmnscomp(1) writes the tree loaded from an ASCII PMNS file to an image
+ * file of the same name with ".bin" appended, which load() then maps
+ * read-only in preference to parsing the ASCII file, provided the image
+ * records the same size and modification time as the ASCII file (else
+ * the image is stale and ignored).  Nodes refer to each other by index
+ * and to names by offset into a string table, so the image is position
+ * independent; names are used directly from the (shared) mapped image
+ * and only the node pointers are rebuilt when it is loaded.
+ *
+ * The image is in host byte order, and is ignored by a host with a
+ * different byte order.
+ */
+#define IMAGE_MAGIC	"PCPPMNS"
+#define IMAGE_VERSION	1
+#define IMAGE_ORDER	0x01020304
+#define IMAGE_DUPS	0x1		/* more than one name for some PMIDs */
+#define IMAGE_NONE	0xffffffff	/* no node */
+
+typedef struct {
+    char	magic[8];	/* IMAGE_MAGIC */
+    __uint32_t	version;	/* IMAGE_VERSION */
+    __uint32_t	order;		/* IMAGE_ORDER, in writer's byte order */
+    __uint32_t	flags;		/* IMAGE_DUPS */
+    __uint32_t	nnodes;		/* node table entries, root is first */
+    __uint32_t	htabsize;	/* pmid hash table entries */
+    __uint32_t	strsize;	/* string table bytes */
+    __int64_t	size;		/* ASCII PMNS file size ... */
+    __int64_t	sec;		/* ... and modification time */
+    __int64_t	nsec;
+} image_hdr_t;
+
+typedef struct {
+    __uint32_t	parent;		/* node indices, or IMAGE_NONE */
+    __uint32_t	next;
+    __uint32_t	first;
+    __uint32_t	hash;
+    __uint32_t	name;		/* string table offset */
+    __uint32_t	pmid;
+} image_node_t;
+
+typedef struct {
+    __pmnsNode	*np;
+    __uint32_t	index;
+} image_map_t;
+
+static void
+image_mtime(const struct stat *sbuf, __int64_t *sec, __int64_t *nsec)
+{
+#if defined(HAVE_ST_MTIME_WITH_E)
+    *sec = sbuf->st_mtime;
+    *nsec = 0;
+#elif defined(HAVE_ST_MTIME_WITH_SPEC)
+    *sec = sbuf->st_mtimespec.tv_sec;
+    *nsec = sbuf->st_mtimespec.tv_nsec;
+#else
+    *sec = sbuf->st_mtim.tv_sec;
+    *nsec = sbuf->st_mtim.tv_nsec;
+#endif
+}
+
+static int
+image_mapcmp(const void *a, const void *b)
+{
+    const __pmnsNode	*na = ((const image_map_t *)a)->np;
+    const __pmnsNode	*nb = ((const image_map_t *)b)->np;
+
+    return na < nb ? -1 : na > nb;
+}
+
+/* node table index for np, using map sorted on node address */
+static __uint32_t
+image_index(__pmnsNode *np, image_map_t *map, int nnodes)
+{
+    image_map_t	key, *mp;
+
+    if (np == NULL)
+	return IMAGE_NONE;
+    key.np = np;
+    mp = bsearch(&key, map, nnodes, sizeof(*map), image_mapcmp);
+    return mp == NULL ? IMAGE_NONE : mp->index;
+}
+
+/*
+ * Write the compiled form of tree, as loaded from the ASCII PMNS file
+ * source, to the file image.  This is written to a temporary file and
+ * renamed into place, so no process ever maps a partial image.
+ */
+int
+__pmWritePMNSImage(__pmnsTree *tree, const char *source, const char *image)
+{
+    image_hdr_t		hdr;
+    image_node_t	*table = NULL;
+    image_map_t		*map = NULL;
+    __pmnsNode		**nodelist = NULL;
+    __pmnsNode		*np, *xp;
+    __uint32_t		*htab = NULL;
+    struct stat		sbuf;
+    char		tmpname[MAXPATHLEN];
+    FILE		*f = NULL;
+    int			nnodes = 0, maxnodes = 0;
+    int			i, sts = 0;
+
+    if (tree == NULL || tree->root == NULL)
+	return PM_ERR_NOPMNS;
+    if (stat(source, &sbuf) < 0)
+	return -oserror();
+
+    memset(&hdr, 0, sizeof(hdr));
+    memcpy(hdr.magic, IMAGE_MAGIC, sizeof(IMAGE_MAGIC));
+    hdr.version = IMAGE_VERSION;
+    hdr.order = IMAGE_ORDER;
+    hdr.htabsize = tree->htabsize;
+    hdr.size = sbuf.st_size;
+    image_mtime(&sbuf, &hdr.sec, &hdr.nsec);
+
+    /*
+     * Breadth first, so the root is the first node and the children
+     * of each node are adjacent in the node table.
+     */
+    for (i = -1; i < nnodes; i++) {
+	np = (i < 0) ? tree->root : nodelist[i]->first;
+	for ( ; np != NULL; np = (i < 0) ? NULL : np->next) {
+	    if (nnodes == maxnodes) {
+		__pmnsNode	**tmp_list;
+
+		maxnodes = maxnodes ? maxnodes * 2 : 1024;
+		tmp_list = (__pmnsNode **)realloc(nodelist, maxnodes * sizeof(*nodelist));
+		if (tmp_list == NULL) {
+		    sts = -oserror();
+		    goto done;
+		}
+		nodelist = tmp_list;
+	    }
+	    nodelist[nnodes++] = np;
+	}
+    }
+    hdr.nnodes = nnodes;
+
+    if ((map = (image_map_t *)malloc(nnodes * sizeof(*map))) == NULL ||
+	(table = (image_node_t *)malloc(nnodes * sizeof(*table))) == NULL ||
+	(htab = (__uint32_t *)malloc((hdr.htabsize + 1) * sizeof(*htab))) == NULL) {
+	sts = -oserror();
+	goto done;
+    }
+    for (i = 0; i < nnodes; i++) {
+	map[i].np = nodelist[i];
+	map[i].index = i;
+    }
+    qsort(map, nnodes, sizeof(*map), image_mapcmp);
+
+    for (i = 0; i < nnodes; i++) {
+	np = nodelist[i];
+	table[i].parent = image_index(np->parent, map, nnodes);
+	table[i].next = image_index(np->next, map, nnodes);
+	table[i].first = image_index(np->first, map, nnodes);
+	table[i].hash = image_index(np->hash, map, nnodes);
+	table[i].name = hdr.strsize;
+	table[i].pmid = np->pmid;
+	hdr.strsize += strlen(np->name) + 1;
+    }
+    table[0].parent = table[0].next = IMAGE_NONE;
+    for (i = 0; i < tree->htabsize; i++) {
+	htab[i] = image_index(tree->htab[i], map, nnodes);
+	for (np = tree->htab[i]; np != NULL; np = np->hash) {
+	    for (xp = np->hash; xp != NULL; xp = xp->hash) {
+		if (xp->pmid == np->pmid)
+		    hdr.flags |= IMAGE_DUPS;
+	    }
+	}
+    }
+
+    pmsprintf(tmpname, sizeof(tmpname), "%s.%" FMT_PID, image, (pid_t)getpid());
+    if ((f = fopen(tmpname, "w")) == NULL) {
+	sts = -oserror();
+	goto done;
+    }
+    if (fwrite(&hdr, sizeof(hdr), 1, f) != 1 ||
+	fwrite(table, sizeof(*table), nnodes, f) != nnodes ||
+	fwrite(htab, sizeof(*htab), hdr.htabsize, f) != hdr.htabsize) {
+	sts = -oserror();
+	goto done;
+    }
+    for (i = 0; i < nnodes; i++) {
+	if (fwrite(nodelist[i]->name, strlen(nodelist[i]->name) + 1, 1, f) != 1) {
+	    sts = -oserror();
+	    goto done;
+	}
+    }
+    if (fclose(f) != 0) {
+	f = NULL;
+	sts = -oserror();
+	goto done;
+    }
+    f = NULL;
+    /* readable by whoever can read the ASCII PMNS */
+    chmod(tmpname, sbuf.st_mode & ~S_IFMT);
+    if (rename(tmpname, image) < 0) {
+	sts = -oserror();
+	goto done;
+    }
+    if (pmDebugOptions.pmns)
+	fprintf(stderr, "__pmWritePMNSImage(%s): %d nodes, %u string bytes -> %s\n",
+		source, nnodes, hdr.strsize, image);
+
+done:
+    if (f != NULL)
+	fclose(f);
+    if (sts < 0)
+	unlink(tmpname);
+    free(nodelist);
+    free(map);
+    free(table);
+    free(htab);
+    return sts;
+}
+
+/*
+ * Try to load main_pmns from the compiled image for the ASCII PMNS
+ * file fname, returning 0 on success, else < 0 and the caller should
+ * load the ASCII PMNS instead.
+ */
+static int
+loadimage(int dupok)
+{
+    const image_hdr_t	*hdr;
+    const image_node_t	*table;
+    const __uint32_t	*htab;
+    const char		*strings;
+    __pmnsTree		*tree = NULL;
+    __pmnsNode		*nodes = NULL;
+    __pmnsNode		*np;
+    struct stat		sbuf;
+    __int64_t		sec, nsec;
+    char		image[MAXPATHLEN];
+    char		*addr = NULL;
+    size_t		len = 0;
+    __uint32_t		i, n;
+    int			fd, sts;
+
+    PM_ASSERT_IS_LOCKED(pmns_lock);
+
+    if (stat(fname, &sbuf) < 0)
+	return -oserror();
+    image_mtime(&sbuf, &sec, &nsec);
+
+    pmsprintf(image, sizeof(image), "%s.bin", fname);
+    if ((fd = open(image, O_RDONLY)) < 0)
+	return -oserror();
+    if (fstat(fd, &sbuf) < 0) {
+	sts = -oserror();
+	close(fd);
+	return sts;
+    }
+    len = sbuf.st_size;
+    addr = (len == 0) ? NULL : (char *)__pmMemoryMap(fd, len, 0);
+    close(fd);
+    if (addr == NULL)
+	return len == 0 ? PM_ERR_PMNS : -oserror();
+
+    sts = PM_ERR_PMNS;
+    hdr = (const image_hdr_t *)addr;
+    if (len < sizeof(*hdr) ||
+	memcmp(hdr->magic, IMAGE_MAGIC, sizeof(IMAGE_MAGIC)) != 0 ||
+	hdr->version != IMAGE_VERSION || hdr->order != IMAGE_ORDER ||
+	hdr->nnodes == 0 || hdr->strsize == 0 || hdr->htabsize == 0 ||
+	hdr->nnodes > len / sizeof(image_node_t) ||
+	hdr->htabsize > len / sizeof(__uint32_t) ||
+	len != sizeof(*hdr) + (size_t)hdr->nnodes * sizeof(image_node_t) +
+		(size_t)hdr->htabsize * sizeof(__uint32_t) + hdr->strsize) {
+	if (pmDebugOptions.pmns)
+	    fprintf(stderr, "loadimage: %s: not a compiled PMNS\n", image);
+	goto fail;
+    }
+    if (hdr->size != (__int64_t)last_size || hdr->sec != sec || hdr->nsec != nsec) {
+	if (pmDebugOptions.pmns)
+	    fprintf(stderr, "loadimage: %s: stale, %s has changed\n", image, fname);
+	goto fail;
+    }
+    if ((hdr->flags & IMAGE_DUPS) && !dupok) {
+	if (pmDebugOptions.pmns)
+	    fprintf(stderr, "loadimage: %s: has duplicate PMIDs\n", image);
+	goto fail;
+    }
+
+    table = (const image_node_t *)&hdr[1];
+    htab = (const __uint32_t *)&table[hdr->nnodes];
+    strings = (const char *)&htab[hdr->htabsize];
+    if (strings[hdr->strsize - 1] != '\0')
+	goto fail;
+
+    if ((tree = (__pmnsTree *)malloc(sizeof(*tree))) == NULL ||
+	(nodes = (__pmnsNode *)malloc(hdr->nnodes * sizeof(*nodes))) == NULL ||
+	(tree->htab = (__pmnsNode **)calloc(hdr->htabsize + 1, sizeof(__pmnsNode *))) == NULL) {
+	sts = -oserror();
+	free(nodes);
+	free(tree);
+	goto fail;
+    }
+
+    /*
+     * Nodes are stored breadth-first from the root, so parents precede
+     * their children and each node precedes its next sibling - holding
+     * the image to this ordering ensures the tree has no cycles.
+     */
+#define IMAGE_NODE(x)	((x) == IMAGE_NONE ? NULL : &nodes[(x)])
+    for (i = 0; i < hdr->nnodes; i++) {
+	const image_node_t	*ip = &table[i];
+
+	if ((i == 0 && (ip->parent != IMAGE_NONE || ip->next != IMAGE_NONE)) ||
+	    (i > 0 && ip->parent >= i) ||
+	    (ip->next != IMAGE_NONE && (ip->next <= i || ip->next >= hdr->nnodes)) ||
+	    (ip->first != IMAGE_NONE && (ip->first <= i || ip->first >= hdr->nnodes)) ||
+	    (ip->hash != IMAGE_NONE && ip->hash >= hdr->nnodes) ||
+	    ip->name >= hdr->strsize) {
+	    free(tree->htab);
+	    free(tree);
+	    free(nodes);
+	    goto fail;
+	}
+	np = &nodes[i];
+	np->parent = IMAGE_NODE(ip->parent);
+	np->next = IMAGE_NODE(ip->next);
+	np->first = IMAGE_NODE(ip->first);
+	np->hash = IMAGE_NODE(ip->hash);
+	/* read-only, but nothing modifies names in the main PMNS */
+	np->name = (char *)&strings[ip->name];
+	np->pmid = ip->pmid;
+    }
+    /* each node is on at most one hash chain, so chains are short */
+    for (i = 0, n = 0; i < hdr->htabsize; i++) {
+	if (htab[i] != IMAGE_NONE && htab[i] >= hdr->nnodes) {
+	    free(tree->htab);
+	    free(tree);
+	    free(nodes);
+	    goto fail;
+	}
+	tree->htab[i] = IMAGE_NODE(htab[i]);
+	for (np = tree->htab[i]; np != NULL && n <= hdr->nnodes; np = np->hash)
+	    n++;
+	if (n > hdr->nnodes) {
+	    free(tree->htab);
+	    free(tree);
+	    free(nodes);
+	    goto fail;
+	}
+    }
+#undef IMAGE_NODE
+
+    tree->root = &nodes[0];
+    tree->htabsize = hdr->htabsize;
+    tree->mark_state = UNKNOWN_MARK_STATE;
+    tree->image = addr;
+    tree->imagelen = len;
+    tree->nodes = nodes;
+    main_pmns = tree;
+
+    if (pmDebugOptions.pmns)
+	fprintf(stderr, "Loaded compiled PMNS %s (%u nodes)\n", image, hdr->nnodes);
+    return 0;
+
+fail:
+    if (addr != NULL)
+	__pmMemoryUnmap(addr, len);
+    return sts;
+}
+
 static int
 load(const char *filename, int dupok, int use_cpp)
 {
@@ -1517,6 +1892,13 @@ load(const char *filename, int dupok, int use_cpp)
     if (use_cpp == USE_CPP && filename == PM_NS_DEFAULT)
 	use_cpp = NO_CPP;
 
+    /*
+     * use the compiled image if there is a current one, unless the
+     * ASCII PMNS may need pre-processing
+     */
+    if (use_cpp == NO_CPP && loadimage(dupok) == 0)
+	return 0;
+
     /*
      * load ASCII PMNS
      */
@@ -1582,7 +1964,8 @@ locate(const char *name, __pmnsNode *root)
  */
 
 /*
- * As of PCP 3.6, there is _only_ the ASCII version of the PMNS.
+ * As of PCP 3.6, there is _only_ the ASCII version of the PMNS, although
+ * a compiled image of it is used if pmnscomp(1) has created one.
  * As of PCP 3.10.3, the default is to allow duplicates in the PMNS.
  */
 int
@@ -1651,7 +2034,13 @@ __pmFreePMNS(__pmnsTree *pmns)
 {
     if (pmns != NULL) {
 	free(pmns->htab);
-	FreeTraversePMNS(pmns->root);
+	if (pmns->image != NULL) {
+	    /* nodes allocated together, names in the mapped image */
+	    free(pmns->nodes);
+	    __pmMemoryUnmap(pmns->image, pmns->imagelen);
+	}
+	else
+	    FreeTraversePMNS(pmns->root);
 	free(pmns);
     }
 }
@@ -1867,8 +2256,10 @@ pmLookupName_ctx(__pmContext *ctxp, int derive_locked, int numpmid, char *nameli
 		fprintf(stderr, " [%d] %s", i, namelist[i]);
 	    fputc('\n', stderr);
 	}
-	sts = __pmSendNameList(ctxp->c_pmcd->pc_fd, __pmPtrToHandle(ctxp),
-		numpmid, namelist, NULL);
+	PM_LOCK(ctxp->c_pmcd->pc_lock);
+	if ((sts = __pmAsyncBusy(ctxp)) >= 0)
+	    sts = __pmSendNameList(ctxp->c_pmcd->pc_fd, __pmPtrToHandle(ctxp),
+		    numpmid, namelist, NULL);
 	if (sts < 0)
 	    sts = __pmMapErrno(sts);
 	else {
@@ -1912,6 +2303,7 @@ PM_FAULT_POINT("libpcp/" __FILE__ ":1", PM_FAULT_TIMEOUT);
 		fprintf(stderr, " %s\n", pmErrStr_r(sts, errmsg, sizeof(errmsg)));
 	    }
 	}
+	PM_UNLOCK(ctxp->c_pmcd->pc_lock);
     }
 
     /*
@@ -2009,8 +2401,10 @@ GetChildrenStatusRemote(__pmContext *ctxp, const char *name,
 {
     int n;
 
-    n = __pmSendChildReq(ctxp->c_pmcd->pc_fd, __pmPtrToHandle(ctxp),
-		name, statuslist == NULL ? 0 : 1);
+    PM_LOCK(ctxp->c_pmcd->pc_lock);
+    if ((n = __pmAsyncBusy(ctxp)) >= 0)
+	n = __pmSendChildReq(ctxp->c_pmcd->pc_fd, __pmPtrToHandle(ctxp),
+		    name, statuslist == NULL ? 0 : 1);
     if (n < 0)
 	n =  __pmMapErrno(n);
     else {
@@ -2034,6 +2428,7 @@ PM_FAULT_POINT("libpcp/" __FILE__ ":2", PM_FAULT_TIMEOUT);
 	if (pinpdu > 0)
 	    __pmUnpinPDUBuf(pb);
     }
+    PM_UNLOCK(ctxp->c_pmcd->pc_lock);
 
     return n;
 }
@@ -2450,6 +2845,8 @@ request_namebypmid(__pmContext *ctxp, pmID pmid)
 {
     int n;
 
+    if ((n = __pmAsyncBusy(ctxp)) < 0)
+	return n;
     n = __pmSendIDList(ctxp->c_pmcd->pc_fd, __pmPtrToHandle(ctxp), 1, &pmid, 0);
     if (n < 0)
 	n = __pmMapErrno(n);
@@ -2596,9 +2993,11 @@ pmNameID(pmID pmid, char **name)
     else {
 	/* assume PMNS_REMOTE */
 	assert(c_type == PM_CONTEXT_HOST);
+	PM_LOCK(ctxp->c_pmcd->pc_lock);
 	if ((sts = request_namebypmid(ctxp, pmid)) >= 0) {
 	    sts = receive_a_name(ctxp, name);
 	}
+	PM_UNLOCK(ctxp->c_pmcd->pc_lock);
     }
 
     if (sts >= 0)
@@ -2766,9 +3165,11 @@ pmNameAll_ctx(__pmContext *ctxp, pmID pmid, char ***namelist)
     else {
 	/* assume PMNS_REMOTE */
 	assert(c_type == PM_CONTEXT_HOST);
+	PM_LOCK(ctxp->c_pmcd->pc_lock);
 	if ((sts = request_namebypmid (ctxp, pmid)) >= 0) {
 	    sts = receive_namesbyid (ctxp, namelist);
 	}
+	PM_UNLOCK(ctxp->c_pmcd->pc_lock);
 	if (sts > 0)
 	    goto pmapi_return;
     }
@@ -2971,8 +3372,11 @@ TraversePMNS(const char *name, void(*func)(const char *), void(*func_r)(const ch
 	    sts = PM_ERR_NOCONTEXT;
 	    goto pmapi_return;
 	}
-	sts = __pmSendTraversePMNSReq(ctxp->c_pmcd->pc_fd, __pmPtrToHandle(ctxp), name);
+	PM_LOCK(ctxp->c_pmcd->pc_lock);
+	if ((sts = __pmAsyncBusy(ctxp)) >= 0)
+	    sts = __pmSendTraversePMNSReq(ctxp->c_pmcd->pc_fd, __pmPtrToHandle(ctxp), name);
 	if (sts < 0) {
+	    PM_UNLOCK(ctxp->c_pmcd->pc_lock);
 	    sts = __pmMapErrno(sts);
 	    goto pmapi_return;
 	}
@@ -2985,6 +3389,7 @@ TraversePMNS(const char *name, void(*func)(const char *), void(*func_r)(const ch
 PM_FAULT_POINT("libpcp/" __FILE__ ":4", PM_FAULT_TIMEOUT);
 	    pinpdu = sts = __pmGetPDU(ctxp->c_pmcd->pc_fd, ANY_SIZE, 
 				      TIMEOUT_DEFAULT, &pb);
+	    PM_UNLOCK(ctxp->c_pmcd->pc_lock);
 
 	    /*
 	     * It is important that we don't hold the context lock before
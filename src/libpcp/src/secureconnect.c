@@ -1,5 +1,5 @@
 /*
- * Copyright (c) 2012-2015 Red Hat.
+ * Copyright (c) 2012-2015,2019 Red Hat.
  * Security and Authentication (NSS and SASL) support.  Client side.
  * 
  * This library is free software; you can redistribute it and/or modify it
@@ -24,6 +24,7 @@
 #include <sslerr.h>
 #include <pk11pub.h>
 #include <sys/stat.h>
+#include <sys/uio.h>
 #ifdef HAVE_SYS_TERMIOS_H
 #include <sys/termios.h>
 #endif
@@ -1563,6 +1564,29 @@ __pmSend(int fd, const void *buffer, size_t length, int flags)
     return send(fd, buffer, length, flags);
 }
 
+ssize_t
+__pmSendv(int fd, const struct iovec *iov, int count)
+{
+    __pmSecureSocket socket;
+    ssize_t	size, total = 0;
+    int		i;
+
+    if (__pmDataIPC(fd, &socket) == 0 && socket.nsprFd) {
+	for (i = 0; i < count; i++) {
+	    size = PR_Write(socket.nsprFd, iov[i].iov_base, iov[i].iov_len);
+	    if (size < 0) {
+		__pmSecureSocketsError(PR_GetError());
+		return total ? total : size;
+	    }
+	    total += size;
+	    if (size < iov[i].iov_len)
+		break;
+	}
+	return total;
+    }
+    return writev(fd, iov, count);
+}
+
 ssize_t
 __pmRecv(int fd, void *buffer, size_t length, int flags)
 {
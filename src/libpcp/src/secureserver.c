@@ -1,5 +1,5 @@
 /*
- * Copyright (c) 2012-2015 Red Hat.
+ * Copyright (c) 2012-2015,2019 Red Hat.
  *
  * Server side security features - via Network Security Services (NSS) and
  * the Simple Authentication and Security Layer (SASL).
@@ -757,7 +757,7 @@ __pmSecureServerHandshake(int fd, int flags, __pmHashCtl *attrs)
     /* protect from unsupported requests from future/oddball clients */
     if (flags & ~(PDU_FLAG_SECURE | PDU_FLAG_SECURE_ACK | PDU_FLAG_COMPRESS |
 		  PDU_FLAG_AUTH | PDU_FLAG_CREDS_REQD | PDU_FLAG_CONTAINER |
-		  PDU_FLAG_CERT_REQD))
+		  PDU_FLAG_CERT_REQD | PDU_FLAG_LZMA))
 	return PM_ERR_IPC;
 
     if (flags & PDU_FLAG_CREDS_REQD) {
@@ -1,5 +1,5 @@
 /*
- * Copyright (c) 2013-2015 Red Hat.
+ * Copyright (c) 2013-2015,2019 Red Hat.
  * Copyright (c) 2007 Aconex.  All Rights Reserved.
  * Copyright (c) 1995-2002 Silicon Graphics, Inc.  All Rights Reserved.
  * 
@@ -817,8 +817,11 @@ __pmLookupAttrKey(const char *attribute, size_t size)
 	strncmp(attribute, "container", size) == 0)
 	return PCP_ATTR_CONTAINER;
     if (size == sizeof("exclusive") &&
-	strncmp(attribute, "exclusive", size) == 0)	/* deprecated */
+	strncmp(attribute, "exclusive", size) == 0)
 	return PCP_ATTR_EXCLUSIVE;
+    if (size == sizeof("shared") &&
+	strncmp(attribute, "shared", size) == 0)
+	return PCP_ATTR_SHARED;
     return PCP_ATTR_NONE;
 }
 
@@ -992,7 +995,9 @@ __pmAttrKeyStr_r(__pmAttrKey key, char *string, size_t size)
     case PCP_ATTR_CONTAINER:
 	return pmsprintf(string, size, "container");
     case PCP_ATTR_EXCLUSIVE:
-	return pmsprintf(string, size, "exclusive");	/* deprecated */
+	return pmsprintf(string, size, "exclusive");
+    case PCP_ATTR_SHARED:
+	return pmsprintf(string, size, "shared");
     case PCP_ATTR_NONE:
     default:
 	break;
@@ -1026,7 +1031,8 @@ __pmAttrStr_r(__pmAttrKey key, const char *data, char *string, size_t size)
     case PCP_ATTR_LOCAL:
     case PCP_ATTR_COMPRESS:
     case PCP_ATTR_USERAUTH:
-    case PCP_ATTR_EXCLUSIVE:	/* deprecated */
+    case PCP_ATTR_EXCLUSIVE:
+    case PCP_ATTR_SHARED:
 	return pmsprintf(string, size, "%s", name);
 
     case PCP_ATTR_NONE:
@@ -1,5 +1,5 @@
 /*
- * Copyright (c) 2013,2015-2017 Red Hat.
+ * Copyright (c) 2013,2015-2017,2019 Red Hat.
  * Copyright (c) 2005 Silicon Graphics, Inc.  All Rights Reserved.
  * 
  * This library is free software; you can redistribute it and/or modify it
@@ -36,12 +36,21 @@ typedef struct entry {
     int			state;
     void		*private;
     time_t		stamp;
+    int			saved;		/* in the snapshot or journal file */
 } entry_t;
 
 #define CACHE_VERSION1	1
 #define CACHE_VERSION2	2
 #define CACHE_VERSION	CACHE_VERSION2	/* version of external file format */
 #define MAX_HASH_TRY	10
+#define MAX_HASH_SIZE	65536		/* largest inst and name hash tables */
+
+/*
+ * Caches with at least this many entries are saved incrementally, by
+ * appending changes to a journal file alongside the snapshot file.
+ */
+#define JOURNAL_MIN	1024
+#define JOURNAL_SUFFIX	".journal"
 
 /*
  * linked list of cache headers
@@ -61,6 +70,11 @@ typedef struct hdr {
     int			hstate;		/* dirty/clean/string state */
     int			keyhash_cnt[MAX_HASH_TRY];
     int			maxinst;	/* maximum inst */
+    int			snapshot;	/* saved entries match the files */
+    int			snap_ins_mode;	/* ins_mode in snapshot header */
+    int			snap_maxinst;	/* maxinst in snapshot header */
+    int			compact;	/* journal out of step, rewrite */
+    int			jcount;		/* records in the journal file */
 } hdr_t;
 
 #define DEFAULT_MAXINST 0x7fffffff
@@ -71,10 +85,20 @@ typedef struct hdr {
 #define CACHE_STRINGS	0x4
 
 static hdr_t	*base;		/* start of cache headers */
-static char 	filename[MAXPATHLEN];
-				/* for load/save ops */
 static char	*vdp;		/* first trip mkdir for load/save */
 
+/*
+ * The list of cache headers (and the load/save directory) is shared,
+ * so this lock allows different threads to concurrently operate on
+ * caches for different instance domains.  Operations on any single
+ * instance domain must still be serialized by the PMDA.
+ */
+#ifdef PM_MULTI_THREAD
+static pthread_mutex_t	cache_lock = PTHREAD_MUTEX_INITIALIZER;
+#else
+void			*cache_lock;
+#endif
+
 /*
  * Count character to end of string or first space, whichever comes
  * first.  In the special case of string caches, spaces are allowed.
@@ -166,21 +190,23 @@ find_cache(pmInDom indom, int *sts)
     hdr_t	*h;
     int		i;
 
+    PM_LOCK(cache_lock);
     for (h = base; h != NULL; h = h->next) {
-	if (h->indom == indom)
+	if (h->indom == indom) {
+	    PM_UNLOCK(cache_lock);
 	    return h;
+	}
     }
 
     if ((h = (hdr_t *)malloc(sizeof(hdr_t))) == NULL) {
 	char	strbuf[20];
+	PM_UNLOCK(cache_lock);
 	pmNotifyErr(LOG_ERR, 
 	     "find_cache: indom %s: unable to allocate memory for hdr_t",
 	     pmInDomStr_r(indom, strbuf, sizeof(strbuf)));
 	*sts = PM_ERR_GENERIC;
 	return NULL;
     }
-    h->next = base;
-    base = h;
     h->first = NULL;
     h->last = NULL;
     h->hsize = 16;
@@ -194,6 +220,12 @@ find_cache(pmInDom indom, int *sts)
     for (i = 0; i < MAX_HASH_TRY; i++)
 	h->keyhash_cnt[i] = 0;
     h->maxinst = DEFAULT_MAXINST;
+    h->snapshot = 0;
+    h->compact = 0;
+    h->jcount = 0;
+    h->next = base;
+    base = h;
+    PM_UNLOCK(cache_lock);
     return h;
 }
 
@@ -528,6 +560,9 @@ reorder:
 		h->first = e;
 	    else
 		last_e->next = e;
+	    if (t->saved)
+		/* cull not yet journalled, so snapshot must be rewritten */
+		h->compact = 1;
 	    if (t->name)
 		free(t->name);
 	    free(t);
@@ -535,7 +570,7 @@ reorder:
 	else
 	    last_e = t;
     }
-
+    h->last = last_e;
 }
 
 /*
@@ -595,11 +630,17 @@ insert_cache(hdr_t *h, const char *name, int inst, int *sts)
 	    *sts = PM_ERR_INST;
 	    return e;
 	}
-	for (e = h->first; e != NULL; e = e->next) {
-	    if (e->inst < inst)
-		last_e = e;
-	    else if (e->inst > inst)
-		break;
+	if (h->last != NULL && h->last->inst < inst) {
+	    /* common case when loading, entries saved in inst order */
+	    last_e = h->last;
+	}
+	else {
+	    for (e = h->first; e != NULL; e = e->next) {
+		if (e->inst < inst)
+		    last_e = e;
+		else if (e->inst > inst)
+		    break;
+	    }
 	}
     }
 
@@ -681,11 +722,12 @@ retry:
     e->state = PMDA_CACHE_INACTIVE;
     e->private = NULL;
     e->stamp = 0;
+    e->saved = 0;
     if (h->last == NULL || h->last->inst < inst)
 	h->last = e;
     h->nentry++;
 
-    if (h->hsize > 0 && h->hsize < 1024 && h->nentry > 4 * h->hsize)
+    if (h->hsize > 0 && h->hsize < MAX_HASH_SIZE && h->nentry > 4 * h->hsize)
 	redo_hash(h, 1);
 
     /* link into the inst hash list, if any */
@@ -709,38 +751,252 @@ retry:
     return e;
 }
 
+/*
+ * Build the load/save path for an indom (snapshot file, or the journal
+ * file with a suffix), creating the directory on the first trip through
+ * here.
+ */
 static int
-load_cache(hdr_t *h)
+cache_filename(hdr_t *h, const char *suffix, char *filename, size_t length)
 {
-    FILE	*fp;
-    entry_t	*e;
-    int		cnt;
-    int		x;
-    int		inst;
-    int		keylen = 0;
-    void	*key = NULL;
-    int		s;
-    char	buf[1024];	/* input line buffer, is this big enough? */
-    char	*p;
-    int		sts;
     int		sep = pmPathSeparator();
     char	strbuf[20];
 
+    PM_LOCK(cache_lock);
     if (vdp == NULL) {
-	if ((vdp = pmGetOptionalConfig("PCP_VAR_DIR")) == NULL)
+	if ((vdp = pmGetOptionalConfig("PCP_VAR_DIR")) == NULL) {
+	    PM_UNLOCK(cache_lock);
 	    return PM_ERR_GENERIC;
-	pmsprintf(filename, sizeof(filename),
+	}
+	pmsprintf(filename, length,
 		"%s%c" "config" "%c" "pmda", vdp, sep, sep);
 	mkdir2(filename, 0755);
     }
+    PM_UNLOCK(cache_lock);
 
-    pmsprintf(filename, sizeof(filename), "%s%cconfig%cpmda%c%s",
+    pmsprintf(filename, length, "%s%cconfig%cpmda%c%s%s",
 		vdp, sep, sep, sep,
-		pmInDomStr_r(h->indom, strbuf, sizeof(strbuf)));
+		pmInDomStr_r(h->indom, strbuf, sizeof(strbuf)), suffix);
+    return 0;
+}
+
+/*
+ * Parse one saved entry - inst, timestamp, optional [key] and name.
+ * The buffer is modified in place, the name returned points into it.
+ */
+static int
+parse_record(hdr_t *h, const char *filename, char *buf,
+	int *instp, int *stampp, int *keylenp, void **keyp, char **namep)
+{
+    char	*p;
+    int		inst;
+    int		x;
+    int		keylen = 0;
+    void	*key = NULL;
+
+    if ((p = strchr(buf, '\n')) != NULL)
+	*p = '\0';
+    p = buf;
+    while (*p && isascii((int)*p) && isspace((int)*p))
+	p++;
+    if (*p == '\0') goto bad;
+    inst = 0;
+    while (*p && isascii((int)*p) && isdigit((int)*p)) {
+	inst = inst*10 + (*p-'0');
+	p++;
+    }
+    while (*p && isascii((int)*p) && isspace((int)*p))
+	p++;
+    if (inst < 0 || *p == '\0') goto bad;
+    x = 0;
+    while (*p && isascii((int)*p) && isdigit((int)*p)) {
+	x = x*10 + (*p-'0');
+	p++;
+    }
+    while (*p && isascii((int)*p) && isspace((int)*p))
+	p++;
+    if (*p == '[') {
+	char	*pend;
+	char	*q;
+	int	i;
+	int	tmp;
+	p++;
+	pend = p;
+	while (*pend && *pend != ']')
+	    pend++;
+	if (*pend != ']')
+	    goto bad;
+	/*
+	 * convert key in place ...
+	 */
+	keylen = (pend - p) / 2;
+	if ((key = malloc(keylen)) == NULL) {
+	    pmNotifyErr(LOG_ERR,
+		 "load_cache: indom %s: unable to allocate memory for keylen=%d",
+		 pmInDomStr(h->indom), keylen);
+	    return PM_ERR_GENERIC;
+	}
+	q = key;
+	for (i = 0; i < keylen; i++) {
+	    sscanf(p, "%2x", &tmp);
+	    *q++ = (tmp & 0xff);
+	    p += 2;
+	}
+	p += 2;
+	while (*p && isascii((int)*p) && isspace((int)*p))
+	    p++;
+    }
+    if (*p == '\0') {
+bad:
+	pmNotifyErr(LOG_ERR,
+	     "pmdaCacheOp: %s: illegal record: %s",
+	     filename, buf);
+	if (key) free(key);
+	return PM_ERR_GENERIC;
+    }
+    *instp = inst;
+    *stampp = x;
+    *keylenp = keylen;
+    *keyp = key;
+    *namep = p;
+    return 0;
+}
+
+/*
+ * Add a saved entry to the cache, as read from the snapshot or journal.
+ * An entry already present with the same inst and name is refreshed.
+ */
+static int
+load_record(hdr_t *h, const char *filename, int inst, int stamp,
+	int keylen, void *key, const char *name)
+{
+    entry_t	*e;
+    int		sts;
+
+    e = insert_cache(h, name, inst, &sts);
+    if (e == NULL) {
+	if (key) free(key);
+	return sts;
+    }
+    if (sts != 0) {
+	pmNotifyErr(LOG_WARNING,
+	    "pmdaCacheOp: %s: loading instance %d (\"%s\") ignored, already in cache as %d (\"%s\")",
+	    filename, inst, name, e->inst, e->name);
+    }
+    if (e->key && e->key != key)
+	free(e->key);
+    e->keylen = keylen;
+    e->key = key;
+    e->stamp = stamp;
+    e->saved = 1;
+    return sts == 0;
+}
+
+/*
+ * Replay the journal of changes saved since the snapshot was written.
+ * Each record is either "+ <entry>" for an added entry (or an updated
+ * timestamp), or "- <inst>" for a culled entry.  A damaged record (e.g.
+ * a partial write) ends the replay, and forces the next save to write
+ * a fresh snapshot.  The change in the number of entries is returned
+ * via cntp.
+ */
+static int
+load_journal(hdr_t *h, int *cntp)
+{
+    FILE	*fp;
+    entry_t	*e;
+    int		inst, stamp, keylen;
+    void	*key;
+    char	*name;
+    int		cnt = 0;
+    int		culled = 0;
+    int		sts;
+    char	buf[1024];
+    char	filename[MAXPATHLEN];
+
+    if ((sts = cache_filename(h, JOURNAL_SUFFIX, filename, sizeof(filename))) < 0)
+	return sts;
+    if ((fp = fopen(filename, "r")) == NULL) {
+	*cntp = 0;
+	return 0;
+    }
+
+    while (fgets(buf, sizeof(buf), fp) != NULL) {
+	h->jcount++;
+	if (buf[0] == '+' && buf[1] == ' ') {
+	    sts = parse_record(h, filename, &buf[2], &inst, &stamp, &keylen, &key, &name);
+	    if (sts < 0)
+		break;
+	    if ((e = find_entry(h, NULL, inst, &sts)) != NULL &&
+		name_eq(e, name, get_hashlen(h, name)) == 1) {
+		e->stamp = stamp;
+		e->saved = 1;
+		if (key) free(key);
+		continue;
+	    }
+	    if ((sts = load_record(h, filename, inst, stamp, keylen, key, name)) < 0)
+		break;
+	    cnt += sts;
+	}
+	else if (buf[0] == '-' && sscanf(&buf[1], "%d", &inst) == 1) {
+	    if ((e = find_entry(h, NULL, inst, &sts)) != NULL) {
+		e->state = PMDA_CACHE_EMPTY;
+		e->saved = 0;
+		culled++;
+		cnt--;
+	    }
+	}
+	else {
+	    if ((name = strchr(buf, '\n')) != NULL)
+		*name = '\0';
+	    pmNotifyErr(LOG_ERR,
+		 "pmdaCacheOp: %s: illegal record: %s", filename, buf);
+	    sts = PM_ERR_GENERIC;
+	    break;
+	}
+    }
+    fclose(fp);
+
+    if (sts < 0)
+	h->compact = 1;
+    if (culled > 0) {
+	/* release the culled entries now, not at the next resize */
+	redo_hash(h, 0);
+	h->nentry = 0;
+	for (e = h->first; e != NULL; e = e->next)
+	    h->nentry++;
+    }
+
+    if (pmDebugOptions.indom)
+	fprintf(stderr, "load_journal: %s: %d records, %d culled\n",
+		filename, h->jcount, culled);
+
+    *cntp = cnt;
+    return 0;
+}
+
+static int
+load_cache(hdr_t *h)
+{
+    FILE	*fp;
+    int		cnt;
+    int		x;
+    int		inst;
+    int		keylen;
+    void	*key;
+    int		s;
+    char	buf[1024];	/* input line buffer, is this big enough? */
+    char	*name;
+    int		sts;
+    int		delta;
+    char	filename[MAXPATHLEN];
+
+    if ((sts = cache_filename(h, "", filename, sizeof(filename))) < 0)
+	return sts;
     if ((fp = fopen(filename, "r")) == NULL)
 	return -oserror();
     if (fgets(buf, sizeof(buf), fp) == NULL) {
-	pmNotifyErr(LOG_ERR, 
+	pmNotifyErr(LOG_ERR,
 	     "pmdaCacheOp: %s: empty file?", filename);
 	fclose(fp);
 	return PM_ERR_GENERIC;
@@ -748,12 +1004,12 @@ load_cache(hdr_t *h)
     /* First grab the file version. */
     s = sscanf(buf, "%d ", &x);
     if (s != 1 || x <= 0 || x > CACHE_VERSION) {
-	pmNotifyErr(LOG_ERR, 
+	pmNotifyErr(LOG_ERR,
 	     "pmdaCacheOp: %s: illegal cache header record: %s",
 	     filename, buf);
 	fclose(fp);
 	return PM_ERR_GENERIC;
-    }	
+    }
 
     /* Based on the file version, grab the entire line. */
     switch (x) {
@@ -770,7 +1026,7 @@ load_cache(hdr_t *h)
 	    break;
     }
     if (s == 0 || h->ins_mode < 0 || h->ins_mode > 1 || h->maxinst < 0) {
-	pmNotifyErr(LOG_ERR, 
+	pmNotifyErr(LOG_ERR,
 	     "pmdaCacheOp: %s: illegal cache header record: %s",
 	     filename, buf);
 	fclose(fp);
@@ -780,89 +1036,24 @@ load_cache(hdr_t *h)
     for (cnt = 0; ; cnt++) {
 	if (fgets(buf, sizeof(buf), fp) == NULL)
 	    break;
-	if ((p = strchr(buf, '\n')) != NULL)
-	    *p = '\0';
-	p = buf;
-	while (*p && isascii((int)*p) && isspace((int)*p))
-	    p++;
-	if (*p == '\0') goto bad;
-	inst = 0;
-	while (*p && isascii((int)*p) && isdigit((int)*p)) {
-	    inst = inst*10 + (*p-'0');
-	    p++;
-	}
-	while (*p && isascii((int)*p) && isspace((int)*p))
-	    p++;
-	if (inst < 0 || *p == '\0') goto bad;
-	x = 0;
-	while (*p && isascii((int)*p) && isdigit((int)*p)) {
-	    x = x*10 + (*p-'0');
-	    p++;
-	}
-	while (*p && isascii((int)*p) && isspace((int)*p))
-	    p++;
-	if (*p == '[') {
-	    char	*pend;
-	    char	*q;
-	    int		i;
-	    int		tmp;
-	    p++;
-	    pend = p;
-	    while (*pend && *pend != ']')
-		pend++;
-	    if (*pend != ']')
-		goto bad;
-	    /*
-	     * convert key in place ...
-	     */
-	    keylen = (pend - p) / 2;
-	    if ((key = malloc(keylen)) == NULL) {
-		pmNotifyErr(LOG_ERR, 
-		     "load_cache: indom %s: unable to allocate memory for keylen=%d",
-		     pmInDomStr(h->indom), keylen);
-		fclose(fp);
-		return PM_ERR_GENERIC;
-	    }
-	    q = key;
-	    for (i = 0; i < keylen; i++) {
-		sscanf(p, "%2x", &tmp);
-		*q++ = (tmp & 0xff);
-		p += 2;
-	    }
-	    p += 2;
-	    while (*p && isascii((int)*p) && isspace((int)*p))
-		p++;
-	}
-	else {
-	    keylen = 0;
-	    key = NULL;
-	}
-	if (*p == '\0') {
-bad:
-	    pmNotifyErr(LOG_ERR, 
-		 "pmdaCacheOp: %s: illegal record: %s",
-		 filename, buf);
-	    if (key) free(key);
-	    fclose(fp);
-	    return PM_ERR_GENERIC;
-	}
-	e = insert_cache(h, p, inst, &sts);
-	if (e == NULL) {
-	    if (key) free(key);
+	sts = parse_record(h, filename, buf, &inst, &x, &keylen, &key, &name);
+	if (sts == 0)
+	    sts = load_record(h, filename, inst, x, keylen, key, name);
+	if (sts < 0) {
 	    fclose(fp);
 	    return sts;
 	}
-	if (sts != 0) {
-	    pmNotifyErr(LOG_WARNING,
-		"pmdaCacheOp: %s: loading instance %d (\"%s\") ignored, already in cache as %d (\"%s\")",
-		filename, inst, p, e->inst, e->name);
-	}
-	e->keylen = keylen;
-	e->key = key;
-	e->stamp = x;
     }
     fclose(fp);
 
+    h->snapshot = 1;
+    h->snap_ins_mode = h->ins_mode;
+    h->snap_maxinst = h->maxinst;
+    h->jcount = 0;
+    if ((sts = load_journal(h, &delta)) < 0)
+	return sts;
+    cnt += delta;
+
     if (pmDebugOptions.indom) {
 	fprintf(stderr, "After PMDA_CACHE_LOAD\n");
 	dump(stderr, h, 0);
@@ -871,6 +1062,70 @@ bad:
     return cnt;
 }
 
+static void
+save_entry(FILE *fp, entry_t *e)
+{
+    fprintf(fp, "%d %d", e->inst, (int)e->stamp);
+    if (e->keylen > 0) {
+	char	*p = (char *)e->key;
+	int	i;
+	fprintf(fp, " [");
+	for (i = 0; i < e->keylen; i++, p++)
+	    fprintf(fp, "%02x", (*p & 0xff));
+	fputc(']', fp);
+    }
+    fprintf(fp, " %s\n", e->name);
+}
+
+/*
+ * Append the entries added, culled or stamped since the last save to
+ * the journal, rather than rewriting every entry in the snapshot.
+ */
+static int
+save_journal(hdr_t *h, time_t now)
+{
+    FILE	*fp;
+    entry_t	*e;
+    int		cnt = 0;
+    int		nrecords = 0;
+    int		sts;
+    char	filename[MAXPATHLEN];
+
+    if ((sts = cache_filename(h, JOURNAL_SUFFIX, filename, sizeof(filename))) < 0)
+	return sts;
+    if ((fp = fopen(filename, "a")) == NULL)
+	return -oserror();
+
+    for (e = h->first; e != NULL; e = e->next) {
+	if (e->state == PMDA_CACHE_EMPTY) {
+	    if (e->saved) {
+		fprintf(fp, "- %d\n", e->inst);
+		e->saved = 0;
+		nrecords++;
+	    }
+	    continue;
+	}
+	if (e->stamp == 0 || !e->saved) {
+	    if (e->stamp == 0)
+		e->stamp = now;
+	    fputs("+ ", fp);
+	    save_entry(fp, e);
+	    e->saved = 1;
+	    nrecords++;
+	}
+	cnt++;
+    }
+    h->jcount += nrecords;
+
+    if (fclose(fp) != 0) {
+	/* journal state unknown, start afresh next time */
+	sts = -oserror();
+	h->compact = 1;
+	return sts;
+    }
+    return cnt;
+}
+
 static int
 save_cache(hdr_t *h, int hstate)
 {
@@ -878,52 +1133,61 @@ save_cache(hdr_t *h, int hstate)
     entry_t	*e;
     int		cnt;
     time_t	now;
-    int		sep = pmPathSeparator();
+    int		sts;
     int		state = h->hstate & ~CACHE_STRINGS;
-    char	strbuf[20];
+    char	filename[MAXPATHLEN];
 
     if ((state & hstate) == 0) {
 	/* nothing to be done */
 	return 0;
     }
 
-    if (vdp == NULL) {
-	if ((vdp = pmGetOptionalConfig("PCP_VAR_DIR")) == NULL)
-	    return PM_ERR_GENERIC;
-	pmsprintf(filename, sizeof(filename),
-		"%s%c" "config" "%c" "pmda", vdp, sep, sep);
-	mkdir2(filename, 0755);
+    now = time(NULL);
+
+    /*
+     * Large caches, already in step with the files, are journalled
+     * until the journal outgrows the snapshot, or the header changes.
+     */
+    if (h->snapshot && !h->compact && h->nentry >= JOURNAL_MIN &&
+	h->jcount < h->nentry &&
+	h->ins_mode == h->snap_ins_mode && h->maxinst == h->snap_maxinst) {
+	if ((cnt = save_journal(h, now)) < 0)
+	    return cnt;
+	h->hstate &= ~(DIRTY_INSTANCE | DIRTY_STAMP);
+	goto done;
     }
 
-    pmsprintf(filename, sizeof(filename), "%s%cconfig%cpmda%c%s",
-		vdp, sep, sep, sep,
-		pmInDomStr_r(h->indom, strbuf, sizeof(strbuf)));
+    if ((sts = cache_filename(h, "", filename, sizeof(filename))) < 0)
+	return sts;
     if ((fp = fopen(filename, "w")) == NULL)
 	return -oserror();
     fprintf(fp, "%d %d %d\n", CACHE_VERSION, h->ins_mode, h->maxinst);
 
-    now = time(NULL);
     cnt = 0;
     for (e = h->first; e != NULL; e = e->next) {
-	if (e->state == PMDA_CACHE_EMPTY)
+	if (e->state == PMDA_CACHE_EMPTY) {
+	    e->saved = 0;
 	    continue;
+	}
 	if (e->stamp == 0)
 	    e->stamp = now;
-	fprintf(fp, "%d %d", e->inst, (int)e->stamp);
-	if (e->keylen > 0) {
-	    char	*p = (char *)e->key;
-	    int		i;
-	    fprintf(fp, " [");
-	    for (i = 0; i < e->keylen; i++, p++)
-		fprintf(fp, "%02x", (*p & 0xff));
-	    fputc(']', fp);
-	}
-	fprintf(fp, " %s\n", e->name);
+	save_entry(fp, e);
+	e->saved = 1;
 	cnt++;
     }
     fclose(fp);
     h->hstate &= ~(DIRTY_INSTANCE | DIRTY_STAMP);
 
+    /* snapshot now holds everything, any journal is obsolete */
+    if (cache_filename(h, JOURNAL_SUFFIX, filename, sizeof(filename)) == 0)
+	unlink(filename);
+    h->snapshot = 1;
+    h->snap_ins_mode = h->ins_mode;
+    h->snap_maxinst = h->maxinst;
+    h->compact = 0;
+    h->jcount = 0;
+
+done:
     if (pmDebugOptions.indom) {
 	fprintf(stderr, "After cache_save hstate={");
 	if (hstate & DIRTY_INSTANCE) fprintf(stderr, "DIRTY_INSTANCE");
@@ -1180,11 +1444,13 @@ int pmdaCacheOp(pmInDom indom, int op)
 
     if (op == PMDA_CACHE_CHECK) {
 	/* is there a cache for this one? */
+	PM_LOCK(cache_lock);
 	for (h = base; h != NULL; h = h->next) {
 	    if (h->indom == indom)
-		return 1;
+		break;
 	}
-	return 0;
+	PM_UNLOCK(cache_lock);
+	return h != NULL;
     }
 
     if ((h = find_cache(indom, &sts)) == NULL)
@@ -1,5 +1,5 @@
 /*
- * Copyright (c) 2013-2014,2017-2018 Red Hat.
+ * Copyright (c) 2013-2014,2017-2019 Red Hat.
  * Copyright (c) 1995-2000 Silicon Graphics, Inc.  All Rights Reserved.
  * 
  * This library is free software; you can redistribute it and/or modify it
@@ -489,9 +489,323 @@ __pmdaEncodeStatus(pmResult *result, unsigned char byte)
 
 #define PMDA_STATUS_CHANGE (PMDA_EXT_LABEL_CHANGE|PMDA_EXT_NAMES_CHANGE)
 
+/*
+ * Result arena allocations - see e_arena_t in libdefs.h
+ */
+struct arenachunk {
+    struct arenachunk	*next;
+    double		data[1];	/* aligned start of the allocation */
+};
+
+#define ARENA_ALIGN(n)	(((n) + sizeof(double) - 1) & ~(sizeof(double) - 1))
+
+static void *
+__pmdaArenaAlloc(e_arena_t *arena, size_t size)
+{
+    struct arenachunk	*chunk;
+    void		*p;
+
+    size = ARENA_ALIGN(size);
+    if (arena->used + size <= arena->size) {
+	p = arena->base + arena->used;
+	arena->used += size;
+	return p;
+    }
+    /* out of space, use an overflow chunk until the next reset */
+    chunk = (struct arenachunk *)malloc(offsetof(struct arenachunk, data) + size);
+    if (chunk == NULL)
+	return NULL;
+    chunk->next = arena->chunks;
+    arena->chunks = chunk;
+    arena->spilled += size;
+    return chunk->data;
+}
+
+static void
+__pmdaArenaReset(e_arena_t *arena)
+{
+    struct arenachunk	*chunk, *next;
+    size_t		need;
+    char		*base;
+
+    if (arena->spilled) {
+	for (chunk = arena->chunks; chunk != NULL; chunk = next) {
+	    next = chunk->next;
+	    free(chunk);
+	}
+	arena->chunks = NULL;
+	/* make room for everything the last fetch needed, plus a bit */
+	need = arena->used + arena->spilled;
+	need += need / 4;
+	free(arena->base);
+	if ((base = (char *)malloc(need)) == NULL)
+	    need = 0;
+	arena->base = base;
+	arena->size = need;
+	arena->spilled = 0;
+    }
+    arena->used = 0;
+}
+
+static pmValueSet *
+__pmdaAllocValueSet(e_ext_t *extp, int numval)
+{
+    size_t	need = sizeof(pmValueSet) - sizeof(pmValue);
+
+    if (numval > 0)
+	need += numval * sizeof(pmValue);
+    if (extp->arena.inuse)
+	return (pmValueSet *)__pmdaArenaAlloc(&extp->arena, need);
+    /* Must use individual malloc()s because of pmFreeResult() */
+    return (pmValueSet *)malloc(need);
+}
+
+static pmValueSet *
+__pmdaGrowValueSet(e_ext_t *extp, pmValueSet *vset, int oldnumval, int numval)
+{
+    pmValueSet	*tmp_vset;
+    size_t	need = sizeof(pmValueSet) + (numval - 1) * sizeof(pmValue);
+
+    if (!extp->arena.inuse)
+	return (pmValueSet *)realloc(vset, need);
+    if ((tmp_vset = (pmValueSet *)__pmdaArenaAlloc(&extp->arena, need)) != NULL)
+	memcpy(tmp_vset, vset, sizeof(pmValueSet) + (oldnumval - 1) * sizeof(pmValue));
+    return tmp_vset;
+}
+
+/*
+ * As per __pmStuffValue, but with value blocks allocated from the
+ * result arena when in use.  These are still marked PM_VAL_DPTR as
+ * that format is sent to pmcd (and logged), but the result is never
+ * passed to __pmFreeResultValues - see __pmdaMainPDU.
+ */
+static int
+__pmdaStuffValue(e_ext_t *extp, const pmAtomValue *avp, pmValue *vp, int type)
+{
+    pmValueBlock	*vbp;
+    const void		*src;
+    size_t		need, body;
+
+    if (!extp->arena.inuse)
+	return __pmStuffValue(avp, vp, type);
+
+    switch (type) {
+	case PM_TYPE_FLOAT:
+	    body = sizeof(float);
+	    src  = &avp->f;
+	    break;
+
+	case PM_TYPE_64:
+	case PM_TYPE_U64:
+	case PM_TYPE_DOUBLE:
+	    body = sizeof(__int64_t);
+	    src  = &avp->ull;
+	    break;
+
+	case PM_TYPE_AGGREGATE:
+	    body = avp->vbp->vlen - PM_VAL_HDR_SIZE;
+	    src  = avp->vbp->vbuf;
+	    break;
+
+	case PM_TYPE_STRING:
+	    body = strlen(avp->cp) + 1;
+	    src  = avp->cp;
+	    break;
+
+	default:
+	    /* in-situ values, static value blocks and bad types */
+	    return __pmStuffValue(avp, vp, type);
+    }
+    need = body + PM_VAL_HDR_SIZE;
+    vbp = (pmValueBlock *)__pmdaArenaAlloc(&extp->arena,
+		(need < sizeof(pmValueBlock)) ? sizeof(pmValueBlock) : need);
+    if (vbp == NULL)
+	return -ENOMEM;
+    vbp->vlen = (int)need;
+    vbp->vtype = type;
+    memcpy(vbp->vbuf, src, body);
+    vp->value.pval = vbp;
+    return PM_VAL_DPTR;
+}
+
+/*
+ * Instance counts are cached for the duration of each fetch, as the
+ * profile does not change and metrics often share instance domains.
+ */
+#define MAX_INDOM_COUNTS	8
+
+typedef struct {
+    pmInDom	indom;
+    int		count;
+} indom_count_t;
+
+static int
+__pmdaCountInstCached(pmDesc *dp, pmdaExt *pmda,
+		indom_count_t *counts, int *ncounts)
+{
+    int		i, count;
+
+    if (dp->indom == PM_INDOM_NULL)
+	return 1;
+    for (i = 0; i < *ncounts; i++) {
+	if (counts[i].indom == dp->indom)
+	    return counts[i].count;
+    }
+    count = __pmdaCountInst(dp, pmda);
+    if (*ncounts < MAX_INDOM_COUNTS) {
+	counts[*ncounts].indom = dp->indom;
+	counts[*ncounts].count = count;
+	(*ncounts)++;
+    }
+    return count;
+}
+
+static int
+__pmdaBulkResize(e_ext_t *extp, int size)
+{
+    int		*ip;
+    pmAtomValue	*ap;
+
+    if ((ip = (int *)realloc(extp->bulkinst, size * sizeof(int))) == NULL)
+	return -oserror();
+    extp->bulkinst = ip;
+    if ((ip = (int *)realloc(extp->bulksts, size * sizeof(int))) == NULL)
+	return -oserror();
+    extp->bulksts = ip;
+    if ((ap = (pmAtomValue *)realloc(extp->bulkatoms, size * sizeof(pmAtomValue))) == NULL)
+	return -oserror();
+    extp->bulkatoms = ap;
+    extp->maxbulkinst = size;
+    return 0;
+}
+
+/*
+ * Build the list of instances in the profile for the bulk fetch
+ * callback, reusing it for consecutive metrics of the same indom.
+ * Also used by pmdaMain request threads, as the instance walk state
+ * (and that of the cache) is shared - so only one walk at a time,
+ * and the instance, text and label methods run under the same lock.
+ */
+#ifdef PM_MULTI_THREAD
+pthread_mutex_t		__pmdaWalkLock = PTHREAD_MUTEX_INITIALIZER;
+#else
+void			*__pmdaWalkLock;
+#endif
+
+static int
+__pmdaBulkInst(pmDesc *dp, pmdaExt *pmda, e_ext_t *extp)
+{
+    int		inst, sts = 0, n = 0;
+
+    if (extp->nbulkinst >= 0 && extp->bulkindom == dp->indom)
+	return extp->nbulkinst;
+
+    extp->nbulkinst = -1;
+    if (extp->worker)
+	PM_LOCK(__pmdaWalkLock);
+    __pmdaStartInst(dp->indom, pmda);
+    while (__pmdaNextInst(&inst, pmda)) {
+	if (n == extp->maxbulkinst &&
+	    (sts = __pmdaBulkResize(extp, n ? n * 2 : 64)) < 0)
+	    break;
+	extp->bulkinst[n++] = inst;
+    }
+    if (extp->worker)
+	PM_UNLOCK(__pmdaWalkLock);
+    if (sts < 0)
+	return sts;
+    extp->bulkindom = dp->indom;
+    extp->nbulkinst = n;
+    return n;
+}
+
+/*
+ * Check the fetch callback status for one instance of a metric and,
+ * if a value was returned, add it to the value set at index *jp.
+ * Returns the callback status, or the error from storing the value.
+ */
+static int
+__pmdaFetchValue(e_ext_t *extp, int version, pmDesc *dp, int inst,
+		int sts, pmAtomValue *atom, pmValueSet *vset, int *jp)
+{
+    int		type = dp->type;
+    int		lsts;
+    char	idbuf[20];
+    char	strbuf[20];
+
+    if (sts < 0) {
+	pmIDStr_r(dp->pmid, strbuf, sizeof(strbuf));
+	if (sts == PM_ERR_PMID) {
+	    pmNotifyErr(LOG_ERR, 
+		"pmdaFetch: PMID %s not handled by fetch callback\n",
+			strbuf);
+	}
+	else if (sts == PM_ERR_INST) {
+	    if (pmDebugOptions.libpmda) {
+		pmNotifyErr(LOG_ERR,
+		    "pmdaFetch: Instance %d of PMID %s not handled by fetch callback\n",
+			    inst, strbuf);
+	    }
+	}
+	else if (sts == PM_ERR_APPVERSION ||
+		 sts == PM_ERR_PERMISSION ||
+		 sts == PM_ERR_AGAIN ||
+		 sts == PM_ERR_NYI) {
+	    if (pmDebugOptions.libpmda) {
+		pmNotifyErr(LOG_ERR,
+		     "pmdaFetch: Unavailable metric PMID %s[%d]\n",
+			    strbuf, inst);
+	    }
+	}
+	else {
+	    pmNotifyErr(LOG_ERR,
+		"pmdaFetch: Fetch callback error from metric PMID %s[%d]: %s\n",
+			strbuf, inst, pmErrStr(sts));
+	}
+    }
+    /*
+     * PMDA_INTERFACE_2
+     *	>= 0 => OK
+     * PMDA_INTERFACE_3 or PMDA_INTERFACE_4
+     *	== 0 => no values
+     *	> 0  => OK
+     * PMDA_INTERFACE_5 or later
+     *	== 0 (PMDA_FETCH_NOVALUES) => no values
+     *	== 1 (PMDA_FETCH_STATIC) or > 2 => OK
+     *	== 2 (PMDA_FETCH_DYNAMIC) => OK and free(atom.vp)
+     *	     after __pmStuffValue() called
+     */
+    else if ((version == PMDA_INTERFACE_2) || (version >= PMDA_INTERFACE_3 && sts > 0)) {
+	vset->vlist[*jp].inst = inst;
+	if ((lsts = __pmdaStuffValue(extp, atom, &vset->vlist[*jp], type)) == PM_ERR_TYPE) {
+	    pmNotifyErr(LOG_ERR, "pmdaFetch: Descriptor type (%s) for metric %s is bad",
+			pmTypeStr_r(type, strbuf, sizeof(strbuf)),
+			pmIDStr_r(dp->pmid, idbuf, sizeof(idbuf)));
+	}
+	else if (lsts >= 0) {
+	    vset->valfmt = lsts;
+	    (*jp)++;
+	}
+	if (version >= PMDA_INTERFACE_5 && sts == PMDA_FETCH_DYNAMIC) {
+	    if (type == PM_TYPE_STRING)
+		free(atom->cp);
+	    else if (type == PM_TYPE_AGGREGATE)
+		free(atom->vbp);
+	    else {
+		pmNotifyErr(LOG_WARNING, "pmdaFetch: Attempt to free value for metric %s of wrong type %s\n",
+			    pmIDStr_r(dp->pmid, idbuf, sizeof(idbuf)),
+			    pmTypeStr_r(type, strbuf, sizeof(strbuf)));
+	    }
+	}
+	if (lsts < 0)
+	    sts = lsts;
+    }
+    return sts;
+}
+
 /*
  * Resize the pmResult and call the e_callback for each metric instance
- * required in the profile.
+ * required in the profile, or the bulk callback once for all of them.
  */
 
 int
@@ -499,11 +813,15 @@ pmdaFetch(int numpmid, pmID pmidlist[], pmResult **resp, pmdaExt *pmda)
 {
     int			i;		/* over pmidlist[] */
     int			j;		/* over metatab and vset->vlist[] */
+    int			k;		/* over listed instances */
     int			sts;
     int			need;
     int			inst;
     int			numval;
     int			version;
+    int			nullsts;
+    int			ncounts = 0;
+    indom_count_t	counts[MAX_INDOM_COUNTS];
     unsigned char	flags;
     pmValueSet		*vset;
     pmValueSet		*tmp_vset;
@@ -511,8 +829,9 @@ pmdaFetch(int numpmid, pmID pmidlist[], pmResult **resp, pmdaExt *pmda)
     pmdaMetric          metabuf;
     pmdaMetric		*metap;
     pmAtomValue		atom;
-    int			type;
-    int			lsts;
+    int			*instlist;
+    int			*stslist;
+    pmAtomValue		*atomlist;
     char		idbuf[20];
     char		strbuf[20];
     e_ext_t		*extp = (e_ext_t *)pmda->e_ext;
@@ -524,7 +843,7 @@ pmdaFetch(int numpmid, pmID pmidlist[], pmResult **resp, pmdaExt *pmda)
 	fprintf(stderr, ", ...) called\n");
     }
 
-    if (extp->dispatch->version.any.ext != pmda)
+    if (extp->dispatch->version.any.ext != pmda && !extp->worker)
 	fprintf(stderr, "Botch: pmdaFetch: PMDA domain=%d pmda=%p extp=%p backpointer=%p pmda-via-backpointer %p NOT EQUAL to pmda\n",
 	    pmda->e_domain, pmda, extp, extp->dispatch, extp->dispatch->version.any.ext);
 
@@ -543,6 +862,11 @@ pmdaFetch(int numpmid, pmID pmidlist[], pmResult **resp, pmdaExt *pmda)
     }
     extp->res->numpmid = numpmid;
 
+    /* any previous arena result has been sent, reuse the space */
+    __pmdaArenaReset(&extp->arena);
+    extp->arena.inuse = extp->arena.enabled;
+    extp->nbulkinst = -1;
+
     flags = 0;
     if (version >= PMDA_INTERFACE_7 && (pmda->e_flags & PMDA_STATUS_CHANGE)) {
 	if (pmda->e_flags & PMDA_EXT_LABEL_CHANGE)
@@ -565,9 +889,9 @@ pmdaFetch(int numpmid, pmID pmidlist[], pmResult **resp, pmdaExt *pmda)
 	 * will be zero
 	 */
 	dp = &(metap->m_desc);
-	if (dp->pmid != 0)
-	    numval = __pmdaCountInst(dp, pmda);
-	else {
+	instlist = stslist = NULL;
+	atomlist = NULL;
+	if (dp->pmid == 0) {
 	    /* dynamic name metrics may often vanish, avoid log spam */
 	    if (version < PMDA_INTERFACE_4) {
 		pmNotifyErr(LOG_ERR,
@@ -576,14 +900,27 @@ pmdaFetch(int numpmid, pmID pmidlist[], pmResult **resp, pmdaExt *pmda)
 	    }
 	    numval = PM_ERR_PMID;
 	}
+	else if (extp->bulkCallBack == NULL && !extp->worker)
+	    numval = __pmdaCountInstCached(dp, pmda, counts, &ncounts);
+	else if (dp->indom == PM_INDOM_NULL) {
+	    inst = PM_IN_NULL;
+	    instlist = &inst;
+	    stslist = &nullsts;
+	    atomlist = &atom;
+	    numval = 1;
+	}
+	else {
+	    if ((numval = __pmdaBulkInst(dp, pmda, extp)) < 0) {
+		sts = numval;
+		extp->res->vset[i] = NULL;
+		goto error;
+	    }
+	    instlist = extp->bulkinst;
+	    stslist = extp->bulksts;
+	    atomlist = extp->bulkatoms;
+	}
 
-	/* Must use individual malloc()s because of pmFreeResult() */
-	if (numval >= 1)
-	    extp->res->vset[i] = vset = (pmValueSet *)malloc(sizeof(pmValueSet) +
-					    (numval - 1)*sizeof(pmValue));
-	else
-	    extp->res->vset[i] = vset = (pmValueSet *)malloc(sizeof(pmValueSet) -
-					    sizeof(pmValue));
+	extp->res->vset[i] = vset = __pmdaAllocValueSet(extp, numval);
 	if (vset == NULL) {
 	    sts = -oserror();
 	    goto error;
@@ -594,100 +931,48 @@ pmdaFetch(int numpmid, pmID pmidlist[], pmResult **resp, pmdaExt *pmda)
 	if (vset->numval <= 0)
 	    continue;
 
-	if (dp->indom == PM_INDOM_NULL)
-	    inst = PM_IN_NULL;
-	else {
-	    __pmdaStartInst(dp->indom, pmda);
-	    __pmdaNextInst(&inst, pmda);
-	}
-	type = dp->type;
 	j = 0;
-	do {
-	    if (j == numval) {
-		/* more instances than expected! */
-		numval++;
-		extp->res->vset[i] = tmp_vset = (pmValueSet *)realloc(vset,
-			    sizeof(pmValueSet) + (numval - 1)*sizeof(pmValue));
-		if (tmp_vset == NULL) {
-		    free(vset);
-		    vset = NULL;
-		    sts = -oserror();
-		    goto error;
-		}
-		vset = tmp_vset;
+	if (instlist != NULL && extp->bulkCallBack != NULL &&
+	    (sts = (*(extp->bulkCallBack))(metap, numval, instlist, atomlist, stslist)) != PM_ERR_NYI) {
+	    /* whole instance column from one call, or error for all */
+	    if (sts >= 0) {
+		for (k = 0; k < numval; k++)
+		    sts = __pmdaFetchValue(extp, version, dp, instlist[k],
+				stslist[k], &atomlist[k], vset, &j);
 	    }
-	    vset->vlist[j].inst = inst;
-
-	    if ((sts = (*(pmda->e_fetchCallBack))(metap, inst, &atom)) < 0) {
-		pmIDStr_r(dp->pmid, strbuf, sizeof(strbuf));
-		if (sts == PM_ERR_PMID) {
-		    pmNotifyErr(LOG_ERR, 
-		        "pmdaFetch: PMID %s not handled by fetch callback\n",
-				strbuf);
-		}
-		else if (sts == PM_ERR_INST) {
-		    if (pmDebugOptions.libpmda) {
-			pmNotifyErr(LOG_ERR,
-			    "pmdaFetch: Instance %d of PMID %s not handled by fetch callback\n",
-				    inst, strbuf);
-		    }
-		}
-		else if (sts == PM_ERR_APPVERSION ||
-			 sts == PM_ERR_PERMISSION ||
-			 sts == PM_ERR_AGAIN ||
-			 sts == PM_ERR_NYI) {
-		    if (pmDebugOptions.libpmda) {
-			pmNotifyErr(LOG_ERR,
-			     "pmdaFetch: Unavailable metric PMID %s[%d]\n",
-				    strbuf, inst);
-		    }
-		}
-		else {
-		    pmNotifyErr(LOG_ERR,
-			"pmdaFetch: Fetch callback error from metric PMID %s[%d]: %s\n",
-				strbuf, inst, pmErrStr(sts));
-		}
+	}
+	else if (instlist != NULL) {
+	    for (k = 0; k < numval; k++) {
+		sts = (*(pmda->e_fetchCallBack))(metap, instlist[k], &atom);
+		sts = __pmdaFetchValue(extp, version, dp, instlist[k],
+				sts, &atom, vset, &j);
 	    }
+	}
+	else {
+	    if (dp->indom == PM_INDOM_NULL)
+		inst = PM_IN_NULL;
 	    else {
-		/*
-		 * PMDA_INTERFACE_2
-		 *	>= 0 => OK
-		 * PMDA_INTERFACE_3 or PMDA_INTERFACE_4
-		 *	== 0 => no values
-		 *	> 0  => OK
-		 * PMDA_INTERFACE_5 or later
-		 *	== 0 (PMDA_FETCH_NOVALUES) => no values
-		 *	== 1 (PMDA_FETCH_STATIC) or > 2 => OK
-		 *	== 2 (PMDA_FETCH_DYNAMIC) => OK and free(atom.vp)
-		 *	     after __pmStuffValue() called
-		 */
-		if ((version == PMDA_INTERFACE_2) || (version >= PMDA_INTERFACE_3 && sts > 0)) {
-
-		    if ((lsts = __pmStuffValue(&atom, &vset->vlist[j], type)) == PM_ERR_TYPE) {
-			pmNotifyErr(LOG_ERR, "pmdaFetch: Descriptor type (%s) for metric %s is bad",
-				    pmTypeStr_r(type, strbuf, sizeof(strbuf)),
-				    pmIDStr_r(dp->pmid, idbuf, sizeof(idbuf)));
-		    }
-		    else if (lsts >= 0) {
-			vset->valfmt = lsts;
-			j++;
-		    }
-		    if (version >= PMDA_INTERFACE_5 && sts == PMDA_FETCH_DYNAMIC) {
-			if (type == PM_TYPE_STRING)
-			    free(atom.cp);
-			else if (type == PM_TYPE_AGGREGATE)
-			    free(atom.vbp);
-			else {
-			    pmNotifyErr(LOG_WARNING, "pmdaFetch: Attempt to free value for metric %s of wrong type %s\n",
-					pmIDStr_r(dp->pmid, idbuf, sizeof(idbuf)),
-					pmTypeStr_r(type, strbuf, sizeof(strbuf)));
-			}
+		__pmdaStartInst(dp->indom, pmda);
+		__pmdaNextInst(&inst, pmda);
+	    }
+	    do {
+		if (j == numval) {
+		    /* more instances than expected! */
+		    tmp_vset = __pmdaGrowValueSet(extp, vset, numval, numval * 2);
+		    if (tmp_vset == NULL) {
+			if (!extp->arena.inuse)
+			    free(vset);
+			extp->res->vset[i] = NULL;
+			sts = -oserror();
+			goto error;
 		    }
-		    if (lsts < 0)
-			sts = lsts;
+		    extp->res->vset[i] = vset = tmp_vset;
+		    numval *= 2;
 		}
-	    }
-	} while (dp->indom != PM_INDOM_NULL && __pmdaNextInst(&inst, pmda));
+		sts = (*(pmda->e_fetchCallBack))(metap, inst, &atom);
+		sts = __pmdaFetchValue(extp, version, dp, inst, sts, &atom, vset, &j);
+	    } while (dp->indom != PM_INDOM_NULL && __pmdaNextInst(&inst, pmda));
+	}
 
 	if (j == 0)
 	    vset->numval = sts;
@@ -702,7 +987,7 @@ pmdaFetch(int numpmid, pmID pmidlist[], pmResult **resp, pmdaExt *pmda)
 
 error:
 
-    if (i) {
+    if (i && !extp->arena.inuse) {
 	extp->res->numpmid = i;
 	__pmFreeResultValues(extp->res);
     }
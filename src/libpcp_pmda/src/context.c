@@ -13,10 +13,37 @@
  */
 
 #include "pmapi.h"
+#include "libpcp.h"
 #include "pmda.h"
 
 static int	last_ctx = -1;	/* not thread safe! */
 
+#if defined(PM_MULTI_THREAD) && defined(HAVE___THREAD)
+/* private to each pmdaMain fetch thread, see pmdaSetThreads */
+static __thread int	thread_ctx = -1;
+static __thread int	threaded;
+
+void
+__pmdaThreadContext(void)
+{
+    threaded = 1;
+}
+
+void
+__pmdaSetContext(int ctx)
+{
+    if (threaded)
+	thread_ctx = ctx;
+    else
+	last_ctx = ctx;
+}
+
+int
+pmdaGetContext(void)
+{
+    return threaded ? thread_ctx : last_ctx;
+}
+#else
 void
 __pmdaSetContext(int ctx)
 {
@@ -28,3 +55,4 @@ pmdaGetContext(void)
 {
     return last_ctx;
 }
+#endif
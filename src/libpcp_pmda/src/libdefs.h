@@ -23,6 +23,24 @@
 #define HAVE_ANY(interface)	((interface) <= PMDA_INTERFACE_7 && HAVE_V_TWO(interface))
 
 struct dynamic;
+struct arenachunk;
+
+/*
+ * Result arena for pmdaFetch, holding the value sets and value blocks
+ * of one pmResult.  Only used when the result is sent and released
+ * before the next fetch (daemon PMDAs in pmdaMain), then reset - any
+ * overflow chunks are coalesced into one larger arena at that time,
+ * so a steady workload makes no allocations at all.
+ */
+typedef struct {
+    int			enabled;	/* result released before next fetch */
+    int			inuse;		/* last pmdaFetch result in arena */
+    char		*base;		/* reusable arena memory */
+    size_t		size;		/* allocated size of base */
+    size_t		used;		/* bytes used in base this fetch */
+    size_t		spilled;	/* bytes in overflow chunks */
+    struct arenachunk	*chunks;	/* overflow chunks this fetch */
+} e_arena_t;
 
 /*
  * Auxilliary structure used to save data from pmdaDSO or pmdaDaemon and
@@ -37,8 +55,33 @@ typedef struct {
     int			ndynamics;	/* number of dynamics entries, below */
     struct dynamic	*dynamics;	/* dynamic metric manipulation table */
     void		*privdata;	/* private (user) data for this PMDA */
+    e_arena_t		arena;		/* fetch result value allocations */
+    pmdaFetchBulkCallBack bulkCallBack;	/* fetch all instances of a metric */
+    pmInDom		bulkindom;	/* indom of the cached instance list */
+    int			nbulkinst;	/* number of cached instances */
+    int			maxbulkinst;	/* allocated size of bulk arrays */
+    int			*bulkinst;	/* cached instances in the profile */
+    int			*bulksts;	/* per-instance callback status */
+    pmAtomValue		*bulkatoms;	/* per-instance callback values */
+    int			nthreads;	/* pmdaMain fetch threads, if any */
+    int			worker;		/* private copy for a fetch thread */
 } e_ext_t;
 
+/*
+ * pmdaMain internals, shared with the threaded request handling
+ */
+extern int __pmdaMainCheck(pmdaInterface *);
+extern int __pmdaProcessPDU(pmdaInterface *, int, __pmPDU *, int);
+extern void __pmdaRequestPDU(pmdaInterface *, pmdaExt *, int, __pmPDU *);
+extern int __pmdaMainThreads(pmdaInterface *);
+extern void __pmdaThreadContext(void);
+extern void __pmdaRetireProfile(pmProfile *);
+#ifdef PM_MULTI_THREAD
+extern pthread_mutex_t __pmdaWalkLock;
+#else
+extern void *__pmdaWalkLock;
+#endif
+
 /*
  * Local hash function
  */
@@ -1,5 +1,5 @@
 /*
- * Copyright (c) 2013,2017-2018 Red Hat.
+ * Copyright (c) 2013,2017-2019 Red Hat.
  * Copyright (c) 1995-2000 Silicon Graphics, Inc.  All Rights Reserved.
  * 
  * This library is free software; you can redistribute it and/or modify it
@@ -29,40 +29,16 @@ __pmdaInFd(pmdaInterface *dispatch)
     return -1;
 }
 
+static pmProfile	*profile;	/* last profile received from pmcd */
+
+/*
+ * Initial version checks, once only
+ */
 int
-__pmdaMainPDU(pmdaInterface *dispatch)
+__pmdaMainCheck(pmdaInterface *dispatch)
 {
-    __pmPDU		*pb;
-    int			sts;
-    int			op_sts;
-    pmID		pmid;
-    pmDesc		desc;
-    int			npmids;
-    pmID		*pmidlist;
-    char		**namelist = NULL;
-    char		*name;
-    char		**offspring = NULL;
-    int			*statuslist = NULL;
-    int			subtype;
-    pmResult		*result;
-    int			ctxnum;
-    int			length;
-    pmTimeval		when;
-    int			ident;
-    int			type;
-    pmInDom		indom;
-    int			inst;
-    char		*iname;
-    pmInResult		*inres;
-    pmLabelSet		*labels = NULL;
-    char		*buffer;
-    pmProfile  		*new_profile;
-    static pmProfile	*profile = NULL;
     static int		first_time = 1;
-    static pmdaExt	*pmda = NULL;
-    int			pinpdu;
 
-    /* Initial version checks */
     if (first_time) {
 	if (dispatch->status != 0) {
 	    pmNotifyErr(LOG_ERR, "PMDA Initialisation Failed");
@@ -73,10 +49,23 @@ __pmdaMainPDU(pmdaInterface *dispatch)
 			 dispatch->comm.pmda_interface);
 	    return -1;
 	}
-	pmda = dispatch->version.any.ext;
 	dispatch->comm.pmapi_version = PMAPI_VERSION;
 	first_time = 0;
     }
+    return 0;
+}
+
+int
+__pmdaMainPDU(pmdaInterface *dispatch)
+{
+    __pmPDU		*pb;
+    int			sts;
+    int			pinpdu;
+    pmdaExt		*pmda;
+
+    if (__pmdaMainCheck(dispatch) < 0)
+	return -1;
+    pmda = dispatch->version.any.ext;
 
     pinpdu = sts = __pmGetPDU(pmda->e_infd, ANY_SIZE, TIMEOUT_NEVER, &pb);
     if (pmDebugOptions.pdu && pmDebugOptions.desperate) {
@@ -89,6 +78,101 @@ __pmdaMainPDU(pmdaInterface *dispatch)
 	pmNotifyErr(LOG_ERR, "IPC Error: %s\n", pmErrStr(sts));
 	return sts;
     }
+    return __pmdaProcessPDU(dispatch, sts, pb, pinpdu);
+}
+
+/*
+ * Answer a label, instance or text request from pmcd, using the given
+ * pmdaExt - that of the PMDA, or a private copy in a worker thread.
+ */
+void
+__pmdaRequestPDU(pmdaInterface *dispatch, pmdaExt *pmda, int pdutype, __pmPDU *pb)
+{
+    int			sts;
+    int			ident;
+    int			type;
+    pmTimeval		when;
+    pmInDom		indom;
+    int			inst;
+    char		*iname;
+    pmInResult		*inres;
+    pmLabelSet		*labels = NULL;
+    char		*buffer;
+
+    switch (pdutype) {
+    case PDU_LABEL_REQ:
+	if (pmDebugOptions.libpmda)
+	    pmNotifyErr(LOG_DEBUG, "Received PDU_LABEL_REQ\n");
+
+	if ((sts = __pmDecodeLabelReq(pb, &ident, &type)) >= 0 &&
+	    HAVE_V_SEVEN(dispatch->comm.pmda_interface))
+	    sts = dispatch->version.seven.label(ident, type, &labels, pmda);
+	if (sts < 0)
+	    __pmSendError(pmda->e_outfd, FROM_ANON, sts);
+	else {
+	    if (sts > 0 && !(type & PM_LABEL_INSTANCES))
+		sts = 1;
+	    __pmSendLabel(pmda->e_outfd, FROM_ANON, ident, type, labels, sts);
+	    pmFreeLabelSets(labels, sts);
+	}
+	break;
+
+    case PDU_INSTANCE_REQ:
+	if (pmDebugOptions.libpmda)
+	    pmNotifyErr(LOG_DEBUG, "Received PDU_INSTANCE_REQ\n");
+
+	iname = NULL;
+	if ((sts = __pmDecodeInstanceReq(pb, &when, &indom, &inst, &iname)) >= 0)
+	    sts = dispatch->version.any.instance(indom, inst, iname, &inres, pmda);
+	if (sts < 0)
+	    __pmSendError(pmda->e_outfd, FROM_ANON, sts);
+	else {
+	    __pmSendInstance(pmda->e_outfd, FROM_ANON, inres);
+	    __pmFreeInResult(inres);
+	}
+	if (iname)
+	    free(iname);
+	break;
+
+    case PDU_TEXT_REQ:
+	if (pmDebugOptions.libpmda)
+	    pmNotifyErr(LOG_DEBUG, "Received PDU_TEXT_REQ\n");
+
+	if ((sts = __pmDecodeTextReq(pb, &ident, &type)) >= 0)
+	    sts = dispatch->version.any.text(ident, type, &buffer, pmda);
+	if (sts < 0)
+	    __pmSendError(pmda->e_outfd, FROM_ANON, sts);
+	else
+	    __pmSendText(pmda->e_outfd, FROM_ANON, ident, buffer);
+	break;
+    }
+}
+
+/*
+ * Handle one PDU of the given type read from pmcd, sending any reply
+ */
+int
+__pmdaProcessPDU(pmdaInterface *dispatch, int pdutype, __pmPDU *pb, int pinpdu)
+{
+    int			sts = pdutype;
+    int			op_sts;
+    pmID		pmid;
+    pmDesc		desc;
+    int			npmids;
+    pmID		*pmidlist;
+    char		**namelist = NULL;
+    char		*name;
+    char		**offspring = NULL;
+    int			*statuslist = NULL;
+    int			subtype;
+    pmResult		*result;
+    int			ctxnum;
+    int			length;
+    pmTimeval		when;
+    char		*buffer;
+    pmProfile  		*new_profile;
+    pmdaExt		*pmda = dispatch->version.any.ext;
+    e_ext_t		*extp = (e_ext_t *)pmda->e_ext;
 
     if (HAVE_V_FIVE(dispatch->comm.pmda_interface)) {
 	/* set up sender context */
@@ -142,7 +226,8 @@ __pmdaMainPDU(pmdaInterface *dispatch)
 	/*
 	 * can ignore ctxnum, since pmcd has already used this to send
 	 * the correct profile, if required
-	 * Free last profile received (if any)
+	 * Free last profile received (if any), once no fetch in progress
+	 * may still be using it
 	 * Note error responses are not sent for PDU_PROFILE
 	 */
 	if (__pmDecodeProfile(pb, &ctxnum, &new_profile) < 0) 
@@ -151,7 +236,7 @@ __pmdaMainPDU(pmdaInterface *dispatch)
 	if (sts < 0) {
 	    __pmFreeProfile(new_profile);
 	} else {
-	    __pmFreeProfile(profile);
+	    __pmdaRetireProfile(profile);
 	    profile = new_profile;
 	}
 	break;
@@ -166,14 +251,22 @@ __pmdaMainPDU(pmdaInterface *dispatch)
 	 */
 	sts = __pmDecodeFetch(pb, &ctxnum, &when, &npmids, &pmidlist);
 	if (sts >= 0) {
+	    /*
+	     * result is released below, before the next fetch, so unless
+	     * the PMDA cleans up itself pmdaFetch can use its arena
+	     */
+	    extp->arena.enabled = (pmda->e_resultCallBack == __pmFreeResultValues);
 	    sts = dispatch->version.any.fetch(npmids, pmidlist, &result, pmda);
+	    extp->arena.enabled = 0;
 	    __pmUnpinPDUBuf(pmidlist);
 	}
 	if (sts < 0) {
 	    __pmSendError(pmda->e_outfd, FROM_ANON, sts);
 	} else {
 	    __pmSendResult(pmda->e_outfd, FROM_ANON, result);
-	    if (pmda->e_resultCallBack)
+	    if (extp->arena.inuse && result == extp->res)
+		;	/* arena values, reset by the next pmdaFetch */
+	    else if (pmda->e_resultCallBack)
 		pmda->e_resultCallBack(result);
 	}
 	break;
@@ -291,50 +384,9 @@ __pmdaMainPDU(pmdaInterface *dispatch)
 	break;
 
     case PDU_LABEL_REQ:
-	if (pmDebugOptions.libpmda)
-	    pmNotifyErr(LOG_DEBUG, "Received PDU_LABEL_REQ\n");
-
-	if ((sts = __pmDecodeLabelReq(pb, &ident, &type)) >= 0 &&
-	    HAVE_V_SEVEN(dispatch->comm.pmda_interface)) {
-	    ctxnum = dispatch->version.seven.ext->e_context;
-	    sts = dispatch->version.seven.label(ident, type, &labels, pmda);
-	}
-	if (sts < 0)
-	    __pmSendError(pmda->e_outfd, FROM_ANON, sts);
-	else {
-	    if (sts > 0 && !(type & PM_LABEL_INSTANCES))
-		sts = 1;
-	    __pmSendLabel(pmda->e_outfd, FROM_ANON, ident, type, labels, sts);
-	    pmFreeLabelSets(labels, sts);
-	}
-	break;
-
     case PDU_INSTANCE_REQ:
-	if (pmDebugOptions.libpmda)
-	    pmNotifyErr(LOG_DEBUG, "Received PDU_INSTANCE_REQ\n");
-
-	if ((sts = __pmDecodeInstanceReq(pb, &when, &indom, &inst, &iname)) >= 0)
-	    sts = dispatch->version.any.instance(indom, inst, iname, &inres, pmda);
-	if (sts < 0)
-	    __pmSendError(pmda->e_outfd, FROM_ANON, sts);
-	else {
-	    __pmSendInstance(pmda->e_outfd, FROM_ANON, inres);
-	    __pmFreeInResult(inres);
-	}
-	if (iname)
-	    free(iname);
-	break;
-
     case PDU_TEXT_REQ:
-	if (pmDebugOptions.libpmda)
-	    pmNotifyErr(LOG_DEBUG, "Received PDU_TEXT_REQ\n");
-
-	if ((sts = __pmDecodeTextReq(pb, &ident, &type)) >= 0)
-	    sts = dispatch->version.any.text(ident, type, &buffer, pmda);
-	if (sts < 0)
-	    __pmSendError(pmda->e_outfd, FROM_ANON, sts);
-	else
-	    __pmSendText(pmda->e_outfd, FROM_ANON, ident, buffer);
+	__pmdaRequestPDU(dispatch, pmda, sts, pb);
 	break;
 
     case PDU_RESULT:
@@ -393,6 +445,8 @@ __pmdaMainPDU(pmdaInterface *dispatch)
 void 
 pmdaMain(pmdaInterface *dispatch)
 {
+    if (__pmdaMainThreads(dispatch) == 0)
+	return;
     for ( ; ; ) {
 	if (__pmdaMainPDU(dispatch) < 0)
 	    break;
@@ -435,6 +489,22 @@ pmdaSetFetchCallBack(pmdaInterface *dispatch, pmdaFetchCallBack callback)
     }
 }
 
+void
+pmdaSetFetchBulkCallBack(pmdaInterface *dispatch, pmdaFetchBulkCallBack callback)
+{
+    e_ext_t	*extp;
+
+    if (HAVE_ANY(dispatch->comm.pmda_interface)) {
+	extp = (e_ext_t *)dispatch->version.any.ext->e_ext;
+	extp->bulkCallBack = callback;
+    }
+    else {
+	pmNotifyErr(LOG_CRIT, "Unable to set fetch bulk callback for PMDA interface version %d.",
+		     dispatch->comm.pmda_interface);
+	dispatch->status = PM_ERR_GENERIC;
+    }
+}
+
 void
 pmdaSetCheckCallBack(pmdaInterface *dispatch, pmdaCheckCallBack callback)
 {
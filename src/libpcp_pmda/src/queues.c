@@ -1,14 +1,14 @@
 /*
  * Generic event queue support for PMDAs
  *
- * Copyright (c) 2011,2015-2016 Red Hat.
+ * Copyright (c) 2011,2015-2016,2019 Red Hat.
  * Copyright (c) 2011 Nathan Scott.  All rights reserved.
- * 
+ *
  * This library is free software; you can redistribute it and/or modify it
  * under the terms of the GNU Lesser General Public License as published
  * by the Free Software Foundation; either version 2.1 of the License, or
  * (at your option) any later version.
- * 
+ *
  * This library is distributed in the hope that it will be useful, but
  * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
  * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
@@ -19,6 +19,9 @@
 #include "pmda.h"
 #include "queues.h"
 #include <ctype.h>
+#ifdef HAVE_SCHED_H
+#include <sched.h>
+#endif
 
 static event_queue_t *queues;
 static int numqueues;
@@ -26,6 +29,7 @@ static int numqueues;
 static event_client_t *clients;
 static int numclients;
 static event_client_t *client_lookup(int context);
+static event_clientq_t *client_queue_lookup(int, int, int);
 
 typedef void (*clientVisitCallBack)(event_clientq_t *, event_queue_t *, void *);
 static void client_iterate(clientVisitCallBack, int, event_queue_t *, void *);
@@ -43,51 +47,130 @@ queue_lookup(int handle)
     return NULL;
 }
 
-/*
- * Drop an event after it has been queued (i.e. client was too slow)
- */
 static void
-queue_drop(event_clientq_t *clientq, event_queue_t *queue, void *data)
+queue_wait(void)
 {
-    event_t *event = (event_t *)data;
-
-    if (clientq->last != NULL && clientq->last == event) {
-	clientq->last = TAILQ_NEXT(event, events);
-	clientq->missed++;
+#ifdef HAVE_SCHED_H
+    sched_yield();
+#endif
+}
 
-	if (pmDebugOptions.libpmda)
-	    pmNotifyErr(LOG_DEBUG, "Client missed queue %s event %p",
-			queue->name, event);
+static void
+ring_copyin(event_queue_t *queue, __uint64_t pos, const void *data, size_t bytes)
+{
+    size_t	offset = pos % queue->ringsize;
+    size_t	space = queue->ringsize - offset;
+
+    if (bytes <= space) {
+	memcpy(queue->ring + offset, data, bytes);
+    } else {
+	memcpy(queue->ring + offset, data, space);
+	memcpy(queue->ring, (const char *)data + space, bytes - space);
     }
 }
 
 static void
-queue_drop_bytes(int handle, event_queue_t *queue, size_t bytes)
+ring_copyout(event_queue_t *queue, __uint64_t pos, void *data, size_t bytes)
 {
-    event_t *event, *next;
+    size_t	offset = pos % queue->ringsize;
+    size_t	space = queue->ringsize - offset;
+
+    if (bytes <= space) {
+	memcpy(data, queue->ring + offset, bytes);
+    } else {
+	memcpy(data, queue->ring + offset, space);
+	memcpy((char *)data + space, queue->ring, bytes - space);
+    }
+}
 
-    event = TAILQ_FIRST(&queue->tailq);
-    while (event) {
-	if (bytes <= queue->maxmemory - queue->qsize)
-	    break;
-	next = TAILQ_NEXT(event, events);
+/*
+ * Allocate the ring once, when the first client shows an interest
+ * in this queue - events arriving before then are not kept.  The
+ * ring is sized at twice the largest possible event record, so the
+ * maxmemory limit on event data is reached before the ring fills up
+ * (unless events are very small, relative to their record headers).
+ */
+static int
+queue_setup(event_queue_t *queue)
+{
+    size_t	size;
+    char	*ring;
 
-	if (pmDebugOptions.libpmda)
-	    pmNotifyErr(LOG_DEBUG, "Dropping %s: e=%p sz=%d max=%d qsz=%d",
-				    queue->name, event, (int)event->size,
-				    (int)queue->maxmemory, (int)queue->qsize);
+    if (queue->ring)
+	return 0;
 
-	/* Walk clients - if event last seen, drop it and bump missed count */
-	client_iterate(queue_drop, handle, queue, event);
+    size = RECORD_ALIGN(sizeof(event_record_t) + queue->maxmemory) * 2;
+    if ((queue->scratch = malloc(queue->maxmemory + 1)) == NULL ||
+	(ring = malloc(size)) == NULL) {
+	pmNotifyErr(LOG_ERR, "event queue %s allocation failure: %ld bytes",
+			queue->name, (long)size);
+	free(queue->scratch);
+	queue->scratch = NULL;
+	return -ENOMEM;
+    }
+    queue->ringsize = size;
+    queue_store(&queue->ring, ring);
+    return 0;
+}
 
-	if (pmDebugOptions.libpmda)
-	    pmNotifyErr(LOG_DEBUG, "Removing %s event %p (%d bytes)",
-				    queue->name, event, (int)event->size);
+/*
+ * Event data currently held in the ring (the two counters are read
+ * separately, so briefly the released data may include events not
+ * yet seen as queued).
+ */
+static __uint64_t
+queue_memory(event_queue_t *queue)
+{
+    __uint64_t	released = queue_load(&queue->released);
+    __uint64_t	queued = queue_load(&queue->queued);
+
+    return queued > released ? queued - released : 0;
+}
+
+/*
+ * Move the queue head past the oldest event, if no other thread did
+ * so first.  The record header is only trusted once the head update
+ * succeeds, as no append can overwrite it until the head has moved.
+ */
+static int
+queue_advance(event_queue_t *queue, __uint64_t head, event_record_t *record)
+{
+    ring_copyout(queue, head, record, sizeof(*record));
+    if (!queue_cas(&queue->head, &head, head + record->length))
+	return 0;
+    queue_add(&queue->released, record->size);
+    return 1;
+}
 
-	TAILQ_REMOVE(&queue->tailq, event, events);
-	queue->qsize -= event->size;
-	free(event);
-	event = next;
+/*
+ * Drop events after they have been queued (i.e. clients were too slow),
+ * oldest first, until there is space in the ring up to the given end
+ * position and the event data fits within the queue memory limit.
+ * Clients notice the gap in event sequence numbers on their next fetch.
+ */
+static void
+queue_drop_bytes(event_queue_t *queue, __uint64_t end, size_t bytes)
+{
+    event_record_t	record;
+    __uint64_t		head;
+
+    for (;;) {
+	head = queue_load(&queue->head);
+	if (end - head <= queue->ringsize &&
+	    queue_memory(queue) + bytes <= queue->maxmemory)
+	    break;
+	if (head >= queue_load(&queue->commit)) {
+	    /* only appends still being copied in, wait for those */
+	    if (end - head <= queue->ringsize)
+		break;
+	    queue_wait();
+	    continue;
+	}
+	if (queue_advance(queue, head, &record) && pmDebugOptions.libpmda)
+	    pmNotifyErr(LOG_DEBUG, "Dropping %s: e=%" FMT_UINT64 " sz=%d max=%d qsz=%d",
+				    queue->name, record.seq, (int)record.size,
+				    (int)queue->maxmemory,
+				    (int)(record.size + queue_memory(queue)));
     }
 }
 
@@ -96,7 +179,7 @@ pmdaEventNewActiveQueue(const char *name, size_t maxmemory, unsigned int numclie
 {
     event_queue_t *queue;
     size_t size;
-    int i;
+    int i, sts;
 
     if (name == NULL || maxmemory <= 0)
 	return -EINVAL;
@@ -110,32 +193,30 @@ pmdaEventNewActiveQueue(const char *name, size_t maxmemory, unsigned int numclie
 	    break;
     if (i == numqueues) {
 	/*
-	 * No free slots - extend the available set.
-	  realloc potentially moves "queues" address, fix up 
-	 * must tear down existing queues which may have back
-	 * references and then re-initialise them afterward.
+	 * No free slots - extend the available set.  Queues hold
+	 * no pointers to themselves, so they can safely be moved
+	 * (but not while events are being appended concurrently).
 	 */
-	for (i = 0; i < numqueues; i++)
-	    queue_drop_bytes(i, &queues[i], INT_MAX);
 	size = (numqueues + 1) * sizeof(event_queue_t);
 	queues = realloc(queues, size);
 	if (!queues)
 	    pmNoMem("pmdaEventNewQueue", size, PM_FATAL_ERR);
-	/* realloc moves tailq tqh_last pointer - reset 'em */
-	for (i = 0; i < numqueues; i++)
-	    TAILQ_INIT(&queues[i].tailq);
 	numqueues++;
     }
 
     /* "i" now indexes into a free slot */
     queue = &queues[i];
     memset(queue, 0, sizeof(*queue));
-    TAILQ_INIT(&queue->tailq); 
     queue->eventarray = pmdaEventNewArray();
     queue->numclients = numclients;
     queue->maxmemory = maxmemory;
     queue->inuse = 1;
     queue->name = name;
+    if (numclients > 0 && (sts = queue_setup(queue)) < 0) {
+	pmdaEventReleaseArray(queue->eventarray);
+	memset(queue, 0, sizeof(*queue));
+	return sts;
+    }
     return i;
 }
 
@@ -163,7 +244,7 @@ pmdaEventQueueCounter(int handle, pmAtomValue *atom)
 
     if (!queue)
 	return -EINVAL;
-    atom->ul = queue->count;
+    atom->ul = queue_load(&queue->records) + queue_load(&queue->unqueued);
     return PMDA_FETCH_STATIC;
 }
 
@@ -174,7 +255,7 @@ pmdaEventQueueClients(int handle, pmAtomValue *atom)
 
     if (!queue)
 	return -EINVAL;
-    atom->ul = queue->numclients;
+    atom->ul = queue_load(&queue->numclients);
     return PMDA_FETCH_STATIC;
 }
 
@@ -185,7 +266,7 @@ pmdaEventQueueMemory(int handle, pmAtomValue *atom)
 
     if (!queue)
 	return -EINVAL;
-    atom->ull = queue->qsize;
+    atom->ull = queue_memory(queue);
     return PMDA_FETCH_STATIC;
 }
 
@@ -196,15 +277,35 @@ pmdaEventQueueBytes(int handle, pmAtomValue *atom)
 
     if (!queue)
 	return -EINVAL;
-    atom->ull = queue->bytes;
+    atom->ull = queue_load(&queue->queued) + queue_load(&queue->unqueuedbytes);
     return PMDA_FETCH_STATIC;
 }
 
+int
+pmdaEventQueueDropped(int handle, pmAtomValue *atom, int context)
+{
+    event_clientq_t *clientq = client_queue_lookup(context, handle, 0);
+    event_queue_t *queue = queue_lookup(handle);
+
+    if (!queue)
+	return -EINVAL;
+    atom->ull = clientq ? clientq->dropped : 0;
+    return PMDA_FETCH_STATIC;
+}
+
+/*
+ * Append an event to the ring - this may be called from any thread,
+ * concurrently with other appends and with client fetches.  Space is
+ * reserved by advancing the reserve position, so several events can
+ * be copied in at once, but they are completed (committed) in ring
+ * order and only then become visible to clients.
+ */
 int
 pmdaEventQueueAppend(int handle, void *data, size_t bytes, struct timeval *tv)
 {
     event_queue_t *queue = queue_lookup(handle);
-    event_t *event;
+    event_record_t record;
+    __uint64_t pos;
 
     if (!queue)
 	return -EINVAL;
@@ -214,44 +315,50 @@ pmdaEventQueueAppend(int handle, void *data, size_t bytes, struct timeval *tv)
     if (bytes > queue->maxmemory) {
 	pmNotifyErr(LOG_WARNING, "Event too large for queue %s (%ld > %ld)",
 			queue->name, (long)bytes, (long)queue->maxmemory);
-	goto done;
+	goto unqueued;
     }
+    if (queue_load(&queue->numclients) == 0 || queue_load(&queue->ring) == NULL)
+	goto unqueued;
+
+    /* Track the actual event data */
+    memset(&record, 0, sizeof(record));
+    memcpy(&record.time, tv, sizeof(*tv));
+    record.length = RECORD_ALIGN(sizeof(record) + bytes);
+    record.size = bytes;
+    pos = queue_fetch_add(&queue->reserve, record.length);
 
     /*
      * We may need to make room in the event queue.  If so, start at the head
-     * and madly drop events until sufficient space exists or all are freed.
-     * Bump the missed counter for each client who missed an event we had to
-     * throw away.
+     * and madly drop events until sufficient space exists.  The head must be
+     * seen to move before the space is reused, so clients reading an event
+     * as it is being overwritten can detect that and discard their copy.
      */
-    queue_drop_bytes(handle, queue, bytes);
-    if (queue->numclients == 0)
-	goto done;
-
-    if ((event = malloc(sizeof(event_t) + bytes + 1)) == NULL) {
-	pmNotifyErr(LOG_ERR, "event allocation failure: %ld bytes",
-			(long)(bytes + 1));
-	return -ENOMEM;
-    }
-
-    /* Track the actual event data */
-    event->count = queue->numclients;
-    memcpy(event->buffer, data, bytes);
-    memcpy(&event->time, tv, sizeof(*tv));
-    event->size = bytes;
-
-    /* Finally, store the event in the queue */
-    TAILQ_INSERT_TAIL(&queue->tailq, event, events);
-    queue->qsize += bytes;
+    queue_drop_bytes(queue, pos + record.length, bytes);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    ring_copyin(queue, pos + sizeof(record), data, bytes);
+
+    /* Finally, number and publish the event once all earlier ones are */
+    while (queue_load(&queue->turn) != pos)
+	queue_wait();
+    record.seq = queue->records;
+    ring_copyin(queue, pos, &record, sizeof(record));
+    queue_store(&queue->queued, queue->queued + bytes);
+    queue_store(&queue->commit, pos + record.length);
+    queue_store(&queue->records, record.seq + 1);
+    queue_store(&queue->turn, pos + record.length);
 
     if (pmDebugOptions.libpmda)
 	pmNotifyErr(LOG_DEBUG,
-			"Inserted %s event %p (%ld bytes) clients = %d",
-			queue->name, event, (long)event->size, event->count);
+			"Inserted %s event %" FMT_UINT64 " (%ld bytes) clients = %d",
+			queue->name, record.seq, (long)bytes,
+			(int)queue_load(&queue->numclients));
 
-done:
+    return 0;
+
+unqueued:
     /* Update event queue tracking stats (even for no-clients case) */
-    queue->bytes += bytes;
-    queue->count++;
+    queue_add(&queue->unqueuedbytes, bytes);
+    queue_add(&queue->unqueued, 1);
     return 0;
 }
 
@@ -273,93 +380,198 @@ queue_filter(event_clientq_t *clientq, void *data, size_t size)
     return 0;
 }
 
+/*
+ * Copy one event out of the ring, then check that it was not dropped
+ * (and its space reused) by a concurrent append while being copied.
+ */
+static int
+queue_read(event_queue_t *queue, __uint64_t pos, event_record_t *record)
+{
+    ring_copyout(queue, pos, record, sizeof(*record));
+    if (record->size <= queue->maxmemory)
+	ring_copyout(queue, pos + sizeof(*record), queue->scratch, record->size);
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    if (queue_load(&queue->head) > pos)
+	return -1;
+    queue->scratch[record->size] = '\0';
+    return 0;
+}
+
+/*
+ * Consistent view of the commit position and the sequence number of
+ * the event to be committed there - while an append is between these
+ * updates, the turn position lags behind the commit position.
+ */
+static void
+queue_snapshot(event_queue_t *queue, __uint64_t *commit, __uint64_t *seq)
+{
+    __uint64_t	records;
+
+    for (;;) {
+	records = queue_load(&queue->records);
+	*commit = queue_load(&queue->commit);
+	if (queue_load(&queue->turn) == *commit &&
+	    queue_load(&queue->records) == records)
+	    break;
+	queue_wait();
+    }
+    *seq = records;
+}
+
 static int
 queue_fetch(event_queue_t *queue, event_clientq_t *clientq, pmAtomValue *atom,
 	    pmdaEventDecodeCallBack queue_decoder, void *data)
 {
-    event_t *event, *next;
+    event_record_t record;
+    __uint64_t pos, head, end;
     int records, key, sts;
 
     /*
      * Ensure the way we keep track of which clients are interested
-     * in which queues is up to date.
+     * in which queues is up to date.  New clients start out with the
+     * oldest event still queued or, if there are none, with the next
+     * event to arrive (so any events dropped from then on are known).
      */
     if (clientq->active == 0) {
+	if ((sts = queue_setup(queue)) < 0)
+	    return sts;
+	queue_snapshot(queue, &end, &clientq->seq);
+	head = queue_load(&queue->head);
+	clientq->started = (head >= end);
+	clientq->cursor = clientq->started ? end : head;
 	clientq->active = 1;
-	queue->numclients++;
+	queue_add(&queue->numclients, 1);
     }
-    if (clientq->last == NULL)
-	clientq->last = TAILQ_FIRST(&queue->tailq);
-    event = clientq->last;
+    pos = clientq->cursor;
+    end = queue_load(&queue->commit);
 
     if (pmDebugOptions.libpmda)
-	pmNotifyErr(LOG_DEBUG, "queue_fetch start, last event=%p", event);
+	pmNotifyErr(LOG_DEBUG, "queue_fetch start, cursor=%" FMT_UINT64
+			" commit=%" FMT_UINT64, pos, end);
 
     sts = records = 0;
     key = queue->eventarray;
     pmdaEventResetArray(key);
 
-    while (event != NULL) {
+    while (pos < end) {
 	char	message[64];
 
-	if (queue_filter(clientq, event->buffer, event->size)) {
+	if ((head = queue_load(&queue->head)) > pos) {
+	    pos = head;		/* events dropped, client too slow */
+	    continue;
+	}
+	if (queue_read(queue, pos, &record) < 0)
+	    continue;
+	pos += record.length;
+
+	/* Did this client miss any events since the last one it saw? */
+	if (clientq->started && record.seq > clientq->seq) {
+	    clientq->missed += record.seq - clientq->seq;
+	    clientq->dropped += record.seq - clientq->seq;
+	    if (pmDebugOptions.libpmda)
+		pmNotifyErr(LOG_DEBUG, "Client missed queue %s events %"
+			FMT_UINT64 "-%" FMT_UINT64, queue->name,
+			clientq->seq, record.seq - 1);
+	}
+	clientq->seq = record.seq + 1;
+	clientq->started = 1;
+
+	if (queue_filter(clientq, queue->scratch, record.size)) {
 	    if (pmDebugOptions.libpmda)
-		pmNotifyErr(LOG_DEBUG, "Culling event (sz=%ld): \"%s\"", 
-				(long)event->size,
-				__pmdaEventPrint(event->buffer, event->size,
+		pmNotifyErr(LOG_DEBUG, "Culling event (sz=%ld): \"%s\"",
+				(long)record.size,
+				__pmdaEventPrint(queue->scratch, record.size,
 					message, sizeof(message)));
 	} else {
 	    if (pmDebugOptions.libpmda)
-		pmNotifyErr(LOG_DEBUG, "Adding event (sz=%ld): \"%s\"", 
-				(long)event->size,
-				__pmdaEventPrint(event->buffer, event->size,
+		pmNotifyErr(LOG_DEBUG, "Adding event (sz=%ld): \"%s\"",
+				(long)record.size,
+				__pmdaEventPrint(queue->scratch, record.size,
 					message, sizeof(message)));
 	    if ((sts = queue_decoder(key,
-			event->buffer, event->size, &event->time, data)) < 0)
+			queue->scratch, record.size, &record.time, data)) < 0)
 		break;
 	    records += sts;
 	    sts = 0;
 	}
+    }
 
-	next = TAILQ_NEXT(event, events);
+    /* Update queue read cursor for this client. */
+    clientq->cursor = pos;
 
-	/* Remove the current one (if its use count hits zero) */
-	if (--event->count <= 0) {
-	    if (pmDebugOptions.libpmda)
-		pmNotifyErr(LOG_DEBUG, "Removing %s event %p in fetch",
-					queue->name, event);
-	    TAILQ_REMOVE(&queue->tailq, event, events);
-	    queue->qsize -= event->size;
-	    free(event);
-	}
+    if (sts == 0 && clientq->missed > 0) {
+	struct timeval timestamp;
 
-	/* Go on to the next event. */
-	event = next;
+	gettimeofday(&timestamp, NULL);
+	sts = pmdaEventAddMissedRecord(key, &timestamp, clientq->missed);
+	clientq->missed = 0;
+	records++;
     }
 
+    atom->vbp = records ? (pmValueBlock *)pmdaEventGetAddr(key) : NULL;
+    return sts;
+}
+
+/*
+ * Once every client has read past the oldest events, release their
+ * space in the ring (this is the memory reported for the queue).
+ */
+typedef struct {
+    __uint64_t		cursor;
+    unsigned int	count;
+} queue_cursor_t;
+
+static void
+queue_cursor(event_clientq_t *clientq, event_queue_t *queue, void *data)
+{
+    queue_cursor_t	*oldest = (queue_cursor_t *)data;
+
+    if (clientq->cursor < oldest->cursor)
+	oldest->cursor = clientq->cursor;
+    oldest->count++;
+}
+
+static void
+queue_trim(int handle, event_queue_t *queue)
+{
+    event_record_t	record;
+    queue_cursor_t	oldest;
+    __uint64_t		head, pos, first, bytes;
+
+    if (queue->ring == NULL)
+	return;
+
+    oldest.cursor = queue_load(&queue->commit);
+    oldest.count = 0;
+    client_iterate(queue_cursor, handle, queue, &oldest);
+    if (oldest.count < queue_load(&queue->numclients))
+	return;		/* some clients have not fetched yet */
+
     /*
-     * Did this client miss any events?  The "extra" one is the last previously
-     * observed event (pointed at by per-context last pointer) - so, event only
-     * missed once we move past *more* than just that last observed event.
+     * Release all of these events at once - the record headers walked
+     * here are only trusted if the head has not moved meanwhile (they
+     * may be overwritten by appends as soon as it does).
      */
-    if (sts == 0) {
-	sts = clientq->missed - 1;
-	clientq->missed = 0;
-	if (sts > 0) {
-	    struct timeval timestamp;
-	    gettimeofday(&timestamp, NULL);
-	    sts = pmdaEventAddMissedRecord(key, &timestamp, sts);
-	    records++;
-	} else {
-	    sts = 0;
+    while ((head = queue_load(&queue->head)) < oldest.cursor) {
+	first = ~0ULL;
+	for (pos = head, bytes = 0; pos < oldest.cursor; pos += record.length) {
+	    ring_copyout(queue, pos, &record, sizeof(record));
+	    if (record.length < sizeof(record) || record.length > queue->ringsize)
+		break;
+	    if (first == ~0ULL)
+		first = record.seq;
+	    bytes += record.size;
+	}
+	if (pos < oldest.cursor)
+	    continue;
+	if (queue_cas(&queue->head, &head, pos)) {
+	    queue_add(&queue->released, bytes);
+	    if (pmDebugOptions.libpmda)
+		pmNotifyErr(LOG_DEBUG, "Removing %s events %" FMT_UINT64 "-%"
+			    FMT_UINT64 " in fetch", queue->name, first, record.seq);
+	    break;
 	}
     }
-
-    /* Update queue tail pointer for this client. */
-    clientq->last = NULL;
-
-    atom->vbp = records ? (pmValueBlock *)pmdaEventGetAddr(key) : NULL;
-    return sts;
 }
 
 static event_clientq_t *
@@ -395,6 +607,7 @@ client_queue_lookup(int context, int handle, int accessq)
     return &client->clientq[handle];
 }
 
+
 int
 pmdaEventQueueRecords(int handle, pmAtomValue *atom, int context,
 	    pmdaEventDecodeCallBack queue_decoder, void *data)
@@ -407,6 +620,7 @@ pmdaEventQueueRecords(int handle, pmAtomValue *atom, int context,
 	return -EINVAL;
 
     sts = queue_fetch(queue, clientq, atom, queue_decoder, data);
+    queue_trim(handle, queue);
     if (sts != 0)
 	return sts;
     return (atom->vbp == NULL) ? PMDA_FETCH_NOVALUES : PMDA_FETCH_STATIC;
@@ -417,18 +631,19 @@ queue_release(event_queue_t *queue)
 {
     /* free resources and mark as no longer inuse */
     pmdaEventReleaseArray(queue->eventarray);
+    free(queue->scratch);
+    free(queue->ring);
     memset(queue, 0, sizeof(*queue));
 }
 
 /*
  * We've lost a client (disconnected).
- * Cleanup any filter and any back references across the queues.
+ * Cleanup any filter and release any events only it had not yet seen.
  */
 static void
 queue_cleanup(int handle, event_clientq_t *clientq)
 {
     event_queue_t *queue = queue_lookup(handle);
-    event_t *event, *next;
 
     if (clientq->release)
 	clientq->release(clientq->filter);
@@ -440,29 +655,17 @@ queue_cleanup(int handle, event_clientq_t *clientq)
 	pmNotifyErr(LOG_DEBUG, "queue_cleanup: %s numclients=%d",
 			queue->name, queue->numclients);
 
-    event = clientq->last;
-    while (event) {
-	next = TAILQ_NEXT(event, events);
-
-	/* Remove the current event (if use count hits zero) */
-	if (--event->count <= 0) {
-	    if (pmDebugOptions.libpmda)
-		pmNotifyErr(LOG_DEBUG, "Removing %s event %p",
-				queue->name, event);
-	    TAILQ_REMOVE(&queue->tailq, event, events);
-	    queue->qsize -= event->size;
-	    free(event);
-	}
-	event = next;
-    }
-
-    if (--queue->numclients <= 0) {
+    clientq->active = 0;
+    if (queue_sub(&queue->numclients, 1) <= 0) {
 	if (pmDebugOptions.libpmda)
 	    pmNotifyErr(LOG_DEBUG, "queue_cleanup: %s final shutdown=%d",
 			    queue->name, queue->shutdown);
-	if (queue->shutdown)
+	if (queue->shutdown) {
 	    queue_release(queue);
+	    return;
+	}
     }
+    queue_trim(handle, queue);
 }
 
 int
@@ -0,0 +1,292 @@
+/*
+ * Per-cluster refresh caching support for PMDAs
+ *
+ * Copyright (c) 2019 Red Hat.
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ * License for more details.
+ */
+
+#include "pmapi.h"
+#include "libpcp.h"
+#include "pmda.h"
+
+/*
+ * Many clients (pmlogger, pmie, pmproxy, ...) commonly sample the same
+ * metrics at (almost) the same time.  A PMDA can use these routines to
+ * share the values from one refresh of a cluster with all requests in
+ * a short time window, rather than re-reading (and re-parsing) its data
+ * sources for each request.
+ *
+ * Refresh time is charged to a cluster as the time elapsed since the
+ * previous pmdaRefreshCheck or pmdaRefreshDone call, so the expected
+ * usage is to check all clusters first, then refresh those needed in
+ * turn, marking each done as soon as its refresh completes.
+ */
+
+typedef struct {
+    struct timeval	stamp;		/* completion of last shared refresh */
+    int			window;		/* freshness window, milliseconds */
+    unsigned int	valid : 1;	/* stamp is usable (last was shared) */
+    unsigned int	pending : 1;	/* refresh requested, not yet done */
+    unsigned int	shared : 1;	/* pending refresh may be shared */
+    unsigned int	padding : 29;
+    pmdaRefreshStats	stats;
+} refresh_cluster_t;
+
+struct pmdaRefresh {
+    int			nclusters;
+    int			window;		/* default freshness window */
+    struct timeval	mark;		/* start of current timing interval */
+    refresh_cluster_t	*clusters;
+};
+
+static __uint64_t
+refresh_mark(pmdaRefresh *refresh, struct timeval *now)
+{
+    __uint64_t		usec;
+
+    pmtimevalNow(now);
+    usec = (__uint64_t)(pmtimevalSub(now, &refresh->mark) * 1000000.0);
+    refresh->mark = *now;
+    return usec;
+}
+
+pmdaRefresh *
+pmdaRefreshCreate(int nclusters, int window)
+{
+    pmdaRefresh		*refresh;
+    int			i;
+
+    if (nclusters <= 0)
+	return NULL;
+    if ((refresh = calloc(1, sizeof(*refresh))) == NULL)
+	return NULL;
+    if ((refresh->clusters = calloc(nclusters, sizeof(refresh_cluster_t))) == NULL) {
+	free(refresh);
+	return NULL;
+    }
+    refresh->nclusters = nclusters;
+    refresh->window = window < 0 ? 0 : window;
+    for (i = 0; i < nclusters; i++)
+	refresh->clusters[i].window = -1;
+    pmtimevalNow(&refresh->mark);
+    return refresh;
+}
+
+void
+pmdaRefreshFree(pmdaRefresh *refresh)
+{
+    if (refresh) {
+	free(refresh->clusters);
+	free(refresh);
+    }
+}
+
+int
+pmdaRefreshSetWindow(pmdaRefresh *refresh, int cluster, int window)
+{
+    if (refresh == NULL)
+	return -EINVAL;
+    if (cluster < 0) {
+	refresh->window = window < 0 ? 0 : window;
+	return 0;
+    }
+    if (cluster >= refresh->nclusters)
+	return PM_ERR_PMID;
+    refresh->clusters[cluster].window = window;	/* negative: default */
+    return 0;
+}
+
+int
+pmdaRefreshGetWindow(pmdaRefresh *refresh, int cluster)
+{
+    if (refresh == NULL)
+	return 0;
+    if (cluster < 0 || cluster >= refresh->nclusters ||
+	refresh->clusters[cluster].window < 0)
+	return refresh->window;
+    return refresh->clusters[cluster].window;
+}
+
+static int
+refresh_fresh(pmdaRefresh *refresh, int cluster, int override,
+		struct timeval *now)
+{
+    refresh_cluster_t	*cp = &refresh->clusters[cluster];
+    double		age;
+    int			window;
+
+    window = override >= 0 ? override : pmdaRefreshGetWindow(refresh, cluster);
+    if (window <= 0 || !cp->valid)
+	return 0;
+    age = pmtimevalSub(now, &cp->stamp) * 1000.0;
+    if (age < 0 || age >= window)
+	return 0;
+    if (pmDebugOptions.libpmda)
+	fprintf(stderr, "pmdaRefresh: cluster %d fresh (age %.3fms)\n",
+		cluster, age);
+    return 1;
+}
+
+static void
+refresh_hit(refresh_cluster_t *cp)
+{
+    cp->stats.hits++;
+}
+
+static void
+refresh_miss(refresh_cluster_t *cp, int override)
+{
+    cp->stats.misses++;
+    cp->pending = 1;
+    cp->shared = (override != 0);
+    cp->valid = 0;
+}
+
+/*
+ * Returns non-zero if the cluster must be refreshed for this request.
+ * A non-negative override replaces the freshness window for just this
+ * request; zero forces a refresh, the results of which are then not
+ * shared with any later request (e.g. per-container values).
+ */
+int
+pmdaRefreshCheck(pmdaRefresh *refresh, int cluster, int override)
+{
+    refresh_cluster_t	*cp;
+    struct timeval	now;
+
+    if (refresh == NULL || cluster < 0 || cluster >= refresh->nclusters)
+	return 1;
+    cp = &refresh->clusters[cluster];
+    refresh_mark(refresh, &now);
+    if (refresh_fresh(refresh, cluster, override, &now)) {
+	refresh_hit(cp);
+	return 0;
+    }
+    refresh_miss(cp, override);
+    return 1;
+}
+
+/*
+ * Some clusters are refreshed together by a single operation, with any
+ * one of them being requested causing the entire group to be refreshed
+ * (and perhaps with refresh of some group members resetting the state
+ * of others).  Values are shared only when every requested cluster in
+ * the group is fresh, else all requested clusters are refreshed - and
+ * those not requested are then considered stale.  The group is a list
+ * of clusters terminated by a negative value; need[] is indexed by the
+ * cluster number, entries are cleared for any clusters being shared.
+ * Returns non-zero if the group must be refreshed for this request.
+ */
+int
+pmdaRefreshCheckGroup(pmdaRefresh *refresh, int *need, const int *group,
+		int override)
+{
+    refresh_cluster_t	*cp;
+    struct timeval	now;
+    int			i, c, requested = 0, stale = 0;
+
+    if (refresh == NULL) {
+	for (i = 0; (c = group[i]) >= 0; i++)
+	    if (need[c])
+		return 1;
+	return 0;
+    }
+    refresh_mark(refresh, &now);
+    for (i = 0; (c = group[i]) >= 0; i++) {
+	if (!need[c])
+	    continue;
+	requested = 1;
+	if (c >= refresh->nclusters ||
+	    !refresh_fresh(refresh, c, override, &now))
+	    stale = 1;
+    }
+    if (!requested)
+	return 0;
+    for (i = 0; (c = group[i]) >= 0; i++) {
+	if (c >= refresh->nclusters)
+	    continue;
+	cp = &refresh->clusters[c];
+	if (!need[c]) {
+	    if (stale)
+		cp->valid = 0;
+	} else if (stale) {
+	    refresh_miss(cp, override);
+	} else {
+	    refresh_hit(cp);
+	    need[c] = 0;
+	}
+    }
+    return stale;
+}
+
+static void
+refresh_done(refresh_cluster_t *cp, struct timeval *now, __uint64_t usec)
+{
+    if (!cp->pending)
+	return;
+    cp->stats.time += usec;
+    cp->stamp = *now;
+    cp->valid = cp->shared;
+    cp->pending = 0;
+}
+
+void
+pmdaRefreshDone(pmdaRefresh *refresh, int cluster)
+{
+    struct timeval	now;
+    __uint64_t		usec;
+
+    if (refresh == NULL || cluster < 0 || cluster >= refresh->nclusters)
+	return;
+    usec = refresh_mark(refresh, &now);
+    refresh_done(&refresh->clusters[cluster], &now, usec);
+}
+
+/*
+ * Clusters refreshed concurrently (e.g. in worker threads) cannot be
+ * timed by the interval between calls, so the caller measures it and
+ * reports completion later, from the thread that made the checks.
+ */
+void
+pmdaRefreshDoneTime(pmdaRefresh *refresh, int cluster, __uint64_t usec)
+{
+    struct timeval	now;
+
+    if (refresh == NULL || cluster < 0 || cluster >= refresh->nclusters)
+	return;
+    refresh_mark(refresh, &now);
+    refresh_done(&refresh->clusters[cluster], &now, usec);
+}
+
+void
+pmdaRefreshInvalidate(pmdaRefresh *refresh, int cluster)
+{
+    int			i;
+
+    if (refresh == NULL)
+	return;
+    if (cluster < 0) {
+	for (i = 0; i < refresh->nclusters; i++)
+	    refresh->clusters[i].valid = 0;
+    } else if (cluster < refresh->nclusters) {
+	refresh->clusters[cluster].valid = 0;
+    }
+}
+
+int
+pmdaRefreshGetStats(pmdaRefresh *refresh, int cluster, pmdaRefreshStats *stats)
+{
+    if (refresh == NULL || cluster < 0 || cluster >= refresh->nclusters)
+	return PM_ERR_PMID;
+    *stats = refresh->clusters[cluster].stats;
+    return (stats->hits || stats->misses);
+}
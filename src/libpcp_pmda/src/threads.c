@@ -0,0 +1,434 @@
+/*
+ * Multi-threaded request handling for pmdaMain
+ *
+ * Copyright (c) 2019 Red Hat.
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ * License for more details.
+ */
+
+#include "pmapi.h"
+#include "libpcp.h"
+#include "pmda.h"
+#include "libdefs.h"
+
+#define MAXTHREADS	64
+
+void
+pmdaSetThreads(pmdaInterface *dispatch, int nthreads)
+{
+    e_ext_t	*extp;
+
+    if (HAVE_V_FIVE(dispatch->comm.pmda_interface)) {
+	extp = (e_ext_t *)dispatch->version.any.ext->e_ext;
+	if (nthreads > MAXTHREADS)
+	    nthreads = MAXTHREADS;
+	extp->nthreads = nthreads;
+#if defined(PM_MULTI_THREAD) && defined(HAVE___THREAD)
+	/* replies are kept in order, so pmcd need not wait for each */
+	if (nthreads > 1)
+	    dispatch->comm.flags |= PDU_FLAG_PIPELINE;
+#endif
+    }
+    else {
+	pmNotifyErr(LOG_CRIT, "Unable to set threads for PMDA interface version %d.",
+		     dispatch->comm.pmda_interface);
+	dispatch->status = PM_ERR_GENERIC;
+    }
+}
+
+#if defined(PM_MULTI_THREAD) && defined(HAVE___THREAD)
+
+/*
+ * The main thread reads every PDU from pmcd.  Fetch, instance, text and
+ * label requests are queued for a pool of worker threads, each with a
+ * private pmdaExt and result (see pmdaFetch), so that requests for
+ * different contexts are processed concurrently while those for any one
+ * context are processed in the order they arrived.  Replies are sent
+ * strictly in request order, as pmcd expects, each worker waiting for
+ * its turn once its reply is complete.  Profiles are taken by the main
+ * thread at once, each request using the profile current when it was
+ * read; every other PDU is handled only after all earlier replies have
+ * been sent.  pmcd is told (PDU_FLAG_PIPELINE) that it may send further
+ * requests without waiting for each reply.  The instance, text and label
+ * methods walk the shared instance state, so they run one at a time,
+ * alongside the fetch callbacks but not the instance walks of fetches.
+ */
+
+typedef struct request {
+    struct request	*next;
+    __uint64_t		seq;		/* order in which PDU was read */
+    int			type;		/* PDU type */
+    int			context;	/* client context sending the PDU */
+    int			pinpdu;		/* PDU buffer pinned by the read */
+    __pmPDU		*pb;		/* request PDU from pmcd */
+    pmdaExt		pmda;		/* PMDA state when the PDU was read */
+} request_t;
+
+typedef struct {
+    pthread_t		thread;
+    int			context;	/* context being served, or -1 */
+    pmdaExt		pmda;		/* private pmdaExt for requests */
+    e_ext_t		ext;		/* private result and arena */
+} worker_t;
+
+typedef struct retired {
+    struct retired	*next;
+    __uint64_t		seq;		/* requests before this may use it */
+    pmProfile		*profile;
+} retired_t;
+
+static pthread_mutex_t	threads_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t	threads_queued = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t	threads_sent = PTHREAD_COND_INITIALIZER;
+static pmdaInterface	*threads_dispatch;
+static worker_t		*workers;
+static int		nworkers;
+static int		stopping;
+static request_t	*requests;	/* requests waiting for a worker */
+static request_t	*lastrequest;
+static __uint64_t	nextseq;	/* sequence number of next request */
+static __uint64_t	nextsend;	/* sequence number of next reply */
+static retired_t	*retired;	/* replaced profiles, oldest first */
+static retired_t	*lastretired;
+
+/*
+ * Take the oldest queued request for a context that is not already
+ * being served by another worker - called with threads_lock held.
+ */
+static request_t *
+request_take(worker_t *wp)
+{
+    request_t	*rp, *prev = NULL;
+    int		i;
+
+    for (rp = requests; rp != NULL; prev = rp, rp = rp->next) {
+	for (i = 0; i < nworkers; i++)
+	    if (workers[i].context == rp->context)
+		break;
+	if (i < nworkers)
+	    continue;
+	if (prev == NULL)
+	    requests = rp->next;
+	else
+	    prev->next = rp->next;
+	if (lastrequest == rp)
+	    lastrequest = prev;
+	wp->context = rp->context;
+	return rp;
+    }
+    return NULL;
+}
+
+static void
+worker_request(worker_t *wp, request_t *rp)
+{
+    pmdaInterface	*dispatch = threads_dispatch;
+    pmdaExt		*pmda = dispatch->version.any.ext;
+    e_ext_t		*extp = (e_ext_t *)pmda->e_ext;
+    pmResult		*result = NULL;
+    pmTimeval		when;
+    pmID		*pmidlist;
+    int			ctxnum, npmids, flags, sts = 0;
+
+    /*
+     * Refresh the private copies from the PMDA state taken by the main
+     * thread when this request was read.
+     */
+    flags = rp->pmda.e_flags;
+    wp->pmda = rp->pmda;
+    wp->pmda.e_context = rp->context;
+    wp->pmda.e_ext = (void *)&wp->ext;
+    wp->ext.dispatch = extp->dispatch;
+    wp->ext.hashpmids = extp->hashpmids;
+    wp->ext.ndynamics = extp->ndynamics;
+    wp->ext.dynamics = extp->dynamics;
+    wp->ext.privdata = extp->privdata;
+    wp->ext.bulkCallBack = extp->bulkCallBack;
+    wp->ext.worker = 1;
+
+    if (pmDebugOptions.libpmda) {
+	char	strbuf[20];
+	pmNotifyErr(LOG_DEBUG, "Received %s (context %d, thread %d)\n",
+			__pmPDUTypeStr_r(rp->type, strbuf, sizeof(strbuf)),
+			rp->context, (int)(wp - workers));
+    }
+
+    if (pmda->e_checkCallBack)
+	sts = (*(pmda->e_checkCallBack))();
+    if (rp->type != PDU_FETCH) {
+	/* held back until all earlier replies have been sent, below */
+	__pmXmitBatch(pmda->e_outfd);
+	if (sts < 0)
+	    __pmSendError(pmda->e_outfd, FROM_ANON, sts);
+	else {
+	    /* instance walks and the cache are shared with fetch threads */
+	    PM_LOCK(__pmdaWalkLock);
+	    __pmdaRequestPDU(dispatch, &wp->pmda, rp->type, rp->pb);
+	    PM_UNLOCK(__pmdaWalkLock);
+	}
+    }
+    else if (sts >= 0 &&
+	(sts = __pmDecodeFetch(rp->pb, &ctxnum, &when, &npmids, &pmidlist)) >= 0) {
+	wp->ext.arena.enabled = (pmda->e_resultCallBack == __pmFreeResultValues);
+	sts = dispatch->version.any.fetch(npmids, pmidlist, &result, &wp->pmda);
+	wp->ext.arena.enabled = 0;
+	__pmUnpinPDUBuf(pmidlist);
+    }
+    if (rp->pinpdu > 0)
+	__pmUnpinPDUBuf(rp->pb);
+
+    /* wait for all earlier replies, then send this one */
+    pthread_mutex_lock(&threads_lock);
+    while (rp->seq != nextsend)
+	pthread_cond_wait(&threads_sent, &threads_lock);
+    if (rp->type != PDU_FETCH) {
+	if ((sts = __pmXmitFlush(pmda->e_outfd)) < 0)
+	    pmNotifyErr(LOG_ERR, "%s: reply to pmcd: %s\n",
+			    pmda->e_name, pmErrStr(sts));
+    } else if (sts < 0) {
+	__pmSendError(pmda->e_outfd, FROM_ANON, sts);
+    } else {
+	__pmSendResult(pmda->e_outfd, FROM_ANON, result);
+	if (wp->ext.arena.inuse && result == wp->ext.res)
+	    ;	/* arena values, reset by the next pmdaFetch */
+	else if (pmda->e_resultCallBack)
+	    pmda->e_resultCallBack(result);
+	/* status change flags cleared by pmdaFetch, now sent */
+	pmda->e_flags &= ~(flags & ~wp->pmda.e_flags);
+    }
+    if (pmda->e_doneCallBack)
+	(*(pmda->e_doneCallBack))();
+    wp->context = -1;
+    nextsend++;
+    pthread_cond_broadcast(&threads_sent);
+    pthread_cond_broadcast(&threads_queued);
+    pthread_mutex_unlock(&threads_lock);
+    free(rp);
+}
+
+static void *
+worker_thread(void *arg)
+{
+    worker_t	*wp = (worker_t *)arg;
+    request_t	*rp;
+
+    __pmdaThreadContext();
+    pthread_mutex_lock(&threads_lock);
+    for ( ; ; ) {
+	while ((rp = request_take(wp)) == NULL && !stopping)
+	    pthread_cond_wait(&threads_queued, &threads_lock);
+	if (rp == NULL)
+	    break;
+	pthread_mutex_unlock(&threads_lock);
+	worker_request(wp, rp);
+	pthread_mutex_lock(&threads_lock);
+    }
+    pthread_mutex_unlock(&threads_lock);
+    return NULL;
+}
+
+static void
+worker_release(worker_t *wp)
+{
+    free(wp->ext.res);
+    free(wp->ext.arena.base);
+    free(wp->ext.bulkinst);
+    free(wp->ext.bulksts);
+    free(wp->ext.bulkatoms);
+}
+
+/* wait until every request read so far has been answered */
+static void
+requests_drain(void)
+{
+    pthread_mutex_lock(&threads_lock);
+    while (nextsend != nextseq)
+	pthread_cond_wait(&threads_sent, &threads_lock);
+    pthread_mutex_unlock(&threads_lock);
+}
+
+/*
+ * Free a profile replaced by the main thread, or if any request read
+ * before it was replaced is still in progress, once that is answered.
+ */
+void
+__pmdaRetireProfile(pmProfile *prof)
+{
+    retired_t	*pp;
+
+    if (prof == NULL)
+	return;
+    pthread_mutex_lock(&threads_lock);
+    if (workers == NULL || nextsend == nextseq ||
+	(pp = (retired_t *)malloc(sizeof(retired_t))) == NULL) {
+	if (workers != NULL)
+	    while (nextsend != nextseq)
+		pthread_cond_wait(&threads_sent, &threads_lock);
+	pthread_mutex_unlock(&threads_lock);
+	__pmFreeProfile(prof);
+	return;
+    }
+    pp->next = NULL;
+    pp->seq = nextseq;
+    pp->profile = prof;
+    if (lastretired == NULL)
+	retired = pp;
+    else
+	lastretired->next = pp;
+    lastretired = pp;
+    pthread_mutex_unlock(&threads_lock);
+}
+
+/* free the replaced profiles no longer in use by any request */
+static void
+profiles_reap(void)
+{
+    retired_t	*pp;
+
+    pthread_mutex_lock(&threads_lock);
+    while ((pp = retired) != NULL && pp->seq <= nextsend) {
+	if ((retired = pp->next) == NULL)
+	    lastretired = NULL;
+	pthread_mutex_unlock(&threads_lock);
+	__pmFreeProfile(pp->profile);
+	free(pp);
+	pthread_mutex_lock(&threads_lock);
+    }
+    pthread_mutex_unlock(&threads_lock);
+}
+
+/*
+ * Threaded equivalent of the pmdaMain loop, if requested and possible,
+ * returning zero when done (pmcd has gone away), else -1 if the caller
+ * should use the classic single-threaded loop instead.
+ */
+int
+__pmdaMainThreads(pmdaInterface *dispatch)
+{
+    pmdaExt		*pmda;
+    e_ext_t		*extp;
+    request_t		*rp;
+    __pmPDU		*pb;
+    int			i, sts, pinpdu;
+
+    if (dispatch->status != 0 || !HAVE_V_FIVE(dispatch->comm.pmda_interface))
+	return -1;
+    pmda = dispatch->version.any.ext;
+    extp = (e_ext_t *)pmda->e_ext;
+    if (extp->nthreads < 2)
+	return -1;
+    if (__pmdaMainCheck(dispatch) < 0)
+	return 0;
+
+    if ((workers = (worker_t *)calloc(extp->nthreads, sizeof(worker_t))) == NULL) {
+	pmNotifyErr(LOG_ERR, "%s: cannot allocate %d request threads, using one",
+			pmda->e_name, extp->nthreads);
+	return -1;
+    }
+    threads_dispatch = dispatch;
+    for (i = 0; i < extp->nthreads; i++)
+	workers[i].context = -1;
+    for (i = 0; i < extp->nthreads; i++) {
+	pthread_mutex_lock(&threads_lock);
+	sts = pthread_create(&workers[i].thread, NULL, worker_thread, &workers[i]);
+	if (sts == 0)
+	    nworkers++;
+	pthread_mutex_unlock(&threads_lock);
+	if (sts != 0) {
+	    pmNotifyErr(LOG_ERR, "%s: pthread_create: %s", pmda->e_name,
+			    pmErrStr(-sts));
+	    break;
+	}
+    }
+    if (nworkers == 0) {
+	free(workers);
+	workers = NULL;
+	return -1;
+    }
+    if (pmDebugOptions.libpmda)
+	pmNotifyErr(LOG_DEBUG, "pmdaMain: %d request threads\n", nworkers);
+
+    for ( ; ; ) {
+	pinpdu = sts = __pmGetPDU(pmda->e_infd, ANY_SIZE, TIMEOUT_NEVER, &pb);
+	if (pmDebugOptions.pdu && pmDebugOptions.desperate) {
+	    char	strbuf[20];
+	    fprintf(stderr, "__pmdaMainThreads: got PDU type %s from pmcd\n", __pmPDUTypeStr_r(sts, strbuf, sizeof(strbuf)));
+	}
+	if (sts == 0)
+	    break;
+	if (sts < 0) {
+	    pmNotifyErr(LOG_ERR, "IPC Error: %s\n", pmErrStr(sts));
+	    break;
+	}
+	if ((sts == PDU_FETCH || sts == PDU_INSTANCE_REQ ||
+	     sts == PDU_TEXT_REQ || sts == PDU_LABEL_REQ) &&
+	    (rp = (request_t *)malloc(sizeof(request_t))) != NULL) {
+	    /* ntohl() converted already in __pmGetPDU() */
+	    rp->type = sts;
+	    rp->context = ((__pmPDUHdr *)pb)->from;
+	    rp->pinpdu = pinpdu;
+	    rp->pb = pb;
+	    rp->next = NULL;
+	    pthread_mutex_lock(&threads_lock);
+	    /* e_flags is updated by the workers, with threads_lock held */
+	    rp->pmda = *pmda;
+	    rp->seq = nextseq++;
+	    if (lastrequest == NULL)
+		requests = rp;
+	    else
+		lastrequest->next = rp;
+	    lastrequest = rp;
+	    pthread_cond_signal(&threads_queued);
+	    pthread_mutex_unlock(&threads_lock);
+	    continue;
+	}
+	if (sts == PDU_PROFILE)		/* no reply, taken at once */
+	    __pmdaProcessPDU(dispatch, sts, pb, pinpdu);
+	else {
+	    requests_drain();
+	    __pmdaProcessPDU(dispatch, sts, pb, pinpdu);
+	}
+	profiles_reap();
+    }
+
+    /* answer anything outstanding, then stop the workers */
+    requests_drain();
+    profiles_reap();
+    pthread_mutex_lock(&threads_lock);
+    stopping = 1;
+    pthread_cond_broadcast(&threads_queued);
+    pthread_mutex_unlock(&threads_lock);
+    for (i = 0; i < nworkers; i++) {
+	pthread_join(workers[i].thread, NULL);
+	worker_release(&workers[i]);
+    }
+    free(workers);
+    workers = NULL;
+    nworkers = 0;
+    return 0;
+}
+
+#else /* !PM_MULTI_THREAD || !HAVE___THREAD */
+
+void
+__pmdaRetireProfile(pmProfile *prof)
+{
+    __pmFreeProfile(prof);
+}
+
+int
+__pmdaMainThreads(pmdaInterface *dispatch)
+{
+    (void)dispatch;
+    return -1;
+}
+
+#endif /* PM_MULTI_THREAD && HAVE___THREAD */
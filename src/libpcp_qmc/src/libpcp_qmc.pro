@@ -14,9 +14,9 @@ QMAKE_CXXFLAGS	+= $$(CFLAGS) $$(CXXFLAGS)
 QMAKE_LFLAGS	+= $$(LDFLAGS)
 
 HEADERS	= qmc_context.h qmc_desc.h qmc_group.h \
-	  qmc_indom.h qmc_metric.h qmc_source.h \
+	  qmc_indom.h qmc_metric.h qmc_prefetch.h qmc_source.h \
 	  qmc_time.h
 
 SOURCES = qmc_context.cpp qmc_desc.cpp qmc_group.cpp \
-	  qmc_indom.cpp qmc_metric.cpp qmc_source.cpp \
+	  qmc_indom.cpp qmc_metric.cpp qmc_prefetch.cpp qmc_source.cpp \
 	  qmc_time.cpp
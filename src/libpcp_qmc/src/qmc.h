@@ -21,6 +21,7 @@ class QmcDesc;
 class QmcGroup;
 class QmcIndom;
 class QmcMetric;
+class QmcPrefetch;
 class QmcSource;
 
 #endif // QMC_H
@@ -1,5 +1,5 @@
 /*
- * Copyright (c) 2012 Red Hat.
+ * Copyright (c) 2012,2019 Red Hat.
  * Copyright (c) 2007-2008 Aconex.  All Rights Reserved.
  * Copyright (c) 1997,2005 Silicon Graphics, Inc.  All Rights Reserved.
  * 
@@ -16,6 +16,7 @@
 
 #include "qmc_context.h"
 #include "qmc_metric.h"
+#include "qmc_prefetch.h"
 #include <limits.h>
 #include <QVector>
 #include <QStringList>
@@ -29,6 +30,8 @@ QmcContext::QmcContext(QmcSource* source)
     my.context = -1;
     my.source = source;
     my.needReconnect = false;
+    my.prefetch = NULL;
+    my.usePrefetch = false;
 
     if (my.source->status() >= 0)
 	my.context = my.source->dupContext();
@@ -38,6 +41,7 @@ QmcContext::QmcContext(QmcSource* source)
 
 QmcContext::~QmcContext()
 {
+    delete my.prefetch;
     while (my.metrics.isEmpty() == false) {
 	delete my.metrics.takeFirst();
     }
@@ -262,12 +266,69 @@ QmcContext::addMetric(QmcMetric *metric)
 	for (i = 0; i < my.pmids.size(); i++)
 	    if (my.pmids[i] == pmid)
 		break;
-	if (i == my.pmids.size())
+	if (i == my.pmids.size()) {
 	    my.pmids.append(pmid);
+	    if (my.prefetch)
+		my.prefetch->setPMIDs(my.pmids);
+	}
 	metric->setIdIndex(i);
     }
 }
 
+void
+QmcContext::setArchiveMode(int mode, const struct timeval *when, int interval)
+{
+    if (my.prefetch)
+	my.usePrefetch = my.prefetch->setMode(mode, when, interval);
+}
+
+int
+QmcContext::setPrefetch(int samples)
+{
+    int sts = 0;
+
+    if (samples <= 0 || my.source->type() != PM_CONTEXT_ARCHIVE ||
+	my.context < 0) {
+	delete my.prefetch;
+	my.prefetch = NULL;
+	my.usePrefetch = false;
+	return 0;
+    }
+
+    if (my.prefetch) {
+	my.prefetch->setSamples(samples);
+	return 0;
+    }
+
+    my.prefetch = new QmcPrefetch(my.source, samples);
+    if ((sts = my.prefetch->status()) < 0) {
+	delete my.prefetch;
+	my.prefetch = NULL;
+    }
+    else {
+	my.prefetch->setPMIDs(my.pmids);
+	my.prefetch->start();
+    }
+    if (pmDebugOptions.pmc) {
+	QTextStream cerr(stderr);
+	cerr << "QmcContext::setPrefetch: " << samples << " samples for "
+	     << *this;
+	if (sts < 0)
+	    cerr << ": " << pmErrStr(sts);
+	cerr << endl;
+    }
+    // dupContext switched contexts
+    pmUseContext(my.context);
+    return sts;
+}
+
+void
+QmcContext::prefetch()
+{
+    if (my.usePrefetch)
+	my.prefetch->prefetch();
+}
+
 int
 QmcContext::fetch(bool update)
 {
@@ -322,8 +383,11 @@ QmcContext::fetch(bool update)
 	    cerr << "QmcContext::fetch: fetching context " << *this << endl;
 	}
 
-	sts = pmFetch(my.pmids.size(), 
-		      (pmID *)(my.pmids.toVector().data()), &result);
+	if (my.usePrefetch)
+	    sts = my.prefetch->fetch(&result);
+	else
+	    sts = pmFetch(my.pmids.size(), 
+			  (pmID *)(my.pmids.toVector().data()), &result);
 	if (sts >= 0) {
 	    my.previousTime = my.currentTime;
 	    my.currentTime = result->timestamp;
@@ -335,7 +399,8 @@ QmcContext::fetch(bool update)
 		Q_ASSERT((int)metric->idIndex() < result->numpmid);
 		metric->extractValues(result->vset[metric->idIndex()]);
 	    }
-	    pmFreeResult(result);
+	    if (!my.usePrefetch)	// else owned by the window cache
+		pmFreeResult(result);
 	}
 	else {
 	    if (pmDebugOptions.optfetch) {
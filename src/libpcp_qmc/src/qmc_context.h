@@ -1,5 +1,5 @@
 /*
- * Copyright (c) 2012 Red Hat.
+ * Copyright (c) 2012,2019 Red Hat.
  * Copyright (c) 2007 Aconex.  All Rights Reserved.
  * Copyright (c) 1998-2005 Silicon Graphics, Inc.  All Rights Reserved.
  * 
@@ -83,6 +83,14 @@ public:
 
     void addMetric(QmcMetric* metric);	// Add a metric using this context
 
+    // Archive position, as for pmSetMode
+    void setArchiveMode(int mode, const struct timeval *when, int interval);
+
+    // Cache a window of this many archive samples, fetched in the
+    // background (zero disables)
+    int setPrefetch(int samples);
+
+    void prefetch();			// Start fetching the archive window
     int fetch(bool update);		// Fetch metrics using this context
 
     struct timeval const& timeStamp() const
@@ -108,6 +116,8 @@ private:
 	QList<pmID> pmids;		// List of valid PMIDs to be fetched
 	QList<QmcIndom*> indoms;	// List of requested indoms 
 	QList<QmcMetric*> metrics;	// List of metrics using this context
+	QmcPrefetch *prefetch;		// Archive window cache, if enabled
+	bool usePrefetch;		// Fetch from the archive window cache
 	struct timeval currentTime;	// Time of current fetch
 	struct timeval previousTime;	// Time of previous fetch
 	double delta;			// Time between fetches
@@ -1,5 +1,5 @@
 /*
- * Copyright (c) 2013-2016, Red Hat.
+ * Copyright (c) 2013-2016,2019, Red Hat.
  * Copyright (c) 2007 Aconex.  All Rights Reserved.
  * Copyright (c) 1997-2005 Silicon Graphics, Inc.  All Rights Reserved.
  * 
@@ -40,6 +40,7 @@ QmcGroup::QmcGroup(bool restrictArchives)
     my.tzUser = -1;
     my.tzGroupIndex = 0;
     my.timeEndReal = 0.0;
+    my.prefetch = 0;
 
     // Get timezone from environment
     if (tzLocalInit == false) {
@@ -204,6 +205,8 @@ QmcGroup::use(int type, const QString &theSource, int flags)
 
 	my.contexts.append(newContext);
 	my.use = my.contexts.size() - 1;
+	if (my.prefetch)
+	    newContext->setPrefetch(my.prefetch);
 
 	if (pmDebugOptions.pmc) {
 	    QTextStream cerr(stderr);
@@ -478,6 +481,10 @@ QmcGroup::fetch(bool update)
 	cerr << "QmcGroup::fetch: " << numContexts() << " contexts" << endl;
     }
 
+    // Start any archive window fetching first, so that the contexts
+    // are fetched from in parallel
+    for (unsigned int i = 0; i < numContexts(); i++)
+	my.contexts[i]->prefetch();
     for (unsigned int i = 0; i < numContexts(); i++)
 	my.contexts[i]->fetch(update);
 
@@ -516,9 +523,22 @@ QmcGroup::setArchiveMode(int mode, const struct timeval *when, int interval)
 		     pmErrStr(sts));
 	    result = sts;
 	}
+	else
+	    my.contexts[i]->setArchiveMode(mode, when, interval);
     }
     sts = useContext();
     if (sts < 0)
 	result = sts;
     return result;
 }
+
+void
+QmcGroup::setPrefetch(int samples)
+{
+    my.prefetch = (samples > 0) ? samples : 0;
+    for (unsigned int i = 0; i < numContexts(); i++)
+	if (my.contexts[i]->source().type() == PM_CONTEXT_ARCHIVE)
+	    my.contexts[i]->setPrefetch(my.prefetch);
+    if (numContexts())
+	useContext();
+}
@@ -1,5 +1,5 @@
 /*
- * Copyright (c) 2013, Red Hat.
+ * Copyright (c) 2013,2019, Red Hat.
  * Copyright (c) 2007 Aconex.  All Rights Reserved.
  * Copyright (c) 1998-2005 Silicon Graphics, Inc.  All Rights Reserved.
  * 
@@ -63,6 +63,10 @@ public:
     // Set the archive position and mode
     int setArchiveMode(int mode, const struct timeval *when, int interval);
 
+    // Cache a window of this many interpolated samples from each
+    // archive, fetched in the background (zero disables)
+    void setPrefetch(int samples);
+
     int useTZ();			// Use TZ of current context as default
     int useTZ(const QString &tz);	// Use this TZ as default
     int useLocalTZ();			// Use local TZ as default
@@ -94,6 +98,7 @@ private:
 	struct timeval timeStart;	// Start of first archive
 	struct timeval timeEnd;		// End of last archive
 	double timeEndReal;		// End of last archive
+	int prefetch;			// Archive window samples to cache
     } my;
 
     // Timezone for localhost from environment
@@ -0,0 +1,335 @@
+/*
+ * Copyright (c) 2019 Red Hat.
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ * License for more details.
+ */
+
+#include <pcp/pmapi.h>
+#include <pcp/libpcp.h>
+#include "qmc_prefetch.h"
+#include "qmc_source.h"
+#include <qtextstream.h>
+#include <QVector>
+
+// Samples kept beyond those visible, on each side of the window
+#define MARGIN(samples)	((samples) / 2 + 1)
+
+QmcPrefetch::QmcPrefetch(QmcSource *source, int samples)
+{
+    my.source = source;
+    my.samples = (samples > 0) ? samples : 1;
+    my.stopping = false;
+    my.busy = false;
+    my.position = 0;
+    my.step = 0;
+    my.cacheStep = 0;
+    my.generation = 0;
+    my.pending = false;
+    my.anchor = 0;
+    my.direction = 1;
+    my.low = 0;
+    my.high = 0;
+    my.context = my.source->dupContext();
+}
+
+QmcPrefetch::~QmcPrefetch()
+{
+    my.mutex.lock();
+    my.stopping = true;
+    my.work.wakeAll();
+    my.mutex.unlock();
+    wait();
+
+    flush();
+    if (my.context >= 0)
+	my.source->delContext(my.context);
+}
+
+// Discard all results - called with the mutex held (or thread stopped)
+void
+QmcPrefetch::flush()
+{
+    QMap<qint64, Entry>::iterator it;
+
+    for (it = my.cache.begin(); it != my.cache.end(); ++it)
+	if (it->result)
+	    pmFreeResult(it->result);
+    my.cache.clear();
+    my.generation++;
+}
+
+void
+QmcPrefetch::setPMIDs(const QList<pmID> &pmids)
+{
+    QMutexLocker locker(&my.mutex);
+
+    my.pmids = pmids;
+    flush();
+}
+
+void
+QmcPrefetch::setSamples(int samples)
+{
+    QMutexLocker locker(&my.mutex);
+
+    my.samples = (samples > 0) ? samples : 1;
+}
+
+bool
+QmcPrefetch::setMode(int mode, const struct timeval *when, int interval)
+{
+    QMutexLocker locker(&my.mutex);
+    qint64 step;
+
+    if (my.context < 0 || (mode & __PM_MODE_MASK) != PM_MODE_INTERP) {
+	my.step = 0;
+	return false;
+    }
+
+    switch (PM_XTB_GET(mode)) {
+    case PM_TIME_NSEC:
+	step = interval / 1000;
+	break;
+    case PM_TIME_USEC:
+	step = interval;
+	break;
+    case PM_TIME_SEC:
+	step = interval * 1000000LL;
+	break;
+    case PM_TIME_MIN:
+	step = interval * 60000000LL;
+	break;
+    case PM_TIME_HOUR:
+	step = interval * 3600000000LL;
+	break;
+    default:	// PM_TIME_MSEC
+	step = interval * 1000LL;
+	break;
+    }
+    my.step = step;
+    if (step == 0)
+	return false;
+
+    // Results are only reusable for the same sampling interval
+    if (step < 0)
+	step = -step;
+    if (step != my.cacheStep) {
+	flush();
+	my.cacheStep = step;
+    }
+    my.position = (qint64)when->tv_sec * 1000000LL + when->tv_usec;
+    return true;
+}
+
+// Find a result for the given time, allowing 5% of the sample interval
+// either way - called with the mutex held
+QMap<qint64, QmcPrefetch::Entry>::iterator
+QmcPrefetch::lookup(qint64 when)
+{
+    qint64 tolerance = my.cacheStep / 20;
+    QMap<qint64, Entry>::iterator it = my.cache.lowerBound(when - tolerance);
+
+    if (it != my.cache.end() && it.key() <= when + tolerance)
+	return it;
+    return my.cache.end();
+}
+
+// Ask the thread for the window around anchor - called with the mutex held
+void
+QmcPrefetch::request(qint64 anchor)
+{
+    qint64 span = (qint64)(my.samples + MARGIN(my.samples)) * my.cacheStep;
+    QMap<qint64, Entry>::iterator it;
+
+    my.anchor = anchor;
+    my.direction = (my.step < 0) ? -1 : 1;
+    my.low = anchor - span;
+    my.high = anchor + span;
+    my.pending = true;
+
+    // Results more than a window away are unlikely to be wanted again
+    for (it = my.cache.begin(); it != my.cache.end(); ) {
+	if (it.key() < my.low - span || it.key() > my.high + span) {
+	    if (it->result)
+		pmFreeResult(it->result);
+	    it = my.cache.erase(it);
+	}
+	else
+	    ++it;
+    }
+
+    if (pmDebugOptions.pmc) {
+	QTextStream cerr(stderr);
+	cerr << "QmcPrefetch::request: context " << my.context
+	     << " window " << my.low << " - " << my.high << " usec, "
+	     << my.cache.size() << " cached" << endl;
+    }
+    my.work.wakeOne();
+}
+
+// Request a new window if the position is not (or soon will not be)
+// covered by the current one - called with the mutex held
+void
+QmcPrefetch::update()
+{
+    qint64 margin = (qint64)MARGIN(my.samples) * my.cacheStep;
+
+    if (my.pending || my.busy) {
+	if (my.position < my.low || my.position > my.high)
+	    request(my.position);
+    }
+    else if (lookup(my.position) == my.cache.end() ||
+	     my.position + margin > my.high || my.position - margin < my.low)
+	request(my.position);
+}
+
+void
+QmcPrefetch::prefetch()
+{
+    QMutexLocker locker(&my.mutex);
+
+    if (my.step != 0 && my.pmids.size() > 0)
+	update();
+}
+
+int
+QmcPrefetch::fetch(pmResult **result)
+{
+    QMutexLocker locker(&my.mutex);
+    QMap<qint64, Entry>::iterator it;
+    int sts;
+
+    if (my.context < 0)
+	return my.context;
+    if (my.step == 0 || my.pmids.size() == 0)
+	return PM_ERR_MODE;
+
+    while ((it = lookup(my.position)) == my.cache.end()) {
+	update();
+	my.ready.wait(&my.mutex);
+    }
+    *result = it->result;
+    sts = it->sts;
+
+    my.position += my.step;
+    update();
+    return sts;
+}
+
+//
+// Fetch the samples from..to inclusive, stepping by step usec, skipping
+// any already cached.  The private context is positioned once for each
+// run of samples that are not cached.
+//
+void
+QmcPrefetch::fetchRange(qint64 from, qint64 to, qint64 step,
+			unsigned int gen, const QList<pmID> &pmids)
+{
+    QVector<pmID> list = pmids.toVector();
+    struct timeval when;
+    pmResult *result;
+    bool positioned = false, stop, cached;
+    int mode, interval, sts;
+    qint64 t;
+
+    if (step % 1000000 == 0) {
+	mode = PM_MODE_INTERP | PM_XTB_SET(PM_TIME_SEC);
+	interval = (int)(step / 1000000);
+    }
+    else if (step % 1000 == 0) {
+	mode = PM_MODE_INTERP | PM_XTB_SET(PM_TIME_MSEC);
+	interval = (int)(step / 1000);
+    }
+    else {
+	mode = PM_MODE_INTERP | PM_XTB_SET(PM_TIME_USEC);
+	interval = (int)step;
+    }
+
+    for (t = from; (step > 0) ? (t <= to) : (t >= to); t += step) {
+	my.mutex.lock();
+	stop = (my.pending || my.stopping || gen != my.generation);
+	cached = (stop == false && lookup(t) != my.cache.end());
+	my.mutex.unlock();
+	if (stop)
+	    break;
+	if (cached) {
+	    positioned = false;
+	    continue;
+	}
+
+	sts = 0;
+	if (positioned == false) {
+	    when.tv_sec = t / 1000000;
+	    when.tv_usec = t % 1000000;
+	    if ((sts = pmUseContext(my.context)) >= 0)
+		sts = pmSetMode(mode, &when, interval);
+	    positioned = (sts >= 0);
+	}
+	if (sts >= 0)
+	    sts = pmFetch(list.size(), list.data(), &result);
+
+	my.mutex.lock();
+	if (gen == my.generation) {
+	    Entry entry;
+	    entry.result = (sts >= 0) ? result : NULL;
+	    entry.sts = sts;
+	    my.cache.insert(t, entry);
+	    my.ready.wakeAll();
+	}
+	else if (sts >= 0)
+	    pmFreeResult(result);
+	my.mutex.unlock();
+    }
+}
+
+void
+QmcPrefetch::run()
+{
+    QList<pmID> pmids;
+    qint64 anchor, low, high, step;
+    unsigned int gen;
+    int direction;
+
+    my.mutex.lock();
+    for (;;) {
+	while (my.pending == false && my.stopping == false)
+	    my.work.wait(&my.mutex);
+	if (my.stopping)
+	    break;
+	my.pending = false;
+	my.busy = true;
+	gen = my.generation;
+	anchor = my.anchor;
+	low = my.low;
+	high = my.high;
+	step = my.cacheStep;
+	direction = my.direction;
+	pmids = my.pmids;
+	my.mutex.unlock();
+
+	// Samples in the direction of travel are wanted first
+	if (pmids.size() > 0 && step > 0) {
+	    if (direction > 0) {
+		fetchRange(anchor, high, step, gen, pmids);
+		fetchRange(anchor - step, low, -step, gen, pmids);
+	    }
+	    else {
+		fetchRange(anchor, low, -step, gen, pmids);
+		fetchRange(anchor + step, high, step, gen, pmids);
+	    }
+	}
+
+	my.mutex.lock();
+	my.busy = false;
+	my.ready.wakeAll();
+    }
+    my.mutex.unlock();
+}
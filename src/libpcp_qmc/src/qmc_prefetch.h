@@ -0,0 +1,94 @@
+/*
+ * Copyright (c) 2019 Red Hat.
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ * License for more details.
+ */
+#ifndef QMC_PREFETCH_H
+#define QMC_PREFETCH_H
+
+#include "qmc.h"
+
+#include <qlist.h>
+#include <qmap.h>
+#include <qmutex.h>
+#include <qthread.h>
+#include <qwaitcondition.h>
+
+//
+// Background fetching of interpolated archive results for a window of
+// samples around the current archive position.  A private duplicate of
+// the archive context is positioned once per run of samples, rather than
+// once per sample, and results are kept so that moving back and forth
+// over the window is served from memory.
+//
+class QmcPrefetch : public QThread
+{
+public:
+    QmcPrefetch(QmcSource *source, int samples);
+    ~QmcPrefetch();
+
+    int status() const			// Is the private context valid?
+	{ return (my.context < 0) ? my.context : 0; }
+
+    void setPMIDs(const QList<pmID> &pmids);	// Metrics to be fetched
+    void setSamples(int samples);	// Visible samples, sets window size
+
+    // Position as for pmSetMode, returns false if this mode cannot
+    // be served from the cache
+    bool setMode(int mode, const struct timeval *when, int interval);
+
+    void prefetch();			// Start on window at current position
+    int fetch(pmResult **result);	// Next result, owned by the cache
+
+protected:
+    void run();
+
+private:
+    struct Entry {
+	pmResult *result;
+	int sts;
+    };
+
+    struct {
+	QmcSource *source;
+	int context;			// Private PMAPI context handle
+	QList<pmID> pmids;		// Metrics to fetch, as for QmcContext
+	int samples;			// Visible samples
+	bool stopping;			// Thread is to exit
+	bool busy;			// Thread is working on a request
+
+	qint64 position;		// Next sample to fetch (usec)
+	qint64 step;			// Signed interval between samples (usec)
+
+	QMap<qint64, Entry> cache;	// Results for times in the window
+	qint64 cacheStep;		// Interval between cached samples
+	unsigned int generation;	// Changes when cache is invalidated
+
+	bool pending;			// New window requested
+	qint64 anchor;			// Sample fetched first
+	int direction;			// Fetch order from the anchor
+	qint64 low;			// Window start (usec)
+	qint64 high;			// Window end (usec)
+
+	QMutex mutex;
+	QWaitCondition work;		// Signalled for a new request
+	QWaitCondition ready;		// Signalled for each new result
+    } my;
+
+    void request(qint64 anchor);
+    void update();
+    void flush();
+    QMap<qint64, Entry>::iterator lookup(qint64 when);
+    void fetchRange(qint64 from, qint64 to, qint64 step, unsigned int gen,
+		    const QList<pmID> &pmids);
+};
+
+#endif	// QMC_PREFETCH_H
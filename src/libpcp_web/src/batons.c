@@ -29,6 +29,7 @@ magic_str(seriesBatonMagic *baton)
     case MAGIC_SID:      return "sid";
     case MAGIC_NAMES:    return "names";
     case MAGIC_LABELMAP: return "labelmap";
+    case MAGIC_BATCH:    return "batch";
     default:             break;
     }
     return "???";
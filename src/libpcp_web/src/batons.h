@@ -24,6 +24,7 @@ typedef enum {
     MAGIC_SID,
     MAGIC_NAMES,
     MAGIC_LABELMAP,
+    MAGIC_BATCH,
 
     MAGIC_COUNT
 } series_baton_magic;
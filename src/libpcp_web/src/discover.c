@@ -1,5 +1,5 @@
 /*
- * Copyright (c) 2018 Red Hat.
+ * Copyright (c) 2018-2019 Red Hat.
  *
  * This library is free software; you can redistribute it and/or modify it
  * under the terms of the GNU Lesser General Public License as published
@@ -29,6 +29,16 @@ static pmDiscoverCallBacks **discoverCallBackTable;
 #define PM_DISCOVER_HASHTAB_SIZE 64
 static pmDiscover *discover_hashtable[PM_DISCOVER_HASHTAB_SIZE];
 
+/*
+ * Change events are coalesced - paths are marked pending and then all
+ * processed together once this time window (milliseconds) has passed.
+ * The number of records processed per path in each pass is bounded so
+ * that a busy archive cannot starve the rest of the event loop.
+ */
+#define PM_DISCOVER_COALESCE_WINDOW	100
+#define PM_DISCOVER_MAX_RESULTS		64
+#define PM_DISCOVER_MAX_METARECS	256
+
 /* FNV string hash algorithm. Return unsigned in range 0 .. limit-1 */
 static unsigned int
 strhash(const char *s, unsigned int limit)
@@ -109,6 +119,8 @@ pmDiscoverDelete(sds path)
 		pmDestroyContext(h->ctx);
 	    if (h->fd >= 0)
 		close(h->fd);
+	    if (h->buffer)
+		free(h->buffer);
 
 	    if (h->context.name)
 		sdsfree(h->context.name);
@@ -344,6 +356,8 @@ static struct {
     { PM_DISCOVER_FLAGS_META, "metavol|" },
     { PM_DISCOVER_FLAGS_COMPRESSED, "compressed|" },
     { PM_DISCOVER_FLAGS_MONITORED, "monitored|" },
+    { PM_DISCOVER_FLAGS_PENDING, "pending|" },
+    { PM_DISCOVER_FLAGS_CORRUPT, "corrupt|" },
     { 0, NULL }
 };
 
@@ -611,15 +625,178 @@ pmDiscoverNewSource(pmDiscover *p, int context)
     pmDiscoverInvokeSourceCallBacks(p, &timestamp);
 }
 
-static void
+/*
+ * A metadata record with a bad length cannot be skipped, as there is
+ * no way to find the start of the following record - report it once
+ * and stop tailing the file.
+ */
+static int
+pmDiscoverMetaCorrupt(pmDiscover *p, __pmLogHdr *hdr, int len)
+{
+    sds			msg;
+
+    infofmt(msg, "Bad metadata record type %d (0x%02x), len=%d at offset %lld"
+		" in %s, no longer following this file\n", hdr->type, hdr->type,
+		len, (long long)p->offset, p->context.name);
+    moduleinfo(p->module, PMLOG_WARNING, msg, p->data);
+    p->flags |= PM_DISCOVER_FLAGS_CORRUPT;
+    return -EINVAL;
+}
+
+/*
+ * Read the next complete metadata record at the current tail offset.
+ * Returns the record body length (including trailer), zero if there
+ * is no complete record available yet, or a negative error code.
+ */
+static int
+pmDiscoverReadMeta(pmDiscover *p, __pmLogHdr *hdr)
+{
+    struct stat		sbuf;
+    ssize_t		nb;
+    char		*bp;
+    sds			msg;
+    int			len, trailer;
+
+    if (p->flags & PM_DISCOVER_FLAGS_CORRUPT)
+	return -EINVAL;
+
+    nb = pread(p->fd, hdr, sizeof(__pmLogHdr), p->offset);
+    if (nb != sizeof(__pmLogHdr))
+	return 0;	/* EOF or partial header, wait for more data */
+
+    hdr->len = ntohl(hdr->len);
+    hdr->type = ntohl(hdr->type);
+
+    /* record length: see __pmLogLoadMeta() */
+    len = hdr->len - (int)sizeof(__pmLogHdr); /* includes trailer */
+    if (len < (int)sizeof(trailer))
+	return pmDiscoverMetaCorrupt(p, hdr, len);
+
+    if (len > p->buflen) {
+	/*
+	 * Bound the allocation by the file size, so a corrupt length
+	 * cannot cause a huge allocation - a record extending beyond
+	 * the current end of file is incomplete, so wait for more data.
+	 */
+	if (fstat(p->fd, &sbuf) < 0) {
+	    infofmt(msg, "fstat failed for %s: %s\n", p->context.name,
+			    osstrerror());
+	    moduleinfo(p->module, PMLOG_ERROR, msg, p->data);
+	    return -oserror();
+	}
+	if (p->offset + hdr->len > sbuf.st_size)
+	    return 0;
+	if ((bp = (char *)realloc(p->buffer, len + 4096)) == NULL) {
+	    infofmt(msg, "realloc %d bytes failed for %s\n",
+			    len + 4096, p->context.name);
+	    moduleinfo(p->module, PMLOG_ERROR, msg, p->data);
+	    return -ENOMEM;
+	}
+	p->buffer = bp;
+	p->buflen = len + 4096;
+    }
+
+    /* read the body + trailer */
+    nb = pread(p->fd, p->buffer, len, p->offset + sizeof(__pmLogHdr));
+    if (nb != len)
+	return 0;	/* partial record, wait for more data as above */
+
+    /* trailer repeats the record length: see __pmLogLoadMeta() */
+    memcpy(&trailer, p->buffer + len - sizeof(trailer), sizeof(trailer));
+    if ((int)ntohl(trailer) != hdr->len)
+	return pmDiscoverMetaCorrupt(p, hdr, len);
+
+    p->offset += hdr->len;
+    return len;
+}
+
+/*
+ * Once off setup of a newly discovered archive data volume or metadata
+ * file, positioning at the current end of the archive for log tailing.
+ */
+static int
+pmDiscoverTailSetup(pmDiscover *p)
+{
+    struct timeval	tvp;
+    struct stat		sbuf;
+    __pmLogHdr		hdr;
+    sds			msg;
+    int			nrec, sts;
+
+    if ((sts = pmNewContext(p->context.type, p->context.name)) < 0) {
+	infofmt(msg, "pmNewContext failed for %s: %s\n",
+			p->context.name, pmErrStr(sts));
+	moduleinfo(p->module, PMLOG_ERROR, msg, p->data);
+	return sts;
+    }
+    pmDiscoverNewSource(p, sts);
+
+    if (p->flags & PM_DISCOVER_FLAGS_DATAVOL) {
+	if ((sts = pmGetArchiveEnd(&tvp)) < 0) {
+	    infofmt(msg, "pmGetArchiveEnd failed for %s: %s\n",
+			    p->context.name, pmErrStr(sts));
+	    moduleinfo(p->module, PMLOG_ERROR, msg, p->data);
+	    pmDestroyContext(p->ctx);
+	    p->ctx = -1;
+	    return sts;
+	}
+	pmSetMode(PM_MODE_FORW, &tvp, 1);
+	return 0;
+    }
+
+    /* for archive meta files, p->fd is the direct file descriptor */
+    if ((p->fd = open(p->context.name, O_RDONLY)) < 0) {
+	infofmt(msg, "open failed for %s: %s\n", p->context.name,
+			osstrerror());
+	moduleinfo(p->module, PMLOG_ERROR, msg, p->data);
+	return -oserror();
+    }
+
+    /*
+     * Skip over the raw metadata file thru to current EOF, correctly
+     * handling partial records - only the headers need to be read.
+     * The size recorded at discovery may be stale (or not yet known),
+     * so use the size of the file as opened.
+     */
+    if (fstat(p->fd, &sbuf) < 0) {
+	infofmt(msg, "fstat failed for %s: %s\n", p->context.name,
+			osstrerror());
+	moduleinfo(p->module, PMLOG_ERROR, msg, p->data);
+	sts = -oserror();
+	close(p->fd);
+	p->fd = -1;
+	return sts;
+    }
+    p->offset = 0;
+    for (nrec = 0; ; nrec++) {
+	if (pread(p->fd, &hdr, sizeof(hdr), p->offset) != sizeof(hdr))
+	    break;
+	hdr.len = ntohl(hdr.len);
+	if (hdr.len <= (int)sizeof(hdr) ||
+	    p->offset + hdr.len > sbuf.st_size)
+	    break;	/* corrupt or partial record: wait for more data */
+	p->offset += hdr.len;
+    }
+    if (pmDebugOptions.discovery)
+	fprintf(stderr, "METADATA opened and skipped"
+			" %d metadata records to offset %lld\n",
+			nrec, (long long)p->offset);
+    return 0;
+}
+
+/*
+ * Process metadata records and results appended since the last pass,
+ * calling all registered callbacks.  Work is bounded per invocation;
+ * returns non-zero if more data may be available for processing.
+ */
+static int
 pmDiscoverInvokeCallBacks(pmDiscover *p)
 {
     pmResult		*r;
     pmTimespec		ts;
     pmDesc		desc;
-    off_t		off;
     char		*buffer;
-    int			i, nb, len, sts, nrec, nsets;
+    int			i, len, sts, nsets, count;
     int			type, id; /* pmID or pmInDom */
     int			nnames;
     char		**names;
@@ -627,100 +804,23 @@ pmDiscoverInvokeCallBacks(pmDiscover *p)
     pmLabelSet		*labelset;
     unsigned char	hash[20];
     __pmLogHdr		hdr;
-    sds			msg, source;
-    uint32_t		*bp;
-    static uint32_t	*buf = NULL;
-    static int		buflen = 0;
-
-    if (p->ctx < 0) {
-	/*
-	 * once off initialization on the first event
-	 */
-	if (p->flags & PM_DISCOVER_FLAGS_DATAVOL) {
-	    struct timeval	tvp;
-
-	    /* create the PMAPI context (once off) */
-	    if ((sts = pmNewContext(p->context.type, p->context.name)) < 0) {
-		infofmt(msg, "pmNewContext failed for %s: %s\n",
-			p->context.name, pmErrStr(sts));
-		moduleinfo(p->module, PMLOG_ERROR, msg, p->data);
-		return;
-	    }
-	    pmDiscoverNewSource(p, sts);
-	    if ((sts = pmGetArchiveEnd(&tvp)) < 0) {
-		infofmt(msg, "pmGetArchiveEnd failed for %s: %s\n",
-				p->context.name, pmErrStr(sts));
-		moduleinfo(p->module, PMLOG_ERROR, msg, p->data);
-		pmDestroyContext(p->ctx);
-		p->ctx = -1;
-		return;
-	    }
-	    pmSetMode(PM_MODE_FORW, &tvp, 1);
-	}
-	else if (p->flags & PM_DISCOVER_FLAGS_META) {
-	    if ((sts = pmNewContext(p->context.type, p->context.name)) < 0) {
-		infofmt(msg, "pmNewContext failed for %s: %s\n",
-				p->context.name, pmErrStr(sts));
-		moduleinfo(p->module, PMLOG_ERROR, msg, p->data);
-		return;
-	    }
-	    pmDiscoverNewSource(p, sts);
-
-	    /* for archive meta files, p->fd is the direct file descriptor */
-	    if ((p->fd = open(p->context.name, O_RDONLY)) < 0) {
-		infofmt(msg, "open failed for %s: %s\n", p->context.name,
-				osstrerror());
-		moduleinfo(p->module, PMLOG_ERROR, msg, p->data);
-		return;
-	    }
-
-	    /*
-	     * Scan raw metadata file thru to current EOF, correctly handling
-	     * partial reads.
-	     */
-	    off = lseek(p->fd, 0, SEEK_CUR);
-	    for (nrec = 0; ; nrec++) {
-		if ((nb = read(p->fd, &hdr, sizeof(hdr))) != sizeof(hdr)) {
-		    /* EOF or partial read: rewind so we can wait for more data */
-		    lseek(p->fd, off, SEEK_SET);
-		    break;
-		}
-		hdr.len = ntohl(hdr.len);
-		hdr.type = ntohl(hdr.type);
-		len = hdr.len - sizeof(hdr);
-		if (len > buflen) {
-		    buflen = len + 4096;
-		    if ((bp = (uint32_t *)realloc(buf, buflen)) != NULL) {
-			buf = bp;
-		    } else {
-			infofmt(msg, "realloc %d bytes failed for %s\n",
-					buflen, p->context.name);
-			moduleinfo(p->module, PMLOG_ERROR, msg, p->data);
-			break;
-		    }
-		}
+    sds			source;
+    uint32_t		*buf;
 
-		if ((nb = read(p->fd, buf, len)) != len) {
-		    /* EOF or partial read: rewind and wait for more data, as above */
-		    lseek(p->fd, off, SEEK_SET);
-		    break;
-		}
-	    }
-	    if (pmDebugOptions.discovery)
-		fprintf(stderr, "METADATA opened and scanned"
-				" %d metadata records to EOF\n", nrec);
-	}
-    }
+    if (p->ctx < 0 && pmDiscoverTailSetup(p) < 0)
+	return 0;
 
     /*
      * Now call the registered callbacks, if any, for this path
      */
     if (p->flags & PM_DISCOVER_FLAGS_DATAVOL) {
 	/*
-	 * fetch metric values to EOF and call all registered callbacks
+	 * fetch newly appended metric values and call all registered callbacks
 	 */
 	pmUseContext(p->ctx);
-	while (pmFetchArchive(&r) == 0) {
+	for (count = 0; count < PM_DISCOVER_MAX_RESULTS; count++) {
+	    if (pmFetchArchive(&r) < 0)
+		return 0;
 	    if (pmDebugOptions.discovery) {
 		char		tbuf[64], bufs[64];
 
@@ -734,135 +834,182 @@ pmDiscoverInvokeCallBacks(pmDiscover *p)
 	    pmDiscoverInvokeValuesCallBack(p, &ts, r);
 	    pmFreeResult(r);
 	}
+	return 1;
     }
-    else if (p->flags & PM_DISCOVER_FLAGS_META) {
-    	/*
-	 * Read all metadata records from current offset though to EOF
-	 * and call all registered callbacks
-	 */
-	for (;;) {
-	    off = lseek(p->fd, 0, SEEK_CUR);
-	    nb = read(p->fd, &hdr, sizeof(__pmLogHdr));
 
-	    if (nb != sizeof(__pmLogHdr)) {
-		/* rewind so we can wait for more data on the next change CallBack */
-		lseek(p->fd, off, SEEK_SET);
-		break;
-	    }
+    if ((p->flags & PM_DISCOVER_FLAGS_META) == 0)
+	return 0;
 
-	    hdr.len = ntohl(hdr.len);
-	    hdr.type = ntohl(hdr.type);
-	    if (hdr.len <= 0) {
-	    	/* rewind and wait for more data, as above */
-		lseek(p->fd, off, SEEK_SET);
-		break;
-	    }
-
-	    /* record length: see __pmLogLoadMeta() */
-	    len = hdr.len - (int)sizeof(__pmLogHdr); /* includes trailer */
-	    if (len <= 0) {
-		infofmt(msg, "Unknown metadata record type %d (0x%02x), len=%d\n",
-			hdr.type, hdr.type, len);
-		moduleinfo(p->module, PMLOG_WARNING, msg, p->data);
-		continue; /* skip this one */
-	    }
-
-	    if (len > buflen) {
-		buflen = len + 4096;
-	    	buf = (uint32_t *)realloc(buf, buflen);
-	    }
+    /*
+     * Read metadata records appended since the previous tail offset
+     * and call all registered callbacks
+     */
+    for (count = 0; count < PM_DISCOVER_MAX_METARECS; count++) {
+	if ((len = pmDiscoverReadMeta(p, &hdr)) <= 0)
+	    return 0;
+	buf = (uint32_t *)p->buffer;
 
-	    /* read the body + trailer */
-	    if ((nb = read(p->fd, buf, len)) != len) {
-	    	/* rewind and wait for more data, as above */
-		lseek(p->fd, off, SEEK_SET);
+	if (pmDebugOptions.discovery)
+	    fprintf(stderr, "Log metadata read len %4d type %d:", len, hdr.type);
+
+	switch (hdr.type) {
+	    case TYPE_DESC:
+		/* decode pmDesc result from PDU buffer */
+		nnames = 0;
+		names = NULL;
+		if (pmDiscoverDecodeMetaDesc(buf, len, &desc, &nnames, &names) < 0)
+		    break;
+		/* use timestamp from last modification */
+		ts.tv_sec = p->statbuf.st_mtim.tv_sec;
+		ts.tv_nsec = p->statbuf.st_mtim.tv_nsec;
+		pmDiscoverInvokeMetricCallBacks(p, &ts, &desc, nnames, names);
+		for (i = 0; i < nnames; i++)
+		    free(names[i]);
+		if (names)
+		    free(names);
 		break;
-	    }
 
-	    if (pmDebugOptions.discovery)
-		fprintf(stderr, "Log metadata read len %4d type %d:", len, hdr.type);
-
-	    switch (hdr.type) {
-		case TYPE_DESC:
-		    /* decode pmDesc result from PDU buffer */
-		    nnames = 0;
-		    names = NULL;
-		    if (pmDiscoverDecodeMetaDesc(buf, len, &desc, &nnames, &names) < 0)
-			break;
-		    /* use timestamp from last modification */
-		    ts.tv_sec = p->statbuf.st_mtim.tv_sec;
-		    ts.tv_nsec = p->statbuf.st_mtim.tv_nsec;
-		    pmDiscoverInvokeMetricCallBacks(p, &ts, &desc, nnames, names);
-		    for (i = 0; i < nnames; i++)
-			free(names[i]);
-		    if (names)
-			free(names);
+	    case TYPE_INDOM:
+		/* decode indom result from buffer */
+		if (pmDiscoverDecodeMetaInDom(buf, len, &ts, &inresult) < 0)
 		    break;
+		pmDiscoverInvokeInDomCallBacks(p, &ts, &inresult);
+		if (inresult.numinst > 0) {
+		    for (i = 0; i < inresult.numinst; i++)
+			free(inresult.namelist[i]);
+		    free(inresult.namelist);
+		    free(inresult.instlist);
+		}
+		break;
 
-	    	case TYPE_INDOM:
-		    /* decode indom result from buffer */
-		    if (pmDiscoverDecodeMetaInDom(buf, len, &ts, &inresult) < 0)
-			break;
-		    pmDiscoverInvokeInDomCallBacks(p, &ts, &inresult);
-		    if (inresult.numinst > 0) {
-			for (i = 0; i < inresult.numinst; i++)
-			    free(inresult.namelist[i]);
-			free(inresult.namelist);
-			free(inresult.instlist);
-		    }
+	    case TYPE_LABEL:
+		/* decode labelset from buffer */
+		if (pmDiscoverDecodeMetaLabelSet(buf, len, &ts, &id, &type, &nsets, &labelset) < 0)
 		    break;
 
-		case TYPE_LABEL:
-		    /* decode labelset from buffer */
-		    if (pmDiscoverDecodeMetaLabelSet(buf, len, &ts, &id, &type, &nsets, &labelset) < 0)
-			break;
-
-		    /*
-		     * If this is a context labelset, we need to store it in 'p' and
-		     * also update the source identifier (pmSID) - effectively making
-		     * a new source.
-		     */
-		    if ((type & PM_LABEL_CONTEXT)) {
-			pmwebapi_source_hash(hash, labelset->json, labelset->jsonlen);
-			source = pmwebapi_hash_sds(NULL, hash);
-			if (sdscmp(source, p->context.source) == 0) {
-			    sdsfree(source);
-			} else {
-			    sdsfree(p->context.source);
-			    p->context.source = source;
-			    p->context.labelset = labelset;
-			    pmDiscoverInvokeSourceCallBacks(p, &ts);
-			}
+		/*
+		 * If this is a context labelset, we need to store it in 'p' and
+		 * also update the source identifier (pmSID) - effectively making
+		 * a new source.
+		 */
+		if ((type & PM_LABEL_CONTEXT)) {
+		    pmwebapi_source_hash(hash, labelset->json, labelset->jsonlen);
+		    source = pmwebapi_hash_sds(NULL, hash);
+		    if (sdscmp(source, p->context.source) == 0) {
+			sdsfree(source);
+		    } else {
+			sdsfree(p->context.source);
+			p->context.source = source;
+			p->context.labelset = labelset;
+			pmDiscoverInvokeSourceCallBacks(p, &ts);
 		    }
-		    pmDiscoverInvokeLabelsCallBacks(p, &ts, id, type, labelset, nsets);
-		    if (labelset != p->context.labelset)
-			pmFreeLabelSets(labelset, nsets);
-		    break;
+		}
+		pmDiscoverInvokeLabelsCallBacks(p, &ts, id, type, labelset, nsets);
+		if (labelset != p->context.labelset)
+		    pmFreeLabelSets(labelset, nsets);
+		break;
 
-		case TYPE_TEXT:
-		    if (pmDebugOptions.discovery)
-			fprintf(stderr, "TEXT\n");
-		    /* decode help text from buffer */
-		    buffer = NULL;
-		    if ((sts = pmDiscoverDecodeMetaHelpText(buf, len, &type, &id, &buffer)) < 0)
-			break;
-		    /* use timestamp from last modification */
-		    ts.tv_sec = p->statbuf.st_mtim.tv_sec;
-		    ts.tv_nsec = p->statbuf.st_mtim.tv_nsec;
-		    pmDiscoverInvokeTextCallBacks(p, &ts, id, type, buffer);
-		    if (buffer)
-			free(buffer);
+	    case TYPE_TEXT:
+		if (pmDebugOptions.discovery)
+		    fprintf(stderr, "TEXT\n");
+		/* decode help text from buffer */
+		buffer = NULL;
+		if ((sts = pmDiscoverDecodeMetaHelpText(buf, len, &type, &id, &buffer)) < 0)
 		    break;
+		/* use timestamp from last modification */
+		ts.tv_sec = p->statbuf.st_mtim.tv_sec;
+		ts.tv_nsec = p->statbuf.st_mtim.tv_nsec;
+		pmDiscoverInvokeTextCallBacks(p, &ts, id, type, buffer);
+		if (buffer)
+		    free(buffer);
+		break;
 
-		default:
-		    if (pmDebugOptions.discovery)
-			fprintf(stderr, "%s, len = %d\n",
-				hdr.type == (PM_LOG_MAGIC | PM_LOG_VERS02) ?
-				"PM_LOG_MAGICv2" : "UNKNOWN", len);
-		    break;
-	    }
+	    default:
+		if (pmDebugOptions.discovery)
+		    fprintf(stderr, "%s, len = %d\n",
+			    hdr.type == (PM_LOG_MAGIC | PM_LOG_VERS02) ?
+			    "PM_LOG_MAGICv2" : "UNKNOWN", len);
+		break;
 	}
     }
+    return 1;
+}
+
+static void pmDiscoverSchedule(pmDiscover *, uint64_t);
+
+static void
+pending_callback(pmDiscover *p)
+{
+    if (pmDiscoverInvokeCallBacks(p) == 0)
+	p->flags &= ~PM_DISCOVER_FLAGS_PENDING;
+}
+
+static void
+more_callback(pmDiscover *p)
+{
+    pmDiscoverSchedule(p, 0);
+}
+
+/*
+ * Coalesced change events - process all pending paths, then if any
+ * still have data remaining restart the timer to continue promptly,
+ * after allowing other events on the loop to be serviced.
+ */
+static void
+pending_timer_callback(uv_timer_t *handle)
+{
+    discoverModuleData	*data = (discoverModuleData *)handle->data;
+
+    data->timer_active = 0;
+    pmDiscoverTraverse(PM_DISCOVER_FLAGS_PENDING, pending_callback);
+    pmDiscoverTraverse(PM_DISCOVER_FLAGS_PENDING, more_callback);
+}
+
+static void
+pmDiscoverSchedule(pmDiscover *p, uint64_t window)
+{
+    discoverModuleData	*data = getDiscoverModuleData(p->module);
+
+    p->flags |= PM_DISCOVER_FLAGS_PENDING;
+    if (data == NULL) {
+	pending_callback(p);	/* no coalescing, process directly */
+	return;
+    }
+    if (data->timer_active)
+	return;
+
+    if (data->timer == NULL) {
+	if ((data->timer = malloc(sizeof(uv_timer_t))) == NULL) {
+	    pending_callback(p);	/* no coalescing, process directly */
+	    return;
+	}
+	uv_timer_init(data->events, data->timer);
+	data->timer->data = (void *)data;
+    }
+    data->timer_active = 1;
+    uv_timer_start(data->timer, pending_timer_callback, window, 0);
+}
+
+static void
+timer_close_callback(uv_handle_t *handle)
+{
+    free(handle);
+}
+
+/*
+ * Stop the change coalescing timer of a module being closed, freeing
+ * it once the event loop has finished with it.
+ */
+void
+pmDiscoverTimerClose(discoverModuleData *data)
+{
+    if (data->timer == NULL)
+	return;
+    uv_timer_stop(data->timer);
+    data->timer->data = NULL;
+    uv_close((uv_handle_t *)data->timer, timer_close_callback);
+    data->timer = NULL;
+    data->timer_active = 0;
 }
 
 static void
@@ -889,12 +1036,17 @@ changed_callback(pmDiscover *p)
     	/* we do not monitor any compressed files - do nothing */
 	; /**/
     }
+    else if (p->flags & PM_DISCOVER_FLAGS_CORRUPT) {
+	/* unreadable metadata was reported already - do nothing */
+	; /**/
+    }
     else if (p->flags & (PM_DISCOVER_FLAGS_DATAVOL|PM_DISCOVER_FLAGS_META)) {
     	/*
-	 * We only monitor uncompressed logvol and metadata paths. Fetch new data
-	 * (metadata or logvol) and call the registered callbacks.
+	 * We only monitor uncompressed logvol and metadata paths.  Schedule
+	 * fetching of new data (metadata or logvol), coalescing events that
+	 * arrive in quick succession, then call the registered callbacks.
 	 */
-	pmDiscoverInvokeCallBacks(p);
+	pmDiscoverSchedule(p, PM_DISCOVER_COALESCE_WINDOW);
     }
 }
 
@@ -1,5 +1,5 @@
 /*
- * Copyright (c) 2018 Red Hat.
+ * Copyright (c) 2018-2019 Red Hat.
  *
  * This library is free software; you can redistribute it and/or modify it
  * under the terms of the GNU Lesser General Public License as published
@@ -23,6 +23,7 @@
 #include <uv.h>
 #else
 typedef void uv_loop_t;
+typedef void uv_timer_t;
 #endif
 
 /*
@@ -54,6 +55,8 @@ typedef enum pmDiscoverFlags {
     PM_DISCOVER_FLAGS_DATAVOL	= (1 << 5), /* archive data volume */
     PM_DISCOVER_FLAGS_INDEX	= (1 << 6), /* archive index file */
     PM_DISCOVER_FLAGS_META	= (1 << 7), /* archive metadata */
+    PM_DISCOVER_FLAGS_PENDING	= (1 << 8), /* change awaiting processing */
+    PM_DISCOVER_FLAGS_CORRUPT	= (1 << 9), /* corrupt, no longer tailed */
 
     PM_DISCOVER_FLAGS_ALL	= ((unsigned int)~PM_DISCOVER_FLAGS_NONE)
 } pmDiscoverFlags;
@@ -73,6 +76,9 @@ typedef struct pmDiscover {
     pmTimespec			timestamp;	
     int				ctx;		/* PMAPI context handle ) */
     int				fd;		/* meta file descriptor */
+    off_t			offset;		/* meta file tail offset */
+    char			*buffer;	/* meta record read buffer */
+    size_t			buflen;		/* meta record buffer size */
 #ifdef HAVE_LIBUV
     uv_fs_event_t		*event_handle;	/* uv fs_notify event handle */ 
     uv_stat_t			statbuf;	/* stat buffer from event CB */
@@ -104,6 +110,8 @@ typedef struct discoverModuleData {
     sds				hostspec;	/* slots connection hostspec */
     mmv_registry_t		*metrics;	/* registry of metrics */
     uv_loop_t			*events;	/* event library loop */
+    uv_timer_t			*timer;		/* change coalescing timer */
+    unsigned int		timer_active;	/* timer has been started */
     redisSlots			*slots;		/* server slots data */
     void			*data;		/* user-supplied pointer */
 } discoverModuleData;
@@ -114,10 +122,12 @@ extern discoverModuleData *getDiscoverModuleData(pmDiscoverModule *);
 extern int pmDiscoverRegister(const char *,
 		pmDiscoverModule *, pmDiscoverCallBacks *, void *);
 extern void pmDiscoverUnregister(int);
+extern void pmDiscoverTimerClose(discoverModuleData *);
 
 #else
 #define pmDiscoverRegister(path, module, callbacks, data)	(-EOPNOTSUPP)
 #define pmDiscoverUnregister(handle)	do { } while (0)
+#define pmDiscoverTimerClose(data)	do { } while (0)
 #endif
 
 #endif /* SERIES_DISCOVER_H */
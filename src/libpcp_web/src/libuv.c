@@ -1,5 +1,5 @@
 /*
- * Copyright (c) 2017-2018 Red Hat.
+ * Copyright (c) 2017-2019 Red Hat.
  * Copyright (c) 2018 Challa Venkata Naga Prajwal <cvnprajwal at gmail dot com>
  * Copyright (c) 2009-2011, Salvatore Sanfilippo <antirez at gmail dot com>
  * Copyright (c) 2010-2011, Pieter Noordhuis <pcnoordhuis at gmail dot com>
@@ -31,6 +31,7 @@
  * POSSIBILITY OF SUCH DAMAGE.
  */
 
+#include "pmwebapi.h"
 #include "libuv.h"
 #include "uv.h"
 
@@ -143,3 +144,93 @@ redisEventAttach(redisAsyncContext *ac, void *privdata)
 {
     return redisLibuvAttach(ac, (uv_loop_t *)privdata);
 }
+
+/*
+ * Asynchronous PMAPI requests (pmFetchAsync, pmGetInDomAsync) - watch
+ * the pmcd socket for a context from a libuv loop while requests are
+ * pending, processing replies via pmAsyncEvents as they arrive.
+ */
+typedef struct pmAsyncLibuvEvents {
+    uv_loop_t		*loop;
+    uv_poll_t		*handle;
+    int			context;
+    int			fd;
+} pmAsyncLibuvEvents;
+
+static void
+pmAsyncLibuvPoll(uv_poll_t *handle, int status, int events)
+{
+    pmAsyncLibuvEvents	*p = (pmAsyncLibuvEvents *)handle->data;
+
+    if (status != 0 || p == NULL)
+	return;
+    if (events & UV_READABLE)
+	pmAsyncEvents(p->context);
+}
+
+static void
+on_poll_close(uv_handle_t *handle)
+{
+    free(handle);
+}
+
+static void
+pmAsyncLibuvClose(pmAsyncLibuvEvents *p)
+{
+    if (p->handle == NULL)
+	return;
+    p->handle->data = NULL;	/* watch may be freed before the close */
+    uv_close((uv_handle_t *)p->handle, on_poll_close);
+    p->handle = NULL;
+}
+
+static void
+pmAsyncLibuvWatch(int context, int fd, int action, void *data)
+{
+    pmAsyncLibuvEvents	*p = (pmAsyncLibuvEvents *)data;
+
+    switch (action) {
+    case PM_ASYNC_START:
+	if (p->handle != NULL && p->fd != fd)	/* reconnected */
+	    pmAsyncLibuvClose(p);
+	if (p->handle == NULL) {
+	    if ((p->handle = (uv_poll_t *)calloc(1, sizeof(uv_poll_t))) == NULL)
+		return;
+	    if (uv_poll_init(p->loop, p->handle, fd) != 0) {
+		free(p->handle);
+		p->handle = NULL;
+		return;
+	    }
+	    p->handle->data = p;
+	    p->fd = fd;
+	}
+	uv_poll_start(p->handle, UV_READABLE, pmAsyncLibuvPoll);
+	break;
+
+    case PM_ASYNC_STOP:
+	if (p->handle != NULL)
+	    uv_poll_stop(p->handle);
+	break;
+
+    case PM_ASYNC_CLOSE:
+	pmAsyncLibuvClose(p);
+	free(p);
+	break;
+    }
+}
+
+int
+pmAsyncEventAttach(int context, void *loop)
+{
+    pmAsyncLibuvEvents	*p;
+    int			sts;
+
+    if ((p = (pmAsyncLibuvEvents *)calloc(1, sizeof(*p))) == NULL)
+	return -ENOMEM;
+    p->loop = (uv_loop_t *)loop;
+    p->context = context;
+    p->fd = -1;
+    if ((sts = pmAsyncSetWatch(context, pmAsyncLibuvWatch, p)) < 0)
+	free(p);
+    return sts;
+}
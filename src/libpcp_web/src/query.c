@@ -482,6 +482,38 @@ series_values_reply(seriesQueryBaton *baton, sds series,
     sdsfree(value.data);
 }
 
+static int
+series_compare(const void *a, const void *b)
+{
+    return memcmp(a, b, SHA1SZ);
+}
+
+/*
+ * Series sets are held as compact arrays of SHA1 hashes, sorted and
+ * free of duplicates, such that set operations are linear merges.
+ */
+static void
+series_sort_set(series_set_t *set)
+{
+    unsigned char	*cp, *saved;
+    int			i;
+
+    if (set->nseries <= 1)
+	return;
+
+    qsort(set->series, set->nseries, SHA1SZ, series_compare);
+
+    saved = set->series;
+    for (i = 1, cp = saved + SHA1SZ; i < set->nseries; i++, cp += SHA1SZ) {
+	if (memcmp(saved, cp, SHA1SZ) == 0)
+	    continue;		/* duplicate, continue advancing cp only */
+	saved += SHA1SZ;
+	if (saved != cp)
+	    memcpy(saved, cp, SHA1SZ);
+    }
+    set->nseries = ((saved - set->series) / SHA1SZ) + 1;
+}
+
 /*
  * Save the series hash identifiers contained in a Redis response
  * for all series that are not already in this nodes set (union).
@@ -532,75 +564,70 @@ node_series_reply(seriesQueryBaton *baton, node_t *np, int nelements, redisReply
 	return sts;
     }
 
+    series_sort_set(&set);
     return series_union(&np->result, &set);
 }
 
-static int
-series_compare(const void *a, const void *b)
-{
-    return memcmp(a, b, SHA1SZ);
-}
-
 /*
- * Form resulting set via intersection of two child sets.
+ * Form resulting set via intersection of two sorted child sets.
  * Algorithm:
- * - sort the larger set
- * - for each identifier in the smaller set
- *   o bisect to find match in sorted set
- *   o if matching, add it to the current saved set
+ * - walk both sets in order, advancing past the lesser entry
+ * - when entries match, add it to the current saved set
  *
- * Memory from the smaller set is re-used to hold the result,
- * its memory is trimmed (via realloc) if the final resulting
- * set is smaller, and the larger set is freed on completion.
+ * Memory from the first set is re-used to hold the result (it
+ * can never be larger), its memory is trimmed (via realloc) if
+ * the final resulting set is smaller, and the second set freed.
  */
 static int
 series_intersect(series_set_t *a, series_set_t *b)
 {
-    unsigned char	*small, *large, *saved, *cp;
-    int			nsmall, nlarge, total, i;
-
-    if (a->nseries >= b->nseries) {
-	large = a->series;	nlarge = a->nseries;
-	small = b->series;	nsmall = b->nseries;
-    } else {
-	small = a->series;	nsmall = a->nseries;
-	large = b->series;	nlarge = b->nseries;
-    }
+    unsigned char	*acp, *bcp, *saved, *cp;
+    int			i, j, total, cmp;
 
     if (pmDebugOptions.series)
-	printf("Intersect large(%d) and small(%d) series\n", nlarge, nsmall);
-
-    qsort(large, nlarge, SHA1SZ, series_compare);
-
-    for (i = 0, cp = saved = small; i < nsmall; i++, cp ++) {
-	if (!bsearch(cp, large, nlarge, SHA1SZ, series_compare))
-	    continue;		/* no match, continue advancing cp only */
-	if (saved != cp)
-	    memcpy(saved, cp, SHA1SZ);
-	saved++;		/* stashed, advance cp & saved pointers */
+	printf("Intersect left(%d) and right(%d) series\n",
+		a->nseries, b->nseries);
+
+    acp = saved = a->series;
+    bcp = b->series;
+    for (i = j = 0; i < a->nseries && j < b->nseries; ) {
+	if ((cmp = memcmp(acp, bcp, SHA1SZ)) < 0) {
+	    acp += SHA1SZ;	i++;
+	} else if (cmp > 0) {
+	    bcp += SHA1SZ;	j++;
+	} else {
+	    if (saved != acp)
+		memcpy(saved, acp, SHA1SZ);
+	    saved += SHA1SZ;	/* stashed, advance both sets and saved */
+	    acp += SHA1SZ;	i++;
+	    bcp += SHA1SZ;	j++;
+	}
     }
 
-    if ((total = (saved - small)) < nsmall) {
-	/* shrink the smaller set down further */
-	if ((small = realloc(small, total * SHA1SZ)) == NULL)
+    if ((total = (saved - a->series) / SHA1SZ) == 0) {
+	free(a->series);
+	a->series = NULL;
+    } else if (total < a->nseries) {
+	/* shrink the result set down further */
+	if ((cp = realloc(a->series, total * SHA1SZ)) == NULL)
 	    return -ENOMEM;
+	a->series = cp;
     }
 
     if (pmDebugOptions.series && pmDebugOptions.desperate) {
 	char		hashbuf[42];
 
 	printf("Intersect result set contains %d series:\n", total);
-	for (i = 0, cp = small; i < total; cp++, i++) {
+	for (i = 0, cp = a->series; i < total; cp += SHA1SZ, i++) {
 	    pmwebapi_hash_str(cp, hashbuf, sizeof(hashbuf));
 	    printf("    %s\n", hashbuf);
 	}
     }
 
     a->nseries = total;
-    a->series = small;
+    free(b->series);
     b->series = NULL;
     b->nseries = 0;
-    free(large);
     return 0;
 }
 
@@ -618,72 +645,81 @@ node_series_intersect(node_t *np, node_t *left, node_t *right)
 }
 
 /*
- * Form the resulting set from union of two child sets.
- * The larger set is realloc-ated to form the result, if we
- * need to (i.e. if there are entries in the smaller set not
- * in the larger).
- *
- * Iterates over the smaller set doing a binary search of
- * each series identifier, and tracks which ones in the small
- * need to be added to the large set.
- * At the end, add more space to the larger set if needed and
- * append to it.  As a courtesy, since all callers need this,
- * we free the smaller set as well.
+ * Form the resulting set from union of two sorted child sets.
+ * The sets are merged in order into a newly allocated set, which
+ * is trimmed (via realloc) once the number of entries common to
+ * both sets is known.  As a courtesy, since all callers need this,
+ * we free the second set as well.
  */
 static int
 series_union(series_set_t *a, series_set_t *b)
 {
-    unsigned char	*cp, *saved, *large, *small;
-    int			nlarge, nsmall, total, need, i;
+    unsigned char	*acp, *bcp, *saved, *cp, *merged;
+    int			i, j, total, cmp;
 
-    if (a->nseries >= b->nseries) {
-	large = a->series;	nlarge = a->nseries;
-	small = b->series;	nsmall = b->nseries;
-    } else {
-	small = a->series;	nsmall = a->nseries;
-	large = b->series;	nlarge = b->nseries;
+    if (b->nseries == 0) {
+	free(b->series);
+	b->series = NULL;
+	return 0;
+    }
+    if (a->nseries == 0) {
+	free(a->series);
+	*a = *b;
+	b->series = NULL;
+	b->nseries = 0;
+	return 0;
     }
 
     if (pmDebugOptions.series)
-	printf("Union of large(%d) and small(%d) series\n", nlarge, nsmall);
+	printf("Union of left(%d) and right(%d) series\n",
+		a->nseries, b->nseries);
 
-    qsort(large, nlarge, SHA1SZ, series_compare);
+    if ((merged = malloc((a->nseries + b->nseries) * SHA1SZ)) == NULL)
+	return -ENOMEM;
 
-    for (i = 0, cp = saved = small; i < nsmall; i++, cp += SHA1SZ) {
-	if (bsearch(cp, large, nlarge, SHA1SZ, series_compare) != NULL)
-	    continue;		/* already present, no need to save */
-	if (saved != cp)
-	    memcpy(saved, cp, SHA1SZ);
-	saved += SHA1SZ;	/* stashed, advance both cp & saved */
+    saved = merged;
+    acp = a->series;
+    bcp = b->series;
+    for (i = j = 0; i < a->nseries || j < b->nseries; saved += SHA1SZ) {
+	if (i == a->nseries)
+	    cmp = 1;
+	else if (j == b->nseries)
+	    cmp = -1;
+	else
+	    cmp = memcmp(acp, bcp, SHA1SZ);
+	if (cmp <= 0) {
+	    memcpy(saved, acp, SHA1SZ);
+	    acp += SHA1SZ;	i++;
+	    if (cmp == 0) {	/* present in both, advance both */
+		bcp += SHA1SZ;	j++;
+	    }
+	} else {
+	    memcpy(saved, bcp, SHA1SZ);
+	    bcp += SHA1SZ;	j++;
+	}
     }
 
-    if ((need = (saved - small) / SHA1SZ) > 0) {
-	/* grow the larger set to cater for new entries, then add 'em */
-	if ((cp = realloc(large, (nlarge + need) * SHA1SZ)) == NULL)
-	    return -ENOMEM;
-	large = cp;
-	cp += (nlarge * SHA1SZ);
-	memcpy(cp, small, need * SHA1SZ);
-	total = nlarge + need;
-    } else {
-	total = nlarge;
+    if ((total = (saved - merged) / SHA1SZ) < a->nseries + b->nseries) {
+	if ((cp = realloc(merged, total * SHA1SZ)) != NULL)
+	    merged = cp;
     }
 
     if (pmDebugOptions.series && pmDebugOptions.desperate) {
 	char		hashbuf[42];
 
 	printf("Union result set contains %d series:\n", total);
-	for (i = 0, cp = large; i < total; cp += SHA1SZ, i++) {
+	for (i = 0, cp = merged; i < total; cp += SHA1SZ, i++) {
 	    pmwebapi_hash_str(cp, hashbuf, sizeof(hashbuf));
 	    printf("    %s\n", hashbuf);
 	}
     }
 
+    free(a->series);
     a->nseries = total;
-    a->series = large;
+    a->series = merged;
+    free(b->series);
     b->series = NULL;
     b->nseries = 0;
-    free(small);
     return 0;
 }
 
@@ -877,14 +913,46 @@ series_pattern_match(seriesQueryBaton *baton, node_t *np)
 }
 
 /*
- * Map human names to internal Redis identifiers.
+ * Setup the label name map identifier needed by direct children of
+ * a name node - this depends only on the query text, so is resolved
+ * just once for cached query plans (see query_parser.y).
  */
-static int
-series_prepare_maps(seriesQueryBaton *baton, node_t *np, int level)
+void
+series_name_key(node_t *np)
 {
     unsigned char	hash[20];
     const char		*name;
     char		buffer[42];
+
+    assert(np->type == N_NAME);
+    if (np->key)	/* already resolved */
+	return;
+
+    if ((name = series_instance_name(np->value)) != NULL) {
+	np->subtype = N_INSTANCE;
+	np->key = sdsnew("pcp:map:inst.name");
+    } else if ((name = series_metric_name(np->value)) != NULL) {
+	np->subtype = N_METRIC;
+	np->key = sdsnew("pcp:map:metric.name");
+    } else if ((name = series_context_name(np->value)) != NULL) {
+	np->subtype = N_CONTEXT;
+	np->key = sdsnew("pcp:map:context.name");
+    } else {
+	np->subtype = N_LABEL;
+	if ((name = series_label_name(np->value)) == NULL)
+	    name = np->value;
+	pmwebapi_string_hash(hash, name, strlen(name));
+	np->key = sdscatfmt(sdsempty(), "pcp:map:label.%s.value",
+			    pmwebapi_hash_str(hash, buffer, sizeof(buffer)));
+    }
+}
+
+/*
+ * Map human names to internal Redis identifiers.
+ */
+static int
+series_prepare_maps(seriesQueryBaton *baton, node_t *np, int level)
+{
     int			sts;
 
     if (np == NULL)
@@ -895,24 +963,7 @@ series_prepare_maps(seriesQueryBaton *baton, node_t *np, int level)
 
     switch (np->type) {
     case N_NAME:
-	/* setup any label name map identifiers needed by direct children */
-	if ((name = series_instance_name(np->value)) != NULL) {
-	    np->subtype = N_INSTANCE;
-	    np->key = sdsnew("pcp:map:inst.name");
-	} else if ((name = series_metric_name(np->value)) != NULL) {
-	    np->subtype = N_METRIC;
-	    np->key = sdsnew("pcp:map:metric.name");
-	} else if ((name = series_context_name(np->value)) != NULL) {
-	    np->subtype = N_CONTEXT;
-	    np->key = sdsnew("pcp:map:context.name");
-	} else {
-	    np->subtype = N_LABEL;
-	    if ((name = series_label_name(np->value)) == NULL)
-		name = np->value;
-	    pmwebapi_string_hash(hash, name, strlen(name));
-	    np->key = sdscatfmt(sdsempty(), "pcp:map:label.%s.value",
-			    pmwebapi_hash_str(hash, buffer, sizeof(buffer)));
-	}
+	series_name_key(np);
 	break;
 
     case N_GLOB:	/* globbing or regular expression lookups */
@@ -974,9 +1025,6 @@ series_prepare_smembers_reply(redisAsyncContext *c, redisReply *reply, void *arg
 	    baton->error = sts;
     }
 
-    if (np->nmatches)
-	np->nmatches--;	/* processed one more from this batch */
-
     series_query_end_phase(baton);
 }
 
@@ -992,32 +1040,364 @@ series_prepare_smembers(seriesQueryBaton *baton, sds kp, node_t *np)
 			series_prepare_smembers_reply, np);
 }
 
+static void
+series_prepare_sunion_group(redisSlots *slots, redisAsyncContext *context,
+		unsigned int nkeys, sds *keys, void **data, void *arg)
+{
+    node_t		*np = (node_t *)arg;
+    seriesQueryBaton	*baton = (seriesQueryBaton *)np->baton;
+    unsigned int	i, j, group;
+    sds			cmd;
+
+    /* one request per group of keys, all sent to this Redis instance */
+    for (i = 0; i < nkeys; i = j) {
+	group = redisSlotsKeyGroup(slots, keys[i]);
+	for (j = i + 1; j < nkeys; j++)
+	    if (redisSlotsKeyGroup(slots, keys[j]) != group)
+		break;
+
+	seriesBatonReference(baton, "series_prepare_sunion_group");
+	if (j - i == 1) {
+	    cmd = redis_command(2);
+	    cmd = redis_param_str(cmd, SMEMBERS, SMEMBERS_LEN);
+	} else {
+	    cmd = redis_command(j - i + 1);
+	    cmd = redis_param_str(cmd, SUNION, SUNION_LEN);
+	}
+	for (; i < j; i++)
+	    cmd = redis_param_sds(cmd, keys[i]);
+	redisSlotsContextRequest(context, NULL, cmd,
+			series_prepare_smembers_reply, np);
+    }
+}
+
+/*
+ * Resolve the union of all pattern-matched sets for a node, issuing
+ * one request per Redis instance (or cluster slot) holding the sets,
+ * pipelined so there is one round trip per Redis instance.
+ */
+static int
+series_prepare_sunion(seriesQueryBaton *baton, node_t *np)
+{
+    redisSlotsBatch	batch;
+    unsigned int	i;
+    int			sts = 0;
+
+    redisSlotsBatchInit(&batch, baton->slots, 0);
+    for (i = 0; i < np->nmatches; i++) {
+	if (sts == 0)
+	    sts = redisSlotsBatchAdd(&batch, np->matches[i], NULL);
+	if (sts < 0)
+	    sdsfree(np->matches[i]);
+    }
+    free(np->matches);
+    np->matches = NULL;
+    np->nmatches = 0;
+
+    if (sts == 0 &&
+	(sts = redisSlotsBatchSubmit(&batch, series_prepare_sunion_group, np)) > 0)
+	sts = 0;
+    redisSlotsBatchFree(&batch);
+    return sts;
+}
+
+/*
+ * Server-side evaluation of an expression subtree combining sets via
+ * intersection and union.  The subtree is encoded as a postfix program
+ * where numbers introduce leaf sets (the union of the next N keys) and
+ * "&" and "|" combine the top two sets.  Intersections use membership
+ * tests against the larger set, so only the (typically small) result
+ * set is returned rather than the full membership of every leaf.
+ */
+static const char series_sets_text[] =
+    "local stack, k = {}, 0\n"
+    "local function members(e)\n"
+    "  if e.set then return e.set end\n"
+    "  local n, set, out = #e.keys, {}, {}\n"
+    "  if n == 0 then return out end\n"
+    "  if n <= 1024 then return redis.call('SUNION', unpack(e.keys)) end\n"
+    "  for i = 1, n, 1024 do\n"
+    "    local chunk = redis.call('SUNION', unpack(e.keys, i, math.min(i + 1023, n)))\n"
+    "    for _, m in ipairs(chunk) do\n"
+    "      if not set[m] then set[m] = true; out[#out + 1] = m end\n"
+    "    end\n"
+    "  end\n"
+    "  return out\n"
+    "end\n"
+    "local function size(e)\n"
+    "  if e.set then return #e.set end\n"
+    "  local n = 0\n"
+    "  for _, key in ipairs(e.keys) do n = n + redis.call('SCARD', key) end\n"
+    "  return n\n"
+    "end\n"
+    "local function lookup(e)\n"
+    "  if e.set then\n"
+    "    local set = {}\n"
+    "    for _, m in ipairs(e.set) do set[m] = true end\n"
+    "    return function(m) return set[m] end\n"
+    "  end\n"
+    "  return function(m)\n"
+    "    for _, key in ipairs(e.keys) do\n"
+    "      if redis.call('SISMEMBER', key, m) == 1 then return true end\n"
+    "    end\n"
+    "    return false\n"
+    "  end\n"
+    "end\n"
+    "for _, op in ipairs(ARGV) do\n"
+    "  if op == '&' or op == '|' then\n"
+    "    local b = table.remove(stack)\n"
+    "    local a = table.remove(stack)\n"
+    "    local out = {}\n"
+    "    if op == '&' and not a.set and not b.set and #a.keys == 1 and #b.keys == 1 then\n"
+    "      out = redis.call('SINTER', a.keys[1], b.keys[1])\n"
+    "    elseif op == '&' then\n"
+    "      if size(a) > size(b) then a, b = b, a end\n"
+    "      local member = lookup(b)\n"
+    "      for _, m in ipairs(members(a)) do\n"
+    "        if member(m) then out[#out + 1] = m end\n"
+    "      end\n"
+    "    else\n"
+    "      local set = {}\n"
+    "      for _, e in ipairs({a, b}) do\n"
+    "        for _, m in ipairs(members(e)) do\n"
+    "          if not set[m] then set[m] = true; out[#out + 1] = m end\n"
+    "        end\n"
+    "      end\n"
+    "    end\n"
+    "    stack[#stack + 1] = {set = out}\n"
+    "  else\n"
+    "    local keys = {}\n"
+    "    for i = 1, tonumber(op) do keys[i] = KEYS[k + i] end\n"
+    "    k = k + tonumber(op)\n"
+    "    stack[#stack + 1] = {keys = keys}\n"
+    "  end\n"
+    "end\n"
+    "return members(stack[1])\n";
+
+static redisScript series_sets_script = { NULL, series_sets_text, 0 };
+
+typedef struct seriesScript {
+    unsigned int	nkeys;
+    sds			*keys;
+    unsigned int	nops;
+    sds			*ops;
+} seriesScript;
+
+static sds
+series_node_key(node_t *np)
+{
+    const char		*name = np->left->key + sizeof("pcp:map:") - 1;
+    sds			key, val;
+
+    val = series_node_value(np);
+    key = sdscatfmt(sdsempty(), "pcp:series:%s:%S", name, val);
+    sdsfree(val);
+    return key;
+}
+
+static int
+series_script_append(sds **list, unsigned int *count, sds item)
+{
+    sds			*items;
+
+    if ((items = realloc(*list, (*count + 1) * sizeof(sds))) == NULL) {
+	sdsfree(item);
+	return -ENOMEM;
+    }
+    items[(*count)++] = item;
+    *list = items;
+    return 0;
+}
+
+static void
+series_script_free(seriesScript *script)
+{
+    unsigned int	i;
+
+    for (i = 0; i < script->nkeys; i++)
+	sdsfree(script->keys[i]);
+    for (i = 0; i < script->nops; i++)
+	sdsfree(script->ops[i]);
+    free(script->keys);
+    free(script->ops);
+}
+
+static int
+series_script_eligible(node_t *np)
+{
+    switch (np->type) {
+    case N_AND:
+    case N_OR:
+	return series_script_eligible(np->left) &&
+	       series_script_eligible(np->right);
+    case N_EQ:
+    case N_GLOB:
+    case N_REQ:
+    case N_RNE:
+	return 1;
+    default:
+	break;
+    }
+    return 0;
+}
+
+static int
+series_script_compile(seriesScript *script, node_t *np)
+{
+    unsigned int	i;
+    int			sts;
+
+    switch (np->type) {
+    case N_AND:
+    case N_OR:
+	if ((sts = series_script_compile(script, np->left)) < 0 ||
+	    (sts = series_script_compile(script, np->right)) < 0)
+	    return sts;
+	return series_script_append(&script->ops, &script->nops,
+			sdsnew(np->type == N_AND ? "&" : "|"));
+
+    case N_EQ:
+	if ((sts = series_script_append(&script->keys, &script->nkeys,
+			series_node_key(np))) < 0)
+	    return sts;
+	return series_script_append(&script->ops, &script->nops, sdsnew("1"));
+
+    default:	/* pattern matches - union of all matching sets */
+	for (i = 0; i < np->nmatches; i++)
+	    if ((sts = series_script_append(&script->keys, &script->nkeys,
+			sdsdup(np->matches[i]))) < 0)
+		return sts;
+	return series_script_append(&script->ops, &script->nops,
+			sdscatfmt(sdsempty(), "%u", np->nmatches));
+    }
+}
+
+static void
+series_script_release(node_t *np)
+{
+    unsigned int	i;
+
+    if (np == NULL)
+	return;
+    for (i = 0; i < np->nmatches; i++)
+	sdsfree(np->matches[i]);
+    free(np->matches);
+    np->matches = NULL;
+    np->nmatches = 0;
+    series_script_release(np->left);
+    series_script_release(np->right);
+}
+
+static void
+series_prepare_script_reply(redisAsyncContext *c, redisReply *reply, void *arg)
+{
+    node_t		*np = (node_t *)arg;
+    seriesQueryBaton	*baton = (seriesQueryBaton *)np->baton;
+    sds			msg;
+    int			sts;
+
+    seriesBatonCheckMagic(baton, MAGIC_QUERY, "series_prepare_script_reply");
+
+    if (reply == NULL || reply->type != REDIS_REPLY_ARRAY) {
+	infofmt(msg, "expected array from %s set expression (type=%s)",
+			EVALSHA, redis_reply_type(reply));
+	batoninfo(baton, PMLOG_RESPONSE, msg);
+	baton->error = -EPROTO;
+    } else {
+	if (pmDebugOptions.series)
+	    printf("%s expression\n", EVALSHA);
+	sts = node_series_reply(baton, np, reply->elements, reply->element);
+	if (sts < 0)
+	    baton->error = sts;
+    }
+
+    series_query_end_phase(baton);
+}
+
+/*
+ * Attempt to resolve an intersection or union subtree in one request,
+ * returning zero if this is not possible (some nodes in the subtree
+ * cannot be evaluated server-side, or keys span cluster hash slots),
+ * in which case the leaf sets are fetched and combined locally.
+ *
+ * Note that set keys carry no hash tags, so with a Redis cluster the
+ * keys of a subtree almost always span hash slots (a script may only
+ * access keys of one slot) and the local path is taken - there the
+ * leaf sets are still fetched with one pipelined batch per node.
+ */
+static int
+series_prepare_script(seriesQueryBaton *baton, node_t *np)
+{
+    seriesScript	script = {0};
+    redisAsyncContext	*context;
+    unsigned int	i, group = 0;
+    sds			params, key, nkeys;
+    int			sts;
+
+    if (!series_script_eligible(np))
+	return 0;
+    if ((sts = series_script_compile(&script, np)) < 0)
+	goto done;
+
+    for (i = 0; i < script.nkeys; i++) {
+	if (i == 0)
+	    group = redisSlotsKeyGroup(baton->slots, script.keys[i]);
+	else if (group != redisSlotsKeyGroup(baton->slots, script.keys[i]))
+	    goto done;	/* sets not colocated, combine them locally */
+    }
+
+    if (pmDebugOptions.series)
+	fprintf(stderr, "Set expression with %u keys, %u operations\n",
+			script.nkeys, script.nops);
+
+    /* EVALSHA sha1 numkeys key [key ...] op [op ...] */
+    nkeys = sdscatfmt(sdsempty(), "%u", script.nkeys);
+    params = redis_param_sds(sdsempty(), nkeys);
+    for (i = 0; i < script.nkeys; i++)
+	params = redis_param_sds(params, script.keys[i]);
+    for (i = 0; i < script.nops; i++)
+	params = redis_param_sds(params, script.ops[i]);
+    sdsfree(nkeys);
+    key = script.nkeys ? sdsdup(script.keys[0]) : NULL;
+
+    np->solved = 1;
+    np->baton = baton;
+    series_script_release(np);
+    seriesBatonReference(baton, "series_prepare_script");
+    context = redisGetAsyncContext(baton->slots, EVALSHA, key);
+    redisScriptRequest(context, &series_sets_script, key, params,
+			1 + script.nkeys + script.nops,
+			series_prepare_script_reply, np);
+    sts = 1;
+
+done:
+    series_script_free(&script);
+    return sts;
+}
+
 /*
  * Prepare evaluation of leaf nodes.
  */
 static int
 series_prepare_eval(seriesQueryBaton *baton, node_t *np, int level)
 {
-    sds 		val;
-    int			sts, i;
-    node_t		*left;
-    const char		*name;
+    int			sts;
 
     if (np == NULL)
 	return 0;
 
+    /* resolve set algebra within Redis where possible */
+    if ((np->type == N_AND || np->type == N_OR) &&
+	(sts = series_prepare_script(baton, np)) != 0)
+	return sts < 0 ? sts : 0;
+
     if ((sts = series_prepare_eval(baton, np->left, level+1)) < 0)
 	return sts;
 
     switch (np->type) {
     case N_EQ:		/* direct hash lookup */
-	left = np->left;
-	name = left->key + sizeof("pcp:map:") - 1;
 	assert(np->key == NULL);
-	val = series_node_value(np);
-	np->key = sdsnew("pcp:series:");
-	np->key = sdscatfmt(np->key, "%s:%S", name, val);
-	sdsfree(val);
+	np->key = series_node_key(np);
 	np->baton = baton;
 	seriesBatonReference(baton, "series_prepare_expr[direct]");
 	series_prepare_smembers(baton, np->key, np);
@@ -1027,10 +1407,8 @@ series_prepare_eval(seriesQueryBaton *baton, node_t *np, int level)
     case N_REQ:
     case N_RNE:
 	np->baton = baton;
-	if (np->nmatches > 0)
-	    seriesBatonReferences(baton, np->nmatches, "series_prepare_eval[pattern]");
-	for (i = 0; i < np->nmatches; i++)
-	    series_prepare_smembers(baton, np->matches[i], np);
+	if ((sts = series_prepare_sunion(baton, np)) < 0)
+	    return sts;
 	break;
 
     default:
@@ -1048,7 +1426,7 @@ series_prepare_expr(seriesQueryBaton *baton, node_t *np, int level)
 {
     int			sts;
 
-    if (np == NULL)
+    if (np == NULL || np->solved)
 	return 0;
 
     if ((sts = series_prepare_expr(baton, np->left, level+1)) < 0)
@@ -1098,6 +1476,154 @@ series_prepare_time_reply(redisAsyncContext *c, redisReply *reply, void *arg)
     series_query_end_phase(baton);
 }
 
+/*
+ * Fetch time series ranges for a group of streams from one Redis
+ * instance (or cluster slot) in a single request.
+ */
+static const char series_xrange_text[] =
+    "local r = {}\n"
+    "for i = 1, #KEYS do\n"
+    "  r[i] = redis.call('XRANGE', KEYS[i], ARGV[1], ARGV[2], 'COUNT', ARGV[3])\n"
+    "end\n"
+    "return r\n";
+
+static redisScript series_xrange_script = { NULL, series_xrange_text, 0 };
+
+typedef struct seriesGetSIDs {
+    seriesBatonMagic	header;		/* MAGIC_BATCH */
+    unsigned int	nsids;
+    seriesGetSID	**sids;
+    void		*baton;
+} seriesGetSIDs;
+
+typedef struct seriesTimeRange {
+    seriesQueryBaton	*baton;
+    sds			start;
+    sds			end;
+    sds			count;
+} seriesTimeRange;
+
+static void
+series_prepare_time_batch_reply(redisAsyncContext *c, redisReply *reply, void *arg)
+{
+    seriesGetSIDs	*group = (seriesGetSIDs *)arg;
+    seriesQueryBaton	*baton = (seriesQueryBaton *)group->baton;
+    seriesGetSID	*sid;
+    redisReply		*values;
+    sds			msg;
+    unsigned int	i;
+
+    seriesBatonCheckMagic(group, MAGIC_BATCH, "series_prepare_time_batch_reply");
+    seriesBatonCheckMagic(baton, MAGIC_QUERY, "series_prepare_time_batch_reply");
+
+    if (reply == NULL || reply->type != REDIS_REPLY_ARRAY ||
+	reply->elements != group->nsids) {
+	infofmt(msg, "expected %u element array from %s XSTREAM values (type=%s)",
+			group->nsids, EVALSHA, redis_reply_type(reply));
+	batoninfo(baton, PMLOG_RESPONSE, msg);
+	baton->error = -EPROTO;
+    }
+
+    for (i = 0; i < group->nsids; i++) {
+	sid = group->sids[i];
+	if (baton->error == 0) {
+	    values = reply->element[i];
+	    if (values->type != REDIS_REPLY_ARRAY) {
+		infofmt(msg, "expected array from %s XSTREAM values (type=%s)",
+			    sid->name, redis_reply_type(values));
+		batoninfo(baton, PMLOG_RESPONSE, msg);
+		baton->error = -EPROTO;
+	    } else {
+		series_values_reply(baton, sid->name,
+				values->elements, values->element, sid);
+	    }
+	}
+	freeSeriesGetSID(sid);
+    }
+    free(group->sids);
+    memset(group, 0, sizeof(seriesGetSIDs));
+    free(group);
+
+    series_query_end_phase(baton);
+}
+
+static void
+series_prepare_time_keys(redisAsyncContext *context, seriesTimeRange *range,
+		unsigned int nkeys, sds *keys, void **data)
+{
+    seriesQueryBaton	*baton = range->baton;
+    seriesGetSIDs	*group;
+    sds			cmd, key, nkeystr, params;
+    unsigned int	i;
+
+    seriesBatonReference(baton, "series_prepare_time_keys");
+
+    group = NULL;
+    if (nkeys > 1 && (group = calloc(1, sizeof(seriesGetSIDs))) != NULL) {
+	if ((group->sids = calloc(nkeys, sizeof(seriesGetSID *))) == NULL) {
+	    free(group);
+	    group = NULL;
+	}
+    }
+
+    if (group == NULL) {
+	/* single stream or out of memory - fallback to XRANGE per key */
+	seriesBatonReferences(baton, nkeys - 1, "series_prepare_time_keys");
+	for (i = 0; i < nkeys; i++) {
+	    key = sdsdup(keys[i]);
+	    /* XRANGE key t1 t2 [COUNT count] */
+	    cmd = redis_command(6);
+	    cmd = redis_param_str(cmd, XRANGE, XRANGE_LEN);
+	    cmd = redis_param_sds(cmd, key);
+	    cmd = redis_param_sds(cmd, range->start);
+	    cmd = redis_param_sds(cmd, range->end);
+	    cmd = redis_param_str(cmd, "COUNT", sizeof("COUNT")-1);
+	    cmd = redis_param_sds(cmd, range->count);
+	    redisSlotsContextRequest(context, key, cmd,
+				series_prepare_time_reply, data[i]);
+	}
+	return;
+    }
+
+    initSeriesBatonMagic(group, MAGIC_BATCH);
+    group->baton = baton;
+    group->nsids = nkeys;
+    for (i = 0; i < nkeys; i++)
+	group->sids[i] = (seriesGetSID *)data[i];
+
+    /* EVALSHA sha1 numkeys key [key ...] t1 t2 count */
+    nkeystr = sdscatfmt(sdsempty(), "%u", nkeys);
+    params = redis_param_sds(sdsempty(), nkeystr);
+    sdsfree(nkeystr);
+    for (i = 0; i < nkeys; i++)
+	params = redis_param_sds(params, keys[i]);
+    params = redis_param_sds(params, range->start);
+    params = redis_param_sds(params, range->end);
+    params = redis_param_sds(params, range->count);
+    redisScriptRequest(context, &series_xrange_script, sdsdup(keys[0]),
+			params, nkeys + 4, series_prepare_time_batch_reply, group);
+}
+
+/*
+ * Issue the range requests for all streams held by one Redis instance,
+ * with one request per cluster hash slot when talking to a cluster.
+ */
+static void
+series_prepare_time_group(redisSlots *slots, redisAsyncContext *context,
+		unsigned int nkeys, sds *keys, void **data, void *arg)
+{
+    seriesTimeRange	*range = (seriesTimeRange *)arg;
+    unsigned int	i, j, group;
+
+    for (i = 0; i < nkeys; i = j) {
+	group = redisSlotsKeyGroup(slots, keys[i]);
+	for (j = i + 1; j < nkeys; j++)
+	    if (redisSlotsKeyGroup(slots, keys[j]) != group)
+		break;
+	series_prepare_time_keys(context, range, j - i, keys + i, data + i);
+    }
+}
+
 #define DEFAULT_VALUE_COUNT 10
 
 static void
@@ -1105,54 +1631,69 @@ series_prepare_time(seriesQueryBaton *baton, series_set_t *result)
 {
     timing_t		*tp = &baton->u.query.timing;
     unsigned char	*series = result->series;
+    seriesTimeRange	range;
+    redisSlotsBatch	batch;
     seriesGetSID	*sid;
     char		buffer[64];
-    sds			count, start, end, key, cmd;
+    sds			key, msg;
     unsigned int	i;
+    int			sts;
 
-    start = sdsnew(timeval_stream_str(&tp->start, buffer, sizeof(buffer)));
+    range.baton = baton;
+    range.start = sdsnew(timeval_stream_str(&tp->start, buffer, sizeof(buffer)));
     if (pmDebugOptions.series)
-	fprintf(stderr, "START: %s\n", start);
+	fprintf(stderr, "START: %s\n", range.start);
 
     if (tp->end.tv_sec)
-	end = sdsnew(timeval_stream_str(&tp->end, buffer, sizeof(buffer)));
+	range.end = sdsnew(timeval_stream_str(&tp->end, buffer, sizeof(buffer)));
     else
-	end = sdsnew("+");	/* "+" means "no end" - to the most recent */
+	range.end = sdsnew("+");	/* "+" means "no end" - to the most recent */
     if (pmDebugOptions.series)
-	fprintf(stderr, "END: %s\n", end);
+	fprintf(stderr, "END: %s\n", range.end);
 
     if (tp->count == 0)
 	tp->count = DEFAULT_VALUE_COUNT;
-    count = sdscatfmt(sdsempty(), "%u", tp->count);
+    range.count = sdscatfmt(sdsempty(), "%u", tp->count);
     if (pmDebugOptions.series)
 	fprintf(stderr, "COUNT: %u\n", tp->count);
 
     /*
      * Query cache for the time series range (groups of instance:value
-     * pairs, with an associated timestamp).
+     * pairs, with an associated timestamp), batching the requests for
+     * all series held by the same Redis instance.
      */
+    redisSlotsBatchInit(&batch, baton->slots, 0);
     for (i = 0; i < result->nseries; i++, series += SHA1SZ) {
-	sid = calloc(1, sizeof(seriesGetSID));
+	if ((sid = calloc(1, sizeof(seriesGetSID))) == NULL) {
+	    sts = -ENOMEM;
+	    goto fail;
+	}
 	pmwebapi_hash_str(series, buffer, sizeof(buffer));
 	initSeriesGetSID(sid, buffer, 1, baton);
-	seriesBatonReference(baton, "series_prepare_time");
 
 	key = sdscatfmt(sdsempty(), "pcp:values:series:%S", sid->name);
-
-	/* XREAD key t1 t2 [COUNT count] */
-	cmd = redis_command(6);
-	cmd = redis_param_str(cmd, XRANGE, XRANGE_LEN);
-	cmd = redis_param_sds(cmd, key);
-	cmd = redis_param_sds(cmd, start);
-	cmd = redis_param_sds(cmd, end);
-	cmd = redis_param_str(cmd, "COUNT", sizeof("COUNT")-1);
-	cmd = redis_param_sds(cmd, count);
-	redisSlotsRequest(baton->slots, XRANGE, key, cmd,
-				series_prepare_time_reply, sid);
+	if ((sts = redisSlotsBatchAdd(&batch, key, sid)) < 0) {
+	    freeSeriesGetSID(sid);
+	    sdsfree(key);
+	    goto fail;
+	}
     }
-    sdsfree(count);
-    sdsfree(start);
-    sdsfree(end);
+    if ((sts = redisSlotsBatchSubmit(&batch, series_prepare_time_group, &range)) >= 0)
+	goto done;
+
+fail:
+    infofmt(msg, "out of memory preparing %u series value requests",
+		result->nseries);
+    batoninfo(baton, PMLOG_REQUEST, msg);
+    baton->error = sts;
+    for (i = 0; i < batch.nkeys; i++)
+	freeSeriesGetSID((seriesGetSID *)batch.keys[i].data);
+
+done:
+    redisSlotsBatchFree(&batch);
+    sdsfree(range.count);
+    sdsfree(range.start);
+    sdsfree(range.end);
 }
 
 static void
@@ -1204,12 +1745,14 @@ static void
 series_query_eval(void *arg)
 {
     seriesQueryBaton	*baton = (seriesQueryBaton *)arg;
+    int			sts;
 
     seriesBatonCheckMagic(baton, MAGIC_QUERY, "series_query_eval");
     seriesBatonCheckCount(baton, "series_query_eval");
 
     seriesBatonReference(baton, "series_query_eval");
-    series_prepare_eval(baton, &baton->u.query.root, 0);
+    if ((sts = series_prepare_eval(baton, &baton->u.query.root, 0)) < 0)
+	baton->error = sts;
     series_query_end_phase(baton);
 }
 
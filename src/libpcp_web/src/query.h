@@ -100,6 +100,7 @@ typedef struct node {
 
     /* result set of series at this node */
     struct series_set	result;
+    int			solved;	/* result set resolved by the server */
 
     /* partial match data for glob/regex */
     int			nmatches;
@@ -142,5 +143,6 @@ extern const char *series_instance_name(sds);
 extern const char *series_context_name(sds);
 extern const char *series_metric_name(sds);
 extern const char *series_label_name(sds);
+extern void series_name_key(node_t *);
 
 #endif	/* SERIES_QUERY_H */
@@ -1296,16 +1296,231 @@ series_dumpexpr(node_t *np, int level)
     series_dumpexpr(np->right, level+1);
 }
 
+/*
+ * Prepared query plan cache - maps normalized query text to a parsed
+ * expression tree with label name map keys already resolved, so that
+ * repeated queries (e.g. dashboard panel refreshes) skip the parse and
+ * name mapping phases.  Time window clauses are kept as text only and
+ * evaluated afresh on each use, as these may be relative to "now".
+ *
+ * Only accessed via pmSeriesQuery from the event loop thread (unlike
+ * pmSeriesLoad, which may run on a worker thread and is not cached).
+ */
+#define SERIES_PLANS_MAX	512
+
+typedef struct seriesPlan {
+    node_t		*expr;
+    timing_t		time;		/* time clause strings only */
+} seriesPlan;
+
+static dict		*series_plans;
+static pmSeriesPlanStats series_plan_stats;
+
+static void
+series_freetree(node_t *np)
+{
+    if (np == NULL)
+	return;
+    series_freetree(np->left);
+    series_freetree(np->right);
+    sdsfree(np->key);
+    sdsfree(np->value);
+    free(np);
+}
+
+static node_t *
+series_clonetree(node_t *np)
+{
+    node_t	*copy;
+
+    if (np == NULL)
+	return NULL;
+    copy = newnode(np->type);
+    copy->subtype = np->subtype;
+    copy->meta = np->meta;
+    if (np->key)
+	copy->key = sdsdup(np->key);
+    if (np->value)
+	copy->value = sdsdup(np->value);
+    copy->left = series_clonetree(np->left);
+    copy->right = series_clonetree(np->right);
+    return copy;
+}
+
+/* resolve label name map keys, which depend only on the query text */
+static void
+series_plan_names(node_t *np)
+{
+    if (np == NULL)
+	return;
+    series_plan_names(np->left);
+    if (np->type == N_NAME)
+	series_name_key(np);
+    series_plan_names(np->right);
+}
+
+static void
+series_plan_free(void *privdata, void *value)
+{
+    seriesPlan	*plan = (seriesPlan *)value;
+    timing_t	*tp = &plan->time;
+
+    (void)privdata;
+    series_freetree(plan->expr);
+    sdsfree(tp->deltas);
+    sdsfree(tp->aligns);
+    sdsfree(tp->starts);
+    sdsfree(tp->ends);
+    sdsfree(tp->ranges);
+    sdsfree(tp->counts);
+    sdsfree(tp->offsets);
+    sdsfree(tp->zones);
+    free(plan);
+}
+
+static dictType series_plan_callbacks;
+
+/*
+ * Cache key for a query - its token stream, as seen by the lexer, so
+ * that queries differing only in whitespace between tokens share one
+ * plan.  Each token contributes its type and length-prefixed text, so
+ * distinct token streams always give distinct keys.  Returns NULL for
+ * queries the lexer rejects, which are then not cached.
+ */
+static sds
+series_plan_text(sds query)
+{
+    PARSER	lp = { .yy_input = (char *)query };
+    YYSTYPE	lval;
+    sds		text = sdsempty();
+    int		type;
+
+    do {
+	memset(&lval, 0, sizeof(lval));
+	if ((type = series_lex(&lval, &lp)) == L_ERROR) {
+	    sdsfree(text);
+	    text = NULL;
+	    break;
+	}
+	if (lval.s)
+	    sdsfree(lval.s);
+	if (type != L_EOS)
+	    text = sdscatfmt(text, "%i:%u:%s;", type,
+			(unsigned int)strlen(lp.yy_tokbuf), lp.yy_tokbuf);
+    } while (type != L_EOS);
+
+    free(lp.yy_tokbuf);
+    sdsfree(lp.yy_errstr);
+    return text;
+}
+
+static int
+series_plan_eligible(series_t *sp)
+{
+    timing_t	*tp = &sp->time;
+
+    /* range and start/end clauses interact in source order - skip these */
+    if (tp->ranges && (tp->starts || tp->ends))
+	return 0;
+    return sp->expr != NULL;
+}
+
+static void
+series_plan_insert(sds text, series_t *sp)
+{
+    seriesPlan	*plan;
+    timing_t	*tp;
+    dictEntry	*entry;
+
+    if (series_plans == NULL) {
+	series_plan_callbacks = sdsKeyDictCallBacks;
+	series_plan_callbacks.valDestructor = series_plan_free;
+	series_plans = dictCreate(&series_plan_callbacks, NULL);
+    }
+    if (dictSize(series_plans) >= SERIES_PLANS_MAX &&
+	(entry = dictGetRandomKey(series_plans)) != NULL)
+	dictDelete(series_plans, dictGetKey(entry));
+
+    if ((plan = calloc(1, sizeof(seriesPlan))) == NULL)
+	return;
+    plan->expr = series_clonetree(sp->expr);
+    series_plan_names(plan->expr);
+    tp = &plan->time;
+    tp->deltas = sp->time.deltas ? sdsdup(sp->time.deltas) : NULL;
+    tp->aligns = sp->time.aligns ? sdsdup(sp->time.aligns) : NULL;
+    tp->starts = sp->time.starts ? sdsdup(sp->time.starts) : NULL;
+    tp->ends = sp->time.ends ? sdsdup(sp->time.ends) : NULL;
+    tp->ranges = sp->time.ranges ? sdsdup(sp->time.ranges) : NULL;
+    tp->counts = sp->time.counts ? sdsdup(sp->time.counts) : NULL;
+    tp->offsets = sp->time.offsets ? sdsdup(sp->time.offsets) : NULL;
+    tp->zones = sp->time.zones ? sdsdup(sp->time.zones) : NULL;
+    dictAdd(series_plans, text, plan);	/* key is duplicated */
+}
+
+/* instantiate a cached plan - fresh tree, time clauses re-evaluated */
+static int
+series_plan_instance(PARSER *lp, seriesPlan *plan)
+{
+    timing_t	*tp = &plan->time;
+
+    if (tp->ranges)
+	newrange(lp, tp->ranges);
+    if (tp->starts && !lp->yy_error)
+	newstarttime(lp, tp->starts);
+    if (tp->ends && !lp->yy_error)
+	newendtime(lp, tp->ends);
+    if (tp->aligns && !lp->yy_error)
+	newaligntime(lp, tp->aligns);
+    if (tp->deltas && !lp->yy_error)
+	newinterval(lp, tp->deltas);
+    if (tp->zones && !lp->yy_error)
+	newtimezone(lp, tp->zones);
+    if (tp->counts && !lp->yy_error)
+	newsamples(lp, tp->counts);
+    if (tp->offsets && !lp->yy_error)
+	newoffset(lp, tp->offsets);
+    if (lp->yy_error)
+	return lp->yy_error;
+    lp->yy_series.expr = series_clonetree(plan->expr);
+    return 0;
+}
+
+void
+pmSeriesGetPlanStats(pmSeriesPlanStats *stats)
+{
+    *stats = series_plan_stats;
+    stats->plans = series_plans ? dictSize(series_plans) : 0;
+}
+
 int
 pmSeriesQuery(pmSeriesSettings *settings, sds query, pmSeriesFlags flags, void *arg)
 {
     PARSER	yp = { .yy_base = query, .yy_input = (char *)query };
     series_t	*sp = &yp.yy_series;
+    dictEntry	*entry;
+    sds		text;
+    int		sts;
 
-    if (yyparse(&yp)) {
-	moduleinfo(&settings->module, PMLOG_ERROR, yp.yy_errstr, arg);
-	return yp.yy_error;
+    text = series_plan_text(query);
+    if (text && series_plans &&
+	(entry = dictFind(series_plans, text)) != NULL) {
+	series_plan_stats.hits++;
+	if ((sts = series_plan_instance(&yp, dictGetVal(entry))) < 0) {
+	    moduleinfo(&settings->module, PMLOG_ERROR, yp.yy_errstr, arg);
+	    sdsfree(text);
+	    return sts;
+	}
+    } else {
+	series_plan_stats.misses++;
+	if (yyparse(&yp)) {
+	    moduleinfo(&settings->module, PMLOG_ERROR, yp.yy_errstr, arg);
+	    sdsfree(text);
+	    return yp.yy_error;
+	}
+	if (text && series_plan_eligible(sp))
+	    series_plan_insert(text, sp);
     }
+    sdsfree(text);
 
     if (pmDebugOptions.series)
 	series_dumpexpr(sp->expr, 0);
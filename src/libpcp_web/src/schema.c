@@ -24,35 +24,33 @@
 #define SCHEMA_VERSION	2
 #define SHA1SZ		20
 
-typedef struct redisScript {
-    sds			hash;
-    const char		*text;
-} redisScript;
-
 static redisScript	*scripts;
 static int		nscripts;
 
+/* Calculate unique script identifier from its contents */
 static void
-redisScriptsInit(void)
+redisScriptHash(redisScript *script)
 {
-    const unsigned char	*text;
+    const unsigned char	*text = (const unsigned char *)script->text;
     unsigned char	hash[20];
     char		hashbuf[42];
-    redisScript		*script;
     SHA1_CTX		shactx;
-    int			i;
 
-    for (i = 0; i < nscripts; i++) {
-	script = &scripts[i];
-	text = (const unsigned char *)script->text;
+    SHA1Init(&shactx);
+    SHA1Update(&shactx, text, strlen((char *)text));
+    SHA1Final(hash, &shactx);
+    pmwebapi_hash_str(hash, hashbuf, sizeof(hashbuf));
+    script->hash = sdsnew(hashbuf);
+}
 
-	/* Calculate unique script identifier from its contents */
-	SHA1Init(&shactx);
-	SHA1Update(&shactx, text, strlen((char *)text));
-	SHA1Final(hash, &shactx);
-	pmwebapi_hash_str(hash, hashbuf, sizeof(hashbuf));
-	scripts->hash = sdsnew(hashbuf);
-    }
+static void
+redisScriptsInit(void)
+{
+    int			i;
+
+    for (i = 0; i < nscripts; i++)
+	if (scripts[i].hash == NULL)
+	    redisScriptHash(&scripts[i]);
 }
 
 static int
@@ -62,6 +60,106 @@ testReplyError(redisReply *reply, const char *server_message)
 	    strcmp(reply->str, server_message) == 0);
 }
 
+typedef struct redisScriptBaton {
+    redisScript		*script;
+    sds			params;		/* numkeys key [key ...] arg [arg ...] */
+    unsigned int	nparams;
+    redisAsyncCallBack	*callback;
+    void		*arg;
+} redisScriptBaton;
+
+static void
+redis_script_load_callback(redisAsyncContext *c, redisReply *reply, void *arg)
+{
+    redisScript		*script = (redisScript *)arg;
+
+    /* on failure EVALSHA reports NOSCRIPT and the script is sent in full */
+    if (reply && reply->type == REDIS_REPLY_STRING &&
+	strcmp(reply->str, script->hash) != 0 && pmDebugOptions.series)
+	fprintf(stderr, "%s LOAD returned hash %s, expected %s\n",
+			SCRIPT, reply->str, script->hash);
+}
+
+static void
+redis_script_callback(redisAsyncContext *c, redisReply *reply, void *arg)
+{
+    redisScriptBaton	*baton = (redisScriptBaton *)arg;
+    redisScript		*script = baton->script;
+    sds			cmd;
+
+    if (reply && reply->type == REDIS_REPLY_ERROR &&
+	strncmp(reply->str, "NOSCRIPT", sizeof("NOSCRIPT")-1) == 0) {
+	/* EVAL script numkeys key [key ...] arg [arg ...] - also caches it */
+	if (pmDebugOptions.series)
+	    fprintf(stderr, "%s %s: no script, sending %s\n",
+			EVALSHA, script->hash, EVAL);
+	cmd = redis_command(2 + baton->nparams);
+	cmd = redis_param_str(cmd, EVAL, EVAL_LEN);
+	cmd = redis_param_str(cmd, script->text, strlen(script->text));
+	cmd = sdscatsds(cmd, baton->params);
+	redisSlotsContextRequest(c, NULL, cmd, baton->callback, baton->arg);
+    } else {
+	baton->callback(c, reply, baton->arg);
+    }
+    sdsfree(baton->params);
+    free(baton);
+}
+
+/*
+ * Evaluate a Lua script on the given connection, taking ownership of
+ * the key and the Redis protocol encoded parameters (numkeys, keys and
+ * arguments).  The script is loaded (SCRIPT LOAD) with its first use
+ * and thereafter evaluated by hash, so the script text is not sent with
+ * each request; other servers (cluster nodes) reporting NOSCRIPT are
+ * sent the script once with EVAL, which also caches it there.
+ */
+int
+redisScriptRequest(redisAsyncContext *context, redisScript *script, sds key,
+		sds params, unsigned int nparams,
+		redisAsyncCallBack *callback, void *arg)
+{
+    redisScriptBaton	*baton;
+    sds			cmd;
+    int			sts;
+
+    if ((baton = calloc(1, sizeof(redisScriptBaton))) == NULL) {
+	sdsfree(params);
+	sdsfree(key);
+	return -ENOMEM;
+    }
+    if (script->hash == NULL)
+	redisScriptHash(script);
+
+    if (!script->loaded) {
+	/* SCRIPT LOAD script */
+	cmd = redis_command(3);
+	cmd = redis_param_str(cmd, SCRIPT, SCRIPT_LEN);
+	cmd = redis_param_str(cmd, "LOAD", sizeof("LOAD")-1);
+	cmd = redis_param_str(cmd, script->text, strlen(script->text));
+	redisSlotsContextRequest(context, NULL, cmd,
+			redis_script_load_callback, script);
+	script->loaded = 1;
+    }
+
+    baton->script = script;
+    baton->params = params;
+    baton->nparams = nparams;
+    baton->callback = callback;
+    baton->arg = arg;
+
+    /* EVALSHA sha1 numkeys key [key ...] arg [arg ...] */
+    cmd = redis_command(2 + nparams);
+    cmd = redis_param_str(cmd, EVALSHA, EVALSHA_LEN);
+    cmd = redis_param_sds(cmd, script->hash);
+    cmd = sdscatsds(cmd, params);
+    if ((sts = redisSlotsContextRequest(context, key, cmd,
+			redis_script_callback, baton)) < 0) {
+	sdsfree(params);
+	free(baton);
+    }
+    return sts;
+}
+
 static void
 reportReplyError(redisInfoCallBack info, void *userdata,
 	redisReply *reply, const char *format, va_list argp)
@@ -1431,6 +1529,7 @@ redis_load_slots_callback(redisAsyncContext *c, redisReply *reply, void *arg)
     }
     /* Case of a cluster of Redis instances, following the cluster spec */
     else {
+	baton->slots->cluster = 1;
 	if (checkArrayReply(baton->info, baton->userdata,
 				reply, "%s %s", CLUSTER, "SLOTS") == 0)
 	    decodeRedisSlots(baton, reply);
@@ -1694,7 +1793,9 @@ pmDiscoverClose(pmDiscoverModule *module)
 
     if (discover) {
 	pmDiscoverUnregister(discover->handle);
+	pmDiscoverTimerClose(discover);
 	memset(discover, 0, sizeof(*discover));
 	free(discover);
+	module->privdata = NULL;
     }
 }
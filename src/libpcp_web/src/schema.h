@@ -1,5 +1,5 @@
 /*
- * Copyright (c) 2017-2018 Red Hat.
+ * Copyright (c) 2017-2019 Red Hat.
  * 
  * This library is free software; you can redistribute it and/or modify it
  * under the terms of the GNU Lesser General Public License as published
@@ -27,6 +27,8 @@
 #define COMMAND_LEN	(sizeof(COMMAND)-1)
 #define CLUSTER		"CLUSTER"
 #define CLUSTER_LEN	(sizeof(CLUSTER)-1)
+#define EVAL		"EVAL"
+#define EVAL_LEN	(sizeof(EVAL)-1)
 #define EVALSHA		"EVALSHA"
 #define EVALSHA_LEN	(sizeof(EVALSHA)-1)
 #define EXPIRE		"EXPIRE"
@@ -55,10 +57,14 @@
 #define PUBLISH_LEN	(sizeof(PUBLISH)-1)
 #define SADD		"SADD"
 #define SADD_LEN	(sizeof(SADD)-1)
+#define SCRIPT		"SCRIPT"
+#define SCRIPT_LEN	(sizeof(SCRIPT)-1)
 #define SETS		"SET"
 #define SETS_LEN	(sizeof(SETS)-1)
 #define SMEMBERS	"SMEMBERS"
 #define SMEMBERS_LEN	(sizeof(SMEMBERS)-1)
+#define SUNION		"SUNION"
+#define SUNION_LEN	(sizeof(SUNION)-1)
 #define XADD		"XADD"
 #define XADD_LEN	(sizeof(XADD)-1)
 #define XRANGE		"XRANGE"
@@ -102,6 +108,20 @@ redis_param_raw(sds cmd, sds param)
     return sdscatfmt(cmd, "%S\r\n", param);
 }
 
+/*
+ * Lua scripts evaluated by their SHA1 hash (EVALSHA), with the script
+ * loaded on first use and resent in full (EVAL) to any Redis server
+ * reporting it has no such script.
+ */
+typedef struct redisScript {
+    sds			hash;
+    const char		*text;
+    unsigned int	loaded;		/* SCRIPT LOAD sent */
+} redisScript;
+
+extern int redisScriptRequest(redisAsyncContext *, redisScript *, sds,
+		sds, unsigned int, redisAsyncCallBack *, void *);
+
 extern void redis_series_source(redisSlots *, void *);
 extern void redis_series_mark(redisSlots *, sds, int, void *);
 extern void redis_series_metric(redisSlots *, metric_t *, sds, int, int, void *);
@@ -52,9 +52,39 @@ slotsCompare(const void *pa, const void *pb)
     return 0;
 }
 
+/*
+ * Identify the master server of a slot range by its address - one node
+ * in a Redis cluster may serve several (non-contiguous) slot ranges.
+ */
+static int
+slotRangeNode(redisSlots *redis, redisSlotRange *range)
+{
+    const char		*hostspec = range->master.hostspec;
+    unsigned int	i;
+    sds			*nodes;
+
+    for (i = 0; i < redis->nnodes; i++) {
+	if (strcmp(redis->nodes[i], hostspec) == 0) {
+	    range->node = i;
+	    return 0;
+	}
+    }
+    if ((nodes = realloc(redis->nodes, (i + 1) * sizeof(sds))) == NULL)
+	return -ENOMEM;
+    redis->nodes = nodes;
+    if ((nodes[i] = sdsnew(hostspec)) == NULL)
+	return -ENOMEM;
+    redis->nnodes++;
+    range->node = i;
+    return 0;
+}
+
 int
 redisSlotRangeInsert(redisSlots *redis, redisSlotRange *range)
 {
+    if (slotRangeNode(redis, range) < 0)
+	return -ENOMEM;
+
     if (pmDebugOptions.series) {
 	int		i;
 
@@ -96,12 +126,16 @@ redisSlotsFree(redisSlots *pool)
 {
     void		*root = pool->slots;
     redisSlotRange	*range;
+    unsigned int	i;
 
     while (root != NULL) {
 	range = *(redisSlotRange **)root;
 	tdelete(range, &root, slotsCompare);
 	redisSlotRangeFree(pool, range);
     }
+    for (i = 0; i < pool->nnodes; i++)
+	sdsfree(pool->nodes[i]);
+    free(pool->nodes);
     redisAsyncFree(pool->control.redis);
     sdsfree(pool->control.hostspec);
     dictRelease(pool->keymap);
@@ -244,6 +278,18 @@ redisSlotsRequest(redisSlots *slots, const char *command, sds key, sds cmd,
 	redisAsyncCallBack *callback, void *arg)
 {
     redisAsyncContext	*context = redisGetAsyncContext(slots, command, key);
+
+    return redisSlotsContextRequest(context, key, cmd, callback, arg);
+}
+
+/*
+ * Send a request on a given connection, e.g. one already selected for
+ * a batch of keys, taking ownership of the key and command as above.
+ */
+int
+redisSlotsContextRequest(redisAsyncContext *context, sds key, sds cmd,
+	redisAsyncCallBack *callback, void *arg)
+{
     int			sts;
 
     if (UNLIKELY(pmDebugOptions.desperate))
@@ -258,6 +304,147 @@ redisSlotsRequest(redisSlots *slots, const char *command, sds key, sds cmd,
     return 0;
 }
 
+/*
+ * Identify the Redis server (master node address) serving a slot.
+ */
+static unsigned int
+slotNode(redisSlots *slots, unsigned int slot)
+{
+    redisSlotRange	*range, s;
+    void		*p;
+
+    s.start = s.end = slot;
+    p = tfind((const void *)&s, (void **)&slots->slots, slotsCompare);
+    if (p != NULL && (range = *(redisSlotRange **)p) != NULL)
+	return range->node;
+    return slots->nnodes;	/* no server */
+}
+
+/*
+ * Identify the group of keys which may be used together in a single
+ * multi-key request - the hash slot for a Redis cluster, else the
+ * Redis instance serving the key.
+ */
+unsigned int
+redisSlotsKeyGroup(redisSlots *slots, sds key)
+{
+    unsigned int	slot = keySlot(key, sdslen(key));
+
+    return slots->cluster ? slot : slotNode(slots, slot);
+}
+
+void
+redisSlotsBatchInit(redisSlotsBatch *batch, redisSlots *slots,
+		unsigned int maxkeys)
+{
+    memset(batch, 0, sizeof(*batch));
+    batch->slots = slots;
+    batch->maxkeys = maxkeys ? maxkeys : BATCHMAXKEYS;
+}
+
+/*
+ * Add a key (and associated caller data) to a batch.  The batch takes
+ * ownership of the key, which is freed by redisSlotsBatchFree.
+ */
+int
+redisSlotsBatchAdd(redisSlotsBatch *batch, sds key, void *data)
+{
+    redisBatchKey	*keys, *bp;
+    unsigned int	size, slot;
+
+    if (batch->nkeys >= batch->size) {
+	size = batch->size ? batch->size * 2 : 16;
+	if ((keys = realloc(batch->keys, size * sizeof(redisBatchKey))) == NULL)
+	    return -ENOMEM;
+	batch->keys = keys;
+	batch->size = size;
+    }
+
+    bp = &batch->keys[batch->nkeys];
+    slot = keySlot(key, sdslen(key));
+    bp->node = slotNode(batch->slots, slot);
+    bp->group = batch->slots->cluster ? slot : bp->node;
+    bp->index = batch->nkeys++;
+    bp->key = key;
+    bp->data = data;
+    return 0;
+}
+
+static int
+batchCompare(const void *pa, const void *pb)
+{
+    redisBatchKey	*a = (redisBatchKey *)pa;
+    redisBatchKey	*b = (redisBatchKey *)pb;
+
+    if (a->node != b->node)
+	return a->node < b->node ? -1 : 1;
+    if (a->group != b->group)
+	return a->group < b->group ? -1 : 1;
+    return a->index < b->index ? -1 : (a->index > b->index);
+}
+
+/*
+ * Issue callbacks for the keys of each Redis server in the batch, in
+ * group order.  The callback is expected to send one request for each
+ * group of keys it is passed, on the connection given, so all requests
+ * to one server are written (pipelined) together and their replies
+ * arrive in one round trip.  Returns the number of callbacks issued.
+ */
+int
+redisSlotsBatchSubmit(redisSlotsBatch *batch, redisBatchCallBack callback,
+		void *arg)
+{
+    redisAsyncContext	*context;
+    redisBatchKey	*bp;
+    unsigned int	i, n, ncalls = 0;
+    void		**data;
+    sds			*keys;
+
+    if (batch->nkeys == 0)
+	return 0;
+
+    keys = (sds *)calloc(batch->maxkeys, sizeof(sds));
+    data = (void **)calloc(batch->maxkeys, sizeof(void *));
+    if (keys == NULL || data == NULL) {
+	free(keys);
+	free(data);
+	return -ENOMEM;
+    }
+
+    qsort(batch->keys, batch->nkeys, sizeof(redisBatchKey), batchCompare);
+
+    for (i = n = 0; i < batch->nkeys; i++) {
+	bp = &batch->keys[i];
+	keys[n] = bp->key;
+	data[n] = bp->data;
+	n++;
+	if (n < batch->maxkeys && i + 1 < batch->nkeys &&
+	    batch->keys[i + 1].node == bp->node)
+	    continue;
+	if (UNLIKELY(pmDebugOptions.series))
+	    fprintf(stderr, "Redis batch [node=%05u] %u keys\n", bp->node, n);
+	context = redisGetAsyncContext(batch->slots, "batch", keys[0]);
+	callback(batch->slots, context, n, keys, data, arg);
+	ncalls++;
+	n = 0;
+    }
+
+    free(keys);
+    free(data);
+    return ncalls;
+}
+
+void
+redisSlotsBatchFree(redisSlotsBatch *batch)
+{
+    unsigned int	i;
+
+    for (i = 0; i < batch->nkeys; i++)
+	sdsfree(batch->keys[i].key);
+    free(batch->keys);
+    memset(batch, 0, sizeof(*batch));
+}
+
 int
 redisSlotsProxyConnect(redisSlots *slots, redisInfoCallBack info,
 	redisReader **readerp, const char *buffer, ssize_t nread,
@@ -1,5 +1,5 @@
 /*
- * Copyright (c) 2017-2018 Red Hat.
+ * Copyright (c) 2017-2019 Red Hat.
  * 
  * This library is free software; you can redistribute it and/or modify it
  * under the terms of the GNU Lesser General Public License as published
@@ -35,6 +35,7 @@ typedef struct redisSlotServer {
 typedef struct redisSlotRange {
     unsigned int	start;
     unsigned int	end;
+    unsigned int	node;		/* index of master in redisSlots nodes */
     redisSlotServer	master;
     unsigned int	counter;
     unsigned int	nreplicas;
@@ -44,7 +45,10 @@ typedef struct redisSlotRange {
 typedef struct redisSlots {
     redisSlotServer	control;	/* control socket/host specification */
     redisSlotRange	*slots;		/* all instances; e.g. CLUSTER SLOTS */
+    sds			*nodes;		/* distinct master server addresses */
+    unsigned int	nnodes;
     redisMap		*keymap;	/* map command names to key position */
+    unsigned int	cluster;	/* keys of one request must share a slot */
     void		*events;
 } redisSlots;
 
@@ -59,8 +63,46 @@ extern redisSlots *redisSlotsConnect(sds, redisSlotsFlags,
 		redisInfoCallBack, redisDoneCallBack, void *, void *, void *);
 extern int redisSlotsRequest(redisSlots *, const char *, sds, sds,
 		redisAsyncCallBack *, void *);
+extern int redisSlotsContextRequest(redisAsyncContext *, sds, sds,
+		redisAsyncCallBack *, void *);
 extern void redisSlotsFree(redisSlots *);
 
+/*
+ * Batches of keyed requests, grouped by the Redis server each key is
+ * routed to.  Keys served by one server are passed to the caller in
+ * one callback, along with the connection to use, so that requests
+ * for them are written back-to-back and answered in one round trip.
+ * Within a server, keys are ordered by group (hash slot for a Redis
+ * cluster, else the server itself) - a single multi-key request (e.g.
+ * SUNION, EVALSHA) can be sent for each group instead of per key.
+ */
+#define BATCHMAXKEYS	256
+
+typedef struct redisBatchKey {
+    unsigned int	node;		/* master server serving the key */
+    unsigned int	group;		/* hash slot (cluster), else node */
+    unsigned int	index;		/* insertion order, for stable sorting */
+    sds			key;
+    void		*data;
+} redisBatchKey;
+
+typedef struct redisSlotsBatch {
+    redisSlots		*slots;
+    unsigned int	maxkeys;	/* upper limit on keys in one callback */
+    unsigned int	nkeys;
+    unsigned int	size;
+    redisBatchKey	*keys;
+} redisSlotsBatch;
+
+typedef void (*redisBatchCallBack)(redisSlots *, redisAsyncContext *,
+		unsigned int, sds *, void **, void *);
+
+extern unsigned int redisSlotsKeyGroup(redisSlots *, sds);
+extern void redisSlotsBatchInit(redisSlotsBatch *, redisSlots *, unsigned int);
+extern int redisSlotsBatchAdd(redisSlotsBatch *, sds, void *);
+extern int redisSlotsBatchSubmit(redisSlotsBatch *, redisBatchCallBack, void *);
+extern void redisSlotsBatchFree(redisSlotsBatch *);
+
 extern int redisSlotsProxyConnect(redisSlots *,
 		redisInfoCallBack, redisReader **, const char *, ssize_t,
 		redisAsyncCallBack *, void *);
@@ -13,23 +13,144 @@
 */
 
 #include <pcp/pmapi.h>
+#include <limits.h>
 #include <ctype.h>
 
 #include "atop.h"
 #include "photoproc.h"
 #include "procmetrics.h"
 
+/*
+** proc values that cannot change during the life of a process are
+** fetched once only, when the process is first seen - all others
+** are fetched on every sample.  Note the process name is not one of
+** these, as it changes on exec and on prctl(PR_SET_NAME) (kworkers),
+** and nor are credentials, which change with setuid(2) and friends.
+*/
+static const int staticmetrics[] = {
+	TASK_GEN_PID, TASK_GEN_TGID, TASK_GEN_BTIME,
+	TASK_GEN_ENVID, TASK_GEN_VPID, TASK_GEN_CONTAINER,
+};
+#define NSTATIC	(sizeof(staticmetrics) / sizeof(staticmetrics[0]))
+
+/*
+** sampled but not (yet) reported, so never fetched
+*/
+static const int unusedmetrics[] = {
+	TASK_GEN_RUIDNM, TASK_GEN_EUIDNM, TASK_GEN_SUIDNM, TASK_GEN_FSUIDNM,
+};
+#define NUNUSED	(sizeof(unusedmetrics) / sizeof(unusedmetrics[0]))
+
+/*
+** static values for one process/thread, kept across samples in an
+** array sorted on pid - the external instance name (pid and command
+** line) identifies the process should its pid be reused
+*/
+struct taskstatic {
+	int	pid;
+	int	fetched;	/* boolean: static values are valid */
+	char	*inst;		/* instance name, from current insts */
+	int	procpid;	/* as reported, maybe 0 */
+	int	tgid;
+	int	ctid;
+	int	vpid;
+	time_t	btime;
+	char	container[CLEN];
+};
+
+/*
+** a process/thread of the current sample, for searching on pid
+*/
+struct taskslot {
+	int	pid;
+	int	pos;		/* index into current instance list */
+};
+
+static int
+compare_slot(const void *a, const void *b)
+{
+	const struct taskslot	*sa = (const struct taskslot *)a;
+	const struct taskslot	*sb = (const struct taskslot *)b;
+
+	return (sa->pid > sb->pid) - (sa->pid < sb->pid);
+}
+
+/*
+** for one metric, record the index into the value list of the value
+** for each process/thread, in the slots of an index array with stride
+** TASK_NMETRICS - values are usually in instance domain order, so a
+** search is needed only when that is not the case.  Processes without
+** a value get an index beyond the value list, which the extract_*_index
+** routines treat as "no value".
+*/
+static void
+index_values(pmValueSet *vsp, int metric, int *pids, struct taskslot *sorted,
+		unsigned long count, int *index)
+{
+	struct taskslot	key, *slot;
+	unsigned long	i;
+	int		j, pos;
+
+	for (i=0; i < count; i++)
+		index[i * TASK_NMETRICS + metric] = INT_MAX;
+
+	for (j=0; j < vsp->numval; j++)
+	{
+		key.pid = vsp->vlist[j].inst;
+		if (j < (int)count && pids[j] == key.pid)
+			pos = j;
+		else if ((slot = bsearch(&key, sorted, count,
+				sizeof(struct taskslot), compare_slot)) != NULL)
+			pos = slot->pos;
+		else
+			continue;
+		index[pos * TASK_NMETRICS + metric] = j;
+	}
+}
+
+/*
+** sampled static proc values into the cache, for one process/thread
+*/
+static void
+update_static(struct taskstatic *sp, pmResult *rp, pmDesc *dp, int *index)
+{
+	int	i;
+
+	for (i=0; i < NSTATIC; i++)
+		if (index[staticmetrics[i]] < rp->vset[staticmetrics[i]]->numval)
+			sp->fetched = 1;
+
+	/* /proc/pid/cgroup */
+	extract_string_index(rp, dp, TASK_GEN_CONTAINER, &sp->container[0],
+			sizeof(sp->container), index[TASK_GEN_CONTAINER]);
+
+	/* /proc/pid/stat */
+	sp->btime = extract_integer_index(rp, dp, TASK_GEN_BTIME,
+			index[TASK_GEN_BTIME]);
+
+	/* /proc/pid/status */
+	sp->procpid = extract_integer_index(rp, dp, TASK_GEN_PID,
+			index[TASK_GEN_PID]);
+	sp->tgid = extract_integer_index(rp, dp, TASK_GEN_TGID,
+			index[TASK_GEN_TGID]);
+	sp->ctid = extract_integer_index(rp, dp, TASK_GEN_ENVID,
+			index[TASK_GEN_ENVID]);
+	sp->vpid = extract_integer_index(rp, dp, TASK_GEN_VPID,
+			index[TASK_GEN_VPID]);
+}
+
 /*
 ** sampled proc values into task structure, for one process/thread
 */
 static void
-update_task(struct tstat *task, int pid, char *name, pmResult *rp, pmDesc *dp)
+update_task(struct tstat *task, int pid, char *name, struct taskstatic *sp,
+		pmResult *rp, pmDesc *dp, int *index)
 {
-	char *nametail = name;
+	char *nametail = strchr(name, ' ');
 	memset(task, 0, sizeof(struct tstat));
 
-	strsep(&nametail, " ");	/* remove process identifier prefix; might fail */
-	strncpy(task->gen.cmdline, nametail ? nametail : name, CMDLEN);
+	/* remove process identifier prefix (might fail), leaving name intact */
+	strncpy(task->gen.cmdline, nametail ? nametail + 1 : name, CMDLEN);
 	task->gen.cmdline[CMDLEN] = '\0';
 	task->gen.isproc = 1;		/* thread/process marker */
 
@@ -37,59 +158,87 @@ update_task(struct tstat *task, int pid, char *name, pmResult *rp, pmDesc *dp)
 	task->mem.pmem = (unsigned long long)-1LL;
 
 	/* /proc/pid/cgroup */
-	extract_string_inst(rp, dp, TASK_GEN_CONTAINER, &task->gen.container[0],
-				sizeof(task->gen.container), pid);
+	memcpy(task->gen.container, sp->container, sizeof(task->gen.container));
         if (task->gen.container[0] != '\0')
 		supportflags |= DOCKSTAT;
 
 	/* /proc/pid/stat */
-	extract_string_inst(rp, dp, TASK_GEN_NAME, &task->gen.name[0],
-				sizeof(task->gen.name), pid);
-	extract_string_inst(rp, dp, TASK_GEN_STATE, &task->gen.state,
-				sizeof(task->gen.state), pid);
+	extract_string_index(rp, dp, TASK_GEN_NAME, &task->gen.name[0],
+				sizeof(task->gen.name), index[TASK_GEN_NAME]);
+	extract_string_index(rp, dp, TASK_GEN_STATE, &task->gen.state,
+				sizeof(task->gen.state), index[TASK_GEN_STATE]);
 
-	task->gen.pid = extract_integer_inst(rp, dp, TASK_GEN_PID, pid);
-	task->gen.ppid = extract_integer_inst(rp, dp, TASK_GEN_PPID, pid);
+	task->gen.pid = sp->procpid;
+	task->gen.ppid = extract_integer_index(rp, dp, TASK_GEN_PPID,
+				index[TASK_GEN_PPID]);
 	if (task->gen.ppid <= 0 && pid != 1)
 		task->gen.ppid = 1;
-	task->mem.minflt = extract_count_t_inst(rp, dp, TASK_MEM_MINFLT, pid);
-	task->mem.majflt = extract_count_t_inst(rp, dp, TASK_MEM_MAJFLT, pid);
-	task->cpu.utime = extract_count_t_inst(rp, dp, TASK_CPU_UTIME, pid);
-	task->cpu.stime = extract_count_t_inst(rp, dp, TASK_CPU_STIME, pid);
-	task->cpu.prio = extract_integer_inst(rp, dp, TASK_CPU_PRIO, pid);
-	task->cpu.nice = extract_integer_inst(rp, dp, TASK_CPU_NICE, pid);
-	task->gen.btime = extract_integer_inst(rp, dp, TASK_GEN_BTIME, pid);
-	task->mem.vmem = extract_count_t_inst(rp, dp, TASK_MEM_VMEM, pid);
-	task->mem.rmem = extract_count_t_inst(rp, dp, TASK_MEM_RMEM, pid);
-	task->cpu.curcpu = extract_integer_inst(rp, dp, TASK_CPU_CURCPU, pid);
-	task->cpu.rtprio = extract_integer_inst(rp, dp, TASK_CPU_RTPRIO, pid);
-	task->cpu.policy = extract_integer_inst(rp, dp, TASK_CPU_POLICY, pid);
+	task->mem.minflt = extract_count_t_index(rp, dp, TASK_MEM_MINFLT,
+				index[TASK_MEM_MINFLT]);
+	task->mem.majflt = extract_count_t_index(rp, dp, TASK_MEM_MAJFLT,
+				index[TASK_MEM_MAJFLT]);
+	task->cpu.utime = extract_count_t_index(rp, dp, TASK_CPU_UTIME,
+				index[TASK_CPU_UTIME]);
+	task->cpu.stime = extract_count_t_index(rp, dp, TASK_CPU_STIME,
+				index[TASK_CPU_STIME]);
+	task->cpu.prio = extract_integer_index(rp, dp, TASK_CPU_PRIO,
+				index[TASK_CPU_PRIO]);
+	task->cpu.nice = extract_integer_index(rp, dp, TASK_CPU_NICE,
+				index[TASK_CPU_NICE]);
+	task->gen.btime = sp->btime;
+	task->mem.vmem = extract_count_t_index(rp, dp, TASK_MEM_VMEM,
+				index[TASK_MEM_VMEM]);
+	task->mem.rmem = extract_count_t_index(rp, dp, TASK_MEM_RMEM,
+				index[TASK_MEM_RMEM]);
+	task->cpu.curcpu = extract_integer_index(rp, dp, TASK_CPU_CURCPU,
+				index[TASK_CPU_CURCPU]);
+	task->cpu.rtprio = extract_integer_index(rp, dp, TASK_CPU_RTPRIO,
+				index[TASK_CPU_RTPRIO]);
+	task->cpu.policy = extract_integer_index(rp, dp, TASK_CPU_POLICY,
+				index[TASK_CPU_POLICY]);
 
 	/* /proc/pid/status */
-	task->gen.nthr = extract_integer_inst(rp, dp, TASK_GEN_NTHR, pid);
-	task->gen.tgid = extract_integer_inst(rp, dp, TASK_GEN_TGID, pid);
+	task->gen.nthr = extract_integer_index(rp, dp, TASK_GEN_NTHR,
+				index[TASK_GEN_NTHR]);
+	task->gen.tgid = sp->tgid;
 	if (task->gen.tgid <= 0)
 		task->gen.tgid = pid;
-	task->gen.ctid = extract_integer_inst(rp, dp, TASK_GEN_ENVID, pid);
-	task->gen.vpid = extract_integer_inst(rp, dp, TASK_GEN_VPID, pid);
-	task->gen.ruid = extract_integer_inst(rp, dp, TASK_GEN_RUID, pid);
-	task->gen.euid = extract_integer_inst(rp, dp, TASK_GEN_EUID, pid);
-	task->gen.suid = extract_integer_inst(rp, dp, TASK_GEN_SUID, pid);
-	task->gen.fsuid = extract_integer_inst(rp, dp, TASK_GEN_FSUID, pid);
-	task->gen.rgid = extract_integer_inst(rp, dp, TASK_GEN_RGID, pid);
-	task->gen.egid = extract_integer_inst(rp, dp, TASK_GEN_EGID, pid);
-	task->gen.sgid = extract_integer_inst(rp, dp, TASK_GEN_SGID, pid);
-	task->gen.fsgid = extract_integer_inst(rp, dp, TASK_GEN_FSGID, pid);
-	task->mem.vdata = extract_count_t_inst(rp, dp, TASK_MEM_VDATA, pid);
-	task->mem.vstack = extract_count_t_inst(rp, dp, TASK_MEM_VSTACK, pid);
-	task->mem.vexec = extract_count_t_inst(rp, dp, TASK_MEM_VEXEC, pid);
-	task->mem.vlibs = extract_count_t_inst(rp, dp, TASK_MEM_VLIBS, pid);
-	task->mem.vswap = extract_count_t_inst(rp, dp, TASK_MEM_VSWAP, pid);
+	task->gen.ctid = sp->ctid;
+	task->gen.vpid = sp->vpid;
+	task->gen.ruid = extract_integer_index(rp, dp, TASK_GEN_RUID,
+				index[TASK_GEN_RUID]);
+	task->gen.euid = extract_integer_index(rp, dp, TASK_GEN_EUID,
+				index[TASK_GEN_EUID]);
+	task->gen.suid = extract_integer_index(rp, dp, TASK_GEN_SUID,
+				index[TASK_GEN_SUID]);
+	task->gen.fsuid = extract_integer_index(rp, dp, TASK_GEN_FSUID,
+				index[TASK_GEN_FSUID]);
+	task->gen.rgid = extract_integer_index(rp, dp, TASK_GEN_RGID,
+				index[TASK_GEN_RGID]);
+	task->gen.egid = extract_integer_index(rp, dp, TASK_GEN_EGID,
+				index[TASK_GEN_EGID]);
+	task->gen.sgid = extract_integer_index(rp, dp, TASK_GEN_SGID,
+				index[TASK_GEN_SGID]);
+	task->gen.fsgid = extract_integer_index(rp, dp, TASK_GEN_FSGID,
+				index[TASK_GEN_FSGID]);
+	task->mem.vdata = extract_count_t_index(rp, dp, TASK_MEM_VDATA,
+				index[TASK_MEM_VDATA]);
+	task->mem.vstack = extract_count_t_index(rp, dp, TASK_MEM_VSTACK,
+				index[TASK_MEM_VSTACK]);
+	task->mem.vexec = extract_count_t_index(rp, dp, TASK_MEM_VEXEC,
+				index[TASK_MEM_VEXEC]);
+	task->mem.vlibs = extract_count_t_index(rp, dp, TASK_MEM_VLIBS,
+				index[TASK_MEM_VLIBS]);
+	task->mem.vswap = extract_count_t_index(rp, dp, TASK_MEM_VSWAP,
+				index[TASK_MEM_VSWAP]);
 
 	/* /proc/pid/io */
-	task->dsk.rsz = extract_count_t_inst(rp, dp, TASK_DSK_RSZ, pid);
-	task->dsk.wsz = extract_count_t_inst(rp, dp, TASK_DSK_WSZ, pid);
-	task->dsk.cwsz = extract_count_t_inst(rp, dp, TASK_DSK_CWSZ, pid);
+	task->dsk.rsz = extract_count_t_index(rp, dp, TASK_DSK_RSZ,
+				index[TASK_DSK_RSZ]);
+	task->dsk.wsz = extract_count_t_index(rp, dp, TASK_DSK_WSZ,
+				index[TASK_DSK_WSZ]);
+	task->dsk.cwsz = extract_count_t_index(rp, dp, TASK_DSK_CWSZ,
+				index[TASK_DSK_CWSZ]);
 
 	/*
  	** normalization
@@ -125,11 +274,23 @@ photoproc(struct tstat **tasks, unsigned int *taskslen)
 {
 	static int	setup;
 	static pmID	pmids[TASK_NMETRICS];
+	static pmID	dynamicpmids[TASK_NMETRICS];
+	static pmID	staticpmids[TASK_NMETRICS];
 	static pmDesc	descs[TASK_NMETRICS];
-	pmResult	*result;
+
+	/* arrays reused from one sample to the next */
+	static struct taskstatic *cache, *spare;
+	static struct taskslot	*sorted;
+	static int	*index, *newpids;
+	static char	**previnsts;
+	static unsigned long	ncache, nalloc;
+
+	struct taskstatic *swap, *sp;
+	pmResult	*result, *sresult;
+	pmInDom		indom;
 	char		**insts;
 	int		*pids;
-	unsigned long	count, i;
+	unsigned long	count, i, j, k, nnew;
 
 	if (!setup)
 	{
@@ -137,10 +298,22 @@ photoproc(struct tstat **tasks, unsigned int *taskslen)
 			for (i = 0; i < TASK_NMETRICS; i++)
 				procmetrics[i] += 3;	/* skip "hot" */
 		setup_metrics(procmetrics, pmids, descs, TASK_NMETRICS);
+
+		/* metrics not in a fetch are PM_ID_NULL, to keep offsets */
+		memcpy(dynamicpmids, pmids, sizeof(pmids));
+		for (i = 0; i < TASK_NMETRICS; i++)
+			staticpmids[i] = PM_ID_NULL;
+		for (i = 0; i < NSTATIC; i++)
+		{
+			staticpmids[staticmetrics[i]] = pmids[staticmetrics[i]];
+			dynamicpmids[staticmetrics[i]] = PM_ID_NULL;
+		}
+		for (i = 0; i < NUNUSED; i++)
+			dynamicpmids[unusedmetrics[i]] = PM_ID_NULL;
 		setup = 1;
 	}
 
-	fetch_metrics("task", TASK_NMETRICS, pmids, &result);
+	fetch_metrics("task", TASK_NMETRICS, dynamicpmids, &result);
 
 	/* extract external process names (insts) */
 	count = get_instances("task", TASK_GEN_NAME, descs, &pids, &insts);
@@ -152,21 +325,121 @@ photoproc(struct tstat **tasks, unsigned int *taskslen)
 		ptrverify(*tasks, "photoproc [%ld]\n", (long)size);
 		*taskslen = count;
 	}
+	if (count > nalloc)
+	{
+		size_t	size = count * sizeof(struct taskstatic);
+
+		cache = (struct taskstatic *)realloc(cache, size);
+		ptrverify(cache, "photoproc cache [%ld]\n", (long)size);
+		spare = (struct taskstatic *)realloc(spare, size);
+		ptrverify(spare, "photoproc cache [%ld]\n", (long)size);
+
+		size = count * sizeof(struct taskslot);
+		sorted = (struct taskslot *)realloc(sorted, size);
+		ptrverify(sorted, "photoproc slots [%ld]\n", (long)size);
+
+		size = count * sizeof(int);
+		newpids = (int *)realloc(newpids, size);
+		ptrverify(newpids, "photoproc pids [%ld]\n", (long)size);
+
+		size *= TASK_NMETRICS;
+		index = (int *)realloc(index, size);
+		ptrverify(index, "photoproc index [%ld]\n", (long)size);
+		nalloc = count;
+	}
+
+	for (i=0; i < count; i++)
+	{
+		sorted[i].pid = pids[i];
+		sorted[i].pos = i;
+	}
+	qsort(sorted, count, sizeof(struct taskslot), compare_slot);
+
+	/*
+	** merge with the (also sorted) processes of the previous sample,
+	** keeping static values for any with the same pid and instance
+	** name, and gathering the rest for the static values fetch
+	*/
+	for (i = j = nnew = 0; i < count; i++)
+	{
+		sp = &spare[i];
+		while (j < ncache && cache[j].pid < sorted[i].pid)
+			j++;
+		if (j < ncache && cache[j].pid == sorted[i].pid &&
+		    cache[j].fetched &&
+		    strcmp(cache[j].inst, insts[sorted[i].pos]) == 0)
+		{
+			*sp = cache[j++];
+		}
+		else
+		{
+			memset(sp, 0, sizeof(struct taskstatic));
+			sp->pid = sorted[i].pid;
+			newpids[nnew++] = sorted[i].pid;
+		}
+		sp->inst = insts[sorted[i].pos];
+	}
+	swap = cache;
+	cache = spare;
+	spare = swap;
+	ncache = count;
+
+	if (nnew > 0)
+	{
+		indom = descs[TASK_GEN_NAME].indom;
+		if (nnew < count)
+		{
+			pmDelProfile(indom, 0, NULL);
+			pmAddProfile(indom, nnew, newpids);
+		}
+		fetch_metrics("task", TASK_NMETRICS, staticpmids, &sresult);
+		if (nnew < count)
+			pmAddProfile(indom, 0, NULL);
+
+		for (i=0; i < NSTATIC; i++)
+		{
+			k = staticmetrics[i];
+			index_values(sresult->vset[k], k, pids, sorted, count, index);
+		}
+		for (i=0; i < count; i++)
+		{
+			if (cache[i].fetched)
+				continue;
+			k = sorted[i].pos;
+			update_static(&cache[i], sresult, descs,
+					&index[k * TASK_NMETRICS]);
+		}
+		pmFreeResult(sresult);
+	}
+	if (pmDebugOptions.appl0)
+		fprintf(stderr, "%s: %lu of %lu processes are new\n",
+			pmGetProgname(), nnew, count);
+
+	for (i=0; i < TASK_NMETRICS; i++)
+	{
+		if (dynamicpmids[i] != PM_ID_NULL)
+			index_values(result->vset[i], i, pids, sorted, count, index);
+	}
 
 	supportflags &= ~DOCKSTAT;
 
 	for (i=0; i < count; i++)
 	{
+		k = sorted[i].pos;
 		if (pmDebugOptions.appl0)
 			fprintf(stderr, "%s: updating process %d: %s\n",
-				pmGetProgname(), pids[i], insts[i]);
-		update_task(&(*tasks)[i], pids[i], insts[i], result, descs);
+				pmGetProgname(), pids[k], insts[k]);
+		update_task(&(*tasks)[k], pids[k], insts[k], &cache[i],
+				result, descs, &index[k * TASK_NMETRICS]);
 	}
 	if (pmDebugOptions.appl0)
 		fprintf(stderr, "%s: done %lu processes\n", pmGetProgname(), count);
 
 	pmFreeResult(result);
-	free(insts);
+
+	/* instance names are referenced from the cache until next time */
+	free(previnsts);
+	previnsts = insts;
 	free(pids);
 
 	return count;
@@ -165,6 +165,7 @@ CleanupAgent(AgentInfo* aPtr, int why, int status)
     aPtr->reason = reason;
     aPtr->status.connected = 0;
     aPtr->status.busy = 0;
+    aPtr->pending = 0;
     aPtr->status.notReady = 0;
     aPtr->status.fenced = 0;
     aPtr->status.flags = 0;
@@ -239,3 +240,19 @@ HarvestAgents(unsigned int total)
     sts |= HarvestAgentByParent(tp, 0);
     return sts;
 }
+
+/*
+ * Can a request be sent to an agent before the replies to its earlier
+ * requests have been read?  A DSO result is only valid until the next
+ * request, so only daemon agents replying strictly in the order they
+ * read requests (PDU_FLAG_PIPELINE) may have more than one outstanding.
+ */
+int
+AgentPipeline(AgentInfo *ap)
+{
+    if (ap->pending == 0)
+	return 1;
+    if (ap->ipcType == AGENT_DSO || !ap->status.connected)
+	return 0;
+    return (ap->status.flags & PDU_FLAG_PIPELINE) != 0;
+}
@@ -1,5 +1,5 @@
 /*
- * Copyright (c) 2012-2018 Red Hat.
+ * Copyright (c) 2012-2019 Red Hat.
  * Copyright (c) 1995-2001,2004 Silicon Graphics, Inc.  All Rights Reserved.
  * 
  * This program is free software; you can redistribute it and/or modify it
@@ -116,7 +116,9 @@ AcceptNewClient(int reqfd)
     client[i].status.connected = 1;
     client[i].status.attributes = 0;
     client[i].status.changes = 0;
+    client[i].status.sent = 0;
     memset(&client[i].attrs, 0, sizeof(__pmHashCtl));
+    memset(&client[i].indoms, 0, sizeof(__pmHashCtl));
 
     /*
      * Note seq needs to be unique, but we're using a free running counter
@@ -218,11 +220,13 @@ DeleteClient(ClientInfo *cp)
     __pmHashClear(hcp);
     __pmFreeAttrsSpec(&cp->attrs);
     __pmHashClear(&cp->attrs);
+    FreeClientInDoms(cp);
     __pmSockAddrFree(cp->addr);
     cp->addr = NULL;
     cp->status.connected = 0;
     cp->status.attributes = 0;
     cp->status.changes = 0;
+    cp->status.sent = 0;
     cp->fd = -1;
 
     NotifyEndContext(cp-client);
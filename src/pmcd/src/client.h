@@ -1,5 +1,5 @@
 /*
- * Copyright (c) 2012-2018 Red Hat.
+ * Copyright (c) 2012-2019 Red Hat.
  * Copyright (c) 1995 Silicon Graphics, Inc.  All Rights Reserved.
  * 
  * This program is free software; you can redistribute it and/or modify it
@@ -22,6 +22,7 @@ typedef struct {
 	unsigned int	connected : 1;	/* Client connected */
 	unsigned int	changes : 6;	/* PMCD_* bits for changes since last fetch */
 	unsigned int	attributes: 1;	/* Connection attributes have changed */
+	unsigned int	sent : 1;	/* Request already sent to agent */
     } status;
     /* There is a profile associated with each client context.
      * The context slot number (not the context number) sent with each
@@ -34,6 +35,7 @@ typedef struct {
     time_t		start;		/* Time client connected (pmdapmcd) */
     __pmSockAddr	*addr;		/* Network address of client */
     __pmHashCtl		attrs;		/* Connection attributes (tuples) */
+    __pmHashCtl		indoms;		/* Instance domains sent, for changes */
 } ClientInfo;
 
 PMCD_DATA extern ClientInfo *client;		/* Array of clients */
@@ -17,16 +17,12 @@
 #include "libpcp.h"
 #include "pmcd.h"
 
-/* Freq. histogram: pmids for each agent in current fetch request */
-
-static int	*aFreq;
-
 /* Routine to break a list of pmIDs up into sublists of metrics within the
  * same metric domain.  The resulting lists are returned via a pointer to an
  * array of per-domain lists as defined by the struct below.  Any metrics for
  * which no agent exists are collected into a list at the end of the list of
  * valid lists.  This list has domain = -1 and is used to indicate the end of
- * the list of pmID lists.
+ * the list of pmID lists.  The caller frees the returned list.
  */
 
 typedef struct {
@@ -39,12 +35,12 @@ static DomPmidList *
 SplitPmidList(int nPmids, pmID *pmidList)
 {
     int			i, j;
+    static int		*aFreq = NULL;	/* aFreq[k] = No. of pmIDs for agent[k] */
     static int		*resIndex = NULL;	/* resIndex[k] = index of agent[k]'s list in result */
     static int		nDoms = 0;	/* No. of entries in two tables above */
     int			nGood;
-    static int		currentSize = 0;
     int			resultSize;
-    static DomPmidList	*result;
+    DomPmidList		*result;
     pmID		*resultPmids;
 
     /* Allocate the frequency histogram and array for mapping from agent to
@@ -114,14 +110,9 @@ SplitPmidList(int nPmids, pmID *pmidList)
 doit:
     resultSize = (nGood + 1) * (int)sizeof(DomPmidList);
     resultSize += nPmids * sizeof(pmID);
-    if (resultSize > currentSize) {
-	if (currentSize > 0)
-	    free(result);
-	result = (DomPmidList *)malloc(resultSize);
-	if (result == NULL) {
-	    pmNoMem("SplitPmidList.result", resultSize, PM_FATAL_ERR);
-	}
-	currentSize = resultSize;
+    result = (DomPmidList *)malloc(resultSize);
+    if (result == NULL) {
+	pmNoMem("SplitPmidList.result", resultSize, PM_FATAL_ERR);
     }
 
     resultPmids = (pmID *)&result[nGood + 1];
@@ -159,6 +150,19 @@ doit:
     return result;
 }
 
+/* Find the entry in a split pmID list for an agent */
+
+static DomPmidList *
+FindPmidList(DomPmidList *dList, AgentInfo *aPtr)
+{
+    int		j;
+
+    for (j = 0; dList[j].domain != -1; j++)
+	if (dList[j].domain == aPtr->pmDomainId)
+	    break;
+    return &dList[j];
+}
+
 /* Build a pmResult indicating that no values are available for the pmID list
  * supplied.
  */
@@ -354,65 +358,153 @@ ExtractState(pmResult *result)
     return (int)byte;
 }
 
+/*
+ * A fetch request, from being sent to the agents until the pmResult is
+ * sent to the client.  Several may be in progress at once when requests
+ * are pipelined to the agents (see HandleClientInput).
+ */
+struct fetchctl {
+    ClientInfo		*cip;		/* client sending the request */
+    int			ctxnum;		/* client context slot */
+    int			nPmids;
+    pmID		*pmidList;	/* pinned in the request PDU */
+    DomPmidList		*dList;		/* NOTE: NOT indexed by agent index */
+    pmResult		**results;	/* per-agent, then bad-pmID results */
+    unsigned int	changes;	/* state changes from DSO results */
+    int			sent;		/* request sent on to the agents */
+};
+
+/*
+ * Decode a fetch request and send it on to each of the agents concerned.
+ * The request is decoded only the first time through (the PDU is decoded
+ * in place), into *fcpp.  When pipelining, the request is sent only if
+ * every one of those agents can take it before replying to their earlier
+ * requests, else zero is returned and FinishFetch sends it later.
+ * Returns 1 once sent.
+ */
 int
-DoFetch(ClientInfo *cip, __pmPDU* pb)
+StartFetch(ClientInfo *cip, __pmPDU *pb, int pipeline, FetchCtl **fcpp)
 {
     int			i, j;
     int 		sts;
     int			ctxnum;
-    unsigned int	changes = 0;
     pmTimeval		when;
     int			nPmids;
     pmID		*pmidList;
+    DomPmidList		*dList;
+    FetchCtl		*fcp;
+    __pmHashCtl		*hcp;
+    __pmHashNode	*hp;
+    pmProfile		*profile;
+
+    if ((fcp = *fcpp) == NULL) {
+	sts = __pmDecodeFetch(pb, &ctxnum, &when, &nPmids, &pmidList);
+	if (sts < 0)
+	    return sts;
+
+	/* Check that a profile has been received from the specified context */
+	profile = NULL;
+	if (ctxnum >= 0) {
+	    hcp = &cip->profile;
+	    hp = __pmHashSearch(ctxnum, hcp);
+	    if (hp != NULL)
+		profile = (pmProfile *)hp->data;
+	}
+	if (ctxnum < 0 || profile == NULL) {
+	    __pmUnpinPDUBuf(pb);
+	    if (ctxnum < 0)
+		pmNotifyErr(LOG_ERR, "DoFetch: bad ctxnum=%d\n", ctxnum);
+	    else
+		pmNotifyErr(LOG_ERR, "DoFetch: no profile for ctxnum=%d\n", ctxnum);
+	    return PM_ERR_NOPROFILE;
+	}
+
+	if ((fcp = (FetchCtl *)calloc(1, sizeof(FetchCtl))) == NULL ||
+	    (fcp->results = (pmResult **)calloc(nAgents + 1, sizeof(pmResult *))) == NULL) {
+	    pmNoMem("DoFetch.results", (nAgents + 1) * sizeof(pmResult *), PM_FATAL_ERR);
+	}
+	fcp->cip = cip;
+	fcp->ctxnum = ctxnum;
+	fcp->nPmids = nPmids;
+	fcp->pmidList = pmidList;
+	fcp->dList = SplitPmidList(nPmids, pmidList);
+	*fcpp = fcp;
+    }
+    dList = fcp->dList;
+
+    if (pipeline) {
+	for (i = 0; dList[i].domain != -1; i++) {
+	    if (!AgentPipeline(&agent[mapdom[dList[i].domain]]))
+		return 0;
+	}
+    }
+
+    /* For each domain in the split pmidList, dispatch the per-domain subset
+     * of pmIDs to the appropriate agent.  For DSO agents, the pmResult will
+     * come back immediately.  If a request cannot be sent to an agent, a
+     * suitable pmResult (containing metric not available values) will be
+     * returned.
+     */
+    for (i = 0; dList[i].domain != -1; i++) {
+	j = mapdom[dList[i].domain];
+	fcp->results[j] = SendFetch(&dList[i], &agent[j], cip, fcp->ctxnum);
+	if (fcp->results[j] == NULL)	/* agent's response to be read */
+	    agent[j].pending++;
+	else {
+	    fcp->changes |= ExtractState(fcp->results[j]);
+	    if (agent[j].ipcType == AGENT_DSO)
+		agent[j].pending++;	/* result in use until FinishFetch */
+	}
+    }
+    /* Construct pmResult for bad-pmID list */
+    if (dList[i].listSize != 0)
+	fcp->results[nAgents] = MakeBadResult(dList[i].listSize, dList[i].list, PM_ERR_NOAGENT);
+
+    fcp->sent = 1;
+    return 1;
+}
+
+/*
+ * Read the results of a fetch from StartFetch - any earlier requests to
+ * the same agents having been completed already, so sending it now if it
+ * was held back - and send the combined pmResult to the client.
+ */
+int
+FinishFetch(FetchCtl *fcp)
+{
+    int			i, j;
+    int 		sts;
+    unsigned int	changes;
+    ClientInfo		*cip = fcp->cip;
+    int			nPmids = fcp->nPmids;
+    pmID		*pmidList = fcp->pmidList;
+    DomPmidList		*dList = fcp->dList;
+    DomPmidList		*dp;
+    pmResult		**results = fcp->results;
+    __pmPDU		*pb;
     static pmResult	*endResult = NULL;
     static int		maxnpmids = 0;	/* sizes endResult */
-    DomPmidList		*dList;		/* NOTE: NOT indexed by agent index */
     static int		nDoms = 0;
-    static pmResult	**results = NULL;
     static int		*resIndex = NULL;
     __pmFdSet		waitFds;
     __pmFdSet		readyFds;
     int			nWait;
     int			maxFd;
     struct timeval	timeout;
-    __pmHashCtl		*hcp;
-    __pmHashNode	*hp;
-    pmProfile		*profile;
+
+    if (!fcp->sent)
+	StartFetch(cip, NULL, 0, &fcp);
+    changes = fcp->changes;
 
     if (nAgents > nDoms) {
-	if (results != NULL)
-	    free(results);
 	if (resIndex != NULL)
 	    free(resIndex);
-	results = (pmResult **)malloc((nAgents + 1) * sizeof (pmResult *));
 	resIndex = (int *)malloc((nAgents + 1) * sizeof(int));
-	if (results == NULL || resIndex == NULL) {
-	    pmNoMem("DoFetch.results", (nAgents + 1) * sizeof (pmResult *) + (nAgents + 1) * sizeof(int), PM_FATAL_ERR);
+	if (resIndex == NULL) {
+	    pmNoMem("DoFetch.resIndex", (nAgents + 1) * sizeof(int), PM_FATAL_ERR);
 	}
 	nDoms = nAgents;
     }
-    memset(results, 0, (nAgents + 1) * sizeof(results[0]));
-
-    sts = __pmDecodeFetch(pb, &ctxnum, &when, &nPmids, &pmidList);
-    if (sts < 0)
-	return sts;
-
-    /* Check that a profile has been received from the specified context */
-    profile = NULL;
-    if (ctxnum >= 0) {
-	hcp = &cip->profile;
-	hp = __pmHashSearch(ctxnum, hcp);
-	if (hp != NULL)
-	    profile = (pmProfile *)hp->data;
-    }
-    if (ctxnum < 0 || profile == NULL) {
-	__pmUnpinPDUBuf(pb);
-	if (ctxnum < 0)
-	    pmNotifyErr(LOG_ERR, "DoFetch: bad ctxnum=%d\n", ctxnum);
-	else
-	    pmNotifyErr(LOG_ERR, "DoFetch: no profile for ctxnum=%d\n", ctxnum);
-	return PM_ERR_NOPROFILE;
-    }
 
     if (nPmids > maxnpmids) {
 	int		need;
@@ -425,34 +517,26 @@ DoFetch(ClientInfo *cip, __pmPDU* pb)
 	maxnpmids = nPmids;
     }
 
-    dList = SplitPmidList(nPmids, pmidList);
-
-    /* For each domain in the split pmidList, dispatch the per-domain subset
-     * of pmIDs to the appropriate agent.  For DSO agents, the pmResult will
-     * come back immediately.  If a request cannot be sent to an agent, a
-     * suitable pmResult (containing metric not available values) will be
-     * returned.
-     */
     __pmFD_ZERO(&waitFds);
     nWait = 0;
     maxFd = -1;
     for (i = 0; dList[i].domain != -1; i++) {
 	j = mapdom[dList[i].domain];
-	results[j] = SendFetch(&dList[i], &agent[j], cip, ctxnum);
-	if (results[j] == NULL) { /* Wait for agent's response */
+	if (results[j] != NULL)
+	    continue;
+	if (!agent[j].status.connected) {
+	    /* agent lost since the request was sent */
+	    results[j] = MakeBadResult(dList[i].listSize, dList[i].list,
+				       PM_ERR_NOAGENT);
+	} else { /* Wait for agent's response */
 	    int fd = agent[j].outFd;
 	    agent[j].status.busy = 1;
 	    __pmFD_SET(fd, &waitFds);
 	    if (fd > maxFd)
 		maxFd = fd;
 	    nWait++;
-	} else {
-	    changes |= ExtractState(results[j]);
 	}
     }
-    /* Construct pmResult for bad-pmID list */
-    if (dList[i].listSize != 0)
-	results[nAgents] = MakeBadResult(dList[i].listSize, dList[i].list, PM_ERR_NOAGENT);
 
     /* Wait for results to roll in from agents */
     while (nWait > 0) {
@@ -471,12 +555,8 @@ DoFetch(ClientInfo *cip, __pmPDU* pb)
 		/* Timeout, terminate agents with undelivered results */
 		for (i = 0; i < nAgents; i++) {
 		    if (agent[i].status.busy) {
-			/* Find entry in dList for this agent */
-			for (j = 0; dList[j].domain != -1; j++)
-			    if (dList[j].domain == agent[i].pmDomainId)
-				break;
-			results[i] = MakeBadResult(dList[j].listSize,
-						   dList[j].list,
+			dp = FindPmidList(dList, &agent[i]);
+			results[i] = MakeBadResult(dp->listSize, dp->list,
 						   PM_ERR_NOAGENT);
 			pmcd_trace(TR_RECV_TIMEOUT, agent[i].outFd, PDU_RESULT, 0);
 			CleanupAgent(&agent[i], AT_COMM, agent[i].inFd);
@@ -502,19 +582,21 @@ DoFetch(ClientInfo *cip, __pmPDU* pb)
 	    if (!ap->status.busy || !__pmFD_ISSET(ap->outFd, &readyFds))
 		continue;
 	    ap->status.busy = 0;
+	    ap->pending--;
 	    __pmFD_CLR(ap->outFd, &waitFds);
 	    nWait--;
+	    dp = FindPmidList(dList, ap);
 	    pinpdu = sts = __pmGetPDU(ap->outFd, ANY_SIZE, pmcd_timeout, &pb);
 	    if (sts > 0)
 		pmcd_trace(TR_RECV_PDU, ap->outFd, sts, (int)((__psint_t)pb & 0xffffffff));
 	    if (sts == PDU_RESULT) {
-		if ((sts = __pmDecodeResult(pb, &results[i])) >= 0) {
-		    if (results[i]->numpmid == aFreq[i]) {
+		if ((sts = __pmDecodeResultArena(pb, &results[i])) >= 0) {
+		    if (results[i]->numpmid == dp->listSize) {
 			changes |= ExtractState(results[i]);
 		    } else {
 			if (pmDebugOptions.appl0)
 			    pmNotifyErr(LOG_ERR, "DoFetch: \"%s\" agent given %d pmIDs, returned %d\n",
-					 ap->pmDomainLabel, aFreq[i], results[i]->numpmid);
+					 ap->pmDomainLabel, dp->listSize, results[i]->numpmid);
 			pmFreeResult(results[i]);
 			sts = PM_ERR_IPC;
 		    }
@@ -538,19 +620,14 @@ DoFetch(ClientInfo *cip, __pmPDU* pb)
 		__pmUnpinPDUBuf(pb);
 
 	    if (sts < 0) {
-		/* Find entry in dList for this agent */
-		for (j = 0; dList[j].domain != -1; j++)
-		    if (dList[j].domain == agent[i].pmDomainId)
-			break;
-		results[i] = MakeBadResult(dList[j].listSize,
-					   dList[j].list, sts);
+		results[i] = MakeBadResult(dp->listSize, dp->list, sts);
 
 		if (sts == PM_ERR_PMDANOTREADY) {
 		    /* the agent is indicating it can't handle PDUs for now */
 		    int k;
 		    extern int CheckError(AgentInfo *ap, int sts);
 
-		    for (k = 0; k < dList[j].listSize; k++)
+		    for (k = 0; k < dp->listSize; k++)
 			results[i]->vset[k]->numval = PM_ERR_AGAIN;
 		    sts = CheckError(&agent[i], sts);
 		}
@@ -585,7 +662,8 @@ DoFetch(ClientInfo *cip, __pmPDU* pb)
 
     sts = 0;
     if (cip->status.changes) {
-	/* notify client of PMCD state change */
+	/* notify client of PMCD state change, along with the result */
+	__pmXmitBatch(cip->fd);
 	sts = __pmSendError(cip->fd, FROM_ANON, (int)cip->status.changes);
 	if (sts > 0)
 	    sts = 0;
@@ -593,6 +671,8 @@ DoFetch(ClientInfo *cip, __pmPDU* pb)
     }
     if (sts == 0)
 	sts = __pmSendResult(cip->fd, FROM_ANON, endResult);
+    if ((i = __pmXmitFlush(cip->fd)) < 0 && sts >= 0)
+	sts = i;
 
     if (sts < 0) {
 	pmcd_trace(TR_XMIT_ERR, cip->fd, PDU_RESULT, sts);
@@ -604,6 +684,8 @@ DoFetch(ClientInfo *cip, __pmPDU* pb)
      */
     for (i = 0; dList[i].domain != -1; i++) {
 	j = mapdom[dList[i].domain];
+	if (agent[j].ipcType == AGENT_DSO && agent[j].pending > 0)
+	    agent[j].pending--;
 	if (agent[j].ipcType == AGENT_DSO && agent[j].status.connected &&
 	    !agent[j].status.madeDsoResult)
 	    /* Living DSO's manage their own pmResult skeleton unless
@@ -612,7 +694,7 @@ DoFetch(ClientInfo *cip, __pmPDU* pb)
 	     */
 	    __pmFreeResultValues(results[j]);
 	else
-	    /* For others it is dynamically allocated in __pmDecodeResult or
+	    /* For others it is dynamically allocated in __pmDecodeResultArena or
 	     * MakeBadResult
 	     */
 	    pmFreeResult(results[j]);
@@ -620,5 +702,19 @@ DoFetch(ClientInfo *cip, __pmPDU* pb)
     if (results[nAgents] != NULL)
 	pmFreeResult(results[nAgents]);
     __pmUnpinPDUBuf(pmidList);
+    free(results);
+    free(dList);
+    free(fcp);
     return 0;
 }
+
+int
+DoFetch(ClientInfo *cip, __pmPDU* pb)
+{
+    FetchCtl		*fcp = NULL;
+    int			sts;
+
+    if ((sts = StartFetch(cip, pb, 0, &fcp)) < 0)
+	return sts;
+    return FinishFetch(fcp);
+}
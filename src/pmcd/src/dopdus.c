@@ -79,12 +79,16 @@ DoText(ClientInfo *cp, __pmPDU* pb)
 					  ap->ipc.dso.dispatch.version.any.ext);
     }
     else {
-	if (ap->status.notReady)
-	    return PM_ERR_AGAIN;
-	pmcd_trace(TR_XMIT_PDU, ap->inFd, PDU_TEXT_REQ, ident);
-	sts = __pmSendTextReq(ap->inFd, cp - client, ident, type);
+	if (!cp->status.sent) {		/* else sent by StartRequest */
+	    if (ap->status.notReady)
+		return PM_ERR_AGAIN;
+	    pmcd_trace(TR_XMIT_PDU, ap->inFd, PDU_TEXT_REQ, ident);
+	    sts = __pmSendTextReq(ap->inFd, cp - client, ident, type);
+	}
 	if (sts >= 0) {
 	    int		pinpdu;
+	    if (cp->status.sent)
+		ap->pending--;
 	    pinpdu = sts = __pmGetPDU(ap->outFd, ANY_SIZE, pmcd_timeout, &pb);
 	    if (sts > 0)
 		pmcd_trace(TR_RECV_PDU, ap->outFd, sts, (int)((__psint_t)pb & 0xffffffff));
@@ -243,6 +247,178 @@ DoDesc(ClientInfo *cp, __pmPDU *pb)
     return sts;
 }
 
+/*
+ * The instance domains last sent to each client that asks for changes
+ * (PDU_FLAG_INDOM_DELTA), so that only the instances added, renamed or
+ * removed since need be sent the next time it asks.
+ */
+typedef struct {
+    int			generation;	/* incremented as instances change */
+    pmInResult		*result;	/* instances as last sent */
+} InDomSent;
+
+static __pmHashWalkState
+FreeInDomSent(const __pmHashNode *tp, void *cdata)
+{
+    InDomSent	*sp = (InDomSent *)tp->data;
+
+    (void)cdata;
+    if (sp->result != NULL)
+	__pmFreeInResult(sp->result);
+    free(sp);
+    return PM_HASH_WALK_DELETE_NEXT;
+}
+
+void
+FreeClientInDoms(ClientInfo *cp)
+{
+    __pmHashWalkCB(FreeInDomSent, NULL, &cp->indoms);
+    __pmHashClear(&cp->indoms);
+}
+
+static __pmHashWalkState
+FreeInDomNode(const __pmHashNode *tp, void *cdata)
+{
+    (void)tp;
+    (void)cdata;
+    return PM_HASH_WALK_DELETE_NEXT;
+}
+
+/*
+ * Changes from the instances last sent to the current instances, where
+ * the client can apply them - the remaining instances must be in the
+ * same order, with any new instances after them.  Returns zero with
+ * the changes (referring to the names in result), one if the whole
+ * instance domain should be sent instead, or an error.
+ */
+static int
+InDomChanges(pmInResult *prev, pmInResult *result, __pmInDomDelta *dp)
+{
+    __pmHashCtl		old;
+    __pmHashNode	*hp;
+    char		*kept = NULL;
+    int			first, last, added;
+    int			i, j, sts = 0;
+
+    /* unchanged leading instances, usually all of them */
+    for (i = 0; i < prev->numinst && i < result->numinst; i++) {
+	if (prev->instlist[i] != result->instlist[i] ||
+	    strcmp(prev->namelist[i], result->namelist[i]) != 0)
+	    break;
+    }
+    if (i == prev->numinst && i == result->numinst)
+	return 0;
+    first = i;
+
+    __pmHashInit(&old);
+    if ((kept = (char *)calloc(prev->numinst + 1, sizeof(char))) == NULL ||
+	(dp->droplist = (int *)malloc((prev->numinst + 1) * sizeof(int))) == NULL ||
+	(dp->instlist = (int *)malloc((result->numinst + 1) * sizeof(int))) == NULL ||
+	(dp->namelist = (char **)malloc((result->numinst + 1) * sizeof(char *))) == NULL) {
+	sts = -oserror();
+	goto done;
+    }
+    for (j = first; j < prev->numinst; j++) {
+	if ((sts = __pmHashAdd((unsigned int)prev->instlist[j],
+				(void *)(__psint_t)j, &old)) < 0)
+	    goto done;
+    }
+    sts = 0;
+
+    for (last = first - 1, added = 0; i < result->numinst; i++) {
+	if ((hp = __pmHashSearch((unsigned int)result->instlist[i], &old)) != NULL) {
+	    j = (int)(__psint_t)hp->data;
+	    if (added || j < last || kept[j]) {
+		sts = 1;	/* reordered */
+		goto done;
+	    }
+	    last = j;
+	    kept[j] = 1;
+	    if (strcmp(prev->namelist[j], result->namelist[i]) == 0)
+		continue;
+	}
+	else
+	    added = 1;
+	dp->instlist[dp->numinst] = result->instlist[i];
+	dp->namelist[dp->numinst++] = result->namelist[i];
+    }
+    for (j = first; j < prev->numinst; j++) {
+	if (!kept[j])
+	    dp->droplist[dp->numdrop++] = prev->instlist[j];
+    }
+    /* no point sending changes as large as the instance domain itself */
+    if (dp->numdrop + dp->numinst >= result->numinst)
+	sts = 1;
+
+done:
+    if (kept)
+	free(kept);
+    __pmHashWalkCB(FreeInDomNode, NULL, &old);
+    __pmHashClear(&old);
+    if (sts != 0)
+	__pmFreeInDomDelta(dp);
+    return sts;
+}
+
+/*
+ * Reply to a request for the changes to an instance domain since the
+ * generation the client holds, taking ownership of result.
+ */
+static int
+SendInstanceDelta(ClientInfo *cp, pmInDom indom, int generation, pmInResult *result)
+{
+    __pmInDomDelta	delta;
+    __pmHashNode	*hp;
+    InDomSent		*sp = NULL;
+    int			complete, sts = 1;
+
+    complete = (result->instlist != NULL && result->namelist != NULL);
+    if ((hp = __pmHashSearch((unsigned int)indom, &cp->indoms)) != NULL)
+	sp = (InDomSent *)hp->data;
+    else if (complete &&
+	     (sp = (InDomSent *)calloc(1, sizeof(InDomSent))) != NULL &&
+	     __pmHashAdd((unsigned int)indom, (void *)sp, &cp->indoms) < 0) {
+	free(sp);
+	sp = NULL;
+    }
+
+    memset(&delta, 0, sizeof(delta));
+    if (sp != NULL && sp->result != NULL && complete &&
+	generation == sp->generation) {
+	if ((sts = InDomChanges(sp->result, result, &delta)) == 0 &&
+	    (delta.numdrop > 0 || delta.numinst > 0))
+	    sp->generation++;
+    }
+    if (sts != 0) {
+	/* the whole instance domain, as a new generation */
+	memset(&delta, 0, sizeof(delta));
+	delta.full = 1;
+	delta.numinst = result->numinst;
+	delta.instlist = result->instlist;
+	delta.namelist = result->namelist;
+	if (sp != NULL)
+	    sp->generation++;
+    }
+    if (sp != NULL && sp->generation <= 0)
+	sp->generation = 1;
+    delta.indom = indom;
+    delta.generation = sp != NULL ? sp->generation : 0;
+
+    sts = __pmSendInstanceDelta(cp->fd, FROM_ANON, &delta);
+    if (!delta.full)
+	__pmFreeInDomDelta(&delta);
+
+    /* remember what the client now has, if it can be built upon */
+    if (sp != NULL) {
+	if (sp->result != NULL)
+	    __pmFreeInResult(sp->result);
+	sp->result = complete ? result : NULL;
+    }
+    if (sp == NULL || !complete)
+	__pmFreeInResult(result);
+    return sts;
+}
+
 int
 DoInstance(ClientInfo *cp, __pmPDU *pb)
 {
@@ -254,10 +430,18 @@ DoInstance(ClientInfo *cp, __pmPDU *pb)
     pmInResult	*inresult = NULL;
     AgentInfo		*ap;
     int			fdfail = -1;
+    int			delta = 0;
+    int			generation = 0;
 
     sts = __pmDecodeInstanceReq(pb, &when, &indom, &inst, &name);
     if (sts < 0)
 	return sts;
+    if (when.tv_usec == PDU_INDOM_DELTA && inst == PM_IN_NULL && name == NULL) {
+	/* changes since the generation the client holds are wanted */
+	delta = 1;
+	generation = when.tv_sec;
+	when.tv_sec = when.tv_usec = 0;
+    }
     if (when.tv_sec != 0 || when.tv_usec != 0) {
 	if (name != NULL) free(name);
 	return PM_ERR_IPC;
@@ -283,14 +467,18 @@ DoInstance(ClientInfo *cp, __pmPDU *pb)
 					ap->ipc.dso.dispatch.version.any.ext);
     }
     else {
-	if (ap->status.notReady) {
-	    if (name != NULL) free(name);
-	    return PM_ERR_AGAIN;
+	if (!cp->status.sent) {		/* else sent by StartRequest */
+	    if (ap->status.notReady) {
+		if (name != NULL) free(name);
+		return PM_ERR_AGAIN;
+	    }
+	    pmcd_trace(TR_XMIT_PDU, ap->inFd, PDU_INSTANCE_REQ, (int)indom);
+	    sts = __pmSendInstanceReq(ap->inFd, cp - client, &when, indom, inst, name);
 	}
-	pmcd_trace(TR_XMIT_PDU, ap->inFd, PDU_INSTANCE_REQ, (int)indom);
-	sts = __pmSendInstanceReq(ap->inFd, cp - client, &when, indom, inst, name);
 	if (sts >= 0) {
 	    int		pinpdu;
+	    if (cp->status.sent)
+		ap->pending--;
 	    pinpdu = sts = __pmGetPDU(ap->outFd, ANY_SIZE, pmcd_timeout, &pb);
 	    if (sts > 0)
 		pmcd_trace(TR_RECV_PDU, ap->outFd, sts, (int)((__psint_t)pb & 0xffffffff));
@@ -322,12 +510,16 @@ DoInstance(ClientInfo *cp, __pmPDU *pb)
 
     if (sts >= 0) {
 	pmcd_trace(TR_XMIT_PDU, cp->fd, PDU_INSTANCE, (int)(inresult->indom));
-	sts = __pmSendInstance(cp->fd, FROM_ANON, inresult);
+	if (delta)
+	    sts = SendInstanceDelta(cp, indom, generation, inresult);
+	else {
+	    sts = __pmSendInstance(cp->fd, FROM_ANON, inresult);
+	    __pmFreeInResult(inresult);
+	}
 	if (sts < 0) {
 	    pmcd_trace(TR_XMIT_ERR, cp->fd, PDU_INSTANCE, sts);
 	    CleanupClient(cp, sts);
 	}
-	__pmFreeInResult(inresult);
     }
     else
 	if (ap->ipcType != AGENT_DSO &&
@@ -506,13 +698,16 @@ DoLabel(ClientInfo *cp, __pmPDU *pb)
 	    nsets = sts;
     }
     else {
-	if (ap->status.notReady)
-	    return PM_ERR_AGAIN;
-
-	pmcd_trace(TR_XMIT_PDU, ap->inFd, PDU_LABEL_REQ, ident);
-	sts = __pmSendLabelReq(ap->inFd, cp - client, ident, type);
+	if (!cp->status.sent) {		/* else sent by StartRequest */
+	    if (ap->status.notReady)
+		return PM_ERR_AGAIN;
+	    pmcd_trace(TR_XMIT_PDU, ap->inFd, PDU_LABEL_REQ, ident);
+	    sts = __pmSendLabelReq(ap->inFd, cp - client, ident, type);
+	}
 	if (sts >= 0) {
 	    int		pinpdu;
+	    if (cp->status.sent)
+		ap->pending--;
 	    pinpdu = sts = __pmGetPDU(ap->outFd, ANY_SIZE, pmcd_timeout, &pb);
 	    if (sts > 0)
 		pmcd_trace(TR_RECV_PDU, ap->outFd, sts, (int)((__psint_t)pb & 0xffffffff));
@@ -564,6 +759,88 @@ response:
     return sts;
 }
 
+/*
+ * Send a text, instance or label request on to a daemon agent before
+ * the replies to earlier requests have been read (see HandleClientInput),
+ * for DoText, DoInstance or DoLabel to read the reply in turn later.
+ * Returns zero if the agent cannot take another request yet, else 1 -
+ * including when there is nothing to send, pmcd itself or a DSO agent
+ * answering the request later instead.
+ */
+int
+StartRequest(ClientInfo *cp, __pmPDU *pb)
+{
+    __pmPDUHdr	*php = (__pmPDUHdr *)pb;
+    AgentInfo	*ap = NULL;
+    pmTimeval	when;
+    pmInDom	indom;
+    char	*name = NULL;
+    int		ident, type, inst;
+    int		sts;
+
+    switch (php->type) {
+	case PDU_TEXT_REQ:
+	    if (__pmDecodeTextReq(pb, &ident, &type) < 0)
+		return 1;
+	    ap = pmcd_agent(((__pmID_int *)&ident)->domain);
+	    break;
+
+	case PDU_INSTANCE_REQ:
+	    if (__pmDecodeInstanceReq(pb, &when, &indom, &inst, &name) < 0)
+		return 1;
+	    if (when.tv_usec == PDU_INDOM_DELTA && inst == PM_IN_NULL && name == NULL)
+		when.tv_sec = when.tv_usec = 0;
+	    if (when.tv_sec == 0 && when.tv_usec == 0)
+		ap = pmcd_agent(((__pmInDom_int *)&indom)->domain);
+	    ident = (int)indom;
+	    break;
+
+	case PDU_LABEL_REQ:
+	    if (__pmDecodeLabelReq(pb, &ident, &type) < 0)
+		return 1;
+	    if (type == PM_LABEL_DOMAIN)
+		ap = pmcd_agent(ident);
+	    else if (type == PM_LABEL_INDOM)
+		ap = pmcd_agent(((__pmInDom_int *)&ident)->domain);
+	    else if (type == PM_LABEL_CLUSTER || type == PM_LABEL_ITEM ||
+		     type == PM_LABEL_INSTANCES)
+		ap = pmcd_agent(((__pmID_int *)&ident)->domain);
+	    break;
+
+	default:
+	    return 0;
+    }
+
+    if (ap == NULL || ap->ipcType == AGENT_DSO || !ap->status.connected ||
+	ap->status.fenced || ap->status.notReady) {
+	if (name != NULL) free(name);
+	return 1;
+    }
+    if (!AgentPipeline(ap)) {
+	if (name != NULL) free(name);
+	return 0;
+    }
+
+    pmcd_trace(TR_XMIT_PDU, ap->inFd, php->type, ident);
+    if (php->type == PDU_TEXT_REQ)
+	sts = __pmSendTextReq(ap->inFd, cp - client, ident, type);
+    else if (php->type == PDU_INSTANCE_REQ)
+	sts = __pmSendInstanceReq(ap->inFd, cp - client, &when, indom, inst, name);
+    else
+	sts = __pmSendLabelReq(ap->inFd, cp - client, ident, type);
+    if (name != NULL) free(name);
+
+    if (sts < 0) {
+	/* no reply to come, DoText et al. report the agent has gone */
+	pmcd_trace(TR_XMIT_ERR, ap->inFd, php->type, sts);
+	CleanupAgent(ap, AT_COMM, ap->inFd);
+    } else {
+	ap->pending++;
+	cp->status.sent = 1;
+    }
+    return 1;
+}
+
 /*
  * This handler is for remote versions of pmNameAll or pmNameID.
  * Note: only one pmid for the list should be sent.
@@ -1279,6 +1556,12 @@ ConnectionAttributes(ClientInfo *cp, int flags)
 	return sts;
     }
 
+    /* large PDUs may be compressed from now on, in either direction */
+    if ((flags & PDU_FLAG_LZMA) &&
+	__pmServerHasFeature(PM_SERVER_FEATURE_LZMA) &&
+	(sts = __pmSetCompressIPC(cp->fd, 1)) < 0)
+	return sts;
+
     return 0;
 }
 
@@ -1323,6 +1606,8 @@ DoCreds(ClientInfo *cp, __pmPDU *pb)
 			{ PDU_FLAG_CONTAINER,	"CONTAINER" },
 			{ PDU_FLAG_BAD_LABEL,	"BAD_LABEL" },
 			{ PDU_FLAG_LABELS,	"LABELS" },
+			{ PDU_FLAG_LZMA,	"LZMA" },
+			{ PDU_FLAG_INDOM_DELTA,	"INDOM_DELTA" },
 		    };
 		    int	i;
 		    int	first = 1;
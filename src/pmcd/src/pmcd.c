@@ -1,5 +1,5 @@
 /*
- * Copyright (c) 2012-2017 Red Hat.
+ * Copyright (c) 2012-2017,2019 Red Hat.
  * Copyright (c) 1995-2001,2004 Silicon Graphics, Inc.  All Rights Reserved.
  * 
  * This program is free software; you can redistribute it and/or modify it
@@ -295,18 +295,193 @@ ParseOptions(int argc, char *argv[], int *nports)
     }
 }
 
+/*
+ * A request read from a client in one pass through HandleClientInput
+ */
+typedef struct {
+    int		client;		/* index into client[] */
+    __pmPDU	*pb;
+    int		pinpdu;
+    int		sts;		/* error from starting the request */
+    FetchCtl	*fetch;		/* fetch started, if any */
+} Request;
+
+/*
+ * Send a request on to the agent(s) before the replies to the requests
+ * read ahead of it are read, if all of the agents concerned can take it
+ * now (see AgentPipeline).  Returns zero if not, and the request is then
+ * handled entirely by HandleRequest, once all earlier ones are done.
+ */
+static int
+StartClientRequest(Request *rp)
+{
+    ClientInfo	*cp = &client[rp->client];
+    __pmPDUHdr	*php = (__pmPDUHdr *)rp->pb;
+    int		sts;
+
+    switch (php->type) {
+	case PDU_FETCH:
+	case PDU_INSTANCE_REQ:
+	case PDU_LABEL_REQ:
+	case PDU_TEXT_REQ:
+	    if (cp->denyOps & PMCD_OP_FETCH)
+		return 1;
+	    break;
+	default:
+	    return 0;
+    }
+
+    this_client_id = rp->client;
+    if (php->type != PDU_FETCH)
+	return StartRequest(cp, rp->pb);
+    if ((sts = StartFetch(cp, rp->pb, 1, &rp->fetch)) < 0)
+	rp->sts = sts;
+    return sts != 0;
+}
+
+/*
+ * Complete a request read from a client, sending the reply (or an error
+ * PDU) to the client.
+ */
+static void
+HandleRequest(Request *rp)
+{
+    int		i = rp->client;
+    ClientInfo	*cp = &client[i];
+    __pmPDU	*pb = rp->pb;
+    __pmPDUHdr	*php = (__pmPDUHdr *)pb;
+    int		sts;
+
+    this_client_id = i;
+
+    if (rp->fetch != NULL)
+	sts = FinishFetch(rp->fetch);
+    else if (rp->sts < 0)
+	sts = rp->sts;
+    else switch (php->type) {
+	case PDU_PROFILE:
+	    sts = (cp->denyOps & PMCD_OP_FETCH) ?
+		  PM_ERR_PERMISSION : DoProfile(cp, pb);
+	    break;
+
+	case PDU_FETCH:
+	    sts = (cp->denyOps & PMCD_OP_FETCH) ?
+		  PM_ERR_PERMISSION : DoFetch(cp, pb);
+	    break;
+
+	case PDU_INSTANCE_REQ:
+	    sts = (cp->denyOps & PMCD_OP_FETCH) ?
+		  PM_ERR_PERMISSION : DoInstance(cp, pb);
+	    break;
+
+	case PDU_LABEL_REQ:
+	    sts = (cp->denyOps & PMCD_OP_FETCH) ?
+		  PM_ERR_PERMISSION : DoLabel(cp, pb);
+	    break;
+
+	case PDU_DESC_REQ:
+	    sts = (cp->denyOps & PMCD_OP_FETCH) ?
+		  PM_ERR_PERMISSION : DoDesc(cp, pb);
+	    break;
+
+	case PDU_TEXT_REQ:
+	    sts = (cp->denyOps & PMCD_OP_FETCH) ?
+		  PM_ERR_PERMISSION : DoText(cp, pb);
+	    break;
+
+	case PDU_RESULT:
+	    sts = (cp->denyOps & PMCD_OP_STORE) ?
+		  PM_ERR_PERMISSION : DoStore(cp, pb);
+	    break;
+
+	case PDU_PMNS_IDS:
+	    sts = (cp->denyOps & PMCD_OP_FETCH) ?
+		  PM_ERR_PERMISSION : DoPMNSIDs(cp, pb);
+	    break;
+
+	case PDU_PMNS_NAMES:
+	    sts = (cp->denyOps & PMCD_OP_FETCH) ?
+		  PM_ERR_PERMISSION : DoPMNSNames(cp, pb);
+	    break;
+
+	case PDU_PMNS_CHILD:
+	    sts = (cp->denyOps & PMCD_OP_FETCH) ?
+		  PM_ERR_PERMISSION : DoPMNSChild(cp, pb);
+	    break;
+
+	case PDU_PMNS_TRAVERSE:
+	    sts = (cp->denyOps & PMCD_OP_FETCH) ?
+		  PM_ERR_PERMISSION : DoPMNSTraverse(cp, pb);
+	    break;
+
+	case PDU_CREDS:
+	    sts = DoCreds(cp, pb);
+	    break;
+
+	default:
+	    sts = PM_ERR_IPC;
+    }
+    cp->status.sent = 0;
+    if (sts < 0) {
+	if (pmDebugOptions.appl0)
+	    fprintf(stderr, "PDU:  %s client[%d]: %s\n",
+		__pmPDUTypeStr(php->type), i, pmErrStr(sts));
+	/* Make sure client still alive before sending. */
+	if (cp->status.connected) {
+	    pmcd_trace(TR_XMIT_PDU, cp->fd, PDU_ERROR, sts);
+	    sts = __pmSendError(cp->fd, FROM_ANON, sts);
+	    if (sts < 0)
+		pmNotifyErr(LOG_ERR, "HandleClientInput: "
+		    "error sending Error PDU to client[%d] %s\n", i, pmErrStr(sts));
+	}
+    }
+    if (rp->pinpdu > 0)
+	__pmUnpinPDUBuf(pb);
+
+    /*
+     * May need to send connection attributes to interested PMDAs, if
+     * something changed for this client during this PDU exchange.
+     */
+    if (client[i].status.attributes) {
+	if (pmDebugOptions.appl1)
+	    pmNotifyErr(LOG_INFO, "Client idx=%d,seq=%d attrs reset\n",
+			    i, client[i].seq);
+	AgentsAttributes(i);
+    }
+}
+
 /*
  * Determine which clients (if any) have sent data to the server and handle it
  * as required.
+ *
+ * One request is read from each client ready, and as many of those as
+ * possible (in order) are sent on to the agents before any replies are
+ * read, so that agents work on them concurrently - including several
+ * at once for agents that can pipeline requests.  The requests are then
+ * completed in the order read, which is also the order any agent sent
+ * more than one of them replies in.
  */
 void
 HandleClientInput(__pmFdSet *fdsPtr)
 {
-    int		sts;
-    int		i;
-    __pmPDU	*pb;
-    __pmPDUHdr	*php;
-    ClientInfo	*cp;
+    int			sts;
+    int			i;
+    int			nrequests = 0;
+    int			pipeline = 1;
+    static Request	*requests;
+    static int		maxrequests;
+    Request		*rp;
+    __pmPDU		*pb;
+    __pmPDUHdr		*php;
+    ClientInfo		*cp;
+
+    if (nClients > maxrequests) {
+	if ((rp = (Request *)realloc(requests, nClients * sizeof(Request))) == NULL) {
+	    pmNoMem("HandleClientInput.requests", nClients * sizeof(Request), PM_FATAL_ERR);
+	}
+	requests = rp;
+	maxrequests = nClients;
+    }
 
     for (i = 0; i < nClients; i++) {
 	int		pinpdu;
@@ -337,96 +512,25 @@ HandleClientInput(__pmFdSet *fdsPtr)
 	if (pmDebugOptions.appl0)
 	    ShowClients(stderr);
 
-	switch (php->type) {
-	    case PDU_PROFILE:
-		sts = (cp->denyOps & PMCD_OP_FETCH) ?
-		      PM_ERR_PERMISSION : DoProfile(cp, pb);
-		break;
-
-	    case PDU_FETCH:
-		sts = (cp->denyOps & PMCD_OP_FETCH) ?
-		      PM_ERR_PERMISSION : DoFetch(cp, pb);
-		break;
-
-	    case PDU_INSTANCE_REQ:
-		sts = (cp->denyOps & PMCD_OP_FETCH) ?
-		      PM_ERR_PERMISSION : DoInstance(cp, pb);
-		break;
-
-	    case PDU_LABEL_REQ:
-		sts = (cp->denyOps & PMCD_OP_FETCH) ?
-		      PM_ERR_PERMISSION : DoLabel(cp, pb);
-		break;
+	rp = &requests[nrequests];
+	rp->client = i;
+	rp->pb = pb;
+	rp->pinpdu = pinpdu;
+	rp->sts = 0;
+	rp->fetch = NULL;
 
-	    case PDU_DESC_REQ:
-		sts = (cp->denyOps & PMCD_OP_FETCH) ?
-		      PM_ERR_PERMISSION : DoDesc(cp, pb);
-		break;
-
-	    case PDU_TEXT_REQ:
-		sts = (cp->denyOps & PMCD_OP_FETCH) ?
-		      PM_ERR_PERMISSION : DoText(cp, pb);
-		break;
-
-	    case PDU_RESULT:
-		sts = (cp->denyOps & PMCD_OP_STORE) ?
-		      PM_ERR_PERMISSION : DoStore(cp, pb);
-		break;
-
-	    case PDU_PMNS_IDS:
-		sts = (cp->denyOps & PMCD_OP_FETCH) ?
-		      PM_ERR_PERMISSION : DoPMNSIDs(cp, pb);
-		break;
-
-	    case PDU_PMNS_NAMES:
-		sts = (cp->denyOps & PMCD_OP_FETCH) ?
-		      PM_ERR_PERMISSION : DoPMNSNames(cp, pb);
-		break;
-
-	    case PDU_PMNS_CHILD:
-		sts = (cp->denyOps & PMCD_OP_FETCH) ?
-		      PM_ERR_PERMISSION : DoPMNSChild(cp, pb);
-		break;
-
-	    case PDU_PMNS_TRAVERSE:
-		sts = (cp->denyOps & PMCD_OP_FETCH) ?
-		      PM_ERR_PERMISSION : DoPMNSTraverse(cp, pb);
-		break;
-
-	    case PDU_CREDS:
-		sts = DoCreds(cp, pb);
-		break;
-
-	    default:
-		sts = PM_ERR_IPC;
-	}
-	if (sts < 0) {
-	    if (pmDebugOptions.appl0)
-		fprintf(stderr, "PDU:  %s client[%d]: %s\n",
-		    __pmPDUTypeStr(php->type), i, pmErrStr(sts));
-	    /* Make sure client still alive before sending. */
-	    if (cp->status.connected) {
-		pmcd_trace(TR_XMIT_PDU, cp->fd, PDU_ERROR, sts);
-		sts = __pmSendError(cp->fd, FROM_ANON, sts);
-		if (sts < 0)
-		    pmNotifyErr(LOG_ERR, "HandleClientInput: "
-			"error sending Error PDU to client[%d] %s\n", i, pmErrStr(sts));
-	    }
-	}
-	if (pinpdu > 0)
-	    __pmUnpinPDUBuf(pb);
-
-	/*
-	 * May need to send connection attributes to interested PMDAs, if
-	 * something changed for this client during this PDU exchange.
-	 */
-	if (client[i].status.attributes) {
-	    if (pmDebugOptions.appl1)
-		pmNotifyErr(LOG_INFO, "Client idx=%d,seq=%d attrs reset\n",
-				i, client[i].seq);
-	    AgentsAttributes(i);
+	if (php->type == PDU_PROFILE) {
+	    /* no reply, and no agent involved - done at once */
+	    HandleRequest(rp);
+	    continue;
 	}
+	nrequests++;
+	if (pipeline && !StartClientRequest(rp))
+	    pipeline = 0;
     }
+
+    for (i = 0; i < nrequests; i++)
+	HandleRequest(&requests[i]);
 }
 
 /*
@@ -687,7 +791,7 @@ CheckNewClient(__pmFdSet * fdset, int rfd, int family)
 	    memset(&cp->pduInfo, 0, sizeof(cp->pduInfo));
 	    cp->pduInfo.version = PDU_VERSION;
 	    cp->pduInfo.licensed = 1;
-	    cp->pduInfo.features = PDU_FLAG_LABELS;
+	    cp->pduInfo.features = (PDU_FLAG_LABELS | PDU_FLAG_INDOM_DELTA);
 	    if (__pmServerHasFeature(PM_SERVER_FEATURE_SECURE))
 		cp->pduInfo.features |= (PDU_FLAG_SECURE | PDU_FLAG_SECURE_ACK);
 	    if (__pmServerHasFeature(PM_SERVER_FEATURE_COMPRESS))
@@ -700,6 +804,8 @@ CheckNewClient(__pmFdSet * fdset, int rfd, int family)
 		cp->pduInfo.features |= PDU_FLAG_CREDS_REQD;
 	    if (__pmServerHasFeature(PM_SERVER_FEATURE_CONTAINERS))
 		cp->pduInfo.features |= PDU_FLAG_CONTAINER;
+	    if (__pmServerHasFeature(PM_SERVER_FEATURE_LZMA))
+		cp->pduInfo.features |= PDU_FLAG_LZMA;
 	    challenge = *(__uint32_t *)(&cp->pduInfo);
 	    sts = 0;
 	}
@@ -933,6 +1039,7 @@ main(int argc, char *argv[])
     __pmSetInternalState(PM_STATE_PMCS);
     __pmServerSetFeature(PM_SERVER_FEATURE_DISCOVERY);
     __pmServerSetFeature(PM_SERVER_FEATURE_CONTAINERS);
+    __pmServerSetFeature(PM_SERVER_FEATURE_LZMA);
 
     if ((envstr = getenv("PMCD_PORT")) != NULL) {
 	nport = __pmServerAddPorts(envstr);
@@ -79,6 +79,7 @@ typedef struct {
     int        pduVersion;		/* PDU_VERSION for this agent */
     int        inFd, outFd;		/* For input to/output from agent */
     int	       done;			/* Set when processed for this Fetch */
+    int	       pending;			/* Requests sent, replies not yet read */
     ClientInfo *profClient;		/* Last client to send profile to agent */
     int	       profIndex;		/* Index of profile that client sent */
     char       *pmDomainLabel;		/* Textual label for agent's PMD */
@@ -148,6 +149,7 @@ extern int		AgentDied;	/* for updating mapdom[] */
 PMCD_CALL extern AgentInfo *pmcd_agent(int);
 extern void CleanupAgent(AgentInfo *, int, int);
 extern int HarvestAgents(unsigned int);
+extern int AgentPipeline(AgentInfo *);
 
 /* pmdaroot file descriptor */
 extern int	pmdarootfd;
@@ -203,6 +205,10 @@ extern int pmcd_load_libpcp_pmda(void);
 /*
  * PDU handling routines
  */
+typedef struct fetchctl FetchCtl;	/* fetch in progress, see dofetch.c */
+extern int StartFetch(ClientInfo *, __pmPDU *, int, FetchCtl **);
+extern int FinishFetch(FetchCtl *);
+extern int StartRequest(ClientInfo *, __pmPDU *);
 extern int DoFetch(ClientInfo *, __pmPDU *);
 extern int DoProfile(ClientInfo *, __pmPDU *);
 extern int DoDesc(ClientInfo *, __pmPDU *);
@@ -228,6 +234,7 @@ extern void PrintAgentInfo(FILE *);
 extern void CheckLabelChange(void);
 extern void MarkStateChanges(unsigned int);
 extern void CleanupClient(ClientInfo *, int);
+extern void FreeClientInDoms(ClientInfo *);
 extern int ClientsAttributes(AgentInfo *);
 extern int AgentsAttributes(int);
 extern pmResult **SplitResult(pmResult *);
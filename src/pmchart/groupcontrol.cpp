@@ -1,5 +1,5 @@
 /*
- * Copyright (c) 2012-2017, Red Hat.  All Rights Reserved.
+ * Copyright (c) 2012-2017,2019, Red Hat.  All Rights Reserved.
  * Copyright (c) 2007-2008, Aconex.  All Rights Reserved.
  * Copyright (c) 2006, Ken McDonell.  All Rights Reserved.
  * 
@@ -55,6 +55,10 @@ GroupControl::init(int samples, int visible,
     my.timeData.clear();
     for (int i = 0; i < samples; i++)
 	my.timeData.push_back(my.realPosition - (i * my.realDelta));
+
+    // Redraw scrolled or resized archive views from a background cache
+    if (isArchiveSource())
+	setPrefetch(samples);
 }
 
 bool
@@ -596,6 +600,8 @@ GroupControl::setSampleHistory(int v)
     console->post("GroupControl::setSampleHistory (%d -> %d)", my.samples, v);
     if (my.samples != v) {
 	my.samples = v;
+	if (isArchiveSource())
+	    setPrefetch(v);
 
 	double right = my.realPosition;
 	my.timeData.clear();
@@ -107,6 +107,7 @@ enum {
 	CLUSTER_PRESSURE_CPU,	/* 83 /proc/pressure/cpu metrics */
 	CLUSTER_PRESSURE_MEM,	/* 84 /proc/pressure/memory metrics */
 	CLUSTER_PRESSURE_IO,	/* 85 /proc/pressure/io metrics */
+	CLUSTER_PMDA_REFRESH,	/* 86 pmda.refresh shared refresh statistics */
 
 	NUM_CLUSTERS		/* one more than highest numbered cluster */
 };
@@ -175,6 +176,7 @@ enum {
 	TTY_INDOM,              /* 35 - serial tty devices */
 	SOFTIRQS_INDOM,		/* 36 - softirqs */
 	PRESSUREAVG_INDOM,	/* 37 - 10, 60, 300 second pressure averages */
+	REFRESH_INDOM,		/* 38 - refreshed clusters */
 
 	NUM_INDOMS		/* one more than highest numbered cluster */
 };
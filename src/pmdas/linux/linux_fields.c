@@ -0,0 +1,241 @@
+/*
+ * Linux PMDA /proc file parsing helpers
+ *
+ * Copyright (c) 2019 Red Hat.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ * for more details.
+ */
+#include <fcntl.h>
+#include <pthread.h>
+#include "linux.h"
+#include "linux_fields.h"
+
+#define BUFFER_MINSIZE	4096
+#define DISPLACE_MAX	(1U << 16)
+
+static pthread_mutex_t	fields_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/*
+ * Read an entire stats file into a reusable buffer.  Files in /proc
+ * report a zero size, so read until end-of-file, growing as needed.
+ */
+int
+linux_statsbuffer(const char *path, linux_buffer_t *buffer)
+{
+    char		name[MAXPATHLEN];
+    char		*data;
+    ssize_t		bytes;
+    size_t		size;
+    int			fd, sts = 0;
+
+    pmsprintf(name, sizeof(name), "%s%s", linux_statspath, path);
+    if ((fd = open(name, O_RDONLY)) < 0)
+	return -oserror();
+
+    buffer->length = 0;
+    for (;;) {
+	if (buffer->size - buffer->length < 2) {
+	    size = buffer->size ? buffer->size * 2 : BUFFER_MINSIZE;
+	    if ((data = realloc(buffer->data, size)) == NULL) {
+		sts = -ENOMEM;
+		break;
+	    }
+	    buffer->data = data;
+	    buffer->size = size;
+	}
+	bytes = read(fd, buffer->data + buffer->length,
+			buffer->size - buffer->length - 1);
+	if (bytes < 0) {
+	    if (oserror() == EINTR)
+		continue;
+	    sts = -oserror();
+	    break;
+	}
+	if (bytes == 0)
+	    break;
+	buffer->length += bytes;
+    }
+    close(fd);
+    if (buffer->data)
+	buffer->data[buffer->length] = '\0';
+    return sts;
+}
+
+static inline const char *
+fields_key(const linux_fields_t *fields, unsigned int index)
+{
+    return *(const char * const *)
+		((const char *)fields->table + index * fields->stride);
+}
+
+static inline __uint64_t
+fields_hash(const char *key, size_t length)
+{
+    __uint64_t		hash = 0xcbf29ce484222325ULL;	/* FNV-1a */
+
+    while (length--) {
+	hash ^= (unsigned char)*key++;
+	hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+static inline unsigned int
+fields_slot(__uint64_t hash, unsigned int displace, unsigned int mask)
+{
+    hash ^= displace * 0x9e3779b97f4a7c15ULL;
+    hash *= 0xff51afd7ed558ccdULL;
+    return (unsigned int)(hash >> 32) & mask;
+}
+
+/*
+ * Hash-and-displace construction: keys are grouped into buckets by
+ * their hash, then (largest buckets first) each bucket is assigned a
+ * displacement placing all of its keys into otherwise unused slots.
+ */
+static int
+fields_build(linux_fields_t *fields)
+{
+    __uint64_t		*hashes = NULL;
+    unsigned int	*order = NULL, *sizes = NULL, *placed = NULL;
+    unsigned int	i, j, b, k, n, d, nbuckets, nslots, tmp;
+    int			sts = -ENOMEM;
+
+    for (n = 0; fields_key(fields, n) != NULL; n++)
+	;
+    for (nslots = 8; nslots < n * 2; nslots <<= 1)
+	;
+    for (nbuckets = 4; nbuckets * 2 < n; nbuckets <<= 1)
+	;
+
+    if ((fields->lengths = calloc(n ? n : 1, sizeof(unsigned short))) == NULL ||
+	(fields->slots = malloc(nslots * sizeof(int))) == NULL ||
+	(fields->displace = calloc(nbuckets, sizeof(unsigned int))) == NULL ||
+	(hashes = malloc((n ? n : 1) * sizeof(__uint64_t))) == NULL ||
+	(order = malloc(nbuckets * sizeof(unsigned int))) == NULL ||
+	(sizes = calloc(nbuckets, sizeof(unsigned int))) == NULL ||
+	(placed = malloc((n ? n : 1) * sizeof(unsigned int))) == NULL)
+	goto done;
+
+    for (i = 0; i < nslots; i++)
+	fields->slots[i] = -1;
+    for (i = 0; i < n; i++) {
+	fields->lengths[i] = strlen(fields_key(fields, i));
+	hashes[i] = fields_hash(fields_key(fields, i), fields->lengths[i]);
+	sizes[hashes[i] & (nbuckets - 1)]++;
+    }
+    for (b = 0; b < nbuckets; b++)
+	order[b] = b;
+    for (b = 1; b < nbuckets; b++) {	/* insertion sort, largest first */
+	tmp = order[b];
+	for (j = b; j > 0 && sizes[order[j-1]] < sizes[tmp]; j--)
+	    order[j] = order[j-1];
+	order[j] = tmp;
+    }
+
+    for (b = 0; b < nbuckets && sizes[order[b]] > 0; b++) {
+	for (d = 0; d < DISPLACE_MAX; d++) {
+	    for (i = k = 0; i < n; i++) {
+		if ((hashes[i] & (nbuckets - 1)) != order[b])
+		    continue;
+		/* a duplicate key is only reachable via its first entry */
+		for (j = 0; j < i; j++)
+		    if (hashes[j] == hashes[i] &&
+			fields->lengths[j] == fields->lengths[i] &&
+			strcmp(fields_key(fields, j), fields_key(fields, i)) == 0)
+			break;
+		if (j < i)
+		    continue;
+		placed[k] = fields_slot(hashes[i], d, nslots - 1);
+		if (fields->slots[placed[k]] >= 0)
+		    break;
+		for (j = 0; j < k; j++)
+		    if (placed[j] == placed[k])
+			break;
+		if (j < k)
+		    break;
+		fields->slots[placed[k++]] = i;
+	    }
+	    if (i == n)
+		break;
+	    while (k > 0)	/* undo partial placement, try next */
+		fields->slots[placed[--k]] = -1;
+	}
+	if (d == DISPLACE_MAX) {
+	    sts = -E2BIG;
+	    goto done;
+	}
+	fields->displace[order[b]] = d;
+    }
+
+    fields->count = n;
+    fields->mask = nslots - 1;
+    fields->bmask = nbuckets - 1;
+    sts = 0;
+
+done:
+    if (sts < 0) {
+	free(fields->lengths);
+	free(fields->slots);
+	free(fields->displace);
+	fields->lengths = NULL;
+	fields->slots = NULL;
+	fields->displace = NULL;
+    }
+    free(hashes);
+    free(order);
+    free(sizes);
+    free(placed);
+    return sts;
+}
+
+/*
+ * Build the hash for a field table once, on first use - may be called
+ * from concurrent refresh threads.
+ */
+int
+linux_fields_setup(linux_fields_t *fields)
+{
+    int			sts = 0;
+
+    pthread_mutex_lock(&fields_lock);
+    if (fields->slots == NULL) {
+	if ((sts = fields_build(fields)) < 0)
+	    pmNotifyErr(LOG_ERR, "%s: field table hash setup failed: %s",
+			pmGetProgname(), pmErrStr(sts));
+	else if (pmDebugOptions.libpmda)
+	    fprintf(stderr, "linux_fields_setup: %u keys, %u slots\n",
+			fields->count, fields->mask + 1);
+    }
+    pthread_mutex_unlock(&fields_lock);
+    return sts;
+}
+
+/*
+ * Returns the table index of the key, or -1 if not present.
+ */
+int
+linux_fields_lookup(const linux_fields_t *fields, const char *key, size_t length)
+{
+    __uint64_t		hash;
+    unsigned int	slot;
+    int			index;
+
+    if (fields->slots == NULL)
+	return -1;
+    hash = fields_hash(key, length);
+    slot = fields_slot(hash, fields->displace[hash & fields->bmask], fields->mask);
+    if ((index = fields->slots[slot]) < 0 ||
+	fields->lengths[index] != length ||
+	memcmp(fields_key(fields, index), key, length) != 0)
+	return -1;
+    return index;
+}
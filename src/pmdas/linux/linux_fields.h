@@ -0,0 +1,155 @@
+/*
+ * Linux PMDA /proc file parsing helpers
+ *
+ * Copyright (c) 2019 Red Hat.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ * for more details.
+ */
+
+#ifndef _LINUX_FIELDS_H
+#define _LINUX_FIELDS_H
+
+/*
+ * Whole-file buffer, reused from one refresh to the next - the file
+ * contents are NUL terminated and may be modified in-place, e.g. by
+ * linux_buffer_line() splitting it into lines.
+ */
+typedef struct {
+    char		*data;
+    size_t		size;		/* allocated bytes */
+    size_t		length;		/* bytes read, excluding the NUL */
+} linux_buffer_t;
+
+extern int linux_statsbuffer(const char *, linux_buffer_t *);
+
+/*
+ * Keyed field tables, e.g. :
+ *
+ *	static struct {
+ *	    const char	*field;
+ *	    __uint64_t	*offset;
+ *	} vmstat_fields[] = {
+ *	    { "allocstall",	&_pm_proc_vmstat.allocstall },
+ *	    ...
+ *	    { NULL }
+ *	};
+ *	static linux_fields_t vmstat_map = LINUX_FIELDS_INIT(vmstat_fields);
+ *
+ * The key must be the first member of each table entry.  A minimal
+ * perfect hash over the keys is built once, on first use, giving each
+ * lookup a single hash computation and (at most) one key comparison.
+ */
+typedef struct {
+    const void		*table;
+    size_t		stride;		/* bytes per table entry */
+    unsigned int	count;		/* number of keys in the table */
+    unsigned int	mask;		/* hash slots, less one */
+    unsigned int	bmask;		/* displacement buckets, less one */
+    unsigned int	*displace;	/* per-bucket displacement */
+    int			*slots;		/* table index per slot, or -1 */
+    unsigned short	*lengths;	/* key length per table index */
+} linux_fields_t;
+
+#define LINUX_FIELDS_INIT(t)	{ .table = (t), .stride = sizeof((t)[0]) }
+
+extern int linux_fields_setup(linux_fields_t *);
+extern int linux_fields_lookup(const linux_fields_t *, const char *, size_t);
+
+/*
+ * In-place line and token iteration over a buffer.
+ */
+static inline char *
+linux_buffer_line(char **cursor)
+{
+    char		*line = *cursor, *end;
+
+    if (line == NULL || *line == '\0')
+	return NULL;
+    if ((end = strchr(line, '\n')) != NULL) {
+	*end = '\0';
+	*cursor = end + 1;
+    } else {
+	*cursor = line + strlen(line);
+    }
+    return line;
+}
+
+static inline char *
+linux_token(char *p, size_t *length)
+{
+    char		*start;
+
+    while (*p == ' ' || *p == '\t')
+	p++;
+    for (start = p; *p && *p != ' ' && *p != '\t' && *p != '\n'; p++)
+	;
+    *length = p - start;
+    return start;
+}
+
+/*
+ * Fast integer conversions - decimal with the strtoull(3) treatment
+ * of a leading minus sign, and hexadecimal.  No overflow detection,
+ * kernel values are at most 64 bits wide.
+ */
+static inline __uint64_t
+linux_strtou64(const char *p, char **end)
+{
+    __uint64_t		value = 0;
+    int			negate = 0;
+
+    while (*p == ' ' || *p == '\t')
+	p++;
+    if (*p == '-') {
+	negate = 1;
+	p++;
+    }
+    for (; (unsigned int)(*p - '0') < 10; p++)
+	value = value * 10 + (*p - '0');
+    if (end)
+	*end = (char *)p;
+    return negate ? -value : value;
+}
+
+static inline __uint64_t
+linux_strtox64(const char *p, char **end)
+{
+    __uint64_t		value = 0;
+    unsigned int	digit;
+
+    while (*p == ' ' || *p == '\t')
+	p++;
+    for (;; p++) {
+	if ((digit = (unsigned int)(*p - '0')) < 10)
+	    ;
+	else if ((digit = (unsigned int)((*p | 0x20) - 'a')) < 6)
+	    digit += 10;
+	else
+	    break;
+	value = (value << 4) | digit;
+    }
+    if (end)
+	*end = (char *)p;
+    return value;
+}
+
+/*
+ * Skip to the first digit on a line, as for "key:   1234 kB" formats.
+ */
+static inline __uint64_t
+linux_strtou64_skip(const char *p, char **end)
+{
+    while (*p && (unsigned int)(*p - '0') >= 10)
+	p++;
+    return linux_strtou64(p, end);
+}
+
+#endif /* _LINUX_FIELDS_H */
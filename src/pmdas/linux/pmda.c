@@ -70,6 +70,7 @@
 #include "sysfs_tapestats.h"
 #include "proc_tty.h"
 #include "proc_pressure.h"
+#include "workers.h"
 
 static proc_stat_t		proc_stat;
 static proc_meminfo_t		proc_meminfo;
@@ -111,6 +112,9 @@ static int		_isDSO = 1;	/* =0 I am a daemon */
 static int		rootfd = -1;	/* af_unix pmdaroot */
 static char		*username;
 static int		hz;
+static int		refresh_window;	/* shared refresh window (msec) */
+static int		refresh_workers;	/* concurrent refresh threads */
+static pmdaRefresh	*linux_refresh_cache;
 
 /* globals */
 int _pm_pageshift; /* for hinv.pagesize and for pages -> bytes */
@@ -364,6 +368,7 @@ static pmdaIndom indomtab[] = {
     { TTY_INDOM, 0, NULL },
     { SOFTIRQS_INDOM, 0, NULL },
     { PRESSUREAVG_INDOM, 3, pressureavg_indom_id },
+    { REFRESH_INDOM, 0, NULL },
 };
 
 
@@ -5675,6 +5680,25 @@ static pmdaMetric metrictab[] = {
     /* kernel.all.pressure.io.full.total */
     { NULL, { PMDA_PMID(CLUSTER_PRESSURE_IO,3), PM_TYPE_U64, PM_INDOM_NULL,
 	      PM_SEM_COUNTER, PMDA_PMUNITS(0,1,0,0,PM_TIME_USEC,0)}},
+
+/*
+ * shared refresh cluster
+ */
+    /* pmda.refresh.hits */
+    { NULL, { PMDA_PMID(CLUSTER_PMDA_REFRESH,0), PM_TYPE_U64, REFRESH_INDOM,
+	      PM_SEM_COUNTER, PMDA_PMUNITS(0,0,1,0,0,PM_COUNT_ONE)}},
+    /* pmda.refresh.misses */
+    { NULL, { PMDA_PMID(CLUSTER_PMDA_REFRESH,1), PM_TYPE_U64, REFRESH_INDOM,
+	      PM_SEM_COUNTER, PMDA_PMUNITS(0,0,1,0,0,PM_COUNT_ONE)}},
+    /* pmda.refresh.time */
+    { NULL, { PMDA_PMID(CLUSTER_PMDA_REFRESH,2), PM_TYPE_U64, REFRESH_INDOM,
+	      PM_SEM_COUNTER, PMDA_PMUNITS(0,1,0,0,PM_TIME_USEC,0)}},
+    /* pmda.refresh.window */
+    { &refresh_window, { PMDA_PMID(CLUSTER_PMDA_REFRESH,3), PM_TYPE_32,
+	      PM_INDOM_NULL, PM_SEM_DISCRETE, PMDA_PMUNITS(0,1,0,0,PM_TIME_MSEC,0)}},
+    /* pmda.refresh.workers */
+    { &refresh_workers, { PMDA_PMID(CLUSTER_PMDA_REFRESH,4), PM_TYPE_32,
+	      PM_INDOM_NULL, PM_SEM_DISCRETE, PMDA_PMUNITS(0,0,0,0,0,0)}},
 };
 
 typedef struct {
@@ -5718,6 +5742,234 @@ linux_ctx_container(int ctx)
     return NULL;
 }
 
+/*
+ * Values from a recent refresh of a cluster are shared with subsequent
+ * requests within the (optional, -R option) freshness window.  Several
+ * clusters are refreshed as a group, with finer-grained refresh indices
+ * selecting values within them - these groups are shared only when all
+ * of the requested indices are fresh.
+ */
+static const int refresh_net_dev_group[] = {
+    REFRESH_NET_MTU, REFRESH_NET_TYPE, REFRESH_NET_SPEED, REFRESH_NET_DUPLEX,
+    REFRESH_NET_LINKUP, REFRESH_NET_RUNNING, REFRESH_NET_WIRELESS,
+    CLUSTER_NET_DEV, -1
+};
+static const int refresh_net_addr_group[] = {
+    REFRESH_NETADDR_INET, REFRESH_NETADDR_IPV6, REFRESH_NETADDR_HW,
+    CLUSTER_NET_ADDR, -1
+};
+static const int refresh_partitions_group[] = {
+    REFRESH_PROC_DISKSTATS, REFRESH_PROC_PARTITIONS,
+    CLUSTER_PARTITIONS, -1
+};
+
+static void
+refresh_pmda_refresh(pmInDom indom)
+{
+    pmdaRefreshStats	stats;
+    char		name[16];
+    int			i;
+
+    pmdaCacheOp(indom, PMDA_CACHE_INACTIVE);
+    for (i = 0; i < NUM_CLUSTERS; i++) {
+	if (pmdaRefreshGetStats(linux_refresh_cache, i, &stats) <= 0)
+	    continue;
+	pmsprintf(name, sizeof(name), "%d", i);
+	pmdaCacheStore(indom, PMDA_CACHE_ADD, name, NULL);
+    }
+}
+
+static void
+linux_refresh_check(int *need_refresh, int override)
+{
+    int		i;
+
+    pmdaRefreshCheckGroup(linux_refresh_cache, need_refresh,
+			refresh_net_dev_group, override);
+    pmdaRefreshCheckGroup(linux_refresh_cache, need_refresh,
+			refresh_net_addr_group, override);
+    pmdaRefreshCheckGroup(linux_refresh_cache, need_refresh,
+			refresh_partitions_group, override);
+
+    for (i = 0; i < NUM_CLUSTERS; i++) {
+	if (i == CLUSTER_NET_DEV || i == CLUSTER_NET_ADDR ||
+	    i == CLUSTER_PARTITIONS || i == CLUSTER_PMDA_REFRESH)
+	    continue;
+	if (need_refresh[i] &&
+	    !pmdaRefreshCheck(linux_refresh_cache, i, override))
+	    need_refresh[i] = 0;
+    }
+}
+
+static void
+linux_refresh_done(int cluster)
+{
+    pmdaRefreshDone(linux_refresh_cache, cluster);
+}
+
+/*
+ * Clusters with entirely private state - no instance domains shared with
+ * other clusters, no namespace switching and no non-reentrant library
+ * calls - are refreshed by tasks that may run concurrently with each
+ * other and the remaining clusters (-W option).  Clusters sharing any
+ * state are refreshed in order, as steps of the same task.
+ */
+static int refresh_interrupts_mtab;
+
+static void task_meminfo(void) { refresh_proc_meminfo(&proc_meminfo); }
+static void task_loadavg(void) { refresh_proc_loadavg(&proc_loadavg); }
+static void task_sockstat(void) { refresh_proc_net_sockstat(&proc_net_sockstat); }
+static void task_sockstat6(void) { refresh_proc_net_sockstat6(&proc_net_sockstat6); }
+static void task_snmp(void) { refresh_proc_net_snmp(&_pm_proc_net_snmp); }
+static void task_snmp6(void) { refresh_proc_net_snmp6(_pm_proc_net_snmp6); }
+static void task_netstat(void) { refresh_proc_net_netstat(&_pm_proc_net_netstat); }
+static void task_raw(void) { refresh_proc_net_raw(&proc_net_raw); }
+static void task_raw6(void) { refresh_proc_net_raw6(&proc_net_raw6); }
+static void task_tcp(void) { refresh_proc_net_tcp(&proc_net_tcp); }
+static void task_tcp6(void) { refresh_proc_net_tcp6(&proc_net_tcp6); }
+static void task_udp(void) { refresh_proc_net_udp(&proc_net_udp); }
+static void task_udp6(void) { refresh_proc_net_udp6(&proc_net_udp6); }
+static void task_unix(void) { refresh_proc_net_unix(&proc_net_unix); }
+static void task_scsi(void) { refresh_proc_scsi(INDOM(SCSI_INDOM)); }
+static void task_uptime(void) { refresh_proc_uptime(&proc_uptime); }
+static void task_utmp(void) { refresh_login_info(&login_info); }
+static void task_vfs(void) { refresh_proc_sys_fs(&proc_sys_fs); }
+static void task_locks(void) { refresh_proc_locks(&proc_locks); }
+static void task_sys_kernel(void) { refresh_proc_sys_kernel(&proc_sys_kernel); }
+static void task_vmstat(void) { refresh_proc_vmstat(&_pm_proc_vmstat); }
+static void task_sysfs_kernel(void) { refresh_sysfs_kernel(&sysfs_kernel); }
+static void task_buddyinfo(void) { refresh_proc_buddyinfo(&proc_buddyinfo); }
+static void task_ksm(void) { refresh_ksm_info(&ksm_info); }
+static void task_tapedev(void) { refresh_sysfs_tapestats(INDOM(TAPEDEV_INDOM)); }
+static void task_pressure_cpu(void) { refresh_proc_pressure_cpu(&proc_pressure); }
+static void task_pressure_mem(void) { refresh_proc_pressure_mem(&proc_pressure); }
+static void task_pressure_io(void) { refresh_proc_pressure_io(&proc_pressure); }
+
+static void
+task_zoneinfo(void)
+{
+    refresh_proc_zoneinfo(INDOM(ZONEINFO_INDOM),
+			  INDOM(ZONEINFO_PROTECTION_INDOM));
+}
+
+static void
+task_interrupts(void)
+{
+    refresh_interrupts_mtab |= refresh_interrupt_values();
+}
+
+static void
+task_softirqs(void)
+{
+    refresh_interrupts_mtab |= refresh_softirqs_values();
+}
+
+static void
+task_slab(void)
+{
+    if (proc_slabinfo.permission)
+	refresh_proc_slabinfo(INDOM(SLAB_INDOM), &proc_slabinfo);
+}
+
+static void
+task_tty(void)
+{
+    if (proc_tty_permission)
+	refresh_tty(INDOM(TTY_INDOM));
+}
+
+static const int need_interrupts[] = {
+    CLUSTER_INTERRUPTS, CLUSTER_INTERRUPT_LINES, CLUSTER_INTERRUPT_OTHER, -1
+};
+static const int need_softirqs[] = {
+    CLUSTER_SOFTIRQS, CLUSTER_SOFTIRQS_TOTAL, -1
+};
+static const int need_zoneinfo[] = {
+    CLUSTER_ZONEINFO, CLUSTER_ZONEINFO_PROTECTION, -1
+};
+
+static refresh_task_t refresh_tasks[] = {
+    { { { CLUSTER_ZONEINFO, need_zoneinfo, task_zoneinfo } } },
+    { { { CLUSTER_SLAB, NULL, task_slab } } },
+    { { { CLUSTER_INTERRUPTS, need_interrupts, task_interrupts },
+	{ CLUSTER_SOFTIRQS, need_softirqs, task_softirqs } } },
+    { { { CLUSTER_MEMINFO, NULL, task_meminfo } } },
+    { { { CLUSTER_VMSTAT, NULL, task_vmstat } } },
+    { { { CLUSTER_BUDDYINFO, NULL, task_buddyinfo } } },
+    { { { CLUSTER_SCSI, NULL, task_scsi } } },
+    { { { CLUSTER_TAPEDEV, NULL, task_tapedev } } },
+    { { { CLUSTER_TTY, NULL, task_tty } } },
+    { { { CLUSTER_KSM_INFO, NULL, task_ksm } } },
+    { { { CLUSTER_NET_TCP, NULL, task_tcp } } },
+    { { { CLUSTER_NET_TCP6, NULL, task_tcp6 } } },
+    { { { CLUSTER_NET_UDP, NULL, task_udp } } },
+    { { { CLUSTER_NET_UDP6, NULL, task_udp6 } } },
+    { { { CLUSTER_NET_RAW, NULL, task_raw } } },
+    { { { CLUSTER_NET_RAW6, NULL, task_raw6 } } },
+    { { { CLUSTER_NET_UNIX, NULL, task_unix } } },
+    { { { CLUSTER_NET_SNMP, NULL, task_snmp } } },
+    { { { CLUSTER_NET_SNMP6, NULL, task_snmp6 } } },
+    { { { CLUSTER_NET_NETSTAT, NULL, task_netstat } } },
+    { { { CLUSTER_NET_SOCKSTAT, NULL, task_sockstat } } },
+    { { { CLUSTER_NET_SOCKSTAT6, NULL, task_sockstat6 } } },
+    { { { CLUSTER_LOADAVG, NULL, task_loadavg } } },
+    { { { CLUSTER_UPTIME, NULL, task_uptime } } },
+    { { { CLUSTER_UTMP, NULL, task_utmp } } },
+    { { { CLUSTER_VFS, NULL, task_vfs } } },
+    { { { CLUSTER_LOCKS, NULL, task_locks } } },
+    { { { CLUSTER_SYS_KERNEL, NULL, task_sys_kernel } } },
+    { { { CLUSTER_SYSFS_KERNEL, NULL, task_sysfs_kernel } } },
+    { { { CLUSTER_PRESSURE_CPU, NULL, task_pressure_cpu },
+	{ CLUSTER_PRESSURE_MEM, NULL, task_pressure_mem },
+	{ CLUSTER_PRESSURE_IO, NULL, task_pressure_io } } },
+};
+static const int num_refresh_tasks = sizeof(refresh_tasks)/sizeof(refresh_tasks[0]);
+
+/*
+ * Start any tasks needed for this request, in worker threads if the
+ * values are not container-specific (mount namespace switching is only
+ * possible while single-threaded) - else inline, before returning.
+ */
+static void
+linux_refresh_start(int *need_refresh, int threaded)
+{
+    refresh_task_t	*tp;
+    const int		*np;
+    int			i, j;
+
+    for (i = 0; i < num_refresh_tasks; i++) {
+	tp = &refresh_tasks[i];
+	for (j = 0; j < REFRESH_MAXSTEPS && tp->step[j].refresh; j++) {
+	    tp->active[j] = need_refresh[tp->step[j].cluster];
+	    for (np = tp->step[j].need; np && *np >= 0 && !tp->active[j]; np++)
+		tp->active[j] = need_refresh[*np];
+	}
+    }
+    refresh_interrupts_mtab = 0;
+    refresh_workers_run(refresh_tasks, num_refresh_tasks, threaded);
+}
+
+/*
+ * Wait for all tasks to complete, accounting the time taken by each
+ * of their refresh steps.
+ */
+static int
+linux_refresh_finish(void)
+{
+    refresh_task_t	*tp;
+    int			i, j;
+
+    refresh_workers_wait();
+    for (i = 0; i < num_refresh_tasks; i++) {
+	tp = &refresh_tasks[i];
+	for (j = 0; j < REFRESH_MAXSTEPS && tp->step[j].refresh; j++)
+	    if (tp->active[j])
+		pmdaRefreshDoneTime(linux_refresh_cache,
+				tp->step[j].cluster, tp->usec[j]);
+    }
+    return refresh_interrupts_mtab;
+}
+
 static int
 linux_refresh(pmdaExt *pmda, int *need_refresh, int context)
 {
@@ -5727,75 +5979,56 @@ linux_refresh(pmdaExt *pmda, int *need_refresh, int context)
     int need_net_ioctl = 0;
     int ns_fds = 0;
     int sts = 0;
+    int i;
 
     if (cp && (sts = container_lookup(rootfd, cp)) < 0)
 	return sts;
 
+    /* container values are never shared with other contexts */
+    linux_refresh_check(need_refresh, cp ? 0 : -1);
+
+    /* values that depend on the credentials of the client */
+    if (need_refresh[CLUSTER_SLAB])
+	proc_slabinfo.permission = (access != NULL &&
+				    access->uid == 0 && access->uid_flag);
+    if (need_refresh[CLUSTER_TTY])
+	proc_tty_permission = (access != NULL &&
+				access->uid == 0 && access->uid_flag);
+
+    linux_refresh_start(need_refresh, cp == NULL);
+
     if (need_refresh[CLUSTER_PARTITIONS] ||
 	need_refresh[REFRESH_PROC_DISKSTATS] ||
-	need_refresh[REFRESH_PROC_PARTITIONS])
+	need_refresh[REFRESH_PROC_PARTITIONS]) {
     	refresh_proc_partitions(INDOM(DISK_INDOM),
 			INDOM(PARTITIONS_INDOM),
 			INDOM(DM_INDOM), INDOM(MD_INDOM),
 			need_refresh[REFRESH_PROC_DISKSTATS],
 			need_refresh[REFRESH_PROC_PARTITIONS]);
+	linux_refresh_done(CLUSTER_PARTITIONS);
+    }
 
-    if (need_refresh[CLUSTER_STAT])
+    if (need_refresh[CLUSTER_STAT]) {
 	refresh_proc_stat(&proc_stat);
+	linux_refresh_done(CLUSTER_STAT);
+    }
 
-    if (need_refresh[CLUSTER_CPUINFO])
+    if (need_refresh[CLUSTER_CPUINFO]) {
 	refresh_proc_cpuinfo();
+	linux_refresh_done(CLUSTER_CPUINFO);
+    }
 
-    if (need_refresh[CLUSTER_MEMINFO])
-	refresh_proc_meminfo(&proc_meminfo);
-
-    if (need_refresh[CLUSTER_NUMA_MEMINFO])
+    if (need_refresh[CLUSTER_NUMA_MEMINFO]) {
 	refresh_numa_meminfo();
-
-    if (need_refresh[CLUSTER_LOADAVG])
-	refresh_proc_loadavg(&proc_loadavg);
+	linux_refresh_done(CLUSTER_NUMA_MEMINFO);
+    }
 
     if (need_refresh[CLUSTER_NET_NFS]) {
 	refresh_proc_net_rpc(&proc_net_rpc);
 	refresh_proc_fs_nfsd(&proc_fs_nfsd);
+	linux_refresh_done(CLUSTER_NET_NFS);
     }
 
-    if (need_refresh[CLUSTER_NET_SOCKSTAT])
-	refresh_proc_net_sockstat(&proc_net_sockstat);
-
-    if (need_refresh[CLUSTER_NET_SOCKSTAT6])
-	refresh_proc_net_sockstat6(&proc_net_sockstat6);
-
-    if (need_refresh[CLUSTER_NET_SNMP])
-	refresh_proc_net_snmp(&_pm_proc_net_snmp);
-
-    if (need_refresh[CLUSTER_NET_SNMP6])
-	refresh_proc_net_snmp6(_pm_proc_net_snmp6);
-
-    if (need_refresh[CLUSTER_NET_RAW])
-	refresh_proc_net_raw(&proc_net_raw);
-
-    if (need_refresh[CLUSTER_NET_RAW6])
-	refresh_proc_net_raw6(&proc_net_raw6);
-
-    if (need_refresh[CLUSTER_NET_TCP])
-	refresh_proc_net_tcp(&proc_net_tcp);
-
-    if (need_refresh[CLUSTER_NET_TCP6])
-	refresh_proc_net_tcp6(&proc_net_tcp6);
-
-    if (need_refresh[CLUSTER_NET_UDP])
-	refresh_proc_net_udp(&proc_net_udp);
-
-    if (need_refresh[CLUSTER_NET_UDP6])
-	refresh_proc_net_udp6(&proc_net_udp6);
-
-    if (need_refresh[CLUSTER_NET_UNIX])
-	refresh_proc_net_unix(&proc_net_unix);
-
-    if (need_refresh[CLUSTER_NET_NETSTAT])
-	refresh_proc_net_netstat(&_pm_proc_net_netstat);
-
     /*
      * Network interface metrics and namespaces are complicated by a
      * need to be in the right namespace at the right time (for /sys
@@ -5834,14 +6067,18 @@ linux_refresh(pmdaExt *pmda, int *need_refresh, int context)
 		goto done;
 	    refresh_proc_net_dev(netdev, cp);
 	    container_nsleave(cp, LINUX_NAMESPACE_NET);
+	    linux_refresh_done(CLUSTER_NET_DEV);
 	}
 
 	if ((sts = container_nsenter(cp, LINUX_NAMESPACE_MNT, &ns_fds)) < 0)
 	    goto done;
 	refresh_net_addr_sysfs(netaddr, need_refresh);
 	need_net_ioctl |= refresh_net_sysfs(netdev, need_refresh);
-	if (need_refresh[CLUSTER_FILESYS] || need_refresh[CLUSTER_TMPFS])
+	if (need_refresh[CLUSTER_FILESYS] || need_refresh[CLUSTER_TMPFS]) {
 	    refresh_filesys(INDOM(FILESYS_INDOM), INDOM(TMPFS_INDOM), cp);
+	    linux_refresh_done(CLUSTER_FILESYS);
+	    linux_refresh_done(CLUSTER_TMPFS);
+	}
 	container_nsleave(cp, LINUX_NAMESPACE_MNT);
 
 	if (need_net_ioctl) {
@@ -5854,6 +6091,7 @@ linux_refresh(pmdaExt *pmda, int *need_refresh, int context)
 
 	if (need_refresh[CLUSTER_NET_ADDR])
 	    store_net_addr_indom(netaddr, cp);
+	linux_refresh_done(CLUSTER_NET_ADDR);
     }
 
     if (need_refresh[CLUSTER_KERNEL_UNAME]) {
@@ -5861,114 +6099,75 @@ linux_refresh(pmdaExt *pmda, int *need_refresh, int context)
 	    goto done;
 	uname(&kernel_uname);
 	container_nsleave(cp, LINUX_NAMESPACE_UTS);
+	linux_refresh_done(CLUSTER_KERNEL_UNAME);
     }
 
-    if (need_refresh[CLUSTER_INTERRUPTS] ||
-	need_refresh[CLUSTER_INTERRUPT_LINES] ||
-	need_refresh[CLUSTER_INTERRUPT_OTHER])
-	need_refresh_mtab |= refresh_interrupt_values();
-
-    if (need_refresh[CLUSTER_SOFTIRQS] ||
-	need_refresh[CLUSTER_SOFTIRQS_TOTAL])
-	need_refresh_mtab |= refresh_softirqs_values();
-
-    if (need_refresh[CLUSTER_SWAPDEV])
+    if (need_refresh[CLUSTER_SWAPDEV]) {
 	refresh_swapdev(INDOM(SWAPDEV_INDOM));
-
-    if (need_refresh[CLUSTER_SCSI])
-	refresh_proc_scsi(INDOM(SCSI_INDOM));
-
-    if (need_refresh[CLUSTER_SLAB]) {
-	if (access != NULL && (access->uid == 0 && access->uid_flag)) {
-	    proc_slabinfo.permission = 1;
-	    refresh_proc_slabinfo(INDOM(SLAB_INDOM), &proc_slabinfo);
-	} else {
-	    proc_slabinfo.permission = 0;
-	}
+	linux_refresh_done(CLUSTER_SWAPDEV);
     }
 
-    if (need_refresh[CLUSTER_SEM_LIMITS])
+    if (need_refresh[CLUSTER_SEM_LIMITS]) {
 	refresh_sem_limits(&sem_limits);
+	linux_refresh_done(CLUSTER_SEM_LIMITS);
+    }
 
-    if (need_refresh[CLUSTER_MSG_LIMITS])
-        refresh_msg_limits(&msg_limits);
-
-    if (need_refresh[CLUSTER_SHM_INFO])
-        refresh_shm_info(&_shm_info);
-
-    if (need_refresh[CLUSTER_SEM_INFO])
-        refresh_sem_info(&_sem_info);
-
-    if (need_refresh[CLUSTER_MSG_INFO])
-        refresh_msg_info(&_msg_info);
-
-    if (need_refresh[CLUSTER_SHM_LIMITS])
-        refresh_shm_limits(&shm_limits);
-
-    if (need_refresh[CLUSTER_UPTIME])
-        refresh_proc_uptime(&proc_uptime);
-
-    if (need_refresh[CLUSTER_UTMP])
-        refresh_login_info(&login_info);
-
-    if (need_refresh[CLUSTER_VFS])
-    	refresh_proc_sys_fs(&proc_sys_fs);
+    if (need_refresh[CLUSTER_MSG_LIMITS]) {
+	refresh_msg_limits(&msg_limits);
+	linux_refresh_done(CLUSTER_MSG_LIMITS);
+    }
 
-    if (need_refresh[CLUSTER_LOCKS])
-    	refresh_proc_locks(&proc_locks);
+    if (need_refresh[CLUSTER_SHM_INFO]) {
+	refresh_shm_info(&_shm_info);
+	linux_refresh_done(CLUSTER_SHM_INFO);
+    }
 
-    if (need_refresh[CLUSTER_SYS_KERNEL])
-    	refresh_proc_sys_kernel(&proc_sys_kernel);
+    if (need_refresh[CLUSTER_SEM_INFO]) {
+	refresh_sem_info(&_sem_info);
+	linux_refresh_done(CLUSTER_SEM_INFO);
+    }
 
-    if (need_refresh[CLUSTER_VMSTAT])
-    	refresh_proc_vmstat(&_pm_proc_vmstat);
+    if (need_refresh[CLUSTER_MSG_INFO]) {
+	refresh_msg_info(&_msg_info);
+	linux_refresh_done(CLUSTER_MSG_INFO);
+    }
 
-    if (need_refresh[CLUSTER_SYSFS_KERNEL])
-    	refresh_sysfs_kernel(&sysfs_kernel);
+    if (need_refresh[CLUSTER_SHM_LIMITS]) {
+	refresh_shm_limits(&shm_limits);
+	linux_refresh_done(CLUSTER_SHM_LIMITS);
+    }
 
-    if (need_refresh[CLUSTER_NET_SOFTNET])
+    if (need_refresh[CLUSTER_NET_SOFTNET]) {
 	refresh_proc_net_softnet(&proc_net_softnet);
+	linux_refresh_done(CLUSTER_NET_SOFTNET);
+    }
 
-    if (need_refresh[CLUSTER_SHM_STAT])
+    if (need_refresh[CLUSTER_SHM_STAT]) {
 	refresh_shm_stat(INDOM(IPC_STAT_INDOM));
+	linux_refresh_done(CLUSTER_SHM_STAT);
+    }
 
-    if (need_refresh[CLUSTER_MSG_STAT])
+    if (need_refresh[CLUSTER_MSG_STAT]) {
 	refresh_msg_que(INDOM(IPC_MSG_INDOM));
+	linux_refresh_done(CLUSTER_MSG_STAT);
+    }
 
-    if (need_refresh[CLUSTER_SEM_STAT])
+    if (need_refresh[CLUSTER_SEM_STAT]) {
 	refresh_sem_array(INDOM(IPC_SEM_INDOM));
+	linux_refresh_done(CLUSTER_SEM_STAT);
+    }
 
-    if (need_refresh[CLUSTER_BUDDYINFO])
-	refresh_proc_buddyinfo(&proc_buddyinfo);
-
-    if (need_refresh[CLUSTER_ZONEINFO] ||
-        need_refresh[CLUSTER_ZONEINFO_PROTECTION])
-	refresh_proc_zoneinfo(INDOM(ZONEINFO_INDOM),
-			      INDOM(ZONEINFO_PROTECTION_INDOM));
-
-    if (need_refresh[CLUSTER_KSM_INFO])
-	refresh_ksm_info(&ksm_info);
-
-    if (need_refresh[CLUSTER_TAPEDEV])
-	refresh_sysfs_tapestats(INDOM(TAPEDEV_INDOM));
+done:
+    need_refresh_mtab |= linux_refresh_finish();
 
-    if (need_refresh[CLUSTER_TTY]) {
-	if (access != NULL && (access->uid == 0 && access->uid_flag)) {
-	    proc_tty_permission = 1;
-	    refresh_tty(INDOM(TTY_INDOM));
-	} else {
-	    proc_tty_permission = 0;
-	}
-    }
+    /* account for everything else requested (and sub-cluster indices) */
+    for (i = 0; i < NUM_REFRESHES; i++)
+	if (need_refresh[i])
+	    linux_refresh_done(i);
 
-    if (need_refresh[CLUSTER_PRESSURE_CPU])
-	refresh_proc_pressure_cpu(&proc_pressure);
-    if (need_refresh[CLUSTER_PRESSURE_MEM])
-	refresh_proc_pressure_mem(&proc_pressure);
-    if (need_refresh[CLUSTER_PRESSURE_IO])
-	refresh_proc_pressure_io(&proc_pressure);
+    if (need_refresh[CLUSTER_PMDA_REFRESH])
+	refresh_pmda_refresh(INDOM(REFRESH_INDOM));
 
-done:
     if (need_refresh_mtab)
 	pmdaDynamicMetricTable(pmda);
     container_close(cp, ns_fds);
@@ -6052,6 +6251,9 @@ linux_instance(pmInDom indom, int inst, char *name, pmInResult **result, pmdaExt
     case TTY_INDOM:
 	need_refresh[CLUSTER_TTY]++;
 	break;
+    case REFRESH_INDOM:
+	need_refresh[CLUSTER_PMDA_REFRESH]++;
+	break;
     /* no default label : pmdaInstance will pick up errors */
     }
 
@@ -8054,6 +8256,31 @@ linux_fetchCallBack(pmdaMetric *mdesc, unsigned int inst, pmAtomValue *atom)
 	}
 	break;
 
+    case CLUSTER_PMDA_REFRESH: {
+	pmdaRefreshStats stats;
+	char *name;
+
+	/* instance names are the cluster numbers of refreshed metrics */
+	if (pmdaCacheLookup(INDOM(REFRESH_INDOM), inst, &name, NULL) !=
+		PMDA_CACHE_ACTIVE ||
+	    pmdaRefreshGetStats(linux_refresh_cache, atoi(name), &stats) <= 0)
+	    return PM_ERR_INST;
+	switch (item) {
+	case 0:	/* pmda.refresh.hits */
+	    atom->ull = stats.hits;
+	    break;
+	case 1:	/* pmda.refresh.misses */
+	    atom->ull = stats.misses;
+	    break;
+	case 2:	/* pmda.refresh.time */
+	    atom->ull = stats.time;
+	    break;
+	default:
+	    return PM_ERR_PMID;
+	}
+	break;
+    }
+
     default: /* unknown cluster */
 	return PM_ERR_PMID;
     }
@@ -8174,6 +8401,37 @@ linux_fetch(int numpmid, pmID pmidlist[], pmResult **resp, pmdaExt *pmda)
     return pmdaFetch(numpmid, pmidlist, resp, pmda);
 }
 
+static int
+linux_store(pmResult *result, pmdaExt *pmda)
+{
+    linux_access_t	*access = access_ctx(pmda->e_context);
+    pmValueSet		*vsp;
+    pmAtomValue		av;
+    int			i, sts = 0;
+
+    for (i = 0; i < result->numpmid && sts == 0; i++) {
+	vsp = result->vset[i];
+	if (pmID_cluster(vsp->pmid) != CLUSTER_PMDA_REFRESH ||
+	    pmID_item(vsp->pmid) != 3)	/* pmda.refresh.window */
+	    sts = PM_ERR_PERMISSION;
+	else if (access == NULL || access->uid != 0 || !access->uid_flag)
+	    sts = PM_ERR_PERMISSION;
+	else if (vsp->numval != 1)
+	    sts = PM_ERR_INST;
+	else if ((sts = pmExtractValue(vsp->valfmt, &vsp->vlist[0],
+				PM_TYPE_32, &av, PM_TYPE_32)) >= 0) {
+	    if (av.l < 0)
+		sts = PM_ERR_BADSTORE;
+	    else {
+		refresh_window = av.l;
+		pmdaRefreshSetWindow(linux_refresh_cache, -1, refresh_window);
+		sts = 0;
+	    }
+	}
+    }
+    return sts;
+}
+
 static int
 linux_text(int ident, int type, char **buf, pmdaExt *pmda)
 {
@@ -8537,6 +8795,7 @@ linux_init(pmdaInterface *dp)
     dp->version.seven.children = linux_children;
     dp->version.seven.attribute = linux_attribute;
     dp->version.seven.label = linux_label;
+    dp->version.seven.store = linux_store;
     pmdaSetLabelCallBack(dp, linux_labelCallBack);
     pmdaSetEndContextCallBack(dp, linux_endContextCallBack);
     pmdaSetFetchCallBack(dp, linux_fetchCallBack);
@@ -8643,6 +8902,12 @@ linux_init(pmdaInterface *dp)
     pmdaCacheResize(INDOM(INTERRUPT_NAMES_INDOM), (1 << 10)-1);
     pmdaCacheOp(INDOM(SOFTIRQS_NAMES_INDOM), PMDA_CACHE_STRINGS);
     pmdaCacheResize(INDOM(SOFTIRQS_NAMES_INDOM), (1 << 10)-1);
+
+    /* optional sharing of refreshed values between client requests */
+    linux_refresh_cache = pmdaRefreshCreate(NUM_REFRESHES, refresh_window);
+    /* values that depend on the credentials of the client are not shared */
+    pmdaRefreshSetWindow(linux_refresh_cache, CLUSTER_SLAB, 0);
+    pmdaRefreshSetWindow(linux_refresh_cache, CLUSTER_TTY, 0);
 }
 
 pmLongOptions	longopts[] = {
@@ -8650,13 +8915,15 @@ pmLongOptions	longopts[] = {
     PMOPT_DEBUG,
     PMDAOPT_DOMAIN,
     PMDAOPT_LOGFILE,
+    { "refresh", 1, 'R', "MSEC", "share refreshed values across requests within MSEC milliseconds" },
+    { "workers", 1, 'W', "N", "refresh independent clusters concurrently using N threads" },
     PMDAOPT_USERNAME,
     PMOPT_HELP,
     PMDA_OPTIONS_END
 };
 
 pmdaOptions	opts = {
-    .short_options = "D:d:l:U:?",
+    .short_options = "D:d:l:R:U:W:?",
     .long_options = longopts,
 };
 
@@ -8668,7 +8935,8 @@ main(int argc, char **argv)
 {
     int			sep = pmPathSeparator();
     pmdaInterface	dispatch;
-    char		helppath[MAXPATHLEN];
+    char		helppath[MAXPATHLEN], *endnum;
+    int			c;
 
     _isDSO = 0;
     pmSetProgname(argv[0]);
@@ -8677,7 +8945,27 @@ main(int argc, char **argv)
 		pmGetConfig("PCP_PMDAS_DIR"), sep, sep);
     pmdaDaemon(&dispatch, PMDA_INTERFACE_7, pmGetProgname(), LINUX, "linux.log", helppath);
 
-    pmdaGetOptions(argc, argv, &opts, &dispatch);
+    while ((c = pmdaGetOptions(argc, argv, &opts, &dispatch)) != EOF) {
+	switch (c) {
+	case 'R':
+	    refresh_window = (int)strtol(opts.optarg, &endnum, 10);
+	    if (*endnum != '\0' || refresh_window < 0) {
+		fprintf(stderr, "%s: -R requires a non-negative number of milliseconds\n",
+			pmGetProgname());
+		opts.errors++;
+	    }
+	    break;
+	case 'W':
+	    refresh_workers = (int)strtol(opts.optarg, &endnum, 10);
+	    if (*endnum != '\0' || refresh_workers_init(refresh_workers) < 0) {
+		fprintf(stderr, "%s: -W requires a non-negative number of threads\n",
+			pmGetProgname());
+		opts.errors++;
+	    }
+	    refresh_workers = refresh_workers_count();
+	    break;
+	}
+    }
     if (opts.errors) {
 	pmdaUsageMessage(&opts);
 	exit(1);
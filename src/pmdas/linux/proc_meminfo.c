@@ -14,9 +14,9 @@
  * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
  * for more details.
  */
-#include <ctype.h>
 #include <sys/stat.h>
 #include "linux.h"
+#include "linux_fields.h"
 #include "proc_meminfo.h"
 
 static proc_meminfo_t moff;
@@ -82,46 +82,39 @@ static struct {
     { NULL, NULL }
 };
 
+static linux_fields_t meminfo_map = LINUX_FIELDS_INIT(meminfo_fields);
+static linux_buffer_t meminfo_buffer;
+
 #define MOFFSET(ii, pp) (int64_t *)((char *)pp + \
     (__psint_t)meminfo_fields[ii].offset - (__psint_t)&moff)
 
 int
 refresh_proc_meminfo(proc_meminfo_t *proc_meminfo)
 {
-    char	buf[1024];
-    char	*bufp;
+    char	*line, *cursor, *bufp;
     int64_t	*p;
-    int		i;
-    FILE	*fp;
+    int		i, sts;
 
     for (i = 0; meminfo_fields[i].field != NULL; i++) {
 	p = MOFFSET(i, proc_meminfo);
 	*p = -1; /* marked as "no value available" */
     }
 
-    if ((fp = linux_statsfile("/proc/meminfo", buf, sizeof(buf))) == NULL)
-	return -oserror();
+    if ((sts = linux_fields_setup(&meminfo_map)) < 0)
+	return sts;
+    if ((sts = linux_statsbuffer("/proc/meminfo", &meminfo_buffer)) < 0)
+	return sts;
 
-    while (fgets(buf, sizeof(buf), fp) != NULL) {
-	if ((bufp = strchr(buf, ':')) == NULL)
+    for (cursor = meminfo_buffer.data; (line = linux_buffer_line(&cursor)); ) {
+	if ((bufp = strchr(line, ':')) == NULL)
 	    continue;
-	*bufp = '\0';
-	for (i=0; meminfo_fields[i].field != NULL; i++) {
-	    if (strcmp(buf, meminfo_fields[i].field) != 0)
-		continue;
-	    p = MOFFSET(i, proc_meminfo);
-	    for (bufp++; *bufp; bufp++) {
-	    	if (isdigit((int)*bufp)) {
-		    sscanf(bufp, "%llu", (unsigned long long *)p);
-		    *p *= 1024; /* kbytes -> bytes */
-		    break;
-		}
-	    }
-	}
+	if ((i = linux_fields_lookup(&meminfo_map, line, bufp - line)) < 0)
+	    continue;
+	p = MOFFSET(i, proc_meminfo);
+	*p = linux_strtou64_skip(bufp + 1, NULL);
+	*p *= 1024; /* kbytes -> bytes */
     }
 
-    fclose(fp);
-
     /*
      * MemAvailable is only in 3.x or later kernels but we can calculate it
      * using other values, similar to upstream kernel commit 34e431b0ae.
@@ -136,19 +129,18 @@ refresh_proc_meminfo(proc_meminfo_t *proc_meminfo)
 
 	    int64_t pagecache;
 	    int64_t wmark_low = 0;
+	    size_t length;
 
 	    /*
 	     * sum for each zone->watermark[WMARK_LOW];
 	     */
-	    if ((fp = linux_statsfile("/proc/zoneinfo", buf, sizeof(buf))) != NULL) {
-		while (fgets(buf, sizeof(buf), fp) != NULL) {
-		    if ((bufp = strstr(buf, "low ")) != NULL) {
-			int64_t low;
-		    	if (sscanf(bufp+4, "%lld", (long long int *)&low) == 1)
-			    wmark_low += low;
-		    }
+	    if (linux_statsbuffer("/proc/zoneinfo", &meminfo_buffer) == 0) {
+		cursor = meminfo_buffer.data;
+		while ((line = linux_buffer_line(&cursor)) != NULL) {
+		    bufp = linux_token(line, &length);
+		    if (length == 3 && strncmp(bufp, "low", 3) == 0)
+			wmark_low += linux_strtou64(bufp + 3, NULL);
 		}
-		fclose(fp);
 		wmark_low <<= _pm_pageshift;
 	    }
 
@@ -12,6 +12,7 @@
  * for more details.
  */
 #include "linux.h"
+#include "linux_fields.h"
 #include "proc_net_netstat.h"
 
 extern proc_net_netstat_t	_pm_proc_net_netstat;
@@ -268,49 +269,33 @@ netstat_fields_t netstat_tcp_fields[] = {
     { .field = NULL, .offset = NULL }
 };
 
+static linux_fields_t netstat_ip_map = LINUX_FIELDS_INIT(netstat_ip_fields);
+static linux_fields_t netstat_tcp_map = LINUX_FIELDS_INIT(netstat_tcp_fields);
+static linux_buffer_t netstat_buffer;
+
 static void
-get_fields(netstat_fields_t *fields, char *header, char *buffer)
+get_fields(linux_fields_t *map, netstat_fields_t *fields, char *header, char *buffer)
 {
-    int i, j, count;
-    char *p, *indices[NETSTAT_MAX_COLUMNS];
-
-    /* first get pointers to each of the column headings */
-    strtok(header, " ");
-    for (i = 0; i < NETSTAT_MAX_COLUMNS; i++) {
-	if ((p = strtok(NULL, " \n")) == NULL)
-	    break;
-	indices[i] = p;
-    }
-    count = i;
+    char *name, *value;
+    size_t nlen, vlen;
+    int i;
 
     /*
-     * Extract values via back-referencing column headings.
-     * "i" is the last found index, which we use for a bit
-     * of optimisation for the (common) in-order maps case
-     * (where "in order" means in the order defined by the
-     * passed in "fields" table which typically matches the
-     * kernel - but may be out-of-order for older kernels).
+     * Extract values by pairing each column heading with the value
+     * in the same column, after the leading "TcpExt:" (etc) labels.
      */
-    strtok(buffer, " ");
-    for (i = j = 0; j < count && fields[i].field; j++, i++) {
-        if ((p = strtok(NULL, " \n")) == NULL)
-            break;
-        if (strcmp(fields[i].field, indices[j]) == 0)
-            *fields[i].offset = strtoull(p, NULL, 10);
-        else {
-            for (i = 0; fields[i].field; i++) {
-                if (strcmp(fields[i].field, indices[j]) != 0)
-                    continue;
-                *fields[i].offset = strtoull(p, NULL, 10);
-                break;
-            }
-	    if (fields[i].field == NULL) /* not found, ignore */
-		i = 0;
-	}
+    name = linux_token(header, &nlen);
+    value = linux_token(buffer, &vlen);
+    for (;;) {
+	name = linux_token(name + nlen, &nlen);
+	value = linux_token(value + vlen, &vlen);
+	if (nlen == 0 || vlen == 0)
+	    break;
+	if ((i = linux_fields_lookup(map, name, nlen)) >= 0)
+	    *fields[i].offset = linux_strtou64(value, NULL);
     }
 }
 
-
 #define NETSTAT_IP_OFFSET(ii, pp) (int64_t *)((char *)pp + \
     (__psint_t)netstat_ip_fields[ii].offset - (__psint_t)&_pm_proc_net_netstat.ip)
 #define NETSTAT_TCP_OFFSET(ii, pp) (int64_t *)((char *)pp + \
@@ -331,24 +316,25 @@ init_refresh_proc_net_netstat(proc_net_netstat_t *netstat)
 int
 refresh_proc_net_netstat(proc_net_netstat_t *netstat)
 {
-    /* Need a sufficiently large value to hold a full line */
-    char	buf[MAXPATHLEN];
-    char	header[2048];
-    FILE	*fp;
+    char	*header, *buf, *cursor;
+    int		sts;
 
     init_refresh_proc_net_netstat(netstat);
-    if ((fp = linux_statsfile("/proc/net/netstat", buf, sizeof(buf))) == NULL)
-	return -oserror();
-    while (fgets(header, sizeof(header), fp) != NULL) {
-	if (fgets(buf, sizeof(buf), fp) != NULL) {
+    if ((sts = linux_fields_setup(&netstat_ip_map)) < 0 ||
+	(sts = linux_fields_setup(&netstat_tcp_map)) < 0)
+	return sts;
+    if ((sts = linux_statsbuffer("/proc/net/netstat", &netstat_buffer)) < 0)
+	return sts;
+    cursor = netstat_buffer.data;
+    while ((header = linux_buffer_line(&cursor)) != NULL) {
+	if ((buf = linux_buffer_line(&cursor)) != NULL) {
 	    if (strncmp(buf, "IpExt:", 6) == 0)
-		get_fields(netstat_ip_fields, header, buf);
+		get_fields(&netstat_ip_map, netstat_ip_fields, header, buf);
 	    else if (strncmp(buf, "TcpExt:", 7) == 0)
-		get_fields(netstat_tcp_fields, header, buf);
-	    else
-		pmNotifyErr(LOG_ERR, "Unrecognised netstat row: %s\n", buf);
+		get_fields(&netstat_tcp_map, netstat_tcp_fields, header, buf);
+	    else if (pmDebugOptions.libpmda)
+		fprintf(stderr, "refresh_proc_net_netstat: skipped row: %.16s\n", buf);
 	}
     }
-    fclose(fp);
     return 0;
 }
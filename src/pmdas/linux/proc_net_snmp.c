@@ -13,6 +13,7 @@
  * for more details.
  */
 #include "linux.h"
+#include "linux_fields.h"
 #include "proc_net_snmp.h"
 
 extern proc_net_snmp_t	_pm_proc_net_snmp;
@@ -125,9 +126,9 @@ snmp_fields_t icmp_fields[] = {
 };
 
 snmp_fields_t icmpmsg_fields[] = {
-    { .field = "InType%u",
+    { .field = "InType",
      .offset = &_pm_proc_net_snmp.icmpmsg[_PM_SNMP_ICMPMSG_INTYPE] },
-    { .field = "OutType%u",
+    { .field = "OutType",
      .offset = &_pm_proc_net_snmp.icmpmsg[_PM_SNMP_ICMPMSG_OUTTYPE] },
     { .field = NULL, .offset = NULL }
 };
@@ -202,74 +203,63 @@ snmp_fields_t udplite_fields[] = {
     { .field = NULL, .offset = NULL }
 };
 
+static linux_fields_t ip_map = LINUX_FIELDS_INIT(ip_fields);
+static linux_fields_t icmp_map = LINUX_FIELDS_INIT(icmp_fields);
+static linux_fields_t tcp_map = LINUX_FIELDS_INIT(tcp_fields);
+static linux_fields_t udp_map = LINUX_FIELDS_INIT(udp_fields);
+static linux_fields_t udplite_map = LINUX_FIELDS_INIT(udplite_fields);
+static linux_buffer_t snmp_buffer;
+
 static void
-get_fields(snmp_fields_t *fields, char *header, char *buffer)
+get_fields(linux_fields_t *map, snmp_fields_t *fields, char *header, char *buffer)
 {
-    int i, j, count;
-    char *p, *indices[SNMP_MAX_COLUMNS];
-
-    /* first get pointers to each of the column headings */
-    strtok(header, " ");
-    for (i = 0; i < SNMP_MAX_COLUMNS; i++) {
-	if ((p = strtok(NULL, " \n")) == NULL)
-	    break;
-	indices[i] = p;
-    }
-    count = i;
+    char *name, *value;
+    size_t nlen, vlen;
+    int i;
 
     /*
-     * Extract values via back-referencing column headings.
-     * "i" is the last found index, which we use for a bit
-     * of optimisation for the (common) in-order maps case
-     * (where "in order" means in the order defined by the
-     * passed in "fields" table which typically matches the
-     * kernel - but may be out-of-order for older kernels).
+     * Extract values by pairing each column heading with the value
+     * in the same column, after the leading "Ip:" (etc) row labels.
      */
-    strtok(buffer, " ");
-    for (i = j = 0; j < count && fields[i].field; j++, i++) {
-        if ((p = strtok(NULL, " \n")) == NULL)
-            break;
-        if (strcmp(fields[i].field, indices[j]) == 0) {
-            *fields[i].offset = strtoull(p, NULL, 10);
-        } else {
-            for (i = 0; fields[i].field; i++) {
-                if (strcmp(fields[i].field, indices[j]) != 0)
-                    continue;
-                *fields[i].offset = strtoull(p, NULL, 10);
-                break;
-            }
-	    if (fields[i].field == NULL) /* not found, ignore */
-		i = 0;
-	}
+    name = linux_token(header, &nlen);
+    value = linux_token(buffer, &vlen);
+    for (;;) {
+	name = linux_token(name + nlen, &nlen);
+	value = linux_token(value + vlen, &vlen);
+	if (nlen == 0 || vlen == 0)
+	    break;
+	if ((i = linux_fields_lookup(map, name, nlen)) >= 0)
+	    *fields[i].offset = linux_strtou64(value, NULL);
     }
 }
 
+/*
+ * Column headings are a field name prefix and instance, e.g. "InType3"
+ */
 static void
 get_ordinal_fields(snmp_fields_t *fields, char *header, char *buffer,
                    unsigned limit)
 {
-    int i, j, count;
+    char *name, *value, *end;
+    size_t nlen, vlen, length;
     unsigned int inst;
-    char *p, *indices[SNMP_MAX_COLUMNS];
+    int i;
 
-    strtok(header, " ");
-    for (i = 0; i < SNMP_MAX_COLUMNS; i++) {
-	if ((p = strtok(NULL, " \n")) == NULL)
+    name = linux_token(header, &nlen);
+    value = linux_token(buffer, &vlen);
+    for (;;) {
+	name = linux_token(name + nlen, &nlen);
+	value = linux_token(value + vlen, &vlen);
+	if (nlen == 0 || vlen == 0)
 	    break;
-	indices[i] = p;
-    }
-    count = i;
-
-    strtok(buffer, " ");
-    for (j = 0; j < count; j++) {
-        if ((p = strtok(NULL, " \n")) == NULL)
-            break;
         for (i = 0; fields[i].field; i++) {
-            if (sscanf(indices[j], fields[i].field, &inst) != 1)
-                continue;
-            if (inst >= limit)
-                continue;
-            *(fields[i].offset + inst) = strtoull(p, NULL, 10);
+	    length = strlen(fields[i].field);
+	    if (nlen <= length || strncmp(name, fields[i].field, length) != 0)
+		continue;
+	    inst = linux_strtou64(name + length, &end);
+	    if (end != name + nlen || inst >= limit)
+		continue;
+            *(fields[i].offset + inst) = linux_strtou64(value, NULL);
             break;
 	}
     }
@@ -331,32 +321,37 @@ init_refresh_proc_net_snmp(proc_net_snmp_t *snmp)
 int
 refresh_proc_net_snmp(proc_net_snmp_t *snmp)
 {
-    char	buf[MAXPATHLEN];
-    char	header[1024];
-    FILE	*fp;
+    char	*header, *buf, *cursor;
+    int		sts;
 
     init_refresh_proc_net_snmp(snmp);
-    if ((fp = linux_statsfile("/proc/net/snmp", buf, sizeof(buf))) == NULL)
-	return -oserror();
-    while (fgets(header, sizeof(header), fp) != NULL) {
-	if (fgets(buf, sizeof(buf), fp) != NULL) {
+    if ((sts = linux_fields_setup(&ip_map)) < 0 ||
+	(sts = linux_fields_setup(&icmp_map)) < 0 ||
+	(sts = linux_fields_setup(&tcp_map)) < 0 ||
+	(sts = linux_fields_setup(&udp_map)) < 0 ||
+	(sts = linux_fields_setup(&udplite_map)) < 0)
+	return sts;
+    if ((sts = linux_statsbuffer("/proc/net/snmp", &snmp_buffer)) < 0)
+	return sts;
+    cursor = snmp_buffer.data;
+    while ((header = linux_buffer_line(&cursor)) != NULL) {
+	if ((buf = linux_buffer_line(&cursor)) != NULL) {
 	    if (strncmp(buf, "Ip:", 3) == 0)
-		get_fields(ip_fields, header, buf);
+		get_fields(&ip_map, ip_fields, header, buf);
 	    else if (strncmp(buf, "Icmp:", 5) == 0)
-		get_fields(icmp_fields, header, buf);
+		get_fields(&icmp_map, icmp_fields, header, buf);
 	    else if (strncmp(buf, "IcmpMsg:", 8) == 0)
 		get_ordinal_fields(icmpmsg_fields, header, buf,
                                    NR_ICMPMSG_COUNTERS);
 	    else if (strncmp(buf, "Tcp:", 4) == 0)
-		get_fields(tcp_fields, header, buf);
+		get_fields(&tcp_map, tcp_fields, header, buf);
 	    else if (strncmp(buf, "Udp:", 4) == 0)
-		get_fields(udp_fields, header, buf);
+		get_fields(&udp_map, udp_fields, header, buf);
 	    else if (strncmp(buf, "UdpLite:", 8) == 0)
-		get_fields(udplite_fields, header, buf);
+		get_fields(&udplite_map, udplite_fields, header, buf);
 	    else
-	    	fprintf(stderr, "Error: unrecognised snmp row: %s", buf);
+	    	fprintf(stderr, "Error: unrecognised snmp row: %s\n", buf);
 	}
     }
-    fclose(fp);
     return 0;
 }
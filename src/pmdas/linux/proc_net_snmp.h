@@ -13,7 +13,6 @@
  * for more details.
  */
 
-#define SNMP_MAX_COLUMNS	64	/* arbitrary upper bound */
 #define SNMP_PERLINE		16	/* see net/ipv4/proc.c */
 #define SNMP_MAX_ICMPMSG_TYPESTR 8	/* longest name for type */
 #define NR_ICMPMSG_COUNTERS     256     /* half of __ICMPMSG_MIB_MAX from kernel */
@@ -13,47 +13,47 @@
  */
 #include <ctype.h>
 #include "linux.h"
+#include "linux_fields.h"
 #include "proc_net_softnet.h"
 
+#define SOFTNET_COLUMNS	11
+
+static linux_buffer_t softnet_buffer;
+
+/*
+ * Extract the (hexadecimal) columns of one line, returning the number
+ * found - older kernels have fewer columns.
+ */
+static int
+softnet_columns(char *line, uint64_t *values)
+{
+    char	*end;
+    int		i;
+
+    for (i = 0; i < SOFTNET_COLUMNS; i++) {
+	values[i] = linux_strtox64(line, &end);
+	if (end == line || (*end != ' ' && *end != '\0'))
+	    break;
+	line = end;
+    }
+    return i;
+}
+
 int
 refresh_proc_net_softnet(proc_net_softnet_t *all)
 {
-    int		i, cpu;
-    char	buf[1024];
+    int		i, cpu, sts;
+    char	*line, *cursor;
     pmInDom	cpus = INDOM(CPU_INDOM);
     percpu_t	*cp;
     softnet_t	*snp;
-    uint64_t	filler;
-    FILE	*fp;
+    uint64_t	values[SOFTNET_COLUMNS];
     static int	logonce;
 
-    /* size > (11*7)+1 bytes, where 7 == strlen("%08llx "), and +1 for '\0' */
-    static char fmt[128] = { '\0' };
-
-    if (fmt[0] == '\0') {
-	/*
-	 * one trip initialization to decide the correct sscanf format
-	 * for a uint64_t data type .. needs to be
-	 * "%08lx %08lx %08lx %08lx %08lx %08lx %08lx %08lx %08lx %08lx %08lx"
-	 * or
-	 * "%08llx %08llx %08llx %08llx %08llx %08llx %08llx %08llx %08llx %08llx %08llx"
-	 */
-	fmt[0] = '\0';
-	if (strcmp(FMT_INT64, "lld") == 0) {
-	    for (i = 0; i < 11; i++)
-		strcat(fmt, "%08llx ");
-	}
-	else {
-	    for (i = 0; i < 11; i++)
-		strcat(fmt, "%08lx ");
-	}
-	/* chop off last ' ' */
-	fmt[strlen(fmt)] = '\0';
-    }
-
     memset(all, 0, sizeof(*all));
-    if ((fp = linux_statsfile("/proc/net/softnet_stat", buf, sizeof(buf))) == NULL)
-	return -oserror();
+    if ((sts = linux_statsbuffer("/proc/net/softnet_stat", &softnet_buffer)) < 0)
+	return sts;
+    cursor = softnet_buffer.data;
 
     /* walk over the online CPUs (only) - refreshed via /proc/stat already */
     for (pmdaCacheOp(cpus, PMDA_CACHE_WALK_REWIND);;) {
@@ -66,15 +66,20 @@ refresh_proc_net_softnet(proc_net_softnet_t *all)
 	    fprintf(stderr, "refresh_proc_net_softnet: out of memory, cpu %d\n", cpu);
 	    break;
 	}
-	if (fgets(buf, sizeof(buf), fp) == NULL) {
+	if ((line = linux_buffer_line(&cursor)) == NULL) {
 	    fprintf(stderr, "refresh_proc_net_softnet: warning: insufficient data, cpu %d\n", cpu);
 	    break;
 	}
 	snp = cp->softnet;
 	memset(snp, 0, sizeof(*snp));
-	i = sscanf(buf, fmt, &snp->processed, &snp->dropped, &snp->time_squeeze,
-		&filler, &filler, &filler, &filler, &filler,
-		&snp->cpu_collision, &snp->received_rps, &snp->flow_limit_count);
+	memset(values, 0, sizeof(values));
+	i = softnet_columns(line, values);
+	snp->processed = values[0];
+	snp->dropped = values[1];
+	snp->time_squeeze = values[2];
+	snp->cpu_collision = values[8];
+	snp->received_rps = values[9];
+	snp->flow_limit_count = values[10];
 
 	/* update aggregate CPU stats as well */
 	all->processed += snp->processed;
@@ -100,6 +105,5 @@ refresh_proc_net_softnet(proc_net_softnet_t *all)
     if (logonce)
 	logonce++;	/* remember for next time, limit logging */
 
-    fclose(fp);
     return 0;
 }
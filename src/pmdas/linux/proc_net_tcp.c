@@ -1,5 +1,5 @@
 /*
- * Copyright (c) 2014,2018 Red Hat.
+ * Copyright (c) 2014,2018-2019 Red Hat.
  * Copyright (c) 1999,2004 Silicon Graphics, Inc.  All Rights Reserved.
  * This code contributed by Michal Kara (lemming@arthur.plbohnice.cz)
  * 
@@ -15,10 +15,40 @@
  */
 #include <ctype.h>
 #include "linux.h"
+#include "sock_diag.h"
 #include "proc_net_tcp.h"
 
+static sockdiag_source_t tcp_netlink = { .name = "tcp" };
+static sockdiag_source_t tcp6_netlink = { .name = "tcp6" };
+
+#ifdef HAVE_LINUX_SOCK_DIAG_H
+static void
+tcpconn_state(const void *record, void *arg)
+{
+    const struct inet_diag_msg	*msg = record;
+    tcpconn_stats_t		*conn = arg;
+
+    if (msg->idiag_state < _PM_TCP_LAST)
+	conn->stat[msg->idiag_state]++;
+}
+
 static int
-refresh_tcpconn_stats(tcpconn_stats_t *conn, const char *path)
+netlink_tcpconn_stats(tcpconn_stats_t *conn, int family)
+{
+    struct inet_diag_req_v2	req;
+
+    memset(&req, 0, sizeof(req));
+    req.sdiag_family = family;
+    req.sdiag_protocol = IPPROTO_TCP;
+    req.idiag_states = ~0U;	/* all states, no extensions */
+    return sockdiag_dump(&req, sizeof(req), sizeof(struct inet_diag_msg),
+			tcpconn_state, conn);
+}
+#endif
+
+static int
+refresh_tcpconn_stats(tcpconn_stats_t *conn, const char *path,
+		int family, sockdiag_source_t *netlink)
 {
     char		buf[BUFSIZ]; 
     char		*q, *p = buf;
@@ -29,6 +59,17 @@ refresh_tcpconn_stats(tcpconn_stats_t *conn, const char *path)
 
     memset(conn, 0, sizeof(*conn));
 
+#ifdef HAVE_LINUX_SOCK_DIAG_H
+    if (sockdiag_enabled(netlink)) {
+	int	sts;
+
+	if ((sts = netlink_tcpconn_stats(conn, family)) >= 0)
+	    return 0;
+	sockdiag_disable(netlink, sts);
+	memset(conn, 0, sizeof(*conn));
+    }
+#endif
+
     if ((fp = linux_statsfile(path, buf, sizeof(buf))) == NULL)
 	return -oserror();
 
@@ -59,11 +100,13 @@ refresh_tcpconn_stats(tcpconn_stats_t *conn, const char *path)
 int
 refresh_proc_net_tcp(proc_net_tcp_t *proc_net_tcp)
 {
-    return refresh_tcpconn_stats(proc_net_tcp, "/proc/net/tcp");
+    return refresh_tcpconn_stats(proc_net_tcp, "/proc/net/tcp",
+			AF_INET, &tcp_netlink);
 }
 
 int
 refresh_proc_net_tcp6(proc_net_tcp6_t *proc_net_tcp6)
 {
-    return refresh_tcpconn_stats(proc_net_tcp6, "/proc/net/tcp6");
+    return refresh_tcpconn_stats(proc_net_tcp6, "/proc/net/tcp6",
+			AF_INET6, &tcp6_netlink);
 }
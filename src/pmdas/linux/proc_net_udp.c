@@ -1,5 +1,5 @@
 /*
- * Copyright (c) 2014,2018 Red Hat.
+ * Copyright (c) 2014,2018-2019 Red Hat.
  *
  * This program is free software; you can redistribute it and/or modify it
  * under the terms of the GNU General Public License as published by the
@@ -13,10 +13,42 @@
  */
 #include <ctype.h>
 #include "linux.h"
+#include "sock_diag.h"
 #include "proc_net_udp.h"
 
+static sockdiag_source_t udp_netlink = { .name = "udp" };
+static sockdiag_source_t udp6_netlink = { .name = "udp6" };
+
+#ifdef HAVE_LINUX_SOCK_DIAG_H
+static void
+udpconn_state(const void *record, void *arg)
+{
+    const struct inet_diag_msg	*msg = record;
+    udpconn_stats_t		*conn = arg;
+
+    if (msg->idiag_state == 0x07)
+	conn->listen++;
+    else if (msg->idiag_state == 0x01)
+	conn->established++;
+}
+
 static int
-refresh_udpconn_stats(udpconn_stats_t *conn, const char *path)
+netlink_udpconn_stats(udpconn_stats_t *conn, int family)
+{
+    struct inet_diag_req_v2	req;
+
+    memset(&req, 0, sizeof(req));
+    req.sdiag_family = family;
+    req.sdiag_protocol = IPPROTO_UDP;
+    req.idiag_states = (1 << 0x07) | (1 << 0x01);
+    return sockdiag_dump(&req, sizeof(req), sizeof(struct inet_diag_msg),
+			udpconn_state, conn);
+}
+#endif
+
+static int
+refresh_udpconn_stats(udpconn_stats_t *conn, const char *path,
+		int family, sockdiag_source_t *netlink)
 {
     char		buf[BUFSIZ]; 
     char		*q, *p = buf;
@@ -27,6 +59,17 @@ refresh_udpconn_stats(udpconn_stats_t *conn, const char *path)
 
     memset(conn, 0, sizeof(*conn));
 
+#ifdef HAVE_LINUX_SOCK_DIAG_H
+    if (sockdiag_enabled(netlink)) {
+	int	sts;
+
+	if ((sts = netlink_udpconn_stats(conn, family)) >= 0)
+	    return 0;
+	sockdiag_disable(netlink, sts);
+	memset(conn, 0, sizeof(*conn));
+    }
+#endif
+
     if ((fp = linux_statsfile(path, buf, sizeof(buf))) == NULL)
 	return -oserror();
 
@@ -61,11 +104,13 @@ refresh_udpconn_stats(udpconn_stats_t *conn, const char *path)
 int
 refresh_proc_net_udp(proc_net_udp_t *proc_net_udp)
 {
-    return refresh_udpconn_stats(proc_net_udp, "/proc/net/udp");
+    return refresh_udpconn_stats(proc_net_udp, "/proc/net/udp",
+			AF_INET, &udp_netlink);
 }
 
 int
 refresh_proc_net_udp6(proc_net_udp6_t *proc_net_udp6)
 {
-    return refresh_udpconn_stats(proc_net_udp6, "/proc/net/udp6");
+    return refresh_udpconn_stats(proc_net_udp6, "/proc/net/udp6",
+			AF_INET6, &udp6_netlink);
 }
@@ -1,5 +1,5 @@
 /*
- * Copyright (c) 2018 Red Hat.
+ * Copyright (c) 2018-2019 Red Hat.
  * 
  * This program is free software; you can redistribute it and/or modify it
  * under the terms of the GNU General Public License as published by the
@@ -12,8 +12,48 @@
  * for more details.
  */
 #include "linux.h"
+#include "sock_diag.h"
 #include "proc_net_unix.h"
 
+static sockdiag_source_t unix_netlink = { .name = "unix" };
+
+#ifdef HAVE_LINUX_SOCK_DIAG_H
+/*
+ * The /proc/net/unix "St" column shows stream sockets as connected
+ * (0x03) when established, else unconnected (0x01) - which is what
+ * the listen count has always been based on, so the same split is
+ * made here from the underlying socket state.
+ */
+static void
+unix_state(const void *record, void *arg)
+{
+    const struct unix_diag_msg	*msg = record;
+    proc_net_unix_t		*up = arg;
+
+    if (msg->udiag_type == SOCK_DGRAM)
+	up->datagram_count++;
+    else if (msg->udiag_type == SOCK_STREAM) {
+	if (msg->udiag_state == 0x01)	/* TCP_ESTABLISHED */
+	    up->stream_established++;
+	else
+	    up->stream_listen++;
+	up->stream_count++;
+    }
+}
+
+static int
+netlink_unix_stats(proc_net_unix_t *up)
+{
+    struct unix_diag_req	req;
+
+    memset(&req, 0, sizeof(req));
+    req.sdiag_family = AF_UNIX;
+    req.udiag_states = ~0U;	/* all states, no attributes */
+    return sockdiag_dump(&req, sizeof(req), sizeof(struct unix_diag_msg),
+			unix_state, up);
+}
+#endif
+
 int
 refresh_proc_net_unix(proc_net_unix_t *up)
 {
@@ -26,13 +66,24 @@ refresh_proc_net_unix(proc_net_unix_t *up)
 
     memset(up, 0, sizeof(*up));
 
+#ifdef HAVE_LINUX_SOCK_DIAG_H
+    if (sockdiag_enabled(&unix_netlink)) {
+	int	sts;
+
+	if ((sts = netlink_unix_stats(up)) >= 0)
+	    return 0;
+	sockdiag_disable(&unix_netlink, sts);
+	memset(up, 0, sizeof(*up));
+    }
+#endif
+
     if ((fp = linux_statsfile("/proc/net/unix", buf, sizeof(buf))) == NULL)
 	return -oserror();
 
     for (buf[0]='\0';;) {
 	q = strchrnul(p, '\n');
 	if (*q == '\n') {
-	    if (sscanf(p, "%*s %*s %*s %*s %*s %x %x", &type, &state) == 2) {
+	    if (sscanf(p, "%*s %*s %*s %*s %x %x", &type, &state) == 2) {
 		if (type == 0x0002)
 		    up->datagram_count++;
 		else if (type == 0x0001) {
@@ -15,8 +15,8 @@
  * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
  * for more details.
  */
-#include <ctype.h>
 #include "linux.h"
+#include "linux_fields.h"
 #include "proc_vmstat.h"
 
 static struct {
@@ -336,6 +336,9 @@ static struct {
     { .field = NULL, .offset = NULL }
 };
 
+static linux_fields_t vmstat_map = LINUX_FIELDS_INIT(vmstat_fields);
+static linux_buffer_t vmstat_buffer;
+
 #define VMSTAT_OFFSET(ii, pp) (int64_t *)((char *)pp + \
     (__psint_t)vmstat_fields[ii].offset - (__psint_t)&_pm_proc_vmstat)
 
@@ -361,39 +364,30 @@ proc_vmstat_init(void)
 int
 refresh_proc_vmstat(proc_vmstat_t *proc_vmstat)
 {
-    char	buf[1024];
-    char	*bufp;
+    char	*line, *cursor, *key;
+    size_t	length;
     int64_t	*p;
-    int		i;
-    FILE	*fp;
+    int		i, sts;
 
     for (i = 0; vmstat_fields[i].field != NULL; i++) {
 	p = VMSTAT_OFFSET(i, proc_vmstat);
 	*p = -1; /* marked as "no value available" */
     }
 
-    if ((fp = linux_statsfile("/proc/vmstat", buf, sizeof(buf))) == NULL)
-    	return -oserror();
+    if ((sts = linux_fields_setup(&vmstat_map)) < 0)
+	return sts;
+    if ((sts = linux_statsbuffer("/proc/vmstat", &vmstat_buffer)) < 0)
+	return sts;
 
     _pm_have_proc_vmstat = 1;
 
-    while (fgets(buf, sizeof(buf), fp) != NULL) {
-	if ((bufp = strchr(buf, ' ')) == NULL)
+    for (cursor = vmstat_buffer.data; (line = linux_buffer_line(&cursor)); ) {
+	key = linux_token(line, &length);
+	if ((i = linux_fields_lookup(&vmstat_map, key, length)) < 0)
 	    continue;
-	*bufp = '\0';
-	for (i = 0; vmstat_fields[i].field != NULL; i++) {
-	    if (strcmp(buf, vmstat_fields[i].field) != 0)
-		continue;
-	    p = VMSTAT_OFFSET(i, proc_vmstat);
-	    for (bufp++; *bufp; bufp++) {
-	    	if (isdigit((int)*bufp)) {
-		    sscanf(bufp, "%llu", (unsigned long long *)p);
-		    break;
-		}
-	    }
-	}
+	p = VMSTAT_OFFSET(i, proc_vmstat);
+	*p = linux_strtou64_skip(key + length, NULL);
     }
-    fclose(fp);
 
     if (proc_vmstat->nr_slab == -1)	/* split apart in 2.6.18 */
 	proc_vmstat->nr_slab = proc_vmstat->nr_slab_reclaimable +
@@ -15,10 +15,72 @@
  * for more details.
  */
 #include "linux.h"
+#include "linux_fields.h"
 #include "proc_zoneinfo.h"
 
+/* extra (non-value) field index for the lowmem reserve list */
+#define ZONE_PROTECTION	ZONE_VALUES
+
+static struct {
+    const char	*field;
+    int		index;
+} zoneinfo_fields[] = {
+    { "pages",			ZONE_FREE }, /* "pages free" */
+    { "min",			ZONE_MIN },
+    { "low",			ZONE_LOW },
+    { "high",			ZONE_HIGH },
+    { "scanned",		ZONE_SCANNED },
+    { "node_scanned",		ZONE_SCANNED },
+    { "spanned",		ZONE_SPANNED },
+    { "present",		ZONE_PRESENT },
+    { "managed",		ZONE_MANAGED },
+    { "nr_free_pages",		ZONE_NR_FREE_PAGES },
+    { "nr_alloc_batch",		ZONE_NR_ALLOC_BATCH },
+    { "nr_inactive_anon",	ZONE_NR_INACTIVE_ANON },
+    { "nr_active_anon",		ZONE_NR_ACTIVE_ANON },
+    { "nr_inactive_file",	ZONE_NR_INACTIVE_FILE },
+    { "nr_active_file",		ZONE_NR_ACTIVE_FILE },
+    { "nr_unevictable",		ZONE_NR_UNEVICTABLE },
+    { "nr_mlock",		ZONE_NR_MLOCK },
+    { "nr_anon_pages",		ZONE_NR_ANON_PAGES },
+    { "nr_mapped",		ZONE_NR_MAPPED },
+    { "nr_file_pages",		ZONE_NR_FILE_PAGES },
+    { "nr_dirty",		ZONE_NR_DIRTY },
+    { "nr_writeback",		ZONE_NR_WRITEBACK },
+    { "nr_slab_reclaimable",	ZONE_NR_SLAB_RECLAIMABLE },
+    { "nr_slab_unreclaimable",	ZONE_NR_SLAB_UNRECLAIMABLE },
+    { "nr_page_table_pages",	ZONE_NR_PAGE_TABLE_PAGES },
+    { "nr_kernel_stack",	ZONE_NR_KERNEL_STACK },
+    { "nr_unstable",		ZONE_NR_UNSTABLE },
+    { "nr_bounce",		ZONE_NR_BOUNCE },
+    { "nr_vmscan_write",	ZONE_NR_VMSCAN_WRITE },
+    { "nr_vmscan_immediate_reclaim",	ZONE_NR_VMSCAN_IMMEDIATE_RECLAIM },
+    { "nr_writeback_temp",	ZONE_NR_WRITEBACK_TEMP },
+    { "nr_isolated_anon",	ZONE_NR_ISOLATED_ANON },
+    { "nr_isolated_file",	ZONE_NR_ISOLATED_FILE },
+    { "nr_shmem",		ZONE_NR_SHMEM },
+    { "nr_dirtied",		ZONE_NR_DIRTIED },
+    { "nr_written",		ZONE_NR_WRITTEN },
+    { "numa_hit",		ZONE_NUMA_HIT },
+    { "numa_miss",		ZONE_NUMA_MISS },
+    { "numa_foreign",		ZONE_NUMA_FOREIGN },
+    { "numa_interleave",	ZONE_NUMA_INTERLEAVE },
+    { "numa_local",		ZONE_NUMA_LOCAL },
+    { "numa_other",		ZONE_NUMA_OTHER },
+    { "workingset_refault",	ZONE_WORKINGSET_REFAULT },
+    { "workingset_activate",	ZONE_WORKINGSET_ACTIVATE },
+    { "workingset_nodereclaim",	ZONE_WORKINGSET_NODERECLAIM },
+    { "nr_anon_transparent_hugepages",	ZONE_NR_ANON_TRANSPARENT_HUGEPAGES },
+    { "nr_free_cma",		ZONE_NR_FREE_CMA },
+    { "protection:",		ZONE_PROTECTION },
+    { NULL }
+};
+
+static linux_fields_t zoneinfo_map = LINUX_FIELDS_INIT(zoneinfo_fields);
+static linux_buffer_t zoneinfo_buffer;
+
 static void
-extract_zone_protection(const char *bp, int node, const char *zonetype,
+extract_zone_protection(char *bp, int node, const char *zonetype,
 			const char *instname, pmInDom protected)
 {
     zoneprot_entry_t *prot;
@@ -28,7 +90,7 @@ extract_zone_protection(const char *bp, int node, const char *zonetype,
     int sts;
 
     for (lowmem = 0;; lowmem++) {
-	value = (strtoul(bp, &endp, 10) << _pm_pageshift) / 1024;
+	value = (linux_strtou64(bp, &endp) << _pm_pageshift) / 1024;
 	pmsprintf(prot_name, sizeof(prot_name),
 		 "%s::lowmem_reserved%u", instname, lowmem);
 	/* replace existing value if one exists, else need space for new one */
@@ -48,18 +110,53 @@ extract_zone_protection(const char *bp, int node, const char *zonetype,
     }
 }
 
+/*
+ * Parse a "Node 0, zone   Normal" section heading
+ */
+static int
+extract_zone_heading(char *bp, int *node, char *zonetype)
+{
+    size_t length;
+
+    bp = linux_token(bp, &length);
+    if (length != 4 || strncmp(bp, "Node", 4) != 0)
+	return 0;
+    *node = linux_strtou64(bp + length, &bp);
+    if (*bp++ != ',')
+	return 0;
+    bp = linux_token(bp, &length);
+    if (length != 4 || strncmp(bp, "zone", 4) != 0)
+	return 0;
+    bp = linux_token(bp + length, &length);
+    if (length == 0)
+	return 0;
+    if (length >= ZONE_NAMELEN)
+	length = ZONE_NAMELEN - 1;
+    memcpy(zonetype, bp, length);
+    zonetype[length] = '\0';
+    return 1;
+}
+
+static void
+store_zone(pmInDom indom, const char *instname, zoneinfo_entry_t *info)
+{
+    pmdaCacheStore(indom, PMDA_CACHE_ADD, instname, (void *)info);
+
+    if (pmDebugOptions.libpmda)
+	fprintf(stderr, "refresh_proc_zoneinfo: instance %s\n", instname);
+}
+
 int
 refresh_proc_zoneinfo(pmInDom indom, pmInDom protection_indom)
 {
-    int node, values;
-    zoneinfo_entry_t *info;
-    unsigned long long value;
+    int node = 0, i, sts;
+    zoneinfo_entry_t *info = NULL;
     char zonetype[ZONE_NAMELEN];
     char instname[64];
-    char buf[BUFSIZ];
+    char *line, *cursor, *key;
+    size_t length;
     static int setup;
     int changed = 0;
-    FILE *fp;
 
     if (!setup) {
 	pmdaCacheOp(indom, PMDA_CACHE_LOAD);
@@ -67,272 +164,55 @@ refresh_proc_zoneinfo(pmInDom indom, pmInDom protection_indom)
     }
 
     pmdaCacheOp(indom, PMDA_CACHE_INACTIVE);
-    if ((fp = linux_statsfile("/proc/zoneinfo", buf, sizeof(buf))) == NULL)
-	return -oserror();
+    if ((sts = linux_fields_setup(&zoneinfo_map)) < 0)
+	return sts;
+    if ((sts = linux_statsbuffer("/proc/zoneinfo", &zoneinfo_buffer)) < 0)
+	return sts;
 
-    while (fgets(buf, sizeof(buf), fp) != NULL) {
-	if (strncmp(buf, "Node", 4) != 0)
-	    continue;
-	if (sscanf(buf, "Node %d, zone   %s", &node, zonetype) != 2)
-	    continue;
-	pmsprintf(instname, sizeof(instname), "%s::node%u", zonetype, node);
-	values = 0;
-	info = NULL;
-	if (pmdaCacheLookupName(indom, instname, NULL, (void **)&info) < 0 ||
-	    info == NULL) {
-	    /* not found: allocate and add a new entry */
-	    info = (zoneinfo_entry_t *)calloc(1, sizeof(zoneinfo_entry_t));
-	    changed = 1;
-	}
-	info->node = node;
-	pmsprintf(info->zone, ZONE_NAMELEN, "%s", zonetype);
-	/* inner loop to extract all values for this node */
-	while (values < ZONE_VALUES + 1 && fgets(buf, sizeof(buf), fp) != NULL) {
-	 
-   if ((sscanf(buf, "  pages free %llu", &value)) == 1) {
-		info->values[ZONE_FREE] = (value << _pm_pageshift) / 1024;
-		values++;
-		continue;
-	    }
-	    else if ((sscanf(buf, "        min %llu", &value)) == 1) {
-		info->values[ZONE_MIN] = (value << _pm_pageshift) / 1024;
-		values++;
+    for (cursor = zoneinfo_buffer.data; (line = linux_buffer_line(&cursor)); ) {
+	if (strncmp(line, "Node", 4) == 0) {
+	    /* each zone section extends up to the next heading */
+	    if (info)
+		store_zone(indom, instname, info);
+	    info = NULL;
+	    if (!extract_zone_heading(line, &node, zonetype))
 		continue;
+	    pmsprintf(instname, sizeof(instname), "%s::node%u", zonetype, node);
+	    if (pmdaCacheLookupName(indom, instname, NULL, (void **)&info) < 0 ||
+		info == NULL) {
+		/* not found: allocate and add a new entry */
+		if ((info = (zoneinfo_entry_t *)calloc(1, sizeof(zoneinfo_entry_t))) == NULL)
+		    continue;
+		changed = 1;
 	    }
-	    else if ((sscanf(buf, "        low %llu", &value)) == 1) {
-		info->values[ZONE_LOW] = (value << _pm_pageshift) / 1024;
-		values++;
-		continue;
-	    }
-	    else if ((sscanf(buf, "        high %llu", &value)) == 1) {
-		info->values[ZONE_HIGH] = (value << _pm_pageshift) / 1024;
-		values++;
-		continue;
-	    }
-	    else if ((sscanf(buf, "        scanned %llu", &value)) == 1 ||
-	             (sscanf(buf, "   node_scanned %llu", &value)) == 1) {
-		info->values[ZONE_SCANNED] = (value << _pm_pageshift) / 1024;
-		values++;
-		continue;
-	    }
-	    else if ((sscanf(buf, "        spanned %llu", &value)) == 1) {
-		info->values[ZONE_SPANNED] = (value << _pm_pageshift) / 1024;
-		values++;
-		continue;
-	    }
-	    else if ((sscanf(buf, "        present %llu", &value)) == 1) {
-		info->values[ZONE_PRESENT] = (value << _pm_pageshift) / 1024;
-		values++;
-		continue;
-	    }
-	    else if ((sscanf(buf, "        managed %llu", &value)) == 1) {
-		info->values[ZONE_MANAGED] = (value << _pm_pageshift) / 1024;
-		values++;
-		continue;
-	    }
-            else if ((sscanf(buf, "    nr_free_pages %llu", &value)) == 1) {
-                info->values[ZONE_NR_FREE_PAGES] = (value << _pm_pageshift) / 1024;
-                values++;
-                continue;
-            }
-            else if ((sscanf(buf, "    nr_alloc_batch %llu", &value)) == 1) {
-                info->values[ZONE_NR_ALLOC_BATCH] = (value << _pm_pageshift) / 1024;
-                values++;
-                continue;
-            }
-            else if ((sscanf(buf, "    nr_inactive_anon %llu", &value)) == 1) {
-                info->values[ZONE_NR_INACTIVE_ANON] = (value << _pm_pageshift) / 1024;
-                values++;
-                continue;
-            }
-            else if ((sscanf(buf, "    nr_active_anon %llu", &value)) == 1) {
-                info->values[ZONE_NR_ACTIVE_ANON] = (value << _pm_pageshift) / 1024;
-                values++;
-                continue;
-            }
-            else if ((sscanf(buf, "    nr_inactive_file %llu", &value)) == 1) {
-                info->values[ZONE_NR_INACTIVE_FILE] = (value << _pm_pageshift) / 1024;
-                values++;
-                continue;
-            }
-            else if ((sscanf(buf, "    nr_active_file %llu", &value)) == 1) {
-                info->values[ZONE_NR_ACTIVE_FILE] = (value << _pm_pageshift) / 1024;
-                values++;
-                continue;
-            }
-            else if ((sscanf(buf, "    nr_unevictable %llu", &value)) == 1) {
-                info->values[ZONE_NR_UNEVICTABLE] = (value << _pm_pageshift) / 1024;
-                values++;
-                continue;
-            }
-            else if ((sscanf(buf, "    nr_mlock %llu", &value)) == 1) {
-                info->values[ZONE_NR_MLOCK] = (value << _pm_pageshift) / 1024;
-                values++;
-                continue;
-            }
-            else if ((sscanf(buf, "    nr_anon_pages %llu", &value)) == 1) {
-                info->values[ZONE_NR_ANON_PAGES] = (value << _pm_pageshift) / 1024;
-                values++;
-                continue;
-            }
-            else if ((sscanf(buf, "    nr_mapped %llu", &value)) == 1) {
-                info->values[ZONE_NR_MAPPED] = (value << _pm_pageshift) / 1024;
-                values++;
-                continue;
-            }
-            else if ((sscanf(buf, "    nr_file_pages %llu", &value)) == 1) {
-                info->values[ZONE_NR_FILE_PAGES] = (value << _pm_pageshift) / 1024;
-                values++;
-                continue;
-            }
-            else if ((sscanf(buf, "    nr_dirty %llu", &value)) == 1) {
-                info->values[ZONE_NR_DIRTY] = (value << _pm_pageshift) / 1024;
-                values++;
-                continue;
-            }
-            else if ((sscanf(buf, "    nr_writeback %llu", &value)) == 1) {
-                info->values[ZONE_NR_WRITEBACK] = (value << _pm_pageshift) / 1024;
-                values++;
-                continue;
-            }
-            else if ((sscanf(buf, "    nr_slab_reclaimable %llu", &value)) == 1) {
-                info->values[ZONE_NR_SLAB_RECLAIMABLE] = (value << _pm_pageshift) / 1024;
-                values++;
-                continue;
-            }
-            else if ((sscanf(buf, "    nr_slab_unreclaimable %llu", &value)) == 1) {
-                info->values[ZONE_NR_SLAB_UNRECLAIMABLE] = (value << _pm_pageshift) / 1024;
-                values++;
-                continue;
-            }
-            else if ((sscanf(buf, "    nr_page_table_pages %llu", &value)) == 1) {
-                info->values[ZONE_NR_PAGE_TABLE_PAGES] = (value << _pm_pageshift) / 1024;
-                values++;
-                continue;
-            }
-            else if ((sscanf(buf, "    nr_kernel_stack %llu", &value)) == 1) {
-                info->values[ZONE_NR_KERNEL_STACK] = (value << _pm_pageshift) / 1024;
-                values++;
-                continue;
-            }
-            else if ((sscanf(buf, "    nr_unstable %llu", &value)) == 1) {
-                info->values[ZONE_NR_UNSTABLE] = (value << _pm_pageshift) / 1024;
-                values++;
-                continue;
-            }
-            else if ((sscanf(buf, "    nr_bounce %llu", &value)) == 1) {
-                info->values[ZONE_NR_BOUNCE] = (value << _pm_pageshift) / 1024;
-                values++;
-                continue;
-            }
-            else if ((sscanf(buf, "    nr_vmscan_write %llu", &value)) == 1) {
-                info->values[ZONE_NR_VMSCAN_WRITE] = (value << _pm_pageshift) / 1024;
-                values++;
-                continue;
-            }
-            else if ((sscanf(buf, "    nr_vmscan_immediate_reclaim %llu", &value)) == 1) {
-                info->values[ZONE_NR_VMSCAN_IMMEDIATE_RECLAIM] = (value << _pm_pageshift) / 1024;
-                values++;
-                continue;
-            }
-            else if ((sscanf(buf, "    nr_writeback_temp %llu", &value)) == 1) {
-                info->values[ZONE_NR_WRITEBACK_TEMP] = (value << _pm_pageshift) / 1024;
-                values++;
-                continue;
-            }
-            else if ((sscanf(buf, "    nr_isolated_anon %llu", &value)) == 1) {
-                info->values[ZONE_NR_ISOLATED_ANON] = (value << _pm_pageshift) / 1024;
-                values++;
-                continue;
-            }
-            else if ((sscanf(buf, "    nr_isolated_file %llu", &value)) == 1) {
-                info->values[ZONE_NR_ISOLATED_FILE] = (value << _pm_pageshift) / 1024;
-                values++;
-                continue;
-            }
-            else if ((sscanf(buf, "    nr_shmem %llu", &value)) == 1) {
-                info->values[ZONE_NR_SHMEM] = (value << _pm_pageshift) / 1024;
-                values++;
-                continue;
-            }
-            else if ((sscanf(buf, "    nr_dirtied %llu", &value)) == 1) {
-                info->values[ZONE_NR_DIRTIED] = (value << _pm_pageshift) / 1024;
-                values++;
-                continue;
-            }
-            else if ((sscanf(buf, "    nr_written %llu", &value)) == 1) {
-                info->values[ZONE_NR_WRITTEN] = (value << _pm_pageshift) / 1024;
-                values++;
-                continue;
-            }
-            else if ((sscanf(buf, "    numa_hit %llu", &value)) == 1) {
-                info->values[ZONE_NUMA_HIT] = (value << _pm_pageshift) / 1024;
-                values++;
-                continue;
-            }
-            else if ((sscanf(buf, "    numa_miss %llu", &value)) == 1) {
-                info->values[ZONE_NUMA_MISS] = (value << _pm_pageshift) / 1024;
-                values++;
-                continue;
-            }
-            else if ((sscanf(buf, "    numa_foreign %llu", &value)) == 1) {
-                info->values[ZONE_NUMA_FOREIGN] = (value << _pm_pageshift) / 1024;
-                values++;
-                continue;
-            }
-            else if ((sscanf(buf, "    numa_interleave %llu", &value)) == 1) {
-                info->values[ZONE_NUMA_INTERLEAVE] = (value << _pm_pageshift) / 1024;
-                values++;
-                continue;
-            }
-            else if ((sscanf(buf, "    numa_local %llu", &value)) == 1) {
-                info->values[ZONE_NUMA_LOCAL] = (value << _pm_pageshift) / 1024;
-                values++;
-                continue;
-            }
-            else if ((sscanf(buf, "    numa_other %llu", &value)) == 1) {
-                info->values[ZONE_NUMA_OTHER] = (value << _pm_pageshift) / 1024;
-                values++;
-                continue;
-            }
-            else if ((sscanf(buf, "    workingset_refault %llu", &value)) == 1) {
-                info->values[ZONE_WORKINGSET_REFAULT] = (value << _pm_pageshift) / 1024;
-                values++;
-                continue;
-            }
-            else if ((sscanf(buf, "    workingset_activate %llu", &value)) == 1) {
-                info->values[ZONE_WORKINGSET_ACTIVATE] = (value << _pm_pageshift) / 1024;
-                values++;
-                continue;
-            }
-            else if ((sscanf(buf, "    workingset_nodereclaim %llu", &value)) == 1) {
-                info->values[ZONE_WORKINGSET_NODERECLAIM] = (value << _pm_pageshift) / 1024;
-                values++;
-                continue;
-            }
-            else if ((sscanf(buf, "    nr_anon_transparent_hugepages %llu", &value)) == 1) {
-                info->values[ZONE_NR_ANON_TRANSPARENT_HUGEPAGES] = (value << _pm_pageshift) / 1024;
-                values++;
-                continue;
-            }
-            else if ((sscanf(buf, "    nr_free_cma %llu", &value)) == 1) {
-                info->values[ZONE_NR_FREE_CMA] = (value << _pm_pageshift) / 1024;
-                values++;
-                continue;
-            }
-            else if (strncmp(buf, "        protection: (", 20) == 0) {
-		extract_zone_protection(buf+20+1, node, zonetype,
+	    info->node = node;
+	    pmsprintf(info->zone, ZONE_NAMELEN, "%s", zonetype);
+	    continue;
+	}
+	if (info == NULL)
+	    continue;
+	key = linux_token(line, &length);
+	if ((i = linux_fields_lookup(&zoneinfo_map, key, length)) < 0)
+	    continue;
+	key += length;
+	if (zoneinfo_fields[i].index == ZONE_PROTECTION) {
+	    while (*key == ' ' || *key == '(')
+		key++;
+	    extract_zone_protection(key, node, zonetype,
 				instname, protection_indom);
-		values++;
+	    continue;
+	}
+	if (zoneinfo_fields[i].index == ZONE_FREE) {
+	    key = linux_token(key, &length);
+	    if (length != 4 || strncmp(key, "free", 4) != 0)
 		continue;
-            }
+	    key += length;
 	}
-	pmdaCacheStore(indom, PMDA_CACHE_ADD, instname, (void *)info);
-
-	if (pmDebugOptions.libpmda)
-	    fprintf(stderr, "refresh_proc_zoneinfo: instance %s\n", instname);
+	info->values[zoneinfo_fields[i].index] =
+		(linux_strtou64(key, NULL) << _pm_pageshift) / 1024;
     }
-    fclose(fp);
+    if (info)
+	store_zone(indom, instname, info);
 
     if (changed)
 	pmdaCacheOp(indom, PMDA_CACHE_SAVE);
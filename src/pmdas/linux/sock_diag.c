@@ -0,0 +1,133 @@
+/*
+ * Linux netlink socket diagnostics (sock_diag) support
+ *
+ * Copyright (c) 2019 Red Hat.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ * for more details.
+ */
+#include "linux.h"
+#include "sock_diag.h"
+
+#ifdef HAVE_LINUX_SOCK_DIAG_H
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+#define DUMP_BUFSIZE	32768	/* large enough for the kernel to batch */
+
+/*
+ * Request a dump of all sockets matching the given (protocol-specific)
+ * request, passing each binary socket record to the callback.  Unlike
+ * the /proc/net files nothing is formatted by the kernel, or parsed
+ * here, and the socket tables are walked without holding the locks
+ * needed to produce consistent text for every socket.
+ */
+int
+sockdiag_dump(const void *request, size_t length, size_t recordsize,
+		sockdiag_callback_t callback, void *arg)
+{
+    struct sockaddr_nl	nladdr = { .nl_family = AF_NETLINK };
+    struct nlmsghdr	header, *nlh;
+    struct nlmsgerr	*error;
+    struct msghdr	msg;
+    struct iovec	iov[2];
+    __uint64_t		buffer[DUMP_BUFSIZE / sizeof(__uint64_t)];
+    ssize_t		bytes;
+    int			fd, done = 0, sts = 0;
+
+    if ((fd = socket(AF_NETLINK, SOCK_DGRAM | SOCK_CLOEXEC,
+				NETLINK_SOCK_DIAG)) < 0)
+	return -oserror();
+
+    memset(&header, 0, sizeof(header));
+    header.nlmsg_len = NLMSG_LENGTH(length);
+    header.nlmsg_type = SOCK_DIAG_BY_FAMILY;
+    header.nlmsg_flags = NLM_F_REQUEST | NLM_F_DUMP;
+    header.nlmsg_seq = 1;
+    iov[0].iov_base = &header;
+    iov[0].iov_len = sizeof(header);
+    iov[1].iov_base = (void *)request;
+    iov[1].iov_len = length;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_name = &nladdr;
+    msg.msg_namelen = sizeof(nladdr);
+    msg.msg_iov = iov;
+    msg.msg_iovlen = 2;
+
+    if (sendmsg(fd, &msg, 0) < 0) {
+	sts = -oserror();
+	close(fd);
+	return sts;
+    }
+
+    while (!done) {
+	if ((bytes = recv(fd, buffer, sizeof(buffer), 0)) < 0) {
+	    if (oserror() == EINTR)
+		continue;
+	    sts = -oserror();
+	    break;
+	}
+	if (bytes == 0) {
+	    sts = -EPROTO;
+	    break;
+	}
+	for (nlh = (struct nlmsghdr *)buffer; NLMSG_OK(nlh, bytes);
+	     nlh = NLMSG_NEXT(nlh, bytes)) {
+	    if (nlh->nlmsg_seq != header.nlmsg_seq)
+		continue;
+	    if (nlh->nlmsg_type == NLMSG_DONE) {
+		done = 1;
+		break;
+	    }
+	    if (nlh->nlmsg_type == NLMSG_ERROR) {
+		error = (struct nlmsgerr *)NLMSG_DATA(nlh);
+		if (nlh->nlmsg_len < NLMSG_LENGTH(sizeof(*error)))
+		    sts = -EPROTO;
+		else
+		    sts = error->error ? error->error : -EPROTO;
+		done = 1;
+		break;
+	    }
+	    if (nlh->nlmsg_type == SOCK_DIAG_BY_FAMILY &&
+		nlh->nlmsg_len >= NLMSG_LENGTH(recordsize))
+		callback(NLMSG_DATA(nlh), arg);
+	}
+    }
+
+    close(fd);
+    return sts;
+}
+#endif
+
+/*
+ * Netlink reports on the live system, so it cannot be used when the
+ * stats files are being read from an alternate location (QA).
+ */
+int
+sockdiag_enabled(sockdiag_source_t *source)
+{
+#ifdef HAVE_LINUX_SOCK_DIAG_H
+    if (source->disabled || (linux_test_mode & LINUX_TEST_STATSPATH))
+	return 0;
+    return 1;
+#else
+    (void)source;
+    return 0;
+#endif
+}
+
+void
+sockdiag_disable(sockdiag_source_t *source, int sts)
+{
+    if (pmDebugOptions.libpmda)
+	fprintf(stderr, "sockdiag: %s netlink dump failed, using procfs: %s\n",
+		source->name, pmErrStr(sts));
+    source->disabled = 1;
+}
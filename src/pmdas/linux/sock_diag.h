@@ -0,0 +1,50 @@
+/*
+ * Linux netlink socket diagnostics (sock_diag) support
+ *
+ * Copyright (c) 2019 Red Hat.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ * for more details.
+ */
+
+#ifndef _SOCK_DIAG_H
+#define _SOCK_DIAG_H
+
+#ifdef HAVE_LINUX_SOCK_DIAG_H
+#include <linux/netlink.h>
+#include <linux/sock_diag.h>
+#include <linux/inet_diag.h>
+#include <linux/unix_diag.h>
+
+/*
+ * Called once for each socket record in a dump, with the message
+ * payload (struct inet_diag_msg or struct unix_diag_msg) - records
+ * shorter than the size given to sockdiag_dump are not passed on.
+ */
+typedef void (*sockdiag_callback_t)(const void *, void *);
+
+extern int sockdiag_dump(const void *, size_t, size_t,
+			sockdiag_callback_t, void *);
+#endif
+
+/*
+ * Per-source backend selection - netlink is attempted first and, on any
+ * failure (no sock_diag support, protocol module not loaded, ...), that
+ * source reverts to reading its /proc/net file from then on.
+ */
+typedef struct {
+    const char		*name;
+    int			disabled;
+} sockdiag_source_t;
+
+extern int sockdiag_enabled(sockdiag_source_t *);
+extern void sockdiag_disable(sockdiag_source_t *, int);
+
+#endif /* _SOCK_DIAG_H */
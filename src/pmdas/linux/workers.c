@@ -0,0 +1,146 @@
+/*
+ * Linux PMDA concurrent cluster refresh
+ *
+ * Copyright (c) 2019 Red Hat.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ * for more details.
+ */
+
+#include "pmapi.h"
+#include "libpcp.h"
+#include "pmda.h"
+#include "workers.h"
+#include <pthread.h>
+#include <signal.h>
+
+/*
+ * Worker threads refresh the clusters with private state while the main
+ * thread refreshes the rest.  The main thread then joins in on any tasks
+ * not yet started, and waits for the workers to exit before the request
+ * continues - so no refresh is ever concurrent with a fetch, instance or
+ * store request.  Workers are started per-request rather than pooled, as
+ * setns(2) on a mount namespace (for container metrics) is only allowed
+ * for a single-threaded process.
+ */
+#define REFRESH_MAXWORKERS	32
+
+static pthread_mutex_t	workers_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_t	workers[REFRESH_MAXWORKERS];
+static int		maxworkers;	/* configured, -W option */
+static int		nworkers;	/* currently running */
+static refresh_task_t	*tasks;
+static int		ntasks;
+static int		next;		/* next task to be started */
+
+static void
+refresh_task(refresh_task_t *tp)
+{
+    struct timeval	start, end;
+    int			i;
+
+    for (i = 0; i < REFRESH_MAXSTEPS && tp->step[i].refresh; i++) {
+	if (!tp->active[i])
+	    continue;
+	pmtimevalNow(&start);
+	tp->step[i].refresh();
+	pmtimevalNow(&end);
+	tp->usec[i] = (__uint64_t)(pmtimevalSub(&end, &start) * 1000000.0);
+    }
+}
+
+static void
+refresh_tasks(void)
+{
+    refresh_task_t	*tp;
+
+    for (;;) {
+	PM_LOCK(workers_lock);
+	tp = (next < ntasks) ? &tasks[next++] : NULL;
+	PM_UNLOCK(workers_lock);
+	if (tp == NULL)
+	    break;
+	refresh_task(tp);
+    }
+}
+
+static void *
+refresh_worker(void *arg)
+{
+    (void)arg;
+    refresh_tasks();
+    return NULL;
+}
+
+int
+refresh_workers_init(int count)
+{
+    if (count < 0)
+	return -EINVAL;
+    maxworkers = count < REFRESH_MAXWORKERS ? count : REFRESH_MAXWORKERS;
+    return maxworkers;
+}
+
+int
+refresh_workers_count(void)
+{
+    return maxworkers;
+}
+
+/*
+ * Start refreshing the given tasks, in worker threads if threaded is
+ * set (and workers are configured), else inline before returning.
+ */
+void
+refresh_workers_run(refresh_task_t *tasklist, int count, int threaded)
+{
+    sigset_t		all, save;
+    int			i, j, sts;
+
+    for (i = 0; i < count; i++)
+	for (j = 0; j < REFRESH_MAXSTEPS; j++)
+	    tasklist[i].usec[j] = 0;
+
+    tasks = tasklist;
+    ntasks = count;
+    next = 0;
+
+    if (!threaded || maxworkers == 0) {
+	refresh_tasks();
+	return;
+    }
+
+    /* signals are handled by the main thread only */
+    sigfillset(&all);
+    pthread_sigmask(SIG_BLOCK, &all, &save);
+    for (nworkers = 0; nworkers < maxworkers && nworkers < count; nworkers++) {
+	sts = pthread_create(&workers[nworkers], NULL, refresh_worker, NULL);
+	if (sts != 0) {
+	    if (pmDebugOptions.libpmda)
+		fprintf(stderr, "refresh_workers_run: pthread_create: %s\n",
+			pmErrStr(-sts));
+	    break;	/* remaining tasks are done by the main thread */
+	}
+    }
+    pthread_sigmask(SIG_SETMASK, &save, NULL);
+}
+
+void
+refresh_workers_wait(void)
+{
+    int			i;
+
+    refresh_tasks();
+    for (i = 0; i < nworkers; i++)
+	pthread_join(workers[i], NULL);
+    nworkers = 0;
+    tasks = NULL;
+    ntasks = next = 0;
+}
@@ -0,0 +1,40 @@
+/*
+ * Linux PMDA concurrent cluster refresh
+ *
+ * Copyright (c) 2019 Red Hat.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ * for more details.
+ */
+
+#define REFRESH_MAXSTEPS	3
+
+/*
+ * A refresh task is run by a single thread, performing each of its
+ * active steps in order - steps sharing any state (indoms, buffers,
+ * etc) must be in the same task.  Separate tasks run concurrently.
+ */
+typedef struct {
+    int		cluster;	/* cluster charged with the refresh time */
+    const int	*need;		/* requesting indices (-1 terminated), or
+				   NULL if requested by cluster only */
+    void	(*refresh)(void);
+} refresh_step_t;
+
+typedef struct {
+    refresh_step_t	step[REFRESH_MAXSTEPS];	/* NULL refresh terminated */
+    int			active[REFRESH_MAXSTEPS];
+    __uint64_t		usec[REFRESH_MAXSTEPS];
+} refresh_task_t;
+
+extern int refresh_workers_init(int);
+extern int refresh_workers_count(void);
+extern void refresh_workers_run(refresh_task_t *, int, int);
+extern void refresh_workers_wait(void);
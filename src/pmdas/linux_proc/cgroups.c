@@ -1,5 +1,5 @@
 /*
- * Copyright (c) 2012-2018 Red Hat.
+ * Copyright (c) 2012-2019 Red Hat.
  * Copyright (c) 2010 Aconex.  All Rights Reserved.
  *
  * This program is free software; you can redistribute it and/or modify it
@@ -21,6 +21,7 @@
 #include "clusters.h"
 #include "proc_pid.h"
 #include <sys/stat.h>
+#include <fcntl.h>
 #include <ctype.h>
 
 static void
@@ -333,21 +334,6 @@ cgroup_container(const char *cgroup, char *buf, int buflen, int *key)
 	*key = proc_strings_insert(cid);
 }
 
-static const char *
-cgroup_name(const char *path, int offset)
-{
-    char *name = (char *)path + offset;
-
-    if (*name == '/') {
-	while (*name == '/')
-	    name++;
-	name--;
-    } else if (*name == '\0') {
-	name = "/";
-    }
-    return name;
-}
-
 static int
 check_refresh(const char *cgroup, const char *container, int container_length)
 {
@@ -363,51 +349,73 @@ check_refresh(const char *cgroup, const char *container, int container_length)
     return 1;
 }
 
+static int
+check_descend(const char *cgroup, const char *container, int container_length)
+{
+    int length;
+
+    /*
+     * See whether any cgroup below this one could need a refresh - if
+     * this name is not (a prefix of) the container name/path, then no
+     * cgroup in the subtree below it can match, so skip it entirely.
+     */
+    if (container_length > 0) {
+	while (*cgroup == '/')
+	    cgroup++;	/* do not compare any leading slashes */
+	if ((length = strlen(cgroup)) > container_length)
+	    length = container_length;
+	return (strncmp(cgroup, container, length) == 0);
+    }
+    return 1;
+}
+
+/*
+ * Scan one cgroup directory (given as an open file descriptor, which
+ * is consumed here) and all of the cgroups below it.  Subdirectories
+ * are opened relative to their parent and each refresh callback reads
+ * its files relative to the cgroup directory, so that no full paths
+ * are built or resolved by the kernel for every cgroup and file.  The
+ * cgname buffer holds the cgroup name, extended in place at offset
+ * length for each subdirectory.
+ */
 static void
-cgroup_scan(const char *mnt, const char *path, cgroup_refresh_t refresh,
+cgroup_scan(int fd, char *cgname, int length, cgroup_refresh_t refresh,
 		const char *container, int container_length)
 {
-    int length, mntlen = strlen(mnt) + 1;
     DIR *dirp;
     struct stat sbuf;
     struct dirent *dp;
-    const char *cgname;
-    char cgpath[MAXPATHLEN] = { 0 };
-
-    if (path[0] == '\0') {
-	pmsprintf(cgpath, sizeof(cgpath), "%s%s", proc_statspath, mnt);
-	length = strlen(cgpath);
-    } else {
-	pmsprintf(cgpath, sizeof(cgpath), "%s%s/%s", proc_statspath, mnt, path);
-	length = strlen(proc_statspath) + mntlen;
-    }
+    int subfd, sublen;
 
-    if ((dirp = opendir(cgpath)) == NULL)
+    if ((dirp = fdopendir(fd)) == NULL) {
+	close(fd);
 	return;
+    }
 
-    cgname = cgroup_name(cgpath, length);
-    if (check_refresh(cgpath + mntlen, container, container_length))
-	refresh(cgpath, cgname);
+    if (check_refresh(cgname, container, container_length))
+	refresh(fd, cgname);
 
     /* descend into subdirectories to find all cgroups */
     while ((dp = readdir(dirp)) != NULL) {
 	if (dp->d_name[0] == '.')
 	    continue;
-	if (path[0] == '\0')
-	    pmsprintf(cgpath, sizeof(cgpath), "%s%s/%s",
-			proc_statspath, mnt, dp->d_name);
-	else
-	    pmsprintf(cgpath, sizeof(cgpath), "%s%s/%s/%s",
-			proc_statspath, mnt, path, dp->d_name);
-	if (stat(cgpath, &sbuf) < 0)
+	if (dp->d_type != DT_DIR) {
+	    if (dp->d_type != DT_UNKNOWN && dp->d_type != DT_LNK)
+		continue;
+	    if (fstatat(fd, dp->d_name, &sbuf, 0) < 0)
+		continue;
+	    if (!(S_ISDIR(sbuf.st_mode)))
+		continue;
+	}
+	sublen = pmsprintf(cgname + length, MAXPATHLEN - length, "/%s", dp->d_name);
+	if (length + sublen >= MAXPATHLEN - 1)
+	    continue;	/* name truncated */
+	if (!check_descend(cgname, container, container_length))
 	    continue;
-	if (!(S_ISDIR(sbuf.st_mode)))
+	if ((subfd = openat(fd, dp->d_name, O_RDONLY|O_DIRECTORY)) < 0)
 	    continue;
-
-	cgname = cgroup_name(cgpath, length);
-	if (check_refresh(cgpath + mntlen, container, container_length))
-	    refresh(cgpath, cgname);
-	cgroup_scan(mnt, cgname, refresh, container, container_length);
+	cgroup_scan(subfd, cgname, length + sublen, refresh,
+			container, container_length);
     }
     closedir(dirp);
 }
@@ -416,15 +424,16 @@ cgroup_scan(const char *mnt, const char *path, cgroup_refresh_t refresh,
  * Primary driver interface - finds any/all mount points for a given
  * cgroup subsystem and iteratively expands all of the cgroups below
  * them.  The setup callback inactivates each indoms contents, while
- * the refresh callback is called once per cgroup (with path/name) -
- * its role is to refresh the values for that one named cgroup.
+ * the refresh callback is called once per cgroup (with directory fd
+ * and name) - its role is to refresh the values for that one cgroup.
  */
 void
 refresh_cgroups(const char *subsys, const char *container,
 	int length, cgroup_setup_t setup, cgroup_refresh_t refresh)
 {
-    int sts;
+    int fd, sts;
     filesys_t *fs;
+    char cgname[MAXPATHLEN];
     pmInDom mounts = INDOM(CGROUP_MOUNTS_INDOM);
 
     pmdaCacheOp(mounts, PMDA_CACHE_WALK_REWIND);
@@ -434,57 +443,121 @@ refresh_cgroups(const char *subsys, const char *container,
 	if (scan_filesys_options(fs->options, subsys) == NULL)
 	    continue;
 	setup();
-	cgroup_scan(fs->path, "", refresh, container, length);
+	pmsprintf(cgname, sizeof(cgname), "%s%s", proc_statspath, fs->path);
+	if ((fd = open(cgname, O_RDONLY|O_DIRECTORY)) < 0)
+	    continue;
+	pmsprintf(cgname, sizeof(cgname), "/");
+	cgroup_scan(fd, cgname, 0, refresh, container, length);
     }
 }
 
-static int
-read_oneline(const char *file, char *buffer, size_t length)
+/*
+ * Read all of a cgroup file, relative to the cgroup directory, into a
+ * buffer that is reused (and grown as needed) for every file read, as
+ * many thousands of these small files may be read on each refresh.
+ * Returns the null-terminated contents, or NULL on failure.
+ */
+static char *
+read_cgroup_file(int dirfd, const char *file)
 {
-    FILE *fp;
-    int sts;
+    static char *buffer;
+    static size_t size;
+    size_t offset = 0;
+    ssize_t bytes;
+    char *p;
+    int fd;
+
+    if ((fd = openat(dirfd, file, O_RDONLY)) < 0)
+	return NULL;
+    for (;;) {
+	if (offset + 1 >= size) {
+	    if ((p = realloc(buffer, size ? size * 2 : 4096)) == NULL) {
+		close(fd);
+		return NULL;
+	    }
+	    size = size ? size * 2 : 4096;
+	    buffer = p;
+	}
+	if ((bytes = pread(fd, buffer + offset, size - offset - 1, offset)) <= 0)
+	    break;
+	offset += bytes;
+    }
+    close(fd);
+    if (bytes < 0)
+	return NULL;
+    buffer[offset] = '\0';
+    return buffer;
+}
 
-    if ((fp = fopen(file, "r")) == NULL)
-	return -ENOENT;
-    if (fgets(buffer, length, fp) != NULL) {
-	buffer[length-1] = '\0';
-	sts = 0;
+/* return the next line from a file buffer, null-terminated in place */
+static char *
+next_line(char **bufp)
+{
+    char *line = *bufp, *end;
+
+    if (*line == '\0')
+	return NULL;
+    if ((end = strchr(line, '\n')) != NULL) {
+	*end = '\0';
+	*bufp = end + 1;
     } else {
-	sts = -ENOMEM;
+	*bufp = line + strlen(line);
     }
-    fclose(fp);
-    return sts;
+    return line;
+}
+
+/* split a "name value" line, as found in the various stat files */
+static int
+split_line(char *line, char **name, unsigned long long *value)
+{
+    char *p, *endp;
+
+    if ((p = strchr(line, ' ')) == NULL)
+	return 0;
+    *p++ = '\0';
+    *name = line;
+    *value = strtoull(p, &endp, 10);
+    return endp != p;
+}
+
+static int
+read_oneline(int dirfd, const char *file, char **line)
+{
+    char *buffer;
+
+    if ((buffer = read_cgroup_file(dirfd, file)) == NULL)
+	return -ENOENT;
+    if (*buffer == '\0')
+	return -ENOMEM;
+    *line = next_line(&buffer);
+    return 0;
 }
 
 static int
-read_oneline_string(const char *file)
+read_oneline_string(int dirfd, const char *file)
 {
-    char buffer[4096];
-    size_t length;
+    char *buffer;
     int sts;
 
-    if ((sts = read_oneline(file, buffer, sizeof(buffer))) < 0)
+    if ((sts = read_oneline(dirfd, file, &buffer)) < 0)
 	return sts;
-    length = strlen(buffer);
-    while (buffer[--length] == '\n')
-	buffer[length] = '\0';
     return proc_strings_insert(buffer);
 }
 
 static int
-read_oneline_ull(const char *file, __uint64_t *value)
+read_oneline_ull(int dirfd, const char *file, __uint64_t *value)
 {
-    char buffer[4096], *endp;
-    int sts = read_oneline(file, buffer, sizeof(buffer));
+    char *buffer, *endp;
+    int sts = read_oneline(dirfd, file, &buffer);
     *value = sts < 0 ? ULONGLONG_MAX : strtoull(buffer, &endp, 0);
     return sts;
 }
 
 static int
-read_oneline_ll(const char *file, __int64_t *value)
+read_oneline_ll(int dirfd, const char *file, __int64_t *value)
 {
-    char buffer[4096], *endp;
-    int sts = read_oneline(file, buffer, sizeof(buffer));
+    char *buffer, *endp;
+    int sts = read_oneline(dirfd, file, &buffer);
     *value = sts < 0 ? sts : strtoll(buffer, &endp, 0);
     return sts;
 }
@@ -496,11 +569,10 @@ setup_cpuset(void)
 }
 
 void
-refresh_cpuset(const char *path, const char *name)
+refresh_cpuset(int dirfd, const char *name)
 {
     pmInDom indom = INDOM(CGROUP_CPUSET_INDOM);
     cgroup_cpuset_t *cpuset;
-    char file[MAXPATHLEN];
     char id[MAXCIDLEN];
     int sts;
 
@@ -512,10 +584,8 @@ refresh_cpuset(const char *path, const char *name)
 	if (!cpuset)
 	    return;
     }
-    pmsprintf(file, sizeof(file), "%s/cpuset.cpus", path);
-    cpuset->cpus = read_oneline_string(file);
-    pmsprintf(file, sizeof(file), "%s/cpuset.mems", path);
-    cpuset->mems = read_oneline_string(file);
+    cpuset->cpus = read_oneline_string(dirfd, "cpuset.cpus");
+    cpuset->mems = read_oneline_string(dirfd, "cpuset.mems");
     cgroup_container(name, id, sizeof(id), &cpuset->container);
     pmdaCacheStore(indom, PMDA_CACHE_ADD, name, cpuset);
 }
@@ -529,7 +599,7 @@ setup_cpuacct(void)
 }
 
 static int
-read_cpuacct_stats(const char *file, cgroup_cpuacct_t *cap)
+read_cpuacct_stats(int dirfd, const char *file, cgroup_cpuacct_t *cap)
 {
     static cgroup_cpuacct_t cpuacct;
     static struct {
@@ -540,15 +610,14 @@ read_cpuacct_stats(const char *file, cgroup_cpuacct_t *cap)
 	{ "system",			&cpuacct.system },
 	{ NULL, NULL }
     };
-    char buffer[4096], name[64];
+    char *buffer, *line, *name;
     unsigned long long value;
-    FILE *fp;
     int i;
 
-    if ((fp = fopen(file, "r")) == NULL)
+    if ((buffer = read_cgroup_file(dirfd, file)) == NULL)
 	return -ENOENT;
-    while (fgets(buffer, sizeof(buffer), fp) != NULL) {
-	if (sscanf(buffer, "%s %llu\n", &name[0], &value) < 2)
+    while ((line = next_line(&buffer)) != NULL) {
+	if (!split_line(line, &name, &value))
 	    continue;
 	for (i = 0; cpuacct_fields[i].field != NULL; i++) {
 	    if (strcmp(name, cpuacct_fields[i].field) != 0)
@@ -557,33 +626,25 @@ read_cpuacct_stats(const char *file, cgroup_cpuacct_t *cap)
 	    break;
 	}
     }
-    fclose(fp);
     memcpy(cap, &cpuacct, sizeof(cpuacct));
     return 0;
 }
 
 static int
-read_percpuacct_usage(const char *file, const char *name)
+read_percpuacct_usage(int dirfd, const char *file, const char *name)
 {
     pmInDom indom =  INDOM(CGROUP_PERCPUACCT_INDOM);
     cgroup_percpuacct_t *percpuacct;
-    char buffer[16 * 4096], *endp;
-    char inst[MAXPATHLEN], *p;
+    char inst[MAXPATHLEN], *p, *endp;
     unsigned long long value;
-    FILE *fp;
     int cpu, sts;
 
-    if ((fp = fopen(file, "r")) == NULL)
-	return -ENOENT;
-    p = fgets(buffer, sizeof(buffer), fp);
-    if (!p) {
-	fclose(fp);
-	return -ENOMEM;
-    }
+    if ((sts = read_oneline(dirfd, file, &p)) < 0)
+	return sts;
 
     for (cpu = 0; ; cpu++) {
 	value = strtoull(p, &endp, 0);
-	if (*endp == '\0' || endp == p)
+	if (endp == p)
 	    break;
 	p = endp;
 	while (p && isspace((int)*p))
@@ -600,16 +661,14 @@ read_percpuacct_usage(const char *file, const char *name)
 	percpuacct->usage = value;
 	pmdaCacheStore(indom, PMDA_CACHE_ADD, inst, percpuacct);
     }
-    fclose(fp);
     return 0;
 }
 
 void
-refresh_cpuacct(const char *path, const char *name)
+refresh_cpuacct(int dirfd, const char *name)
 {
     pmInDom indom = INDOM(CGROUP_CPUACCT_INDOM);
     cgroup_cpuacct_t *cpuacct;
-    char file[MAXPATHLEN];
     char id[MAXCIDLEN];
     int sts;
 
@@ -621,12 +680,9 @@ refresh_cpuacct(const char *path, const char *name)
 	if (!cpuacct)
 	    return;
     }
-    pmsprintf(file, sizeof(file), "%s/cpuacct.stat", path);
-    read_cpuacct_stats(file, cpuacct);
-    pmsprintf(file, sizeof(file), "%s/cpuacct.usage", path);
-    read_oneline_ull(file, &cpuacct->usage);
-    pmsprintf(file, sizeof(file), "%s/cpuacct.usage_percpu", path);
-    read_percpuacct_usage(file, name);
+    read_cpuacct_stats(dirfd, "cpuacct.stat", cpuacct);
+    read_oneline_ull(dirfd, "cpuacct.usage", &cpuacct->usage);
+    read_percpuacct_usage(dirfd, "cpuacct.usage_percpu", name);
     cgroup_container(name, id, sizeof(id), &cpuacct->container);
     pmdaCacheStore(indom, PMDA_CACHE_ADD, name, cpuacct);
 }
@@ -638,7 +694,7 @@ setup_cpusched(void)
 }
 
 static int
-read_cpu_stats(const char *file, cgroup_cpustat_t *ccp)
+read_cpu_stats(int dirfd, const char *file, cgroup_cpustat_t *ccp)
 {
     static cgroup_cpustat_t cpustat;
     static struct {
@@ -648,19 +704,19 @@ read_cpu_stats(const char *file, cgroup_cpustat_t *ccp)
 	{ "nr_periods",			&cpustat.nr_periods },
 	{ "nr_throttled",		&cpustat.nr_throttled },
 	{ "throttled_time",		&cpustat.throttled_time },
+	{ NULL, NULL }
     };
-    char buffer[4096], name[64];
+    char *buffer, *line, *name;
     unsigned long long value;
-    FILE *fp;
     int i;
 
     memset(&cpustat, 0, sizeof(cpustat));
-    if ((fp = fopen(file, "r")) == NULL) {
+    if ((buffer = read_cgroup_file(dirfd, file)) == NULL) {
 	memcpy(ccp, &cpustat, sizeof(cpustat));
 	return -ENOENT;
     }
-    while (fgets(buffer, sizeof(buffer), fp) != NULL) {
-	if (sscanf(buffer, "%s %llu\n", &name[0], &value) < 2)
+    while ((line = next_line(&buffer)) != NULL) {
+	if (!split_line(line, &name, &value))
 	    continue;
 	for (i = 0; cpustat_fields[i].field != NULL; i++) {
 	    if (strcmp(name, cpustat_fields[i].field) != 0)
@@ -669,17 +725,15 @@ read_cpu_stats(const char *file, cgroup_cpustat_t *ccp)
 	    break;
 	}
     }
-    fclose(fp);
     memcpy(ccp, &cpustat, sizeof(cpustat));
     return 0;
 }
 
 void
-refresh_cpusched(const char *path, const char *name)
+refresh_cpusched(int dirfd, const char *name)
 {
     pmInDom indom = INDOM(CGROUP_CPUSCHED_INDOM);
     cgroup_cpusched_t *cpusched;
-    char file[MAXPATHLEN];
     char id[MAXCIDLEN];
     int sts;
 
@@ -691,14 +745,10 @@ refresh_cpusched(const char *path, const char *name)
 	if (!cpusched)
 	    return;
     }
-    pmsprintf(file, sizeof(file), "%s/cpu.stat", path);
-    read_cpu_stats(file, &cpusched->stat);
-    pmsprintf(file, sizeof(file), "%s/cpu.shares", path);
-    read_oneline_ull(file, &cpusched->shares);
-    pmsprintf(file, sizeof(file), "%s/cpu.cfs_period_us", path);
-    read_oneline_ull(file, &cpusched->cfs_period);
-    pmsprintf(file, sizeof(file), "%s/cpu.cfs_quota_us", path);
-    read_oneline_ll(file, &cpusched->cfs_quota);
+    read_cpu_stats(dirfd, "cpu.stat", &cpusched->stat);
+    read_oneline_ull(dirfd, "cpu.shares", &cpusched->shares);
+    read_oneline_ull(dirfd, "cpu.cfs_period_us", &cpusched->cfs_period);
+    read_oneline_ll(dirfd, "cpu.cfs_quota_us", &cpusched->cfs_quota);
     cgroup_container(name, id, sizeof(id), &cpusched->container);
 
     pmdaCacheStore(indom, PMDA_CACHE_ADD, name, cpusched);
@@ -711,7 +761,7 @@ setup_memory(void)
 }
 
 static int
-read_memory_stats(const char *file, cgroup_memory_t *cmp)
+read_memory_stats(int dirfd, const char *file, cgroup_memory_t *cmp)
 {
     static cgroup_memory_t memory;
     static struct {
@@ -754,18 +804,17 @@ read_memory_stats(const char *file, cgroup_memory_t *cmp)
 	{ "recent_scanned_file",	&memory.recent_scanned_file },
 	{ NULL, NULL }
     };
-    char buffer[4096], name[64];
+    char *buffer, *line, *name;
     unsigned long long value;
-    FILE *fp;
     int i;
 
     memset(&memory, 0, sizeof(memory));
-    if ((fp = fopen(file, "r")) == NULL) {
+    if ((buffer = read_cgroup_file(dirfd, file)) == NULL) {
 	memcpy(cmp, &memory, sizeof(memory));
 	return -ENOENT;
     }
-    while (fgets(buffer, sizeof(buffer), fp) != NULL) {
-	if (sscanf(buffer, "%s %llu\n", &name[0], &value) < 2)
+    while ((line = next_line(&buffer)) != NULL) {
+	if (!split_line(line, &name, &value))
 	    continue;
 	for (i = 0; memory_fields[i].field != NULL; i++) {
 	    if (strcmp(name, memory_fields[i].field) != 0)
@@ -774,17 +823,15 @@ read_memory_stats(const char *file, cgroup_memory_t *cmp)
 	    break;
 	}
     }
-    fclose(fp);
     memcpy(cmp, &memory, sizeof(memory));
     return 0;
 }
 
 void
-refresh_memory(const char *path, const char *name)
+refresh_memory(int dirfd, const char *name)
 {
     pmInDom indom = INDOM(CGROUP_MEMORY_INDOM);
     cgroup_memory_t *memory;
-    char file[MAXPATHLEN];
     char id[MAXCIDLEN];
     int sts;
 
@@ -796,14 +843,10 @@ refresh_memory(const char *path, const char *name)
 	if (!memory)
 	    return;
     }
-    pmsprintf(file, sizeof(file), "%s/memory.stat", path);
-    read_memory_stats(file, memory);
-    pmsprintf(file, sizeof(file), "%s/memory.limit_in_bytes", path);
-    read_oneline_ull(file, &memory->limit);
-    pmsprintf(file, sizeof(file), "%s/memory.usage_in_bytes", path);
-    read_oneline_ull(file, &memory->usage);
-    pmsprintf(file, sizeof(file), "%s/memory.failcnt", path);
-    read_oneline_ull(file, &memory->failcnt);
+    read_memory_stats(dirfd, "memory.stat", memory);
+    read_oneline_ull(dirfd, "memory.limit_in_bytes", &memory->limit);
+    read_oneline_ull(dirfd, "memory.usage_in_bytes", &memory->usage);
+    read_oneline_ull(dirfd, "memory.failcnt", &memory->failcnt);
     cgroup_container(name, id, sizeof(id), &memory->container);
 
     pmdaCacheStore(indom, PMDA_CACHE_ADD, name, memory);
@@ -816,11 +859,10 @@ setup_netcls(void)
 }
 
 void
-refresh_netcls(const char *path, const char *name)
+refresh_netcls(int dirfd, const char *name)
 {
     pmInDom indom = INDOM(CGROUP_NETCLS_INDOM);
     cgroup_netcls_t *netcls;
-    char file[MAXPATHLEN];
     char id[MAXCIDLEN];
     int sts;
 
@@ -832,8 +874,7 @@ refresh_netcls(const char *path, const char *name)
 	if (!netcls)
 	    return;
     }
-    pmsprintf(file, sizeof(file), "%s/net_cls.classid", path);
-    read_oneline_ull(file, &netcls->classid);
+    read_oneline_ull(dirfd, "net_cls.classid", &netcls->classid);
     cgroup_container(name, id, sizeof(id), &netcls->container);
     pmdaCacheStore(indom, PMDA_CACHE_ADD, name, netcls);
 }
@@ -913,16 +954,16 @@ get_perdevblkio(pmInDom indom, const char *name, const char *disk,
 }
 
 static int
-read_blkio_devices_stats(const char *file, const char *name, int style,
-			cgroup_blkiops_t *total)
+read_blkio_devices_stats(int dirfd, const char *file, const char *name,
+			int style, cgroup_blkiops_t *total)
 {
     pmInDom indom = INDOM(CGROUP_PERDEVBLKIO_INDOM);
     pmInDom devtindom = INDOM(DEVT_INDOM);
     cgroup_perdevblkio_t *blkdev;
     cgroup_blkiops_t *blkios;
     char *devname = NULL;
-    char buffer[4096];
-    FILE *fp;
+    char *buffer, *line;
+    char inst[MAXPATHLEN];
 
     static cgroup_blkiops_t blkiops;
     static struct {
@@ -940,21 +981,19 @@ read_blkio_devices_stats(const char *file, const char *name, int style,
     /* reset, so counts accumulate from zero for this set of devices */
     memset(total, 0, sizeof(cgroup_blkiops_t));
 
-    if ((fp = fopen(file, "r")) == NULL)
+    if ((buffer = read_cgroup_file(dirfd, file)) == NULL)
 	return -ENOENT;
 
-    while (fgets(buffer, sizeof(buffer), fp) != NULL) {
+    while ((line = next_line(&buffer)) != NULL) {
 	unsigned int major, minor;
 	unsigned long long value;
 	char *realname, op[8];
 	int i;
 
-	i = sscanf(buffer, "Total %llu\n", &value);
-	if (i == 2) {	/* final field - per-cgroup Total operations */
-	    break;
-	}
+	if (strncmp(line, "Total ", 6) == 0)
+	    break;	/* final field - per-cgroup Total operations */
 
-	i = sscanf(buffer, "%u:%u %s %llu\n", &major, &minor, &op[0], &value);
+	i = sscanf(line, "%u:%u %7s %llu", &major, &minor, &op[0], &value);
 	if (i < 3)
 	    continue;
 	realname = get_blkdev(devtindom, major, minor);
@@ -970,10 +1009,10 @@ read_blkio_devices_stats(const char *file, const char *name, int style,
 	    if (strcmp("Total", blkio_fields[i].field) != 0)
 		break;
 	    /* all device fields are now acquired, update indom and cgroup totals */
-	    blkdev = get_perdevblkio(indom, name, devname, buffer, sizeof(buffer));
+	    blkdev = get_perdevblkio(indom, name, devname, inst, sizeof(inst));
 	    blkios = get_blkiops(style, blkdev);
 	    memcpy(blkios, &blkiops, sizeof(cgroup_blkiops_t));
-	    pmdaCacheStore(indom, PMDA_CACHE_ADD, buffer, blkdev);
+	    pmdaCacheStore(indom, PMDA_CACHE_ADD, inst, blkdev);
 	    /* accumulate stats for this latest device into the per-cgroup totals */
 	    total->read += blkiops.read;
 	    total->write += blkiops.write;
@@ -983,57 +1022,54 @@ read_blkio_devices_stats(const char *file, const char *name, int style,
 	    break;
 	}
     }
-    fclose(fp);
     return 0;
 }
 
 static int
-read_blkio_devices_value(const char *file, const char *name, int style,
-			__uint64_t *total)
+read_blkio_devices_value(int dirfd, const char *file, const char *name,
+			int style, __uint64_t *total)
 {
     pmInDom indom = INDOM(CGROUP_PERDEVBLKIO_INDOM);
     pmInDom devtindom = INDOM(DEVT_INDOM);
     cgroup_perdevblkio_t *blkdev;
-    char buffer[4096];
-    FILE *fp;
+    char *buffer, *line;
+    char inst[MAXPATHLEN];
 
     /* reset, so counts accumulate from zero for this set of devices */
     memset(total, 0, sizeof(__uint64_t));
 
-    if ((fp = fopen(file, "r")) == NULL)
+    if ((buffer = read_cgroup_file(dirfd, file)) == NULL)
 	return -ENOENT;
 
-    while (fgets(buffer, sizeof(buffer), fp) != NULL) {
+    while ((line = next_line(&buffer)) != NULL) {
 	unsigned int major, minor;
 	unsigned long long value;
 	char *devname;
 	int i;
 
-	i = sscanf(buffer, "%u:%u %llu\n", &major, &minor, &value);
+	i = sscanf(line, "%u:%u %llu", &major, &minor, &value);
 	if (i < 3)
 	    continue;
 	if ((devname = get_blkdev(devtindom, major, minor)) == NULL)
 	    continue;
 	/* all device fields are now acquired, update indom and cgroup total */
-	blkdev = get_perdevblkio(indom, name, devname, buffer, sizeof(buffer));
+	blkdev = get_perdevblkio(indom, name, devname, inst, sizeof(inst));
 	if (style == CG_BLKIO_SECTORS)
 	    blkdev->stats.sectors = value;
 	if (style == CG_BLKIO_TIME)
 	    blkdev->stats.time = value;
-	pmdaCacheStore(indom, PMDA_CACHE_ADD, buffer, blkdev);
+	pmdaCacheStore(indom, PMDA_CACHE_ADD, inst, blkdev);
 	/* accumulate stats for this latest device into the per-cgroup total */
 	*total += value;
     }
-    fclose(fp);
     return 0;
 }
 
 void
-refresh_blkio(const char *path, const char *name)
+refresh_blkio(int dirfd, const char *name)
 {
     pmInDom indom = INDOM(CGROUP_BLKIO_INDOM);
     cgroup_blkio_t *blkio;
-    char file[MAXPATHLEN];
     char id[MAXCIDLEN];
     int sts;
 
@@ -1045,35 +1081,25 @@ refresh_blkio(const char *path, const char *name)
 	if (!blkio)
 	    return;
     }
-    pmsprintf(file, sizeof(file), "%s/blkio.io_merged", path);
-    read_blkio_devices_stats(file, name,
+    read_blkio_devices_stats(dirfd, "blkio.io_merged", name,
 		CG_BLKIO_IOMERGED_TOTAL, &blkio->total.io_merged);
-    pmsprintf(file, sizeof(file), "%s/blkio.io_queued", path);
-    read_blkio_devices_stats(file, name,
+    read_blkio_devices_stats(dirfd, "blkio.io_queued", name,
 		CG_BLKIO_IOQUEUED_TOTAL, &blkio->total.io_queued);
-    pmsprintf(file, sizeof(file), "%s/blkio.io_service_bytes", path);
-    read_blkio_devices_stats(file, name,
+    read_blkio_devices_stats(dirfd, "blkio.io_service_bytes", name,
 		CG_BLKIO_IOSERVICEBYTES_TOTAL, &blkio->total.io_service_bytes);
-    pmsprintf(file, sizeof(file), "%s/blkio.io_serviced", path);
-    read_blkio_devices_stats(file, name,
+    read_blkio_devices_stats(dirfd, "blkio.io_serviced", name,
 		CG_BLKIO_IOSERVICED_TOTAL, &blkio->total.io_serviced);
-    pmsprintf(file, sizeof(file), "%s/blkio.io_service_time", path);
-    read_blkio_devices_stats(file, name,
+    read_blkio_devices_stats(dirfd, "blkio.io_service_time", name,
 		CG_BLKIO_IOSERVICETIME_TOTAL, &blkio->total.io_service_time);
-    pmsprintf(file, sizeof(file), "%s/blkio.io_wait_time", path);
-    read_blkio_devices_stats(file, name,
+    read_blkio_devices_stats(dirfd, "blkio.io_wait_time", name,
 		CG_BLKIO_IOWAITTIME_TOTAL, &blkio->total.io_wait_time);
-    pmsprintf(file, sizeof(file), "%s/blkio.sectors", path);
-    read_blkio_devices_value(file, name,
+    read_blkio_devices_value(dirfd, "blkio.sectors", name,
 		CG_BLKIO_SECTORS, &blkio->total.sectors);
-    pmsprintf(file, sizeof(file), "%s/blkio.time", path);
-    read_blkio_devices_value(file, name,
+    read_blkio_devices_value(dirfd, "blkio.time", name,
 		CG_BLKIO_TIME, &blkio->total.time);
-    pmsprintf(file, sizeof(file), "%s/blkio.throttle.io_service_bytes", path);
-    read_blkio_devices_stats(file, name,
+    read_blkio_devices_stats(dirfd, "blkio.throttle.io_service_bytes", name,
 		CG_BLKIO_THROTTLEIOSERVICEBYTES_TOTAL, &blkio->total.throttle_io_service_bytes);
-    pmsprintf(file, sizeof(file), "%s/blkio.throttle.io_serviced", path);
-    read_blkio_devices_stats(file, name,
+    read_blkio_devices_stats(dirfd, "blkio.throttle.io_serviced", name,
 		CG_BLKIO_THROTTLEIOSERVICED_TOTAL, &blkio->total.throttle_io_serviced);
     cgroup_container(name, id, sizeof(id), &blkio->container);
 
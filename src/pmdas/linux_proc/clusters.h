@@ -52,8 +52,9 @@
 
 #define CLUSTER_PID_OOM_SCORE	62 /* /proc/<pid>/oom_score */
 #define CLUSTER_HOTPROC_PID_OOM_SCORE   63 /* /proc/<pid>/oom_score */
+#define CLUSTER_REFRESH		64 /* shared refresh statistics */
 
 #define MIN_CLUSTER  8		/* first cluster number we use here */
-#define MAX_CLUSTER 64		/* one more than highest cluster number used */
+#define MAX_CLUSTER 65		/* one more than highest cluster number used */
 
 #endif /* _CLUSTERS_H */
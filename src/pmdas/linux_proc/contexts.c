@@ -287,3 +287,37 @@ proc_ctx_set_cgroups(int ctx, const char *cgroups)
     pp->cgroups = cgroups;
     return 0;
 }
+
+int
+proc_ctx_refresh(int ctx)
+{
+    proc_perctx_t *pp;
+
+    if (ctx < 0 || ctx >= num_ctx)
+	return -1;	/* fallback to default */
+    pp = &ctxtab[ctx];
+    if (pp->state & CTX_REFRESH)
+	return pp->refresh;	/* client setting */
+    return -1;	/* fallback to default */
+}
+
+int
+proc_ctx_set_refresh(int ctx, int refresh)
+{
+    proc_perctx_t *pp;
+
+    if (ctx < 0 || ctx >= num_ctx)
+	return PM_ERR_NOCONTEXT;
+    pp = &ctxtab[ctx];
+    if (pp->state == CTX_INACTIVE)
+	return PM_ERR_NOCONTEXT;
+
+    if (refresh < 0) {
+	pp->state &= ~CTX_REFRESH;
+	pp->refresh = 0;
+    } else {
+	pp->state |= CTX_REFRESH;
+	pp->refresh = refresh;
+    }
+    return 0;
+}
@@ -32,6 +32,7 @@ enum {
     CTX_THREADS  = (1<<3),
     CTX_CGROUPS  = (1<<4),
     CTX_CONTAINER= (1<<5),
+    CTX_REFRESH  = (1<<6),
 };
 
 typedef struct {
@@ -46,6 +47,7 @@ typedef struct {
     gid_t		gid;
     unsigned int	threads;
     const char		*cgroups;
+    int			refresh;
     proc_container_t	container;
 } proc_perctx_t;
 
@@ -65,4 +67,7 @@ extern int proc_ctx_set_threads(int, unsigned int);
 extern const char *proc_ctx_cgroups(int, const char *);
 extern int proc_ctx_set_cgroups(int, const char *);
 
+extern int proc_ctx_refresh(int);
+extern int proc_ctx_set_refresh(int, int);
+
 #endif	/* _CONTEXTS_H */
@@ -57,6 +57,9 @@ static int			have_access;	/* =1 recvd uid/gid */
 static size_t			_pm_system_pagesize;
 static unsigned int		threads;	/* control.all.threads */
 static char *			cgroups;	/* control.all.cgroups */
+static int			refresh_window;	/* control.all.refresh */
+static int			refresh_uid = -1; /* uid of last shared refresh */
+static pmdaRefresh		*proc_refresh_cache;
 int				conf_gen;	/* hotproc config version, if zero hotproc not configured yet */
 long				hz;
 
@@ -1544,6 +1547,35 @@ static pmdaMetric metrictab[] = {
     { PMDA_PMID(CLUSTER_CONTROL, 3), PM_TYPE_STRING,
     PM_INDOM_NULL, PM_SEM_INSTANT, PMDA_PMUNITS(0,0,0,0,0,0) } },
 
+/* proc.control.all.refresh */
+  { &refresh_window,
+    { PMDA_PMID(CLUSTER_CONTROL, 4), PM_TYPE_32,
+    PM_INDOM_NULL, PM_SEM_DISCRETE, PMDA_PMUNITS(0,1,0,0,PM_TIME_MSEC,0) } },
+
+/* proc.control.perclient.refresh */
+  { NULL,
+    { PMDA_PMID(CLUSTER_CONTROL, 5), PM_TYPE_32,
+    PM_INDOM_NULL, PM_SEM_DISCRETE, PMDA_PMUNITS(0,1,0,0,PM_TIME_MSEC,0) } },
+
+/*
+ * Shared refresh statistics cluster
+ */
+
+/* proc.refresh.hits */
+  { NULL,
+    { PMDA_PMID(CLUSTER_REFRESH, 0), PM_TYPE_U64,
+    REFRESH_INDOM, PM_SEM_COUNTER, PMDA_PMUNITS(0,0,1,0,0,PM_COUNT_ONE) } },
+
+/* proc.refresh.misses */
+  { NULL,
+    { PMDA_PMID(CLUSTER_REFRESH, 1), PM_TYPE_U64,
+    REFRESH_INDOM, PM_SEM_COUNTER, PMDA_PMUNITS(0,0,1,0,0,PM_COUNT_ONE) } },
+
+/* proc.refresh.time */
+  { NULL,
+    { PMDA_PMID(CLUSTER_REFRESH, 2), PM_TYPE_U64,
+    REFRESH_INDOM, PM_SEM_COUNTER, PMDA_PMUNITS(0,1,0,0,PM_TIME_USEC,0) } },
+
 /*
  * hotproc specific clusters
  */
@@ -1625,12 +1657,73 @@ proc_statsfile(const char *path, char *buffer, int size)
     return fopen(buffer, "r");
 }
 
+/*
+ * Values from a recent refresh are shared with subsequent requests
+ * within the (optional) freshness window.  The cgroup and process
+ * clusters are each refreshed as a group, and values are shared only
+ * between clients with the same credentials and default settings.
+ */
+static const int refresh_cgroup_group[] = {
+    CLUSTER_CGROUP_SUBSYS, CLUSTER_CGROUP_MOUNTS,
+    CLUSTER_CPUSET_GROUPS, CLUSTER_CPUACCT_GROUPS, CLUSTER_CPUSCHED_GROUPS,
+    CLUSTER_MEMORY_GROUPS, CLUSTER_NETCLS_GROUPS, CLUSTER_BLKIO_GROUPS, -1
+};
+static const int refresh_pid_group[] = {
+    CLUSTER_PID_STAT, CLUSTER_PID_STATM, CLUSTER_PID_STATUS,
+    CLUSTER_PID_IO, CLUSTER_PID_LABEL, CLUSTER_PID_CGROUP,
+    CLUSTER_PID_SCHEDSTAT, CLUSTER_PID_OOM_SCORE, CLUSTER_PID_FD,
+    CLUSTER_PROC_RUNQ, -1
+};
+
+static int
+proc_refresh_override(int ctx, proc_container_t *container)
+{
+    int		uid = proc_ctx_getuid(ctx);
+
+    /* per-client settings and containers change the values refreshed */
+    if (container ||
+	proc_ctx_threads(ctx, threads) != threads ||
+	proc_ctx_cgroups(ctx, cgroups) != cgroups)
+	return 0;
+    if (uid != refresh_uid) {
+	pmdaRefreshInvalidate(proc_refresh_cache, -1);
+	refresh_uid = uid;
+    }
+    return proc_ctx_refresh(ctx);
+}
+
+static void
+proc_refresh_done(const int *group, int *need_refresh)
+{
+    int		i;
+
+    for (i = 0; group[i] >= 0; i++)
+	if (need_refresh[group[i]])
+	    pmdaRefreshDone(proc_refresh_cache, group[i]);
+}
+
+static void
+refresh_proc_refresh(pmInDom indom)
+{
+    pmdaRefreshStats	stats;
+    char		name[16];
+    int			i;
+
+    pmdaCacheOp(indom, PMDA_CACHE_INACTIVE);
+    for (i = MIN_CLUSTER; i < MAX_CLUSTER; i++) {
+	if (pmdaRefreshGetStats(proc_refresh_cache, i, &stats) <= 0)
+	    continue;
+	pmsprintf(name, sizeof(name), "%d", i);
+	pmdaCacheStore(indom, PMDA_CACHE_ADD, name, NULL);
+    }
+}
+
 static int
 proc_refresh(pmdaExt *pmda, int *need_refresh)
 {
     char cgroup[MAXPATHLEN];
     proc_container_t *container;
-    int sts, cgrouplen = 0;
+    int sts, override, cgrouplen = 0;
 
     if ((container = proc_ctx_container(pmda->e_context)) != NULL) {
 	if ((sts = pmdaRootContainerCGroupName(rootfd,
@@ -1640,6 +1733,12 @@ proc_refresh(pmdaExt *pmda, int *need_refresh)
 	cgrouplen = sts;
     }
 
+    override = proc_refresh_override(pmda->e_context, container);
+    pmdaRefreshCheckGroup(proc_refresh_cache, need_refresh,
+			refresh_cgroup_group, override);
+    pmdaRefreshCheckGroup(proc_refresh_cache, need_refresh,
+			refresh_pid_group, override);
+
     if (need_refresh[CLUSTER_CGROUP_SUBSYS] ||
 	need_refresh[CLUSTER_CGROUP_MOUNTS] ||
 	need_refresh[CLUSTER_CPUSET_GROUPS] || 
@@ -1671,6 +1770,7 @@ proc_refresh(pmdaExt *pmda, int *need_refresh)
 	if (need_refresh[CLUSTER_BLKIO_GROUPS])
 	    refresh_cgroups("blkio", cgroup, cgrouplen,
 			    setup_blkio, refresh_blkio);
+	proc_refresh_done(refresh_cgroup_group, need_refresh);
     }
 
     if (need_refresh[CLUSTER_PID_STAT] ||
@@ -1688,7 +1788,7 @@ proc_refresh(pmdaExt *pmda, int *need_refresh)
 		proc_ctx_threads(pmda->e_context, threads),
 		proc_ctx_cgroups(pmda->e_context, cgroups),
 		container ? cgroup : NULL, cgrouplen);
-
+	proc_refresh_done(refresh_pid_group, need_refresh);
     }
     if (need_refresh[CLUSTER_HOTPROC_PID_STAT] ||
         need_refresh[CLUSTER_HOTPROC_PID_STATM] ||
@@ -1705,6 +1805,9 @@ proc_refresh(pmdaExt *pmda, int *need_refresh)
                         proc_ctx_threads(pmda->e_context, threads),
                         proc_ctx_cgroups(pmda->e_context, cgroups));
     }
+
+    if (need_refresh[CLUSTER_REFRESH])
+	refresh_proc_refresh(INDOM(REFRESH_INDOM));
     return 0;
 }
 
@@ -1768,6 +1871,9 @@ proc_instance(pmInDom indom, int inst, char *name, pmInResult **result, pmdaExt
     case CGROUP_MOUNTS_INDOM:
     	need_refresh[CLUSTER_CGROUP_MOUNTS]++;
 	break;
+    case REFRESH_INDOM:
+	need_refresh[CLUSTER_REFRESH]++;
+	break;
     /* no default label : pmdaInstance will pick up errors */
     }
 
@@ -3148,10 +3254,39 @@ proc_fetchCallBack(pmdaMetric *mdesc, unsigned int inst, pmAtomValue *atom)
 	    cp = proc_ctx_cgroups(pmdaGetContext(), cgroups);
 	    atom->cp = (char *)(cp ? cp : "");
 	    break;
+	/* case 4: not reached -- proc.control.all.refresh is direct */
+	case 5:	/* proc.control.perclient.refresh */
+	    atom->l = proc_ctx_refresh(pmdaGetContext());
+	    break;
+	default:
+	    return PM_ERR_PMID;
+	}
+	break;
+
+    case CLUSTER_REFRESH: {
+	pmdaRefreshStats stats;
+	char *name;
+
+	/* instance names are the cluster numbers of refreshed metrics */
+	if (pmdaCacheLookup(INDOM(REFRESH_INDOM), inst, &name, NULL) !=
+		PMDA_CACHE_ACTIVE ||
+	    pmdaRefreshGetStats(proc_refresh_cache, atoi(name), &stats) <= 0)
+	    return PM_ERR_INST;
+	switch (item) {
+	case 0:	/* proc.refresh.hits */
+	    atom->ull = stats.hits;
+	    break;
+	case 1:	/* proc.refresh.misses */
+	    atom->ull = stats.misses;
+	    break;
+	case 2:	/* proc.refresh.time */
+	    atom->ull = stats.time;
+	    break;
 	default:
 	    return PM_ERR_PMID;
 	}
 	break;
+    }
 
     default: /* unknown cluster */
 	return PM_ERR_PMID;
@@ -3227,6 +3362,25 @@ proc_store(pmResult *result, pmdaExt *pmda)
 			free(av.cp);
 		}
 		break;
+	    case 4: /* proc.control.all.refresh */
+		if (!isroot)
+		    sts = PM_ERR_PERMISSION;
+		else if ((sts = pmExtractValue(vsp->valfmt, &vsp->vlist[0],
+				PM_TYPE_32, &av, PM_TYPE_32)) >= 0) {
+		    if (av.l < 0)
+			sts = PM_ERR_BADSTORE;
+		    else {
+			refresh_window = av.l;
+			pmdaRefreshSetWindow(proc_refresh_cache, -1, av.l);
+		    }
+		}
+		break;
+	    case 5: /* proc.control.perclient.refresh */
+		if ((sts = pmExtractValue(vsp->valfmt, &vsp->vlist[0],
+				PM_TYPE_32, &av, PM_TYPE_32)) >= 0) {
+		    sts = proc_ctx_set_refresh(pmda->e_context, av.l);
+		}
+		break;
 	    default:
 		sts = PM_ERR_PERMISSION;
 		break;
@@ -3532,6 +3686,9 @@ proc_init(pmdaInterface *dp)
     indomtab[HOTPROC_INDOM].it_indom = HOTPROC_INDOM;
     hotproc_pid.indom = &indomtab[HOTPROC_INDOM];
 
+    indomtab[REFRESH_INDOM].it_indom = REFRESH_INDOM;
+    proc_refresh_cache = pmdaRefreshCreate(MAX_CLUSTER, refresh_window);
+
     hotproc_init();
     init_hotproc_pid(&hotproc_pid);
  
@@ -3573,13 +3730,14 @@ pmLongOptions	longopts[] = {
     PMDAOPT_LOGFILE,
     { "with-threads", 0, 'L', 0, "include threads in the all-processes instance domain" },
     { "from-cgroup", 1, 'r', "NAME", "restrict monitoring to processes in the named cgroup" },
+    { "refresh", 1, 'R', "MSEC", "share refreshed values across requests within MSEC milliseconds" },
     PMDAOPT_USERNAME,
     PMOPT_HELP,
     PMDA_OPTIONS_END
 };
 
 pmdaOptions	opts = {
-    .short_options = "AD:d:l:Lr:U:?",
+    .short_options = "AD:d:l:Lr:R:U:?",
     .long_options = longopts,
 };
 
@@ -3588,7 +3746,7 @@ main(int argc, char **argv)
 {
     int			c, sep = pmPathSeparator();
     pmdaInterface	dispatch;
-    char		helppath[MAXPATHLEN];
+    char		helppath[MAXPATHLEN], *endnum;
     char		*username = "root";
 
     _isDSO = 0;
@@ -3608,6 +3766,14 @@ main(int argc, char **argv)
 	case 'r':
 	    cgroups = opts.optarg;
 	    break;
+	case 'R':
+	    refresh_window = (int)strtol(opts.optarg, &endnum, 10);
+	    if (*endnum != '\0' || refresh_window < 0) {
+		fprintf(stderr, "%s: -R requires a non-negative number of milliseconds\n",
+			pmGetProgname());
+		opts.errors++;
+	    }
+	    break;
 	}
     }
 
@@ -95,6 +95,12 @@ static void free_perfdata(perfdata_t *del)
         free_event(&del->events[i]);
     }
     free(del->events);
+    for ( i = 0; i < del->ngroups; ++i )
+    {
+        free(del->groups[i].members);
+        free(del->groups[i].buffer);
+    }
+    free(del->groups);
     free_architecture(del->archinfo);
     free(del->archinfo);
     free(del);
@@ -521,6 +527,118 @@ static int perf_setup_derived_event(perfdata_t *inst, pmcderived_t *derived_pmc)
 }
 
 
+/*
+ * Maximum number of counters of the given type that may be grouped
+ * together: one means no grouping.  A group is only ever scheduled onto
+ * the PMU as a whole, so hardware groups are kept small enough to fit in
+ * the generic counters (leaving one spare, e.g. for the NMI watchdog) and
+ * are still multiplexed against each other.  Software counters do not
+ * use the PMU and can always be grouped.
+ */
+static int perf_group_limit(perfdata_t *inst, uint32_t type)
+{
+    switch(type)
+    {
+        case PERF_TYPE_SOFTWARE:
+            return 0;
+        case PERF_TYPE_HARDWARE:
+        case PERF_TYPE_HW_CACHE:
+        case PERF_TYPE_RAW:
+            return inst->group_limit > 1 ? inst->group_limit : 1;
+    }
+    return 1;
+}
+
+static int perf_group_add(perf_group_t *group, eventcpuinfo_t *info)
+{
+    eventcpuinfo_t **members;
+    uint64_t *buffer;
+    int n = group->nmembers + 1;
+
+    members = realloc(group->members, n * sizeof(*members));
+    if (NULL == members)
+        return -E_PERFEVENT_REALLOC;
+    group->members = members;
+
+    buffer = realloc(group->buffer, (3 + n) * sizeof(*buffer));
+    if (NULL == buffer)
+        return -E_PERFEVENT_REALLOC;
+    group->buffer = buffer;
+
+    members[group->nmembers++] = info;
+    return 0;
+}
+
+/*
+ * Open a counter on its cpu, joining the most recent group of counters of
+ * the same type on that cpu if possible, else as the leader of a new group.
+ * Returns the file descriptor, or -1 with errno set as for perf_event_open.
+ */
+static int perf_group_open(perfdata_t *inst, eventcpuinfo_t *info)
+{
+    perf_group_t *group = NULL, *groups;
+    int i, fd, limit;
+
+    info->group = -1;
+    limit = perf_group_limit(inst, info->hw.type);
+    if (limit == 1)
+        return perf_event_open(&info->hw, -1, info->cpu, -1, 0);
+
+    for (i = inst->ngroups - 1; i >= 0; i--) {
+        group = &inst->groups[i];
+        if (group->cpu == info->cpu && group->type == info->hw.type && !group->full)
+            break;
+    }
+    if (i >= 0) {
+        if (limit == 0 || group->nmembers < limit) {
+            /* the kernel refuses a group that cannot fit on the PMU */
+            fd = perf_event_open(&info->hw, -1, info->cpu, group->fd, 0);
+            if (fd != -1) {
+                info->fd = fd;
+                if (perf_group_add(group, info) < 0) {
+                    close(fd);
+                    errno = ENOMEM;
+                    return -1;
+                }
+                info->group = i;
+                return fd;
+            }
+        }
+        group->full = 1;
+    }
+
+    groups = realloc(inst->groups, (inst->ngroups + 1) * sizeof(*groups));
+    if (NULL == groups) {
+        errno = ENOMEM;
+        return -1;
+    }
+    inst->groups = groups;
+
+    info->hw.read_format |= PERF_FORMAT_GROUP;
+    fd = perf_event_open(&info->hw, -1, info->cpu, -1, 0);
+    if (fd == -1) {
+        info->hw.read_format &= ~PERF_FORMAT_GROUP;
+        return -1;
+    }
+
+    group = &inst->groups[inst->ngroups];
+    memset(group, 0, sizeof(*group));
+    group->fd = fd;
+    group->cpu = info->cpu;
+    group->type = info->hw.type;
+    group->limit = limit;
+    info->fd = fd;
+    if (perf_group_add(group, info) < 0) {
+        free(group->members);
+        free(group->buffer);
+        close(fd);
+        errno = ENOMEM;
+        return -1;
+    }
+    info->group = inst->ngroups++;
+    return fd;
+}
+
 /* Setup an event
  */
 static int perf_setup_event(perfdata_t *inst, const char *eventname,
@@ -586,6 +704,7 @@ static int perf_setup_event(perfdata_t *inst, const char *eventname,
         memset(info, 0, sizeof *info);
         info->fd = -1;
         info->cpu = cpuarr[i];
+        info->group = -1;
 
         if( 0 == strncmp(eventname, "RAPL:", 5) ) {
             // try to use rapl interface
@@ -619,7 +738,7 @@ static int perf_setup_event(perfdata_t *inst, const char *eventname,
             info->hw.exclude_hv = 1;
             info->hw.exclude_guest = 1;
             info->hw.disabled = 1;
-            info->fd = perf_event_open(&info->hw, -1, info->cpu, -1, 0);
+            info->fd = perf_group_open(inst, info);
 
             if (info->fd == -1) {
                 fprintf(stderr, "perf_event_open failed on cpu%d for \"%s\": %s\n",
@@ -652,7 +771,7 @@ static int perf_setup_event(perfdata_t *inst, const char *eventname,
 
             info->hw.disabled = 1;
             info->hw.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
-            info->fd = perf_event_open(&info->hw, -1, info->cpu, -1, 0);
+            info->fd = perf_group_open(inst, info);
             if(info->fd == -1)
             {
                 fprintf(stderr, "perf_event_open failed on cpu%d for \"%s\": %s\n", 
@@ -752,6 +871,7 @@ static int perf_setup_dynamic_events(perfdata_t *inst,
                 memset(info, 0, sizeof *info);
                 info->fd = -1;
                 info->cpu = cpuarr[i];
+                info->group = -1;
                 info->type = EVENT_TYPE_PERF;
                 info->hw.size = sizeof(info->hw);
 
@@ -860,7 +980,7 @@ static void log_events_for_pmu(pfm_pmu_info_t *pinfo)
     }
 }
 
-static int enumerate_active_pmus(char **activepmus, int logevents)
+static int enumerate_active_pmus(char **activepmus, int *ncounters, int logevents)
 {
     pfm_pmu_info_t pinfo;
     pfm_pmu_t j;
@@ -885,6 +1005,7 @@ static int enumerate_active_pmus(char **activepmus, int logevents)
         fprintf(stderr, "Found PMU: %s (%s) identification %d (%d events %d generic counters %d fixed counters)\n",
                 pinfo.name, pinfo.desc, pinfo.pmu, pinfo.nevents, pinfo.num_cntrs, pinfo.num_fixed_cntrs);
         activepmus[nactive] = strdup(pinfo.name);
+        ncounters[nactive] = pinfo.num_cntrs;
         ++nactive;
 
         if(logevents)
@@ -894,7 +1015,7 @@ static int enumerate_active_pmus(char **activepmus, int logevents)
     return nactive;
 }
 
-static pmcsetting_t *search_active_pmus(char **activepmus, int nactive, configuration_t *perfconfig)
+static pmcsetting_t *search_active_pmus(char **activepmus, int nactive, configuration_t *perfconfig, int *active)
 {
     int i, j;
     pmctype_t *entry = NULL;
@@ -908,6 +1029,7 @@ static pmcsetting_t *search_active_pmus(char **activepmus, int nactive, configur
                 if( 0 == strcmp(entry->name, activepmus[j]) )
                 {
                     fprintf(stderr, "Using configuration entry [%s]\n", entry->name);
+                    *active = j;
                     return perfconfig->configArr[i].pmcSettingList;
                 }
             }
@@ -917,11 +1039,12 @@ static pmcsetting_t *search_active_pmus(char **activepmus, int nactive, configur
     return NULL;
 }
 
-static pmcsetting_t *find_perf_settings(configuration_t *perfconfig)
+static pmcsetting_t *find_perf_settings(configuration_t *perfconfig, int *ncounters)
 {
     char *activepmus[PFM_PMU_MAX + 1];
+    int counters[PFM_PMU_MAX + 1];
     int nactive = 0;
-    int i;
+    int i, active = -1;
     pmcsetting_t *ret = NULL;
 
     if((NULL == perfconfig) || (perfconfig->nConfigEntries < 1) )
@@ -929,9 +1052,10 @@ static pmcsetting_t *find_perf_settings(configuration_t *perfconfig)
         return NULL;
     }
     
-    nactive = enumerate_active_pmus(activepmus, 1);
+    nactive = enumerate_active_pmus(activepmus, counters, 1);
 
-    ret = search_active_pmus(activepmus, nactive, perfconfig);
+    ret = search_active_pmus(activepmus, nactive, perfconfig, &active);
+    *ncounters = (active >= 0) ? counters[active] : 0;
 
     for(i = 0; i < nactive; ++i)
     {
@@ -1075,7 +1199,7 @@ static int perf_derived_get(perf_derived_counter **derived_counters,
             pdcounter[idx].counter_list = counter_list;
             if (pdcounter[idx].counter_list != NULL)
                 pdcounter[idx].ninstances = (pdcounter[idx].counter_list)->counter->ninstances;
-            pdcounter[idx].data = calloc(pdcounter[idx].ninstances, sizeof(uint64_t));
+            pdcounter[idx].data = calloc(pdcounter[idx].ninstances, sizeof *pdcounter[idx].data);
         }
         *derived_counters = pdcounter;
         *derived_size = nderivedcounters;
@@ -1084,19 +1208,21 @@ static int perf_derived_get(perf_derived_counter **derived_counters,
     if (pdcounter) {
         nderivedcounters = *derived_size;
 
+        /* accumulate each scaled counter across all instances in turn */
         for (idx = 0; idx < nderivedcounters; idx++) {
+            perf_derived_data *ddata = pdcounter[idx].data;
+            int ninstances = pdcounter[idx].ninstances;
             perf_counter_list *clist;
-            perf_counter *ctr;
-
-            for (cpuidx = 0; cpuidx < pdcounter[idx].ninstances; cpuidx++) {
-                pdcounter[idx].data[cpuidx].value = 0;
-                clist = pdcounter[idx].counter_list;
-                while(clist) {
-                    ctr = clist->counter;
-                    pdcounter[idx].data[cpuidx].value += (ctr->data[cpuidx].value *
-                                                          clist->scale);
-                    clist = clist->next;
-                }
+            perf_data *cdata;
+            double scale;
+
+            for (cpuidx = 0; cpuidx < ninstances; cpuidx++)
+                ddata[cpuidx].value = 0;
+            for (clist = pdcounter[idx].counter_list; clist; clist = clist->next) {
+                cdata = clist->counter->data;
+                scale = clist->scale;
+                for (cpuidx = 0; cpuidx < ninstances; cpuidx++)
+                    ddata[cpuidx].value += cdata[cpuidx].value * scale;
             }
         }
     }
@@ -1104,6 +1230,39 @@ static int perf_derived_get(perf_derived_counter **derived_counters,
     return 0;
 }
 
+/*
+ * Read every group of counters with a single read() each, saving the
+ * values into the counters of the group members.
+ */
+static void perf_group_read(perfdata_t *pdata)
+{
+    perf_group_t *group;
+    eventcpuinfo_t *info;
+    size_t bytes;
+    ssize_t ret;
+    uint64_t nr;
+    int i, j;
+
+    for (i = 0; i < pdata->ngroups; i++) {
+        group = &pdata->groups[i];
+        bytes = (3 + group->nmembers) * sizeof(uint64_t);
+        ret = read(group->fd, group->buffer, bytes);
+        nr = (ret >= (ssize_t)(3 * sizeof(uint64_t))) ? group->buffer[0] : 0;
+        group->valid = (ret == (ssize_t)bytes && nr == group->nmembers);
+        if (!group->valid) {
+            fprintf(stderr, "cannot read group of %d events on cpu %d:%d\n",
+                    group->nmembers, group->cpu, (int)ret);
+            continue;
+        }
+        for (j = 0; j < group->nmembers; j++) {
+            info = group->members[j];
+            info->values[RAW_VALUE] = group->buffer[3 + j];
+            info->values[TIME_ENABLED] = group->buffer[1];
+            info->values[TIME_RUNNING] = group->buffer[2];
+        }
+    }
+}
+
 int perf_get(perfhandle_t *inst, perf_counter **counters, int *size,
              perf_derived_counter **derived_counters, int *derived_size)
 {
@@ -1130,6 +1289,8 @@ int perf_get(perfhandle_t *inst, perf_counter **counters, int *size,
         ncounters = pdata->nevents;
     }
 
+    perf_group_read(pdata);
+
     events_read = 0;
     for(idx = 0; idx < pdata->nevents; ++idx)
     {
@@ -1155,8 +1316,12 @@ int perf_get(perfhandle_t *inst, perf_counter **counters, int *size,
             int ret;
 
             if( info->type == EVENT_TYPE_PERF ) {
-                ret = read(info->fd, info->values, sizeof(info->values));
-                if (ret != sizeof(info->values)) {
+                if (info->group >= 0) {
+                    if (!pdata->groups[info->group].valid)
+                        continue;
+                    ++events_read;
+                }
+                else if ((ret = read(info->fd, info->values, sizeof(info->values))) != sizeof(info->values)) {
                     if (ret == -1)
                         fprintf(stderr, "cannot read event %s on cpu %d:%d\n", event->name, info->cpu, ret);
                     else
@@ -1199,7 +1364,7 @@ int perf_get(perfhandle_t *inst, perf_counter **counters, int *size,
 
 perfhandle_t *perf_event_create(const char *config_file)
 {
-    int ret, i;
+    int ret, i, ncounters = 0;
     perfdata_t *inst = 0;
     configuration_t *perfconfig = 0;
     pmcsetting_t *pmcsetting = 0;
@@ -1231,7 +1396,8 @@ perfhandle_t *perf_event_create(const char *config_file)
         goto out;
     }
 
-    pmcsetting = find_perf_settings(perfconfig);
+    pmcsetting = find_perf_settings(perfconfig, &ncounters);
+    inst->group_limit = ncounters - 1;
     if(NULL == pmcsetting)
     {
         fprintf(stderr, "find_perf_settings unable to find suitable config entry\n");
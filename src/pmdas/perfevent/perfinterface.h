@@ -67,8 +67,23 @@ typedef struct eventcpuinfo_t_ {
     char *fstr; /* fstr from library, must be freed */
     rapl_data_t rapldata;
     int cpu;
+    int group; /* index of the group this counter is read with, or -1 */
 } eventcpuinfo_t;
 
+/* Counters on one cpu that are opened as a group and read together in
+ * a single read() using PERF_FORMAT_GROUP */
+typedef struct perf_group_t_ {
+    int fd; /* group leader */
+    int cpu;
+    uint32_t type; /* perf_event_attr type shared by all members */
+    int limit; /* maximum number of members, zero if unlimited */
+    int full; /* kernel refused another member, no more are added */
+    int valid; /* values from the most recent read are usable */
+    int nmembers;
+    eventcpuinfo_t **members;
+    uint64_t *buffer; /* read buffer: nr, time enabled, time running, values */
+} perf_group_t;
+
 typedef struct event_t_ {
     char *name;
     int disable_event;
@@ -101,6 +116,13 @@ typedef struct perfdata_t_
     int nderivedevents;
     derived_event_t *derived_events;
 
+    int ngroups;
+    perf_group_t *groups;
+
+    /* maximum group size for hardware counters, from the number of
+     * generic counters of the pmu in use */
+    int group_limit;
+
     /* information about the architecture (number of cpus, numa nodes etc) */
     archinfo_t *archinfo;
 
@@ -0,0 +1,1808 @@
+/* A Bison parser, made by GNU Bison 3.8.2.  */
+
+/* Bison implementation for Yacc-like parsers in C
+
+   Copyright (C) 1984, 1989-1990, 2000-2015, 2018-2021 Free Software Foundation,
+   Inc.
+
+   This program is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <https://www.gnu.org/licenses/>.  */
+
+/* As a special exception, you may create a larger work that contains
+   part or all of the Bison parser skeleton and distribute that work
+   under terms of your choice, so long as that work isn't itself a
+   parser generator using the skeleton or a modified version thereof
+   as a parser skeleton.  Alternatively, if you modify or redistribute
+   the parser skeleton itself, you may (at your option) remove this
+   special exception, which will cause the skeleton and the resulting
+   Bison output files to be licensed under the GNU General Public
+   License without this special exception.
+
+   This special exception was added by the Free Software Foundation in
+   version 2.2 of Bison.  */
+
+/* C LALR(1) parser skeleton written by Richard Stallman, by
+   simplifying the original so-called "semantic" parser.  */
+
+/* DO NOT RELY ON FEATURES THAT ARE NOT DOCUMENTED in the manual,
+   especially those whose name start with YY_ or yy_.  They are
+   private implementation details that can be changed or removed.  */
+
+/* All symbols defined below should begin with yy or YY, to avoid
+   infringing on user name space.  This should be done even for local
+   variables, as they might otherwise be expanded by user macros.
+   There are some unavoidable exceptions within include files to
+   define necessary library symbols; they are noted "INFRINGES ON
+   USER NAME SPACE" below.  */
+
+/* Identify Bison output, and Bison version.  */
+#define YYBISON 30802
+
+/* Bison version string.  */
+#define YYBISON_VERSION "3.8.2"
+
+/* Skeleton name.  */
+#define YYSKELETON_NAME "yacc.c"
+
+/* Pure parsers.  */
+#define YYPURE 0
+
+/* Push parsers.  */
+#define YYPUSH 0
+
+/* Pull parsers.  */
+#define YYPULL 1
+
+
+
+
+/* First part of user prologue.  */
+#line 16 "gram.y"
+
+#include <stdio.h>
+#include <string.h>
+#include <sys/time.h>
+
+#include "pmapi.h"
+#include "libpcp.h"
+#include "./pmlc.h"
+
+#ifdef YYDEBUG
+int yydebug=1;
+#endif
+
+int	mystate = GLOBAL;
+int	logfreq;
+int	parse_stmt;
+char	emess[160];
+char	*hostname;
+int	state;
+int	control;
+int	qa_case;
+
+static int	sts;
+
+extern int	port;
+extern int	pid;
+extern int	is_local;
+extern int	is_unix;
+extern int	is_socket_path;
+
+
+#line 103 "gram.tab.c"
+
+# ifndef YY_CAST
+#  ifdef __cplusplus
+#   define YY_CAST(Type, Val) static_cast<Type> (Val)
+#   define YY_REINTERPRET_CAST(Type, Val) reinterpret_cast<Type> (Val)
+#  else
+#   define YY_CAST(Type, Val) ((Type) (Val))
+#   define YY_REINTERPRET_CAST(Type, Val) ((Type) (Val))
+#  endif
+# endif
+# ifndef YY_NULLPTR
+#  if defined __cplusplus
+#   if 201103L <= __cplusplus
+#    define YY_NULLPTR nullptr
+#   else
+#    define YY_NULLPTR 0
+#   endif
+#  else
+#   define YY_NULLPTR ((void*)0)
+#  endif
+# endif
+
+#include "gram.tab.h"
+/* Symbol kind.  */
+enum yysymbol_kind_t
+{
+  YYSYMBOL_YYEMPTY = -2,
+  YYSYMBOL_YYEOF = 0,                      /* "end of file"  */
+  YYSYMBOL_YYerror = 1,                    /* error  */
+  YYSYMBOL_YYUNDEF = 2,                    /* "invalid token"  */
+  YYSYMBOL_LSQB = 3,                       /* LSQB  */
+  YYSYMBOL_RSQB = 4,                       /* RSQB  */
+  YYSYMBOL_COMMA = 5,                      /* COMMA  */
+  YYSYMBOL_LBRACE = 6,                     /* LBRACE  */
+  YYSYMBOL_RBRACE = 7,                     /* RBRACE  */
+  YYSYMBOL_AT = 8,                         /* AT  */
+  YYSYMBOL_EOL = 9,                        /* EOL  */
+  YYSYMBOL_LOG = 10,                       /* LOG  */
+  YYSYMBOL_MANDATORY = 11,                 /* MANDATORY  */
+  YYSYMBOL_ADVISORY = 12,                  /* ADVISORY  */
+  YYSYMBOL_ON = 13,                        /* ON  */
+  YYSYMBOL_OFF = 14,                       /* OFF  */
+  YYSYMBOL_MAYBE = 15,                     /* MAYBE  */
+  YYSYMBOL_EVERY = 16,                     /* EVERY  */
+  YYSYMBOL_ONCE = 17,                      /* ONCE  */
+  YYSYMBOL_MSEC = 18,                      /* MSEC  */
+  YYSYMBOL_SECOND = 19,                    /* SECOND  */
+  YYSYMBOL_MINUTE = 20,                    /* MINUTE  */
+  YYSYMBOL_HOUR = 21,                      /* HOUR  */
+  YYSYMBOL_QUERY = 22,                     /* QUERY  */
+  YYSYMBOL_SHOW = 23,                      /* SHOW  */
+  YYSYMBOL_LOGGER = 24,                    /* LOGGER  */
+  YYSYMBOL_CONNECT = 25,                   /* CONNECT  */
+  YYSYMBOL_PRIMARY = 26,                   /* PRIMARY  */
+  YYSYMBOL_QUIT = 27,                      /* QUIT  */
+  YYSYMBOL_STATUS = 28,                    /* STATUS  */
+  YYSYMBOL_HELP = 29,                      /* HELP  */
+  YYSYMBOL_TIMEZONE = 30,                  /* TIMEZONE  */
+  YYSYMBOL_LOCAL = 31,                     /* LOCAL  */
+  YYSYMBOL_PORT = 32,                      /* PORT  */
+  YYSYMBOL_SOCK = 33,                      /* SOCK  */
+  YYSYMBOL_NEW = 34,                       /* NEW  */
+  YYSYMBOL_VOLUME = 35,                    /* VOLUME  */
+  YYSYMBOL_SYNC = 36,                      /* SYNC  */
+  YYSYMBOL_QA = 37,                        /* QA  */
+  YYSYMBOL_NAME = 38,                      /* NAME  */
+  YYSYMBOL_HOSTNAME = 39,                  /* HOSTNAME  */
+  YYSYMBOL_STRING = 40,                    /* STRING  */
+  YYSYMBOL_URL = 41,                       /* URL  */
+  YYSYMBOL_NUMBER = 42,                    /* NUMBER  */
+  YYSYMBOL_YYACCEPT = 43,                  /* $accept  */
+  YYSYMBOL_stmt = 44,                      /* stmt  */
+  YYSYMBOL_45_1 = 45,                      /* $@1  */
+  YYSYMBOL_46_2 = 46,                      /* $@2  */
+  YYSYMBOL_dowhat = 47,                    /* dowhat  */
+  YYSYMBOL_action = 48,                    /* action  */
+  YYSYMBOL_logopt = 49,                    /* logopt  */
+  YYSYMBOL_cntrl = 50,                     /* cntrl  */
+  YYSYMBOL_frequency = 51,                 /* frequency  */
+  YYSYMBOL_everyopt = 52,                  /* everyopt  */
+  YYSYMBOL_timeunits = 53,                 /* timeunits  */
+  YYSYMBOL_somemetrics = 54,               /* somemetrics  */
+  YYSYMBOL_55_3 = 55,                      /* $@3  */
+  YYSYMBOL_metriclist = 56,                /* metriclist  */
+  YYSYMBOL_metricspec = 57,                /* metricspec  */
+  YYSYMBOL_58_4 = 58,                      /* $@4  */
+  YYSYMBOL_optinst = 59,                   /* optinst  */
+  YYSYMBOL_instancelist = 60,              /* instancelist  */
+  YYSYMBOL_instance = 61,                  /* instance  */
+  YYSYMBOL_loggersopt = 62,                /* loggersopt  */
+  YYSYMBOL_hostopt = 63,                   /* hostopt  */
+  YYSYMBOL_towhom = 64,                    /* towhom  */
+  YYSYMBOL_tzspec = 65                     /* tzspec  */
+};
+typedef enum yysymbol_kind_t yysymbol_kind_t;
+
+
+
+
+#ifdef short
+# undef short
+#endif
+
+/* On compilers that do not define __PTRDIFF_MAX__ etc., make sure
+   <limits.h> and (if available) <stdint.h> are included
+   so that the code can choose integer types of a good width.  */
+
+#ifndef __PTRDIFF_MAX__
+# include <limits.h> /* INFRINGES ON USER NAME SPACE */
+# if defined __STDC_VERSION__ && 199901 <= __STDC_VERSION__
+#  include <stdint.h> /* INFRINGES ON USER NAME SPACE */
+#  define YY_STDINT_H
+# endif
+#endif
+
+/* Narrow types that promote to a signed type and that can represent a
+   signed or unsigned integer of at least N bits.  In tables they can
+   save space and decrease cache pressure.  Promoting to a signed type
+   helps avoid bugs in integer arithmetic.  */
+
+#ifdef __INT_LEAST8_MAX__
+typedef __INT_LEAST8_TYPE__ yytype_int8;
+#elif defined YY_STDINT_H
+typedef int_least8_t yytype_int8;
+#else
+typedef signed char yytype_int8;
+#endif
+
+#ifdef __INT_LEAST16_MAX__
+typedef __INT_LEAST16_TYPE__ yytype_int16;
+#elif defined YY_STDINT_H
+typedef int_least16_t yytype_int16;
+#else
+typedef short yytype_int16;
+#endif
+
+/* Work around bug in HP-UX 11.23, which defines these macros
+   incorrectly for preprocessor constants.  This workaround can likely
+   be removed in 2023, as HPE has promised support for HP-UX 11.23
+   (aka HP-UX 11i v2) only through the end of 2022; see Table 2 of
+   <https://h20195.www2.hpe.com/V2/getpdf.aspx/4AA4-7673ENW.pdf>.  */
+#ifdef __hpux
+# undef UINT_LEAST8_MAX
+# undef UINT_LEAST16_MAX
+# define UINT_LEAST8_MAX 255
+# define UINT_LEAST16_MAX 65535
+#endif
+
+#if defined __UINT_LEAST8_MAX__ && __UINT_LEAST8_MAX__ <= __INT_MAX__
+typedef __UINT_LEAST8_TYPE__ yytype_uint8;
+#elif (!defined __UINT_LEAST8_MAX__ && defined YY_STDINT_H \
+       && UINT_LEAST8_MAX <= INT_MAX)
+typedef uint_least8_t yytype_uint8;
+#elif !defined __UINT_LEAST8_MAX__ && UCHAR_MAX <= INT_MAX
+typedef unsigned char yytype_uint8;
+#else
+typedef short yytype_uint8;
+#endif
+
+#if defined __UINT_LEAST16_MAX__ && __UINT_LEAST16_MAX__ <= __INT_MAX__
+typedef __UINT_LEAST16_TYPE__ yytype_uint16;
+#elif (!defined __UINT_LEAST16_MAX__ && defined YY_STDINT_H \
+       && UINT_LEAST16_MAX <= INT_MAX)
+typedef uint_least16_t yytype_uint16;
+#elif !defined __UINT_LEAST16_MAX__ && USHRT_MAX <= INT_MAX
+typedef unsigned short yytype_uint16;
+#else
+typedef int yytype_uint16;
+#endif
+
+#ifndef YYPTRDIFF_T
+# if defined __PTRDIFF_TYPE__ && defined __PTRDIFF_MAX__
+#  define YYPTRDIFF_T __PTRDIFF_TYPE__
+#  define YYPTRDIFF_MAXIMUM __PTRDIFF_MAX__
+# elif defined PTRDIFF_MAX
+#  ifndef ptrdiff_t
+#   include <stddef.h> /* INFRINGES ON USER NAME SPACE */
+#  endif
+#  define YYPTRDIFF_T ptrdiff_t
+#  define YYPTRDIFF_MAXIMUM PTRDIFF_MAX
+# else
+#  define YYPTRDIFF_T long
+#  define YYPTRDIFF_MAXIMUM LONG_MAX
+# endif
+#endif
+
+#ifndef YYSIZE_T
+# ifdef __SIZE_TYPE__
+#  define YYSIZE_T __SIZE_TYPE__
+# elif defined size_t
+#  define YYSIZE_T size_t
+# elif defined __STDC_VERSION__ && 199901 <= __STDC_VERSION__
+#  include <stddef.h> /* INFRINGES ON USER NAME SPACE */
+#  define YYSIZE_T size_t
+# else
+#  define YYSIZE_T unsigned
+# endif
+#endif
+
+#define YYSIZE_MAXIMUM                                  \
+  YY_CAST (YYPTRDIFF_T,                                 \
+           (YYPTRDIFF_MAXIMUM < YY_CAST (YYSIZE_T, -1)  \
+            ? YYPTRDIFF_MAXIMUM                         \
+            : YY_CAST (YYSIZE_T, -1)))
+
+#define YYSIZEOF(X) YY_CAST (YYPTRDIFF_T, sizeof (X))
+
+
+/* Stored state numbers (used for stacks). */
+typedef yytype_int8 yy_state_t;
+
+/* State numbers in computations.  */
+typedef int yy_state_fast_t;
+
+#ifndef YY_
+# if defined YYENABLE_NLS && YYENABLE_NLS
+#  if ENABLE_NLS
+#   include <libintl.h> /* INFRINGES ON USER NAME SPACE */
+#   define YY_(Msgid) dgettext ("bison-runtime", Msgid)
+#  endif
+# endif
+# ifndef YY_
+#  define YY_(Msgid) Msgid
+# endif
+#endif
+
+
+#ifndef YY_ATTRIBUTE_PURE
+# if defined __GNUC__ && 2 < __GNUC__ + (96 <= __GNUC_MINOR__)
+#  define YY_ATTRIBUTE_PURE __attribute__ ((__pure__))
+# else
+#  define YY_ATTRIBUTE_PURE
+# endif
+#endif
+
+#ifndef YY_ATTRIBUTE_UNUSED
+# if defined __GNUC__ && 2 < __GNUC__ + (7 <= __GNUC_MINOR__)
+#  define YY_ATTRIBUTE_UNUSED __attribute__ ((__unused__))
+# else
+#  define YY_ATTRIBUTE_UNUSED
+# endif
+#endif
+
+/* Suppress unused-variable warnings by "using" E.  */
+#if ! defined lint || defined __GNUC__
+# define YY_USE(E) ((void) (E))
+#else
+# define YY_USE(E) /* empty */
+#endif
+
+/* Suppress an incorrect diagnostic about yylval being uninitialized.  */
+#if defined __GNUC__ && ! defined __ICC && 406 <= __GNUC__ * 100 + __GNUC_MINOR__
+# if __GNUC__ * 100 + __GNUC_MINOR__ < 407
+#  define YY_IGNORE_MAYBE_UNINITIALIZED_BEGIN                           \
+    _Pragma ("GCC diagnostic push")                                     \
+    _Pragma ("GCC diagnostic ignored \"-Wuninitialized\"")
+# else
+#  define YY_IGNORE_MAYBE_UNINITIALIZED_BEGIN                           \
+    _Pragma ("GCC diagnostic push")                                     \
+    _Pragma ("GCC diagnostic ignored \"-Wuninitialized\"")              \
+    _Pragma ("GCC diagnostic ignored \"-Wmaybe-uninitialized\"")
+# endif
+# define YY_IGNORE_MAYBE_UNINITIALIZED_END      \
+    _Pragma ("GCC diagnostic pop")
+#else
+# define YY_INITIAL_VALUE(Value) Value
+#endif
+#ifndef YY_IGNORE_MAYBE_UNINITIALIZED_BEGIN
+# define YY_IGNORE_MAYBE_UNINITIALIZED_BEGIN
+# define YY_IGNORE_MAYBE_UNINITIALIZED_END
+#endif
+#ifndef YY_INITIAL_VALUE
+# define YY_INITIAL_VALUE(Value) /* Nothing. */
+#endif
+
+#if defined __cplusplus && defined __GNUC__ && ! defined __ICC && 6 <= __GNUC__
+# define YY_IGNORE_USELESS_CAST_BEGIN                          \
+    _Pragma ("GCC diagnostic push")                            \
+    _Pragma ("GCC diagnostic ignored \"-Wuseless-cast\"")
+# define YY_IGNORE_USELESS_CAST_END            \
+    _Pragma ("GCC diagnostic pop")
+#endif
+#ifndef YY_IGNORE_USELESS_CAST_BEGIN
+# define YY_IGNORE_USELESS_CAST_BEGIN
+# define YY_IGNORE_USELESS_CAST_END
+#endif
+
+
+#define YY_ASSERT(E) ((void) (0 && (E)))
+
+#if !defined yyoverflow
+
+/* The parser invokes alloca or malloc; define the necessary symbols.  */
+
+# ifdef YYSTACK_USE_ALLOCA
+#  if YYSTACK_USE_ALLOCA
+#   ifdef __GNUC__
+#    define YYSTACK_ALLOC __builtin_alloca
+#   elif defined __BUILTIN_VA_ARG_INCR
+#    include <alloca.h> /* INFRINGES ON USER NAME SPACE */
+#   elif defined _AIX
+#    define YYSTACK_ALLOC __alloca
+#   elif defined _MSC_VER
+#    include <malloc.h> /* INFRINGES ON USER NAME SPACE */
+#    define alloca _alloca
+#   else
+#    define YYSTACK_ALLOC alloca
+#    if ! defined _ALLOCA_H && ! defined EXIT_SUCCESS
+#     include <stdlib.h> /* INFRINGES ON USER NAME SPACE */
+      /* Use EXIT_SUCCESS as a witness for stdlib.h.  */
+#     ifndef EXIT_SUCCESS
+#      define EXIT_SUCCESS 0
+#     endif
+#    endif
+#   endif
+#  endif
+# endif
+
+# ifdef YYSTACK_ALLOC
+   /* Pacify GCC's 'empty if-body' warning.  */
+#  define YYSTACK_FREE(Ptr) do { /* empty */; } while (0)
+#  ifndef YYSTACK_ALLOC_MAXIMUM
+    /* The OS might guarantee only one guard page at the bottom of the stack,
+       and a page size can be as small as 4096 bytes.  So we cannot safely
+       invoke alloca (N) if N exceeds 4096.  Use a slightly smaller number
+       to allow for a few compiler-allocated temporary stack slots.  */
+#   define YYSTACK_ALLOC_MAXIMUM 4032 /* reasonable circa 2006 */
+#  endif
+# else
+#  define YYSTACK_ALLOC YYMALLOC
+#  define YYSTACK_FREE YYFREE
+#  ifndef YYSTACK_ALLOC_MAXIMUM
+#   define YYSTACK_ALLOC_MAXIMUM YYSIZE_MAXIMUM
+#  endif
+#  if (defined __cplusplus && ! defined EXIT_SUCCESS \
+       && ! ((defined YYMALLOC || defined malloc) \
+             && (defined YYFREE || defined free)))
+#   include <stdlib.h> /* INFRINGES ON USER NAME SPACE */
+#   ifndef EXIT_SUCCESS
+#    define EXIT_SUCCESS 0
+#   endif
+#  endif
+#  ifndef YYMALLOC
+#   define YYMALLOC malloc
+#   if ! defined malloc && ! defined EXIT_SUCCESS
+void *malloc (YYSIZE_T); /* INFRINGES ON USER NAME SPACE */
+#   endif
+#  endif
+#  ifndef YYFREE
+#   define YYFREE free
+#   if ! defined free && ! defined EXIT_SUCCESS
+void free (void *); /* INFRINGES ON USER NAME SPACE */
+#   endif
+#  endif
+# endif
+#endif /* !defined yyoverflow */
+
+#if (! defined yyoverflow \
+     && (! defined __cplusplus \
+         || (defined YYSTYPE_IS_TRIVIAL && YYSTYPE_IS_TRIVIAL)))
+
+/* A type that is properly aligned for any stack member.  */
+union yyalloc
+{
+  yy_state_t yyss_alloc;
+  YYSTYPE yyvs_alloc;
+};
+
+/* The size of the maximum gap between one aligned stack and the next.  */
+# define YYSTACK_GAP_MAXIMUM (YYSIZEOF (union yyalloc) - 1)
+
+/* The size of an array large to enough to hold all stacks, each with
+   N elements.  */
+# define YYSTACK_BYTES(N) \
+     ((N) * (YYSIZEOF (yy_state_t) + YYSIZEOF (YYSTYPE)) \
+      + YYSTACK_GAP_MAXIMUM)
+
+# define YYCOPY_NEEDED 1
+
+/* Relocate STACK from its old location to the new one.  The
+   local variables YYSIZE and YYSTACKSIZE give the old and new number of
+   elements in the stack, and YYPTR gives the new location of the
+   stack.  Advance YYPTR to a properly aligned location for the next
+   stack.  */
+# define YYSTACK_RELOCATE(Stack_alloc, Stack)                           \
+    do                                                                  \
+      {                                                                 \
+        YYPTRDIFF_T yynewbytes;                                         \
+        YYCOPY (&yyptr->Stack_alloc, Stack, yysize);                    \
+        Stack = &yyptr->Stack_alloc;                                    \
+        yynewbytes = yystacksize * YYSIZEOF (*Stack) + YYSTACK_GAP_MAXIMUM; \
+        yyptr += yynewbytes / YYSIZEOF (*yyptr);                        \
+      }                                                                 \
+    while (0)
+
+#endif
+
+#if defined YYCOPY_NEEDED && YYCOPY_NEEDED
+/* Copy COUNT objects from SRC to DST.  The source and destination do
+   not overlap.  */
+# ifndef YYCOPY
+#  if defined __GNUC__ && 1 < __GNUC__
+#   define YYCOPY(Dst, Src, Count) \
+      __builtin_memcpy (Dst, Src, YY_CAST (YYSIZE_T, (Count)) * sizeof (*(Src)))
+#  else
+#   define YYCOPY(Dst, Src, Count)              \
+      do                                        \
+        {                                       \
+          YYPTRDIFF_T yyi;                      \
+          for (yyi = 0; yyi < (Count); yyi++)   \
+            (Dst)[yyi] = (Src)[yyi];            \
+        }                                       \
+      while (0)
+#  endif
+# endif
+#endif /* !YYCOPY_NEEDED */
+
+/* YYFINAL -- State number of the termination state.  */
+#define YYFINAL  34
+/* YYLAST -- Last index in YYTABLE.  */
+#define YYLAST   74
+
+/* YYNTOKENS -- Number of terminals.  */
+#define YYNTOKENS  43
+/* YYNNTS -- Number of nonterminals.  */
+#define YYNNTS  23
+/* YYNRULES -- Number of rules.  */
+#define YYNRULES  63
+/* YYNSTATES -- Number of states.  */
+#define YYNSTATES  91
+
+/* YYMAXUTOK -- Last valid token kind.  */
+#define YYMAXUTOK   297
+
+
+/* YYTRANSLATE(TOKEN-NUM) -- Symbol number corresponding to TOKEN-NUM
+   as returned by yylex, with out-of-bounds checking.  */
+#define YYTRANSLATE(YYX)                                \
+  (0 <= (YYX) && (YYX) <= YYMAXUTOK                     \
+   ? YY_CAST (yysymbol_kind_t, yytranslate[YYX])        \
+   : YYSYMBOL_YYUNDEF)
+
+/* YYTRANSLATE[TOKEN-NUM] -- Symbol number corresponding to TOKEN-NUM
+   as returned by yylex.  */
+static const yytype_int8 yytranslate[] =
+{
+       0,     2,     2,     2,     2,     2,     2,     2,     2,     2,
+       2,     2,     2,     2,     2,     2,     2,     2,     2,     2,
+       2,     2,     2,     2,     2,     2,     2,     2,     2,     2,
+       2,     2,     2,     2,     2,     2,     2,     2,     2,     2,
+       2,     2,     2,     2,     2,     2,     2,     2,     2,     2,
+       2,     2,     2,     2,     2,     2,     2,     2,     2,     2,
+       2,     2,     2,     2,     2,     2,     2,     2,     2,     2,
+       2,     2,     2,     2,     2,     2,     2,     2,     2,     2,
+       2,     2,     2,     2,     2,     2,     2,     2,     2,     2,
+       2,     2,     2,     2,     2,     2,     2,     2,     2,     2,
+       2,     2,     2,     2,     2,     2,     2,     2,     2,     2,
+       2,     2,     2,     2,     2,     2,     2,     2,     2,     2,
+       2,     2,     2,     2,     2,     2,     2,     2,     2,     2,
+       2,     2,     2,     2,     2,     2,     2,     2,     2,     2,
+       2,     2,     2,     2,     2,     2,     2,     2,     2,     2,
+       2,     2,     2,     2,     2,     2,     2,     2,     2,     2,
+       2,     2,     2,     2,     2,     2,     2,     2,     2,     2,
+       2,     2,     2,     2,     2,     2,     2,     2,     2,     2,
+       2,     2,     2,     2,     2,     2,     2,     2,     2,     2,
+       2,     2,     2,     2,     2,     2,     2,     2,     2,     2,
+       2,     2,     2,     2,     2,     2,     2,     2,     2,     2,
+       2,     2,     2,     2,     2,     2,     2,     2,     2,     2,
+       2,     2,     2,     2,     2,     2,     2,     2,     2,     2,
+       2,     2,     2,     2,     2,     2,     2,     2,     2,     2,
+       2,     2,     2,     2,     2,     2,     2,     2,     2,     2,
+       2,     2,     2,     2,     2,     2,     1,     2,     3,     4,
+       5,     6,     7,     8,     9,    10,    11,    12,    13,    14,
+      15,    16,    17,    18,    19,    20,    21,    22,    23,    24,
+      25,    26,    27,    28,    29,    30,    31,    32,    33,    34,
+      35,    36,    37,    38,    39,    40,    41,    42
+};
+
+#if YYDEBUG
+/* YYRLINE[YYN] -- Source line where rule number YYN was defined.  */
+static const yytype_int16 yyrline[] =
+{
+       0,    81,    81,    95,    80,   104,   109,   114,   119,   124,
+     129,   134,   139,   144,   150,   155,   158,   161,   162,   163,
+     164,   171,   172,   175,   176,   179,   180,   183,   184,   187,
+     188,   189,   190,   193,   193,   194,   197,   198,   199,   203,
+     202,   227,   228,   231,   232,   233,   236,   237,   238,   241,
+     242,   245,   246,   247,   272,   279,   280,   283,   284,   285,
+     286,   289,   290,   291
+};
+#endif
+
+/** Accessing symbol of state STATE.  */
+#define YY_ACCESSING_SYMBOL(State) YY_CAST (yysymbol_kind_t, yystos[State])
+
+#if YYDEBUG || 0
+/* The user-facing name of the symbol whose (internal) number is
+   YYSYMBOL.  No bounds checking.  */
+static const char *yysymbol_name (yysymbol_kind_t yysymbol) YY_ATTRIBUTE_UNUSED;
+
+/* YYTNAME[SYMBOL-NUM] -- String name of the symbol SYMBOL-NUM.
+   First, the terminals, then, starting at YYNTOKENS, nonterminals.  */
+static const char *const yytname[] =
+{
+  "\"end of file\"", "error", "\"invalid token\"", "LSQB", "RSQB",
+  "COMMA", "LBRACE", "RBRACE", "AT", "EOL", "LOG", "MANDATORY", "ADVISORY",
+  "ON", "OFF", "MAYBE", "EVERY", "ONCE", "MSEC", "SECOND", "MINUTE",
+  "HOUR", "QUERY", "SHOW", "LOGGER", "CONNECT", "PRIMARY", "QUIT",
+  "STATUS", "HELP", "TIMEZONE", "LOCAL", "PORT", "SOCK", "NEW", "VOLUME",
+  "SYNC", "QA", "NAME", "HOSTNAME", "STRING", "URL", "NUMBER", "$accept",
+  "stmt", "$@1", "$@2", "dowhat", "action", "logopt", "cntrl", "frequency",
+  "everyopt", "timeunits", "somemetrics", "$@3", "metriclist",
+  "metricspec", "$@4", "optinst", "instancelist", "instance", "loggersopt",
+  "hostopt", "towhom", "tzspec", YY_NULLPTR
+};
+
+static const char *
+yysymbol_name (yysymbol_kind_t yysymbol)
+{
+  return yytname[yysymbol];
+}
+#endif
+
+#define YYPACT_NINF (-63)
+
+#define yypact_value_is_default(Yyn) \
+  ((Yyn) == YYPACT_NINF)
+
+#define YYTABLE_NINF (-16)
+
+#define yytable_value_is_error(Yyn) \
+  0
+
+/* YYPACT[STATE-NUM] -- Index in YYTABLE of the portion describing
+   STATE-NUM.  */
+static const yytype_int8 yypact[] =
+{
+       0,   -63,   -63,   -63,   -11,   -21,    -6,    10,    29,   -16,
+       7,    31,     8,    52,   -63,   -63,     5,   -63,    53,   -63,
+      20,   -63,   -63,    53,   -63,   -63,   -63,   -63,   -63,   -63,
+      51,    54,   -63,    55,   -63,    -5,    50,   -63,    18,     6,
+      57,   -63,    58,   -63,   -63,   -63,   -63,   -63,   -63,   -63,
+     -63,    42,   -63,   -63,   -63,   -63,   -63,   -63,   -63,   -63,
+      30,    66,    61,   -63,   -63,   -63,    32,    -3,   -63,    11,
+     -63,   -63,    36,    30,   -63,   -63,   -63,   -63,   -63,    67,
+       1,   -63,   -63,   -63,   -63,   -63,   -63,   -63,    11,   -63,
+     -63
+};
+
+/* YYDEFACT[STATE-NUM] -- Default reduction number in state STATE-NUM.
+   Performed when YYTABLE does not specify something else to do.  Zero
+   means the default is an error.  */
+static const yytype_int8 yydefact[] =
+{
+      22,    14,    21,    17,    50,     0,     0,     0,     0,     0,
+       0,     0,     0,     0,     2,    16,     0,    49,    56,    57,
+       0,    60,    58,    56,     8,     9,     7,    62,    61,    63,
+       0,     0,    12,     0,     1,     0,    23,    24,     0,     0,
+       0,    59,     0,    11,    10,    13,    33,    39,     3,    35,
+      20,    28,    19,    51,    52,    55,    53,    54,     5,     6,
+       0,    42,     0,    27,    26,    18,     0,     0,    36,     0,
+      40,     4,     0,     0,    34,    37,    46,    48,    47,     0,
+      43,    29,    30,    31,    32,    25,    38,    41,     0,    44,
+      45
+};
+
+/* YYPGOTO[NTERM-NUM].  */
+static const yytype_int8 yypgoto[] =
+{
+     -63,   -63,   -63,   -63,   -63,   -63,   -63,   -63,   -63,   -63,
+     -63,   -63,   -63,   -63,   -53,   -63,   -63,   -62,   -63,   -63,
+      49,   -63,   -63
+};
+
+/* YYDEFGOTO[NTERM-NUM].  */
+static const yytype_int8 yydefgoto[] =
+{
+       0,    13,    35,    62,    14,    15,    16,    38,    65,    66,
+      85,    48,    60,    67,    49,    61,    70,    79,    80,    18,
+      40,    23,    30
+};
+
+/* YYTABLE[YYPACT[STATE-NUM]] -- What to do in state STATE-NUM.  If
+   positive, shift that token.  If negative, reduce the rule whose
+   number is the opposite.  If YYTABLE_NINF, syntax error.  */
+static const yytype_int8 yytable[] =
+{
+     -15,    46,    73,    24,    74,    19,    88,    68,    27,     1,
+       2,    20,    21,    17,    75,    28,    36,    37,    89,    25,
+      86,    22,     3,     4,    29,     5,    90,     6,     7,     8,
+       9,    51,    52,    47,    10,    47,    11,    12,    26,    76,
+      32,    77,    31,    78,    53,    54,    55,    56,    57,    76,
+      33,    77,    34,    78,    81,    82,    83,    84,    63,    64,
+      43,    39,    41,    44,    45,    50,    58,    59,    47,    69,
+      71,    87,    42,     0,    72
+};
+
+static const yytype_int8 yycheck[] =
+{
+       0,     6,     5,     9,     7,    26,     5,    60,    24,     9,
+      10,    32,    33,    24,    67,    31,    11,    12,    80,     9,
+      73,    42,    22,    23,    40,    25,    88,    27,    28,    29,
+      30,    13,    14,    38,    34,    38,    36,    37,     9,    38,
+       9,    40,    35,    42,    38,    39,    40,    41,    42,    38,
+      42,    40,     0,    42,    18,    19,    20,    21,    16,    17,
+       9,     8,    42,     9,     9,    15,     9,     9,    38,     3,
+       9,     4,    23,    -1,    42
+};
+
+/* YYSTOS[STATE-NUM] -- The symbol kind of the accessing symbol of
+   state STATE-NUM.  */
+static const yytype_int8 yystos[] =
+{
+       0,     9,    10,    22,    23,    25,    27,    28,    29,    30,
+      34,    36,    37,    44,    47,    48,    49,    24,    62,    26,
+      32,    33,    42,    64,     9,     9,     9,    24,    31,    40,
+      65,    35,     9,    42,     0,    45,    11,    12,    50,     8,
+      63,    42,    63,     9,     9,     9,     6,    38,    54,    57,
+      15,    13,    14,    38,    39,    40,    41,    42,     9,     9,
+      55,    58,    46,    16,    17,    51,    52,    56,    57,     3,
+      59,     9,    42,     5,     7,    57,    38,    40,    42,    60,
+      61,    18,    19,    20,    21,    53,    57,     4,     5,    60,
+      60
+};
+
+/* YYR1[RULE-NUM] -- Symbol kind of the left-hand side of rule RULE-NUM.  */
+static const yytype_int8 yyr1[] =
+{
+       0,    43,    45,    46,    44,    44,    44,    44,    44,    44,
+      44,    44,    44,    44,    44,    44,    47,    48,    48,    48,
+      48,    49,    49,    50,    50,    51,    51,    52,    52,    53,
+      53,    53,    53,    55,    54,    54,    56,    56,    56,    58,
+      57,    59,    59,    60,    60,    60,    61,    61,    61,    62,
+      62,    63,    63,    63,    63,    63,    63,    64,    64,    64,
+      64,    65,    65,    65
+};
+
+/* YYR2[RULE-NUM] -- Number of symbols on the right-hand side of rule RULE-NUM.  */
+static const yytype_int8 yyr2[] =
+{
+       0,     2,     0,     0,     5,     4,     4,     2,     2,     2,
+       3,     3,     2,     3,     1,     0,     1,     1,     4,     3,
+       3,     1,     0,     1,     1,     3,     1,     1,     0,     1,
+       1,     1,     1,     0,     4,     1,     1,     2,     3,     0,
+       3,     3,     0,     1,     2,     3,     1,     1,     1,     1,
+       0,     2,     2,     2,     2,     2,     0,     1,     1,     2,
+       1,     1,     1,     1
+};
+
+
+enum { YYENOMEM = -2 };
+
+#define yyerrok         (yyerrstatus = 0)
+#define yyclearin       (yychar = YYEMPTY)
+
+#define YYACCEPT        goto yyacceptlab
+#define YYABORT         goto yyabortlab
+#define YYERROR         goto yyerrorlab
+#define YYNOMEM         goto yyexhaustedlab
+
+
+#define YYRECOVERING()  (!!yyerrstatus)
+
+#define YYBACKUP(Token, Value)                                    \
+  do                                                              \
+    if (yychar == YYEMPTY)                                        \
+      {                                                           \
+        yychar = (Token);                                         \
+        yylval = (Value);                                         \
+        YYPOPSTACK (yylen);                                       \
+        yystate = *yyssp;                                         \
+        goto yybackup;                                            \
+      }                                                           \
+    else                                                          \
+      {                                                           \
+        yyerror (YY_("syntax error: cannot back up")); \
+        YYERROR;                                                  \
+      }                                                           \
+  while (0)
+
+/* Backward compatibility with an undocumented macro.
+   Use YYerror or YYUNDEF. */
+#define YYERRCODE YYUNDEF
+
+
+/* Enable debugging if requested.  */
+#if YYDEBUG
+
+# ifndef YYFPRINTF
+#  include <stdio.h> /* INFRINGES ON USER NAME SPACE */
+#  define YYFPRINTF fprintf
+# endif
+
+# define YYDPRINTF(Args)                        \
+do {                                            \
+  if (yydebug)                                  \
+    YYFPRINTF Args;                             \
+} while (0)
+
+
+
+
+# define YY_SYMBOL_PRINT(Title, Kind, Value, Location)                    \
+do {                                                                      \
+  if (yydebug)                                                            \
+    {                                                                     \
+      YYFPRINTF (stderr, "%s ", Title);                                   \
+      yy_symbol_print (stderr,                                            \
+                  Kind, Value); \
+      YYFPRINTF (stderr, "\n");                                           \
+    }                                                                     \
+} while (0)
+
+
+/*-----------------------------------.
+| Print this symbol's value on YYO.  |
+`-----------------------------------*/
+
+static void
+yy_symbol_value_print (FILE *yyo,
+                       yysymbol_kind_t yykind, YYSTYPE const * const yyvaluep)
+{
+  FILE *yyoutput = yyo;
+  YY_USE (yyoutput);
+  if (!yyvaluep)
+    return;
+  YY_IGNORE_MAYBE_UNINITIALIZED_BEGIN
+  YY_USE (yykind);
+  YY_IGNORE_MAYBE_UNINITIALIZED_END
+}
+
+
+/*---------------------------.
+| Print this symbol on YYO.  |
+`---------------------------*/
+
+static void
+yy_symbol_print (FILE *yyo,
+                 yysymbol_kind_t yykind, YYSTYPE const * const yyvaluep)
+{
+  YYFPRINTF (yyo, "%s %s (",
+             yykind < YYNTOKENS ? "token" : "nterm", yysymbol_name (yykind));
+
+  yy_symbol_value_print (yyo, yykind, yyvaluep);
+  YYFPRINTF (yyo, ")");
+}
+
+/*------------------------------------------------------------------.
+| yy_stack_print -- Print the state stack from its BOTTOM up to its |
+| TOP (included).                                                   |
+`------------------------------------------------------------------*/
+
+static void
+yy_stack_print (yy_state_t *yybottom, yy_state_t *yytop)
+{
+  YYFPRINTF (stderr, "Stack now");
+  for (; yybottom <= yytop; yybottom++)
+    {
+      int yybot = *yybottom;
+      YYFPRINTF (stderr, " %d", yybot);
+    }
+  YYFPRINTF (stderr, "\n");
+}
+
+# define YY_STACK_PRINT(Bottom, Top)                            \
+do {                                                            \
+  if (yydebug)                                                  \
+    yy_stack_print ((Bottom), (Top));                           \
+} while (0)
+
+
+/*------------------------------------------------.
+| Report that the YYRULE is going to be reduced.  |
+`------------------------------------------------*/
+
+static void
+yy_reduce_print (yy_state_t *yyssp, YYSTYPE *yyvsp,
+                 int yyrule)
+{
+  int yylno = yyrline[yyrule];
+  int yynrhs = yyr2[yyrule];
+  int yyi;
+  YYFPRINTF (stderr, "Reducing stack by rule %d (line %d):\n",
+             yyrule - 1, yylno);
+  /* The symbols being reduced.  */
+  for (yyi = 0; yyi < yynrhs; yyi++)
+    {
+      YYFPRINTF (stderr, "   $%d = ", yyi + 1);
+      yy_symbol_print (stderr,
+                       YY_ACCESSING_SYMBOL (+yyssp[yyi + 1 - yynrhs]),
+                       &yyvsp[(yyi + 1) - (yynrhs)]);
+      YYFPRINTF (stderr, "\n");
+    }
+}
+
+# define YY_REDUCE_PRINT(Rule)          \
+do {                                    \
+  if (yydebug)                          \
+    yy_reduce_print (yyssp, yyvsp, Rule); \
+} while (0)
+
+/* Nonzero means print parse trace.  It is left uninitialized so that
+   multiple parsers can coexist.  */
+int yydebug;
+#else /* !YYDEBUG */
+# define YYDPRINTF(Args) ((void) 0)
+# define YY_SYMBOL_PRINT(Title, Kind, Value, Location)
+# define YY_STACK_PRINT(Bottom, Top)
+# define YY_REDUCE_PRINT(Rule)
+#endif /* !YYDEBUG */
+
+
+/* YYINITDEPTH -- initial size of the parser's stacks.  */
+#ifndef YYINITDEPTH
+# define YYINITDEPTH 200
+#endif
+
+/* YYMAXDEPTH -- maximum size the stacks can grow to (effective only
+   if the built-in stack extension method is used).
+
+   Do not make this value too large; the results are undefined if
+   YYSTACK_ALLOC_MAXIMUM < YYSTACK_BYTES (YYMAXDEPTH)
+   evaluated with infinite-precision integer arithmetic.  */
+
+#ifndef YYMAXDEPTH
+# define YYMAXDEPTH 10000
+#endif
+
+
+
+
+
+
+/*-----------------------------------------------.
+| Release the memory associated to this symbol.  |
+`-----------------------------------------------*/
+
+static void
+yydestruct (const char *yymsg,
+            yysymbol_kind_t yykind, YYSTYPE *yyvaluep)
+{
+  YY_USE (yyvaluep);
+  if (!yymsg)
+    yymsg = "Deleting";
+  YY_SYMBOL_PRINT (yymsg, yykind, yyvaluep, yylocationp);
+
+  YY_IGNORE_MAYBE_UNINITIALIZED_BEGIN
+  YY_USE (yykind);
+  YY_IGNORE_MAYBE_UNINITIALIZED_END
+}
+
+
+/* Lookahead token kind.  */
+int yychar;
+
+/* The semantic value of the lookahead symbol.  */
+YYSTYPE yylval;
+/* Number of syntax errors so far.  */
+int yynerrs;
+
+
+
+
+/*----------.
+| yyparse.  |
+`----------*/
+
+int
+yyparse (void)
+{
+    yy_state_fast_t yystate = 0;
+    /* Number of tokens to shift before error messages enabled.  */
+    int yyerrstatus = 0;
+
+    /* Refer to the stacks through separate pointers, to allow yyoverflow
+       to reallocate them elsewhere.  */
+
+    /* Their size.  */
+    YYPTRDIFF_T yystacksize = YYINITDEPTH;
+
+    /* The state stack: array, bottom, top.  */
+    yy_state_t yyssa[YYINITDEPTH];
+    yy_state_t *yyss = yyssa;
+    yy_state_t *yyssp = yyss;
+
+    /* The semantic value stack: array, bottom, top.  */
+    YYSTYPE yyvsa[YYINITDEPTH];
+    YYSTYPE *yyvs = yyvsa;
+    YYSTYPE *yyvsp = yyvs;
+
+  int yyn;
+  /* The return value of yyparse.  */
+  int yyresult;
+  /* Lookahead symbol kind.  */
+  yysymbol_kind_t yytoken = YYSYMBOL_YYEMPTY;
+  /* The variables used to return semantic value and location from the
+     action routines.  */
+  YYSTYPE yyval;
+
+
+
+#define YYPOPSTACK(N)   (yyvsp -= (N), yyssp -= (N))
+
+  /* The number of symbols on the RHS of the reduced rule.
+     Keep to zero when no symbol should be popped.  */
+  int yylen = 0;
+
+  YYDPRINTF ((stderr, "Starting parse\n"));
+
+  yychar = YYEMPTY; /* Cause a token to be read.  */
+
+  goto yysetstate;
+
+
+/*------------------------------------------------------------.
+| yynewstate -- push a new state, which is found in yystate.  |
+`------------------------------------------------------------*/
+yynewstate:
+  /* In all cases, when you get here, the value and location stacks
+     have just been pushed.  So pushing a state here evens the stacks.  */
+  yyssp++;
+
+
+/*--------------------------------------------------------------------.
+| yysetstate -- set current state (the top of the stack) to yystate.  |
+`--------------------------------------------------------------------*/
+yysetstate:
+  YYDPRINTF ((stderr, "Entering state %d\n", yystate));
+  YY_ASSERT (0 <= yystate && yystate < YYNSTATES);
+  YY_IGNORE_USELESS_CAST_BEGIN
+  *yyssp = YY_CAST (yy_state_t, yystate);
+  YY_IGNORE_USELESS_CAST_END
+  YY_STACK_PRINT (yyss, yyssp);
+
+  if (yyss + yystacksize - 1 <= yyssp)
+#if !defined yyoverflow && !defined YYSTACK_RELOCATE
+    YYNOMEM;
+#else
+    {
+      /* Get the current used size of the three stacks, in elements.  */
+      YYPTRDIFF_T yysize = yyssp - yyss + 1;
+
+# if defined yyoverflow
+      {
+        /* Give user a chance to reallocate the stack.  Use copies of
+           these so that the &'s don't force the real ones into
+           memory.  */
+        yy_state_t *yyss1 = yyss;
+        YYSTYPE *yyvs1 = yyvs;
+
+        /* Each stack pointer address is followed by the size of the
+           data in use in that stack, in bytes.  This used to be a
+           conditional around just the two extra args, but that might
+           be undefined if yyoverflow is a macro.  */
+        yyoverflow (YY_("memory exhausted"),
+                    &yyss1, yysize * YYSIZEOF (*yyssp),
+                    &yyvs1, yysize * YYSIZEOF (*yyvsp),
+                    &yystacksize);
+        yyss = yyss1;
+        yyvs = yyvs1;
+      }
+# else /* defined YYSTACK_RELOCATE */
+      /* Extend the stack our own way.  */
+      if (YYMAXDEPTH <= yystacksize)
+        YYNOMEM;
+      yystacksize *= 2;
+      if (YYMAXDEPTH < yystacksize)
+        yystacksize = YYMAXDEPTH;
+
+      {
+        yy_state_t *yyss1 = yyss;
+        union yyalloc *yyptr =
+          YY_CAST (union yyalloc *,
+                   YYSTACK_ALLOC (YY_CAST (YYSIZE_T, YYSTACK_BYTES (yystacksize))));
+        if (! yyptr)
+          YYNOMEM;
+        YYSTACK_RELOCATE (yyss_alloc, yyss);
+        YYSTACK_RELOCATE (yyvs_alloc, yyvs);
+#  undef YYSTACK_RELOCATE
+        if (yyss1 != yyssa)
+          YYSTACK_FREE (yyss1);
+      }
+# endif
+
+      yyssp = yyss + yysize - 1;
+      yyvsp = yyvs + yysize - 1;
+
+      YY_IGNORE_USELESS_CAST_BEGIN
+      YYDPRINTF ((stderr, "Stack size increased to %ld\n",
+                  YY_CAST (long, yystacksize)));
+      YY_IGNORE_USELESS_CAST_END
+
+      if (yyss + yystacksize - 1 <= yyssp)
+        YYABORT;
+    }
+#endif /* !defined yyoverflow && !defined YYSTACK_RELOCATE */
+
+
+  if (yystate == YYFINAL)
+    YYACCEPT;
+
+  goto yybackup;
+
+
+/*-----------.
+| yybackup.  |
+`-----------*/
+yybackup:
+  /* Do appropriate processing given the current state.  Read a
+     lookahead token if we need one and don't already have one.  */
+
+  /* First try to decide what to do without reference to lookahead token.  */
+  yyn = yypact[yystate];
+  if (yypact_value_is_default (yyn))
+    goto yydefault;
+
+  /* Not known => get a lookahead token if don't already have one.  */
+
+  /* YYCHAR is either empty, or end-of-input, or a valid lookahead.  */
+  if (yychar == YYEMPTY)
+    {
+      YYDPRINTF ((stderr, "Reading a token\n"));
+      yychar = yylex ();
+    }
+
+  if (yychar <= YYEOF)
+    {
+      yychar = YYEOF;
+      yytoken = YYSYMBOL_YYEOF;
+      YYDPRINTF ((stderr, "Now at end of input.\n"));
+    }
+  else if (yychar == YYerror)
+    {
+      /* The scanner already issued an error message, process directly
+         to error recovery.  But do not keep the error token as
+         lookahead, it is too special and may lead us to an endless
+         loop in error recovery. */
+      yychar = YYUNDEF;
+      yytoken = YYSYMBOL_YYerror;
+      goto yyerrlab1;
+    }
+  else
+    {
+      yytoken = YYTRANSLATE (yychar);
+      YY_SYMBOL_PRINT ("Next token is", yytoken, &yylval, &yylloc);
+    }
+
+  /* If the proper action on seeing token YYTOKEN is to reduce or to
+     detect an error, take that action.  */
+  yyn += yytoken;
+  if (yyn < 0 || YYLAST < yyn || yycheck[yyn] != yytoken)
+    goto yydefault;
+  yyn = yytable[yyn];
+  if (yyn <= 0)
+    {
+      if (yytable_value_is_error (yyn))
+        goto yyerrlab;
+      yyn = -yyn;
+      goto yyreduce;
+    }
+
+  /* Count tokens shifted since error; after three, turn off error
+     status.  */
+  if (yyerrstatus)
+    yyerrstatus--;
+
+  /* Shift the lookahead token.  */
+  YY_SYMBOL_PRINT ("Shifting", yytoken, &yylval, &yylloc);
+  yystate = yyn;
+  YY_IGNORE_MAYBE_UNINITIALIZED_BEGIN
+  *++yyvsp = yylval;
+  YY_IGNORE_MAYBE_UNINITIALIZED_END
+
+  /* Discard the shifted token.  */
+  yychar = YYEMPTY;
+  goto yynewstate;
+
+
+/*-----------------------------------------------------------.
+| yydefault -- do the default action for the current state.  |
+`-----------------------------------------------------------*/
+yydefault:
+  yyn = yydefact[yystate];
+  if (yyn == 0)
+    goto yyerrlab;
+  goto yyreduce;
+
+
+/*-----------------------------.
+| yyreduce -- do a reduction.  |
+`-----------------------------*/
+yyreduce:
+  /* yyn is the number of a rule to reduce with.  */
+  yylen = yyr2[yyn];
+
+  /* If YYLEN is nonzero, implement the default value of the action:
+     '$$ = $1'.
+
+     Otherwise, the following line sets YYVAL to garbage.
+     This behavior is undocumented and Bison
+     users should not rely upon it.  Assigning to YYVAL
+     unconditionally makes the parser a bit smaller, and it avoids a
+     GCC warning that YYVAL may be used uninitialized.  */
+  yyval = yyvsp[1-yylen];
+
+
+  YY_REDUCE_PRINT (yyn);
+  switch (yyn)
+    {
+  case 2: /* $@1: %empty  */
+#line 81 "gram.y"
+                {
+		    mystate |= INSPEC;
+		    if (!connected()) {
+			metric_cnt = -1;
+			return 0;
+		    }
+		    if (ConnectPMCD() < 0) {
+			yyerror("");
+			metric_cnt = -1;
+			return 0;
+		    }
+		    beginmetrics();
+		}
+#line 1228 "gram.tab.c"
+    break;
+
+  case 3: /* $@2: %empty  */
+#line 95 "gram.y"
+                {
+		    mystate = GLOBAL;
+		    endmetrics();
+		}
+#line 1237 "gram.tab.c"
+    break;
+
+  case 4: /* stmt: dowhat $@1 somemetrics $@2 EOL  */
+#line 100 "gram.y"
+                {
+		    parse_stmt = LOG;
+		    YYACCEPT;
+		}
+#line 1246 "gram.tab.c"
+    break;
+
+  case 5: /* stmt: SHOW loggersopt hostopt EOL  */
+#line 105 "gram.y"
+                {
+		    parse_stmt = SHOW;
+		    YYACCEPT;
+		}
+#line 1255 "gram.tab.c"
+    break;
+
+  case 6: /* stmt: CONNECT towhom hostopt EOL  */
+#line 110 "gram.y"
+                {
+		    parse_stmt = CONNECT;
+		    YYACCEPT;
+		}
+#line 1264 "gram.tab.c"
+    break;
+
+  case 7: /* stmt: HELP EOL  */
+#line 115 "gram.y"
+                {
+		    parse_stmt = HELP;
+		    YYACCEPT;
+		}
+#line 1273 "gram.tab.c"
+    break;
+
+  case 8: /* stmt: QUIT EOL  */
+#line 120 "gram.y"
+                {
+		    parse_stmt = QUIT;
+		    YYACCEPT;
+		}
+#line 1282 "gram.tab.c"
+    break;
+
+  case 9: /* stmt: STATUS EOL  */
+#line 125 "gram.y"
+                {
+		    parse_stmt = STATUS;
+		    YYACCEPT;
+		}
+#line 1291 "gram.tab.c"
+    break;
+
+  case 10: /* stmt: NEW VOLUME EOL  */
+#line 130 "gram.y"
+                {
+		    parse_stmt = NEW;
+		    YYACCEPT;
+		}
+#line 1300 "gram.tab.c"
+    break;
+
+  case 11: /* stmt: TIMEZONE tzspec EOL  */
+#line 135 "gram.y"
+                {
+		    parse_stmt = TIMEZONE;
+		    YYACCEPT;
+		}
+#line 1309 "gram.tab.c"
+    break;
+
+  case 12: /* stmt: SYNC EOL  */
+#line 140 "gram.y"
+                {
+		    parse_stmt = SYNC;
+		    YYACCEPT;
+		}
+#line 1318 "gram.tab.c"
+    break;
+
+  case 13: /* stmt: QA NUMBER EOL  */
+#line 145 "gram.y"
+                {
+		    parse_stmt = QA;
+		    qa_case = (yyvsp[-1].lval);
+		    YYACCEPT;
+		}
+#line 1328 "gram.tab.c"
+    break;
+
+  case 14: /* stmt: EOL  */
+#line 151 "gram.y"
+                {
+		    parse_stmt = 0;
+		    YYACCEPT;
+		}
+#line 1337 "gram.tab.c"
+    break;
+
+  case 15: /* stmt: %empty  */
+#line 155 "gram.y"
+                  { YYERROR; }
+#line 1343 "gram.tab.c"
+    break;
+
+  case 17: /* action: QUERY  */
+#line 161 "gram.y"
+                                                { state = PM_LOG_ENQUIRE; }
+#line 1349 "gram.tab.c"
+    break;
+
+  case 18: /* action: logopt cntrl ON frequency  */
+#line 162 "gram.y"
+                                                { state = PM_LOG_ON; }
+#line 1355 "gram.tab.c"
+    break;
+
+  case 19: /* action: logopt cntrl OFF  */
+#line 163 "gram.y"
+                                                { state = PM_LOG_OFF; }
+#line 1361 "gram.tab.c"
+    break;
+
+  case 20: /* action: logopt MANDATORY MAYBE  */
+#line 165 "gram.y"
+                {
+		    control = PM_LOG_MANDATORY;
+		    state = PM_LOG_MAYBE;
+		}
+#line 1370 "gram.tab.c"
+    break;
+
+  case 23: /* cntrl: MANDATORY  */
+#line 175 "gram.y"
+                                                { control = PM_LOG_MANDATORY; }
+#line 1376 "gram.tab.c"
+    break;
+
+  case 24: /* cntrl: ADVISORY  */
+#line 176 "gram.y"
+                                                { control = PM_LOG_ADVISORY; }
+#line 1382 "gram.tab.c"
+    break;
+
+  case 25: /* frequency: everyopt NUMBER timeunits  */
+#line 179 "gram.y"
+                                                { logfreq = (yyvsp[-1].lval) * (yyvsp[0].lval); }
+#line 1388 "gram.tab.c"
+    break;
+
+  case 26: /* frequency: ONCE  */
+#line 180 "gram.y"
+                                                { logfreq = -1; }
+#line 1394 "gram.tab.c"
+    break;
+
+  case 29: /* timeunits: MSEC  */
+#line 187 "gram.y"
+                                { (yyval.lval) = 1; }
+#line 1400 "gram.tab.c"
+    break;
+
+  case 30: /* timeunits: SECOND  */
+#line 188 "gram.y"
+                                { (yyval.lval) = 1000; }
+#line 1406 "gram.tab.c"
+    break;
+
+  case 31: /* timeunits: MINUTE  */
+#line 189 "gram.y"
+                                { (yyval.lval) = 60000; }
+#line 1412 "gram.tab.c"
+    break;
+
+  case 32: /* timeunits: HOUR  */
+#line 190 "gram.y"
+                                { (yyval.lval) = 3600000; }
+#line 1418 "gram.tab.c"
+    break;
+
+  case 33: /* $@3: %empty  */
+#line 193 "gram.y"
+                         { mystate |= INSPECLIST; }
+#line 1424 "gram.tab.c"
+    break;
+
+  case 39: /* $@4: %empty  */
+#line 203 "gram.y"
+                {
+		    beginmetgrp();
+		    if ((sts = pmTraversePMNS((yyvsp[0].str), addmetric)) < 0)
+			/* metric_cnt is set by addmetric but if
+			 * traversePMNS fails, set it so that the bad
+			 * news is visible to other routines
+			 */
+			metric_cnt = sts;
+		    else if (metric_cnt < 0) /* addmetric failed */
+			sts = metric_cnt;
+
+		    if (sts < 0 || metric_cnt == 0) {
+			pmsprintf(emess, sizeof(emess),
+				"Problem with lookup for metric \"%s\" ...",(yyvsp[0].str));
+			yywarn(emess);
+			if (sts < 0) {
+			    fprintf(stderr, "Reason: ");
+			    fprintf(stderr, "%s\n", pmErrStr(sts));
+			}
+		    }
+		}
+#line 1450 "gram.tab.c"
+    break;
+
+  case 40: /* metricspec: NAME $@4 optinst  */
+#line 224 "gram.y"
+                                { endmetgrp(); }
+#line 1456 "gram.tab.c"
+    break;
+
+  case 46: /* instance: NAME  */
+#line 236 "gram.y"
+                                { addinst((yyvsp[0].str), 0); }
+#line 1462 "gram.tab.c"
+    break;
+
+  case 47: /* instance: NUMBER  */
+#line 237 "gram.y"
+                                { addinst(NULL, (yyvsp[0].lval)); }
+#line 1468 "gram.tab.c"
+    break;
+
+  case 48: /* instance: STRING  */
+#line 238 "gram.y"
+                                { addinst((yyvsp[0].str), 0); }
+#line 1474 "gram.tab.c"
+    break;
+
+  case 51: /* hostopt: AT NAME  */
+#line 245 "gram.y"
+                                { hostname = strdup((yyvsp[0].str)); }
+#line 1480 "gram.tab.c"
+    break;
+
+  case 52: /* hostopt: AT HOSTNAME  */
+#line 246 "gram.y"
+                                { hostname = strdup((yyvsp[0].str)); }
+#line 1486 "gram.tab.c"
+    break;
+
+  case 53: /* hostopt: AT URL  */
+#line 248 "gram.y"
+                {
+		    char	*prefix_end;
+		    size_t	prefix_len;
+		    hostname = strdup((yyvsp[0].str));
+		    prefix_end = strchr(hostname, ':');
+		    if (prefix_end != NULL) {
+			prefix_len = prefix_end - hostname + 1;
+			if (prefix_len == 6 && strncmp(hostname, "local:", prefix_len) == 0)
+			    is_local = 1;
+			else if (prefix_len == 5 && strncmp(hostname, "unix:", prefix_len) == 0)
+			    is_unix = 1;
+			if (is_local || is_unix) {
+			    const char *p;
+			    /*
+			     * Find out is a path was specified.
+			     * Skip any initial path separators.
+			     */
+			    for (p = hostname + prefix_len; *p == pmPathSeparator(); ++p)
+				;
+			    if (*p != '\0')
+				is_socket_path = 1;
+			}
+		    }
+		}
+#line 1515 "gram.tab.c"
+    break;
+
+  case 54: /* hostopt: AT NUMBER  */
+#line 273 "gram.y"
+                { 
+			/* That MUST be a mistake! */
+			char tb[64];
+			pmsprintf(tb, sizeof(tb), "%d", (int)(yyvsp[0].lval));
+			hostname = strdup(tb); 
+		}
+#line 1526 "gram.tab.c"
+    break;
+
+  case 55: /* hostopt: AT STRING  */
+#line 279 "gram.y"
+                                { hostname = strdup((yyvsp[0].str)); }
+#line 1532 "gram.tab.c"
+    break;
+
+  case 57: /* towhom: PRIMARY  */
+#line 283 "gram.y"
+                                { pid = PM_LOG_PRIMARY_PID; port = PM_LOG_NO_PORT; }
+#line 1538 "gram.tab.c"
+    break;
+
+  case 58: /* towhom: NUMBER  */
+#line 284 "gram.y"
+                                { pid = (yyvsp[0].lval); port = PM_LOG_NO_PORT; }
+#line 1544 "gram.tab.c"
+    break;
+
+  case 59: /* towhom: PORT NUMBER  */
+#line 285 "gram.y"
+                                { pid = PM_LOG_NO_PID; port = (yyvsp[0].lval); }
+#line 1550 "gram.tab.c"
+    break;
+
+  case 60: /* towhom: SOCK  */
+#line 286 "gram.y"
+                                { pid = PM_LOG_NO_PID; port = PM_LOG_NO_PORT; }
+#line 1556 "gram.tab.c"
+    break;
+
+  case 61: /* tzspec: LOCAL  */
+#line 289 "gram.y"
+                                { tztype = TZ_LOCAL; }
+#line 1562 "gram.tab.c"
+    break;
+
+  case 62: /* tzspec: LOGGER  */
+#line 290 "gram.y"
+                                { tztype = TZ_LOGGER; }
+#line 1568 "gram.tab.c"
+    break;
+
+  case 63: /* tzspec: STRING  */
+#line 292 "gram.y"
+                {
+		    tztype = TZ_OTHER;
+		    /* ignore the quotes: skip the leading one and
+		     * clobber the trailing one with a null to
+		     * terminate the string really required.
+		     */
+		    if (tz != NULL)
+			free(tz);
+		    if ((tz = strdup((yyvsp[0].str))) == NULL) {
+			pmNoMem("setting up timezone",
+				 strlen((yyvsp[0].str)), PM_FATAL_ERR);
+		    }
+		}
+#line 1586 "gram.tab.c"
+    break;
+
+
+#line 1590 "gram.tab.c"
+
+      default: break;
+    }
+  /* User semantic actions sometimes alter yychar, and that requires
+     that yytoken be updated with the new translation.  We take the
+     approach of translating immediately before every use of yytoken.
+     One alternative is translating here after every semantic action,
+     but that translation would be missed if the semantic action invokes
+     YYABORT, YYACCEPT, or YYERROR immediately after altering yychar or
+     if it invokes YYBACKUP.  In the case of YYABORT or YYACCEPT, an
+     incorrect destructor might then be invoked immediately.  In the
+     case of YYERROR or YYBACKUP, subsequent parser actions might lead
+     to an incorrect destructor call or verbose syntax error message
+     before the lookahead is translated.  */
+  YY_SYMBOL_PRINT ("-> $$ =", YY_CAST (yysymbol_kind_t, yyr1[yyn]), &yyval, &yyloc);
+
+  YYPOPSTACK (yylen);
+  yylen = 0;
+
+  *++yyvsp = yyval;
+
+  /* Now 'shift' the result of the reduction.  Determine what state
+     that goes to, based on the state we popped back to and the rule
+     number reduced by.  */
+  {
+    const int yylhs = yyr1[yyn] - YYNTOKENS;
+    const int yyi = yypgoto[yylhs] + *yyssp;
+    yystate = (0 <= yyi && yyi <= YYLAST && yycheck[yyi] == *yyssp
+               ? yytable[yyi]
+               : yydefgoto[yylhs]);
+  }
+
+  goto yynewstate;
+
+
+/*--------------------------------------.
+| yyerrlab -- here on detecting error.  |
+`--------------------------------------*/
+yyerrlab:
+  /* Make sure we have latest lookahead translation.  See comments at
+     user semantic actions for why this is necessary.  */
+  yytoken = yychar == YYEMPTY ? YYSYMBOL_YYEMPTY : YYTRANSLATE (yychar);
+  /* If not already recovering from an error, report this error.  */
+  if (!yyerrstatus)
+    {
+      ++yynerrs;
+      yyerror (YY_("syntax error"));
+    }
+
+  if (yyerrstatus == 3)
+    {
+      /* If just tried and failed to reuse lookahead token after an
+         error, discard it.  */
+
+      if (yychar <= YYEOF)
+        {
+          /* Return failure if at end of input.  */
+          if (yychar == YYEOF)
+            YYABORT;
+        }
+      else
+        {
+          yydestruct ("Error: discarding",
+                      yytoken, &yylval);
+          yychar = YYEMPTY;
+        }
+    }
+
+  /* Else will try to reuse lookahead token after shifting the error
+     token.  */
+  goto yyerrlab1;
+
+
+/*---------------------------------------------------.
+| yyerrorlab -- error raised explicitly by YYERROR.  |
+`---------------------------------------------------*/
+yyerrorlab:
+  /* Pacify compilers when the user code never invokes YYERROR and the
+     label yyerrorlab therefore never appears in user code.  */
+  if (0)
+    YYERROR;
+  ++yynerrs;
+
+  /* Do not reclaim the symbols of the rule whose action triggered
+     this YYERROR.  */
+  YYPOPSTACK (yylen);
+  yylen = 0;
+  YY_STACK_PRINT (yyss, yyssp);
+  yystate = *yyssp;
+  goto yyerrlab1;
+
+
+/*-------------------------------------------------------------.
+| yyerrlab1 -- common code for both syntax error and YYERROR.  |
+`-------------------------------------------------------------*/
+yyerrlab1:
+  yyerrstatus = 3;      /* Each real token shifted decrements this.  */
+
+  /* Pop stack until we find a state that shifts the error token.  */
+  for (;;)
+    {
+      yyn = yypact[yystate];
+      if (!yypact_value_is_default (yyn))
+        {
+          yyn += YYSYMBOL_YYerror;
+          if (0 <= yyn && yyn <= YYLAST && yycheck[yyn] == YYSYMBOL_YYerror)
+            {
+              yyn = yytable[yyn];
+              if (0 < yyn)
+                break;
+            }
+        }
+
+      /* Pop the current state because it cannot handle the error token.  */
+      if (yyssp == yyss)
+        YYABORT;
+
+
+      yydestruct ("Error: popping",
+                  YY_ACCESSING_SYMBOL (yystate), yyvsp);
+      YYPOPSTACK (1);
+      yystate = *yyssp;
+      YY_STACK_PRINT (yyss, yyssp);
+    }
+
+  YY_IGNORE_MAYBE_UNINITIALIZED_BEGIN
+  *++yyvsp = yylval;
+  YY_IGNORE_MAYBE_UNINITIALIZED_END
+
+
+  /* Shift the error token.  */
+  YY_SYMBOL_PRINT ("Shifting", YY_ACCESSING_SYMBOL (yyn), yyvsp, yylsp);
+
+  yystate = yyn;
+  goto yynewstate;
+
+
+/*-------------------------------------.
+| yyacceptlab -- YYACCEPT comes here.  |
+`-------------------------------------*/
+yyacceptlab:
+  yyresult = 0;
+  goto yyreturnlab;
+
+
+/*-----------------------------------.
+| yyabortlab -- YYABORT comes here.  |
+`-----------------------------------*/
+yyabortlab:
+  yyresult = 1;
+  goto yyreturnlab;
+
+
+/*-----------------------------------------------------------.
+| yyexhaustedlab -- YYNOMEM (memory exhaustion) comes here.  |
+`-----------------------------------------------------------*/
+yyexhaustedlab:
+  yyerror (YY_("memory exhausted"));
+  yyresult = 2;
+  goto yyreturnlab;
+
+
+/*----------------------------------------------------------.
+| yyreturnlab -- parsing is finished, clean up and return.  |
+`----------------------------------------------------------*/
+yyreturnlab:
+  if (yychar != YYEMPTY)
+    {
+      /* Make sure we have latest lookahead translation.  See comments at
+         user semantic actions for why this is necessary.  */
+      yytoken = YYTRANSLATE (yychar);
+      yydestruct ("Cleanup: discarding lookahead",
+                  yytoken, &yylval);
+    }
+  /* Do not reclaim the symbols of the rule whose action triggered
+     this YYABORT or YYACCEPT.  */
+  YYPOPSTACK (yylen);
+  YY_STACK_PRINT (yyss, yyssp);
+  while (yyssp != yyss)
+    {
+      yydestruct ("Cleanup: popping",
+                  YY_ACCESSING_SYMBOL (+*yyssp), yyvsp);
+      YYPOPSTACK (1);
+    }
+#ifndef yyoverflow
+  if (yyss != yyssa)
+    YYSTACK_FREE (yyss);
+#endif
+
+  return yyresult;
+}
+
+#line 307 "gram.y"
+
+
+extern char	*configfile;
+extern int	lineno;
+
+void
+yywarn(char *s)
+{
+    fprintf(stderr, "Warning [%s, line %d]\n",
+	    configfile == NULL ? "<stdin>" : configfile, lineno);
+    if (s != NULL && s[0] != '\0')
+	fprintf(stderr, "%s\n", s);
+}
+
+void
+yyerror(char *s)
+{
+    fprintf(stderr, "Error [%s, line %d]\n",
+	    configfile == NULL ? "<stdin>" : configfile, lineno);
+    if (s != NULL && s[0] != '\0')
+	fprintf(stderr, "%s\n", s);
+
+    skipAhead ();
+    yyclearin;
+    mystate = GLOBAL;
+}
@@ -1,5 +1,5 @@
 /*
- * Copyright (c) 2014-2018 Red Hat.
+ * Copyright (c) 2014-2019 Red Hat.
  * Copyright (c) 1995-2001 Silicon Graphics, Inc.  All Rights Reserved.
  * 
  * This program is free software; you can redistribute it and/or modify it
@@ -733,8 +733,8 @@ do_work(task_t *tp)
 	assert(last_log_offset >= 0);
 
 	resp = NULL; /* silence coverity */
-	if ((sts = __pmDecodeResult(pb_in, &resp)) < 0) {
-	    fprintf(stderr, "__pmDecodeResult: %s\n", pmErrStr(sts));
+	if ((sts = __pmDecodeResultArena(pb_in, &resp)) < 0) {
+	    fprintf(stderr, "__pmDecodeResultArena: %s\n", pmErrStr(sts));
 	    exit(1);
 	}
 	setavail(resp);
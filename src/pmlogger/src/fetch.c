@@ -1,5 +1,5 @@
 /*
- * Copyright (c) 2013-2018 Red Hat.
+ * Copyright (c) 2013-2019 Red Hat.
  * Copyright (c) 1995 Silicon Graphics, Inc.  All Rights Reserved.
  * 
  * This program is free software; you can redistribute it and/or modify it
@@ -147,7 +147,7 @@ myFetch(int numpmid, pmID pmidlist[], __pmPDU **pdup)
 			__pmPDU		*npb;
 			int		sts;
 
-			if ((sts = __pmDecodeResult(pb, &result)) < 0) {
+			if ((sts = __pmDecodeResultArena(pb, &result)) < 0) {
 			    n = sts;
 			}
 			else {
@@ -199,6 +199,9 @@ myFetch(int numpmid, pmID pmidlist[], __pmPDU **pdup)
 		}
 	    } while (n == 0);
 
+	    if (changed & (PMCD_LABEL_CHANGE | PMCD_AGENT_CHANGE))
+		ctxp->c_pmcd->pc_labels++;	/* discard any cached label sets */
+
 	    if (changed & PMCD_NAMES_CHANGE) {
 		/*
 		 * Fetch has returned with the PMCD_NAMES_CHANGE flag set.
@@ -1,5 +1,5 @@
 /*
- * Copyright (c) 2012-2018 Red Hat.
+ * Copyright (c) 2012-2019 Red Hat.
  * Copyright (c) 1995-2001,2003 Silicon Graphics, Inc.  All Rights Reserved.
  * 
  * This program is free software; you can redistribute it and/or modify it
@@ -893,6 +893,9 @@ main(int argc, char **argv)
     else if (pmcd_host_conn == NULL)
 	pmcd_host_conn = "local:";
 
+    /* pmcd socket is used directly (see control.c), so must not be shared */
+    if (host_context == PM_CONTEXT_HOST)
+	host_context |= PM_CTXFLAG_EXCLUSIVE;
     if ((ctx = pmNewContext(host_context, pmcd_host_conn)) < 0) {
 	fprintf(stderr, "%s: Cannot connect to PMCD on host \"%s\": %s\n", pmGetProgname(), pmcd_host_conn, pmErrStr(ctx));
 	exit(1);
@@ -0,0 +1,136 @@
+/*
+ * pmnscomp [-df] [-n namespace] [outfile]
+ *
+ * Compile a PCP PMNS into an image for fast loading
+ *
+ * Copyright (c) 2019 Red Hat.
+ * 
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2 of the License, or (at your
+ * option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ * for more details.
+ */
+
+#include "pmapi.h"
+#include "libpcp.h"
+
+static pmLongOptions longopts[] = {
+    PMAPI_OPTIONS_HEADER("Options"),
+    PMOPT_DEBUG,
+    { "dupok", 0, 'd', 0, "duplicate names for the same PMID are allowed [default]" },
+    { "force", 0, 'f', 0, "force overwriting of the output file if it exists" },
+    PMOPT_NAMESPACE,
+    { "nodups", 0, 'x', 0, "duplicate names for the same PMID are not allowed" },
+    PMOPT_HELP,
+    PMAPI_OPTIONS_END
+};
+
+static pmOptions opts = {
+    .short_options = "dD:fn:x?",
+    .long_options = longopts,
+    .short_usage = "[options] [outfile]",
+};
+
+int
+main(int argc, char **argv)
+{
+    int		sep = pmPathSeparator();
+    int		sts;
+    int		c;
+    int		dupok = 1;
+    int		force = 0;
+    char	*p;
+    char	pmnsfile[MAXPATHLEN];
+    char	outfname[MAXPATHLEN];
+    __pmnsTree	*tree;
+
+    /* no derived or anon metrics, please */
+    __pmSetInternalState(PM_STATE_PMCS);
+
+    if ((p = getenv("PMNS_DEFAULT")) != NULL) {
+	strncpy(pmnsfile, p, MAXPATHLEN);
+	pmnsfile[MAXPATHLEN-1]= '\0';
+    } else {
+	pmsprintf(pmnsfile, sizeof(pmnsfile), "%s%c" "pmns" "%c" "root",
+		pmGetConfig("PCP_VAR_DIR"), sep, sep);
+    }
+
+    while ((c = pmgetopt_r(argc, argv, &opts)) != EOF) {
+	switch (c) {
+
+	case 'd':	/* duplicate PMIDs are OK */
+	    dupok = 1;
+	    break;
+
+	case 'D':	/* debug options */
+	    if ((sts = pmSetDebug(opts.optarg)) < 0) {
+		fprintf(stderr, "%s: unrecognized debug options specification (%s)\n",
+			pmGetProgname(), opts.optarg);
+		opts.errors++;
+	    }
+	    break;
+
+	case 'f':	/* force ... clobber output file if it exists */
+	    force = 1;
+	    break;
+
+	case 'n':	/* alternative name space file */
+	    strncpy(pmnsfile, opts.optarg, MAXPATHLEN);
+	    pmnsfile[MAXPATHLEN-1]= '\0';
+	    break;
+
+	case 'x':	/* duplicate PMIDs are NOT OK */
+	    dupok = 0;
+	    break;
+
+	case '?':
+	default:
+	    opts.errors++;
+	    break;
+	}
+    }
+
+    if (opts.errors || opts.optind < argc - 1) {
+	pmUsageMessage(&opts);
+	exit(1);
+    }
+
+    if (opts.optind < argc)
+	pmsprintf(outfname, sizeof(outfname), "%s", argv[opts.optind]);
+    else
+	pmsprintf(outfname, sizeof(outfname), "%s.bin", pmnsfile);
+
+    if (!force && access(outfname, F_OK) == 0) {
+	fprintf(stderr, "%s: Error: output file \"%s\" already exists!\nYou must either remove it first, or use -f\n",
+		pmGetProgname(), outfname);
+	exit(1);
+    }
+
+    /*
+     * an explicit filename is always loaded from the ASCII PMNS (and
+     * pre-processed), never from an existing compiled image
+     */
+    if ((sts = pmLoadASCIINameSpace(pmnsfile, dupok)) < 0) {
+	fprintf(stderr, "%s: Error: pmLoadASCIINameSpace(%s, %d): %s\n",
+		pmGetProgname(), pmnsfile, dupok, pmErrStr(sts));
+	exit(1);
+    }
+    if ((tree = __pmExportPMNS()) == NULL) {
+	/* sanity check - shouldn't ever happen */
+	fprintf(stderr, "%s: Error: exported PMNS is NULL\n", pmGetProgname());
+	exit(1);
+    }
+
+    if ((sts = __pmWritePMNSImage(tree, pmnsfile, outfname)) < 0) {
+	fprintf(stderr, "%s: Error: cannot write compiled PMNS \"%s\": %s\n",
+		pmGetProgname(), outfname, pmErrStr(sts));
+	exit(1);
+    }
+
+    exit(0);
+}
@@ -0,0 +1,375 @@
+/*
+ * Copyright (c) 2019 Red Hat.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ * for more details.
+ */
+#include <math.h>
+#include <ctype.h>
+#include "columns.h"
+
+/* largest integer magnitude exactly representable as a double */
+#define COLUMN_EXACT_INTEGER	(9007199254740992.0)	/* 2^53 */
+
+seriesColumns *
+seriesColumnsCreate(void)
+{
+    return calloc(1, sizeof(seriesColumns));
+}
+
+void
+seriesColumnsFree(seriesColumns *columns)
+{
+    seriesColumn	*column;
+    unsigned int	i;
+
+    if (columns == NULL)
+	return;
+    for (i = 0; i < columns->count; i++) {
+	column = &columns->columns[i];
+	sdsfree(column->series);
+	sdsfree(column->instance);
+	sdsfree(column->strings);
+	free(column->stamps);
+	free(column->seqnums);
+	free(column->doubles);
+    }
+    free(columns->columns);
+    free(columns);
+}
+
+static sds
+column_varint(sds buffer, __uint64_t value)
+{
+    unsigned char	bytes[10];
+    int			n = 0;
+
+    do {
+	bytes[n] = value & 0x7f;
+	if ((value >>= 7) != 0)
+	    bytes[n] |= 0x80;
+	n++;
+    } while (value);
+    return sdscatlen(buffer, bytes, n);
+}
+
+static inline __uint64_t
+column_zigzag(__int64_t value)
+{
+    return ((__uint64_t)value << 1) ^ (__uint64_t)(value >> 63);
+}
+
+/*
+ * Timestamps arrive as Redis stream identifiers, "milliseconds.seqnum"
+ */
+static int
+column_timestamp(sds timestamp, __uint64_t *stamp, __uint64_t *seqnum)
+{
+    char		*end;
+
+    *stamp = strtoull(timestamp, &end, 10);
+    if (end == timestamp)
+	return -EINVAL;
+    if (*end == '\0') {
+	*seqnum = 0;
+	return 0;
+    }
+    if (*end != '.' && *end != '-')
+	return -EINVAL;
+    timestamp = end + 1;
+    *seqnum = strtoull(timestamp, &end, 10);
+    if (end == timestamp || *end != '\0')
+	return -EINVAL;
+    return 0;
+}
+
+/*
+ * Values arrive as strings - only encode them as doubles when this can
+ * be done without loss, i.e. the entire string is a finite number and
+ * integers are within the exactly representable range.
+ */
+static int
+column_double(sds data, double *value)
+{
+    const char		*p;
+    char		*end;
+    int			integer = 1;
+
+    if (sdslen(data) == 0 || isspace((int)data[0]))
+	return 0;
+    *value = strtod(data, &end);
+    if (end != data + sdslen(data) || !isfinite(*value))
+	return 0;
+    for (p = data; p < end; p++) {
+	if (*p == '.' || *p == 'e' || *p == 'E' || *p == 'x' || *p == 'X') {
+	    integer = 0;
+	    break;
+	}
+    }
+    if (integer &&
+	(*value > COLUMN_EXACT_INTEGER || *value < -COLUMN_EXACT_INTEGER))
+	return 0;
+    return 1;
+}
+
+static inline int
+column_match(seriesColumn *column, sds series)
+{
+    sds			name = column->instance ? column->instance : column->series;
+
+    return sdscmp(name, series) == 0;
+}
+
+static seriesColumn *
+column_lookup(seriesColumns *columns, sds sid, sds series)
+{
+    seriesColumn	*column;
+    unsigned int	i, count = columns->count;
+
+    /* values are grouped by metric series, then timestamp, instance */
+    if (count == 0 || sdscmp(columns->columns[columns->start].series, sid))
+	columns->start = columns->cursor = count;
+
+    /* instances commonly arrive in the same order at each timestamp */
+    for (i = columns->cursor + 1; i < count; i++)
+	if (column_match(&columns->columns[i], series))
+	    return &columns->columns[columns->cursor = i];
+    for (i = columns->start; i < count && i <= columns->cursor; i++)
+	if (column_match(&columns->columns[i], series))
+	    return &columns->columns[columns->cursor = i];
+
+    if (count == columns->size) {
+	unsigned int	size = count ? count * 2 : 16;
+
+	column = realloc(columns->columns, size * sizeof(seriesColumn));
+	if (column == NULL)
+	    return NULL;
+	columns->columns = column;
+	columns->size = size;
+    }
+    column = &columns->columns[count];
+    memset(column, 0, sizeof(*column));
+    column->series = sdsdup(sid);
+    if (sdscmp(sid, series) != 0)	/* an instance of a metric */
+	column->instance = sdsdup(series);
+    column->strings = sdsempty();
+    column->numeric = 1;
+    columns->cursor = columns->count++;
+    return column;
+}
+
+int
+seriesColumnsAppend(seriesColumns *columns, sds sid, sds series,
+		sds timestamp, sds data)
+{
+    seriesColumn	*column;
+    __uint64_t		stamp, seqnum;
+    double		value;
+
+    if (column_timestamp(timestamp, &stamp, &seqnum) < 0)
+	return -EINVAL;
+    if ((column = column_lookup(columns, sid, series)) == NULL)
+	return -ENOMEM;
+
+    if (column->count == column->size) {
+	unsigned int	size = column->size ? column->size * 2 : 64;
+	__uint64_t	*stamps, *seqnums;
+	double		*doubles;
+
+	if ((stamps = realloc(column->stamps, size * sizeof(*stamps))) == NULL)
+	    return -ENOMEM;
+	column->stamps = stamps;
+	if ((seqnums = realloc(column->seqnums, size * sizeof(*seqnums))) == NULL)
+	    return -ENOMEM;
+	column->seqnums = seqnums;
+	if ((doubles = realloc(column->doubles, size * sizeof(*doubles))) == NULL)
+	    return -ENOMEM;
+	column->doubles = doubles;
+	column->size = size;
+    }
+
+    if (column->numeric && column_double(data, &value))
+	column->doubles[column->count] = value;
+    else
+	column->numeric = 0;
+    column->strings = column_varint(column->strings, sdslen(data));
+    column->strings = sdscatlen(column->strings, data, sdslen(data));
+
+    column->stamps[column->count] = stamp;
+    column->seqnums[column->count] = seqnum;
+    if (seqnum)
+	column->sequence = 1;
+    column->count++;
+    return 0;
+}
+
+static sds
+column_encode_stamps(sds buffer, seriesColumn *column)
+{
+    __int64_t		delta, prior = 0;
+    unsigned int	i;
+
+    for (i = 0; i < column->count; i++) {
+	if (i == 0) {
+	    buffer = column_varint(buffer, column->stamps[0]);
+	    continue;
+	}
+	delta = (__int64_t)(column->stamps[i] - column->stamps[i-1]);
+	buffer = column_varint(buffer, column_zigzag(delta - prior));
+	prior = delta;
+    }
+    if (column->sequence) {
+	for (i = 0; i < column->count; i++)
+	    buffer = column_varint(buffer, column->seqnums[i]);
+    }
+    return buffer;
+}
+
+static sds
+column_encode_doubles(sds buffer, seriesColumn *column)
+{
+    unsigned char	bytes[9];
+    __uint64_t		bits, xor, prior = 0;
+    unsigned int	i, lz, tz, n, b;
+
+    for (i = 0; i < column->count; i++) {
+	memcpy(&bits, &column->doubles[i], sizeof(bits));
+	xor = bits ^ prior;
+	prior = bits;
+	if (xor == 0) {
+	    bytes[0] = 0;
+	    buffer = sdscatlen(buffer, bytes, 1);
+	    continue;
+	}
+	for (lz = 0; lz < 7 && !(xor >> (56 - lz * 8) & 0xff); lz++)
+	    ;
+	for (tz = 0; tz < 7 && !(xor >> (tz * 8) & 0xff); tz++)
+	    ;
+	n = 8 - lz - tz;
+	bytes[0] = 0x80 | (lz << 4) | n;
+	for (b = 0; b < n; b++)
+	    bytes[b + 1] = (xor >> (56 - (lz + b) * 8)) & 0xff;
+	buffer = sdscatlen(buffer, bytes, n + 1);
+    }
+    return buffer;
+}
+
+sds
+seriesColumnsEncode(seriesColumns *columns, sds buffer)
+{
+    seriesColumn	*column;
+    unsigned char	flags[2];
+    unsigned int	i;
+
+    buffer = sdscatlen(buffer, SERIES_COLUMNS_MAGIC,
+			sizeof(SERIES_COLUMNS_MAGIC) - 1);
+    flags[0] = SERIES_COLUMNS_VERSION;
+    buffer = sdscatlen(buffer, flags, 1);
+    buffer = column_varint(buffer, columns->count);
+
+    for (i = 0; i < columns->count; i++) {
+	column = &columns->columns[i];
+	buffer = column_varint(buffer, sdslen(column->series));
+	buffer = sdscatsds(buffer, column->series);
+	if (column->instance) {
+	    buffer = column_varint(buffer, sdslen(column->instance));
+	    buffer = sdscatsds(buffer, column->instance);
+	} else {
+	    buffer = column_varint(buffer, 0);
+	}
+	buffer = column_varint(buffer, column->count);
+	flags[0] = column->numeric ? SERIES_COLUMN_DOUBLE : SERIES_COLUMN_STRING;
+	flags[1] = column->sequence;
+	buffer = sdscatlen(buffer, flags, 2);
+
+	buffer = column_encode_stamps(buffer, column);
+	if (column->numeric)
+	    buffer = column_encode_doubles(buffer, column);
+	else
+	    buffer = sdscatsds(buffer, column->strings);
+    }
+    return buffer;
+}
+
+/*
+ * Quality (preference, 0 to 1000) given to a media type by the media
+ * ranges of an HTTP Accept header, from the most specific matching
+ * range - see RFC 7231 section 5.3.2.  Returns -1 for no match.
+ */
+static int
+column_accept_quality(const char *accept, const char *type)
+{
+    const char		*range, *end, *param, *slash;
+    size_t		length, typelen = strlen(type);
+    int			quality, best = -1, specific = -1, level;
+
+    for (range = accept; *range != '\0'; range = end) {
+	while (*range == ' ' || *range == '\t' || *range == ',')
+	    range++;
+	if ((end = strchr(range, ',')) == NULL)
+	    end = range + strlen(range);
+	if (range == end)
+	    continue;
+
+	/* media range: type "/" subtype, up to parameters or whitespace */
+	for (length = 0; range + length < end; length++)
+	    if (range[length] == ';' || range[length] == ' ' ||
+		range[length] == '\t')
+		break;
+	if (length == 3 && strncmp(range, "*/*", 3) == 0)
+	    level = 0;
+	else if (length >= 2 && strncmp(range + length - 2, "/*", 2) == 0 &&
+		 (slash = strchr(type, '/')) != NULL &&
+		 (size_t)(slash - type) == length - 2 &&
+		 strncasecmp(range, type, length - 2) == 0)
+	    level = 1;
+	else if (length == typelen && strncasecmp(range, type, length) == 0)
+	    level = 2;
+	else
+	    continue;
+
+	/* quality parameter, defaulting to 1 */
+	quality = 1000;
+	for (param = range + length; param < end; param++) {
+	    if (*param != ';')
+		continue;
+	    do {
+		param++;
+	    } while (*param == ' ' || *param == '\t');
+	    if ((param[0] == 'q' || param[0] == 'Q') && param[1] == '=') {
+		quality = (int)(strtod(param + 2, NULL) * 1000 + 0.5);
+		if (quality < 0)
+		    quality = 0;
+		if (quality > 1000)
+		    quality = 1000;
+		break;
+	    }
+	}
+	if (level > specific) {
+	    specific = level;
+	    best = quality;
+	}
+    }
+    return best;
+}
+
+/*
+ * JSON remains the default response format, unless an HTTP Accept header
+ * value finds the columnar format acceptable and prefers it over JSON.
+ */
+int
+seriesColumnsAccepted(const char *accept)
+{
+    int			columns, json;
+
+    columns = column_accept_quality(accept, SERIES_COLUMNS_MIMETYPE);
+    json = column_accept_quality(accept, "application/json");
+    return columns > 0 && columns > json;
+}
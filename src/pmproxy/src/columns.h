@@ -0,0 +1,79 @@
+/*
+ * Copyright (c) 2019 Red Hat.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ * for more details.
+ */
+#ifndef PMPROXY_COLUMNS_H
+#define PMPROXY_COLUMNS_H
+
+#include "pmapi.h"
+#include "sds.h"
+
+/*
+ * Compact columnar encoding of time series values, offered by the
+ * /series/query and /grafana/query REST APIs as an alternative to JSON
+ * when a client sends "Accept: application/vnd.pcp.series" in its request.
+ *
+ * All values are collected by (series, instance) column and encoded
+ * once the query completes:
+ *
+ *   "PCPS" magic, u8 version, varint ncolumns, then each column -
+ *   varint length + series identifier
+ *   varint length + instance identifier (zero length if no instance)
+ *   varint count, u8 value type (1: double, 2: string), u8 seq flag
+ *   timestamps: milliseconds as varint first, zigzag varint delta,
+ *	then zigzag varint delta-of-delta for the remaining points
+ *   sequence numbers: varint per point (only present if seq flag set)
+ *   values: doubles XOR'd with their predecessor - one control byte
+ *	(zero when unchanged, else 0x80 | leading-zero-bytes << 4 |
+ *	significant-bytes) followed by the significant bytes, or else
+ *	strings as varint length + bytes.
+ *
+ * Varints are unsigned LEB128, zigzag maps signed to unsigned values.
+ */
+#define SERIES_COLUMNS_MAGIC	"PCPS"
+#define SERIES_COLUMNS_VERSION	1
+#define SERIES_COLUMNS_MIMETYPE	"application/vnd.pcp.series"
+
+enum {
+    SERIES_COLUMN_DOUBLE	= 1,
+    SERIES_COLUMN_STRING	= 2,
+};
+
+typedef struct seriesColumn {
+    sds			series;		/* metric series identifier */
+    sds			instance;	/* instance identifier, or NULL */
+    unsigned int	count;		/* number of points in column */
+    unsigned int	size;		/* allocated points in arrays */
+    unsigned int	numeric : 1;	/* all values exactly doubles */
+    unsigned int	sequence : 1;	/* some non-zero stream seqnum */
+    unsigned int	padding : 30;
+    __uint64_t		*stamps;	/* timestamps (milliseconds) */
+    __uint64_t		*seqnums;	/* timestamp sequence numbers */
+    double		*doubles;	/* values, while still numeric */
+    sds			strings;	/* values, length-prefixed text */
+} seriesColumn;
+
+typedef struct seriesColumns {
+    unsigned int	count;		/* number of columns in use */
+    unsigned int	size;		/* allocated columns in array */
+    unsigned int	start;		/* first column of current series */
+    unsigned int	cursor;		/* most recently appended column */
+    seriesColumn	*columns;
+} seriesColumns;
+
+extern seriesColumns *seriesColumnsCreate(void);
+extern int seriesColumnsAppend(seriesColumns *, sds, sds, sds, sds);
+extern sds seriesColumnsEncode(seriesColumns *, sds);
+extern void seriesColumnsFree(seriesColumns *);
+extern int seriesColumnsAccepted(const char *);
+
+#endif /* PMPROXY_COLUMNS_H */
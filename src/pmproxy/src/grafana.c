@@ -13,6 +13,7 @@
  */
 #include <assert.h>
 #include "server.h"
+#include "columns.h"
 
 typedef enum GrafanaRestKey {
     RESTKEY_NONE	= 0,
@@ -47,6 +48,7 @@ typedef struct GrafanaBaton {
     sds			maxseries;
     sds			interval;
     sds			timezone;
+    seriesColumns	*columns;	/* binary columnar values response */
 } GrafanaBaton;
 
 static GrafanaRestCommand commands[] = {
@@ -63,6 +65,7 @@ static sds PARAM_REFID, PARAM_PANELID, PARAM_DASHBOARDID,
 	   PARAM_EXPR, PARAM_TARGET, PARAM_TIMEZONE,
 	   PARAM_START, PARAM_FINISH, PARAM_INTERVAL,
 	   PARAM_MAXSERIES, PARAM_MAXVALUES;
+static sds HEADER_ACCEPT;
 
 /* constant global strings (read-only) */
 static const char grafana_success[] = "{\"success\":true}\r\n";
@@ -120,6 +123,8 @@ grafana_free_baton(struct client *client, GrafanaBaton *baton)
 	sdsfree(baton->maxvalues);
     if (baton->maxseries)
 	sdsfree(baton->maxseries);
+    if (baton->columns)
+	seriesColumnsFree(baton->columns);
     memset(baton, 0, sizeof(*baton));
 }
 
@@ -146,11 +151,16 @@ on_grafana_value(pmSID sid, pmSeriesValue *value, void *arg)
 	fprintf(stderr, "%s: client=%p %s\n", "on_grafana_value", client, sid);
 
     assert(client != NULL);
-    result = http_get_buffer(client);
 
     data = value->data;
     series = value->series;
     timestamp = value->timestamp;
+
+    /* binary response - accumulate columns, encoded once query completes */
+    if (baton->columns)
+	return seriesColumnsAppend(baton->columns, sid, series, timestamp, data);
+
+    result = http_get_buffer(client);
     /* chop off the sub-millisecond component of timestamp */
     if ((s = strchr(timestamp, '.')) == NULL)
 	return 1;	/* bad timestamp */
@@ -296,7 +306,11 @@ on_grafana_done(int status, void *arg)
 
     if (status == 0) {
 	code = HTTP_STATUS_OK;
-	if (flags & (HTTP_FLAG_OBJECT|HTTP_FLAG_ARRAY))
+	if (baton->columns && !(flags & (HTTP_FLAG_OBJECT|HTTP_FLAG_ARRAY))) {
+	    msg = seriesColumnsEncode(baton->columns, sdsempty());
+	    flags |= HTTP_FLAG_COLUMNS;
+	}
+	else if (flags & (HTTP_FLAG_OBJECT|HTTP_FLAG_ARRAY))
 	    msg = baton->series ? sdsnewlen("]}", 2) : sdsempty();
 	else
 	    msg = sdsnewlen(grafana_success, sizeof(grafana_success) - 1);
@@ -455,11 +469,36 @@ grafana_request_url(struct client *client, sds url, dict *parameters)
     return 1;
 }
 
+/*
+ * Query values may be requested in the columnar binary format used by
+ * the series servlet (see columns.h) instead of JSON datapoints.
+ */
+static int
+grafana_accept_columns(struct dict *headers)
+{
+    dictEntry		*entry;
+    sds			value;
+
+    if ((entry = dictFind(headers, HEADER_ACCEPT)) == NULL)
+	return 0;
+    if ((value = dictGetVal(entry)) == NULL)
+	return 0;
+    return seriesColumnsAccepted(value);
+}
+
 static int
 grafana_request_headers(struct client *client, struct dict *headers)
 {
+    GrafanaBaton	*baton = (GrafanaBaton *)client->u.http.data;
+
     if (pmDebugOptions.http)
 	fprintf(stderr, "grafana servlet headers (client=%p)\n", client);
+
+    if (baton && baton->restkey == RESTKEY_QUERY &&
+	baton->columns == NULL && grafana_accept_columns(headers)) {
+	if ((baton->columns = seriesColumnsCreate()) == NULL)
+	    client->u.http.parser.status_code = HTTP_STATUS_INTERNAL_SERVER_ERROR;
+    }
     return 0;
 }
 
@@ -632,6 +671,8 @@ grafana_servlet_setup(struct proxy *proxy)
 	PARAM_MAXSERIES = sdsnew("maxseries");
     if (PARAM_MAXVALUES == NULL)
 	PARAM_MAXVALUES = sdsnew("maxdatapoints");
+    if (HEADER_ACCEPT == NULL)
+	HEADER_ACCEPT = sdsnew("Accept");
 
     pmSeriesSetSlots(&grafana_settings.module, proxy->slots);
     pmSeriesSetHostSpec(&grafana_settings.module, proxy->redishost);
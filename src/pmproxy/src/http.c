@@ -12,6 +12,7 @@
  * for more details.
  */
 #include <assert.h>
+#include <ctype.h>
 #include "server.h"
 #include "dict.h"
 #include "util.h"
@@ -19,6 +20,51 @@
 static int chunked_transfer_size = 4096;	/* TODO: config file */
 static int smallest_buffer_size = 128;		/* TODO: config file */
 
+/*
+ * HTTP header field names are case-insensitive (RFC 7230), so the
+ * request headers dictionary hashes and compares names regardless of
+ * case - servlets look up one spelling of a header name.
+ */
+static uint64_t
+headerHashCallBack(const void *key)
+{
+    const unsigned char	*name = (const unsigned char *)key;
+    uint64_t		hash = 14695981039346656037ULL;	/* FNV-1a */
+    size_t		i, length = sdslen((sds)key);
+
+    for (i = 0; i < length; i++) {
+	hash ^= tolower(name[i]);
+	hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+static int
+headerCompareCallBack(void *privdata, const void *key1, const void *key2)
+{
+    size_t		length = sdslen((sds)key1);
+
+    (void)privdata;
+    if (length != sdslen((sds)key2))
+	return 0;
+    return strncasecmp((const char *)key1, (const char *)key2, length) == 0;
+}
+
+static void
+headerFreeCallBack(void *privdata, void *value)
+{
+    (void)privdata;
+    sdsfree(value);
+}
+
+/* header names are inserted without copying, the dictionary frees them */
+static dictType headerDictCallBacks = {
+    .hashFunction	= headerHashCallBack,
+    .keyCompare		= headerCompareCallBack,
+    .keyDestructor	= headerFreeCallBack,
+    .valDestructor	= headerFreeCallBack,
+};
+
 static inline int
 ishex(int x)
 {
@@ -73,6 +119,8 @@ http_content_type(http_flags flags)
 	return "image/png";
     if (flags & HTTP_FLAG_GIF)
 	return "image/gif";
+    if (flags & HTTP_FLAG_COLUMNS)
+	return "application/vnd.pcp.series";
     return "application/octet-stream";
 }
 
@@ -477,7 +525,7 @@ on_url(http_parser *request, const char *offset, size_t length)
     if ((servlet = servlet_lookup(client, offset, length)) != NULL) {
 	client->u.http.servlet = servlet;
 	if ((sts = client->u.http.parser.status_code) == 0) {
-	    client->u.http.headers = dictCreate(&sdsDictCallBacks, NULL);
+	    client->u.http.headers = dictCreate(&headerDictCallBacks, NULL);
 	    return 0;
 	}
 	result = sdsnew("failed to process URL");
@@ -512,14 +560,19 @@ on_header_field(http_parser *request, const char *offset, size_t length)
     if (pmDebugOptions.http)
 	fprintf(stderr, "Header field: %s (client=%p)\n", field, client);
 
-    if (client->u.http.parser.status_code || !client->u.http.headers)
+    if (client->u.http.parser.status_code || !client->u.http.headers) {
+	sdsfree(field);
 	return 0;	/* already in process of failing connection */
+    }
 
     /*
      * Insert this header into the dictionary (name only so far);
      * track this header for associating the value to it (below).
+     * Repeated header names keep the first value.
      */
     client->u.http.privdata = dictAddRaw(client->u.http.headers, field, NULL);
+    if (client->u.http.privdata == NULL)
+	sdsfree(field);
     return 0;
 }
 
@@ -531,10 +584,14 @@ on_header_value(http_parser *request, const char *offset, size_t length)
 
     if (pmDebugOptions.http)
 	fprintf(stderr, "Header value: %s (client=%p)\n", value, client);
-    if (client->u.http.parser.status_code || !client->u.http.headers)
+    if (client->u.http.parser.status_code || !client->u.http.headers ||
+	client->u.http.privdata == NULL) {
+	sdsfree(value);
 	return 0;	/* already in process of failing connection */
+    }
 
     dictSetVal(client->u.http.headers, (dictEntry *)client->u.http.privdata, value);
+    client->u.http.privdata = NULL;
     return 0;
 }
 
@@ -31,6 +31,7 @@ typedef enum http_flags {
     HTTP_FLAG_JPG	= (1<<6),
     HTTP_FLAG_PNG	= (1<<7),
     HTTP_FLAG_GIF	= (1<<8),
+    HTTP_FLAG_COLUMNS	= (1<<9),
     HTTP_FLAG_UTF8	= (1<<10),
     HTTP_FLAG_UTF16	= (1<<11),
     HTTP_FLAG_ARRAY	= (1<<12),
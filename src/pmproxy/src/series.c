@@ -12,6 +12,7 @@
  * for more details.
  */
 #include "server.h"
+#include "columns.h"
 #include <assert.h>
 
 typedef enum pmSeriesRestKey {
@@ -45,6 +46,7 @@ typedef struct pmSeriesBaton {
     unsigned int	values;
     sds			info;
     sds			query;
+    seriesColumns	*columns;	/* binary columnar values response */
 } pmSeriesBaton;
 
 static pmSeriesRestCommand commands[] = {
@@ -60,6 +62,7 @@ static pmSeriesRestCommand commands[] = {
 
 /* constant string keys (initialized during servlet setup) */
 static sds PARAM_EXPR, PARAM_MATCH, PARAM_SERIES, PARAM_SOURCE;
+static sds HEADER_ACCEPT;
 
 /* constant global strings (read-only) */
 static const char pmseries_success[] = "{\"success\":true}\r\n";
@@ -94,6 +97,8 @@ pmseries_free_baton(struct client *client, pmSeriesBaton *baton)
 	sdsfree(baton->info);
     if (baton->query)
 	sdsfree(baton->query);
+    if (baton->columns)
+	seriesColumnsFree(baton->columns);
     memset(baton, 0, sizeof(*baton));
 }
 
@@ -127,6 +132,12 @@ on_pmseries_value(pmSID sid, pmSeriesValue *value, void *arg)
     series = value->series;
     data = value->data;
 
+    /* binary response - accumulate columns, encoded once query completes */
+    if (baton->columns) {
+	sdsfree(result);
+	return seriesColumnsAppend(baton->columns, sid, series, timestamp, data);
+    }
+
     prefix = (baton->values++ == 0) ? "[" : ",";
     result = sdscatfmt(result, "%s{\"series\":\"%S\",", prefix, sid);
     if (sdscmp(sid, series) != 0)	/* an instance of a metric */
@@ -365,7 +376,11 @@ on_pmseries_done(int status, void *arg)
     if (status == 0) {
 	code = HTTP_STATUS_OK;
 	/* complete current response */
-	if (flags & HTTP_FLAG_OBJECT)
+	if (baton->columns && !(flags & (HTTP_FLAG_OBJECT|HTTP_FLAG_ARRAY))) {
+	    msg = seriesColumnsEncode(baton->columns, sdsempty());
+	    flags |= HTTP_FLAG_COLUMNS;
+	}
+	else if (flags & HTTP_FLAG_OBJECT)
 	    msg = sdsnewlen("}\r\n", 3);
 	else if (flags & HTTP_FLAG_ARRAY)
 	    msg = sdsnewlen("]\r\n", 3);
@@ -512,11 +527,36 @@ pmseries_request_url(struct client *client, sds url, dict *parameters)
     return 1;
 }
 
+/*
+ * Clients may request time series values in the compact columnar binary
+ * format (see columns.h) instead of JSON, via the HTTP Accept header.
+ */
+static int
+pmseries_accept_columns(struct dict *headers)
+{
+    dictEntry		*entry;
+    sds			value;
+
+    if ((entry = dictFind(headers, HEADER_ACCEPT)) == NULL)
+	return 0;
+    if ((value = dictGetVal(entry)) == NULL)
+	return 0;
+    return seriesColumnsAccepted(value);
+}
+
 static int
 pmseries_request_headers(struct client *client, struct dict *headers)
 {
+    pmSeriesBaton	*baton = (pmSeriesBaton *)client->u.http.data;
+
     if (pmDebugOptions.http)
 	fprintf(stderr, "series servlet headers (client=%p)\n", client);
+
+    if (baton && baton->restkey == RESTKEY_QUERY &&
+	baton->columns == NULL && pmseries_accept_columns(headers)) {
+	if ((baton->columns = seriesColumnsCreate()) == NULL)
+	    client->u.http.parser.status_code = HTTP_STATUS_INTERNAL_SERVER_ERROR;
+    }
     return 0;
 }
 
@@ -664,6 +704,8 @@ pmseries_servlet_setup(struct proxy *proxy)
 	PARAM_SERIES = sdsnew("series");
     if (PARAM_SOURCE == NULL)
 	PARAM_SOURCE = sdsnew("source");
+    if (HEADER_ACCEPT == NULL)
+	HEADER_ACCEPT = sdsnew("Accept");
 
     pmSeriesSetSlots(&pmseries_settings.module, proxy->slots);
     pmSeriesSetHostSpec(&pmseries_settings.module, proxy->redishost);
@@ -678,6 +720,7 @@ pmseries_servlet_close(void)
     sdsfree(PARAM_MATCH);
     sdsfree(PARAM_SERIES);
     sdsfree(PARAM_SOURCE);
+    sdsfree(HEADER_ACCEPT);
 }
 
 struct servlet pmseries_servlet = {
@@ -13,6 +13,18 @@
  */
 #include "server.h"
 
+#define PROXY_METRICS_CLUSTER	4	/* mmv cluster for pmproxy metrics */
+#define PROXY_METRICS_INTERVAL	1000	/* milliseconds between refreshes */
+
+enum {
+    METRIC_PLAN_HITS,
+    METRIC_PLAN_MISSES,
+    METRIC_PLAN_COUNT,
+    NUM_METRICS
+};
+
+static pmAtomValue	*proxy_values[NUM_METRICS];
+
 void
 proxylog(pmLogLevel level, sds message, void *arg)
 {
@@ -73,6 +85,7 @@ server_init(int portcount, const char *localpath)
 
     proxy->redishost = sdscatfmt(sdsempty(), "%s:%u",
 		    redis_host ? redis_host : "localhost", redis_port);
+    proxy->metrics = mmv_stats_registry("pmproxy", PROXY_METRICS_CLUSTER, 0);
     proxy->events = uv_default_loop();
     uv_loop_init(proxy->events);
     return proxy;
@@ -517,6 +530,11 @@ shutdown_ports(void *arg)
 	redisSlotsFree(proxy->slots);
 	proxy->slots = NULL;
     }
+    if (proxy->metrics) {
+	mmv_stats_free(proxy->metrics);
+	proxy->metrics = NULL;
+	proxy->map = NULL;
+    }
     sdsfree(proxy->redishost);
 }
 
@@ -564,6 +582,70 @@ setup_proxy(uv_timer_t *arg)
     setup_pcp_modules(proxy);
 }
 
+static void
+refresh_metrics(uv_timer_t *arg)
+{
+    uv_handle_t		*handle = (uv_handle_t *)arg;
+    struct proxy	*proxy = (struct proxy *)handle->data;
+    pmSeriesPlanStats	plans;
+
+    pmSeriesGetPlanStats(&plans);
+    mmv_set_value(proxy->map, proxy_values[METRIC_PLAN_HITS], plans.hits);
+    mmv_set_value(proxy->map, proxy_values[METRIC_PLAN_MISSES], plans.misses);
+    mmv_set_value(proxy->map, proxy_values[METRIC_PLAN_COUNT], plans.plans);
+}
+
+/*
+ * Export pmproxy internal statistics via memory-mapped values (MMV),
+ * periodically refreshed from the modules that maintain them.
+ */
+static void
+setup_metrics(struct proxy *proxy)
+{
+    static uv_timer_t	refresh;
+    static const char	*names[NUM_METRICS] = {
+	[METRIC_PLAN_HITS]	= "series.query.plan.hits",
+	[METRIC_PLAN_MISSES]	= "series.query.plan.misses",
+	[METRIC_PLAN_COUNT]	= "series.query.plan.count",
+    };
+    mmv_registry_t	*registry = proxy->metrics;
+    pmUnits		count = MMV_UNITS(0,0,1,0,0,PM_COUNT_ONE);
+    uv_handle_t		*handle;
+    int			i;
+
+    if (registry == NULL)
+	return;
+
+    mmv_stats_add_metric(registry, names[METRIC_PLAN_HITS],
+	METRIC_PLAN_HITS + 1, MMV_TYPE_U64, MMV_SEM_COUNTER, count, 0,
+	"time series queries using a cached query plan",
+	"Count of time series queries where parsing and name mapping were\n"
+	"avoided by using a previously prepared query plan.");
+    mmv_stats_add_metric(registry, names[METRIC_PLAN_MISSES],
+	METRIC_PLAN_MISSES + 1, MMV_TYPE_U64, MMV_SEM_COUNTER, count, 0,
+	"time series queries requiring a full parse",
+	"Count of time series queries where no cached query plan existed\n"
+	"and the query string was parsed in full.");
+    mmv_stats_add_metric(registry, names[METRIC_PLAN_COUNT],
+	METRIC_PLAN_COUNT + 1, MMV_TYPE_U32, MMV_SEM_INSTANT, count, 0,
+	"number of cached time series query plans",
+	"Current number of prepared time series query plans in the cache.");
+
+    if ((proxy->map = mmv_stats_start(registry)) == NULL) {
+	pmNotifyErr(LOG_WARNING, "%s: cannot export metrics: %s\n",
+			pmGetProgname(), osstrerror());
+	return;
+    }
+    for (i = 0; i < NUM_METRICS; i++)
+	proxy_values[i] = mmv_lookup_value_desc(proxy->map, names[i], NULL);
+
+    uv_timer_init(proxy->events, &refresh);
+    handle = (uv_handle_t *)&refresh;
+    handle->data = (void *)proxy;
+    uv_timer_start(&refresh, refresh_metrics,
+			PROXY_METRICS_INTERVAL, PROXY_METRICS_INTERVAL);
+}
+
 static void
 main_loop(void *arg)
 {
@@ -571,6 +653,8 @@ main_loop(void *arg)
     uv_timer_t		attempt;
     uv_handle_t		*handle;
 
+    setup_metrics(proxy);
+
     uv_timer_init(proxy->events, &attempt);
     handle = (uv_handle_t *)&attempt;
     handle->data = (void *)proxy;
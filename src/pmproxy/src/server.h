@@ -107,7 +107,8 @@ typedef struct proxy {
     unsigned int	redisetup;	/* is Redis slots information setup */
     struct servlet	*servlets;	/* linked list of http URL handlers */
     sds			redishost;	/* initial Redis host specification */
-    mmv_registry_t	*metrics;
+    mmv_registry_t	*metrics;	/* registry of pmproxy metrics */
+    void		*map;		/* mmv memory-mapped metric values */
     uv_loop_t		*events;
     redisSlots		*slots;
 } proxy;
@@ -2551,6 +2551,16 @@ LIBPCP.pmExtendFetchGroup_indom.argtypes = [c_void_p, c_char_p, c_char_p,
                                             c_uint,
                                             POINTER(c_uint),
                                             POINTER(c_int)]
+LIBPCP.pmExtendFetchGroup_column.restype = c_int
+LIBPCP.pmExtendFetchGroup_column.argtypes = [c_void_p, c_char_p, c_char_p,
+                                             POINTER(c_int),
+                                             POINTER(c_char_p),
+                                             c_void_p,
+                                             c_int,
+                                             POINTER(c_int),
+                                             c_uint,
+                                             POINTER(c_uint),
+                                             POINTER(c_int)]
 LIBPCP.pmExtendFetchGroup_event.restype = c_int
 LIBPCP.pmExtendFetchGroup_event.argtypes = [c_void_p, c_char_p, c_char_p, c_char_p, c_char_p,
                                             POINTER(timespec),
@@ -2667,6 +2677,64 @@ class fetchgroup(object):
             return vv
 
 
+    class fetchgroup_column(object):
+        """
+        An internal class to receive values/statuses for an indom of
+        numeric items into contiguous arrays.  It may be called as if
+        it were a function object to create a tuple of the instance
+        codes, instance names, values and statuses set at the most
+        recent fetch() call.  Codes, values and statuses are views of
+        the underlying arrays (buffer protocol), so that a sample can
+        be processed in bulk, e.g. with tolist() or numpy.frombuffer().
+        """
+
+        # ctypes element and memoryview format for each column type
+        column_types = {
+            c_api.PM_TYPE_32: (c_int32, 'i'),
+            c_api.PM_TYPE_U32: (c_uint32, 'I'),
+            c_api.PM_TYPE_64: (c_int64, 'q'),
+            c_api.PM_TYPE_U64: (c_uint64, 'Q'),
+            c_api.PM_TYPE_FLOAT: (c_float, 'f'),
+            c_api.PM_TYPE_DOUBLE: (c_double, 'd'),
+        }
+
+        def __init__(self, pmtype, num):
+            """Allocate arrays to receive a fetchgroup indom column."""
+            if pmtype not in self.column_types:
+                raise pmErr(c_api.PM_ERR_TYPE)
+            ctype, self.fmt = self.column_types[pmtype]
+            stss_t = c_int * num
+            values_t = ctype * num
+            icodes_t = c_uint * num
+            inames_t = c_char_p * num
+            self.sts = c_int()
+            self.stss = stss_t()
+            self.pmtype = pmtype
+            self.values = values_t()
+            self.icodes = icodes_t()
+            self.inames = inames_t()
+            self.num = c_uint()
+
+        @staticmethod
+        def view(array, fmt, num):
+            """Return a memoryview of the first num elements of array."""
+            try:
+                return memoryview(array).cast('B').cast(fmt)[:num]
+            except AttributeError: # no memoryview.cast before python 3.3
+                return array[:num]
+
+        def __call__(self):
+            """Retrieve the converted values of a fetchgroup column."""
+            if self.sts.value < 0:
+                raise pmErr(self.sts.value)
+            num = self.num.value
+            inames = [name.decode('utf-8') if name else None
+                      for name in self.inames[:num]]
+            return (self.view(self.icodes, 'I', num), inames,
+                    self.view(self.values, self.fmt, num),
+                    self.view(self.stss, 'i', num))
+
+
     class fetchgroup_event(object):
         """
         An internal class to receive value/status for an
@@ -2811,6 +2879,34 @@ class fetchgroup(object):
         self.items.append(vv) # keep registered pmAtomValue/etc. alive
         return vv
 
+    def extend_column(self, metric=None, mtype=None, scale=None, maxnum=100):
+        """Extend the fetchgroup with up to @maxnum instances of a metric,
+        like extend_indom, but with values stored in contiguous arrays
+        of a numeric type for bulk processing.  Infer type if necessary.
+        Convert scale/rate if appropriate/requested.
+        """
+        if metric is None or maxnum < 0:
+            raise pmErr(-errno.EINVAL)
+        if mtype is None:
+            # a special service to dynamically-typed python
+            pmids = self.ctx.pmLookupName(metric)
+            descs = self.ctx.pmLookupDescs(pmids)
+            mtype = descs[0].type
+        vv = fetchgroup.fetchgroup_column(mtype, maxnum)
+        sts = LIBPCP.pmExtendFetchGroup_column(self.pmfg,
+                      c_char_p(metric.encode('utf-8') if metric else None),
+                      c_char_p(scale.encode('utf-8') if scale else None),
+                      cast(pointer(vv.icodes), POINTER(c_int)),
+                      cast(pointer(vv.inames), POINTER(c_char_p)),
+                      cast(pointer(vv.values), c_void_p),
+                      c_int(mtype),
+                      cast(pointer(vv.stss), POINTER(c_int)),
+                      c_uint(maxnum), pointer(vv.num), pointer(vv.sts))
+        if sts < 0:
+            raise pmErr(sts)
+        self.items.append(vv) # keep registered arrays alive
+        return vv
+
     def extend_timestamp(self):
         """Extend the fetchgroup with a timestamp query. """
         v = fetchgroup.fetchgroup_timestamp(self.ctx)
@@ -801,6 +801,8 @@ class pmConfig(object):
                             del self.insts[i][0][v]
                             del self.insts[i][1][v]
                     self.util.metrics[metric][5] = self.pmfg_items_to_indom(items)
+                elif mtype in pmapi.fetchgroup.fetchgroup_column.column_types:
+                    self.util.metrics[metric][5] = self.util.pmfg.extend_column(metric, mtype, scale, max_insts)
                 else:
                     self.util.metrics[metric][5] = self.util.pmfg.extend_indom(metric, mtype, scale, max_insts)
 
@@ -973,6 +975,30 @@ class pmConfig(object):
         """ Deprecated, use get_ranked_results() instead """
         return self.get_ranked_results(valid_only)
 
+    def get_column_results(self, metric, predicates, early_live_filter):
+        """ Get filtered results of a metric from a fetchgroup column """
+        results = []
+        icodes, inames, values, stss = self.util.metrics[metric][5]()
+        limit = self.util.metrics[metric][7]
+        if metric in predicates:
+            limit = None
+        for inst, name, value, sts in zip(icodes, inames, values, stss):
+            # Ignore failed values and transient instances
+            if sts < 0:
+                continue
+            if inst != pmapi.c_api.PM_IN_NULL and not name:
+                continue
+            if early_live_filter and inst != pmapi.c_api.PM_IN_NULL and \
+               not self.filter_instance(metric, name):
+                continue
+            if limit:
+                if limit > 0 and value < limit:
+                    continue
+                elif limit < 0 and value > abs(limit):
+                    continue
+            results.append((inst, name, value))
+        return results
+
     def get_ranked_results(self, valid_only=False):
         """ Get filtered and ranked results """
         results = OrderedDict()
@@ -983,6 +1009,14 @@ class pmConfig(object):
         early_live_filter = self.do_live_filtering() and not self.do_invert_filtering()
         for i, metric in enumerate(self.util.metrics):
             results[metric] = []
+            if isinstance(self.util.metrics[metric][5], pmapi.fetchgroup.fetchgroup_column):
+                try:
+                    results[metric] = self.get_column_results(metric, predicates, early_live_filter)
+                except Exception:
+                    pass
+                if valid_only and not results[metric]:
+                    del results[metric]
+                continue
             try:
                 for inst, name, val in self.util.metrics[metric][5]():
                     try:
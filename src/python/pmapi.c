@@ -1,5 +1,5 @@
 /*
- * Copyright (C) 2012-2018 Red Hat.
+ * Copyright (C) 2012-2019 Red Hat.
  * Copyright (C) 2009-2012 Michael T. Werner
  *
  * This file is part of the "pcp" module, the python interfaces for the
@@ -1536,6 +1536,7 @@ MOD_INIT(cpmapi)
     dict_add(dict, "PM_CTXFLAG_SECURE", PM_CTXFLAG_SECURE);
     dict_add(dict, "PM_CTXFLAG_COMPRESS", PM_CTXFLAG_COMPRESS);
     dict_add(dict, "PM_CTXFLAG_RELAXED", PM_CTXFLAG_RELAXED);
+    dict_add(dict, "PM_CTXFLAG_SHARED", PM_CTXFLAG_SHARED);
 
     dict_add(dict, "PM_VAL_HDR_SIZE", PM_VAL_HDR_SIZE);
     dict_add(dict, "PM_VAL_VLEN_MAX", PM_VAL_VLEN_MAX);